@@ -0,0 +1,135 @@
+/*
+libdmtx - Data Matrix Encoding/Decoding Library
+
+Copyright (C) 2008, 2009 Mike Laughton
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+Contact: mike@dragonflylogic.com
+*/
+
+/**
+ * @file dmtxalloc.c
+ * @brief Count heap allocations made by the program and libdmtx
+ *
+ * With glibc, malloc() and friends are defined here and forward to the
+ * C library, so calls made from inside libdmtx are counted too. Other
+ * C libraries leave the allocator alone and AllocCounting() says so.
+ */
+
+#include "../config.h"
+#include "dmtxalloc.h"
+
+static AllocCounts allocCounts;
+
+#ifdef HAVE___LIBC_MALLOC
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+/* Any thread may allocate, so counts are updated atomically. glibc is
+ * only built by compilers that provide these builtins. */
+#define ALLOC_COUNT_ADD(field, n) ((void)__sync_fetch_and_add(&(field), (long)(n)))
+
+/**
+ * @brief  Count and forward a malloc() call
+ * @param  size bytes requested
+ * @return Allocated memory, or NULL
+ */
+void *
+malloc(size_t size)
+{
+   ALLOC_COUNT_ADD(allocCounts.calls, 1);
+   ALLOC_COUNT_ADD(allocCounts.bytes, size);
+
+   return __libc_malloc(size);
+}
+
+/**
+ * @brief  Count and forward a calloc() call
+ * @param  count number of elements
+ * @param  size bytes per element
+ * @return Allocated zeroed memory, or NULL
+ */
+void *
+calloc(size_t count, size_t size)
+{
+   ALLOC_COUNT_ADD(allocCounts.calls, 1);
+   ALLOC_COUNT_ADD(allocCounts.bytes, count * size);
+
+   return __libc_calloc(count, size);
+}
+
+/**
+ * @brief  Count and forward a realloc() call
+ * @param  ptr memory to resize, or NULL
+ * @param  size new size in bytes
+ * @return Resized memory, or NULL
+ */
+void *
+realloc(void *ptr, size_t size)
+{
+   ALLOC_COUNT_ADD(allocCounts.calls, 1);
+   ALLOC_COUNT_ADD(allocCounts.bytes, size);
+
+   return __libc_realloc(ptr, size);
+}
+
+/**
+ * @brief  Count and forward a free() call
+ * @param  ptr memory to release, or NULL
+ * @return void
+ */
+void
+free(void *ptr)
+{
+   if(ptr != NULL)
+      ALLOC_COUNT_ADD(allocCounts.frees, 1);
+
+   __libc_free(ptr);
+}
+#endif
+
+/**
+ * @brief  Tell whether allocations are being counted
+ * @return 1 if they are, 0 if counts stay at zero
+ */
+extern int
+AllocCounting(void)
+{
+#ifdef HAVE___LIBC_MALLOC
+   return 1;
+#else
+   return 0;
+#endif
+}
+
+/**
+ * @brief  Read the allocation counts so far
+ * @param  counts counts to fill
+ * @return void
+ */
+extern void
+AllocGetCounts(AllocCounts *counts)
+{
+#ifdef HAVE___LIBC_MALLOC
+   counts->calls = __sync_fetch_and_add(&allocCounts.calls, 0);
+   counts->bytes = __sync_fetch_and_add(&allocCounts.bytes, 0);
+   counts->frees = __sync_fetch_and_add(&allocCounts.frees, 0);
+#else
+   *counts = allocCounts;
+#endif
+}
@@ -0,0 +1,1721 @@
+/*
+libdmtx - Data Matrix Encoding/Decoding Library
+
+Copyright (C) 2008, 2009 Mike Laughton
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+Contact: mike@dragonflylogic.com
+*/
+
+/**
+ * @file dmtxbench.c
+ * @brief Benchmark harness and regression gate for dmtxread
+ *
+ * Runs dmtxread over a dmtxgen corpus once per profile of options,
+ * several times each, and measures throughput, time_ms percentiles,
+ * peak memory and recall against the corpus ground truth. Runs are
+ * recorded in a baseline file; later runs are compared with it and
+ * fail when a profile got worse by more than a threshold, and by more
+ * than the spread between repeated runs can explain.
+ */
+
+#include "dmtxbench.h"
+
+char *programName;
+
+static const MetricInfo metricInfo[MetricCount] = {
+      { "images_per_s",   GateThroughput },
+      { "barcodes_per_s", GateThroughput },
+      { "time_p50_ms",    GateLatency },
+      { "time_p90_ms",    GateLatency },
+      { "time_p99_ms",    GateLatency },
+      { "first_p50_ms",   GateLatency },
+      { "first_p99_ms",   GateLatency },
+      { "last_p50_ms",    GateLatency },
+      { "last_p99_ms",    GateLatency },
+      { "peak_rss_mib",   GateMemory },
+      { "recall",         GateAccuracy },
+      { "precision",      GateAccuracy }
+};
+
+/* Values tried by --tune, the dmtxread default first */
+static const TuneAxis tuneAxes[TUNE_AXIS_COUNT] = {
+      { "-S", { 1, 2, 3, 4 },          4 },  /* --shrink */
+      { "-g", { 2, 1, 4, 8, 16 },      5 },  /* --gap */
+      { "-t", { 5, 2, 10, 20, 40 },    5 },  /* --threshold */
+      { "-q", { 0, 10, 20, 30, 50 },   5 },  /* --square-deviation */
+      { "-e", { 0, 10, 20, 40 },       4 },  /* --minimum-edge */
+      { "-E", { 0, 100, 200, 400 },    4 }   /* --maximum-edge */
+};
+
+/**
+ * @brief  Main function for the dmtxbench benchmark harness.
+ * @param  argc count of arguments passed from command line
+ * @param  argv list of argument passed strings from command line
+ * @return Numeric exit code
+ */
+int
+main(int argc, char *argv[])
+{
+   int i, err;
+   DmtxBoolean record, regressed;
+   UserOptions opt;
+   BenchContext ctx;
+
+   SetOptionDefaults(&opt);
+
+   err = HandleArgs(&opt, &argc, &argv);
+   if(err != DmtxPass)
+      ShowUsage(EX_USAGE);
+
+   memset(&ctx, 0x00, sizeof(BenchContext));
+   ctx.opt = &opt;
+
+   ListImages(&ctx);
+   ReadTruth(&ctx);
+
+   if(opt.tune == DmtxTrue) {
+      RunTune(&ctx);
+      exit(EX_OK);
+   }
+
+   ReadProfiles(&ctx);
+
+   /* A missing baseline is recorded by this run */
+   record = (opt.baselinePath != NULL && (opt.update == DmtxTrue ||
+         access(opt.baselinePath, F_OK) != 0)) ? DmtxTrue : DmtxFalse;
+   if(opt.baselinePath != NULL && record == DmtxFalse)
+      ReadBaseline(&ctx);
+
+   regressed = DmtxFalse;
+   for(i = 0; i < ctx.profileCount; i++) {
+      RunProfile(&ctx, &ctx.profiles[i]);
+      if(ReportProfile(&ctx, &ctx.profiles[i]) == DmtxTrue)
+         regressed = DmtxTrue;
+   }
+
+   if(record == DmtxTrue) {
+      WriteBaseline(&ctx);
+      fprintf(stdout, _("Baseline written to \"%s\"\n"), opt.baselinePath);
+   }
+
+   exit((regressed == DmtxTrue) ? EX_REGRESSED : EX_OK);
+}
+
+/**
+ * @brief  Set default option values
+ * @param  opt runtime options
+ * @return void
+ */
+static void
+SetOptionDefaults(UserOptions *opt)
+{
+   memset(opt, 0x00, sizeof(UserOptions));
+
+   opt->dmtxread = "dmtxread";
+   opt->profilesPath = NULL;
+   opt->baselinePath = NULL;
+   opt->update = DmtxFalse;
+   opt->repeat = 5;
+   opt->warmup = 1;
+   opt->alpha = 0.05;
+   opt->threshold[GateThroughput] = 0.05;
+   opt->threshold[GateLatency] = 0.10;
+   opt->threshold[GateMemory] = 0.10;
+   opt->threshold[GateAccuracy] = 0.002;
+   opt->verbose = DmtxFalse;
+   opt->tune = DmtxFalse;
+   opt->budget = 64;
+   opt->outputPath = NULL;
+   opt->corpus = NULL;
+}
+
+/**
+ * @brief  Set and validate user-requested options from command line arguments.
+ * @param  opt runtime options from defaults or command line
+ * @param  argcp pointer to argument count
+ * @param  argvp pointer to argument list
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+HandleArgs(UserOptions *opt, int *argcp, char **argvp[])
+{
+   int err;
+   int optchr;
+   int longIndex;
+   char *ptr;
+
+   struct option longOptions[] = {
+         {"dmtxread",         required_argument, NULL, 'r'},
+         {"profiles",         required_argument, NULL, 'p'},
+         {"baseline",         required_argument, NULL, 'b'},
+         {"update",           no_argument,       NULL, 'u'},
+         {"repeat",           required_argument, NULL, 'n'},
+         {"warmup",           required_argument, NULL, 'w'},
+         {"alpha",            required_argument, NULL, OptAlpha},
+         {"max-slowdown",     required_argument, NULL, OptMaxSlowdown},
+         {"max-latency",      required_argument, NULL, OptMaxLatency},
+         {"max-memory",       required_argument, NULL, OptMaxMemory},
+         {"max-recall-drop",  required_argument, NULL, OptMaxRecallDrop},
+         {"tune",             no_argument,       NULL, OptTune},
+         {"budget",           required_argument, NULL, OptBudget},
+         {"output",           required_argument, NULL, 'o'},
+         {"verbose",          no_argument,       NULL, 'v'},
+         {"version",          no_argument,       NULL, 'V'},
+         {"help",             no_argument,       NULL,  0 },
+         {0, 0, 0, 0}
+   };
+
+   programName = Basename((*argvp)[0]);
+
+   for(;;) {
+      optchr = getopt_long(*argcp, *argvp, "r:p:b:un:w:o:vV", longOptions, &longIndex);
+      if(optchr == -1)
+         break;
+
+      switch(optchr) {
+         case 0: /* --help */
+            ShowUsage(EX_OK);
+            break;
+         case 'r':
+            opt->dmtxread = optarg;
+            break;
+         case 'p':
+            opt->profilesPath = optarg;
+            break;
+         case 'b':
+            opt->baselinePath = optarg;
+            break;
+         case 'u':
+            opt->update = DmtxTrue;
+            break;
+         case 'n':
+            err = StringToInt(&(opt->repeat), optarg, &ptr);
+            if(err != DmtxPass || opt->repeat < 1 || opt->repeat > BENCH_REPEAT_MAX ||
+                  *ptr != '\0')
+               FatalError(EX_USAGE, _("Invalid repeat count specified \"%s\""), optarg);
+            break;
+         case 'w':
+            err = StringToInt(&(opt->warmup), optarg, &ptr);
+            if(err != DmtxPass || opt->warmup < 0 || *ptr != '\0')
+               FatalError(EX_USAGE, _("Invalid warmup count specified \"%s\""), optarg);
+            break;
+         case OptAlpha:
+            opt->alpha = strtod(optarg, &ptr);
+            if(ptr == optarg || *ptr != '\0' || opt->alpha <= 0.0 || opt->alpha > 1.0)
+               FatalError(EX_USAGE, _("Invalid significance level specified \"%s\""), optarg);
+            break;
+         case OptMaxSlowdown:
+            if(ParsePercent(&(opt->threshold[GateThroughput]), optarg) != DmtxPass)
+               FatalError(EX_USAGE, _("Invalid slowdown specified \"%s\""), optarg);
+            break;
+         case OptMaxLatency:
+            if(ParsePercent(&(opt->threshold[GateLatency]), optarg) != DmtxPass)
+               FatalError(EX_USAGE, _("Invalid latency growth specified \"%s\""), optarg);
+            break;
+         case OptMaxMemory:
+            if(ParsePercent(&(opt->threshold[GateMemory]), optarg) != DmtxPass)
+               FatalError(EX_USAGE, _("Invalid memory growth specified \"%s\""), optarg);
+            break;
+         case OptMaxRecallDrop:
+            opt->threshold[GateAccuracy] = strtod(optarg, &ptr);
+            if(ptr == optarg || *ptr != '\0' || opt->threshold[GateAccuracy] < 0.0 ||
+                  opt->threshold[GateAccuracy] > 1.0)
+               FatalError(EX_USAGE, _("Invalid recall drop specified \"%s\""), optarg);
+            break;
+         case OptTune:
+            opt->tune = DmtxTrue;
+            break;
+         case OptBudget:
+            err = StringToInt(&(opt->budget), optarg, &ptr);
+            if(err != DmtxPass || opt->budget < 1 || opt->budget > 10000 || *ptr != '\0')
+               FatalError(EX_USAGE, _("Invalid budget specified \"%s\""), optarg);
+            break;
+         case 'o':
+            opt->outputPath = optarg;
+            break;
+         case 'v':
+            opt->verbose = DmtxTrue;
+            break;
+         case 'V':
+            fprintf(stderr, "%s version %s\n", programName, DmtxVersion);
+            fprintf(stderr, "libdmtx version %s\n", dmtxVersion());
+            exit(0);
+            break;
+         default:
+            return DmtxFail;
+            break;
+      }
+   }
+
+   /* Exactly one corpus directory */
+   if(optind + 1 != *argcp)
+      return DmtxFail;
+
+   opt->corpus = (*argvp)[optind];
+
+   if(opt->tune == DmtxTrue && (opt->profilesPath != NULL || opt->baselinePath != NULL))
+      FatalError(EX_USAGE, _("--tune cannot be combined with --profiles or --baseline"));
+   if(opt->tune == DmtxFalse && opt->outputPath != NULL)
+      FatalError(EX_USAGE, _("--output requires --tune"));
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Parse a percentage into a fraction
+ * @param  value fraction to fill
+ * @param  s percentage, with or without a trailing '%'
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+ParsePercent(double *value, char *s)
+{
+   char *ptr;
+
+   *value = strtod(s, &ptr) / 100.0;
+   if(ptr == s || *value < 0.0)
+      return DmtxFail;
+
+   if(*ptr == '%')
+      ptr++;
+
+   return (*ptr == '\0') ? DmtxPass : DmtxFail;
+}
+
+/**
+ * @brief  Display program usage and exit with received status.
+ * @param  status error code returned to OS
+ * @return void
+ */
+static void
+ShowUsage(int status)
+{
+   if(status != 0) {
+      fprintf(stderr, _("Usage: %s [OPTION]... CORPUS\n"), programName);
+      fprintf(stderr, _("Try `%s --help' for more information.\n"), programName);
+   }
+   else {
+      fprintf(stderr, _("Usage: %s [OPTION]... CORPUS\n"), programName);
+      fprintf(stderr, _("\
+Run dmtxread over the images of CORPUS, a directory made by dmtxgen, once per\n\
+profile of dmtxread options, and measure throughput, time_ms percentiles,\n\
+peak memory and recall against CORPUS/truth.jsonl. With --baseline, compare\n\
+with the runs recorded there and exit with status 1 if a profile regressed.\n\
+\n\
+With --tune, search dmtxread options for the Pareto front of images per\n\
+second against recall instead, and recommend the fastest option set that\n\
+loses no more than --max-recall-drop of the best recall.\n\
+\n\
+Example: %s -p profiles -b baseline.jsonl corpus\n\
+\n\
+OPTIONS:\n"), programName);
+      fprintf(stderr, _("\
+  -r, --dmtxread=PATH         dmtxread to run (default: from PATH)\n\
+  -p, --profiles=FILE         profiles, one per line: a name followed by\n\
+                              dmtxread options (default: no options)\n\
+  -b, --baseline=FILE         compare with FILE, or record it if it is missing\n\
+  -u, --update                record --baseline from this run\n\
+  -n, --repeat=N              measured runs per profile (default 5)\n\
+  -w, --warmup=N              unmeasured runs first (default 1)\n"));
+      fprintf(stderr, _("\
+A metric regresses when its median is worse than the baseline median by more\n\
+than its threshold, and the runs differ with one-sided significance --alpha\n\
+(default 0.05) by an exact Mann-Whitney test:\n\
+      --max-slowdown=PCT      images and barcodes per second (default 5%%)\n\
+      --max-latency=PCT       time_ms percentiles (default 10%%)\n\
+      --max-memory=PCT        peak resident memory (default 10%%)\n\
+      --max-recall-drop=N     recall and precision (default 0.002)\n"));
+      fprintf(stderr, _("\
+      --tune                  search --shrink, --gap, --threshold,\n\
+                              --square-deviation and edge lengths\n\
+      --budget=N              option sets tried by --tune (default 64)\n\
+  -o, --output=FILE           write the front found by --tune as a\n\
+                              profiles file\n"));
+      fprintf(stderr, _("\
+  -v, --verbose               show dmtxread errors and every run\n\
+  -V, --version               print version information\n\
+      --help                  display this help and exit\n"));
+      fprintf(stderr, _("\nReport bugs to <mike@dragonflylogic.com>.\n"));
+   }
+
+   exit(status);
+}
+
+/**
+ * @brief  Read the profiles file, or make the single default profile
+ * @param  ctx benchmark context
+ * @return void
+ */
+static void
+ReadProfiles(BenchContext *ctx)
+{
+   int i, lineNumber;
+   char line[BENCH_LINE_MAX];
+   char *ptr;
+   FILE *fp;
+
+   ctx->profiles = (BenchProfile *)calloc(BENCH_PROFILE_MAX, sizeof(BenchProfile));
+   if(ctx->profiles == NULL)
+      FatalError(EX_OSERR, _("Out of memory"));
+
+   if(ctx->opt->profilesPath == NULL) {
+      strcpy(line, "default");
+      SplitProfile(&ctx->profiles[0], line);
+      ctx->profileCount = 1;
+      return;
+   }
+
+   fp = fopen(ctx->opt->profilesPath, "rb");
+   if(fp == NULL)
+      FatalError(EX_IOERR, _("Unable to open \"%s\""), ctx->opt->profilesPath);
+
+   for(lineNumber = 1; fgets(line, sizeof(line), fp) != NULL; lineNumber++) {
+      ptr = line + strspn(line, " \t");
+      if(*ptr == '#' || *ptr == '\0' || strspn(ptr, " \t\r\n") == strlen(ptr))
+         continue;
+
+      if(ctx->profileCount == BENCH_PROFILE_MAX ||
+            SplitProfile(&ctx->profiles[ctx->profileCount], ptr) != DmtxPass)
+         FatalError(EX_DATAERR, _("Invalid profile in \"%s\" at line %d"),
+               ctx->opt->profilesPath, lineNumber);
+
+      for(i = 0; i < ctx->profileCount; i++) {
+         if(strcmp(ctx->profiles[i].name, ctx->profiles[ctx->profileCount].name) == 0)
+            FatalError(EX_DATAERR, _("Profile \"%s\" listed twice in \"%s\""),
+                  ctx->profiles[i].name, ctx->opt->profilesPath);
+      }
+      ctx->profileCount++;
+   }
+
+   fclose(fp);
+
+   if(ctx->profileCount == 0)
+      FatalError(EX_DATAERR, _("No profiles in \"%s\""), ctx->opt->profilesPath);
+}
+
+/**
+ * @brief  Split a profiles line into a name and dmtxread options
+ * @param  profile profile to fill
+ * @param  line text of the line, which is modified
+ * @return DmtxPass | DmtxFail (too many options)
+ */
+static DmtxPassFail
+SplitProfile(BenchProfile *profile, char *line)
+{
+   char *ptr;
+
+   line[strcspn(line, "\r\n")] = '\0';
+
+   ptr = line + strcspn(line, " \t");
+   ptr += strspn(ptr, " \t");
+   profile->options = strdup(ptr);
+   if(profile->options == NULL)
+      FatalError(EX_OSERR, _("Out of memory"));
+
+   profile->name = strdup(strtok(line, " \t"));
+   if(profile->name == NULL)
+      FatalError(EX_OSERR, _("Out of memory"));
+
+   /* Options are split at blanks, without quoting */
+   profile->argc = 0;
+   while((ptr = strtok(NULL, " \t")) != NULL) {
+      if(profile->argc == BENCH_OPTION_MAX)
+         return DmtxFail;
+      profile->argv[profile->argc] = strdup(ptr);
+      if(profile->argv[profile->argc] == NULL)
+         FatalError(EX_OSERR, _("Out of memory"));
+      profile->argc++;
+   }
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  List the images of the corpus in name order
+ * @param  ctx benchmark context
+ * @return void
+ */
+static void
+ListImages(BenchContext *ctx)
+{
+   int allocated;
+   char *path;
+   DIR *dir;
+   struct dirent *entry;
+   struct stat info;
+
+   dir = opendir(ctx->opt->corpus);
+   if(dir == NULL)
+      FatalError(EX_IOERR, _("Unable to open corpus \"%s\""), ctx->opt->corpus);
+
+   allocated = 0;
+   while((entry = readdir(dir)) != NULL) {
+      if(entry->d_name[0] == '.' || strcmp(entry->d_name, "truth.jsonl") == 0 ||
+            strcmp(entry->d_name, "manifest.txt") == 0)
+         continue;
+
+      path = (char *)malloc(strlen(ctx->opt->corpus) + strlen(entry->d_name) + 2);
+      if(path == NULL)
+         FatalError(EX_OSERR, _("Out of memory"));
+      sprintf(path, "%s/%s", ctx->opt->corpus, entry->d_name);
+
+      if(stat(path, &info) != 0 || !S_ISREG(info.st_mode)) {
+         free(path);
+         continue;
+      }
+
+      if(ctx->imageCount == allocated) {
+         allocated = (allocated == 0) ? 256 : allocated * 2;
+         ctx->images = (char **)realloc(ctx->images, allocated * sizeof(char *));
+         if(ctx->images == NULL)
+            FatalError(EX_OSERR, _("Out of memory"));
+      }
+      ctx->images[ctx->imageCount++] = path;
+   }
+
+   closedir(dir);
+
+   if(ctx->imageCount == 0)
+      FatalError(EX_DATAERR, _("No images in corpus \"%s\""), ctx->opt->corpus);
+
+   qsort(ctx->images, ctx->imageCount, sizeof(char *), CompareNames);
+}
+
+/**
+ * @brief  Order image paths by name
+ * @param  a pointer to first path
+ * @param  b pointer to second path
+ * @return Comparison result for qsort()
+ */
+static int
+CompareNames(const void *a, const void *b)
+{
+   return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/**
+ * @brief  Read the expected barcodes of the corpus
+ * @param  ctx benchmark context
+ * @return void
+ */
+static void
+ReadTruth(BenchContext *ctx)
+{
+   int i, result, allocated;
+   char *path;
+   FILE *fp;
+   ResultInput *input;
+   ResultRecord rec;
+   TruthEntry *entry;
+
+   path = (char *)malloc(strlen(ctx->opt->corpus) + 16);
+   if(path == NULL)
+      FatalError(EX_OSERR, _("Out of memory"));
+   sprintf(path, "%s/truth.jsonl", ctx->opt->corpus);
+
+   fp = fopen(path, "rb");
+   if(fp == NULL)
+      FatalError(EX_IOERR, _("Unable to open ground truth \"%s\""), path);
+
+   input = InputOpen(fp);
+   if(input == NULL)
+      FatalError(EX_DATAERR, _("\"%s\" is not dmtxread output"), path);
+
+   allocated = 0;
+   while((result = InputRead(input, &rec)) == 1) {
+      if(ctx->truthCount == allocated) {
+         allocated = (allocated == 0) ? 256 : allocated * 2;
+         ctx->truth = (TruthEntry *)realloc(ctx->truth, allocated * sizeof(TruthEntry));
+         if(ctx->truth == NULL)
+            FatalError(EX_OSERR, _("Out of memory"));
+      }
+      entry = &ctx->truth[ctx->truthCount++];
+      entry->key = MakeKey(&rec, &entry->length);
+      entry->found = DmtxFalse;
+
+      for(i = rec.fileLength; i > 0 && rec.file[i - 1] != '/'; i--)
+         ;
+      entry->image = FindImage(ctx, rec.file + i, rec.fileLength - i);
+   }
+
+   if(result == -1)
+      FatalError(EX_DATAERR, _("Malformed ground truth in \"%s\" at line %ld"), path,
+            InputGetLine(input));
+
+   InputClose(&input);
+   fclose(fp);
+   free(path);
+
+   qsort(ctx->truth, ctx->truthCount, sizeof(TruthEntry), CompareTruth);
+}
+
+/**
+ * @brief  Key matching a decoded barcode with the ground truth
+ *
+ * Images are matched by file name without the directory, so the corpus
+ * may be moved or named differently than when it was made.
+ *
+ * @param  rec barcode record
+ * @param  length pointer to key length
+ * @return Allocated key: file name, archive member, page and message
+ */
+static char *
+MakeKey(const ResultRecord *rec, int *length)
+{
+   int i, nameLength;
+   const char *name;
+   char *key;
+   char page[24];
+
+   name = rec->file;
+   nameLength = rec->fileLength;
+   for(i = 0; i < rec->fileLength; i++) {
+      if(rec->file[i] == '/') {
+         name = rec->file + i + 1;
+         nameLength = rec->fileLength - i - 1;
+      }
+   }
+
+   sprintf(page, "\t%ld\t", rec->pageIndex + 1);
+
+   *length = nameLength + ((rec->member != NULL) ? rec->memberLength + 1 : 0) +
+         strlen(page) + (int)rec->messageLength;
+   key = (char *)malloc(*length);
+   if(key == NULL)
+      FatalError(EX_OSERR, _("Out of memory"));
+
+   i = 0;
+   memcpy(key, name, nameLength);
+   i += nameLength;
+   if(rec->member != NULL) {
+      key[i++] = ':';
+      memcpy(key + i, rec->member, rec->memberLength);
+      i += rec->memberLength;
+   }
+   memcpy(key + i, page, strlen(page));
+   i += strlen(page);
+   memcpy(key + i, rec->message, rec->messageLength);
+
+   return key;
+}
+
+/**
+ * @brief  Order ground truth entries by key
+ * @param  a pointer to first entry
+ * @param  b pointer to second entry
+ * @return Comparison result for qsort() and bsearch()
+ */
+static int
+CompareTruth(const void *a, const void *b)
+{
+   int cmp;
+   const TruthEntry *ta = (const TruthEntry *)a;
+   const TruthEntry *tb = (const TruthEntry *)b;
+
+   cmp = memcmp(ta->key, tb->key, (ta->length < tb->length) ? ta->length : tb->length);
+   if(cmp != 0)
+      return cmp;
+
+   return ta->length - tb->length;
+}
+
+/**
+ * @brief  Find an image of the corpus by file name
+ * @param  ctx benchmark context
+ * @param  name file name without directory
+ * @param  length length of name
+ * @return Index in ctx->images, or -1
+ */
+static int
+FindImage(BenchContext *ctx, const char *name, int length)
+{
+   int low, high, middle, cmp;
+   const char *base;
+
+   low = 0;
+   high = ctx->imageCount - 1;
+
+   while(low <= high) {
+      middle = (low + high) / 2;
+      base = ctx->images[middle] + strlen(ctx->opt->corpus) + 1;
+      cmp = strncmp(name, base, length);
+      if(cmp == 0 && base[length] != '\0')
+         cmp = -1;
+
+      if(cmp == 0)
+         return middle;
+      else if(cmp < 0)
+         high = middle - 1;
+      else
+         low = middle + 1;
+   }
+
+   return -1;
+}
+
+/**
+ * @brief  Run dmtxread for a profile: warmup runs, then measured runs
+ * @param  ctx benchmark context
+ * @param  profile profile to measure
+ * @return void
+ */
+static void
+RunProfile(BenchContext *ctx, BenchProfile *profile)
+{
+   int i, j;
+   double metrics[MetricCount];
+
+   for(i = 0; i < ctx->opt->warmup; i++)
+      RunOnce(ctx, profile, 1, metrics);
+
+   for(i = 0; i < ctx->opt->repeat; i++) {
+      RunOnce(ctx, profile, 1, metrics);
+      for(j = 0; j < MetricCount; j++)
+         profile->samples[j][i] = metrics[j];
+      profile->sampleCount = i + 1;
+
+      if(ctx->opt->verbose == DmtxTrue)
+         fprintf(stderr, _("%s: run %d: %0.2f images/s, recall %0.4f, %0.1f MiB\n"),
+               profile->name, i + 1, metrics[MetricImagesPerSec], metrics[MetricRecall],
+               metrics[MetricPeakRss]);
+   }
+}
+
+/**
+ * @brief  Run dmtxread once over the corpus and measure it
+ * @param  ctx benchmark context
+ * @param  profile profile giving dmtxread options
+ * @param  stride run over every stride-th image only
+ * @param  metrics measurements of the run
+ * @return void
+ */
+static void
+RunOnce(BenchContext *ctx, BenchProfile *profile, int stride, double *metrics)
+{
+   int i, argc, fd, status;
+   double seconds, peak;
+   char **argv;
+   pid_t pid;
+   DmtxTime start, end;
+   FILE *fp;
+#if defined(HAVE_SYS_RESOURCE_H) && defined(HAVE_WAIT4)
+   struct rusage usage;
+#endif
+
+   argv = (char **)malloc((profile->argc + ctx->imageCount + 3) * sizeof(char *));
+   if(argv == NULL)
+      FatalError(EX_OSERR, _("Out of memory"));
+
+   argc = 0;
+   argv[argc++] = ctx->opt->dmtxread;
+   argv[argc++] = "--output-format=jsonl";
+   for(i = 0; i < profile->argc; i++)
+      argv[argc++] = profile->argv[i];
+   for(i = 0; i < ctx->imageCount; i += stride)
+      argv[argc++] = ctx->images[i];
+   argv[argc] = NULL;
+
+   fp = OpenTempFile("dmtxbench");
+   if(fp == NULL)
+      FatalError(EX_CANTCREAT, _("Unable to create temporary file: %s"), strerror(errno));
+
+   start = dmtxTimeNow();
+
+   pid = fork();
+   if(pid == -1)
+      FatalError(EX_OSERR, _("Unable to start dmtxread"));
+
+   if(pid == 0) {
+      dup2(fileno(fp), STDOUT_FILENO);
+      if(ctx->opt->verbose == DmtxFalse) {
+         fd = open("/dev/null", O_WRONLY);
+         if(fd != -1)
+            dup2(fd, STDERR_FILENO);
+      }
+      execvp(argv[0], argv);
+      _exit(127);
+   }
+
+   peak = 0.0;
+#if defined(HAVE_SYS_RESOURCE_H) && defined(HAVE_WAIT4)
+   while(wait4(pid, &status, 0, &usage) == -1) {
+      if(errno != EINTR)
+         FatalError(EX_OSERR, _("Lost track of dmtxread"));
+   }
+
+   /* Linux and the BSDs report kilobytes, Darwin reports bytes */
+#ifdef __APPLE__
+   peak = (double)usage.ru_maxrss / (1024.0 * 1024.0);
+#else
+   peak = (double)usage.ru_maxrss / 1024.0;
+#endif
+#else
+   while(waitpid(pid, &status, 0) == -1) {
+      if(errno != EINTR)
+         FatalError(EX_OSERR, _("Lost track of dmtxread"));
+   }
+#endif
+
+   end = dmtxTimeNow();
+   seconds = (double)(end.sec - start.sec) + ((double)end.usec - (double)start.usec) / 1e6;
+
+   /* No barcode (1) and a missed deadline are results, not failures */
+   if(WIFEXITED(status) && WEXITSTATUS(status) == 127)
+      FatalError(EX_UNAVAILABLE, _("Unable to run \"%s\""), ctx->opt->dmtxread);
+   if(!WIFEXITED(status) || (WEXITSTATUS(status) != EX_OK && WEXITSTATUS(status) != 1 &&
+         WEXITSTATUS(status) != EX_TEMPFAIL))
+      FatalError(EX_SOFTWARE, _("dmtxread failed with profile \"%s\""), profile->name);
+
+   if(fseek(fp, 0, SEEK_SET) != 0)
+      FatalError(EX_IOERR, _("Unable to read dmtxread output"));
+
+   ScoreResults(ctx, fp, stride, (seconds > 0.0) ? seconds : 1e-6, metrics);
+   metrics[MetricPeakRss] = peak;
+
+   fclose(fp);
+   free(argv);
+}
+
+/**
+ * @brief  Measure one run from its dmtxread output
+ *
+ * dmtxread reports only the time from the start of each file to each
+ * barcode, so the time to the first and to the last barcode of each
+ * image stand in for locate and complete-page latency.
+ *
+ * @param  ctx benchmark context
+ * @param  fp dmtxread output, at the start
+ * @param  stride dmtxread was given every stride-th image only
+ * @param  seconds wall time of the run
+ * @param  metrics measurements to fill
+ * @return void
+ */
+static void
+ScoreResults(BenchContext *ctx, FILE *fp, int stride, double seconds, double *metrics)
+{
+   int i, result;
+   int count, allocated;
+   int imageCount, imageAllocated;
+   long expected, matched, imagePage, first, last;
+   char *image;
+   double *times, *firsts, *lasts;
+   ResultInput *input;
+   ResultRecord rec;
+   TruthEntry probe, *entry;
+
+   /* Barcodes expected in the images given; missing images count once */
+   expected = 0;
+   for(i = 0; i < ctx->truthCount; i++) {
+      ctx->truth[i].found = DmtxFalse;
+      if((ctx->truth[i].image == -1) ? (stride == 1) : (ctx->truth[i].image % stride == 0))
+         expected++;
+   }
+
+   count = allocated = 0;
+   imageCount = imageAllocated = 0;
+   times = firsts = lasts = NULL;
+   image = NULL;
+   imagePage = first = last = 0;
+   matched = 0;
+
+   input = NULL;
+   if(fgetc(fp) != EOF) {
+      rewind(fp);
+      input = InputOpen(fp);
+      if(input == NULL)
+         FatalError(EX_DATAERR, _("Unable to read dmtxread output"));
+   }
+
+   while(input != NULL && (result = InputRead(input, &rec)) != 0) {
+      if(result == -1)
+         FatalError(EX_DATAERR, _("Malformed dmtxread output at line %ld"),
+               InputGetLine(input));
+
+      probe.key = MakeKey(&rec, &probe.length);
+      entry = (TruthEntry *)bsearch(&probe, ctx->truth, ctx->truthCount,
+            sizeof(TruthEntry), CompareTruth);
+      if(entry != NULL && entry->found == DmtxFalse) {
+         entry->found = DmtxTrue;
+         matched++;
+      }
+      free(probe.key);
+
+      if(count == allocated) {
+         allocated = (allocated == 0) ? 1024 : allocated * 2;
+         times = (double *)realloc(times, allocated * sizeof(double));
+         if(times == NULL)
+            FatalError(EX_OSERR, _("Out of memory"));
+      }
+      times[count++] = (double)rec.elapsedMS;
+
+      /* Barcodes of one image arrive together */
+      if(image == NULL || imagePage != rec.pageIndex ||
+            strncmp(image, rec.file, rec.fileLength) != 0 || image[rec.fileLength] != '\0') {
+         if(imageCount + 1 >= imageAllocated) {
+            imageAllocated = (imageAllocated == 0) ? 256 : imageAllocated * 2;
+            firsts = (double *)realloc(firsts, imageAllocated * sizeof(double));
+            lasts = (double *)realloc(lasts, imageAllocated * sizeof(double));
+            if(firsts == NULL || lasts == NULL)
+               FatalError(EX_OSERR, _("Out of memory"));
+         }
+         if(image != NULL) {
+            firsts[imageCount] = (double)first;
+            lasts[imageCount] = (double)last;
+            imageCount++;
+            free(image);
+         }
+         image = (char *)malloc(rec.fileLength + 1);
+         if(image == NULL)
+            FatalError(EX_OSERR, _("Out of memory"));
+         memcpy(image, rec.file, rec.fileLength);
+         image[rec.fileLength] = '\0';
+         imagePage = rec.pageIndex;
+         first = last = rec.elapsedMS;
+      }
+      else {
+         first = (rec.elapsedMS < first) ? rec.elapsedMS : first;
+         last = (rec.elapsedMS > last) ? rec.elapsedMS : last;
+      }
+   }
+
+   if(image != NULL) {
+      firsts[imageCount] = (double)first;
+      lasts[imageCount] = (double)last;
+      imageCount++;
+      free(image);
+   }
+
+   if(input != NULL)
+      InputClose(&input);
+
+   metrics[MetricImagesPerSec] = ((ctx->imageCount + stride - 1) / stride) / seconds;
+   metrics[MetricBarcodesPerSec] = count / seconds;
+   metrics[MetricTimeP50] = Percentile(times, count, 50.0);
+   metrics[MetricTimeP90] = Percentile(times, count, 90.0);
+   metrics[MetricTimeP99] = Percentile(times, count, 99.0);
+   metrics[MetricFirstP50] = Percentile(firsts, imageCount, 50.0);
+   metrics[MetricFirstP99] = Percentile(firsts, imageCount, 99.0);
+   metrics[MetricLastP50] = Percentile(lasts, imageCount, 50.0);
+   metrics[MetricLastP99] = Percentile(lasts, imageCount, 99.0);
+   metrics[MetricRecall] = (expected > 0) ? (double)matched / expected : 1.0;
+   metrics[MetricPrecision] = (count > 0) ? (double)matched / count : 1.0;
+
+   free(times);
+   free(firsts);
+   free(lasts);
+}
+
+/**
+ * @brief  Nearest-rank percentile, sorting the values in place
+ * @param  values values
+ * @param  count number of values
+ * @param  percent percentile, 0 to 100
+ * @return Percentile, or 0 if there are no values
+ */
+static double
+Percentile(double *values, int count, double percent)
+{
+   int rank;
+
+   if(count == 0)
+      return 0.0;
+
+   qsort(values, count, sizeof(double), CompareDoubles);
+
+   rank = (int)ceil(percent / 100.0 * count) - 1;
+
+   return values[(rank < 0) ? 0 : rank];
+}
+
+/**
+ * @brief  Median of a set of runs
+ * @param  values values, left unchanged
+ * @param  count number of values (at most BENCH_REPEAT_MAX)
+ * @return Median
+ */
+static double
+Median(const double *values, int count)
+{
+   double sorted[BENCH_REPEAT_MAX];
+
+   if(count == 0)
+      return 0.0;
+
+   memcpy(sorted, values, count * sizeof(double));
+   qsort(sorted, count, sizeof(double), CompareDoubles);
+
+   return (count % 2 == 1) ? sorted[count / 2] :
+         (sorted[count / 2 - 1] + sorted[count / 2]) / 2.0;
+}
+
+/**
+ * @brief  Spread of a set of runs: median absolute deviation over median
+ * @param  values values
+ * @param  count number of values (at most BENCH_REPEAT_MAX)
+ * @return Relative spread, 0 if the median is 0
+ */
+static double
+Spread(const double *values, int count)
+{
+   int i;
+   double median;
+   double deviation[BENCH_REPEAT_MAX];
+
+   median = Median(values, count);
+   if(median == 0.0)
+      return 0.0;
+
+   for(i = 0; i < count; i++)
+      deviation[i] = fabs(values[i] - median);
+
+   return Median(deviation, count) / fabs(median);
+}
+
+/**
+ * @brief  Order doubles
+ * @param  a pointer to first value
+ * @param  b pointer to second value
+ * @return Comparison result for qsort()
+ */
+static int
+CompareDoubles(const void *a, const void *b)
+{
+   double da = *(const double *)a;
+   double db = *(const double *)b;
+
+   return (da < db) ? -1 : (da > db) ? 1 : 0;
+}
+
+/**
+ * @brief  Read the runs recorded in the baseline file
+ *
+ * The baseline holds one JSON object per line and profile, written by
+ * WriteBaseline(); only that layout is understood.
+ *
+ * @param  ctx benchmark context
+ * @return void
+ */
+static void
+ReadBaseline(BenchContext *ctx)
+{
+   int i, count;
+   int lineNumber;
+   double value;
+   char line[BENCH_LINE_MAX];
+   BenchProfile *profile;
+   FILE *fp;
+
+   fp = fopen(ctx->opt->baselinePath, "rb");
+   if(fp == NULL)
+      FatalError(EX_IOERR, _("Unable to open baseline \"%s\""), ctx->opt->baselinePath);
+
+   ctx->baseline = (BenchProfile *)calloc(BENCH_PROFILE_MAX, sizeof(BenchProfile));
+   if(ctx->baseline == NULL)
+      FatalError(EX_OSERR, _("Out of memory"));
+
+   for(lineNumber = 1; fgets(line, sizeof(line), fp) != NULL; lineNumber++) {
+      if(strspn(line, " \t\r\n") == strlen(line))
+         continue;
+
+      if(ctx->baselineCount == BENCH_PROFILE_MAX)
+         FatalError(EX_DATAERR, _("Too many profiles in baseline \"%s\""),
+               ctx->opt->baselinePath);
+
+      profile = &ctx->baseline[ctx->baselineCount];
+      profile->name = ReadString(line, "profile");
+      profile->options = ReadString(line, "options");
+      if(profile->name == NULL || profile->options == NULL)
+         FatalError(EX_DATAERR, _("Invalid baseline \"%s\" at line %d"),
+               ctx->opt->baselinePath, lineNumber);
+
+      /* Runs on another corpus are not comparable */
+      if(ReadSamples(line, "images", &value, &count) != DmtxPass || count != 1 ||
+            (int)value != ctx->imageCount ||
+            ReadSamples(line, "symbols", &value, &count) != DmtxPass || count != 1 ||
+            (int)value != ctx->truthCount)
+         FatalError(EX_DATAERR, _("Baseline \"%s\" was recorded on another corpus"),
+               ctx->opt->baselinePath);
+
+      for(i = 0; i < MetricCount; i++) {
+         if(ReadSamples(line, metricInfo[i].name, profile->samples[i],
+               &profile->sampleCount) != DmtxPass)
+            FatalError(EX_DATAERR, _("Invalid baseline \"%s\" at line %d"),
+                  ctx->opt->baselinePath, lineNumber);
+      }
+
+      ctx->baselineCount++;
+   }
+
+   fclose(fp);
+}
+
+/**
+ * @brief  Read a number or an array of numbers from a baseline line
+ * @param  line baseline line
+ * @param  name member name
+ * @param  samples values to fill (at most BENCH_REPEAT_MAX)
+ * @param  count pointer to number of values read
+ * @return DmtxPass | DmtxFail (missing or malformed)
+ */
+static DmtxPassFail
+ReadSamples(const char *line, const char *name, double *samples, int *count)
+{
+   char pattern[64];
+   const char *ptr;
+   char *end;
+
+   sprintf(pattern, "\"%.40s\":", name);
+   ptr = strstr(line, pattern);
+   if(ptr == NULL)
+      return DmtxFail;
+   ptr += strlen(pattern);
+
+   *count = 0;
+   if(*ptr != '[') {
+      samples[0] = strtod(ptr, &end);
+      *count = 1;
+      return (end == ptr) ? DmtxFail : DmtxPass;
+   }
+
+   for(ptr++; *ptr != ']'; ptr = end) {
+      if(*count == BENCH_REPEAT_MAX)
+         return DmtxFail;
+      samples[*count] = strtod(ptr, &end);
+      if(end == ptr)
+         return DmtxFail;
+      (*count)++;
+      if(*end == ',')
+         end++;
+   }
+
+   return (*count > 0) ? DmtxPass : DmtxFail;
+}
+
+/**
+ * @brief  Read a string member from a baseline line
+ * @param  line baseline line
+ * @param  name member name
+ * @return Allocated string, or NULL if missing
+ */
+static char *
+ReadString(const char *line, const char *name)
+{
+   int i;
+   char pattern[64];
+   const char *ptr;
+   char *str;
+
+   sprintf(pattern, "\"%.40s\":\"", name);
+   ptr = strstr(line, pattern);
+   if(ptr == NULL)
+      return NULL;
+   ptr += strlen(pattern);
+
+   str = (char *)malloc(strlen(ptr) + 1);
+   if(str == NULL)
+      FatalError(EX_OSERR, _("Out of memory"));
+
+   for(i = 0; *ptr != '"'; ptr++) {
+      if(*ptr == '\0') {
+         free(str);
+         return NULL;
+      }
+      if(*ptr == '\\' && ptr[1] != '\0')
+         ptr++;
+      str[i++] = *ptr;
+   }
+   str[i] = '\0';
+
+   return str;
+}
+
+/**
+ * @brief  Record this run's profiles as the baseline
+ * @param  ctx benchmark context
+ * @return void
+ */
+static void
+WriteBaseline(BenchContext *ctx)
+{
+   int i, j, k;
+   const char *ptr;
+   BenchProfile *profile;
+   FILE *fp;
+
+   fp = fopen(ctx->opt->baselinePath, "wb");
+   if(fp == NULL)
+      FatalError(EX_CANTCREAT, _("Unable to create baseline \"%s\""), ctx->opt->baselinePath);
+
+   for(i = 0; i < ctx->profileCount; i++) {
+      profile = &ctx->profiles[i];
+
+      fprintf(fp, "{\"profile\":\"%s\",\"options\":\"", profile->name);
+      for(ptr = profile->options; *ptr != '\0'; ptr++) {
+         if(*ptr == '"' || *ptr == '\\')
+            fputc('\\', fp);
+         fputc(*ptr, fp);
+      }
+      fprintf(fp, "\",\"images\":%d,\"symbols\":%d", ctx->imageCount, ctx->truthCount);
+
+      for(j = 0; j < MetricCount; j++) {
+         fprintf(fp, ",\"%s\":[", metricInfo[j].name);
+         for(k = 0; k < profile->sampleCount; k++)
+            fprintf(fp, "%s%0.6g", (k == 0) ? "" : ",", profile->samples[j][k]);
+         fputc(']', fp);
+      }
+      fputs("}\n", fp);
+   }
+
+   if(fclose(fp) != 0)
+      FatalError(EX_IOERR, _("Unable to write baseline \"%s\""), ctx->opt->baselinePath);
+}
+
+/**
+ * @brief  Find a profile of the baseline by name
+ * @param  ctx benchmark context
+ * @param  name profile name
+ * @return Baseline profile, or NULL
+ */
+static BenchProfile *
+FindBaseline(BenchContext *ctx, const char *name)
+{
+   int i;
+
+   for(i = 0; i < ctx->baselineCount; i++) {
+      if(strcmp(ctx->baseline[i].name, name) == 0)
+         return &ctx->baseline[i];
+   }
+
+   return NULL;
+}
+
+/**
+ * @brief  Print a profile's medians and compare them with the baseline
+ * @param  ctx benchmark context
+ * @param  profile measured profile
+ * @return DmtxTrue if any metric regressed
+ */
+static DmtxBoolean
+ReportProfile(BenchContext *ctx, BenchProfile *profile)
+{
+   int i, j;
+   double now, then, change, p;
+   double current[BENCH_REPEAT_MAX], base[BENCH_REPEAT_MAX];
+   DmtxBoolean worse, regressed;
+   BenchGate gate;
+   BenchProfile *baseline;
+
+   baseline = FindBaseline(ctx, profile->name);
+   if(baseline != NULL && strcmp(baseline->options, profile->options) != 0)
+      fprintf(stdout, _("%s: options changed since the baseline (\"%s\")\n"),
+            profile->name, baseline->options);
+
+   fprintf(stdout, "%s: %s --output-format=jsonl %s (%d images, %d runs)\n", profile->name,
+         ctx->opt->dmtxread, profile->options, ctx->imageCount, profile->sampleCount);
+   fprintf(stdout, "   %-16s %12s %8s", "metric", "median", "spread");
+   if(baseline != NULL)
+      fprintf(stdout, " %12s %9s", "baseline", "change");
+   fputc('\n', stdout);
+
+   regressed = DmtxFalse;
+   for(i = 0; i < MetricCount; i++) {
+      gate = metricInfo[i].gate;
+      now = Median(profile->samples[i], profile->sampleCount);
+
+      fprintf(stdout, "   %-16s %12.4g %7.1f%%", metricInfo[i].name, now,
+            100.0 * Spread(profile->samples[i], profile->sampleCount));
+
+      if(baseline == NULL) {
+         fputc('\n', stdout);
+         continue;
+      }
+
+      then = Median(baseline->samples[i], baseline->sampleCount);
+      if(gate == GateAccuracy) {
+         change = now - then;
+         fprintf(stdout, " %12.4g %+9.4f", then, change);
+         worse = (-change > ctx->opt->threshold[gate]) ? DmtxTrue : DmtxFalse;
+      }
+      else {
+         change = (then != 0.0) ? (now - then) / then : 0.0;
+         fprintf(stdout, " %12.4g %+8.1f%%", then, 100.0 * change);
+         if(gate == GateThroughput)
+            worse = (-change > ctx->opt->threshold[gate]) ? DmtxTrue : DmtxFalse;
+         else
+            worse = (change > ctx->opt->threshold[gate]) ? DmtxTrue : DmtxFalse;
+
+         /* time_ms has millisecond resolution; peak memory may be unknown */
+         if((gate == GateLatency && now - then < 1.0) || (gate == GateMemory && then <= 0.0))
+            worse = DmtxFalse;
+      }
+
+      /* Test on values where larger is better */
+      if(worse == DmtxTrue) {
+         for(j = 0; j < profile->sampleCount; j++)
+            current[j] = (gate == GateLatency || gate == GateMemory) ?
+                  -profile->samples[i][j] : profile->samples[i][j];
+         for(j = 0; j < baseline->sampleCount; j++)
+            base[j] = (gate == GateLatency || gate == GateMemory) ?
+                  -baseline->samples[i][j] : baseline->samples[i][j];
+
+         p = MannWhitneyP(current, profile->sampleCount, base, baseline->sampleCount);
+         if(p < ctx->opt->alpha) {
+            fprintf(stdout, _("  REGRESSED (p=%0.3f)"), p);
+            regressed = DmtxTrue;
+         }
+         else {
+            fprintf(stdout, _("  within noise (p=%0.3f)"), p);
+         }
+      }
+      fputc('\n', stdout);
+   }
+
+   if(baseline == NULL && ctx->baselineCount > 0)
+      fprintf(stdout, _("%s: not in the baseline\n"), profile->name);
+
+   fflush(stdout);
+
+   return regressed;
+}
+
+/**
+ * @brief  One-sided exact Mann-Whitney test that one set of runs is lower
+ *
+ * U counts the pairs where a run of a beats a run of b (ties count a
+ * half), and the p-value is the share of all orderings of the pooled
+ * runs with a U as small, counted by the usual recurrence.
+ *
+ * @param  a runs expected to be lower
+ * @param  aCount number of runs in a
+ * @param  b runs to compare with
+ * @param  bCount number of runs in b
+ * @return p-value
+ */
+static double
+MannWhitneyP(const double *a, int aCount, const double *b, int bCount)
+{
+   int i, j, u, uMax, stride;
+   double pairs, total, below;
+   double *f;
+
+   pairs = 0.0;
+   for(i = 0; i < aCount; i++) {
+      for(j = 0; j < bCount; j++)
+         pairs += (a[i] > b[j]) ? 1.0 : (a[i] == b[j]) ? 0.5 : 0.0;
+   }
+
+   /* f[i][j][u]: orderings of i runs of a and j of b with statistic u */
+   uMax = aCount * bCount;
+   stride = uMax + 1;
+   f = (double *)calloc((size_t)(aCount + 1) * (bCount + 1) * stride, sizeof(double));
+   if(f == NULL)
+      FatalError(EX_OSERR, _("Out of memory"));
+
+   for(i = 0; i <= aCount; i++) {
+      for(j = 0; j <= bCount; j++) {
+         if(i == 0 || j == 0) {
+            f[(i * (bCount + 1) + j) * stride] = 1.0;
+            continue;
+         }
+         for(u = 0; u <= i * j; u++) {
+            /* Largest run is from a, beating all j runs of b, or from b */
+            f[(i * (bCount + 1) + j) * stride + u] =
+                  ((u >= j) ? f[((i - 1) * (bCount + 1) + j) * stride + u - j] : 0.0) +
+                  f[(i * (bCount + 1) + j - 1) * stride + u];
+         }
+      }
+   }
+
+   total = below = 0.0;
+   for(u = 0; u <= uMax; u++) {
+      total += f[(aCount * (bCount + 1) + bCount) * stride + u];
+      if(u <= pairs)
+         below += f[(aCount * (bCount + 1) + bCount) * stride + u];
+   }
+
+   free(f);
+
+   return below / total;
+}
+
+/**
+ * @brief  Search dmtxread options for the fastest sets at each recall
+ *
+ * Option sets from the grid in tuneAxes (a random sample of it when it
+ * is larger than --budget) are first run on a sparse subset of the
+ * corpus. Each round keeps the better half by Pareto layer of images
+ * per second against recall and doubles the images they are run on,
+ * until the survivors are measured --repeat times on the whole corpus.
+ *
+ * @param  ctx benchmark context
+ * @return void
+ */
+static void
+RunTune(BenchContext *ctx)
+{
+   int i, count, stride, keep, round, front;
+   long total;
+   double metrics[MetricCount];
+   TuneCandidate *candidates;
+
+   total = 1;
+   for(i = 0; i < TUNE_AXIS_COUNT; i++)
+      total *= tuneAxes[i].valueCount;
+
+   count = MakeCandidates(ctx, &candidates);
+
+   stride = 1;
+   while(ctx->imageCount / (stride * 2) >= TUNE_IMAGES_MIN)
+      stride *= 2;
+
+   fprintf(stdout, _("Tuning %d of %ld option sets on %d images\n"), count, total,
+         ctx->imageCount);
+
+   for(i = 0; i < ctx->opt->warmup; i++)
+      RunOnce(ctx, &candidates[0].profile, stride, metrics);
+
+   for(round = 1; stride > 1; round++) {
+      RunRound(ctx, candidates, count, stride, 1);
+      RankCandidates(candidates, count);
+
+      for(front = 0; front < count && candidates[front].rank == 0; front++)
+         ;
+      keep = (count + 1) / 2;
+      if(keep < TUNE_KEEP_MIN)
+         keep = (count < TUNE_KEEP_MIN) ? count : TUNE_KEEP_MIN;
+
+      fprintf(stdout, _("round %d: %d option sets on %d images, %d on the front, %d kept\n"),
+            round, count, (ctx->imageCount + stride - 1) / stride, front, keep);
+      fflush(stdout);
+
+      count = keep;
+      stride /= 2;
+   }
+
+   RunRound(ctx, candidates, count, 1, ctx->opt->repeat);
+   RankCandidates(candidates, count);
+
+   ReportTune(ctx, candidates, count);
+}
+
+/**
+ * @brief  Choose the option sets tried by --tune
+ *
+ * The whole grid is tried when it fits the budget. Otherwise the
+ * dmtxread defaults come first, followed by distinct random points of
+ * the grid from a fixed seed, so repeated tuning tries the same sets.
+ *
+ * @param  ctx benchmark context
+ * @param  candidates pointer to the allocated option sets
+ * @return Number of option sets
+ */
+static int
+MakeCandidates(BenchContext *ctx, TuneCandidate **candidates)
+{
+   int i, j, count, tries;
+   long total, index;
+   unsigned long x;
+   TuneCandidate *c;
+
+   total = 1;
+   for(i = 0; i < TUNE_AXIS_COUNT; i++)
+      total *= tuneAxes[i].valueCount;
+
+   count = (total < ctx->opt->budget) ? (int)total : ctx->opt->budget;
+
+   *candidates = (TuneCandidate *)calloc(count, sizeof(TuneCandidate));
+   if(*candidates == NULL)
+      FatalError(EX_OSERR, _("Out of memory"));
+
+   if(count == total) {
+      for(index = 0; index < total; index++) {
+         c = &(*candidates)[index];
+         for(i = 0, j = (int)index; i < TUNE_AXIS_COUNT; i++) {
+            c->value[i] = j % tuneAxes[i].valueCount;
+            j /= tuneAxes[i].valueCount;
+         }
+         SetCandidateOptions(c, (int)index);
+      }
+      return count;
+   }
+
+   /* Defaults first (all indexes 0), then distinct random points */
+   x = 0x2545f491UL;
+   SetCandidateOptions(&(*candidates)[0], 0);
+   for(i = 1, tries = 0; i < count && tries < count * 100; tries++) {
+      c = &(*candidates)[i];
+      for(j = 0; j < TUNE_AXIS_COUNT; j++) {
+         /* xorshift32 */
+         x ^= (x << 13) & 0xffffffffUL;
+         x ^= x >> 17;
+         x ^= (x << 5) & 0xffffffffUL;
+         c->value[j] = (int)((x >> 8) % tuneAxes[j].valueCount);
+      }
+
+      for(j = 0; j < i; j++) {
+         if(memcmp((*candidates)[j].value, c->value, sizeof(c->value)) == 0)
+            break;
+      }
+      if(j == i) {
+         SetCandidateOptions(c, i);
+         i++;
+      }
+   }
+
+   return i;
+}
+
+/**
+ * @brief  Build the dmtxread options of an option set
+ * @param  candidate option set, with its value indexes filled
+ * @param  id number naming the option set
+ * @return void
+ */
+static void
+SetCandidateOptions(TuneCandidate *candidate, int id)
+{
+   int i;
+   char name[16];
+   char options[128];
+   char *ptr;
+   BenchProfile *profile;
+
+   profile = &candidate->profile;
+
+   sprintf(name, "tune%d", id);
+   profile->name = strdup(name);
+
+   /* Options left at their first value keep the dmtxread default */
+   options[0] = '\0';
+   profile->argc = 0;
+   for(i = 0; i < TUNE_AXIS_COUNT; i++) {
+      if(candidate->value[i] == 0)
+         continue;
+      ptr = options + strlen(options);
+      sprintf(ptr, "%s%s%d", (ptr == options) ? "" : " ", tuneAxes[i].flag,
+            tuneAxes[i].values[candidate->value[i]]);
+      profile->argv[profile->argc++] = strdup(ptr + ((ptr == options) ? 0 : 1));
+   }
+   profile->options = strdup(options);
+
+   if(profile->name == NULL || profile->options == NULL)
+      FatalError(EX_OSERR, _("Out of memory"));
+   for(i = 0; i < profile->argc; i++) {
+      if(profile->argv[i] == NULL)
+         FatalError(EX_OSERR, _("Out of memory"));
+   }
+}
+
+/**
+ * @brief  Measure option sets on every stride-th image
+ * @param  ctx benchmark context
+ * @param  candidates option sets
+ * @param  count number of option sets
+ * @param  stride run over every stride-th image only
+ * @param  repeat runs per option set
+ * @return void
+ */
+static void
+RunRound(BenchContext *ctx, TuneCandidate *candidates, int count, int stride, int repeat)
+{
+   int i, j, k;
+   double metrics[MetricCount];
+   BenchProfile *profile;
+
+   for(i = 0; i < count; i++) {
+      profile = &candidates[i].profile;
+
+      for(j = 0; j < repeat; j++) {
+         RunOnce(ctx, profile, stride, metrics);
+         for(k = 0; k < MetricCount; k++)
+            profile->samples[k][j] = metrics[k];
+      }
+      profile->sampleCount = repeat;
+
+      candidates[i].imagesPerSec = Median(profile->samples[MetricImagesPerSec], repeat);
+      candidates[i].recall = Median(profile->samples[MetricRecall], repeat);
+
+      if(ctx->opt->verbose == DmtxTrue)
+         fprintf(stderr, _("%s: %0.2f images/s, recall %0.4f: %s\n"), profile->name,
+               candidates[i].imagesPerSec, candidates[i].recall, profile->options);
+   }
+}
+
+/**
+ * @brief  Sort option sets by Pareto layer of images per second and recall
+ *
+ * Layer 0 is the front, the sets no other set beats on both counts.
+ * Layer 1 is the front of the rest, and so on. Within a layer, higher
+ * recall comes first.
+ *
+ * @param  candidates option sets
+ * @param  count number of option sets
+ * @return void
+ */
+static void
+RankCandidates(TuneCandidate *candidates, int count)
+{
+   int i, j, rank, ranked;
+   DmtxBoolean dominated;
+   TuneCandidate *a, *b;
+
+   for(i = 0; i < count; i++)
+      candidates[i].rank = -1;
+
+   for(rank = 0, ranked = 0; ranked < count; rank++) {
+      for(i = 0; i < count; i++) {
+         a = &candidates[i];
+         if(a->rank != -1)
+            continue;
+
+         dominated = DmtxFalse;
+         for(j = 0; j < count && dominated == DmtxFalse; j++) {
+            b = &candidates[j];
+            if(j == i || b->rank >= 0)
+               continue;
+            if(b->imagesPerSec >= a->imagesPerSec && b->recall >= a->recall &&
+                  (b->imagesPerSec > a->imagesPerSec || b->recall > a->recall))
+               dominated = DmtxTrue;
+         }
+
+         /* Marked with the next layer until the whole layer is found */
+         if(dominated == DmtxFalse)
+            a->rank = -2 - rank;
+      }
+
+      for(i = 0; i < count; i++) {
+         if(candidates[i].rank == -2 - rank) {
+            candidates[i].rank = rank;
+            ranked++;
+         }
+      }
+   }
+
+   qsort(candidates, count, sizeof(TuneCandidate), CompareCandidates);
+}
+
+/**
+ * @brief  Order option sets by layer, then recall, then images per second
+ * @param  a pointer to first option set
+ * @param  b pointer to second option set
+ * @return Comparison result for qsort()
+ */
+static int
+CompareCandidates(const void *a, const void *b)
+{
+   const TuneCandidate *ca = (const TuneCandidate *)a;
+   const TuneCandidate *cb = (const TuneCandidate *)b;
+
+   if(ca->rank != cb->rank)
+      return ca->rank - cb->rank;
+   if(ca->recall != cb->recall)
+      return (ca->recall > cb->recall) ? -1 : 1;
+   if(ca->imagesPerSec != cb->imagesPerSec)
+      return (ca->imagesPerSec > cb->imagesPerSec) ? -1 : 1;
+
+   return strcmp(ca->profile.name, cb->profile.name);
+}
+
+/**
+ * @brief  Print the front found by --tune and the recommended options
+ * @param  ctx benchmark context
+ * @param  candidates option sets, ranked
+ * @param  count number of option sets
+ * @return void
+ */
+static void
+ReportTune(BenchContext *ctx, TuneCandidate *candidates, int count)
+{
+   int i;
+   double floor;
+   TuneCandidate *recommended;
+
+   fprintf(stdout, _("Pareto front of images/s against recall, %d images, %d runs:\n"),
+         ctx->imageCount, ctx->opt->repeat);
+   fprintf(stdout, "   %12s %8s %9s  %s\n", "images_per_s", "recall", "precision", "options");
+
+   /* Fastest set within --max-recall-drop of the best recall */
+   floor = candidates[0].recall - ctx->opt->threshold[GateAccuracy];
+   recommended = &candidates[0];
+
+   for(i = 0; i < count && candidates[i].rank == 0; i++) {
+      fprintf(stdout, "   %12.2f %8.4f %9.4f  %s\n", candidates[i].imagesPerSec,
+            candidates[i].recall, Median(candidates[i].profile.samples[MetricPrecision],
+            candidates[i].profile.sampleCount),
+            (candidates[i].profile.options[0] == '\0') ? _("(defaults)") :
+            candidates[i].profile.options);
+      if(candidates[i].recall >= floor &&
+            candidates[i].imagesPerSec > recommended->imagesPerSec)
+         recommended = &candidates[i];
+   }
+
+   fprintf(stdout, _("Recommended (fastest within %g of the best recall %0.4f):\n"),
+         ctx->opt->threshold[GateAccuracy], candidates[0].recall);
+   fprintf(stdout, "   dmtxread %s\n", recommended->profile.options);
+
+   if(ctx->opt->outputPath != NULL) {
+      WriteTemplate(ctx, candidates, count, recommended);
+      fprintf(stdout, _("Profiles written to \"%s\"\n"), ctx->opt->outputPath);
+   }
+}
+
+/**
+ * @brief  Write the front found by --tune as a dmtxbench profiles file
+ *
+ * The recommended set is named "recommended" and listed first, so the
+ * file serves both as a template for production options and as the
+ * profiles of later "make bench" runs.
+ *
+ * @param  ctx benchmark context
+ * @param  candidates option sets, ranked
+ * @param  count number of option sets
+ * @param  recommended recommended option set
+ * @return void
+ */
+static void
+WriteTemplate(BenchContext *ctx, TuneCandidate *candidates, int count,
+      TuneCandidate *recommended)
+{
+   int i, number;
+   char name[16];
+   FILE *fp;
+
+   fp = fopen(ctx->opt->outputPath, "wb");
+   if(fp == NULL)
+      FatalError(EX_CANTCREAT, _("Unable to create \"%s\""), ctx->opt->outputPath);
+
+   fprintf(fp, "# dmtxbench profiles: the Pareto front found by --tune on \"%s\"\n",
+         ctx->opt->corpus);
+   fprintf(fp, "# (%d images, %d runs each)\n", ctx->imageCount, ctx->opt->repeat);
+   fprintf(fp, "\n# %0.2f images/s, recall %0.4f\n", recommended->imagesPerSec,
+         recommended->recall);
+   fprintf(fp, "recommended%s%s\n", (recommended->profile.options[0] == '\0') ? "" : "    ",
+         recommended->profile.options);
+
+   for(i = 0, number = 1; i < count && candidates[i].rank == 0; i++) {
+      if(&candidates[i] == recommended)
+         continue;
+      fprintf(fp, "\n# %0.2f images/s, recall %0.4f\n", candidates[i].imagesPerSec,
+            candidates[i].recall);
+      sprintf(name, "front%d", number++);
+      fprintf(fp, "%s%*s%s\n", name, (candidates[i].profile.options[0] == '\0') ? 0 :
+            (int)(15 - strlen(name)), "", candidates[i].profile.options);
+   }
+
+   if(fclose(fp) != 0)
+      FatalError(EX_IOERR, _("Unable to write \"%s\""), ctx->opt->outputPath);
+}
@@ -0,0 +1,222 @@
+/*
+libdmtx - Data Matrix Encoding/Decoding Library
+
+Copyright (C) 2008, 2009 Mike Laughton
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+Contact: mike@dragonflylogic.com
+*/
+
+#ifndef __DMTXBENCH_H__
+#define __DMTXBENCH_H__
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <errno.h>
+#include <math.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <dmtx.h>
+#include "../common/dmtxutil.h"
+#include "../common/dmtxrecord.h"
+#include "../dmtxquery/dmtxinput.h"
+
+#if defined(HAVE_SYS_RESOURCE_H) && defined(HAVE_WAIT4)
+#include <sys/resource.h>
+#endif
+
+#if ENABLE_NLS
+# include <libintl.h>
+# define _(String) gettext(String)
+#else
+# define _(String) String
+#endif
+#define N_(String) String
+
+/* Exit status when a profile regressed against the baseline */
+#define EX_REGRESSED 1
+
+/* Most measured runs per profile */
+#define BENCH_REPEAT_MAX 50
+
+/* Most profiles in a profiles file, and dmtxread options in one profile */
+#define BENCH_PROFILE_MAX 64
+#define BENCH_OPTION_MAX  32
+
+/* Longest line in a profiles or baseline file */
+#define BENCH_LINE_MAX 8192
+
+/* dmtxread options searched by --tune, and most values tried for each */
+#define TUNE_AXIS_COUNT 6
+#define TUNE_VALUE_MAX 8
+
+/* Fewest images in the first round of --tune, and fewest option sets kept */
+#define TUNE_IMAGES_MIN 16
+#define TUNE_KEEP_MIN 4
+
+/* Long options without a single character equivalent */
+enum {
+   OptAlpha = 256,
+   OptMaxSlowdown,
+   OptMaxLatency,
+   OptMaxMemory,
+   OptMaxRecallDrop,
+   OptTune,
+   OptBudget
+};
+
+/* Measurements taken from every run */
+typedef enum {
+   MetricImagesPerSec = 0,
+   MetricBarcodesPerSec,
+   MetricTimeP50,
+   MetricTimeP90,
+   MetricTimeP99,
+   MetricFirstP50,
+   MetricFirstP99,
+   MetricLastP50,
+   MetricLastP99,
+   MetricPeakRss,
+   MetricRecall,
+   MetricPrecision,
+   MetricCount
+} BenchMetric;
+
+/* Threshold a metric is held to, and which way is worse */
+typedef enum {
+   GateThroughput = 0,  /* relative drop */
+   GateLatency,         /* relative growth */
+   GateMemory,          /* relative growth */
+   GateAccuracy,        /* absolute drop */
+   GateCount
+} BenchGate;
+
+typedef struct {
+   const char *name;
+   BenchGate gate;
+} MetricInfo;
+
+/* dmtxread options to measure, and the measurements of each run */
+typedef struct {
+   char *name;
+   char *options;       /* as written in the profiles file */
+   char *argv[BENCH_OPTION_MAX];
+   int argc;
+   double samples[MetricCount][BENCH_REPEAT_MAX];
+   int sampleCount;
+} BenchProfile;
+
+/* One expected barcode, keyed by image file name, page and message */
+typedef struct {
+   char *key;
+   int length;
+   int image;           /* index in the corpus, or -1 if not there */
+   int found;
+} TruthEntry;
+
+/* dmtxread option searched by --tune; value 0 leaves it unset */
+typedef struct {
+   const char *flag;
+   int values[TUNE_VALUE_MAX];
+   int valueCount;
+} TuneAxis;
+
+/* Option set tried by --tune, with its latest measurements */
+typedef struct {
+   BenchProfile profile;
+   int value[TUNE_AXIS_COUNT]; /* value index for each axis */
+   double imagesPerSec;
+   double recall;
+   int rank;            /* Pareto layer, 0 for the front */
+} TuneCandidate;
+
+typedef struct {
+   char *dmtxread;      /* -r, --dmtxread */
+   char *profilesPath;  /* -p, --profiles */
+   char *baselinePath;  /* -b, --baseline */
+   int update;          /* -u, --update */
+   int repeat;          /* -n, --repeat */
+   int warmup;          /* -w, --warmup */
+   double alpha;        /*     --alpha */
+   double threshold[GateCount]; /* --max-slowdown, --max-latency, etc... */
+   int verbose;         /* -v, --verbose */
+   int tune;            /*     --tune */
+   int budget;          /*     --budget */
+   char *outputPath;    /* -o, --output */
+   char *corpus;
+} UserOptions;
+
+typedef struct {
+   UserOptions *opt;
+   char **images;
+   int imageCount;
+   TruthEntry *truth;
+   int truthCount;
+   BenchProfile *profiles;
+   int profileCount;
+   BenchProfile *baseline;
+   int baselineCount;
+} BenchContext;
+
+static void SetOptionDefaults(UserOptions *opt);
+static DmtxPassFail HandleArgs(UserOptions *opt, int *argcp, char **argvp[]);
+static DmtxPassFail ParsePercent(double *value, char *s);
+static void ShowUsage(int status);
+static void ReadProfiles(BenchContext *ctx);
+static DmtxPassFail SplitProfile(BenchProfile *profile, char *line);
+static void ListImages(BenchContext *ctx);
+static int CompareNames(const void *a, const void *b);
+static void ReadTruth(BenchContext *ctx);
+static char *MakeKey(const ResultRecord *rec, int *length);
+static int CompareTruth(const void *a, const void *b);
+static int FindImage(BenchContext *ctx, const char *name, int length);
+static void RunProfile(BenchContext *ctx, BenchProfile *profile);
+static void RunOnce(BenchContext *ctx, BenchProfile *profile, int stride, double *metrics);
+static void ScoreResults(BenchContext *ctx, FILE *fp, int stride, double seconds,
+      double *metrics);
+static double Percentile(double *values, int count, double percent);
+static double Median(const double *values, int count);
+static double Spread(const double *values, int count);
+static int CompareDoubles(const void *a, const void *b);
+static void ReadBaseline(BenchContext *ctx);
+static DmtxPassFail ReadSamples(const char *line, const char *name, double *samples,
+      int *count);
+static char *ReadString(const char *line, const char *name);
+static void WriteBaseline(BenchContext *ctx);
+static BenchProfile *FindBaseline(BenchContext *ctx, const char *name);
+static DmtxBoolean ReportProfile(BenchContext *ctx, BenchProfile *profile);
+static double MannWhitneyP(const double *a, int aCount, const double *b, int bCount);
+static void RunTune(BenchContext *ctx);
+static int MakeCandidates(BenchContext *ctx, TuneCandidate **candidates);
+static void SetCandidateOptions(TuneCandidate *candidate, int id);
+static void RunRound(BenchContext *ctx, TuneCandidate *candidates, int count, int stride,
+      int repeat);
+static void RankCandidates(TuneCandidate *candidates, int count);
+static int CompareCandidates(const void *a, const void *b);
+static void ReportTune(BenchContext *ctx, TuneCandidate *candidates, int count);
+static void WriteTemplate(BenchContext *ctx, TuneCandidate *candidates, int count,
+      TuneCandidate *recommended);
+
+#endif
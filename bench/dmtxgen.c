@@ -0,0 +1,1283 @@
+/*
+libdmtx - Data Matrix Encoding/Decoding Library
+
+Copyright (C) 2008, 2009 Mike Laughton
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+Contact: mike@dragonflylogic.com
+*/
+
+/**
+ * @file dmtxgen.c
+ * @brief Synthetic Data Matrix corpus generator
+ *
+ * Encodes symbols of every size with the libdmtx encoder and composes
+ * them into grey scenes that vary in size, module size, rotation,
+ * perspective, blur, noise, contrast and clutter. Every scene is drawn
+ * from its own stream of a seeded generator, so a corpus is reproduced
+ * exactly from its command line. Ground truth is written as dmtxread
+ * JSON lines, so a run is scored with dmtxquery compare and reconcile.
+ */
+
+#include "dmtxgen.h"
+
+char *programName;
+
+/**
+ * @brief  Main function for the dmtxgen corpus generator.
+ * @param  argc count of arguments passed from command line
+ * @param  argv list of argument passed strings from command line
+ * @return Numeric exit code
+ */
+int
+main(int argc, char *argv[])
+{
+   int err;
+   int sceneIdx;
+   size_t length;
+   struct stat info;
+   UserOptions opt;
+   GenCorpus corpus;
+
+   SetOptionDefaults(&opt);
+
+   err = HandleArgs(&opt, &argc, &argv);
+   if(err != DmtxPass)
+      ShowUsage(EX_USAGE);
+
+   if(mkdir(opt.directory, 0777) != 0 &&
+         (errno != EEXIST || stat(opt.directory, &info) != 0 || !S_ISDIR(info.st_mode)))
+      FatalError(EX_CANTCREAT, _("Unable to create directory \"%s\""), opt.directory);
+
+   memset(&corpus, 0x00, sizeof(GenCorpus));
+   corpus.opt = &opt;
+
+   /* Modules are read back from the message, so render the image small */
+   corpus.enc = dmtxEncodeCreate();
+   if(corpus.enc == NULL)
+      FatalError(EX_SOFTWARE, "create error");
+   dmtxEncodeSetProp(corpus.enc, DmtxPropPixelPacking, DmtxPack24bppRGB);
+   dmtxEncodeSetProp(corpus.enc, DmtxPropImageFlip, DmtxFlipNone);
+   dmtxEncodeSetProp(corpus.enc, DmtxPropMarginSize, 0);
+   dmtxEncodeSetProp(corpus.enc, DmtxPropModuleSize, 1);
+   dmtxEncodeSetProp(corpus.enc, DmtxPropScheme, opt.scheme);
+
+   length = strlen(opt.directory) + strlen(opt.format) + 32;
+   corpus.path = (char *)malloc(length);
+   if(corpus.path == NULL)
+      FatalError(EX_OSERR, _("Out of memory"));
+
+   snprintf(corpus.path, length, "%s/truth.jsonl", opt.directory);
+   corpus.fpTruth = fopen(corpus.path, "wb");
+   if(corpus.fpTruth == NULL)
+      FatalError(EX_CANTCREAT, _("Unable to create \"%s\""), corpus.path);
+
+   snprintf(corpus.path, length, "%s/manifest.txt", opt.directory);
+   corpus.fpManifest = fopen(corpus.path, "wb");
+   if(corpus.fpManifest == NULL)
+      FatalError(EX_CANTCREAT, _("Unable to create \"%s\""), corpus.path);
+
+   if(strcmp(opt.format, "pgm") != 0)
+      MagickWandGenesis();
+
+   for(sceneIdx = 0; sceneIdx < opt.scenes; sceneIdx++)
+      GenerateScene(&corpus, sceneIdx);
+
+   if(strcmp(opt.format, "pgm") != 0)
+      MagickWandTerminus();
+
+   if(fclose(corpus.fpTruth) != 0 || fclose(corpus.fpManifest) != 0)
+      FatalError(EX_IOERR, _("Unable to write ground truth"));
+
+   if(corpus.leftOut > 0)
+      fprintf(stderr, _("%s: %ld symbols left out (too long for their size, or no room)\n"),
+            programName, corpus.leftOut);
+
+   if(opt.verbose == DmtxTrue)
+      fprintf(stderr, _("%s: %d scenes with %ld symbols written to \"%s\"\n"),
+            programName, opt.scenes, corpus.symbolCount, opt.directory);
+
+   free(corpus.path);
+   dmtxEncodeDestroy(&corpus.enc);
+
+   exit(EX_OK);
+}
+
+/**
+ * @brief  Set default option values
+ * @param  opt runtime options
+ * @return void
+ */
+static void
+SetOptionDefaults(UserOptions *opt)
+{
+   int i;
+
+   memset(opt, 0x00, sizeof(UserOptions));
+
+   opt->scenes = 100;
+   opt->symbols.min = opt->symbols.max = 1.0;
+   for(i = 0; i < DmtxSymbolSquareCount + DmtxSymbolRectCount; i++)
+      opt->sizeIdx[i] = i;
+   opt->sizeCount = DmtxSymbolSquareCount + DmtxSymbolRectCount;
+   opt->scheme = DmtxSchemeAutoBest;
+   opt->format = "pgm";
+   opt->width.min = opt->width.max = 640.0;
+   opt->height.min = opt->height.max = 480.0;
+   opt->module.min = 3.0;
+   opt->module.max = 8.0;
+   opt->rotate.min = 0.0;
+   opt->rotate.max = 360.0;
+   opt->perspective.min = 0.0;
+   opt->perspective.max = 0.05;
+   opt->blur.min = 0.0;
+   opt->blur.max = 1.0;
+   opt->noise.min = 0.0;
+   opt->noise.max = 8.0;
+   opt->contrast.min = 0.4;
+   opt->contrast.max = 1.0;
+   opt->clutter.min = 0.0;
+   opt->clutter.max = 10.0;
+   opt->seed = 1;
+   opt->verbose = DmtxFalse;
+   opt->directory = NULL;
+}
+
+/**
+ * @brief  Set and validate user-requested options from command line arguments.
+ * @param  opt runtime options from defaults or command line
+ * @param  argcp pointer to argument count
+ * @param  argvp pointer to argument list
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+HandleArgs(UserOptions *opt, int *argcp, char **argvp[])
+{
+   int err;
+   int optchr;
+   int longIndex;
+   char *ptr;
+
+   struct option longOptions[] = {
+         {"scenes",           required_argument, NULL, 'n'},
+         {"symbols",          required_argument, NULL, 'k'},
+         {"symbol-size",      required_argument, NULL, 's'},
+         {"encoding",         required_argument, NULL, 'e'},
+         {"format",           required_argument, NULL, 'f'},
+         {"module",           required_argument, NULL, 'd'},
+         {"rotate",           required_argument, NULL, 'R'},
+         {"width",            required_argument, NULL, OptWidth},
+         {"height",           required_argument, NULL, OptHeight},
+         {"perspective",      required_argument, NULL, OptPerspective},
+         {"blur",             required_argument, NULL, OptBlur},
+         {"noise",            required_argument, NULL, OptNoise},
+         {"contrast",         required_argument, NULL, OptContrast},
+         {"clutter",          required_argument, NULL, OptClutter},
+         {"seed",             required_argument, NULL, OptSeed},
+         {"verbose",          no_argument,       NULL, 'v'},
+         {"version",          no_argument,       NULL, 'V'},
+         {"help",             no_argument,       NULL,  0 },
+         {0, 0, 0, 0}
+   };
+
+   programName = Basename((*argvp)[0]);
+
+   for(;;) {
+      optchr = getopt_long(*argcp, *argvp, "n:k:s:e:f:d:R:vV", longOptions, &longIndex);
+      if(optchr == -1)
+         break;
+
+      switch(optchr) {
+         case 0: /* --help */
+            ShowUsage(EX_OK);
+            break;
+         case 'n':
+            err = StringToInt(&(opt->scenes), optarg, &ptr);
+            if(err != DmtxPass || opt->scenes < 0 || *ptr != '\0')
+               FatalError(EX_USAGE, _("Invalid scene count specified \"%s\""), optarg);
+            break;
+         case 'k':
+            if(ParseRange(&(opt->symbols), optarg, 0.0, DMTXGEN_SYMBOLS_MAX) != DmtxPass)
+               FatalError(EX_USAGE, _("Invalid symbol count specified \"%s\""), optarg);
+            break;
+         case 's':
+            if(ParseSymbolSizes(opt, optarg) != DmtxPass)
+               FatalError(EX_USAGE, _("Invalid symbol size specified \"%s\""), optarg);
+            break;
+         case 'e':
+            if(strlen(optarg) != 1)
+               FatalError(EX_USAGE, _("Invalid encodation scheme \"%s\""), optarg);
+            switch(*optarg) {
+               case 'b':
+                  opt->scheme = DmtxSchemeAutoBest;
+                  break;
+               case 'a':
+                  opt->scheme = DmtxSchemeAscii;
+                  break;
+               case 'c':
+                  opt->scheme = DmtxSchemeC40;
+                  break;
+               case 't':
+                  opt->scheme = DmtxSchemeText;
+                  break;
+               case 'x':
+                  opt->scheme = DmtxSchemeX12;
+                  break;
+               case 'e':
+                  opt->scheme = DmtxSchemeEdifact;
+                  break;
+               case '8':
+                  opt->scheme = DmtxSchemeBase256;
+                  break;
+               default:
+                  FatalError(EX_USAGE, _("Invalid encodation scheme \"%s\""), optarg);
+            }
+            break;
+         case 'f':
+            for(ptr = optarg; *ptr != '\0'; ptr++)
+               *ptr = tolower((int)*ptr);
+            if(*optarg == '\0' || strchr(optarg, '/') != NULL)
+               FatalError(EX_USAGE, _("Invalid format specified \"%s\""), optarg);
+            opt->format = optarg;
+            break;
+         case 'd':
+            if(ParseRange(&(opt->module), optarg, 1.0, 100.0) != DmtxPass)
+               FatalError(EX_USAGE, _("Invalid module size specified \"%s\""), optarg);
+            break;
+         case 'R':
+            if(ParseRange(&(opt->rotate), optarg, 0.0, 360.0) != DmtxPass)
+               FatalError(EX_USAGE, _("Invalid rotation angle specified \"%s\""), optarg);
+            break;
+         case OptWidth:
+            if(ParseRange(&(opt->width), optarg, 16.0, 32768.0) != DmtxPass)
+               FatalError(EX_USAGE, _("Invalid width specified \"%s\""), optarg);
+            break;
+         case OptHeight:
+            if(ParseRange(&(opt->height), optarg, 16.0, 32768.0) != DmtxPass)
+               FatalError(EX_USAGE, _("Invalid height specified \"%s\""), optarg);
+            break;
+         case OptPerspective:
+            if(ParseRange(&(opt->perspective), optarg, 0.0, 0.25) != DmtxPass)
+               FatalError(EX_USAGE, _("Invalid perspective specified \"%s\""), optarg);
+            break;
+         case OptBlur:
+            if(ParseRange(&(opt->blur), optarg, 0.0, 20.0) != DmtxPass)
+               FatalError(EX_USAGE, _("Invalid blur specified \"%s\""), optarg);
+            break;
+         case OptNoise:
+            if(ParseRange(&(opt->noise), optarg, 0.0, 128.0) != DmtxPass)
+               FatalError(EX_USAGE, _("Invalid noise specified \"%s\""), optarg);
+            break;
+         case OptContrast:
+            if(ParseRange(&(opt->contrast), optarg, 0.05, 1.0) != DmtxPass)
+               FatalError(EX_USAGE, _("Invalid contrast specified \"%s\""), optarg);
+            break;
+         case OptClutter:
+            if(ParseRange(&(opt->clutter), optarg, 0.0, 1000.0) != DmtxPass)
+               FatalError(EX_USAGE, _("Invalid clutter specified \"%s\""), optarg);
+            break;
+         case OptSeed:
+            errno = 0;
+            opt->seed = strtoul(optarg, &ptr, 10);
+            if(errno != 0 || ptr == optarg || *ptr != '\0')
+               FatalError(EX_USAGE, _("Invalid seed specified \"%s\""), optarg);
+            break;
+         case 'v':
+            opt->verbose = DmtxTrue;
+            break;
+         case 'V':
+            fprintf(stderr, "%s version %s\n", programName, DmtxVersion);
+            fprintf(stderr, "libdmtx version %s\n", dmtxVersion());
+            exit(0);
+            break;
+         default:
+            return DmtxFail;
+            break;
+      }
+   }
+
+   /* Exactly one output directory */
+   if(optind + 1 != *argcp)
+      return DmtxFail;
+
+   opt->directory = (*argvp)[optind];
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Parse "N" or "N-M" into a closed range
+ * @param  range range to fill
+ * @param  s option text
+ * @param  min smallest allowed value
+ * @param  max largest allowed value
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+ParseRange(GenRange *range, char *s, double min, double max)
+{
+   char *ptr;
+
+   errno = 0;
+   range->min = strtod(s, &ptr);
+   if(ptr == s)
+      return DmtxFail;
+
+   if(*ptr == '-') {
+      s = ptr + 1;
+      range->max = strtod(s, &ptr);
+      if(ptr == s)
+         return DmtxFail;
+   }
+   else {
+      range->max = range->min;
+   }
+
+   if(errno != 0 || *ptr != '\0' || range->min < min || range->max > max ||
+         range->min > range->max)
+      return DmtxFail;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Parse a comma-separated list of symbol sizes
+ * @param  opt runtime options receiving the sizes
+ * @param  s "all", "s" (every square size), "r" (every rectangle) or RxC, ...
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+ParseSymbolSizes(UserOptions *opt, char *s)
+{
+   int i, first, last;
+   int total;
+   size_t length;
+
+   total = DmtxSymbolSquareCount + DmtxSymbolRectCount;
+   opt->sizeCount = 0;
+
+   while(*s != '\0') {
+      length = strcspn(s, ",");
+
+      if(length == 3 && strncmp(s, "all", 3) == 0) {
+         first = 0;
+         last = total - 1;
+      }
+      else if(length == 1 && *s == 's') {
+         first = 0;
+         last = DmtxSymbolSquareCount - 1;
+      }
+      else if(length == 1 && *s == 'r') {
+         first = DmtxSymbolSquareCount;
+         last = total - 1;
+      }
+      else {
+         for(first = 0; first < total; first++) {
+            if(strlen(symbolSizes[first]) == length &&
+                  strncmp(s, symbolSizes[first], length) == 0)
+               break;
+         }
+         if(first == total)
+            return DmtxFail;
+         last = first;
+      }
+
+      for(i = first; i <= last; i++) {
+         if(opt->sizeCount == total)
+            return DmtxFail;
+         opt->sizeIdx[opt->sizeCount++] = i;
+      }
+
+      s += length;
+      if(*s == ',')
+         s++;
+   }
+
+   return (opt->sizeCount > 0) ? DmtxPass : DmtxFail;
+}
+
+/**
+ * @brief  Display program usage and exit with received status.
+ * @param  status error code returned to OS
+ * @return void
+ */
+static void
+ShowUsage(int status)
+{
+   if(status != 0) {
+      fprintf(stderr, _("Usage: %s [OPTION]... DIRECTORY\n"), programName);
+      fprintf(stderr, _("Try `%s --help' for more information.\n"), programName);
+   }
+   else {
+      fprintf(stderr, _("Usage: %s [OPTION]... DIRECTORY\n"), programName);
+      fprintf(stderr, _("\
+Render a reproducible corpus of synthetic Data Matrix scenes into DIRECTORY,\n\
+with the ground truth of every symbol in DIRECTORY/truth.jsonl (dmtxread\n\
+--output-format=jsonl records) and its message in DIRECTORY/manifest.txt\n\
+\n\
+Example: %s -n 500 --seed=7 corpus\n\
+Example: dmtxread --output-format=jsonl corpus/*.pgm > run.jsonl\n\
+         dmtxquery compare.summary corpus/truth.jsonl run.jsonl\n\
+\n\
+OPTIONS:\n"), programName);
+      fprintf(stderr, _("\
+  -n, --scenes=N              number of scenes (default 100)\n\
+  -k, --symbols=N[-M]         symbols per scene (default 1)\n\
+  -s, --symbol-size=SIZE,...  sizes used in turn: all [default], s (every\n\
+                              square), r (every rectangle) or RxC\n\
+  -e, --encoding=[abcet8x]    primary encodation scheme, as for dmtxwrite\n\
+  -f, --format=FORMAT         pgm [default], or any format ImageMagick writes\n"));
+      fprintf(stderr, _("\
+Each of the following is drawn anew for every scene or symbol, uniformly\n\
+between N and M:\n\
+      --width=N[-M]           scene width in pixels (default 640)\n\
+      --height=N[-M]          scene height in pixels (default 480)\n\
+  -d, --module=N[-M]          module size in pixels (default 3-8)\n\
+  -R, --rotate=N[-M]          rotation in degrees (default 0-360)\n\
+      --perspective=N[-M]     corner displacement as a share of symbol size\n\
+                              (default 0-0.05)\n\
+      --blur=N[-M]            Gaussian blur sigma in pixels (default 0-1)\n\
+      --noise=N[-M]           Gaussian noise sigma in grey levels (default 0-8)\n\
+      --contrast=N[-M]        ink to paper difference, 1 for black on white\n\
+                              (default 0.4-1)\n\
+      --clutter=N[-M]         distracting shapes per scene (default 0-10)\n"));
+      fprintf(stderr, _("\
+      --seed=N                random seed (default 1)\n\
+  -v, --verbose               use verbose messages\n\
+  -V, --version               print version information\n\
+      --help                  display this help and exit\n"));
+      fprintf(stderr, _("\nReport bugs to <mike@dragonflylogic.com>.\n"));
+   }
+
+   exit(status);
+}
+
+/**
+ * @brief  Seed one stream of the random number generator
+ * @param  rng generator state
+ * @param  seed --seed value
+ * @param  stream independent stream, one per scene
+ * @return void
+ */
+static void
+RandomSeed(GenRandom *rng, unsigned long seed, unsigned long stream)
+{
+   int i;
+   unsigned long x, z;
+
+   x = (seed ^ (stream * 0x9e3779b9UL)) & 0xffffffffUL;
+
+   /* Spread the seed over the state with a 32-bit mixing function */
+   for(i = 0; i < 4; i++) {
+      x = (x + 0x9e3779b9UL + (stream & 0xffffffffUL)) & 0xffffffffUL;
+      z = x;
+      z = ((z ^ (z >> 16)) * 0x85ebca6bUL) & 0xffffffffUL;
+      z = ((z ^ (z >> 13)) * 0xc2b2ae35UL) & 0xffffffffUL;
+      z ^= z >> 16;
+      rng->s[i] = (z == 0) ? 1 : z;
+   }
+}
+
+/**
+ * @brief  Next 32 random bits
+ * @param  rng generator state
+ * @return Value from 0 to 2^32-1
+ */
+static unsigned long
+RandomNext(GenRandom *rng)
+{
+   unsigned long t, s;
+
+   t = rng->s[3];
+   s = rng->s[0];
+   rng->s[3] = rng->s[2];
+   rng->s[2] = rng->s[1];
+   rng->s[1] = s;
+
+   t ^= (t << 11) & 0xffffffffUL;
+   t ^= t >> 8;
+   rng->s[0] = t ^ s ^ (s >> 19);
+
+   return rng->s[0];
+}
+
+/**
+ * @brief  Random number in [0,1)
+ * @param  rng generator state
+ * @return Uniform value
+ */
+static double
+RandomUniform(GenRandom *rng)
+{
+   return (double)RandomNext(rng) / 4294967296.0;
+}
+
+/**
+ * @brief  Random number within a range
+ * @param  rng generator state
+ * @param  range closed range
+ * @return Uniform value
+ */
+static double
+RandomRange(GenRandom *rng, const GenRange *range)
+{
+   if(range->min == range->max)
+      return range->min;
+
+   return range->min + (range->max - range->min) * RandomUniform(rng);
+}
+
+/**
+ * @brief  Random number from the standard normal distribution
+ * @param  rng generator state
+ * @return Gaussian value with mean 0 and sigma 1
+ */
+static double
+RandomGaussian(GenRandom *rng)
+{
+   double u, v;
+
+   u = 1.0 - RandomUniform(rng);
+   v = RandomUniform(rng);
+
+   return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+/**
+ * @brief  Render one scene and write it with its ground truth
+ * @param  corpus corpus being written
+ * @param  sceneIdx 0-based scene number, which also picks the random stream
+ * @return void
+ */
+static void
+GenerateScene(GenCorpus *corpus, int sceneIdx)
+{
+   int i, count, need;
+   int symbolCount, placedCount;
+   double span, area, scale;
+   float ink, paper, background;
+   UserOptions *opt = corpus->opt;
+   GenRandom rng;
+   GenScene scene;
+   GenSymbol *syms;
+
+   RandomSeed(&rng, opt->seed, (unsigned long)sceneIdx);
+
+   count = (int)(RandomRange(&rng, &(opt->symbols)) + 0.5);
+   syms = (GenSymbol *)malloc((count > 0 ? count : 1) * sizeof(GenSymbol));
+   if(syms == NULL)
+      FatalError(EX_OSERR, _("Out of memory"));
+
+   /* Symbols are made first so the scene can be made large enough */
+   need = 0;
+   area = 0.0;
+   symbolCount = 0;
+   for(i = 0; i < count; i++) {
+      if(EncodeSymbol(corpus, &rng, opt->sizeIdx[corpus->sizeCursor++ % opt->sizeCount],
+            &syms[symbolCount]) != DmtxPass ||
+            ShapeSymbol(opt, &rng, &syms[symbolCount]) != DmtxPass) {
+         corpus->leftOut++;
+         continue;
+      }
+      if(need < (int)ceil(2.0 * syms[symbolCount].radius) + 2)
+         need = (int)ceil(2.0 * syms[symbolCount].radius) + 2;
+      area += 4.0 * syms[symbolCount].radius * syms[symbolCount].radius;
+      symbolCount++;
+   }
+
+   scene.width = (int)(RandomRange(&rng, &(opt->width)) + 0.5);
+   scene.height = (int)(RandomRange(&rng, &(opt->height)) + 0.5);
+   if(scene.width < need)
+      scene.width = need;
+   if(scene.height < need)
+      scene.height = need;
+
+   /* Keep symbols to half the scene so that they can all be placed */
+   if(2.0 * area > (double)scene.width * scene.height) {
+      scale = sqrt(2.0 * area / ((double)scene.width * scene.height));
+      scene.width = (int)ceil(scene.width * scale);
+      scene.height = (int)ceil(scene.height * scale);
+   }
+
+   scene.pxl = (float *)malloc((size_t)scene.width * scene.height * sizeof(float));
+   if(scene.pxl == NULL)
+      FatalError(EX_OSERR, _("Out of memory"));
+
+   /* Ink and paper are contrast apart, somewhere in the grey scale */
+   span = 255.0 * RandomRange(&rng, &(opt->contrast));
+   ink = (float)((255.0 - span) * RandomUniform(&rng));
+   paper = ink + (float)span;
+   background = ink + (paper - ink) * (float)(0.25 + 0.5 * RandomUniform(&rng));
+
+   for(i = 0; i < scene.width * scene.height; i++)
+      scene.pxl[i] = background;
+
+   count = (int)(RandomRange(&rng, &(opt->clutter)) + 0.5);
+   DrawClutter(&rng, &scene, &(opt->module), count, ink, paper);
+
+   placedCount = 0;
+   for(i = 0; i < symbolCount; i++) {
+      if(PlaceSymbol(&rng, &scene, syms, placedCount, &syms[i]) != DmtxPass) {
+         corpus->leftOut++;
+         continue;
+      }
+      if(i != placedCount)
+         syms[placedCount] = syms[i];
+      DrawSymbol(&scene, &syms[placedCount], ink, paper);
+      placedCount++;
+   }
+
+   if(BlurScene(&scene, RandomRange(&rng, &(opt->blur))) != DmtxPass)
+      FatalError(EX_OSERR, _("Out of memory"));
+   AddNoise(&rng, &scene, RandomRange(&rng, &(opt->noise)));
+
+   snprintf(corpus->path, strlen(opt->directory) + strlen(opt->format) + 32,
+         "%s/scene-%06d.%s", opt->directory, sceneIdx, opt->format);
+
+   if(WriteScene(opt, &scene, corpus->path) != DmtxPass)
+      FatalError(EX_CANTCREAT, _("Unable to write \"%s\""), corpus->path);
+
+   for(i = 0; i < placedCount; i++) {
+      WriteTruth(corpus->fpTruth, corpus->path, &syms[i]);
+      fwrite(syms[i].message, 1, syms[i].messageLength, corpus->fpManifest);
+      fputc('\n', corpus->fpManifest);
+   }
+   corpus->symbolCount += placedCount;
+
+   if(opt->verbose == DmtxTrue)
+      fprintf(stderr, "%s: %dx%d, %d symbols\n", corpus->path, scene.width, scene.height,
+            placedCount);
+
+   free(scene.pxl);
+   free(syms);
+}
+
+/**
+ * @brief  Encode a unique message into a symbol of the requested size
+ *
+ * Messages are a serial number followed by random digits and capital
+ * letters, as long as the size holds with the chosen scheme, so that
+ * sizes are exercised near capacity and every message is distinct.
+ *
+ * @param  corpus corpus being written
+ * @param  rng generator state
+ * @param  sizeIdx symbol size index
+ * @param  sym symbol receiving message and modules
+ * @return DmtxPass | DmtxFail (the serial number alone does not fit)
+ */
+static DmtxPassFail
+EncodeSymbol(GenCorpus *corpus, GenRandom *rng, int sizeIdx, GenSymbol *sym)
+{
+   int i, row, col;
+   int prefix, length;
+   int dataWords;
+   DmtxEncode *enc = corpus->enc;
+   static const char alphabet[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+   dataWords = dmtxGetSymbolAttribute(DmtxSymAttribSymbolDataWords, sizeIdx);
+
+   prefix = sprintf((char *)sym->message, "%0*ld", DMTXGEN_SERIAL_DIGITS, corpus->serial);
+   length = prefix + (int)(RandomUniform(rng) * (2 * dataWords - prefix + 1));
+   if(length < prefix)
+      length = prefix;
+   if(length > DMTXGEN_MESSAGE_MAX)
+      length = DMTXGEN_MESSAGE_MAX;
+
+   for(i = prefix; i < length; i++)
+      sym->message[i] = alphabet[RandomNext(rng) % (sizeof(alphabet) - 1)];
+
+   /* Shorten the random part until the message fits the size */
+   dmtxEncodeSetProp(enc, DmtxPropSizeRequest, sizeIdx);
+   while(dmtxEncodeDataMatrix(enc, length, sym->message) != DmtxPass) {
+      if(length == prefix) {
+         if(corpus->opt->verbose == DmtxTrue)
+            fprintf(stderr, _("%s: message %s does not fit %s with this scheme\n"),
+                  programName, (char *)sym->message, symbolSizes[sizeIdx]);
+         return DmtxFail;
+      }
+      length = prefix + (length - prefix) * 3 / 4;
+   }
+
+   corpus->serial++;
+
+   sym->sizeIdx = enc->region.sizeIdx;
+   sym->rows = enc->region.symbolRows;
+   sym->cols = enc->region.symbolCols;
+   sym->padCount = enc->message->padCount;
+   sym->messageLength = length;
+
+   for(row = 0; row < sym->rows; row++) {
+      for(col = 0; col < sym->cols; col++) {
+         sym->modules[row * sym->cols + col] = (dmtxSymbolModuleStatus(enc->message,
+               sym->sizeIdx, row, col) & DmtxModuleOnRGB) ? 1 : 0;
+      }
+   }
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Draw module size, rotation and perspective for a symbol
+ *
+ * Corners are left relative to the symbol center until it is placed.
+ *
+ * @param  opt runtime options
+ * @param  rng generator state
+ * @param  sym symbol to shape
+ * @return DmtxPass | DmtxFail (perspective folded the symbol)
+ */
+static DmtxPassFail
+ShapeSymbol(UserOptions *opt, GenRandom *rng, GenSymbol *sym)
+{
+   int i;
+   double angle, shift;
+   double width, height;
+   double x, y, u, v, qu, qv;
+   double fit2raw[9], raw2fit[9];
+   static const double unitX[4] = { -0.5, 0.5, 0.5, -0.5 };
+   static const double unitY[4] = { -0.5, -0.5, 0.5, 0.5 };
+
+   sym->module = RandomRange(rng, &(opt->module));
+   angle = RandomRange(rng, &(opt->rotate)) * M_PI / 180.0;
+
+   width = sym->cols * sym->module;
+   height = sym->rows * sym->module;
+   shift = RandomRange(rng, &(opt->perspective)) * ((width > height) ? width : height);
+
+   /* Rotate counterclockwise with y up, then flip to image y down */
+   for(i = 0; i < 4; i++) {
+      x = unitX[i] * width;
+      y = unitY[i] * height;
+      sym->corner[2 * i] = x * cos(angle) - y * sin(angle) +
+            shift * (2.0 * RandomUniform(rng) - 1.0);
+      sym->corner[2 * i + 1] = -(x * sin(angle) + y * cos(angle)) +
+            shift * (2.0 * RandomUniform(rng) - 1.0);
+   }
+
+   SquareToQuad(sym->corner, fit2raw);
+   if(InvertMatrix(fit2raw, raw2fit) != DmtxPass)
+      return DmtxFail;
+
+   /* Radius covers the quiet zone corners as distorted by perspective */
+   qu = (double)DMTXGEN_QUIET_ZONE / sym->cols;
+   qv = (double)DMTXGEN_QUIET_ZONE / sym->rows;
+   sym->radius = 0.0;
+   for(i = 0; i < 4; i++) {
+      u = (unitX[i] < 0.0) ? -qu : 1.0 + qu;
+      v = (unitY[i] < 0.0) ? -qv : 1.0 + qv;
+      MapPoint(fit2raw, u, v, &x, &y);
+      if(sym->radius < sqrt(x * x + y * y))
+         sym->radius = sqrt(x * x + y * y);
+   }
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Find a spot for a symbol clear of those already placed
+ * @param  rng generator state
+ * @param  scene scene being rendered
+ * @param  placed symbols already placed
+ * @param  placedCount number of symbols already placed
+ * @param  sym shaped symbol to place
+ * @return DmtxPass | DmtxFail (no room found)
+ */
+static DmtxPassFail
+PlaceSymbol(GenRandom *rng, GenScene *scene, GenSymbol *placed, int placedCount,
+      GenSymbol *sym)
+{
+   int i, j, tries;
+   double x, y, dx, dy;
+   double fit2raw[9];
+
+   if(2.0 * sym->radius >= scene->width || 2.0 * sym->radius >= scene->height)
+      return DmtxFail;
+
+   for(tries = 0; tries < DMTXGEN_PLACE_TRIES; tries++) {
+      x = sym->radius + RandomUniform(rng) * (scene->width - 2.0 * sym->radius);
+      y = sym->radius + RandomUniform(rng) * (scene->height - 2.0 * sym->radius);
+
+      for(j = 0; j < placedCount; j++) {
+         dx = x - placed[j].centerX;
+         dy = y - placed[j].centerY;
+         if(sqrt(dx * dx + dy * dy) < sym->radius + placed[j].radius)
+            break;
+      }
+      if(j == placedCount)
+         break;
+   }
+
+   if(tries == DMTXGEN_PLACE_TRIES)
+      return DmtxFail;
+
+   sym->centerX = x;
+   sym->centerY = y;
+   for(i = 0; i < 4; i++) {
+      sym->corner[2 * i] += x;
+      sym->corner[2 * i + 1] += y;
+   }
+
+   SquareToQuad(sym->corner, fit2raw);
+
+   return InvertMatrix(fit2raw, sym->raw2fit);
+}
+
+/**
+ * @brief  Projective map from the unit square onto a quadrilateral
+ *
+ * Heckbert's closed form: (0,0) (1,0) (1,1) (0,1) land on the four
+ * corners in order. The matrix is row-major and maps (u,v,1).
+ *
+ * @param  corner x,y of the four corners
+ * @param  m 3x3 matrix to fill
+ * @return void
+ */
+static void
+SquareToQuad(const double *corner, double *m)
+{
+   double dx1, dx2, dx3, dy1, dy2, dy3;
+   double det, g, h;
+   const double *p = corner;
+
+   dx1 = p[2] - p[4];
+   dx2 = p[6] - p[4];
+   dx3 = p[0] - p[2] + p[4] - p[6];
+   dy1 = p[3] - p[5];
+   dy2 = p[7] - p[5];
+   dy3 = p[1] - p[3] + p[5] - p[7];
+
+   det = dx1 * dy2 - dx2 * dy1;
+   if(fabs(dx3) < 1e-9 && fabs(dy3) < 1e-9) {
+      g = h = 0.0;
+   }
+   else if(fabs(det) < 1e-12) {
+      g = h = 0.0;
+   }
+   else {
+      g = (dx3 * dy2 - dx2 * dy3) / det;
+      h = (dx1 * dy3 - dx3 * dy1) / det;
+   }
+
+   m[0] = p[2] - p[0] + g * p[2];
+   m[1] = p[6] - p[0] + h * p[6];
+   m[2] = p[0];
+   m[3] = p[3] - p[1] + g * p[3];
+   m[4] = p[7] - p[1] + h * p[7];
+   m[5] = p[1];
+   m[6] = g;
+   m[7] = h;
+   m[8] = 1.0;
+}
+
+/**
+ * @brief  Invert a 3x3 matrix
+ * @param  m row-major matrix
+ * @param  inv inverse to fill
+ * @return DmtxPass | DmtxFail (singular)
+ */
+static DmtxPassFail
+InvertMatrix(const double *m, double *inv)
+{
+   int i;
+   double det;
+
+   inv[0] = m[4] * m[8] - m[5] * m[7];
+   inv[1] = m[2] * m[7] - m[1] * m[8];
+   inv[2] = m[1] * m[5] - m[2] * m[4];
+   inv[3] = m[5] * m[6] - m[3] * m[8];
+   inv[4] = m[0] * m[8] - m[2] * m[6];
+   inv[5] = m[2] * m[3] - m[0] * m[5];
+   inv[6] = m[3] * m[7] - m[4] * m[6];
+   inv[7] = m[1] * m[6] - m[0] * m[7];
+   inv[8] = m[0] * m[4] - m[1] * m[3];
+
+   det = m[0] * inv[0] + m[1] * inv[3] + m[2] * inv[6];
+   if(fabs(det) < 1e-12)
+      return DmtxFail;
+
+   for(i = 0; i < 9; i++)
+      inv[i] /= det;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Apply a projective map to a point
+ * @param  m row-major 3x3 matrix
+ * @param  u input x
+ * @param  v input y
+ * @param  x output x
+ * @param  y output y
+ * @return void
+ */
+static void
+MapPoint(const double *m, double u, double v, double *x, double *y)
+{
+   double w;
+
+   w = m[6] * u + m[7] * v + m[8];
+   *x = (m[0] * u + m[1] * v + m[2]) / w;
+   *y = (m[3] * u + m[4] * v + m[5]) / w;
+}
+
+/**
+ * @brief  Draw distracting bars, lines and module-like patches
+ * @param  rng generator state
+ * @param  scene scene being rendered
+ * @param  module range of patch module sizes
+ * @param  count number of shapes
+ * @param  ink darkest grey in the scene
+ * @param  paper lightest grey in the scene
+ * @return void
+ */
+static void
+DrawClutter(GenRandom *rng, GenScene *scene, const GenRange *module, int count,
+      float ink, float paper)
+{
+   int i, k, x, y, n;
+   int x0, y0, x1, y1;
+   unsigned char dark[DMTXGEN_PATCH_MAX * DMTXGEN_PATCH_MAX];
+   double ax, ay, bx, by, t, dx, dy, length, thick, step;
+   float level;
+
+   for(i = 0; i < count; i++) {
+      level = ink + (paper - ink) * (float)RandomUniform(rng);
+
+      switch(RandomNext(rng) % 3) {
+         case 0: /* Filled box */
+            x0 = (int)(RandomUniform(rng) * scene->width);
+            y0 = (int)(RandomUniform(rng) * scene->height);
+            x1 = x0 + (int)((0.02 + 0.2 * RandomUniform(rng)) * scene->width);
+            y1 = y0 + (int)((0.02 + 0.2 * RandomUniform(rng)) * scene->height);
+            for(y = y0; y < y1 && y < scene->height; y++)
+               for(x = x0; x < x1 && x < scene->width; x++)
+                  scene->pxl[y * scene->width + x] = level;
+            break;
+
+         case 1: /* Straight line, which looks like a finder edge */
+            ax = RandomUniform(rng) * scene->width;
+            ay = RandomUniform(rng) * scene->height;
+            bx = RandomUniform(rng) * scene->width;
+            by = RandomUniform(rng) * scene->height;
+            thick = 1.0 + 5.0 * RandomUniform(rng);
+            dx = bx - ax;
+            dy = by - ay;
+            length = dx * dx + dy * dy;
+            x0 = (int)(((ax < bx) ? ax : bx) - thick);
+            x1 = (int)(((ax > bx) ? ax : bx) + thick);
+            y0 = (int)(((ay < by) ? ay : by) - thick);
+            y1 = (int)(((ay > by) ? ay : by) + thick);
+            for(y = (y0 > 0) ? y0 : 0; y <= y1 && y < scene->height; y++) {
+               for(x = (x0 > 0) ? x0 : 0; x <= x1 && x < scene->width; x++) {
+                  t = (length > 0.0) ? ((x - ax) * dx + (y - ay) * dy) / length : 0.0;
+                  t = (t < 0.0) ? 0.0 : (t > 1.0) ? 1.0 : t;
+                  if(hypot(x - ax - t * dx, y - ay - t * dy) <= thick / 2.0)
+                     scene->pxl[y * scene->width + x] = level;
+               }
+            }
+            break;
+
+         default: /* Grid of random modules without a finder pattern */
+            n = 6 + (int)(RandomNext(rng) % (DMTXGEN_PATCH_MAX - 5));
+            for(k = 0; k < n * n; k++)
+               dark[k] = (unsigned char)(RandomNext(rng) & 1);
+            step = RandomRange(rng, module);
+            x0 = (int)(RandomUniform(rng) * scene->width);
+            y0 = (int)(RandomUniform(rng) * scene->height);
+            for(y = y0; y < y0 + (int)(n * step) && y < scene->height; y++) {
+               for(x = x0; x < x0 + (int)(n * step) && x < scene->width; x++) {
+                  k = (int)((y - y0) / step) * n + (int)((x - x0) / step);
+                  scene->pxl[y * scene->width + x] = dark[(k < n * n) ? k : n * n - 1] ?
+                        ink : paper;
+               }
+            }
+            break;
+      }
+   }
+}
+
+/**
+ * @brief  Draw a placed symbol and its quiet zone, antialiased
+ *
+ * Each pixel is sampled at four points mapped back into the symbol
+ * unit square, where row 0 is the bottom (finder) row as for
+ * dmtxSymbolModuleStatus(). Samples outside the quiet zone keep the
+ * scene behind the symbol.
+ *
+ * @param  scene scene being rendered
+ * @param  sym placed symbol
+ * @param  ink grey of dark modules
+ * @param  paper grey of light modules and quiet zone
+ * @return void
+ */
+static void
+DrawSymbol(GenScene *scene, const GenSymbol *sym, float ink, float paper)
+{
+   int i, x, y, row, col, hits;
+   int x0, x1, y0, y1;
+   double px, py, u, v, w, qu, qv;
+   float sum;
+   const double *m = sym->raw2fit;
+
+   qu = (double)DMTXGEN_QUIET_ZONE / sym->cols;
+   qv = (double)DMTXGEN_QUIET_ZONE / sym->rows;
+
+   x0 = (int)floor(sym->centerX - sym->radius);
+   x1 = (int)ceil(sym->centerX + sym->radius);
+   y0 = (int)floor(sym->centerY - sym->radius);
+   y1 = (int)ceil(sym->centerY + sym->radius);
+
+   for(y = (y0 > 0) ? y0 : 0; y <= y1 && y < scene->height; y++) {
+      for(x = (x0 > 0) ? x0 : 0; x <= x1 && x < scene->width; x++) {
+         sum = 0.0;
+         hits = 0;
+
+         for(i = 0; i < 4; i++) {
+            px = x + 0.25 + 0.5 * (i & 1);
+            py = y + 0.25 + 0.5 * (i >> 1);
+            w = m[6] * px + m[7] * py + m[8];
+            if(w <= 0.0)
+               continue;
+            u = (m[0] * px + m[1] * py + m[2]) / w;
+            v = (m[3] * px + m[4] * py + m[5]) / w;
+            if(u < -qu || u >= 1.0 + qu || v < -qv || v >= 1.0 + qv)
+               continue;
+
+            hits++;
+            if(u >= 0.0 && u < 1.0 && v >= 0.0 && v < 1.0) {
+               row = (int)(v * sym->rows);
+               col = (int)(u * sym->cols);
+               sum += sym->modules[row * sym->cols + col] ? ink : paper;
+            }
+            else {
+               sum += paper;
+            }
+         }
+
+         if(hits > 0)
+            scene->pxl[y * scene->width + x] =
+                  (scene->pxl[y * scene->width + x] * (4 - hits) + sum) / 4.0f;
+      }
+   }
+}
+
+/**
+ * @brief  Blur a scene with a separable Gaussian
+ * @param  scene scene being rendered
+ * @param  sigma standard deviation in pixels; small values are skipped
+ * @return DmtxPass | DmtxFail (out of memory)
+ */
+static DmtxPassFail
+BlurScene(GenScene *scene, double sigma)
+{
+   int i, k, x, y, radius;
+   int width, height;
+   float sum;
+   float *kernel, *tmp;
+
+   if(sigma < 0.2)
+      return DmtxPass;
+
+   width = scene->width;
+   height = scene->height;
+   radius = (int)ceil(3.0 * sigma);
+
+   kernel = (float *)malloc((2 * radius + 1) * sizeof(float));
+   tmp = (float *)malloc((size_t)width * height * sizeof(float));
+   if(kernel == NULL || tmp == NULL) {
+      free(kernel);
+      free(tmp);
+      return DmtxFail;
+   }
+
+   sum = 0.0f;
+   for(k = -radius; k <= radius; k++) {
+      kernel[k + radius] = (float)exp(-(k * k) / (2.0 * sigma * sigma));
+      sum += kernel[k + radius];
+   }
+   for(k = 0; k <= 2 * radius; k++)
+      kernel[k] /= sum;
+
+   /* Rows into tmp, then columns back, clamping at the edges */
+   for(y = 0; y < height; y++) {
+      for(x = 0; x < width; x++) {
+         sum = 0.0f;
+         for(k = -radius; k <= radius; k++) {
+            i = x + k;
+            i = (i < 0) ? 0 : (i >= width) ? width - 1 : i;
+            sum += kernel[k + radius] * scene->pxl[y * width + i];
+         }
+         tmp[y * width + x] = sum;
+      }
+   }
+
+   for(y = 0; y < height; y++) {
+      for(x = 0; x < width; x++) {
+         sum = 0.0f;
+         for(k = -radius; k <= radius; k++) {
+            i = y + k;
+            i = (i < 0) ? 0 : (i >= height) ? height - 1 : i;
+            sum += kernel[k + radius] * tmp[i * width + x];
+         }
+         scene->pxl[y * width + x] = sum;
+      }
+   }
+
+   free(kernel);
+   free(tmp);
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Add Gaussian sensor noise to a scene
+ * @param  rng generator state
+ * @param  scene scene being rendered
+ * @param  sigma standard deviation in grey levels
+ * @return void
+ */
+static void
+AddNoise(GenRandom *rng, GenScene *scene, double sigma)
+{
+   int i;
+
+   if(sigma <= 0.0)
+      return;
+
+   for(i = 0; i < scene->width * scene->height; i++)
+      scene->pxl[i] += (float)(sigma * RandomGaussian(rng));
+}
+
+/**
+ * @brief  Write a scene as 8-bit grey, natively for PGM, else through ImageMagick
+ * @param  opt runtime options
+ * @param  scene rendered scene
+ * @param  path output file
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+WriteScene(UserOptions *opt, GenScene *scene, const char *path)
+{
+   int i;
+   size_t count;
+   float value;
+   unsigned char *pxl;
+   FILE *fp;
+   MagickWand *wand;
+   DmtxPassFail err;
+
+   count = (size_t)scene->width * scene->height;
+   pxl = (unsigned char *)malloc(count);
+   if(pxl == NULL)
+      return DmtxFail;
+
+   for(i = 0; i < (int)count; i++) {
+      value = scene->pxl[i] + 0.5f;
+      pxl[i] = (value <= 0.0f) ? 0 : (value >= 255.0f) ? 255 : (unsigned char)value;
+   }
+
+   err = DmtxFail;
+   if(strcmp(opt->format, "pgm") == 0) {
+      fp = fopen(path, "wb");
+      if(fp != NULL) {
+         fprintf(fp, "P5\n%d %d\n255\n", scene->width, scene->height);
+         if(fwrite(pxl, 1, count, fp) == count)
+            err = DmtxPass;
+         if(fclose(fp) != 0)
+            err = DmtxFail;
+      }
+   }
+   else {
+      wand = NewMagickWand();
+      if(wand != NULL) {
+         if(MagickConstituteImage(wand, scene->width, scene->height, "I", CharPixel,
+               pxl) != MagickFalse && MagickSetImageFormat(wand, opt->format) != MagickFalse &&
+               MagickWriteImage(wand, path) != MagickFalse)
+            err = DmtxPass;
+         DestroyMagickWand(wand);
+      }
+   }
+
+   free(pxl);
+
+   return err;
+}
+
+/**
+ * @brief  Write a symbol's ground truth as a dmtxread JSON lines record
+ *
+ * Corners and rotation use the same coordinates as dmtxread --corners:
+ * pixel centers, y down from the top row.
+ *
+ * @param  fp truth.jsonl
+ * @param  path scene file
+ * @param  sym placed symbol
+ * @return void
+ */
+static void
+WriteTruth(FILE *fp, const char *path, const GenSymbol *sym)
+{
+   int i;
+   int rotation;
+   int dataWords;
+   const double *p = sym->corner;
+
+   dataWords = dmtxGetSymbolAttribute(DmtxSymAttribSymbolDataWords, sym->sizeIdx);
+
+   rotation = (int)((2 * M_PI + atan2(p[1] - p[3], p[2] - p[0])) * 180 / M_PI + 0.5);
+   rotation %= 360;
+
+   fputs("{\"file\":", fp);
+   WriteJsonString(fp, (const unsigned char *)path, strlen(path));
+   fputs(",\"page\":1,\"message\":", fp);
+   WriteJsonString(fp, sym->message, sym->messageLength);
+   fprintf(fp, ",\"matrix_size\":\"%dx%d\",\"data_codewords\":%d,\"capacity\":%d,"
+         "\"error_codewords\":%d,\"data_regions_count\":%d,\"interleaved_blocks\":%d,"
+         "\"rotation\":%d,\"corners\":[",
+         sym->rows, sym->cols, dataWords - sym->padCount, dataWords,
+         dmtxGetSymbolAttribute(DmtxSymAttribSymbolErrorWords, sym->sizeIdx),
+         dmtxGetSymbolAttribute(DmtxSymAttribHorizDataRegions, sym->sizeIdx) *
+         dmtxGetSymbolAttribute(DmtxSymAttribVertDataRegions, sym->sizeIdx),
+         dmtxGetSymbolAttribute(DmtxSymAttribInterleavedBlocks, sym->sizeIdx),
+         rotation);
+   for(i = 0; i < 4; i++)
+      fprintf(fp, "%s[%0.1f,%0.1f]", (i == 0) ? "" : ",", p[2 * i] - 0.5, p[2 * i + 1] - 0.5);
+   fprintf(fp, "],\"time_ms\":0,\"module_size\":%0.2f}\n", sym->module);
+}
+
+/**
+ * @brief  Write bytes as a quoted JSON string
+ * @param  fp output stream
+ * @param  str bytes to write
+ * @param  length number of bytes
+ * @return void
+ */
+static void
+WriteJsonString(FILE *fp, const unsigned char *str, int length)
+{
+   int i;
+
+   fputc('"', fp);
+   for(i = 0; i < length; i++) {
+      if(str[i] == '"' || str[i] == '\\')
+         fprintf(fp, "\\%c", str[i]);
+      else if(str[i] < 0x20)
+         fprintf(fp, "\\u%04x", str[i]);
+      else
+         fputc(str[i], fp);
+   }
+   fputc('"', fp);
+}
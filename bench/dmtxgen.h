@@ -0,0 +1,188 @@
+/*
+libdmtx - Data Matrix Encoding/Decoding Library
+
+Copyright (C) 2008, 2009 Mike Laughton
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+Contact: mike@dragonflylogic.com
+*/
+
+#ifndef __DMTXGEN_H__
+#define __DMTXGEN_H__
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <errno.h>
+#include <math.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <dmtx.h>
+#include "../common/dmtxutil.h"
+
+#ifdef IM_API_7
+#include <MagickWand/MagickWand.h>
+#else
+#include <wand/magick-wand.h>
+#endif
+
+#if ENABLE_NLS
+# include <libintl.h>
+# define _(String) gettext(String)
+#else
+# define _(String) String
+#endif
+#define N_(String) String
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/* Longest message tried for one symbol; larger sizes are filled partly */
+#define DMTXGEN_MESSAGE_MAX 1024
+
+/* Digits of the serial number that starts every message */
+#define DMTXGEN_SERIAL_DIGITS 6
+
+/* Modules in the largest symbol (144x144) */
+#define DMTXGEN_MODULES_MAX (144 * 144)
+
+/* Most symbols --symbols places in one scene */
+#define DMTXGEN_SYMBOLS_MAX 256
+
+/* Modules across the largest clutter patch */
+#define DMTXGEN_PATCH_MAX 20
+
+/* Modules of quiet zone printed around each symbol */
+#define DMTXGEN_QUIET_ZONE 2
+
+/* Attempts at a free spot for one symbol before leaving it out */
+#define DMTXGEN_PLACE_TRIES 200
+
+/* Long options without a single character equivalent */
+enum {
+   OptWidth = 256,
+   OptHeight,
+   OptPerspective,
+   OptBlur,
+   OptNoise,
+   OptContrast,
+   OptClutter,
+   OptSeed
+};
+
+/* Closed interval a scene parameter is drawn from */
+typedef struct {
+   double min;
+   double max;
+} GenRange;
+
+typedef struct {
+   int scenes;          /* -n, --scenes */
+   GenRange symbols;    /* -k, --symbols */
+   int sizeIdx[DmtxSymbolSquareCount + DmtxSymbolRectCount]; /* -s, --symbol-size */
+   int sizeCount;
+   int scheme;          /* -e, --encoding */
+   char *format;        /* -f, --format */
+   GenRange width;      /*     --width */
+   GenRange height;     /*     --height */
+   GenRange module;     /* -d, --module */
+   GenRange rotate;     /* -R, --rotate */
+   GenRange perspective; /*    --perspective */
+   GenRange blur;       /*     --blur */
+   GenRange noise;      /*     --noise */
+   GenRange contrast;   /*     --contrast */
+   GenRange clutter;    /*     --clutter */
+   unsigned long seed;  /*     --seed */
+   int verbose;         /* -v, --verbose */
+   char *directory;
+} UserOptions;
+
+/* Seeded random number generator (xorshift128) */
+typedef struct {
+   unsigned long s[4];
+} GenRandom;
+
+/* Symbol as placed in a scene, in image coordinates (y down) */
+typedef struct {
+   int sizeIdx;
+   int rows;
+   int cols;
+   int padCount;
+   unsigned char message[DMTXGEN_MESSAGE_MAX];
+   int messageLength;
+   double module;       /* pixels per module before perspective */
+   double centerX;
+   double centerY;
+   double radius;       /* bounds symbol and quiet zone */
+   double corner[8];    /* x,y of symbol corners (0,0) (1,0) (1,1) (0,1) */
+   double raw2fit[9];   /* image point to symbol unit square */
+   unsigned char modules[DMTXGEN_MODULES_MAX]; /* 1 for dark, bottom row first */
+} GenSymbol;
+
+/* Corpus being written, shared by all scenes */
+typedef struct {
+   UserOptions *opt;
+   DmtxEncode *enc;
+   FILE *fpTruth;       /* truth.jsonl */
+   FILE *fpManifest;    /* manifest.txt */
+   char *path;          /* scene file name buffer */
+   long serial;         /* next message serial number */
+   long sizeCursor;     /* next entry of opt->sizeIdx */
+   long symbolCount;    /* symbols written */
+   long leftOut;        /* symbols that could not be encoded or placed */
+} GenCorpus;
+
+/* Grey scene being rendered */
+typedef struct {
+   int width;
+   int height;
+   float *pxl;
+} GenScene;
+
+static void SetOptionDefaults(UserOptions *opt);
+static DmtxPassFail HandleArgs(UserOptions *opt, int *argcp, char **argvp[]);
+static DmtxPassFail ParseRange(GenRange *range, char *s, double min, double max);
+static DmtxPassFail ParseSymbolSizes(UserOptions *opt, char *s);
+static void ShowUsage(int status);
+static void RandomSeed(GenRandom *rng, unsigned long seed, unsigned long stream);
+static unsigned long RandomNext(GenRandom *rng);
+static double RandomUniform(GenRandom *rng);
+static double RandomRange(GenRandom *rng, const GenRange *range);
+static double RandomGaussian(GenRandom *rng);
+static void GenerateScene(GenCorpus *corpus, int sceneIdx);
+static DmtxPassFail EncodeSymbol(GenCorpus *corpus, GenRandom *rng, int sizeIdx,
+      GenSymbol *sym);
+static DmtxPassFail ShapeSymbol(UserOptions *opt, GenRandom *rng, GenSymbol *sym);
+static DmtxPassFail PlaceSymbol(GenRandom *rng, GenScene *scene, GenSymbol *placed,
+      int placedCount, GenSymbol *sym);
+static void SquareToQuad(const double *corner, double *m);
+static DmtxPassFail InvertMatrix(const double *m, double *inv);
+static void MapPoint(const double *m, double u, double v, double *x, double *y);
+static void DrawClutter(GenRandom *rng, GenScene *scene, const GenRange *module, int count,
+      float ink, float paper);
+static void DrawSymbol(GenScene *scene, const GenSymbol *sym, float ink, float paper);
+static DmtxPassFail BlurScene(GenScene *scene, double sigma);
+static void AddNoise(GenRandom *rng, GenScene *scene, double sigma);
+static DmtxPassFail WriteScene(UserOptions *opt, GenScene *scene, const char *path);
+static void WriteTruth(FILE *fp, const char *path, const GenSymbol *sym);
+static void WriteJsonString(FILE *fp, const unsigned char *str, int length);
+
+#endif
@@ -0,0 +1,865 @@
+/*
+libdmtx - Data Matrix Encoding/Decoding Library
+
+Copyright (C) 2008, 2009 Mike Laughton
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+Contact: mike@dragonflylogic.com
+*/
+
+/**
+ * @file dmtxload.c
+ * @brief Open-loop load generator for dmtxread
+ *
+ * Starts one dmtxread process per arrival, cycling through the files
+ * given, at a fixed or Poisson rate that does not slow down when
+ * dmtxread falls behind. Latency is measured from the scheduled
+ * arrival, so time spent waiting for a free process slot, or for the
+ * generator itself, counts against dmtxread as a camera would see it.
+ *
+ * Each file is named on the dmtxread command line by default. With
+ * --stdin it is piped into dmtxread instead, as a capture process
+ * handing over frames would, so the stream input path is measured
+ * with the cost of the copy through the pipe.
+ */
+
+#include "dmtxload.h"
+
+char *programName;
+
+/* Written by the SIGCHLD handler to wake the poll() of RunRate() */
+static int wakeFd[2] = { -1, -1 };
+
+/**
+ * @brief  Main function for the dmtxload load generator.
+ * @param  argc count of arguments passed from command line
+ * @param  argv list of argument passed strings from command line
+ * @return Numeric exit code
+ */
+int
+main(int argc, char *argv[])
+{
+   int i, err, step, refine;
+   double good, bad, rate;
+   FILE *fpHistogram;
+   UserOptions opt;
+   LoadResult result;
+
+   SetOptionDefaults(&opt);
+
+   err = HandleArgs(&opt, &argc, &argv);
+   if(err != DmtxPass)
+      ShowUsage(EX_USAGE);
+
+   if(pipe(wakeFd) != 0)
+      FatalError(EX_OSERR, _("Unable to create pipe"));
+   for(i = 0; i < 2; i++) {
+      fcntl(wakeFd[i], F_SETFL, fcntl(wakeFd[i], F_GETFL) | O_NONBLOCK);
+      fcntl(wakeFd[i], F_SETFD, FD_CLOEXEC);
+   }
+   signal(SIGCHLD, HandleSigChld);
+
+   fpHistogram = NULL;
+   if(opt.histogramPath != NULL) {
+      fpHistogram = fopen(opt.histogramPath, "wb");
+      if(fpHistogram == NULL)
+         FatalError(EX_CANTCREAT, _("Unable to create \"%s\""), opt.histogramPath);
+   }
+
+   fprintf(stdout, _("dmtxread%s%s: %d files, %s arrivals, %g s per rate after %g s warmup\n"),
+         (opt.options[0] == '\0') ? "" : " ", opt.options, opt.fileCount, (opt.poisson == DmtxTrue) ? _("Poisson") : _("fixed"),
+         opt.duration, opt.warmup);
+   PrintHeader();
+
+   /* Listed rates, then with --ramp doubling (or halving) and bisection */
+   good = bad = 0.0;
+   refine = opt.refine;
+   for(step = 0; step < opt.rateCount + 64; step++) {
+      if(step < opt.rateCount)
+         rate = opt.rate[step];
+      else if(opt.ramp == DmtxFalse)
+         break;
+      else if(bad == 0.0 && good > 0.0 && good * 2.0 <= opt.rateMax)
+         rate = good * 2.0;
+      else if(good == 0.0 && bad > 0.0 && bad / 2.0 >= 0.01)
+         rate = bad / 2.0;
+      else if(good > 0.0 && bad > 0.0 && refine-- > 0)
+         rate = (good + bad) / 2.0;
+      else
+         break;
+
+      RunRate(&opt, rate, &result);
+      PrintResult(&result);
+      if(fpHistogram != NULL)
+         WriteHistogram(fpHistogram, &result);
+
+      if(result.sustained == DmtxTrue)
+         good = (rate > good && (bad == 0.0 || rate < bad)) ? rate : good;
+      else
+         bad = (bad == 0.0 || rate < bad) ? rate : bad;
+   }
+
+   if(fpHistogram != NULL && fclose(fpHistogram) != 0)
+      FatalError(EX_IOERR, _("Unable to write \"%s\""), opt.histogramPath);
+
+   /* Saturation: the highest rate kept up with, below the lowest that was not */
+   if(good > 0.0 && bad > 0.0)
+      fprintf(stdout, _("Saturation between %g/s (sustained) and %g/s (not sustained)\n"),
+            good, bad);
+   else if(good > 0.0)
+      fprintf(stdout, _("Not saturated: %g/s sustained\n"), good);
+   else
+      fprintf(stdout, _("Saturated below %g/s\n"), bad);
+
+   exit(EX_OK);
+}
+
+/**
+ * @brief  Set default option values
+ * @param  opt runtime options
+ * @return void
+ */
+static void
+SetOptionDefaults(UserOptions *opt)
+{
+   memset(opt, 0x00, sizeof(UserOptions));
+
+   opt->dmtxread = "dmtxread";
+   opt->argc = 0;
+   opt->options = "";
+   opt->rate[0] = 10.0;
+   opt->rateCount = 1;
+   opt->poisson = DmtxFalse;
+   opt->duration = 10.0;
+   opt->warmup = 1.0;
+   opt->inFlightMax = 64;
+   opt->ramp = DmtxFalse;
+   opt->rateMax = 10000.0;
+   opt->refine = 3;
+   opt->maxP99 = 0.0;
+   opt->tolerance = 0.05;
+   opt->histogramPath = NULL;
+   opt->seed = 1;
+   opt->useStdin = DmtxFalse;
+   opt->verbose = DmtxFalse;
+   opt->files = NULL;
+   opt->fileCount = 0;
+}
+
+/**
+ * @brief  Set and validate user-requested options from command line arguments.
+ * @param  opt runtime options from defaults or command line
+ * @param  argcp pointer to argument count
+ * @param  argvp pointer to argument list
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+HandleArgs(UserOptions *opt, int *argcp, char **argvp[])
+{
+   int err;
+   int optchr;
+   int longIndex;
+   char *ptr;
+
+   struct option longOptions[] = {
+         {"dmtxread",         required_argument, NULL, 'r'},
+         {"options",          required_argument, NULL, 'O'},
+         {"rate",             required_argument, NULL, 'R'},
+         {"poisson",          no_argument,       NULL, 'P'},
+         {"duration",         required_argument, NULL, 't'},
+         {"warmup",           required_argument, NULL, 'w'},
+         {"in-flight",        required_argument, NULL, 'j'},
+         {"ramp",             no_argument,       NULL, OptRamp},
+         {"rate-max",         required_argument, NULL, OptRateMax},
+         {"refine",           required_argument, NULL, OptRefine},
+         {"max-p99",          required_argument, NULL, OptMaxP99},
+         {"tolerance",        required_argument, NULL, OptTolerance},
+         {"histogram",        required_argument, NULL, OptHistogram},
+         {"seed",             required_argument, NULL, OptSeed},
+         {"stdin",            no_argument,       NULL, OptStdin},
+         {"verbose",          no_argument,       NULL, 'v'},
+         {"version",          no_argument,       NULL, 'V'},
+         {"help",             no_argument,       NULL,  0 },
+         {0, 0, 0, 0}
+   };
+
+   programName = Basename((*argvp)[0]);
+
+   for(;;) {
+      optchr = getopt_long(*argcp, *argvp, "r:O:R:Pt:w:j:vV", longOptions, &longIndex);
+      if(optchr == -1)
+         break;
+
+      switch(optchr) {
+         case 0: /* --help */
+            ShowUsage(EX_OK);
+            break;
+         case 'r':
+            opt->dmtxread = optarg;
+            break;
+         case 'O':
+            if(SplitOptions(opt, optarg) != DmtxPass)
+               FatalError(EX_USAGE, _("Too many dmtxread options \"%s\""), optarg);
+            break;
+         case 'R':
+            if(ParseRates(opt, optarg) != DmtxPass)
+               FatalError(EX_USAGE, _("Invalid rate specified \"%s\""), optarg);
+            break;
+         case 'P':
+            opt->poisson = DmtxTrue;
+            break;
+         case 't':
+            opt->duration = strtod(optarg, &ptr);
+            if(ptr == optarg || *ptr != '\0' || opt->duration <= 0.0)
+               FatalError(EX_USAGE, _("Invalid duration specified \"%s\""), optarg);
+            break;
+         case 'w':
+            opt->warmup = strtod(optarg, &ptr);
+            if(ptr == optarg || *ptr != '\0' || opt->warmup < 0.0)
+               FatalError(EX_USAGE, _("Invalid warmup specified \"%s\""), optarg);
+            break;
+         case 'j':
+            err = StringToInt(&(opt->inFlightMax), optarg, &ptr);
+            if(err != DmtxPass || opt->inFlightMax < 1 || opt->inFlightMax > 4096 ||
+                  *ptr != '\0')
+               FatalError(EX_USAGE, _("Invalid process count specified \"%s\""), optarg);
+            break;
+         case OptRamp:
+            opt->ramp = DmtxTrue;
+            break;
+         case OptRateMax:
+            opt->rateMax = strtod(optarg, &ptr);
+            if(ptr == optarg || *ptr != '\0' || opt->rateMax <= 0.0)
+               FatalError(EX_USAGE, _("Invalid rate specified \"%s\""), optarg);
+            break;
+         case OptRefine:
+            err = StringToInt(&(opt->refine), optarg, &ptr);
+            if(err != DmtxPass || opt->refine < 0 || *ptr != '\0')
+               FatalError(EX_USAGE, _("Invalid refine count specified \"%s\""), optarg);
+            break;
+         case OptMaxP99:
+            opt->maxP99 = strtod(optarg, &ptr);
+            if(ptr == optarg || *ptr != '\0' || opt->maxP99 <= 0.0)
+               FatalError(EX_USAGE, _("Invalid latency specified \"%s\""), optarg);
+            break;
+         case OptTolerance:
+            opt->tolerance = strtod(optarg, &ptr) / 100.0;
+            if(*ptr == '%')
+               ptr++;
+            if(ptr == optarg || *ptr != '\0' || opt->tolerance < 0.0 || opt->tolerance >= 1.0)
+               FatalError(EX_USAGE, _("Invalid tolerance specified \"%s\""), optarg);
+            break;
+         case OptHistogram:
+            opt->histogramPath = optarg;
+            break;
+         case OptSeed:
+            errno = 0;
+            opt->seed = strtoul(optarg, &ptr, 10);
+            if(errno != 0 || ptr == optarg || *ptr != '\0')
+               FatalError(EX_USAGE, _("Invalid seed specified \"%s\""), optarg);
+            break;
+         case OptStdin:
+            opt->useStdin = DmtxTrue;
+            break;
+         case 'v':
+            opt->verbose = DmtxTrue;
+            break;
+         case 'V':
+            fprintf(stderr, "%s version %s\n", programName, DmtxVersion);
+            fprintf(stderr, "libdmtx version %s\n", dmtxVersion());
+            exit(0);
+            break;
+         default:
+            return DmtxFail;
+            break;
+      }
+   }
+
+   if(optind == *argcp)
+      return DmtxFail;
+
+   opt->files = *argvp + optind;
+   opt->fileCount = *argcp - optind;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Parse a comma separated list of rates per second
+ * @param  opt runtime options
+ * @param  s list
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+ParseRates(UserOptions *opt, char *s)
+{
+   double rate;
+   char *ptr;
+
+   opt->rateCount = 0;
+
+   while(*s != '\0') {
+      rate = strtod(s, &ptr);
+      if(ptr == s || rate <= 0.0 || (*ptr != ',' && *ptr != '\0') ||
+            opt->rateCount == LOAD_RATE_MAX)
+         return DmtxFail;
+      opt->rate[opt->rateCount++] = rate;
+
+      s = (*ptr == ',') ? ptr + 1 : ptr;
+   }
+
+   return (opt->rateCount > 0) ? DmtxPass : DmtxFail;
+}
+
+/**
+ * @brief  Split dmtxread options at blanks, without quoting
+ * @param  opt runtime options
+ * @param  s options
+ * @return DmtxPass | DmtxFail (too many options)
+ */
+static DmtxPassFail
+SplitOptions(UserOptions *opt, char *s)
+{
+   char *copy, *ptr;
+
+   opt->options = s;
+
+   copy = strdup(s);
+   if(copy == NULL)
+      FatalError(EX_OSERR, _("Out of memory"));
+
+   opt->argc = 0;
+   for(ptr = strtok(copy, " \t"); ptr != NULL; ptr = strtok(NULL, " \t")) {
+      if(opt->argc == LOAD_OPTION_MAX)
+         return DmtxFail;
+      opt->argv[opt->argc++] = ptr;
+   }
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Display program usage and exit with received status.
+ * @param  status error code returned to OS
+ * @return void
+ */
+static void
+ShowUsage(int status)
+{
+   if(status != 0) {
+      fprintf(stderr, _("Usage: %s [OPTION]... FILE...\n"), programName);
+      fprintf(stderr, _("Try `%s --help' for more information.\n"), programName);
+   }
+   else {
+      fprintf(stderr, _("Usage: %s [OPTION]... FILE...\n"), programName);
+      fprintf(stderr, _("\
+Start one dmtxread process per arrival, cycling through FILEs, at each rate,\n\
+and report latency from the scheduled arrival (corrected for coordinated\n\
+omission) next to the service time of the process alone. A rate is sustained\n\
+when completions keep up with arrivals within --tolerance and, with --max-p99,\n\
+the corrected p99 stays within it.\n\
+\n\
+Example: %s -O \"-S2 -m500\" -R 5 --ramp corpus/*.pgm\n\
+\n\
+OPTIONS:\n"), programName);
+      fprintf(stderr, _("\
+  -r, --dmtxread=PATH         dmtxread to run (default: from PATH)\n\
+  -O, --options=OPTIONS       dmtxread options, split at blanks\n\
+  -R, --rate=LIST             arrivals per second, comma separated (default 10)\n\
+  -P, --poisson               Poisson arrivals instead of fixed intervals\n\
+  -t, --duration=SECONDS      measured time per rate (default 10)\n\
+  -w, --warmup=SECONDS        unmeasured time before it (default 1)\n\
+  -j, --in-flight=N           most dmtxread processes at once (default 64)\n"));
+      fprintf(stderr, _("\
+      --ramp                  after the listed rates, double the rate until it\n\
+                              is not sustained, then bisect to the saturation\n\
+                              point\n\
+      --rate-max=N            highest rate --ramp tries (default 10000)\n\
+      --refine=N              bisection steps of --ramp (default 3)\n\
+      --max-p99=MS            corrected p99 a sustained rate must stay within\n\
+      --tolerance=PCT         completion rate shortfall allowed (default 5%%)\n\
+      --histogram=FILE        write the latency distribution of each rate\n\
+      --seed=N                Poisson arrival seed (default 1)\n\
+      --stdin                 pipe each file into dmtxread instead of naming\n\
+                              it on the command line\n\
+  -v, --verbose               show dmtxread errors\n\
+  -V, --version               print version information\n\
+      --help                  display this help and exit\n"));
+      fprintf(stderr, _("\nReport bugs to <mike@dragonflylogic.com>.\n"));
+   }
+
+   exit(status);
+}
+
+/**
+ * @brief  Wake the main loop when a dmtxread process exits
+ * @param  sig signal received
+ * @return void
+ */
+static void
+HandleSigChld(int sig)
+{
+   int savedErrno;
+   ssize_t written;
+
+   savedErrno = errno;
+   written = write(wakeFd[1], "", 1);
+   (void)written;
+   errno = savedErrno;
+}
+
+/**
+ * @brief  Offer one rate of arrivals and measure how dmtxread keeps up
+ *
+ * Arrivals are scheduled from the start of the run alone. One that is
+ * due while --in-flight processes are running waits, and its wait is
+ * part of its latency. Arrivals still waiting when twice the run time
+ * has passed are dropped and recorded with the latency they had then.
+ *
+ * @param  opt runtime options
+ * @param  rate arrivals per second
+ * @param  result measurements to fill
+ * @return void
+ */
+static void
+RunRate(UserOptions *opt, double rate, LoadResult *result)
+{
+   int i, inFlight, fileIndex, timeout;
+   double now, next, end, giveUp, lastDone;
+   char drain[64];
+   DmtxTime start;
+   LoadRequest *requests;
+   struct pollfd fds;
+
+   memset(result, 0x00, sizeof(LoadResult));
+   result->offered = rate;
+
+   requests = (LoadRequest *)calloc(opt->inFlightMax, sizeof(LoadRequest));
+   if(requests == NULL)
+      FatalError(EX_OSERR, _("Out of memory"));
+
+   end = opt->warmup + opt->duration;
+   giveUp = 2.0 * end;
+   inFlight = fileIndex = 0;
+   lastDone = opt->warmup;
+   next = 0.0;
+
+   start = dmtxTimeNow();
+
+   for(;;) {
+      now = SecondsSince(start);
+      inFlight -= ReapRequests(opt, requests, opt->inFlightMax, now, result, &lastDone);
+
+      /* Start every arrival that is due, while process slots are free */
+      while(next < end && next <= now && inFlight < opt->inFlightMax && now < giveUp) {
+         for(i = 0; requests[i].pid != 0; i++)
+            ;
+         requests[i].intended = next;
+         requests[i].started = now;
+         StartRequest(opt, &requests[i], fileIndex);
+         fileIndex = (fileIndex + 1) % opt->fileCount;
+         inFlight++;
+
+         if(next >= opt->warmup) {
+            result->sent++;
+            if(now - next > result->lagMax)
+               result->lagMax = now - next;
+         }
+         if(inFlight > result->inFlightPeak)
+            result->inFlightPeak = inFlight;
+
+         next = NextArrival(opt, rate, next);
+         now = SecondsSince(start);
+      }
+
+      if(now >= giveUp) {
+         for(; next < end; next = NextArrival(opt, rate, next)) {
+            if(next >= opt->warmup) {
+               result->dropped++;
+               HistogramAdd(&result->latency, now - next);
+            }
+         }
+      }
+
+      if(next >= end && inFlight == 0)
+         break;
+
+      /* Sleep until the next arrival is due, or a process exits */
+      if(next < end && inFlight < opt->inFlightMax)
+         timeout = (int)ceil((next - now) * 1000.0);
+      else
+         timeout = 1000;
+
+      fds.fd = wakeFd[0];
+      fds.events = POLLIN;
+      fds.revents = 0;
+      if(timeout > 0 && poll(&fds, 1, timeout) == -1 && errno != EINTR)
+         FatalError(EX_OSERR, _("Unable to wait for dmtxread"));
+
+      while(read(wakeFd[0], drain, sizeof(drain)) > 0)
+         ;
+   }
+
+   result->achieved = (lastDone > opt->warmup) ? result->done / (lastDone - opt->warmup) : 0.0;
+
+   /* Kept up: started every arrival, and completed them nearly as fast as
+    * they arrived (Poisson arrivals only average the offered rate) */
+   result->sustained = (result->dropped == 0 && result->achieved >=
+         (1.0 - opt->tolerance) * result->sent / opt->duration) ? DmtxTrue : DmtxFalse;
+   if(opt->maxP99 > 0.0 && HistogramPercentile(&result->latency, 99.0) > opt->maxP99)
+      result->sustained = DmtxFalse;
+
+   free(requests);
+}
+
+/**
+ * @brief  Start dmtxread on one file
+ *
+ * With --stdin the process started is a feeder that pipes the file into
+ * dmtxread and exits with its status, so it is reaped and timed the same.
+ *
+ * @param  opt runtime options
+ * @param  request request slot to fill with the process id
+ * @param  fileIndex file to scan
+ * @return void
+ */
+static void
+StartRequest(UserOptions *opt, LoadRequest *request, int fileIndex)
+{
+   int i, argc, fd;
+   char *argv[LOAD_OPTION_MAX + 3];
+
+   argc = 0;
+   argv[argc++] = opt->dmtxread;
+   for(i = 0; i < opt->argc; i++)
+      argv[argc++] = opt->argv[i];
+   if(opt->useStdin == DmtxFalse)
+      argv[argc++] = opt->files[fileIndex];
+   argv[argc] = NULL;
+
+   request->pid = fork();
+   if(request->pid == -1)
+      FatalError(EX_OSERR, _("Unable to start dmtxread"));
+
+   if(request->pid == 0) {
+      fd = open("/dev/null", O_WRONLY);
+      if(fd != -1) {
+         dup2(fd, STDOUT_FILENO);
+         if(opt->verbose == DmtxFalse)
+            dup2(fd, STDERR_FILENO);
+      }
+      if(opt->useStdin == DmtxTrue)
+         FeedRequest(argv, opt->files[fileIndex]);
+      execvp(argv[0], argv);
+      _exit(127);
+   }
+}
+
+/**
+ * @brief  Run dmtxread on a pipe and copy a file into it (child process)
+ * @param  argv dmtxread command line, without a file
+ * @param  path file to copy
+ * @return Never returns: exits with the status of dmtxread
+ */
+static void
+FeedRequest(char *argv[], const char *path)
+{
+   int fd, status, pipeFd[2];
+   char buf[65536];
+   ssize_t bytesRead, bytesWritten, offset;
+   pid_t pid;
+
+   signal(SIGCHLD, SIG_DFL);
+   signal(SIGPIPE, SIG_IGN);
+
+   if(pipe(pipeFd) != 0)
+      _exit(EX_OSERR);
+
+   pid = fork();
+   if(pid == -1)
+      _exit(EX_OSERR);
+
+   if(pid == 0) {
+      dup2(pipeFd[0], STDIN_FILENO);
+      close(pipeFd[0]);
+      close(pipeFd[1]);
+      signal(SIGPIPE, SIG_DFL);
+      execvp(argv[0], argv);
+      _exit(127);
+   }
+   close(pipeFd[0]);
+
+   /* A dmtxread that stops reading early only ends the copy */
+   fd = open(path, O_RDONLY);
+   while(fd != -1 && (bytesRead = read(fd, buf, sizeof(buf))) > 0) {
+      for(offset = 0; offset < bytesRead; offset += bytesWritten) {
+         bytesWritten = write(pipeFd[1], buf + offset, bytesRead - offset);
+         if(bytesWritten <= 0)
+            break;
+      }
+      if(offset < bytesRead)
+         break;
+   }
+   close(pipeFd[1]);
+
+   while(waitpid(pid, &status, 0) == -1)
+      if(errno != EINTR)
+         _exit(EX_OSERR);
+
+   if(fd == -1)
+      _exit(EX_NOINPUT);
+   if(WIFEXITED(status))
+      _exit(WEXITSTATUS(status));
+   _exit(128 + WTERMSIG(status));
+}
+
+/**
+ * @brief  Collect the dmtxread processes that have exited
+ * @param  opt runtime options
+ * @param  requests request slots
+ * @param  count number of request slots
+ * @param  now seconds from the start of the run
+ * @param  result measurements to add to
+ * @param  lastDone latest completion of a measured arrival
+ * @return Number of processes collected
+ */
+static int
+ReapRequests(UserOptions *opt, LoadRequest *requests, int count, double now,
+      LoadResult *result, double *lastDone)
+{
+   int i, status, reaped;
+   pid_t pid;
+
+   for(reaped = 0; (pid = waitpid(-1, &status, WNOHANG)) > 0; reaped++) {
+      for(i = 0; i < count && requests[i].pid != pid; i++)
+         ;
+      if(i == count)
+         continue;
+      requests[i].pid = 0;
+
+      if(WIFEXITED(status) && WEXITSTATUS(status) == 127)
+         FatalError(EX_UNAVAILABLE, _("Unable to run \"%s\""), opt->dmtxread);
+
+      if(requests[i].intended < opt->warmup)
+         continue;
+
+      /* No barcode (1) and a missed deadline are answers too */
+      if(!WIFEXITED(status) || (WEXITSTATUS(status) != EX_OK && WEXITSTATUS(status) != 1 &&
+            WEXITSTATUS(status) != EX_TEMPFAIL))
+         result->errors++;
+
+      result->done++;
+      HistogramAdd(&result->latency, now - requests[i].intended);
+      HistogramAdd(&result->service, now - requests[i].started);
+      if(now > *lastDone)
+         *lastDone = now;
+   }
+
+   return reaped;
+}
+
+/**
+ * @brief  Schedule the arrival after one
+ * @param  opt runtime options
+ * @param  rate arrivals per second
+ * @param  previous scheduled time of the previous arrival
+ * @return Scheduled time of the next arrival, seconds from the start
+ */
+static double
+NextArrival(UserOptions *opt, double rate, double previous)
+{
+   static unsigned long x = 0;
+   double u;
+
+   if(opt->poisson == DmtxFalse)
+      return previous + 1.0 / rate;
+
+   if(x == 0)
+      x = (opt->seed * 2654435761UL + 1) & 0xffffffffUL;
+
+   /* xorshift32, then an exponential gap */
+   x ^= (x << 13) & 0xffffffffUL;
+   x ^= x >> 17;
+   x ^= (x << 5) & 0xffffffffUL;
+   u = ((x >> 8) + 1.0) / 16777217.0;
+
+   return previous - log(u) / rate;
+}
+
+/**
+ * @brief  Seconds elapsed since a time
+ * @param  start earlier time
+ * @return Seconds
+ */
+static double
+SecondsSince(DmtxTime start)
+{
+   DmtxTime now;
+
+   now = dmtxTimeNow();
+
+   return (double)(now.sec - start.sec) + ((double)now.usec - (double)start.usec) / 1e6;
+}
+
+/**
+ * @brief  Count a latency
+ * @param  histogram histogram
+ * @param  seconds latency
+ * @return void
+ */
+static void
+HistogramAdd(LoadHistogram *histogram, double seconds)
+{
+   long usec;
+
+   usec = (seconds > 0.0) ? (long)(seconds * 1e6 + 0.5) : 0;
+
+   histogram->count[GetHistogramBin(usec)]++;
+   histogram->total++;
+   if(usec > histogram->max)
+      histogram->max = usec;
+}
+
+/**
+ * @brief  Histogram bin of a latency
+ * @param  usec microseconds
+ * @return Bin, 0 to LOAD_HISTOGRAM_BINS - 1
+ */
+static int
+GetHistogramBin(long usec)
+{
+   int bin, e;
+
+   if(usec < 64)
+      return (usec < 0) ? 0 : (int)usec;
+
+   for(e = 6; e < 36 && (usec >> (e + 1)) != 0; e++)
+      ;
+
+   bin = 64 + (e - 6) * 16 + (int)((usec >> (e - 4)) & 15);
+
+   return (bin < LOAD_HISTOGRAM_BINS) ? bin : LOAD_HISTOGRAM_BINS - 1;
+}
+
+/**
+ * @brief  Longest latency falling in a histogram bin
+ * @param  bin histogram bin
+ * @return Microseconds
+ */
+static long
+GetBinLimit(int bin)
+{
+   int e;
+
+   if(bin < 64)
+      return bin;
+
+   e = 6 + (bin - 64) / 16;
+
+   return ((long)(16 + (bin - 64) % 16 + 1) << (e - 4)) - 1;
+}
+
+/**
+ * @brief  Latency below which a share of the arrivals completed
+ * @param  histogram histogram
+ * @param  percent share, 0 to 100
+ * @return Milliseconds, rounded up to the end of its bin, at most the maximum
+ */
+static double
+HistogramPercentile(const LoadHistogram *histogram, double percent)
+{
+   int bin;
+   long seen, rank, limit;
+
+   if(histogram->total == 0)
+      return 0.0;
+
+   rank = (long)ceil(percent / 100.0 * histogram->total);
+   if(rank < 1)
+      rank = 1;
+
+   for(bin = 0, seen = 0; bin < LOAD_HISTOGRAM_BINS - 1; bin++) {
+      seen += histogram->count[bin];
+      if(seen >= rank)
+         break;
+   }
+
+   limit = GetBinLimit(bin);
+
+   return ((limit < histogram->max) ? limit : histogram->max) / 1000.0;
+}
+
+/**
+ * @brief  Print the column names of PrintResult()
+ * @return void
+ */
+static void
+PrintHeader(void)
+{
+   fprintf(stdout, "%9s %10s %7s %7s %6s %7s %8s %8s %8s %8s %8s %9s %7s\n",
+         "offered/s", "achieved/s", "sent", "dropped", "errors", "p50_ms", "p90_ms", "p99_ms",
+         "p999_ms", "max_ms", "svc_p99", "lag_max", "procs");
+}
+
+/**
+ * @brief  Print the measurements at one rate
+ * @param  result measurements
+ * @return void
+ */
+static void
+PrintResult(const LoadResult *result)
+{
+   fprintf(stdout, "%9.2f %10.2f %7ld %7ld %6ld %7.1f %8.1f %8.1f %8.1f %8.1f %8.1f %9.1f "
+         "%7d %s\n", result->offered, result->achieved, result->sent, result->dropped, result->errors,
+         HistogramPercentile(&result->latency, 50.0),
+         HistogramPercentile(&result->latency, 90.0),
+         HistogramPercentile(&result->latency, 99.0),
+         HistogramPercentile(&result->latency, 99.9),
+         result->latency.max / 1000.0,
+         HistogramPercentile(&result->service, 99.0),
+         result->lagMax * 1000.0, result->inFlightPeak,
+         (result->sustained == DmtxTrue) ? _("sustained") : _("SATURATED"));
+   fflush(stdout);
+}
+
+/**
+ * @brief  Write the corrected latency distribution at one rate
+ *
+ * One line per non-empty bin: the bin's upper latency in milliseconds,
+ * the share of arrivals completed by then, and the bin's count.
+ *
+ * @param  fp histogram file
+ * @param  result measurements
+ * @return void
+ */
+static void
+WriteHistogram(FILE *fp, const LoadResult *result)
+{
+   int bin;
+   long seen;
+
+   fprintf(fp, "# offered %g/s, %ld arrivals\n", result->offered, result->latency.total);
+   fprintf(fp, "# latency_ms percentile count\n");
+
+   for(bin = 0, seen = 0; bin < LOAD_HISTOGRAM_BINS; bin++) {
+      if(result->latency.count[bin] == 0)
+         continue;
+      seen += result->latency.count[bin];
+      fprintf(fp, "%0.3f %0.6f %ld\n", GetBinLimit(bin) / 1000.0,
+            (double)seen / result->latency.total, result->latency.count[bin]);
+   }
+   fputc('\n', fp);
+}
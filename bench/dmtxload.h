@@ -0,0 +1,146 @@
+/*
+libdmtx - Data Matrix Encoding/Decoding Library
+
+Copyright (C) 2008, 2009 Mike Laughton
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+Contact: mike@dragonflylogic.com
+*/
+
+#ifndef __DMTXLOAD_H__
+#define __DMTXLOAD_H__
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <errno.h>
+#include <math.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <signal.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <dmtx.h>
+#include "../common/dmtxutil.h"
+
+#if ENABLE_NLS
+# include <libintl.h>
+# define _(String) gettext(String)
+#else
+# define _(String) String
+#endif
+#define N_(String) String
+
+/* Most dmtxread options, and most rates listed with --rate */
+#define LOAD_OPTION_MAX 32
+#define LOAD_RATE_MAX 32
+
+/* Latency bins in microseconds: 1 us wide up to 64 us, then 16 per
+ * doubling up to 2^36 us, so any value is within 1/16 of its bin */
+#define LOAD_HISTOGRAM_BINS (64 + 30 * 16)
+
+/* Long options without a single character equivalent */
+enum {
+   OptRamp = 256,
+   OptRateMax,
+   OptRefine,
+   OptMaxP99,
+   OptTolerance,
+   OptHistogram,
+   OptSeed,
+   OptStdin
+};
+
+typedef struct {
+   char *dmtxread;      /* -r, --dmtxread */
+   char *argv[LOAD_OPTION_MAX]; /* -O, --options */
+   int argc;
+   char *options;
+   double rate[LOAD_RATE_MAX]; /* -R, --rate */
+   int rateCount;
+   int poisson;         /* -P, --poisson */
+   double duration;     /* -t, --duration */
+   double warmup;       /* -w, --warmup */
+   int inFlightMax;     /* -j, --in-flight */
+   int ramp;            /*     --ramp */
+   double rateMax;      /*     --rate-max */
+   int refine;          /*     --refine */
+   double maxP99;       /*     --max-p99 */
+   double tolerance;    /*     --tolerance */
+   char *histogramPath; /*     --histogram */
+   unsigned long seed;  /*     --seed */
+   int useStdin;        /*     --stdin */
+   int verbose;         /* -v, --verbose */
+   char **files;
+   int fileCount;
+} UserOptions;
+
+/* Counts of latencies in log-linear bins */
+typedef struct {
+   long count[LOAD_HISTOGRAM_BINS];
+   long total;
+   long max;            /* microseconds */
+} LoadHistogram;
+
+/* dmtxread process started for one arrival */
+typedef struct {
+   pid_t pid;
+   double intended;     /* scheduled arrival, seconds from start */
+   double started;      /* fork, seconds from start */
+} LoadRequest;
+
+/* Measurements at one offered rate */
+typedef struct {
+   double offered;
+   long sent;
+   long done;
+   long errors;
+   long dropped;        /* never started before the run gave up */
+   double achieved;
+   double lagMax;       /* latest start after the scheduled arrival */
+   int inFlightPeak;
+   LoadHistogram latency; /* from scheduled arrival: corrected */
+   LoadHistogram service; /* from process start: uncorrected */
+   DmtxBoolean sustained;
+} LoadResult;
+
+static void SetOptionDefaults(UserOptions *opt);
+static DmtxPassFail HandleArgs(UserOptions *opt, int *argcp, char **argvp[]);
+static DmtxPassFail ParseRates(UserOptions *opt, char *s);
+static DmtxPassFail SplitOptions(UserOptions *opt, char *s);
+static void ShowUsage(int status);
+static void HandleSigChld(int sig);
+static void RunRate(UserOptions *opt, double rate, LoadResult *result);
+static void StartRequest(UserOptions *opt, LoadRequest *request, int fileIndex);
+static void FeedRequest(char *argv[], const char *path);
+static int ReapRequests(UserOptions *opt, LoadRequest *requests, int count, double now,
+      LoadResult *result, double *lastDone);
+static double NextArrival(UserOptions *opt, double rate, double previous);
+static double SecondsSince(DmtxTime start);
+static void HistogramAdd(LoadHistogram *histogram, double seconds);
+static int GetHistogramBin(long usec);
+static long GetBinLimit(int bin);
+static double HistogramPercentile(const LoadHistogram *histogram, double percent);
+static void PrintHeader(void);
+static void PrintResult(const LoadResult *result);
+static void WriteHistogram(FILE *fp, const LoadResult *result);
+
+#endif
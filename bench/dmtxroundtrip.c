@@ -0,0 +1,638 @@
+/*
+libdmtx - Data Matrix Encoding/Decoding Library
+
+Copyright (C) 2008, 2009 Mike Laughton
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+Contact: mike@dragonflylogic.com
+*/
+
+/**
+ * @file dmtxroundtrip.c
+ * @brief In-process encode and decode benchmark over every symbol size
+ *
+ * For each symbol size, encodation scheme and module size, fills the
+ * symbol with a payload, encodes it repeatedly with libdmtx, and decodes
+ * the rendered enc->image repeatedly with dmtxDecodeCreate(). Nothing is
+ * read from or written to files, so the times are libdmtx alone.
+ */
+
+#include "dmtxroundtrip.h"
+
+char *programName;
+
+static const RoundScheme roundSchemes[] = {
+      { 'b', "best",    DmtxSchemeAutoBest, DmtxFalse, NULL },
+      { 'f', "fast",    DmtxSchemeAutoFast, DmtxFalse, NULL },
+      { 'a', "ascii",   DmtxSchemeAscii,    DmtxFalse,
+            " !\"#$%&'()*+,-./0123456789:;<=>?@ABCDEFGHIJKLMNOPQRSTUVWXYZ[\\]^_`"
+            "abcdefghijklmnopqrstuvwxyz{|}~" },
+      { 'c', "c40",     DmtxSchemeC40,      DmtxFalse, " 0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ" },
+      { 't', "text",    DmtxSchemeText,     DmtxFalse, " 0123456789abcdefghijklmnopqrstuvwxyz" },
+      { 'x', "x12",     DmtxSchemeX12,      DmtxFalse, "*> 0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ" },
+      { 'e', "edifact", DmtxSchemeEdifact,  DmtxFalse,
+            " !\"#$%&'()*+,-./0123456789:;<=>?@ABCDEFGHIJKLMNOPQRSTUVWXYZ[\\]^" },
+      { '8', "base256", DmtxSchemeBase256,  DmtxFalse, NULL },
+      { 'm', "mosaic",  DmtxSchemeAscii,    DmtxTrue,
+            " !\"#$%&'()*+,-./0123456789:;<=>?@ABCDEFGHIJKLMNOPQRSTUVWXYZ[\\]^_`"
+            "abcdefghijklmnopqrstuvwxyz{|}~" }
+};
+
+/**
+ * @brief  Main function for the dmtxroundtrip benchmark.
+ * @param  argc count of arguments passed from command line
+ * @param  argv list of argument passed strings from command line
+ * @return Numeric exit code
+ */
+int
+main(int argc, char *argv[])
+{
+   int i, j, k, err;
+   int capacity, failed;
+   unsigned char *payload;
+   const RoundScheme *scheme;
+   UserOptions opt;
+   RoundResult result;
+
+   SetOptionDefaults(&opt);
+
+   err = HandleArgs(&opt, &argc, &argv);
+   if(err != DmtxPass)
+      ShowUsage(EX_USAGE);
+
+   payload = (unsigned char *)malloc(ROUNDTRIP_PAYLOAD_MAX);
+   if(payload == NULL)
+      FatalError(EX_OSERR, _("Out of memory"));
+
+   fprintf(stdout, "%-8s %-8s %6s %9s %7s %10s %10s %10s %8s %10s %8s %s\n", "size",
+         "scheme", "module", "pixels", "bytes", "encode/s", "decode/s", "enc.allocs",
+         "enc.KiB", "dec.allocs", "dec.KiB", "decoded");
+
+   failed = 0;
+   for(i = 0; i < opt.sizeCount; i++) {
+      for(j = 0; j < opt.schemeCount; j++) {
+         scheme = opt.schemes[j];
+         MakePayload(&opt, opt.sizeIdx[i], scheme, payload);
+
+         /* Fill the symbol: the longest payload that fits this size */
+         capacity = FindCapacity(&opt, opt.sizeIdx[i], scheme, payload);
+         if(capacity == 0) {
+            fprintf(stdout, "%-8s %-8s %6s %9s %7s %10s\n", symbolSizes[opt.sizeIdx[i]],
+                  scheme->name, "-", "-", "0", _("unable to encode"));
+            continue;
+         }
+
+         for(k = 0; k < opt.moduleCount; k++) {
+            if(MeasureRoundTrip(&opt, opt.sizeIdx[i], scheme, opt.module[k], payload,
+                  capacity, &result) != DmtxPass) {
+               fprintf(stdout, "%-8s %-8s %6d %9s %7d %10s\n", symbolSizes[opt.sizeIdx[i]],
+                     scheme->name, opt.module[k], "-", capacity, _("unable to encode"));
+               failed++;
+               continue;
+            }
+
+            if(result.decoded < opt.iterations)
+               failed++;
+
+            fprintf(stdout, "%-8s %-8s %6d %4dx%-4d %7d %10.1f %10.1f", symbolSizes[opt.sizeIdx[i]],
+                  scheme->name, opt.module[k], result.width, result.height,
+                  result.payloadLength, result.encodePerSec, result.decodePerSec);
+            if(AllocCounting())
+               fprintf(stdout, " %10.1f %8.1f %10.1f %8.1f", result.encodeCalls,
+                     result.encodeKiB, result.decodeCalls, result.decodeKiB);
+            else
+               fprintf(stdout, " %10s %8s %10s %8s", "-", "-", "-", "-");
+            fprintf(stdout, " %d/%d\n", result.decoded, opt.iterations);
+            fflush(stdout);
+         }
+      }
+   }
+
+   free(payload);
+
+   if(failed > 0) {
+      fprintf(stderr, _("%s: %d measurements did not decode every time\n"), programName,
+            failed);
+      exit(1);
+   }
+
+   exit(EX_OK);
+}
+
+/**
+ * @brief  Set default option values
+ * @param  opt runtime options
+ * @return void
+ */
+static void
+SetOptionDefaults(UserOptions *opt)
+{
+   int i;
+
+   memset(opt, 0x00, sizeof(UserOptions));
+
+   opt->iterations = 20;
+   opt->sizeCount = DmtxSymbolSquareCount + DmtxSymbolRectCount;
+   for(i = 0; i < opt->sizeCount; i++)
+      opt->sizeIdx[i] = i;
+   ParseSchemes(opt, "actxe8m");
+   opt->module[0] = 2;
+   opt->module[1] = 4;
+   opt->module[2] = 6;
+   opt->moduleCount = 3;
+   opt->margin = 2;
+   opt->seed = 1;
+   opt->verbose = DmtxFalse;
+}
+
+/**
+ * @brief  Set and validate user-requested options from command line arguments.
+ * @param  opt runtime options from defaults or command line
+ * @param  argcp pointer to argument count
+ * @param  argvp pointer to argument list
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+HandleArgs(UserOptions *opt, int *argcp, char **argvp[])
+{
+   int err;
+   int optchr;
+   int longIndex;
+   char *ptr;
+
+   struct option longOptions[] = {
+         {"iterations",       required_argument, NULL, 'n'},
+         {"symbol-size",      required_argument, NULL, 's'},
+         {"encoding",         required_argument, NULL, 'e'},
+         {"module",           required_argument, NULL, 'd'},
+         {"margin",           required_argument, NULL, 'm'},
+         {"seed",             required_argument, NULL, OptSeed},
+         {"verbose",          no_argument,       NULL, 'v'},
+         {"version",          no_argument,       NULL, 'V'},
+         {"help",             no_argument,       NULL,  0 },
+         {0, 0, 0, 0}
+   };
+
+   programName = Basename((*argvp)[0]);
+
+   for(;;) {
+      optchr = getopt_long(*argcp, *argvp, "n:s:e:d:m:vV", longOptions, &longIndex);
+      if(optchr == -1)
+         break;
+
+      switch(optchr) {
+         case 0: /* --help */
+            ShowUsage(EX_OK);
+            break;
+         case 'n':
+            err = StringToInt(&(opt->iterations), optarg, &ptr);
+            if(err != DmtxPass || opt->iterations < 1 || *ptr != '\0')
+               FatalError(EX_USAGE, _("Invalid iteration count specified \"%s\""), optarg);
+            break;
+         case 's':
+            if(ParseSymbolSizes(opt, optarg) != DmtxPass)
+               FatalError(EX_USAGE, _("Invalid symbol size specified \"%s\""), optarg);
+            break;
+         case 'e':
+            if(ParseSchemes(opt, optarg) != DmtxPass)
+               FatalError(EX_USAGE, _("Invalid encodation scheme \"%s\""), optarg);
+            break;
+         case 'd':
+            if(ParseModules(opt, optarg) != DmtxPass)
+               FatalError(EX_USAGE, _("Invalid module size specified \"%s\""), optarg);
+            break;
+         case 'm':
+            err = StringToInt(&(opt->margin), optarg, &ptr);
+            if(err != DmtxPass || opt->margin < 0 || opt->margin > 20 || *ptr != '\0')
+               FatalError(EX_USAGE, _("Invalid margin specified \"%s\""), optarg);
+            break;
+         case OptSeed:
+            errno = 0;
+            opt->seed = strtoul(optarg, &ptr, 10);
+            if(errno != 0 || ptr == optarg || *ptr != '\0')
+               FatalError(EX_USAGE, _("Invalid seed specified \"%s\""), optarg);
+            break;
+         case 'v':
+            opt->verbose = DmtxTrue;
+            break;
+         case 'V':
+            fprintf(stderr, "%s version %s\n", programName, DmtxVersion);
+            fprintf(stderr, "libdmtx version %s\n", dmtxVersion());
+            exit(0);
+            break;
+         default:
+            return DmtxFail;
+            break;
+      }
+   }
+
+   if(optind != *argcp)
+      return DmtxFail;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Parse a list of symbol sizes: all, s, r or RxC, comma separated
+ * @param  opt runtime options
+ * @param  s list
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+ParseSymbolSizes(UserOptions *opt, char *s)
+{
+   int i, first, last;
+   int total;
+   size_t length;
+
+   total = DmtxSymbolSquareCount + DmtxSymbolRectCount;
+   opt->sizeCount = 0;
+
+   while(*s != '\0') {
+      length = strcspn(s, ",");
+
+      if(length == 3 && strncmp(s, "all", 3) == 0) {
+         first = 0;
+         last = total - 1;
+      }
+      else if(length == 1 && *s == 's') {
+         first = 0;
+         last = DmtxSymbolSquareCount - 1;
+      }
+      else if(length == 1 && *s == 'r') {
+         first = DmtxSymbolSquareCount;
+         last = total - 1;
+      }
+      else {
+         for(first = 0; first < total; first++) {
+            if(strlen(symbolSizes[first]) == length &&
+                  strncmp(s, symbolSizes[first], length) == 0)
+               break;
+         }
+         if(first == total)
+            return DmtxFail;
+         last = first;
+      }
+
+      for(i = first; i <= last; i++) {
+         if(opt->sizeCount == total)
+            return DmtxFail;
+         opt->sizeIdx[opt->sizeCount++] = i;
+      }
+
+      s += length;
+      if(*s == ',')
+         s++;
+   }
+
+   return (opt->sizeCount > 0) ? DmtxPass : DmtxFail;
+}
+
+/**
+ * @brief  Parse encodation scheme letters, e.g. "actxe8m"
+ * @param  opt runtime options
+ * @param  s letters
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+ParseSchemes(UserOptions *opt, char *s)
+{
+   int i, count;
+
+   count = sizeof(roundSchemes) / sizeof(roundSchemes[0]);
+   opt->schemeCount = 0;
+
+   for(; *s != '\0'; s++) {
+      for(i = 0; i < count; i++) {
+         if(roundSchemes[i].letter == *s)
+            break;
+      }
+      if(i == count || opt->schemeCount == (int)(sizeof(opt->schemes) / sizeof(opt->schemes[0])))
+         return DmtxFail;
+      opt->schemes[opt->schemeCount++] = &roundSchemes[i];
+   }
+
+   return (opt->schemeCount > 0) ? DmtxPass : DmtxFail;
+}
+
+/**
+ * @brief  Parse a comma separated list of module sizes in pixels
+ * @param  opt runtime options
+ * @param  s list
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+ParseModules(UserOptions *opt, char *s)
+{
+   long module;
+   char *ptr;
+
+   opt->moduleCount = 0;
+
+   while(*s != '\0') {
+      module = strtol(s, &ptr, 10);
+      if(ptr == s || module < 1 || module > 32 || (*ptr != ',' && *ptr != '\0') ||
+            opt->moduleCount == ROUNDTRIP_MODULE_MAX)
+         return DmtxFail;
+      opt->module[opt->moduleCount++] = (int)module;
+
+      s = (*ptr == ',') ? ptr + 1 : ptr;
+   }
+
+   return (opt->moduleCount > 0) ? DmtxPass : DmtxFail;
+}
+
+/**
+ * @brief  Display program usage and exit with received status.
+ * @param  status error code returned to OS
+ * @return void
+ */
+static void
+ShowUsage(int status)
+{
+   if(status != 0) {
+      fprintf(stderr, _("Usage: %s [OPTION]...\n"), programName);
+      fprintf(stderr, _("Try `%s --help' for more information.\n"), programName);
+   }
+   else {
+      fprintf(stderr, _("Usage: %s [OPTION]...\n"), programName);
+      fprintf(stderr, _("\
+Encode the longest payload that fits each symbol size with each encodation\n\
+scheme, render it at each module size, and decode the image in memory.\n\
+Reports encodes and decodes per second and heap allocations per call.\n\
+\n\
+Example: %s -s s -e a -d 3 -n 100\n\
+\n\
+OPTIONS:\n"), programName);
+      fprintf(stderr, _("\
+  -n, --iterations=N          encodes and decodes per measurement (default 20)\n\
+  -s, --symbol-size=LIST      sizes measured, comma separated (default all)\n\
+            all = every size       s = square sizes     r = rectangle sizes\n\
+            RxC = one size, e.g. 10x10 or 8x32\n\
+  -e, --encoding=[bfacte8xm]  schemes measured (default actxe8m)\n\
+            b = best optimized     f = fast optimized   a = ASCII\n\
+            c = C40                t = Text             x = X12\n\
+            e = EDIFACT            8 = Base 256         m = Data Mosaic\n\
+  -d, --module=LIST           module sizes in pixels, comma separated\n\
+                              (default 2,4,6)\n\
+  -m, --margin=N              quiet zone in modules (default 2)\n\
+      --seed=N                payload seed (default 1)\n\
+  -v, --verbose               describe each payload\n\
+  -V, --version               print version information\n\
+      --help                  display this help and exit\n"));
+      fprintf(stderr, _("\nReport bugs to <mike@dragonflylogic.com>.\n"));
+   }
+
+   exit(status);
+}
+
+/**
+ * @brief  Fill the payload buffer from the scheme's alphabet
+ *
+ * The payload depends only on the seed, size and scheme, so the same
+ * options measure the same symbols from run to run.
+ *
+ * @param  opt runtime options
+ * @param  sizeIdx symbol size
+ * @param  scheme encodation scheme
+ * @param  payload buffer of ROUNDTRIP_PAYLOAD_MAX bytes
+ * @return void
+ */
+static void
+MakePayload(UserOptions *opt, int sizeIdx, const RoundScheme *scheme, unsigned char *payload)
+{
+   int i, alphabetLength;
+   unsigned long x;
+
+   x = (opt->seed * 2654435761UL + (unsigned long)sizeIdx * 40503UL +
+         (unsigned long)scheme->letter) & 0xffffffffUL;
+   if(x == 0)
+      x = 1;
+
+   alphabetLength = (scheme->alphabet == NULL) ? 256 : strlen(scheme->alphabet);
+
+   for(i = 0; i < ROUNDTRIP_PAYLOAD_MAX; i++) {
+      /* xorshift32 */
+      x ^= (x << 13) & 0xffffffffUL;
+      x ^= x >> 17;
+      x ^= (x << 5) & 0xffffffffUL;
+      payload[i] = (scheme->alphabet == NULL) ? (unsigned char)(x >> 8) :
+            (unsigned char)scheme->alphabet[(x >> 8) % alphabetLength];
+   }
+}
+
+/**
+ * @brief  Encode a payload into a symbol of the given size
+ * @param  opt runtime options
+ * @param  sizeIdx symbol size
+ * @param  scheme encodation scheme
+ * @param  module module size in pixels
+ * @param  payload payload
+ * @param  length payload length
+ * @return Encoder holding the rendered image, or NULL if it does not fit
+ */
+static DmtxEncode *
+EncodePayload(UserOptions *opt, int sizeIdx, const RoundScheme *scheme, int module,
+      unsigned char *payload, int length)
+{
+   DmtxPassFail err;
+   DmtxEncode *enc;
+
+   enc = dmtxEncodeCreate();
+   if(enc == NULL)
+      FatalError(EX_SOFTWARE, _("Unable to create encoder"));
+
+   dmtxEncodeSetProp(enc, DmtxPropPixelPacking, DmtxPack24bppRGB);
+   dmtxEncodeSetProp(enc, DmtxPropImageFlip, DmtxFlipNone);
+   dmtxEncodeSetProp(enc, DmtxPropRowPadBytes, 0);
+   dmtxEncodeSetProp(enc, DmtxPropMarginSize, opt->margin * module);
+   dmtxEncodeSetProp(enc, DmtxPropModuleSize, module);
+   dmtxEncodeSetProp(enc, DmtxPropScheme, scheme->scheme);
+   dmtxEncodeSetProp(enc, DmtxPropSizeRequest, sizeIdx);
+
+   if(scheme->mosaic == DmtxTrue)
+      err = dmtxEncodeDataMosaic(enc, length, payload);
+   else
+      err = dmtxEncodeDataMatrix(enc, length, payload);
+
+   if(err == DmtxFail || enc->image == NULL) {
+      dmtxEncodeDestroy(&enc);
+      return NULL;
+   }
+
+   return enc;
+}
+
+/**
+ * @brief  Longest prefix of the payload that encodes at a symbol size
+ * @param  opt runtime options
+ * @param  sizeIdx symbol size
+ * @param  scheme encodation scheme
+ * @param  payload payload
+ * @return Payload length, or 0 if not even one byte fits
+ */
+static int
+FindCapacity(UserOptions *opt, int sizeIdx, const RoundScheme *scheme, unsigned char *payload)
+{
+   int low, high, middle;
+   DmtxEncode *enc;
+
+   /* Fits at low, does not fit at high */
+   low = 0;
+   high = ROUNDTRIP_PAYLOAD_MAX + 1;
+
+   while(high - low > 1) {
+      middle = (low + high) / 2;
+      enc = EncodePayload(opt, sizeIdx, scheme, 1, payload, middle);
+      if(enc == NULL) {
+         high = middle;
+      }
+      else {
+         low = middle;
+         dmtxEncodeDestroy(&enc);
+      }
+   }
+
+   if(opt->verbose == DmtxTrue)
+      fprintf(stderr, _("%s: %s %s holds %d payload bytes\n"), programName,
+            symbolSizes[sizeIdx], scheme->name, low);
+
+   return low;
+}
+
+/**
+ * @brief  Time repeated encodes and decodes of one symbol
+ * @param  opt runtime options
+ * @param  sizeIdx symbol size
+ * @param  scheme encodation scheme
+ * @param  module module size in pixels
+ * @param  payload payload
+ * @param  length payload length
+ * @param  result measurements to fill
+ * @return DmtxPass | DmtxFail (payload did not encode)
+ */
+static DmtxPassFail
+MeasureRoundTrip(UserOptions *opt, int sizeIdx, const RoundScheme *scheme, int module,
+      unsigned char *payload, int length, RoundResult *result)
+{
+   int i;
+   double seconds;
+   DmtxTime start;
+   DmtxEncode *enc;
+   AllocCounts before, after;
+
+   memset(result, 0x00, sizeof(RoundResult));
+   result->payloadLength = length;
+
+   /* Encode: create, encode, render and destroy, as dmtxwrite does */
+   AllocGetCounts(&before);
+   start = dmtxTimeNow();
+   for(i = 0; i < opt->iterations; i++) {
+      enc = EncodePayload(opt, sizeIdx, scheme, module, payload, length);
+      if(enc == NULL)
+         return DmtxFail;
+      dmtxEncodeDestroy(&enc);
+   }
+   seconds = SecondsSince(start);
+   AllocGetCounts(&after);
+
+   result->encodePerSec = opt->iterations / seconds;
+   result->encodeCalls = (double)(after.calls - before.calls) / opt->iterations;
+   result->encodeKiB = (double)(after.bytes - before.bytes) / 1024.0 / opt->iterations;
+
+   /* Decode the rendered image of one more encode */
+   enc = EncodePayload(opt, sizeIdx, scheme, module, payload, length);
+   if(enc == NULL)
+      return DmtxFail;
+   result->width = enc->image->width;
+   result->height = enc->image->height;
+
+   AllocGetCounts(&before);
+   start = dmtxTimeNow();
+   for(i = 0; i < opt->iterations; i++) {
+      if(DecodePayload(enc->image, scheme, payload, length) == DmtxTrue)
+         result->decoded++;
+   }
+   seconds = SecondsSince(start);
+   AllocGetCounts(&after);
+
+   result->decodePerSec = opt->iterations / seconds;
+   result->decodeCalls = (double)(after.calls - before.calls) / opt->iterations;
+   result->decodeKiB = (double)(after.bytes - before.bytes) / 1024.0 / opt->iterations;
+
+   dmtxEncodeDestroy(&enc);
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Find and decode the symbol of an image and check its message
+ * @param  image image rendered by the encoder
+ * @param  scheme encodation scheme
+ * @param  payload expected message
+ * @param  length expected message length
+ * @return DmtxTrue if the payload came back
+ */
+static DmtxBoolean
+DecodePayload(DmtxImage *image, const RoundScheme *scheme, unsigned char *payload,
+      int length)
+{
+   DmtxBoolean match;
+   DmtxDecode *dec;
+   DmtxRegion *reg;
+   DmtxMessage *msg;
+
+   dec = dmtxDecodeCreate(image, 1);
+   if(dec == NULL)
+      return DmtxFalse;
+
+   match = DmtxFalse;
+   reg = dmtxRegionFindNext(dec, NULL);
+   if(reg != NULL) {
+      if(scheme->mosaic == DmtxTrue)
+         msg = dmtxDecodeMosaicRegion(dec, reg, DmtxUndefined);
+      else
+         msg = dmtxDecodeMatrixRegion(dec, reg, DmtxUndefined);
+
+      if(msg != NULL) {
+         match = (msg->outputIdx == length &&
+               memcmp(msg->output, payload, length) == 0) ? DmtxTrue : DmtxFalse;
+         dmtxMessageDestroy(&msg);
+      }
+      dmtxRegionDestroy(&reg);
+   }
+
+   dmtxDecodeDestroy(&dec);
+
+   return match;
+}
+
+/**
+ * @brief  Seconds elapsed since a time, never zero
+ * @param  start earlier time
+ * @return Seconds
+ */
+static double
+SecondsSince(DmtxTime start)
+{
+   double seconds;
+   DmtxTime now;
+
+   now = dmtxTimeNow();
+   seconds = (double)(now.sec - start.sec) + ((double)now.usec - (double)start.usec) / 1e6;
+
+   return (seconds > 0.0) ? seconds : 1e-6;
+}
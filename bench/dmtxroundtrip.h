@@ -0,0 +1,112 @@
+/*
+libdmtx - Data Matrix Encoding/Decoding Library
+
+Copyright (C) 2008, 2009 Mike Laughton
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+Contact: mike@dragonflylogic.com
+*/
+
+#ifndef __DMTXROUNDTRIP_H__
+#define __DMTXROUNDTRIP_H__
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <sys/types.h>
+
+#include <dmtx.h>
+#include "../common/dmtxutil.h"
+#include "dmtxalloc.h"
+
+#if ENABLE_NLS
+# include <libintl.h>
+# define _(String) gettext(String)
+#else
+# define _(String) String
+#endif
+#define N_(String) String
+
+/* Longest payload tried; the largest Data Mosaic holds about 4700 bytes */
+#define ROUNDTRIP_PAYLOAD_MAX 5000
+
+/* Most module sizes measured per symbol */
+#define ROUNDTRIP_MODULE_MAX 8
+
+/* Long options without a single character equivalent */
+enum {
+   OptSeed = 256
+};
+
+/* Encodation scheme measured, with a payload alphabet it can encode */
+typedef struct {
+   char letter;         /* -e letter, as for dmtxwrite, or 'm' for Data Mosaic */
+   const char *name;
+   int scheme;
+   DmtxBoolean mosaic;
+   const char *alphabet; /* NULL for any byte */
+} RoundScheme;
+
+typedef struct {
+   int iterations;      /* -n, --iterations */
+   int sizeIdx[DmtxSymbolSquareCount + DmtxSymbolRectCount]; /* -s, --symbol-size */
+   int sizeCount;
+   const RoundScheme *schemes[16]; /* -e, --encoding */
+   int schemeCount;
+   int module[ROUNDTRIP_MODULE_MAX]; /* -d, --module */
+   int moduleCount;
+   int margin;          /* -m, --margin */
+   unsigned long seed;  /*     --seed */
+   int verbose;         /* -v, --verbose */
+} UserOptions;
+
+/* Measurements of one symbol size, scheme and module size */
+typedef struct {
+   int width;
+   int height;
+   int payloadLength;
+   double encodePerSec;
+   double decodePerSec;
+   double encodeCalls;  /* allocations per encode */
+   double encodeKiB;
+   double decodeCalls;  /* allocations per decode */
+   double decodeKiB;
+   int decoded;         /* decodes returning the payload */
+} RoundResult;
+
+static void SetOptionDefaults(UserOptions *opt);
+static DmtxPassFail HandleArgs(UserOptions *opt, int *argcp, char **argvp[]);
+static DmtxPassFail ParseSymbolSizes(UserOptions *opt, char *s);
+static DmtxPassFail ParseSchemes(UserOptions *opt, char *s);
+static DmtxPassFail ParseModules(UserOptions *opt, char *s);
+static void ShowUsage(int status);
+static void MakePayload(UserOptions *opt, int sizeIdx, const RoundScheme *scheme,
+      unsigned char *payload);
+static DmtxEncode *EncodePayload(UserOptions *opt, int sizeIdx, const RoundScheme *scheme,
+      int module, unsigned char *payload, int length);
+static int FindCapacity(UserOptions *opt, int sizeIdx, const RoundScheme *scheme,
+      unsigned char *payload);
+static DmtxPassFail MeasureRoundTrip(UserOptions *opt, int sizeIdx, const RoundScheme *scheme,
+      int module, unsigned char *payload, int length, RoundResult *result);
+static DmtxBoolean DecodePayload(DmtxImage *image, const RoundScheme *scheme,
+      unsigned char *payload, int length);
+static double SecondsSince(DmtxTime start);
+
+#endif
@@ -0,0 +1,271 @@
+/*
+libdmtx - Data Matrix Encoding/Decoding Library
+
+Copyright (C) 2008, 2009 Mike Laughton
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+Contact: mike@dragonflylogic.com
+*/
+
+/**
+ * @file dmtxrecord.c
+ * @brief Length-prefixed binary result records
+ *
+ * A stream starts with an 8 byte header ("DMTX", a 16-bit version and a
+ * reserved 16-bit field), followed by records. Each record is a 32-bit
+ * body length and a body starting with a 16-bit type, so readers can
+ * skip types they do not know. All integers are little-endian and
+ * corners are IEEE 754 single precision.
+ *
+ * Symbol record body:
+ *
+ *    u16 type, i16 sizeIdx, u16 padCount, i16 rotation,
+ *    u32 pageIndex, u32 elapsedMS, f32 corner[8],
+ *    u16 fileLength, u16 memberLength, u32 messageLength,
+ *    file bytes, member bytes, message bytes
+ *
+ * A memberLength of 0 means the symbol did not come from an archive.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <dmtx.h>
+#include "dmtxutil.h"
+#include "dmtxrecord.h"
+
+/* Longest body a reader accepts, so a corrupt length cannot exhaust memory */
+#define RECORD_BODY_MAX (64L * 1024 * 1024)
+
+/**
+ * @brief  Write the stream header
+ * @param  fp output stream
+ * @return DmtxPass | DmtxFail
+ */
+extern DmtxPassFail
+RecordWriteHeader(FILE *fp)
+{
+   unsigned char header[RECORD_HEADER_SIZE];
+
+   memcpy(header, RECORD_MAGIC, 4);
+   RecordPutValue(header + 4, RECORD_VERSION, 2);
+   RecordPutValue(header + 6, 0, 2);
+
+   return (fwrite(header, 1, RECORD_HEADER_SIZE, fp) == RECORD_HEADER_SIZE) ?
+         DmtxPass : DmtxFail;
+}
+
+/**
+ * @brief  Write one record
+ * @param  fp output stream
+ * @param  rec record to write (type is always RecordTypeSymbol)
+ * @return DmtxPass | DmtxFail
+ *
+ * The fixed part is encoded in one buffer, and the variable fields are
+ * copied straight from the caller's memory.
+ */
+extern DmtxPassFail
+RecordWrite(FILE *fp, const ResultRecord *rec)
+{
+   int i;
+   int fileLength, memberLength;
+   unsigned int bits;
+   unsigned char fixed[4 + RECORD_FIXED_SIZE];
+   unsigned char *ptr;
+
+   assert(sizeof(float) == 4 && sizeof(unsigned int) >= 4);
+
+   /* Names longer than 16 bits are cut, which no file system produces */
+   fileLength = (rec->fileLength > 0xffff) ? 0xffff : rec->fileLength;
+   memberLength = (rec->member == NULL) ? 0 :
+         (rec->memberLength > 0xffff) ? 0xffff : rec->memberLength;
+
+   ptr = fixed;
+   RecordPutValue(ptr, RECORD_FIXED_SIZE + fileLength + memberLength + rec->messageLength, 4);
+   RecordPutValue(ptr + 4, RecordTypeSymbol, 2);
+   RecordPutValue(ptr + 6, (unsigned long)rec->sizeIdx, 2);
+   RecordPutValue(ptr + 8, rec->padCount, 2);
+   RecordPutValue(ptr + 10, (unsigned long)rec->rotation, 2);
+   RecordPutValue(ptr + 12, rec->pageIndex, 4);
+   RecordPutValue(ptr + 16, rec->elapsedMS, 4);
+   ptr += 20;
+
+   for(i = 0; i < 8; i++) {
+      bits = 0;
+      memcpy(&bits, &(rec->corner[i]), 4);
+      RecordPutValue(ptr, bits, 4);
+      ptr += 4;
+   }
+
+   RecordPutValue(ptr, fileLength, 2);
+   RecordPutValue(ptr + 2, memberLength, 2);
+   RecordPutValue(ptr + 4, rec->messageLength, 4);
+
+   if(fwrite(fixed, 1, sizeof(fixed), fp) != sizeof(fixed) ||
+         fwrite(rec->file, 1, fileLength, fp) != (size_t)fileLength ||
+         (memberLength > 0 && fwrite(rec->member, 1, memberLength, fp) != (size_t)memberLength) ||
+         fwrite(rec->message, 1, rec->messageLength, fp) != (size_t)rec->messageLength)
+      return DmtxFail;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Read and check the stream header
+ * @param  fp input stream
+ * @return DmtxPass | DmtxFail (not a record stream, or a newer version)
+ */
+extern DmtxPassFail
+RecordReadHeader(FILE *fp)
+{
+   unsigned char header[RECORD_HEADER_SIZE];
+
+   if(fread(header, 1, RECORD_HEADER_SIZE, fp) != RECORD_HEADER_SIZE ||
+         memcmp(header, RECORD_MAGIC, 4) != 0 ||
+         RecordGetValue(header + 4, 2) != RECORD_VERSION)
+      return DmtxFail;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Read the next symbol record, skipping other types
+ * @param  fp input stream positioned after the header
+ * @param  rec record to fill (points into *buf)
+ * @param  buf pointer to a buffer grown as needed (may start NULL)
+ * @param  bufSize pointer to the allocated size of *buf
+ * @return 1 for a record, 0 at end of stream, -1 on error
+ */
+extern int
+RecordRead(FILE *fp, ResultRecord *rec, unsigned char **buf, size_t *bufSize)
+{
+   int i;
+   unsigned int bits;
+   unsigned long length;
+   unsigned char prefix[4];
+   unsigned char *body, *newBuf;
+
+   for(;;) {
+      if(fread(prefix, 1, 4, fp) != 4)
+         return (feof(fp) && !ferror(fp)) ? 0 : -1;
+
+      /* Runs appended to the same file each start with a header */
+      if(memcmp(prefix, RECORD_MAGIC, 4) == 0) {
+         if(fread(prefix, 1, 4, fp) != 4 || RecordGetValue(prefix, 2) != RECORD_VERSION)
+            return -1;
+         continue;
+      }
+
+      length = RecordGetValue(prefix, 4);
+      if(length < 2 || length > RECORD_BODY_MAX)
+         return -1;
+
+      if(length > *bufSize) {
+         newBuf = (unsigned char *)realloc(*buf, length);
+         if(newBuf == NULL)
+            return -1;
+         *buf = newBuf;
+         *bufSize = length;
+      }
+      body = *buf;
+
+      if(fread(body, 1, length, fp) != length)
+         return -1;
+
+      if(RecordGetValue(body, 2) == RecordTypeSymbol)
+         break;
+   }
+
+   if(length < RECORD_FIXED_SIZE)
+      return -1;
+
+   memset(rec, 0x00, sizeof(ResultRecord));
+   rec->type = RecordTypeSymbol;
+   rec->sizeIdx = (int)RecordGetSigned16(body + 2);
+   rec->padCount = (int)RecordGetValue(body + 4, 2);
+   rec->rotation = (int)RecordGetSigned16(body + 6);
+   rec->pageIndex = (long)RecordGetValue(body + 8, 4);
+   rec->elapsedMS = (long)RecordGetValue(body + 12, 4);
+
+   for(i = 0; i < 8; i++) {
+      bits = (unsigned int)RecordGetValue(body + 16 + 4 * i, 4);
+      memcpy(&(rec->corner[i]), &bits, 4);
+   }
+
+   rec->fileLength = (int)RecordGetValue(body + 48, 2);
+   rec->memberLength = (int)RecordGetValue(body + 50, 2);
+   rec->messageLength = (long)RecordGetValue(body + 52, 4);
+
+   if((unsigned long)RECORD_FIXED_SIZE + rec->fileLength + rec->memberLength +
+         rec->messageLength != length)
+      return -1;
+
+   rec->file = (const char *)(body + RECORD_FIXED_SIZE);
+   rec->member = (rec->memberLength > 0) ? rec->file + rec->fileLength : NULL;
+   rec->message = body + RECORD_FIXED_SIZE + rec->fileLength + rec->memberLength;
+
+   return 1;
+}
+
+/**
+ * @brief  Store an unsigned value in little-endian order
+ * @param  ptr destination
+ * @param  value value to store
+ * @param  size byte count (2 or 4)
+ * @return void
+ */
+extern void
+RecordPutValue(unsigned char *ptr, unsigned long value, int size)
+{
+   int i;
+
+   for(i = 0; i < size; i++)
+      ptr[i] = (unsigned char)((value >> (8 * i)) & 0xff);
+}
+
+/**
+ * @brief  Load an unsigned little-endian value
+ * @param  ptr source
+ * @param  size byte count (2 or 4)
+ * @return Value
+ */
+extern unsigned long
+RecordGetValue(const unsigned char *ptr, int size)
+{
+   int i;
+   unsigned long value = 0;
+
+   for(i = size - 1; i >= 0; i--)
+      value = (value << 8) | ptr[i];
+
+   return value;
+}
+
+/**
+ * @brief  Load a signed little-endian 16-bit value
+ * @param  ptr source
+ * @return Value
+ */
+extern long
+RecordGetSigned16(const unsigned char *ptr)
+{
+   long value;
+
+   value = (long)RecordGetValue(ptr, 2);
+
+   return (value >= 0x8000) ? value - 0x10000 : value;
+}
@@ -0,0 +1,68 @@
+/*
+libdmtx - Data Matrix Encoding/Decoding Library
+
+Copyright (C) 2008, 2009 Mike Laughton
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+Contact: mike@dragonflylogic.com
+*/
+
+#ifndef __DMTXRECORD_H__
+#define __DMTXRECORD_H__
+
+#include <stdio.h>
+
+/* Stream header: magic, then version and reserved 16-bit fields */
+#define RECORD_MAGIC         "DMTX"
+#define RECORD_VERSION       1
+#define RECORD_HEADER_SIZE   8
+
+/* Fixed part of a record body, before file, member and message bytes */
+#define RECORD_FIXED_SIZE    56
+
+typedef enum {
+   RecordTypeSymbol = 1
+} RecordType;
+
+/**
+ * One decoded symbol. Records read from a stream point into the
+ * caller's buffer and are valid until the next read into it.
+ */
+typedef struct {
+   int type;                 /* RecordType */
+   int sizeIdx;              /* libdmtx symbol size index */
+   int padCount;             /* unused data codewords */
+   int rotation;             /* degrees (0-359) */
+   long pageIndex;           /* 0-based page within file */
+   long elapsedMS;           /* time from start of file to this symbol */
+   float corner[8];          /* x,y of corners 0-3, in --corners coordinates */
+   const char *file;
+   int fileLength;
+   const char *member;       /* archive member, or NULL */
+   int memberLength;
+   const unsigned char *message;
+   long messageLength;
+} ResultRecord;
+
+extern DmtxPassFail RecordWriteHeader(FILE *fp);
+extern DmtxPassFail RecordWrite(FILE *fp, const ResultRecord *rec);
+extern DmtxPassFail RecordReadHeader(FILE *fp);
+extern int RecordRead(FILE *fp, ResultRecord *rec, unsigned char **buf, size_t *bufSize);
+extern void RecordPutValue(unsigned char *ptr, unsigned long value, int size);
+extern unsigned long RecordGetValue(const unsigned char *ptr, int size);
+extern long RecordGetSigned16(const unsigned char *ptr);
+
+#endif
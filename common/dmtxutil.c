@@ -27,6 +27,7 @@
 #include <ctype.h>
 #include <errno.h>
 #include <assert.h>
+#include <unistd.h>
 #include <dmtx.h>
 #include "dmtxutil.h"
 
@@ -89,6 +90,57 @@ StringToInt(int *numberInt, char *numberString, char **terminate)
    return DmtxPass;
 }
 
+/**
+ * @brief  Convert size string such as "512", "64K", "1.5G" or "2GiB" to bytes
+ * @param  size pointer to converted size
+ * @param  sizeString string to be converted (suffixes K, M, G, T are powers of 1024)
+ * @return DmtxPass | DmtxFail
+ */
+extern DmtxPassFail
+StringToSize(size_t *size, char *sizeString)
+{
+   double value;
+   char *terminate;
+
+   if(!ISDIGIT(*sizeString))
+      return DmtxFail;
+
+   errno = 0;
+   value = strtod(sizeString, &terminate);
+   if(errno != 0)
+      return DmtxFail;
+
+   switch(toupper((int)*terminate)) {
+      case 'T':
+         value *= 1024.0;
+         /* fall through */
+      case 'G':
+         value *= 1024.0;
+         /* fall through */
+      case 'M':
+         value *= 1024.0;
+         /* fall through */
+      case 'K':
+         value *= 1024.0;
+         terminate++;
+         if(*terminate == 'i')
+            terminate++;
+         break;
+      default:
+         break;
+   }
+
+   if(toupper((int)*terminate) == 'B')
+      terminate++;
+
+   if(*terminate != '\0' || value >= (double)((size_t)-1))
+      return DmtxFail;
+
+   *size = (size_t)value;
+
+   return DmtxPass;
+}
+
 /**
  * @brief  XXX
  * @param  path
@@ -107,3 +159,43 @@ Basename(char *path)
 
    return path;
 }
+
+/**
+ * @brief  Open an anonymous temporary file
+ * @param  prefix start of the file name, usually the program name
+ * @return Stream open for update, or NULL with errno set
+ *
+ * The file lives in $TMPDIR (or /tmp) and is unlinked at once, so it
+ * disappears when closed or when the program exits for any reason.
+ */
+extern FILE *
+OpenTempFile(const char *prefix)
+{
+   int fd;
+   char *dir;
+   char *path;
+   FILE *fp;
+
+   dir = getenv("TMPDIR");
+   if(dir == NULL || *dir == '\0')
+      dir = "/tmp";
+
+   path = (char *)malloc(strlen(dir) + strlen(prefix) + 8);
+   if(path == NULL)
+      return NULL;
+   sprintf(path, "%s/%sXXXXXX", dir, prefix);
+
+   fd = mkstemp(path);
+   if(fd != -1)
+      unlink(path);
+   free(path);
+
+   if(fd == -1)
+      return NULL;
+
+   fp = fdopen(fd, "w+b");
+   if(fp == NULL)
+      close(fd);
+
+   return fp;
+}
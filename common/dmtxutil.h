@@ -27,21 +27,28 @@ Contact: mike@dragonflylogic.com
 #include "../config.h"
 #endif
 
+#include <stdio.h>
+
 #ifdef HAVE_SYSEXITS_H
 #include <sysexits.h>
 #else
 #define EX_OK           0
 #define EX_USAGE       64
 #define EX_DATAERR     65
+#define EX_NOINPUT     66
+#define EX_UNAVAILABLE 69
 #define EX_SOFTWARE    70
 #define EX_OSERR       71
 #define EX_CANTCREAT   73
 #define EX_IOERR       74
+#define EX_TEMPFAIL    75
 #endif
 
 extern DmtxPassFail StringToInt(int *numberInt, char *numberString, char **terminate);
+extern DmtxPassFail StringToSize(size_t *size, char *sizeString);
 extern void FatalError(int errorCode, char *fmt, ...);
 extern char *Basename(char *path);
+extern FILE *OpenTempFile(const char *prefix);
 
 static char *symbolSizes[] = {
       "10x10", "12x12",   "14x14",   "16x16",   "18x18",   "20x20",
@@ -0,0 +1,558 @@
+/*
+libdmtx - Data Matrix Encoding/Decoding Library
+
+Copyright (C) 2008, 2009 Mike Laughton
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+Contact: mike@dragonflylogic.com
+*/
+
+/**
+ * @file dmtxcompare.c
+ * @brief Image by image comparison of two result sets
+ *
+ * Both runs arrive ordered by file name and page. The caller gathers
+ * the barcodes of one image from each run into a CompareGroup, and
+ * CompareImage() matches their messages: a message in both runs is
+ * common, and its time difference is counted; a message only in the
+ * first run was lost, one only in the second was gained. Only the
+ * current image is held in memory, whatever the size of the runs.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <dmtx.h>
+#include "../common/dmtxutil.h"
+#include "../common/dmtxrecord.h"
+#include "dmtxcompare.h"
+
+/* One barcode of an image, with strings in the group's bytes */
+typedef struct {
+   size_t message;
+   long messageLength;
+   size_t member;
+   int memberLength;          /* DmtxUndefined without an archive member */
+   long elapsedMS;
+} CompareEntry;
+
+struct CompareGroup_struct {
+   char *file;                /* image of this group */
+   int fileLength;
+   int fileSize;
+   long page;
+   CompareEntry *entries;
+   long count;
+   long size;
+   unsigned char *bytes;
+   size_t length;
+   size_t bytesSize;
+};
+
+/* Millisecond histogram covering -COMPARE_TIME_RANGE to +COMPARE_TIME_RANGE */
+typedef struct {
+   long *count;
+   long total;
+   double sum;
+   long min;
+   long max;
+} CompareTimes;
+
+struct ResultCompare_struct {
+   long images;
+   long imagesChanged;
+   long imagesGained;         /* images with more barcodes in the second run */
+   long imagesLost;
+   long barcodesA;
+   long barcodesB;
+   long common;
+   long gained;
+   long lost;
+   CompareTimes timeA;
+   CompareTimes timeB;
+   CompareTimes timeDelta;    /* second run minus first, for common barcodes */
+};
+
+static int CompareBytes(const unsigned char *a, unsigned long aLength,
+      const unsigned char *b, unsigned long bLength);
+static int CompareEntries(const void *a, const void *b);
+static void AddTime(CompareTimes *times, long ms);
+static long GetPercentile(CompareTimes *times, double percent);
+static void PrintTimes(CompareTimes *times, const char *name, FILE *fp);
+static void PrintEntry(FILE *fp, const char *kind, CompareGroup *group, CompareEntry *entry);
+
+/* Group being sorted, as qsort() passes no context to comparisons */
+static CompareGroup *sortGroup;
+
+/**
+ * @brief  Order two barcodes by file name, then page
+ * @param  a first barcode
+ * @param  b second barcode
+ * @return Negative, zero or positive
+ */
+extern int
+CompareRecordKeys(const ResultRecord *a, const ResultRecord *b)
+{
+   int cmp;
+
+   cmp = CompareBytes((const unsigned char *)a->file, a->fileLength,
+         (const unsigned char *)b->file, b->fileLength);
+   if(cmp != 0)
+      return cmp;
+
+   return (a->pageIndex < b->pageIndex) ? -1 : (a->pageIndex > b->pageIndex) ? 1 : 0;
+}
+
+/**
+ * @brief  Create an empty image group
+ * @return Address of new group, or NULL if out of memory
+ */
+extern CompareGroup *
+CompareGroupCreate(void)
+{
+   return (CompareGroup *)calloc(1, sizeof(CompareGroup));
+}
+
+/**
+ * @brief  Free an image group
+ * @param  group pointer to group pointer
+ * @return void
+ */
+extern void
+CompareGroupDestroy(CompareGroup **group)
+{
+   if(group == NULL || *group == NULL)
+      return;
+
+   free((*group)->file);
+   free((*group)->entries);
+   free((*group)->bytes);
+   free(*group);
+
+   *group = NULL;
+}
+
+/**
+ * @brief  Empty a group and give it the image of a barcode
+ * @param  group image group
+ * @param  rec barcode whose file and page name the image
+ * @return DmtxPass | DmtxFail (out of memory)
+ */
+extern DmtxPassFail
+CompareGroupReset(CompareGroup *group, const ResultRecord *rec)
+{
+   char *file;
+
+   if(rec->fileLength > group->fileSize) {
+      file = (char *)realloc(group->file, rec->fileLength);
+      if(file == NULL)
+         return DmtxFail;
+      group->file = file;
+      group->fileSize = rec->fileLength;
+   }
+
+   memcpy(group->file, rec->file, rec->fileLength);
+   group->fileLength = rec->fileLength;
+   group->page = rec->pageIndex;
+   group->count = 0;
+   group->length = 0;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Order a barcode against a group's image
+ * @param  group image group
+ * @param  rec barcode
+ * @return Negative if barcode comes first, zero if it belongs to the group,
+ *         positive if it comes after
+ */
+extern int
+CompareGroupKey(const CompareGroup *group, const ResultRecord *rec)
+{
+   int cmp;
+
+   cmp = CompareBytes((const unsigned char *)rec->file, rec->fileLength,
+         (const unsigned char *)group->file, group->fileLength);
+   if(cmp != 0)
+      return cmp;
+
+   return (rec->pageIndex < group->page) ? -1 : (rec->pageIndex > group->page) ? 1 : 0;
+}
+
+/**
+ * @brief  Copy a barcode of the group's image into the group
+ * @param  group image group
+ * @param  rec barcode
+ * @return DmtxPass | DmtxFail (out of memory)
+ */
+extern DmtxPassFail
+CompareGroupAdd(CompareGroup *group, const ResultRecord *rec)
+{
+   long size;
+   size_t needed, bytesSize;
+   void *grown;
+   CompareEntry *entry;
+
+   if(group->count == group->size) {
+      size = (group->size == 0) ? 16 : group->size * 2;
+      grown = realloc(group->entries, size * sizeof(CompareEntry));
+      if(grown == NULL)
+         return DmtxFail;
+      group->entries = (CompareEntry *)grown;
+      group->size = size;
+   }
+
+   needed = rec->messageLength + ((rec->member == NULL) ? 0 : rec->memberLength);
+   if(group->length + needed > group->bytesSize) {
+      bytesSize = (group->bytesSize == 0) ? 1024 : group->bytesSize;
+      while(group->length + needed > bytesSize)
+         bytesSize *= 2;
+      grown = realloc(group->bytes, bytesSize);
+      if(grown == NULL)
+         return DmtxFail;
+      group->bytes = (unsigned char *)grown;
+      group->bytesSize = bytesSize;
+   }
+
+   entry = &(group->entries[group->count++]);
+   entry->message = group->length;
+   entry->messageLength = rec->messageLength;
+   memcpy(group->bytes + group->length, rec->message, rec->messageLength);
+   group->length += rec->messageLength;
+
+   entry->member = group->length;
+   entry->memberLength = (rec->member == NULL) ? DmtxUndefined : rec->memberLength;
+   if(rec->member != NULL) {
+      memcpy(group->bytes + group->length, rec->member, rec->memberLength);
+      group->length += rec->memberLength;
+   }
+
+   entry->elapsedMS = rec->elapsedMS;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Create an empty comparison
+ * @return Address of new comparison, or NULL if out of memory
+ */
+extern ResultCompare *
+CompareCreate(void)
+{
+   ResultCompare *compare;
+
+   compare = (ResultCompare *)calloc(1, sizeof(ResultCompare));
+   if(compare == NULL)
+      return NULL;
+
+   compare->timeA.count = (long *)calloc(2 * COMPARE_TIME_RANGE + 1, sizeof(long));
+   compare->timeB.count = (long *)calloc(2 * COMPARE_TIME_RANGE + 1, sizeof(long));
+   compare->timeDelta.count = (long *)calloc(2 * COMPARE_TIME_RANGE + 1, sizeof(long));
+   if(compare->timeA.count == NULL || compare->timeB.count == NULL ||
+         compare->timeDelta.count == NULL) {
+      CompareDestroy(&compare);
+      return NULL;
+   }
+
+   return compare;
+}
+
+/**
+ * @brief  Free a comparison
+ * @param  compare pointer to comparison pointer
+ * @return void
+ */
+extern void
+CompareDestroy(ResultCompare **compare)
+{
+   if(compare == NULL || *compare == NULL)
+      return;
+
+   free((*compare)->timeA.count);
+   free((*compare)->timeB.count);
+   free((*compare)->timeDelta.count);
+   free(*compare);
+
+   *compare = NULL;
+}
+
+/**
+ * @brief  Compare the barcodes both runs found in one image
+ *
+ * Lost and gained barcodes are printed as they are found, in message
+ * order. Messages read more than once in an image pair up one to one.
+ *
+ * @param  compare comparison totals
+ * @param  a barcodes of the image in the first run (possibly none)
+ * @param  b barcodes of the image in the second run (possibly none)
+ * @param  fp output stream
+ * @param  section CompareSection being printed
+ * @return void
+ */
+extern void
+CompareImage(ResultCompare *compare, CompareGroup *a, CompareGroup *b, FILE *fp, int section)
+{
+   int cmp;
+   long i, j;
+   long lost, gained;
+   CompareEntry *entryA, *entryB;
+   DmtxBoolean print;
+
+   sortGroup = a;
+   qsort(a->entries, a->count, sizeof(CompareEntry), CompareEntries);
+   sortGroup = b;
+   qsort(b->entries, b->count, sizeof(CompareEntry), CompareEntries);
+
+   print = (section == CompareAll || section == CompareImages) ? DmtxTrue : DmtxFalse;
+   lost = gained = 0;
+
+   for(i = j = 0; i < a->count || j < b->count; ) {
+      entryA = (i < a->count) ? &(a->entries[i]) : NULL;
+      entryB = (j < b->count) ? &(b->entries[j]) : NULL;
+
+      if(entryA == NULL)
+         cmp = 1;
+      else if(entryB == NULL)
+         cmp = -1;
+      else
+         cmp = CompareBytes(a->bytes + entryA->message, entryA->messageLength,
+               b->bytes + entryB->message, entryB->messageLength);
+
+      if(cmp == 0) {
+         compare->common++;
+         AddTime(&(compare->timeDelta), entryB->elapsedMS - entryA->elapsedMS);
+         i++;
+         j++;
+      }
+      else if(cmp < 0) {
+         lost++;
+         if(print == DmtxTrue)
+            PrintEntry(fp, "lost", a, entryA);
+         i++;
+      }
+      else {
+         gained++;
+         if(print == DmtxTrue)
+            PrintEntry(fp, "gained", b, entryB);
+         j++;
+      }
+   }
+
+   for(i = 0; i < a->count; i++)
+      AddTime(&(compare->timeA), a->entries[i].elapsedMS);
+   for(j = 0; j < b->count; j++)
+      AddTime(&(compare->timeB), b->entries[j].elapsedMS);
+
+   compare->images++;
+   if(lost > 0 || gained > 0)
+      compare->imagesChanged++;
+   if(b->count > a->count)
+      compare->imagesGained++;
+   else if(b->count < a->count)
+      compare->imagesLost++;
+
+   compare->barcodesA += a->count;
+   compare->barcodesB += b->count;
+   compare->lost += lost;
+   compare->gained += gained;
+}
+
+/**
+ * @brief  Print comparison totals, recall and time percentiles
+ * @param  compare comparison totals
+ * @param  fp output stream
+ * @param  section CompareSection being printed
+ * @return void
+ */
+extern void
+ComparePrint(ResultCompare *compare, FILE *fp, int section)
+{
+   long found;
+
+   if(section == CompareImages)
+      return;
+
+   /* Recall is measured against every barcode either run found */
+   found = compare->common + compare->lost + compare->gained;
+
+   fprintf(fp, "images: %ld\n", compare->images);
+   fprintf(fp, "images_changed: %ld\n", compare->imagesChanged);
+   fprintf(fp, "images_gained: %ld\n", compare->imagesGained);
+   fprintf(fp, "images_lost: %ld\n", compare->imagesLost);
+   fprintf(fp, "barcodes_a: %ld\n", compare->barcodesA);
+   fprintf(fp, "barcodes_b: %ld\n", compare->barcodesB);
+   fprintf(fp, "barcodes_both: %ld\n", compare->common);
+   fprintf(fp, "gained: %ld\n", compare->gained);
+   fprintf(fp, "lost: %ld\n", compare->lost);
+   fprintf(fp, "recall_a: %.4f\n", (found > 0) ? (double)compare->barcodesA / found : 0.0);
+   fprintf(fp, "recall_b: %.4f\n", (found > 0) ? (double)compare->barcodesB / found : 0.0);
+
+   PrintTimes(&(compare->timeA), "time_ms_a", fp);
+   PrintTimes(&(compare->timeB), "time_ms_b", fp);
+   PrintTimes(&(compare->timeDelta), "time_ms_delta", fp);
+}
+
+/**
+ * @brief  Tell whether any image gained or lost a barcode
+ * @param  compare comparison totals
+ * @return DmtxTrue | DmtxFalse
+ */
+extern DmtxBoolean
+CompareChanged(ResultCompare *compare)
+{
+   return (compare->imagesChanged > 0) ? DmtxTrue : DmtxFalse;
+}
+
+/**
+ * @brief  Order byte strings as memcmp() would, shorter first on a tie
+ * @param  a first string
+ * @param  aLength first string length
+ * @param  b second string
+ * @param  bLength second string length
+ * @return Negative, zero or positive
+ */
+static int
+CompareBytes(const unsigned char *a, unsigned long aLength,
+      const unsigned char *b, unsigned long bLength)
+{
+   int cmp;
+
+   cmp = memcmp(a, b, (aLength < bLength) ? aLength : bLength);
+   if(cmp != 0)
+      return cmp;
+
+   return (aLength < bLength) ? -1 : (aLength > bLength) ? 1 : 0;
+}
+
+/**
+ * @brief  qsort() comparison of two entries of sortGroup by message
+ * @param  a first CompareEntry
+ * @param  b second CompareEntry
+ * @return Negative, zero or positive
+ */
+static int
+CompareEntries(const void *a, const void *b)
+{
+   const CompareEntry *entryA, *entryB;
+
+   entryA = (const CompareEntry *)a;
+   entryB = (const CompareEntry *)b;
+
+   return CompareBytes(sortGroup->bytes + entryA->message, entryA->messageLength,
+         sortGroup->bytes + entryB->message, entryB->messageLength);
+}
+
+/**
+ * @brief  Count one time, clamping to the histogram range
+ * @param  times histogram
+ * @param  ms milliseconds
+ * @return void
+ */
+static void
+AddTime(CompareTimes *times, long ms)
+{
+   long bucket;
+
+   bucket = (ms < -COMPARE_TIME_RANGE) ? -COMPARE_TIME_RANGE :
+         (ms > COMPARE_TIME_RANGE) ? COMPARE_TIME_RANGE : ms;
+   times->count[bucket + COMPARE_TIME_RANGE]++;
+
+   if(times->total == 0 || ms < times->min)
+      times->min = ms;
+   if(times->total == 0 || ms > times->max)
+      times->max = ms;
+   times->sum += ms;
+   times->total++;
+}
+
+/**
+ * @brief  Find the time below which a share of the counted times fall
+ * @param  times histogram with at least one time
+ * @param  percent share, 0 to 100
+ * @return Milliseconds, clamped to the histogram range
+ */
+static long
+GetPercentile(CompareTimes *times, double percent)
+{
+   long i, seen, rank;
+
+   rank = (long)(percent / 100.0 * times->total + 0.5);
+   if(rank < 1)
+      rank = 1;
+
+   for(i = 0, seen = 0; i < 2 * COMPARE_TIME_RANGE; i++) {
+      seen += times->count[i];
+      if(seen >= rank)
+         break;
+   }
+
+   return i - COMPARE_TIME_RANGE;
+}
+
+/**
+ * @brief  Print mean, percentiles and extremes of a histogram
+ * @param  times histogram
+ * @param  name line prefix
+ * @param  fp output stream
+ * @return void
+ */
+static void
+PrintTimes(CompareTimes *times, const char *name, FILE *fp)
+{
+   int i;
+   static const struct {
+      const char *name;
+      double percent;
+   } percentiles[] = {
+         { "p50", 50.0 },
+         { "p90", 90.0 },
+         { "p95", 95.0 },
+         { "p99", 99.0 }
+   };
+
+   if(times->total == 0)
+      return;
+
+   fprintf(fp, "%s min: %ld\n", name, times->min);
+   fprintf(fp, "%s mean: %.1f\n", name, times->sum / times->total);
+   for(i = 0; i < (int)(sizeof(percentiles) / sizeof(percentiles[0])); i++)
+      fprintf(fp, "%s %s: %ld\n", name, percentiles[i].name,
+            GetPercentile(times, percentiles[i].percent));
+   fprintf(fp, "%s max: %ld\n", name, times->max);
+}
+
+/**
+ * @brief  Print one lost or gained barcode: kind, message, file, member, page
+ * @param  fp output stream
+ * @param  kind "lost" or "gained"
+ * @param  group image group holding the barcode
+ * @param  entry barcode
+ * @return void
+ */
+static void
+PrintEntry(FILE *fp, const char *kind, CompareGroup *group, CompareEntry *entry)
+{
+   fputs(kind, fp);
+   fputc('\t', fp);
+   fwrite(group->bytes + entry->message, 1, entry->messageLength, fp);
+   fputc('\t', fp);
+   fwrite(group->file, 1, group->fileLength, fp);
+   fputc('\t', fp);
+   if(entry->memberLength != DmtxUndefined)
+      fwrite(group->bytes + entry->member, 1, entry->memberLength, fp);
+   fprintf(fp, "\t%ld\n", group->page + 1);
+}
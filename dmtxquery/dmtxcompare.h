@@ -0,0 +1,56 @@
+/*
+libdmtx - Data Matrix Encoding/Decoding Library
+
+Copyright (C) 2008, 2009 Mike Laughton
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+Contact: mike@dragonflylogic.com
+*/
+
+#ifndef __DMTXCOMPARE_H__
+#define __DMTXCOMPARE_H__
+
+#include <stdio.h>
+
+/* Times and time differences within this many milliseconds get exact percentiles */
+#define COMPARE_TIME_RANGE  65536
+
+/* Report sections, selected by compare.SECTION */
+typedef enum {
+   CompareAll,
+   CompareImages,
+   CompareSummary
+} CompareSection;
+
+typedef struct CompareGroup_struct CompareGroup;
+typedef struct ResultCompare_struct ResultCompare;
+
+extern int CompareRecordKeys(const ResultRecord *a, const ResultRecord *b);
+
+extern CompareGroup *CompareGroupCreate(void);
+extern void CompareGroupDestroy(CompareGroup **group);
+extern DmtxPassFail CompareGroupReset(CompareGroup *group, const ResultRecord *rec);
+extern int CompareGroupKey(const CompareGroup *group, const ResultRecord *rec);
+extern DmtxPassFail CompareGroupAdd(CompareGroup *group, const ResultRecord *rec);
+
+extern ResultCompare *CompareCreate(void);
+extern void CompareDestroy(ResultCompare **compare);
+extern void CompareImage(ResultCompare *compare, CompareGroup *a, CompareGroup *b,
+      FILE *fp, int section);
+extern void ComparePrint(ResultCompare *compare, FILE *fp, int section);
+extern DmtxBoolean CompareChanged(ResultCompare *compare);
+
+#endif
@@ -0,0 +1,1873 @@
+/*
+libdmtx - Data Matrix Encoding/Decoding Library
+
+Copyright (C) 2008, 2009 Mike Laughton
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+Contact: mike@dragonflylogic.com
+*/
+
+/**
+ * @file dmtxindex.c
+ * @brief Persistent result index for fast lookups
+ *
+ * An index file holds the barcodes of any number of result files in
+ * segments. Each update appends one or more segments and then rewrites
+ * the fixed header, so earlier segments are never touched and a failed
+ * update leaves the index as it was. Segments are capped in size, which
+ * bounds the memory an update needs.
+ *
+ * Every segment carries its records, a hash table on message, the
+ * records sorted by file and page, and the byte offset reached in each
+ * result file it read. Queries map the file read-only and probe each
+ * segment, so a lookup costs a few probes per segment whatever the
+ * number of barcodes. The offsets let later updates read only what was
+ * appended to a result file since it was last indexed.
+ *
+ * A source also keeps a fingerprint of the bytes before its offset (a
+ * hash of the first and last INDEX_FINGERPRINT_SPAN of them), so a
+ * result file written again under the same name is noticed and read
+ * from the start instead of resumed. Each entry names the source it
+ * came from, and each source the ordinal its current reading started
+ * after. Queries skip a record whose ordinal is not past the newest
+ * such start for its file, so the barcodes of a replaced result file
+ * are superseded rather than counted twice.
+ *
+ * All integers are little-endian, as in the binary result stream:
+ *
+ *    header:  "DMTXIDX\0", u32 version, u32 segmentCount,
+ *             u64 newestSegment, u64 recordCount
+ *    segment: "SEGM", u32 recordCount, u64 previousSegment,
+ *             u64 baseOrdinal, u32 hashSize, u32 sourceCount,
+ *             u32 stringsSize, u32 reserved,
+ *             entries[recordCount], u32 sorted[recordCount],
+ *             u32 hash[hashSize], sources[sourceCount], strings
+ *    entry:   u32 fileOffset, u16 fileLength, u16 memberLength,
+ *             u32 memberOffset, u32 messageOffset, u32 messageLength,
+ *             u32 pageIndex, u32 elapsedMS, i16 sizeIdx, u16 padCount,
+ *             i16 rotation, u16 flags, f32 corner[8], u32 source
+ *    source:  u32 pathOffset, u32 pathLength, u64 consumed,
+ *             u64 startOrdinal, u32 fingerprint, u32 reserved
+ *
+ * Hash slots hold a record number plus one (0 is empty) and are probed
+ * linearly. Sources are sorted by path. An entry's source is its number
+ * in the segment's sources plus one, or 0 for standard input. Offsets
+ * in entries and sources point into the segment's strings.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <dmtx.h>
+#include "../common/dmtxutil.h"
+#include "../common/dmtxrecord.h"
+#include "dmtxindex.h"
+
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+#include <sys/mman.h>
+#endif
+
+/* Entry flags */
+#define INDEX_FLAG_MEMBER 0x0001
+
+typedef struct {
+   const unsigned char *entries;
+   const unsigned char *sorted;
+   const unsigned char *hash;
+   const unsigned char *sources;
+   const unsigned char *strings;
+   unsigned long recordCount;
+   unsigned long hashSize;
+   unsigned long sourceCount;
+   unsigned long stringsSize;
+   long baseOrdinal;
+   long *sourceStart;          /* newest start ordinal of each source's file, or NULL */
+   unsigned long liveCount;    /* records not superseded */
+} IndexSegment;
+
+struct ResultIndex_struct {
+   unsigned char *data;
+   size_t size;
+   DmtxBoolean mapped;
+   IndexSegment *segments;     /* oldest first */
+   unsigned long segmentCount;
+   long recordCount;           /* records not superseded */
+   long *sourceStart;          /* storage for every segment's sourceStart */
+};
+
+typedef enum {
+   CursorAll,
+   CursorMessage,
+   CursorFile,
+   CursorSorted
+} CursorMode;
+
+struct IndexCursor_struct {
+   ResultIndex *index;
+   IndexFilter filter;         /* strings belong to the caller */
+   int mode;                   /* CursorMode */
+   unsigned long segment;      /* segment being read (all, message) */
+   unsigned long segmentEnd;   /* segment after the last one to read */
+   unsigned long position;     /* record or hash slot in segment */
+   unsigned long probes;       /* hash slots visited in segment */
+   DmtxBoolean probing;        /* position is a started probe */
+   unsigned long *next;        /* per segment sorted position (file, sorted) */
+   unsigned long *end;         /* per segment end of range (file, sorted) */
+};
+
+typedef struct {
+   unsigned long pathOffset;
+   unsigned long pathLength;
+   long consumed;
+   long start;
+   unsigned long fingerprint;
+   int number;                 /* position before sorting */
+} WriterSource;
+
+struct IndexWriter_struct {
+   FILE *fp;
+   ResultIndex *previous;      /* index before this update, for source offsets */
+   unsigned long segmentCount;
+   long newestSegment;
+   long recordCount;
+   unsigned char *entries;     /* pending segment */
+   size_t entriesSize;
+   unsigned long entryCount;
+   unsigned char *strings;
+   size_t stringsSize;
+   unsigned long stringsLength;
+   unsigned long *names;       /* offset + 1 and length of stored names */
+   unsigned long nameSlots;
+   unsigned long nameCount;
+   WriterSource *sources;
+   int sourceCount;
+   int sourceSize;
+   char *sourcePath;           /* result file being read, or NULL */
+   long sourceStart;           /* ordinal its current reading started after */
+};
+
+static unsigned long GetValue64(const unsigned char *ptr);
+static void PutValue64(unsigned char *ptr, long value);
+static unsigned long HashBytes(const unsigned char *ptr, unsigned long length);
+static int CompareBytes(const unsigned char *a, unsigned long aLength,
+      const unsigned char *b, unsigned long bLength);
+static DmtxPassFail ReadSegments(ResultIndex *index);
+static DmtxPassFail ReadSources(ResultIndex *index);
+static const unsigned char *FindSource(ResultIndex *index, const unsigned char *path,
+      unsigned long pathLength);
+static DmtxBoolean IsLive(IndexSegment *seg, unsigned long i);
+static DmtxPassFail GetFingerprint(const char *path, long consumed, unsigned long *fingerprint);
+static DmtxBoolean MatchPredicate(const IndexPredicate *pred, const ResultRecord *rec);
+static int DecodeEntry(IndexSegment *seg, unsigned long i, ResultRecord *rec);
+static IndexCursor *OpenCursor(ResultIndex *index, const IndexFilter *filter, int mode);
+static unsigned long FindBound(IndexSegment *seg, const IndexFilter *filter, unsigned long page,
+      DmtxBoolean upper);
+static int NextMessage(IndexCursor *cursor, ResultRecord *rec);
+static int NextFile(IndexCursor *cursor, ResultRecord *rec);
+static int NextAll(IndexCursor *cursor, ResultRecord *rec);
+static DmtxPassFail WriteHeader(IndexWriter *writer);
+static DmtxPassFail WriteSegment(IndexWriter *writer);
+static DmtxPassFail AddString(IndexWriter *writer, const void *str, unsigned long length,
+      unsigned long *offset);
+static DmtxPassFail AddName(IndexWriter *writer, const char *name, unsigned long length,
+      unsigned long *offset);
+static DmtxPassFail AddSource(IndexWriter *writer, long consumed);
+static void SetSourceEnd(IndexWriter *writer, long consumed);
+static int CompareWriterEntries(const void *a, const void *b);
+static int CompareWriterSources(const void *a, const void *b);
+
+/* Writer being sorted, as qsort() passes no context to comparisons */
+static IndexWriter *sortWriter;
+
+/**
+ * @brief  Reset a filter to match every barcode
+ * @param  filter filter to reset
+ * @return void
+ */
+extern void
+IndexFilterInit(IndexFilter *filter)
+{
+   memset(filter, 0x00, sizeof(IndexFilter));
+   filter->pageFirst = DmtxUndefined;
+   filter->pageLast = DmtxUndefined;
+}
+
+/**
+ * @brief  Tell whether a filter matches every barcode
+ * @param  filter query filter
+ * @return DmtxTrue | DmtxFalse
+ */
+extern DmtxBoolean
+IndexFilterIsEmpty(const IndexFilter *filter)
+{
+   return (filter->message == NULL && filter->file == NULL &&
+         filter->pageFirst == DmtxUndefined && filter->pageLast == DmtxUndefined &&
+         filter->whereCount == 0) ? DmtxTrue : DmtxFalse;
+}
+
+/**
+ * @brief  Test a barcode against a filter
+ * @param  filter query filter
+ * @param  rec barcode record
+ * @return DmtxTrue | DmtxFalse
+ *
+ * Streaming queries use this directly, so they select exactly what an
+ * indexed query would.
+ */
+extern DmtxBoolean
+IndexFilterMatch(const IndexFilter *filter, const ResultRecord *rec)
+{
+   int i;
+
+   if(filter->message != NULL && (rec->messageLength != filter->messageLength ||
+         memcmp(rec->message, filter->message, filter->messageLength) != 0))
+      return DmtxFalse;
+
+   if(filter->file != NULL && (rec->fileLength != filter->fileLength ||
+         memcmp(rec->file, filter->file, filter->fileLength) != 0))
+      return DmtxFalse;
+
+   if(filter->pageFirst != DmtxUndefined && rec->pageIndex + 1 < filter->pageFirst)
+      return DmtxFalse;
+
+   if(filter->pageLast != DmtxUndefined && rec->pageIndex + 1 > filter->pageLast)
+      return DmtxFalse;
+
+   for(i = 0; i < filter->whereCount; i++) {
+      if(MatchPredicate(&(filter->where[i]), rec) == DmtxFalse)
+         return DmtxFalse;
+   }
+
+   return DmtxTrue;
+}
+
+/**
+ * @brief  Parse a FIELD OP VALUE predicate such as rotation>45 or size=16x16
+ * @param  pred predicate to fill, whose text points into expr
+ * @param  expr predicate text
+ * @return DmtxPass | DmtxFail
+ */
+extern DmtxPassFail
+IndexParsePredicate(IndexPredicate *pred, const char *expr)
+{
+   int i;
+   size_t nameLength;
+   const char *ptr;
+   char *end;
+   char extra;
+   static const struct {
+      const char *name;
+      int field;
+   } fields[] = {
+         { "rotation",       PredRotation },
+         { "size",           PredMatrixSize },
+         { "matrix_size",    PredMatrixSize },
+         { "data_codewords", PredDataCodewords },
+         { "page",           PredPage },
+         { "time_ms",        PredTime },
+         { "file",           PredFile },
+         { "member",         PredMember },
+         { "message",        PredMessage }
+   };
+   static const struct {
+      const char *text;
+      int op;
+   } ops[] = {
+         { "<=", PredLessEqual },
+         { ">=", PredGreaterEqual },
+         { "!=", PredNotEqual },
+         { "==", PredEqual },
+         { "=",  PredEqual },
+         { "<",  PredLess },
+         { ">",  PredGreater }
+   };
+
+   memset(pred, 0x00, sizeof(IndexPredicate));
+
+   for(ptr = expr; *ptr == '_' || (*ptr >= 'a' && *ptr <= 'z'); ptr++)
+      ;
+   nameLength = (size_t)(ptr - expr);
+
+   for(i = 0; i < (int)(sizeof(fields) / sizeof(fields[0])); i++) {
+      if(strlen(fields[i].name) == nameLength && strncmp(expr, fields[i].name, nameLength) == 0)
+         break;
+   }
+   if(i == (int)(sizeof(fields) / sizeof(fields[0])))
+      return DmtxFail;
+   pred->field = fields[i].field;
+
+   for(i = 0; i < (int)(sizeof(ops) / sizeof(ops[0])); i++) {
+      if(strncmp(ptr, ops[i].text, strlen(ops[i].text)) == 0)
+         break;
+   }
+   if(i == (int)(sizeof(ops) / sizeof(ops[0])))
+      return DmtxFail;
+   pred->op = ops[i].op;
+   ptr += strlen(ops[i].text);
+
+   switch(pred->field) {
+      case PredFile:
+      case PredMember:
+      case PredMessage:
+         if(pred->op != PredEqual && pred->op != PredNotEqual)
+            return DmtxFail;
+         pred->text = ptr;
+         pred->textLength = (long)strlen(ptr);
+         break;
+      case PredMatrixSize:
+         /* RxC, or one number for a square symbol */
+         i = sscanf(ptr, "%dx%d%c", &(pred->rows), &(pred->cols), &extra);
+         if(i == 1 && strchr(ptr, 'x') == NULL)
+            pred->cols = pred->rows;
+         else if(i != 2)
+            return DmtxFail;
+         break;
+      default:
+         pred->value = strtod(ptr, &end);
+         if(end == ptr || *end != '\0')
+            return DmtxFail;
+         break;
+   }
+
+   return DmtxPass;
+}
+/**
+ * @brief  Open an index for queries
+ * @param  path index file
+ * @return Address of index, or NULL if missing or not a valid index
+ */
+extern ResultIndex *
+IndexOpen(const char *path)
+{
+   long size;
+   FILE *fp;
+   ResultIndex *index;
+
+   fp = fopen(path, "rb");
+   if(fp == NULL)
+      return NULL;
+
+   if(fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < INDEX_HEADER_SIZE ||
+         fseek(fp, 0, SEEK_SET) != 0) {
+      fclose(fp);
+      return NULL;
+   }
+
+   index = (ResultIndex *)calloc(1, sizeof(ResultIndex));
+   if(index == NULL) {
+      fclose(fp);
+      return NULL;
+   }
+   index->size = (size_t)size;
+
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+   index->data = (unsigned char *)mmap(NULL, index->size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+   if(index->data == (unsigned char *)MAP_FAILED)
+      index->data = NULL;
+   else
+      index->mapped = DmtxTrue;
+#endif
+
+   /* Without mmap the index is read whole */
+   if(index->data == NULL) {
+      index->data = (unsigned char *)malloc(index->size);
+      if(index->data == NULL || fread(index->data, 1, index->size, fp) != index->size) {
+         fclose(fp);
+         IndexClose(&index);
+         return NULL;
+      }
+   }
+
+   fclose(fp);
+
+   if(ReadSegments(index) != DmtxPass) {
+      IndexClose(&index);
+      return NULL;
+   }
+
+   return index;
+}
+
+/**
+ * @brief  Close an index
+ * @param  index pointer to index pointer
+ * @return void
+ */
+extern void
+IndexClose(ResultIndex **index)
+{
+   if(index == NULL || *index == NULL)
+      return;
+
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+   if((*index)->mapped == DmtxTrue)
+      munmap((*index)->data, (*index)->size);
+   else
+#endif
+      free((*index)->data);
+
+   free((*index)->segments);
+   free((*index)->sourceStart);
+   free(*index);
+
+   *index = NULL;
+}
+
+/**
+ * @brief  Number of barcodes in an index
+ * @param  index result index
+ * @return Barcode count, leaving out those of replaced result files
+ */
+extern long
+IndexGetCount(ResultIndex *index)
+{
+   return index->recordCount;
+}
+
+/**
+ * @brief  Fetch a barcode by its position in the index
+ * @param  index result index
+ * @param  ordinal 1-based position, in the order barcodes were added,
+ *         counting only barcodes that were not superseded
+ * @param  rec record pointing into the index, valid until it is closed
+ * @return 1 for a record, 0 if out of range, -1 if the index is corrupt
+ */
+extern int
+IndexGetRecord(ResultIndex *index, long ordinal, ResultRecord *rec)
+{
+   unsigned long i, j;
+   IndexSegment *seg;
+
+   if(ordinal < 1)
+      return 0;
+
+   for(i = 0; i < index->segmentCount; i++) {
+      seg = &(index->segments[i]);
+      if(ordinal > (long)seg->liveCount) {
+         ordinal -= (long)seg->liveCount;
+         continue;
+      }
+
+      if(seg->sourceStart == NULL)
+         return DecodeEntry(seg, (unsigned long)(ordinal - 1), rec);
+
+      for(j = 0; j < seg->recordCount; j++) {
+         if(IsLive(seg, j) == DmtxTrue && --ordinal == 0)
+            return DecodeEntry(seg, j, rec);
+      }
+
+      return -1;
+   }
+
+   return 0;
+}
+
+/**
+ * @brief  Start a query
+ * @param  index result index
+ * @param  filter barcodes wanted, whose strings must outlive the cursor
+ * @return Address of new cursor, or NULL if out of memory
+ *
+ * A message is looked up in each segment's hash table, and a file in
+ * its sorted records. Other queries visit every record. Matches come
+ * in the order they were added, except that file queries return them
+ * by page.
+ */
+extern IndexCursor *
+IndexFind(ResultIndex *index, const IndexFilter *filter)
+{
+   if(filter->message != NULL)
+      return OpenCursor(index, filter, CursorMessage);
+
+   return OpenCursor(index, filter, (filter->file != NULL) ? CursorFile : CursorAll);
+}
+
+/**
+ * @brief  Start a query returning barcodes by file name, then page
+ * @param  index result index
+ * @param  filter barcodes wanted, whose strings must outlive the cursor
+ * @return Address of new cursor, or NULL if out of memory
+ *
+ * Each segment's sorted records are merged, so the whole index streams
+ * in the order dmtxquery compare needs without sorting anything. Files
+ * order as memcmp() orders their names.
+ */
+extern IndexCursor *
+IndexFindSorted(ResultIndex *index, const IndexFilter *filter)
+{
+   return OpenCursor(index, filter, (filter->file != NULL) ? CursorFile : CursorSorted);
+}
+
+/**
+ * @brief  Fetch the next match of a query
+ * @param  cursor query cursor
+ * @param  rec record pointing into the index, valid until it is closed
+ * @return 1 for a record, 0 when done, -1 if the index is corrupt
+ */
+extern int
+IndexNext(IndexCursor *cursor, ResultRecord *rec)
+{
+   switch(cursor->mode) {
+      case CursorMessage:
+         return NextMessage(cursor, rec);
+      case CursorFile:
+      case CursorSorted:
+         return NextFile(cursor, rec);
+      default:
+         break;
+   }
+
+   return NextAll(cursor, rec);
+}
+
+/**
+ * @brief  Free a cursor
+ * @param  cursor pointer to cursor pointer
+ * @return void
+ */
+extern void
+IndexCursorClose(IndexCursor **cursor)
+{
+   if(cursor == NULL || *cursor == NULL)
+      return;
+
+   free((*cursor)->next);
+   free((*cursor)->end);
+   free(*cursor);
+
+   *cursor = NULL;
+}
+
+/**
+ * @brief  Number of segments in an index
+ * @param  index result index
+ * @return Segment count
+ */
+extern unsigned long
+IndexGetSegmentCount(ResultIndex *index)
+{
+   return index->segmentCount;
+}
+
+/**
+ * @brief  Limit a new cursor to one segment, so segments can be read in parallel
+ * @param  cursor query cursor not yet read from
+ * @param  segment segment number (0 is oldest)
+ * @return void
+ */
+extern void
+IndexCursorSetSegment(IndexCursor *cursor, unsigned long segment)
+{
+   unsigned long i;
+
+   cursor->segment = segment;
+   cursor->segmentEnd = segment + 1;
+
+   if(cursor->mode == CursorFile || cursor->mode == CursorSorted) {
+      for(i = 0; i < cursor->index->segmentCount; i++) {
+         if(i != segment)
+            cursor->next[i] = cursor->end[i];
+      }
+   }
+}
+
+/**
+ * @brief  Open an index for adding barcodes, creating it if needed
+ * @param  path index file
+ * @return Address of new writer, or NULL on error (errno is set)
+ */
+extern IndexWriter *
+IndexWriterOpen(const char *path)
+{
+   unsigned char header[INDEX_HEADER_SIZE];
+   IndexWriter *writer;
+
+   writer = (IndexWriter *)calloc(1, sizeof(IndexWriter));
+   if(writer == NULL)
+      return NULL;
+
+   writer->fp = fopen(path, "r+b");
+   if(writer->fp == NULL) {
+      if(errno != ENOENT) {
+         free(writer);
+         return NULL;
+      }
+
+      writer->fp = fopen(path, "w+b");
+      if(writer->fp == NULL || WriteHeader(writer) != DmtxPass) {
+         IndexWriterClose(&writer);
+         return NULL;
+      }
+
+      return writer;
+   }
+
+   if(fread(header, 1, INDEX_HEADER_SIZE, writer->fp) != INDEX_HEADER_SIZE ||
+         memcmp(header, INDEX_MAGIC, 8) != 0 ||
+         RecordGetValue(header + 8, 4) != INDEX_VERSION ||
+         (writer->previous = IndexOpen(path)) == NULL) {
+      IndexWriterClose(&writer);
+      errno = EINVAL;
+      return NULL;
+   }
+
+   writer->segmentCount = RecordGetValue(header + 12, 4);
+   writer->newestSegment = (long)GetValue64(header + 16);
+   writer->recordCount = (long)GetValue64(header + 24);
+
+   return writer;
+}
+
+/**
+ * @brief  Write pending barcodes and close a writer
+ * @param  writer pointer to writer pointer
+ * @return DmtxPass | DmtxFail
+ */
+extern DmtxPassFail
+IndexWriterClose(IndexWriter **writer)
+{
+   DmtxPassFail err;
+
+   if(writer == NULL || *writer == NULL)
+      return DmtxFail;
+
+   err = DmtxPass;
+   if((*writer)->fp != NULL) {
+      if((*writer)->entryCount > 0)
+         err = WriteSegment(*writer);
+      if(fclose((*writer)->fp) != 0)
+         err = DmtxFail;
+   }
+
+   IndexClose(&((*writer)->previous));
+   free((*writer)->entries);
+   free((*writer)->strings);
+   free((*writer)->names);
+   free((*writer)->sources);
+   free((*writer)->sourcePath);
+   free(*writer);
+
+   *writer = NULL;
+
+   return err;
+}
+
+/**
+ * @brief  Byte offset an earlier update reached in a result file
+ * @param  writer index writer
+ * @param  source result file path, as given to IndexWriterBeginSource()
+ * @return Offset, 0 if the file was never indexed, or -1 if its bytes
+ *         before the offset no longer match what was indexed
+ */
+extern long
+IndexWriterGetOffset(IndexWriter *writer, const char *source)
+{
+   long consumed;
+   unsigned long fingerprint;
+   const unsigned char *entry;
+
+   if(writer->previous == NULL)
+      return 0;
+
+   entry = FindSource(writer->previous, (const unsigned char *)source, strlen(source));
+   if(entry == NULL)
+      return 0;
+
+   consumed = (long)GetValue64(entry + 8);
+   if(consumed <= 0)
+      return 0;
+
+   if(GetFingerprint(source, consumed, &fingerprint) != DmtxPass ||
+         fingerprint != RecordGetValue(entry + 24, 4))
+      return -1;
+
+   return consumed;
+}
+
+/**
+ * @brief  Start adding the barcodes of a result file
+ * @param  writer index writer
+ * @param  source result file path, or NULL for a stream that cannot be
+ *         read again (its offset is not kept)
+ * @param  offset byte offset reading starts from, as returned by
+ *         IndexWriterGetOffset(), or 0 to supersede the file's barcodes
+ *         from earlier updates
+ * @return DmtxPass | DmtxFail
+ */
+extern DmtxPassFail
+IndexWriterBeginSource(IndexWriter *writer, const char *source, long offset)
+{
+   const unsigned char *entry;
+
+   free(writer->sourcePath);
+   writer->sourcePath = NULL;
+
+   if(source == NULL)
+      return DmtxPass;
+
+   /* A resumed file keeps the start of the reading it continues */
+   entry = (offset > 0 && writer->previous != NULL) ?
+         FindSource(writer->previous, (const unsigned char *)source, strlen(source)) : NULL;
+   writer->sourceStart = (entry != NULL) ? (long)GetValue64(entry + 16) :
+         writer->recordCount + (long)writer->entryCount;
+
+   writer->sourcePath = (char *)malloc(strlen(source) + 1);
+   if(writer->sourcePath == NULL)
+      return DmtxFail;
+   strcpy(writer->sourcePath, source);
+
+   return AddSource(writer, offset);
+}
+
+/**
+ * @brief  Finish a result file
+ * @param  writer index writer
+ * @param  consumed byte offset reached, just after the last record read
+ * @return void
+ */
+extern void
+IndexWriterEndSource(IndexWriter *writer, long consumed)
+{
+   if(writer->sourcePath == NULL)
+      return;
+
+   SetSourceEnd(writer, consumed);
+
+   free(writer->sourcePath);
+   writer->sourcePath = NULL;
+}
+
+/**
+ * @brief  Add one barcode
+ * @param  writer index writer
+ * @param  rec barcode record
+ * @return DmtxPass | DmtxFail
+ */
+extern DmtxPassFail
+IndexWriterAdd(IndexWriter *writer, const ResultRecord *rec)
+{
+   int i;
+   size_t newSize;
+   unsigned int bits;
+   unsigned long fileOffset, memberOffset, messageOffset;
+   unsigned char *newEntries, *ptr;
+
+   assert(sizeof(float) == 4 && sizeof(unsigned int) >= 4);
+
+   if(rec->fileLength > 0xffff || rec->memberLength > 0xffff)
+      return DmtxFail;
+
+   if((writer->entryCount + 1) * INDEX_ENTRY_SIZE > writer->entriesSize) {
+      newSize = (writer->entriesSize == 0) ? 4096 * INDEX_ENTRY_SIZE : writer->entriesSize * 2;
+      newEntries = (unsigned char *)realloc(writer->entries, newSize);
+      if(newEntries == NULL)
+         return DmtxFail;
+      writer->entries = newEntries;
+      writer->entriesSize = newSize;
+   }
+
+   memberOffset = 0;
+   if(AddName(writer, rec->file, rec->fileLength, &fileOffset) != DmtxPass ||
+         (rec->member != NULL &&
+         AddName(writer, rec->member, rec->memberLength, &memberOffset) != DmtxPass) ||
+         AddString(writer, rec->message, rec->messageLength, &messageOffset) != DmtxPass)
+      return DmtxFail;
+
+   ptr = writer->entries + writer->entryCount * INDEX_ENTRY_SIZE;
+   RecordPutValue(ptr, fileOffset, 4);
+   RecordPutValue(ptr + 4, rec->fileLength, 2);
+   RecordPutValue(ptr + 6, (rec->member == NULL) ? 0 : rec->memberLength, 2);
+   RecordPutValue(ptr + 8, memberOffset, 4);
+   RecordPutValue(ptr + 12, messageOffset, 4);
+   RecordPutValue(ptr + 16, rec->messageLength, 4);
+   RecordPutValue(ptr + 20, rec->pageIndex, 4);
+   RecordPutValue(ptr + 24, rec->elapsedMS, 4);
+   RecordPutValue(ptr + 28, (unsigned long)rec->sizeIdx, 2);
+   RecordPutValue(ptr + 30, rec->padCount, 2);
+   RecordPutValue(ptr + 32, (unsigned long)rec->rotation, 2);
+   RecordPutValue(ptr + 34, (rec->member == NULL) ? 0 : INDEX_FLAG_MEMBER, 2);
+   RecordPutValue(ptr + 68, (writer->sourcePath == NULL) ? 0 : writer->sourceCount, 4);
+   ptr += 36;
+
+   for(i = 0; i < 8; i++) {
+      bits = 0;
+      memcpy(&bits, &(rec->corner[i]), 4);
+      RecordPutValue(ptr, bits, 4);
+      ptr += 4;
+   }
+
+   writer->entryCount++;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Tell whether the pending segment has reached its size limit
+ * @param  writer index writer
+ * @return DmtxTrue | DmtxFalse
+ */
+extern DmtxBoolean
+IndexWriterFull(IndexWriter *writer)
+{
+   return (writer->entryCount >= INDEX_SEGMENT_RECORDS ||
+         writer->stringsLength >= (unsigned long)INDEX_SEGMENT_STRINGS) ? DmtxTrue : DmtxFalse;
+}
+
+/**
+ * @brief  Write the pending segment
+ * @param  writer index writer
+ * @param  consumed byte offset reached in the current result file
+ * @return DmtxPass | DmtxFail
+ */
+extern DmtxPassFail
+IndexWriterFlush(IndexWriter *writer, long consumed)
+{
+   if(writer->sourcePath != NULL)
+      SetSourceEnd(writer, consumed);
+
+   return (writer->entryCount > 0) ? WriteSegment(writer) : DmtxPass;
+}
+
+/**
+ * @brief  Load an unsigned little-endian 64-bit value
+ * @param  ptr source
+ * @return Value (high bits are lost where long is 32 bits)
+ */
+static unsigned long
+GetValue64(const unsigned char *ptr)
+{
+   return RecordGetValue(ptr, 4) | ((RecordGetValue(ptr + 4, 4) << 16) << 16);
+}
+
+/**
+ * @brief  Store a 64-bit value in little-endian order
+ * @param  ptr destination
+ * @param  value value to store
+ * @return void
+ */
+static void
+PutValue64(unsigned char *ptr, long value)
+{
+   RecordPutValue(ptr, (unsigned long)value & 0xffffffffUL, 4);
+   RecordPutValue(ptr + 4, (((unsigned long)value >> 16) >> 16) & 0xffffffffUL, 4);
+}
+
+/**
+ * @brief  32-bit FNV-1a hash
+ * @param  ptr bytes to hash
+ * @param  length byte count
+ * @return Hash value
+ */
+static unsigned long
+HashBytes(const unsigned char *ptr, unsigned long length)
+{
+   unsigned long i, hash;
+
+   hash = 2166136261UL;
+   for(i = 0; i < length; i++) {
+      hash ^= ptr[i];
+      hash = (hash * 16777619UL) & 0xffffffffUL;
+   }
+
+   return hash;
+}
+
+/**
+ * @brief  Order byte strings as memcmp() would, shorter first on a tie
+ * @param  a first string
+ * @param  aLength first string length
+ * @param  b second string
+ * @param  bLength second string length
+ * @return Negative, zero or positive
+ */
+static int
+CompareBytes(const unsigned char *a, unsigned long aLength,
+      const unsigned char *b, unsigned long bLength)
+{
+   int cmp;
+
+   cmp = memcmp(a, b, (aLength < bLength) ? aLength : bLength);
+   if(cmp != 0)
+      return cmp;
+
+   return (aLength < bLength) ? -1 : (aLength > bLength) ? 1 : 0;
+}
+
+/**
+ * @brief  Locate and check every segment of an opened index
+ * @param  index result index with its file contents loaded
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+ReadSegments(ResultIndex *index)
+{
+   unsigned long i, count, offset, remaining;
+   long recordCount;
+   const unsigned char *ptr;
+   IndexSegment *seg;
+
+   if(memcmp(index->data, INDEX_MAGIC, 8) != 0 ||
+         RecordGetValue(index->data + 8, 4) != INDEX_VERSION)
+      return DmtxFail;
+
+   index->segmentCount = RecordGetValue(index->data + 12, 4);
+   index->recordCount = (long)GetValue64(index->data + 24);
+   if(index->segmentCount > index->size / INDEX_SEGMENT_SIZE)
+      return DmtxFail;
+
+   index->segments = (IndexSegment *)calloc(index->segmentCount + 1, sizeof(IndexSegment));
+   if(index->segments == NULL)
+      return DmtxFail;
+
+   /* Segments are linked newest first */
+   recordCount = 0;
+   offset = GetValue64(index->data + 16);
+   for(i = index->segmentCount; i > 0; i--) {
+      if(offset < INDEX_HEADER_SIZE || offset > index->size - INDEX_SEGMENT_SIZE)
+         return DmtxFail;
+
+      ptr = index->data + offset;
+      if(memcmp(ptr, INDEX_SEGMENT_MAGIC, 4) != 0)
+         return DmtxFail;
+
+      seg = &(index->segments[i - 1]);
+      seg->recordCount = RecordGetValue(ptr + 4, 4);
+      seg->baseOrdinal = (long)GetValue64(ptr + 16);
+      seg->hashSize = RecordGetValue(ptr + 24, 4);
+      seg->sourceCount = RecordGetValue(ptr + 28, 4);
+      seg->stringsSize = RecordGetValue(ptr + 32, 4);
+
+      /* Each part is checked against what is left, so nothing can overflow */
+      remaining = index->size - offset - INDEX_SEGMENT_SIZE;
+      ptr += INDEX_SEGMENT_SIZE;
+
+      count = seg->recordCount;
+      if(count > remaining / (INDEX_ENTRY_SIZE + 4))
+         return DmtxFail;
+      seg->entries = ptr;
+      seg->sorted = ptr + count * INDEX_ENTRY_SIZE;
+      ptr += count * (INDEX_ENTRY_SIZE + 4);
+      remaining -= count * (INDEX_ENTRY_SIZE + 4);
+
+      if(seg->hashSize == 0 || (seg->hashSize & (seg->hashSize - 1)) != 0 ||
+            seg->hashSize > remaining / 4)
+         return DmtxFail;
+      seg->hash = ptr;
+      ptr += seg->hashSize * 4;
+      remaining -= seg->hashSize * 4;
+
+      if(seg->sourceCount > remaining / INDEX_SOURCE_SIZE)
+         return DmtxFail;
+      seg->sources = ptr;
+      ptr += seg->sourceCount * INDEX_SOURCE_SIZE;
+      remaining -= seg->sourceCount * INDEX_SOURCE_SIZE;
+
+      if(seg->stringsSize > remaining)
+         return DmtxFail;
+      seg->strings = ptr;
+
+      recordCount += (long)seg->recordCount;
+      offset = GetValue64(index->data + offset + 8);
+   }
+
+   if(recordCount != index->recordCount)
+      return DmtxFail;
+
+   for(i = 0, recordCount = 0; i < index->segmentCount; i++) {
+      if(index->segments[i].baseOrdinal != recordCount)
+         return DmtxFail;
+      recordCount += (long)index->segments[i].recordCount;
+   }
+
+   return ReadSources(index);
+}
+
+/**
+ * @brief  Find which records of an opened index are superseded
+ * @param  index result index whose segments have been located
+ * @return DmtxPass | DmtxFail
+ *
+ * Each segment source is given the newest start ordinal recorded for its
+ * file. Only segments holding records at or before such a start need
+ * their records checked, and only those are counted one by one.
+ */
+static DmtxPassFail
+ReadSources(ResultIndex *index)
+{
+   unsigned long i, j, total;
+   unsigned long pathOffset, pathLength;
+   long start;
+   DmtxBoolean superseded;
+   const unsigned char *ptr, *newest;
+   IndexSegment *seg;
+
+   for(i = 0, total = 0; i < index->segmentCount; i++)
+      total += index->segments[i].sourceCount;
+
+   index->sourceStart = (long *)malloc((total + 1) * sizeof(long));
+   if(index->sourceStart == NULL)
+      return DmtxFail;
+
+   index->recordCount = 0;
+   for(i = 0, total = 0; i < index->segmentCount; i++) {
+      seg = &(index->segments[i]);
+      superseded = DmtxFalse;
+
+      for(j = 0; j < seg->sourceCount; j++) {
+         ptr = seg->sources + j * INDEX_SOURCE_SIZE;
+         pathOffset = RecordGetValue(ptr, 4);
+         pathLength = RecordGetValue(ptr + 4, 4);
+         if(pathOffset > seg->stringsSize || pathLength > seg->stringsSize - pathOffset)
+            return DmtxFail;
+
+         newest = FindSource(index, seg->strings + pathOffset, pathLength);
+         start = (long)GetValue64(((newest == NULL) ? ptr : newest) + 16);
+         if(start > seg->baseOrdinal)
+            superseded = DmtxTrue;
+         index->sourceStart[total + j] = start;
+      }
+
+      seg->liveCount = seg->recordCount;
+      if(superseded == DmtxTrue) {
+         seg->sourceStart = index->sourceStart + total;
+         for(j = 0; j < seg->recordCount; j++) {
+            if(IsLive(seg, j) == DmtxFalse)
+               seg->liveCount--;
+         }
+      }
+
+      total += seg->sourceCount;
+      index->recordCount += (long)seg->liveCount;
+   }
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Find the newest source entry of a result file
+ * @param  index result index
+ * @param  path result file path
+ * @param  pathLength path length
+ * @return Address of the source entry, or NULL if the file is not indexed
+ */
+static const unsigned char *
+FindSource(ResultIndex *index, const unsigned char *path, unsigned long pathLength)
+{
+   int cmp;
+   unsigned long i, low, high, mid;
+   unsigned long pathOffset, entryLength;
+   const unsigned char *ptr;
+   IndexSegment *seg;
+
+   /* Newest segments hold the latest offsets */
+   for(i = index->segmentCount; i > 0; i--) {
+      seg = &(index->segments[i - 1]);
+      low = 0;
+      high = seg->sourceCount;
+      while(low < high) {
+         mid = low + (high - low) / 2;
+         ptr = seg->sources + mid * INDEX_SOURCE_SIZE;
+         pathOffset = RecordGetValue(ptr, 4);
+         entryLength = RecordGetValue(ptr + 4, 4);
+         if(pathOffset > seg->stringsSize || entryLength > seg->stringsSize - pathOffset)
+            return NULL;
+
+         cmp = CompareBytes(seg->strings + pathOffset, entryLength, path, pathLength);
+         if(cmp == 0)
+            return ptr;
+         if(cmp < 0)
+            low = mid + 1;
+         else
+            high = mid;
+      }
+   }
+
+   return NULL;
+}
+
+/**
+ * @brief  Tell whether a record belongs to the current reading of its file
+ * @param  seg index segment
+ * @param  i entry number
+ * @return DmtxTrue | DmtxFalse
+ */
+static DmtxBoolean
+IsLive(IndexSegment *seg, unsigned long i)
+{
+   unsigned long source;
+
+   if(seg->sourceStart == NULL)
+      return DmtxTrue;
+
+   /* Standard input and out of range sources (reported by DecodeEntry) are kept */
+   source = RecordGetValue(seg->entries + i * INDEX_ENTRY_SIZE + 68, 4);
+   if(source == 0 || source > seg->sourceCount)
+      return DmtxTrue;
+
+   return (seg->baseOrdinal + (long)i + 1 > seg->sourceStart[source - 1]) ? DmtxTrue : DmtxFalse;
+}
+
+/**
+ * @brief  Hash the first and last bytes read from a result file
+ * @param  path result file path
+ * @param  consumed byte offset reached
+ * @param  fingerprint pointer to hash value
+ * @return DmtxPass, or DmtxFail if the file is missing or shorter than consumed
+ */
+static DmtxPassFail
+GetFingerprint(const char *path, long consumed, unsigned long *fingerprint)
+{
+   size_t span;
+   DmtxBoolean complete;
+   unsigned char bytes[2 * INDEX_FINGERPRINT_SPAN];
+   FILE *fp;
+
+   fp = fopen(path, "rb");
+   if(fp == NULL)
+      return DmtxFail;
+
+   span = (consumed < INDEX_FINGERPRINT_SPAN) ? (size_t)consumed : INDEX_FINGERPRINT_SPAN;
+   complete = (fread(bytes, 1, span, fp) == span &&
+         fseek(fp, consumed - (long)span, SEEK_SET) == 0 &&
+         fread(bytes + span, 1, span, fp) == span) ? DmtxTrue : DmtxFalse;
+   fclose(fp);
+
+   if(complete == DmtxFalse)
+      return DmtxFail;
+
+   *fingerprint = HashBytes(bytes, 2 * span);
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Test a barcode against one predicate
+ * @param  pred predicate
+ * @param  rec barcode record
+ * @return DmtxTrue | DmtxFalse
+ */
+static DmtxBoolean
+MatchPredicate(const IndexPredicate *pred, const ResultRecord *rec)
+{
+   int cmp;
+   int rows, cols;
+   double value;
+   const void *text;
+   long textLength;
+
+   switch(pred->field) {
+      case PredFile:
+      case PredMember:
+      case PredMessage:
+         if(pred->field == PredFile) {
+            text = rec->file;
+            textLength = rec->fileLength;
+         }
+         else if(pred->field == PredMember) {
+            text = (rec->member == NULL) ? "" : rec->member;
+            textLength = (rec->member == NULL) ? 0 : rec->memberLength;
+         }
+         else {
+            text = rec->message;
+            textLength = rec->messageLength;
+         }
+         cmp = (textLength == pred->textLength &&
+               memcmp(text, pred->text, textLength) == 0) ? 0 : 1;
+         return ((cmp == 0) == (pred->op == PredEqual)) ? DmtxTrue : DmtxFalse;
+      case PredMatrixSize:
+         rows = dmtxGetSymbolAttribute(DmtxSymAttribSymbolRows, rec->sizeIdx);
+         cols = dmtxGetSymbolAttribute(DmtxSymAttribSymbolCols, rec->sizeIdx);
+         cmp = (rows != pred->rows) ? rows - pred->rows : cols - pred->cols;
+         break;
+      default:
+         if(pred->field == PredRotation)
+            value = rec->rotation;
+         else if(pred->field == PredDataCodewords)
+            value = dmtxGetSymbolAttribute(DmtxSymAttribSymbolDataWords, rec->sizeIdx) -
+                  rec->padCount;
+         else if(pred->field == PredPage)
+            value = rec->pageIndex + 1;
+         else
+            value = rec->elapsedMS;
+         cmp = (value < pred->value) ? -1 : (value > pred->value) ? 1 : 0;
+         break;
+   }
+
+   switch(pred->op) {
+      case PredEqual:
+         return (cmp == 0) ? DmtxTrue : DmtxFalse;
+      case PredNotEqual:
+         return (cmp != 0) ? DmtxTrue : DmtxFalse;
+      case PredLess:
+         return (cmp < 0) ? DmtxTrue : DmtxFalse;
+      case PredLessEqual:
+         return (cmp <= 0) ? DmtxTrue : DmtxFalse;
+      case PredGreater:
+         return (cmp > 0) ? DmtxTrue : DmtxFalse;
+      default:
+         break;
+   }
+
+   return (cmp >= 0) ? DmtxTrue : DmtxFalse;
+}
+
+/**
+ * @brief  Fill a record from a segment entry
+ * @param  seg index segment
+ * @param  i entry number
+ * @param  rec record pointing into the index
+ * @return 1 for a record, -1 if the entry points outside its segment
+ */
+static int
+DecodeEntry(IndexSegment *seg, unsigned long i, ResultRecord *rec)
+{
+   int j;
+   unsigned int bits;
+   unsigned long fileOffset, memberOffset, messageOffset, source;
+   const unsigned char *ptr;
+
+   if(i >= seg->recordCount)
+      return -1;
+
+   ptr = seg->entries + i * INDEX_ENTRY_SIZE;
+
+   memset(rec, 0x00, sizeof(ResultRecord));
+   rec->type = RecordTypeSymbol;
+   fileOffset = RecordGetValue(ptr, 4);
+   rec->fileLength = (int)RecordGetValue(ptr + 4, 2);
+   rec->memberLength = (int)RecordGetValue(ptr + 6, 2);
+   memberOffset = RecordGetValue(ptr + 8, 4);
+   messageOffset = RecordGetValue(ptr + 12, 4);
+   rec->messageLength = (long)RecordGetValue(ptr + 16, 4);
+   rec->pageIndex = (long)RecordGetValue(ptr + 20, 4);
+   rec->elapsedMS = (long)RecordGetValue(ptr + 24, 4);
+   rec->sizeIdx = (int)RecordGetSigned16(ptr + 28);
+   rec->padCount = (int)RecordGetValue(ptr + 30, 2);
+   rec->rotation = (int)RecordGetSigned16(ptr + 32);
+   source = RecordGetValue(ptr + 68, 4);
+
+   for(j = 0; j < 8; j++) {
+      bits = (unsigned int)RecordGetValue(ptr + 36 + 4 * j, 4);
+      memcpy(&(rec->corner[j]), &bits, 4);
+   }
+
+   if(fileOffset > seg->stringsSize ||
+         (unsigned long)rec->fileLength > seg->stringsSize - fileOffset ||
+         memberOffset > seg->stringsSize ||
+         (unsigned long)rec->memberLength > seg->stringsSize - memberOffset ||
+         messageOffset > seg->stringsSize ||
+         (unsigned long)rec->messageLength > seg->stringsSize - messageOffset ||
+         source > seg->sourceCount)
+      return -1;
+
+   rec->file = (const char *)(seg->strings + fileOffset);
+   if(RecordGetValue(ptr + 34, 2) & INDEX_FLAG_MEMBER)
+      rec->member = (const char *)(seg->strings + memberOffset);
+   else
+      rec->memberLength = 0;
+   rec->message = seg->strings + messageOffset;
+
+   return 1;
+}
+
+/**
+ * @brief  Create a cursor of the given mode
+ * @param  index result index
+ * @param  filter barcodes wanted
+ * @param  mode CursorMode
+ * @return Address of new cursor, or NULL if out of memory
+ */
+static IndexCursor *
+OpenCursor(ResultIndex *index, const IndexFilter *filter, int mode)
+{
+   unsigned long i;
+   IndexCursor *cursor;
+
+   cursor = (IndexCursor *)calloc(1, sizeof(IndexCursor));
+   if(cursor == NULL)
+      return NULL;
+
+   cursor->index = index;
+   cursor->filter = *filter;
+   cursor->segmentEnd = index->segmentCount;
+   cursor->mode = mode;
+
+   if(mode == CursorFile || mode == CursorSorted) {
+      cursor->next = (unsigned long *)malloc((index->segmentCount + 1) * sizeof(unsigned long));
+      cursor->end = (unsigned long *)malloc((index->segmentCount + 1) * sizeof(unsigned long));
+      if(cursor->next == NULL || cursor->end == NULL) {
+         IndexCursorClose(&cursor);
+         return NULL;
+      }
+
+      for(i = 0; i < index->segmentCount && mode == CursorSorted; i++) {
+         cursor->next[i] = 0;
+         cursor->end[i] = index->segments[i].recordCount;
+      }
+
+      for(i = 0; i < index->segmentCount && mode == CursorFile; i++) {
+         cursor->next[i] = FindBound(&(index->segments[i]), filter,
+               (filter->pageFirst == DmtxUndefined) ? 0 : filter->pageFirst - 1, DmtxFalse);
+         cursor->end[i] = (filter->pageLast == DmtxUndefined) ?
+               FindBound(&(index->segments[i]), filter, 0xffffffffUL, DmtxTrue) :
+               FindBound(&(index->segments[i]), filter, filter->pageLast - 1, DmtxTrue);
+      }
+   }
+
+   return cursor;
+}
+
+/**
+ * @brief  Binary search a segment's sorted records for a file and page
+ * @param  seg index segment
+ * @param  filter filter naming the file
+ * @param  page 0-based page index
+ * @param  upper DmtxFalse for the first position at or after (file, page),
+ *         DmtxTrue for the first position after it
+ * @return Position in the sorted records
+ */
+static unsigned long
+FindBound(IndexSegment *seg, const IndexFilter *filter, unsigned long page, DmtxBoolean upper)
+{
+   int cmp;
+   unsigned long low, high, mid, i;
+   unsigned long fileOffset, fileLength, entryPage;
+   const unsigned char *ptr;
+
+   low = 0;
+   high = seg->recordCount;
+   while(low < high) {
+      mid = low + (high - low) / 2;
+      i = RecordGetValue(seg->sorted + 4 * mid, 4);
+      if(i >= seg->recordCount)
+         return 0;
+
+      ptr = seg->entries + i * INDEX_ENTRY_SIZE;
+      fileOffset = RecordGetValue(ptr, 4);
+      fileLength = RecordGetValue(ptr + 4, 2);
+      entryPage = RecordGetValue(ptr + 20, 4);
+      if(fileOffset > seg->stringsSize || fileLength > seg->stringsSize - fileOffset)
+         return 0;
+
+      cmp = CompareBytes(seg->strings + fileOffset, fileLength,
+            (const unsigned char *)filter->file, filter->fileLength);
+      if(cmp == 0)
+         cmp = (entryPage < page) ? -1 : (entryPage > page) ? 1 : 0;
+
+      if(cmp < 0 || (cmp == 0 && upper == DmtxTrue))
+         low = mid + 1;
+      else
+         high = mid;
+   }
+
+   return low;
+}
+
+/**
+ * @brief  Next match of a message query, probing each segment's hash table
+ * @param  cursor query cursor
+ * @param  rec record to fill
+ * @return 1 for a record, 0 when done, -1 if the index is corrupt
+ */
+static int
+NextMessage(IndexCursor *cursor, ResultRecord *rec)
+{
+   int result;
+   unsigned long value;
+   IndexSegment *seg;
+
+   while(cursor->segment < cursor->segmentEnd) {
+      seg = &(cursor->index->segments[cursor->segment]);
+
+      if(cursor->probing == DmtxFalse) {
+         cursor->position = HashBytes(cursor->filter.message,
+               cursor->filter.messageLength) & (seg->hashSize - 1);
+         cursor->probes = 0;
+         cursor->probing = DmtxTrue;
+      }
+
+      /* Equal messages sit in the order they were added */
+      while(cursor->probes < seg->hashSize) {
+         value = RecordGetValue(seg->hash + 4 * cursor->position, 4);
+         if(value == 0)
+            break;
+
+         cursor->position = (cursor->position + 1) & (seg->hashSize - 1);
+         cursor->probes++;
+
+         result = DecodeEntry(seg, value - 1, rec);
+         if(result != 1)
+            return result;
+
+         if(IsLive(seg, value - 1) == DmtxTrue &&
+               IndexFilterMatch(&(cursor->filter), rec) == DmtxTrue)
+            return 1;
+      }
+
+      cursor->segment++;
+      cursor->probing = DmtxFalse;
+   }
+
+   return 0;
+}
+
+/**
+ * @brief  Next match of a file or sorted query, merging the segments
+ * @param  cursor query cursor
+ * @param  rec record to fill
+ * @return 1 for a record, 0 when done, -1 if the index is corrupt
+ */
+static int
+NextFile(IndexCursor *cursor, ResultRecord *rec)
+{
+   int cmp;
+   int result;
+   unsigned long i, entry, page, bestPage;
+   unsigned long file, fileLength, bestFile, bestFileLength;
+   unsigned long best;
+   const unsigned char *ptr;
+   IndexSegment *seg, *bestSeg;
+
+   for(;;) {
+      best = cursor->index->segmentCount;
+      bestSeg = NULL;
+      bestPage = bestFile = bestFileLength = 0;
+
+      /* Earliest segment wins ties, keeping the order barcodes were added */
+      for(i = 0; i < cursor->index->segmentCount; i++) {
+         if(cursor->next[i] >= cursor->end[i])
+            continue;
+
+         seg = &(cursor->index->segments[i]);
+         entry = RecordGetValue(seg->sorted + 4 * cursor->next[i], 4);
+         if(entry >= seg->recordCount)
+            return -1;
+
+         ptr = seg->entries + entry * INDEX_ENTRY_SIZE;
+         page = RecordGetValue(ptr + 20, 4);
+
+         /* A file query's segments all hold the same name */
+         cmp = 0;
+         file = RecordGetValue(ptr, 4);
+         fileLength = RecordGetValue(ptr + 4, 2);
+         if(file > seg->stringsSize || fileLength > seg->stringsSize - file)
+            return -1;
+         if(cursor->mode == CursorSorted && bestSeg != NULL)
+            cmp = CompareBytes(seg->strings + file, fileLength,
+                  bestSeg->strings + bestFile, bestFileLength);
+
+         if(bestSeg == NULL || cmp < 0 || (cmp == 0 && page < bestPage)) {
+            best = i;
+            bestSeg = seg;
+            bestPage = page;
+            bestFile = file;
+            bestFileLength = fileLength;
+         }
+      }
+
+      if(bestSeg == NULL)
+         return 0;
+
+      entry = RecordGetValue(bestSeg->sorted + 4 * cursor->next[best], 4);
+      cursor->next[best]++;
+
+      result = DecodeEntry(bestSeg, entry, rec);
+      if(result != 1 || (IsLive(bestSeg, entry) == DmtxTrue &&
+            IndexFilterMatch(&(cursor->filter), rec) == DmtxTrue))
+         return result;
+   }
+}
+
+/**
+ * @brief  Next match of a query without an indexed key
+ * @param  cursor query cursor
+ * @param  rec record to fill
+ * @return 1 for a record, 0 when done, -1 if the index is corrupt
+ */
+static int
+NextAll(IndexCursor *cursor, ResultRecord *rec)
+{
+   int result;
+   IndexSegment *seg;
+
+   while(cursor->segment < cursor->segmentEnd) {
+      seg = &(cursor->index->segments[cursor->segment]);
+
+      while(cursor->position < seg->recordCount) {
+         result = DecodeEntry(seg, cursor->position++, rec);
+         if(result != 1)
+            return result;
+
+         if(IsLive(seg, cursor->position - 1) == DmtxTrue &&
+               IndexFilterMatch(&(cursor->filter), rec) == DmtxTrue)
+            return 1;
+      }
+
+      cursor->segment++;
+      cursor->position = 0;
+   }
+
+   return 0;
+}
+
+/**
+ * @brief  Write the index header
+ * @param  writer index writer
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+WriteHeader(IndexWriter *writer)
+{
+   unsigned char header[INDEX_HEADER_SIZE];
+
+   memset(header, 0x00, INDEX_HEADER_SIZE);
+   memcpy(header, INDEX_MAGIC, 8);
+   RecordPutValue(header + 8, INDEX_VERSION, 4);
+   RecordPutValue(header + 12, writer->segmentCount, 4);
+   PutValue64(header + 16, writer->newestSegment);
+   PutValue64(header + 24, writer->recordCount);
+
+   if(fseek(writer->fp, 0, SEEK_SET) != 0 ||
+         fwrite(header, 1, INDEX_HEADER_SIZE, writer->fp) != INDEX_HEADER_SIZE ||
+         fflush(writer->fp) != 0)
+      return DmtxFail;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Append the pending segment and point the header at it
+ * @param  writer index writer
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+WriteSegment(IndexWriter *writer)
+{
+   unsigned long i, n, slot, hashSize;
+   unsigned long messageOffset, messageLength;
+   long offset, consumed;
+   unsigned char segment[INDEX_SEGMENT_SIZE];
+   unsigned char *sorted, *hash, *sources, *ptr;
+   unsigned long *order, *renumber;
+   DmtxPassFail err;
+
+   n = writer->entryCount;
+   for(hashSize = 2; hashSize < 2 * n; hashSize <<= 1)
+      ;
+
+   order = (unsigned long *)malloc((n + 1) * sizeof(unsigned long));
+   sorted = (unsigned char *)malloc((n + 1) * 4);
+   hash = (unsigned char *)calloc(hashSize, 4);
+   sources = (unsigned char *)malloc((writer->sourceCount + 1) * INDEX_SOURCE_SIZE);
+   renumber = (unsigned long *)malloc((writer->sourceCount + 1) * sizeof(unsigned long));
+   if(order == NULL || sorted == NULL || hash == NULL || sources == NULL || renumber == NULL) {
+      free(order);
+      free(sorted);
+      free(hash);
+      free(sources);
+      free(renumber);
+      return DmtxFail;
+   }
+
+   /* File and page order, with equal keys left in the order added */
+   sortWriter = writer;
+   for(i = 0; i < n; i++)
+      order[i] = i;
+   qsort(order, n, sizeof(unsigned long), CompareWriterEntries);
+   for(i = 0; i < n; i++)
+      RecordPutValue(sorted + 4 * i, order[i], 4);
+
+   for(i = 0; i < n; i++) {
+      ptr = writer->entries + i * INDEX_ENTRY_SIZE;
+      messageOffset = RecordGetValue(ptr + 12, 4);
+      messageLength = RecordGetValue(ptr + 16, 4);
+      slot = HashBytes(writer->strings + messageOffset, messageLength) & (hashSize - 1);
+      while(RecordGetValue(hash + 4 * slot, 4) != 0)
+         slot = (slot + 1) & (hashSize - 1);
+      RecordPutValue(hash + 4 * slot, i + 1, 4);
+   }
+
+   /* Remember where the source being read is up to before sorting */
+   consumed = (writer->sourcePath != NULL) ? writer->sources[writer->sourceCount - 1].consumed : 0;
+
+   qsort(writer->sources, writer->sourceCount, sizeof(WriterSource), CompareWriterSources);
+   for(i = 0; i < (unsigned long)writer->sourceCount; i++) {
+      ptr = sources + i * INDEX_SOURCE_SIZE;
+      RecordPutValue(ptr, writer->sources[i].pathOffset, 4);
+      RecordPutValue(ptr + 4, writer->sources[i].pathLength, 4);
+      PutValue64(ptr + 8, writer->sources[i].consumed);
+      PutValue64(ptr + 16, writer->sources[i].start);
+      RecordPutValue(ptr + 24, writer->sources[i].fingerprint, 4);
+      RecordPutValue(ptr + 28, 0, 4);
+      renumber[writer->sources[i].number] = i + 1;
+   }
+
+   /* Entries were numbered by source before the sort */
+   for(i = 0; i < n; i++) {
+      ptr = writer->entries + i * INDEX_ENTRY_SIZE + 68;
+      if(RecordGetValue(ptr, 4) != 0)
+         RecordPutValue(ptr, renumber[RecordGetValue(ptr, 4) - 1], 4);
+   }
+
+   memset(segment, 0x00, INDEX_SEGMENT_SIZE);
+   memcpy(segment, INDEX_SEGMENT_MAGIC, 4);
+   RecordPutValue(segment + 4, n, 4);
+   PutValue64(segment + 8, writer->newestSegment);
+   PutValue64(segment + 16, writer->recordCount);
+   RecordPutValue(segment + 24, hashSize, 4);
+   RecordPutValue(segment + 28, (unsigned long)writer->sourceCount, 4);
+   RecordPutValue(segment + 32, writer->stringsLength, 4);
+
+   err = DmtxFail;
+   if(fseek(writer->fp, 0, SEEK_END) == 0 && (offset = ftell(writer->fp)) >= 0 &&
+         fwrite(segment, 1, INDEX_SEGMENT_SIZE, writer->fp) == INDEX_SEGMENT_SIZE &&
+         fwrite(writer->entries, INDEX_ENTRY_SIZE, n, writer->fp) == n &&
+         fwrite(sorted, 4, n, writer->fp) == n &&
+         fwrite(hash, 4, hashSize, writer->fp) == hashSize &&
+         fwrite(sources, INDEX_SOURCE_SIZE, writer->sourceCount, writer->fp) ==
+               (size_t)writer->sourceCount &&
+         fwrite(writer->strings, 1, writer->stringsLength, writer->fp) == writer->stringsLength &&
+         fflush(writer->fp) == 0) {
+      writer->segmentCount++;
+      writer->newestSegment = offset;
+      writer->recordCount += (long)n;
+      err = WriteHeader(writer);
+   }
+
+   free(order);
+   free(sorted);
+   free(hash);
+   free(sources);
+   free(renumber);
+
+   if(err != DmtxPass)
+      return DmtxFail;
+
+   /* Start the next segment, carrying over the source being read */
+   writer->entryCount = 0;
+   writer->stringsLength = 0;
+   writer->nameCount = 0;
+   if(writer->names != NULL)
+      memset(writer->names, 0x00, 2 * writer->nameSlots * sizeof(unsigned long));
+
+   writer->sourceCount = 0;
+
+   return (writer->sourcePath != NULL) ? AddSource(writer, consumed) : DmtxPass;
+}
+
+/**
+ * @brief  Copy bytes into the pending segment's strings
+ * @param  writer index writer
+ * @param  str bytes to copy
+ * @param  length byte count
+ * @param  offset pointer to offset of the copy
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+AddString(IndexWriter *writer, const void *str, unsigned long length, unsigned long *offset)
+{
+   size_t newSize;
+   unsigned char *newStrings;
+
+   /* Offsets are 32 bits wide, so segments end well short of that */
+   if(length > 0xffffffffUL - writer->stringsLength)
+      return DmtxFail;
+
+   if(writer->stringsLength + length > writer->stringsSize) {
+      newSize = (writer->stringsSize == 0) ? 65536 : writer->stringsSize;
+      while(newSize < writer->stringsLength + length)
+         newSize *= 2;
+      newStrings = (unsigned char *)realloc(writer->strings, newSize);
+      if(newStrings == NULL)
+         return DmtxFail;
+      writer->strings = newStrings;
+      writer->stringsSize = newSize;
+   }
+
+   memcpy(writer->strings + writer->stringsLength, str, length);
+   *offset = writer->stringsLength;
+   writer->stringsLength += length;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Store a file or member name once per segment
+ * @param  writer index writer
+ * @param  name name bytes
+ * @param  length byte count
+ * @param  offset pointer to offset of the stored name
+ * @return DmtxPass | DmtxFail
+ *
+ * Result files repeat the same few names for every barcode, so names
+ * are kept in a small hash table of what the segment already holds.
+ */
+static DmtxPassFail
+AddName(IndexWriter *writer, const char *name, unsigned long length, unsigned long *offset)
+{
+   unsigned long i, slot, slotCount;
+   unsigned long *names, *oldNames;
+
+   if(2 * (writer->nameCount + 1) > writer->nameSlots) {
+      slotCount = (writer->nameSlots == 0) ? 256 : writer->nameSlots * 2;
+      names = (unsigned long *)calloc(2 * slotCount, sizeof(unsigned long));
+      if(names == NULL)
+         return DmtxFail;
+
+      oldNames = writer->names;
+      for(i = 0; i < writer->nameSlots; i++) {
+         if(oldNames[2 * i] == 0)
+            continue;
+         slot = HashBytes(writer->strings + oldNames[2 * i] - 1, oldNames[2 * i + 1]) &
+               (slotCount - 1);
+         while(names[2 * slot] != 0)
+            slot = (slot + 1) & (slotCount - 1);
+         names[2 * slot] = oldNames[2 * i];
+         names[2 * slot + 1] = oldNames[2 * i + 1];
+      }
+
+      free(oldNames);
+      writer->names = names;
+      writer->nameSlots = slotCount;
+   }
+
+   slot = HashBytes((const unsigned char *)name, length) & (writer->nameSlots - 1);
+   while(writer->names[2 * slot] != 0) {
+      if(writer->names[2 * slot + 1] == length &&
+            memcmp(writer->strings + writer->names[2 * slot] - 1, name, length) == 0) {
+         *offset = writer->names[2 * slot] - 1;
+         return DmtxPass;
+      }
+      slot = (slot + 1) & (writer->nameSlots - 1);
+   }
+
+   if(AddString(writer, name, length, offset) != DmtxPass)
+      return DmtxFail;
+
+   writer->names[2 * slot] = *offset + 1;
+   writer->names[2 * slot + 1] = length;
+   writer->nameCount++;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Add the current result file to the pending segment's sources
+ * @param  writer index writer
+ * @param  consumed byte offset reached so far
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+AddSource(IndexWriter *writer, long consumed)
+{
+   int newSize;
+   WriterSource *newSources, *source;
+
+   if(writer->sourceCount == writer->sourceSize) {
+      newSize = (writer->sourceSize == 0) ? 64 : writer->sourceSize * 2;
+      newSources = (WriterSource *)realloc(writer->sources, newSize * sizeof(WriterSource));
+      if(newSources == NULL)
+         return DmtxFail;
+      writer->sources = newSources;
+      writer->sourceSize = newSize;
+   }
+
+   source = &(writer->sources[writer->sourceCount]);
+   source->pathLength = strlen(writer->sourcePath);
+   source->consumed = consumed;
+   source->start = writer->sourceStart;
+   source->fingerprint = 0;
+   source->number = writer->sourceCount;
+   if(AddName(writer, writer->sourcePath, source->pathLength, &(source->pathOffset)) != DmtxPass)
+      return DmtxFail;
+
+   writer->sourceCount++;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Record how far the current result file was read
+ * @param  writer index writer reading a result file
+ * @param  consumed byte offset reached
+ * @return void
+ *
+ * A file whose fingerprint cannot be taken is kept at offset 0, so the
+ * next update reads it again and supersedes what was added now.
+ */
+static void
+SetSourceEnd(IndexWriter *writer, long consumed)
+{
+   WriterSource *source;
+
+   source = &(writer->sources[writer->sourceCount - 1]);
+   if(consumed > 0 && GetFingerprint(writer->sourcePath, consumed,
+         &(source->fingerprint)) != DmtxPass)
+      consumed = 0;
+
+   source->consumed = consumed;
+}
+
+/**
+ * @brief  qsort() comparison of pending entries by file, page and position
+ * @param  a first entry number
+ * @param  b second entry number
+ * @return Negative, zero or positive
+ */
+static int
+CompareWriterEntries(const void *a, const void *b)
+{
+   int cmp;
+   unsigned long i, j, pageA, pageB;
+   const unsigned char *ptrA, *ptrB;
+
+   i = *(const unsigned long *)a;
+   j = *(const unsigned long *)b;
+   ptrA = sortWriter->entries + i * INDEX_ENTRY_SIZE;
+   ptrB = sortWriter->entries + j * INDEX_ENTRY_SIZE;
+
+   cmp = CompareBytes(sortWriter->strings + RecordGetValue(ptrA, 4), RecordGetValue(ptrA + 4, 2),
+         sortWriter->strings + RecordGetValue(ptrB, 4), RecordGetValue(ptrB + 4, 2));
+   if(cmp != 0)
+      return cmp;
+
+   pageA = RecordGetValue(ptrA + 20, 4);
+   pageB = RecordGetValue(ptrB + 20, 4);
+   if(pageA != pageB)
+      return (pageA < pageB) ? -1 : 1;
+
+   return (i < j) ? -1 : (i > j) ? 1 : 0;
+}
+
+/**
+ * @brief  qsort() comparison of pending sources by path
+ * @param  a first source
+ * @param  b second source
+ * @return Negative, zero or positive
+ */
+static int
+CompareWriterSources(const void *a, const void *b)
+{
+   const WriterSource *sourceA, *sourceB;
+
+   sourceA = (const WriterSource *)a;
+   sourceB = (const WriterSource *)b;
+
+   return CompareBytes(sortWriter->strings + sourceA->pathOffset, sourceA->pathLength,
+         sortWriter->strings + sourceB->pathOffset, sourceB->pathLength);
+}
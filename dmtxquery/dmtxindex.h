@@ -0,0 +1,124 @@
+/*
+libdmtx - Data Matrix Encoding/Decoding Library
+
+Copyright (C) 2008, 2009 Mike Laughton
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+Contact: mike@dragonflylogic.com
+*/
+
+#ifndef __DMTXINDEX_H__
+#define __DMTXINDEX_H__
+
+#include <stdio.h>
+
+/* Index file header: magic, version, segment count, newest segment, record count */
+#define INDEX_MAGIC           "DMTXIDX"
+#define INDEX_VERSION         2
+#define INDEX_HEADER_SIZE     32
+
+/* Segment header, record entry and source entry sizes */
+#define INDEX_SEGMENT_MAGIC   "SEGM"
+#define INDEX_SEGMENT_SIZE    40
+#define INDEX_ENTRY_SIZE      72
+#define INDEX_SOURCE_SIZE     32
+
+/* Bytes hashed at each end of what was read from a result file */
+#define INDEX_FINGERPRINT_SPAN 4096
+
+/* Records and string bytes collected in memory before a segment is written */
+#define INDEX_SEGMENT_RECORDS (1 << 20)
+#define INDEX_SEGMENT_STRINGS (1L << 28)
+
+/* Fields and comparisons of --where predicates */
+typedef enum {
+   PredRotation,
+   PredMatrixSize,
+   PredDataCodewords,
+   PredPage,
+   PredTime,
+   PredFile,
+   PredMember,
+   PredMessage
+} PredicateField;
+
+typedef enum {
+   PredEqual,
+   PredNotEqual,
+   PredLess,
+   PredLessEqual,
+   PredGreater,
+   PredGreaterEqual
+} PredicateOp;
+
+/**
+ * One FIELD OP VALUE test. Matrix sizes compare by rows, then columns;
+ * names and messages only by = and !=.
+ */
+typedef struct {
+   int field;                /* PredicateField */
+   int op;                   /* PredicateOp */
+   double value;
+   int rows, cols;           /* matrix size value */
+   const char *text;         /* name or message value */
+   long textLength;
+} IndexPredicate;
+
+/**
+ * Barcodes wanted from a query. Fields left NULL or DmtxUndefined match
+ * any barcode.
+ */
+typedef struct {
+   const unsigned char *message;
+   long messageLength;
+   const char *file;
+   int fileLength;
+   long pageFirst;           /* 1-based, inclusive */
+   long pageLast;
+   IndexPredicate *where;    /* all must hold */
+   int whereCount;
+} IndexFilter;
+
+typedef struct ResultIndex_struct ResultIndex;
+typedef struct IndexCursor_struct IndexCursor;
+typedef struct IndexWriter_struct IndexWriter;
+
+extern void IndexFilterInit(IndexFilter *filter);
+extern DmtxBoolean IndexFilterIsEmpty(const IndexFilter *filter);
+extern DmtxBoolean IndexFilterMatch(const IndexFilter *filter, const ResultRecord *rec);
+extern DmtxPassFail IndexParsePredicate(IndexPredicate *pred, const char *expr);
+
+extern ResultIndex *IndexOpen(const char *path);
+extern void IndexClose(ResultIndex **index);
+extern long IndexGetCount(ResultIndex *index);
+extern int IndexGetRecord(ResultIndex *index, long ordinal, ResultRecord *rec);
+extern IndexCursor *IndexFind(ResultIndex *index, const IndexFilter *filter);
+extern IndexCursor *IndexFindSorted(ResultIndex *index, const IndexFilter *filter);
+extern int IndexNext(IndexCursor *cursor, ResultRecord *rec);
+extern void IndexCursorClose(IndexCursor **cursor);
+extern unsigned long IndexGetSegmentCount(ResultIndex *index);
+extern void IndexCursorSetSegment(IndexCursor *cursor, unsigned long segment);
+
+extern IndexWriter *IndexWriterOpen(const char *path);
+extern DmtxPassFail IndexWriterClose(IndexWriter **writer);
+extern long IndexWriterGetOffset(IndexWriter *writer, const char *source);
+extern DmtxPassFail IndexWriterBeginSource(IndexWriter *writer, const char *source, long offset);
+extern void IndexWriterEndSource(IndexWriter *writer, long consumed);
+extern DmtxPassFail IndexWriterAdd(IndexWriter *writer, const ResultRecord *rec);
+extern DmtxBoolean IndexWriterFull(IndexWriter *writer);
+extern DmtxPassFail IndexWriterFlush(IndexWriter *writer, long consumed);
+
+#endif
@@ -0,0 +1,1288 @@
+/*
+libdmtx - Data Matrix Encoding/Decoding Library
+
+Copyright (C) 2008, 2009 Mike Laughton
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+Contact: mike@dragonflylogic.com
+*/
+
+/**
+ * @file dmtxinput.c
+ * @brief Streaming readers for every dmtxread result format
+ *
+ * Binary, JSON lines and XML results are all read one barcode at a time
+ * into the same ResultRecord. The text formats are parsed straight from
+ * the stream, one character at a time, without building a document, so
+ * memory use depends only on the largest single record.
+ *
+ * The parsers accept what dmtxread writes plus the usual latitude of
+ * each format: whitespace, unknown keys or elements (skipped), entity
+ * and escape forms, comments and processing instructions. Messages are
+ * decoded back to the original bytes.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <dmtx.h>
+#include "../common/dmtxutil.h"
+#include "../common/dmtxrecord.h"
+#include "dmtxinput.h"
+
+/* Longest element, attribute or key name worth telling apart */
+#define INPUT_NAME_MAX    32
+
+/* Longest number in text input */
+#define INPUT_NUMBER_MAX  64
+
+/* Attributes kept from one XML tag */
+#define INPUT_ATTRIB_MAX  8
+
+/* String fields of the record being built, as offsets into buf */
+typedef struct {
+   long offset;
+   long length;
+} InputString;
+
+typedef struct {
+   char name[INPUT_NAME_MAX];
+   InputString value;
+} InputAttrib;
+
+struct ResultInput_struct {
+   FILE *fp;
+   int format;            /* InputFormat */
+   long line;             /* current line of text input, 0 if unknown */
+   long offset;           /* stream position of text input */
+   long end;              /* no record starts at or after this, or DmtxUndefined */
+   unsigned char *buf;    /* bytes of the current record */
+   size_t bufSize;
+   size_t bufLength;
+};
+
+/* Record fields gathered while parsing, resolved once complete */
+typedef struct {
+   InputString file;
+   InputString member;    /* offset -1 when absent */
+   InputString message;
+   int rows, cols;
+   int dataWords;         /* DmtxUndefined when absent */
+   int cornerCount;
+} InputFields;
+
+static int ReadChar(ResultInput *input);
+static void UnreadChar(ResultInput *input, int c);
+static int SkipSpace(ResultInput *input);
+static DmtxPassFail AppendByte(ResultInput *input, int c);
+static DmtxPassFail AppendCodePoint(ResultInput *input, long cp, DmtxBoolean latin1);
+static DmtxPassFail AppendChar(ResultInput *input, int c, DmtxBoolean latin1);
+static DmtxPassFail FinishRecord(ResultInput *input, InputFields *fields, ResultRecord *rec);
+static int FindSizeIdx(int rows, int cols);
+static DmtxPassFail ParseMatrixSize(const char *str, int *rows, int *cols);
+static int ReadJsonRecord(ResultInput *input, ResultRecord *rec);
+static DmtxPassFail ReadJsonString(ResultInput *input, DmtxBoolean latin1, InputString *str);
+static DmtxPassFail ReadJsonName(ResultInput *input, char *name);
+static DmtxPassFail ReadJsonNumber(ResultInput *input, double *value);
+static DmtxPassFail ReadJsonCorners(ResultInput *input, ResultRecord *rec, InputFields *fields);
+static DmtxPassFail SkipJsonValue(ResultInput *input);
+static int ReadXmlRecord(ResultInput *input, ResultRecord *rec);
+static int ReadXmlTag(ResultInput *input, char *name, DmtxBoolean *isEnd, DmtxBoolean *isEmpty,
+      InputAttrib *attribs, int *attribCount);
+static DmtxPassFail ReadXmlText(ResultInput *input, DmtxBoolean latin1, InputString *str);
+static DmtxPassFail ReadXmlEntity(ResultInput *input, DmtxBoolean latin1);
+static DmtxPassFail SkipXmlMarkup(ResultInput *input);
+static DmtxPassFail DecodeBase64(ResultInput *input, InputString *str);
+static DmtxPassFail GetNumber(ResultInput *input, InputString *str, double *value);
+
+/**
+ * @brief  Detect the format of a result stream and prepare to read it
+ * @param  fp input stream
+ * @return Address of new reader, or NULL if the format is not recognized
+ *
+ * Empty input is accepted as JSON lines holding no records.
+ */
+extern ResultInput *
+InputOpen(FILE *fp)
+{
+   int c;
+   ResultInput *input;
+
+   input = (ResultInput *)calloc(1, sizeof(ResultInput));
+   if(input == NULL)
+      return NULL;
+
+   input->fp = fp;
+   input->line = 1;
+   input->offset = (ftell(fp) < 0) ? 0 : ftell(fp);
+   input->end = DmtxUndefined;
+
+   c = SkipSpace(input);
+   if(c == 'D') {
+      UnreadChar(input, c);
+      input->format = InputBinary;
+      if(RecordReadHeader(fp) != DmtxPass) {
+         free(input);
+         return NULL;
+      }
+   }
+   else if(c == '<') {
+      UnreadChar(input, c);
+      input->format = InputXml;
+   }
+   else if(c == '{' || c == EOF) {
+      UnreadChar(input, c);
+      input->format = InputJsonl;
+   }
+   else {
+      free(input);
+      return NULL;
+   }
+
+   return input;
+}
+
+/**
+ * @brief  Free a reader (the stream stays open)
+ * @param  input pointer to reader pointer
+ * @return void
+ */
+extern void
+InputClose(ResultInput **input)
+{
+   if(input == NULL || *input == NULL)
+      return;
+
+   free((*input)->buf);
+   free(*input);
+
+   *input = NULL;
+}
+
+/**
+ * @brief  Format detected by InputOpen
+ * @param  input result reader
+ * @return InputFormat
+ */
+extern int
+InputGetFormat(ResultInput *input)
+{
+   return input->format;
+}
+
+/**
+ * @brief  Line reached in text input, for error messages
+ * @param  input result reader
+ * @return Line number (0 for binary input, or if unknown after InputSeek)
+ */
+extern long
+InputGetLine(ResultInput *input)
+{
+   return (input->format == InputBinary) ? 0 : input->line;
+}
+
+/**
+ * @brief  Stream position just after the last record read
+ * @param  input result reader
+ * @return Byte offset, or -1 if the stream cannot tell
+ */
+extern long
+InputGetOffset(ResultInput *input)
+{
+   return (input->format == InputBinary) ? ftell(input->fp) : input->offset;
+}
+
+/**
+ * @brief  Continue reading at a byte offset
+ * @param  input result reader
+ * @param  offset stream position just after a record, as reported by
+ *         ftell() when an earlier read stopped there
+ * @return DmtxPass | DmtxFail
+ */
+extern DmtxPassFail
+InputSeek(ResultInput *input, long offset)
+{
+   if(fseek(input->fp, offset, SEEK_SET) != 0)
+      return DmtxFail;
+
+   input->line = 0;
+   input->offset = offset;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Read only the records of a JSON lines file starting in a byte range
+ * @param  input result reader, not yet read from
+ * @param  start first byte of range (reading starts at the next line)
+ * @param  end byte after range
+ * @return DmtxPass | DmtxFail (other formats cannot be split)
+ *
+ * Every line belongs to the range holding its first byte, so ranges
+ * that tile a file read each record exactly once.
+ */
+extern DmtxPassFail
+InputSetRange(ResultInput *input, long start, long end)
+{
+   int c;
+
+   if(input->format != InputJsonl)
+      return DmtxFail;
+
+   if(start > 0) {
+      if(InputSeek(input, start - 1) != DmtxPass)
+         return DmtxFail;
+
+      do {
+         c = ReadChar(input);
+      } while(c != '\n' && c != EOF);
+   }
+
+   input->end = end;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Read the next barcode
+ * @param  input result reader
+ * @param  rec record to fill, valid until the next call
+ * @return 1 for a record, 0 at end of input, -1 on malformed input
+ */
+extern int
+InputRead(ResultInput *input, ResultRecord *rec)
+{
+   switch(input->format) {
+      case InputBinary:
+         return RecordRead(input->fp, rec, &(input->buf), &(input->bufSize));
+      case InputJsonl:
+         return ReadJsonRecord(input, rec);
+      case InputXml:
+         return ReadXmlRecord(input, rec);
+      default:
+         break;
+   }
+
+   return -1;
+}
+
+/**
+ * @brief  Read one character, counting lines
+ * @param  input result reader
+ * @return Character or EOF
+ */
+static int
+ReadChar(ResultInput *input)
+{
+   int c;
+
+   /* Each reader's stream belongs to a single thread, so skip the lock */
+#ifdef HAVE_GETC_UNLOCKED
+   c = getc_unlocked(input->fp);
+#else
+   c = getc(input->fp);
+#endif
+   if(c == EOF)
+      return c;
+
+   input->offset++;
+   if(c == '\n' && input->line > 0)
+      input->line++;
+
+   return c;
+}
+
+/**
+ * @brief  Push back the character just read
+ * @param  input result reader
+ * @param  c character (EOF is ignored)
+ * @return void
+ */
+static void
+UnreadChar(ResultInput *input, int c)
+{
+   if(c == EOF)
+      return;
+
+   input->offset--;
+   if(c == '\n' && input->line > 0)
+      input->line--;
+
+   ungetc(c, input->fp);
+}
+
+/**
+ * @brief  Read past whitespace
+ * @param  input result reader
+ * @return First other character, or EOF
+ */
+static int
+SkipSpace(ResultInput *input)
+{
+   int c;
+
+   do {
+      c = ReadChar(input);
+   } while(c == ' ' || c == '\t' || c == '\n' || c == '\r');
+
+   return c;
+}
+
+/**
+ * @brief  Add one byte to the current record
+ * @param  input result reader
+ * @param  c byte value
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+AppendByte(ResultInput *input, int c)
+{
+   size_t newSize;
+   unsigned char *newBuf;
+
+   if(input->bufLength == input->bufSize) {
+      newSize = (input->bufSize == 0) ? 256 : input->bufSize * 2;
+      newBuf = (unsigned char *)realloc(input->buf, newSize);
+      if(newBuf == NULL)
+         return DmtxFail;
+      input->buf = newBuf;
+      input->bufSize = newSize;
+   }
+
+   input->buf[input->bufLength++] = (unsigned char)c;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Add a character given by code point
+ * @param  input result reader
+ * @param  cp Unicode code point
+ * @param  latin1 DmtxTrue to store code points below 256 as one byte
+ *         (messages), DmtxFalse to always store UTF-8 (names)
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+AppendCodePoint(ResultInput *input, long cp, DmtxBoolean latin1)
+{
+   DmtxPassFail err;
+
+   if(cp < 0 || cp > 0x10ffff)
+      return DmtxFail;
+
+   if(cp < 0x80 || (latin1 == DmtxTrue && cp < 0x100))
+      return AppendByte(input, (int)cp);
+
+   if(cp < 0x800) {
+      err = AppendByte(input, 0xc0 | (int)(cp >> 6));
+   }
+   else if(cp < 0x10000) {
+      err = AppendByte(input, 0xe0 | (int)(cp >> 12));
+      if(err == DmtxPass)
+         err = AppendByte(input, 0x80 | (int)((cp >> 6) & 0x3f));
+   }
+   else {
+      err = AppendByte(input, 0xf0 | (int)(cp >> 18));
+      if(err == DmtxPass)
+         err = AppendByte(input, 0x80 | (int)((cp >> 12) & 0x3f));
+      if(err == DmtxPass)
+         err = AppendByte(input, 0x80 | (int)((cp >> 6) & 0x3f));
+   }
+
+   if(err != DmtxPass)
+      return DmtxFail;
+
+   return AppendByte(input, 0x80 | (int)(cp & 0x3f));
+}
+
+/**
+ * @brief  Add a character of raw text input
+ * @param  input result reader
+ * @param  c first byte, with any UTF-8 continuation bytes still unread
+ * @param  latin1 DmtxTrue to store UTF-8 characters below 256 as one byte
+ * @return DmtxPass | DmtxFail
+ *
+ * Message text is decoded so a character means the same byte whether
+ * it arrives escaped or as UTF-8. Bytes that are not valid UTF-8 are
+ * kept as they are.
+ */
+static DmtxPassFail
+AppendChar(ResultInput *input, int c, DmtxBoolean latin1)
+{
+   int next;
+
+   if(latin1 == DmtxFalse || (c & 0xe0) != 0xc0)
+      return AppendByte(input, c);
+
+   /* Only 2-byte sequences can hold code points below 256 */
+   next = ReadChar(input);
+   if((next & 0xc0) != 0x80) {
+      UnreadChar(input, next);
+      return AppendByte(input, c);
+   }
+
+   return AppendCodePoint(input, ((long)(c & 0x1f) << 6) | (next & 0x3f), DmtxTrue);
+}
+
+/**
+ * @brief  Resolve gathered fields into a record
+ * @param  input result reader
+ * @param  fields fields gathered from text input
+ * @param  rec record receiving pointers into the reader's buffer
+ * @return DmtxPass | DmtxFail (required field missing or inconsistent)
+ */
+static DmtxPassFail
+FinishRecord(ResultInput *input, InputFields *fields, ResultRecord *rec)
+{
+   int dataWordLength;
+
+   if(fields->file.offset < 0 || fields->message.offset < 0 || fields->cornerCount != 4)
+      return DmtxFail;
+
+   rec->type = RecordTypeSymbol;
+   rec->sizeIdx = FindSizeIdx(fields->rows, fields->cols);
+   if(rec->sizeIdx == DmtxUndefined)
+      return DmtxFail;
+
+   dataWordLength = dmtxGetSymbolAttribute(DmtxSymAttribSymbolDataWords, rec->sizeIdx);
+   if(fields->dataWords == DmtxUndefined || fields->dataWords > dataWordLength)
+      return DmtxFail;
+   rec->padCount = dataWordLength - fields->dataWords;
+
+   /* Buffer may have moved while growing, so pointers are set last */
+   rec->file = (const char *)(input->buf + fields->file.offset);
+   rec->fileLength = (int)fields->file.length;
+   if(fields->member.offset >= 0) {
+      rec->member = (const char *)(input->buf + fields->member.offset);
+      rec->memberLength = (int)fields->member.length;
+   }
+   rec->message = input->buf + fields->message.offset;
+   rec->messageLength = fields->message.length;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Find the symbol size index for a matrix size
+ * @param  rows symbol rows
+ * @param  cols symbol columns
+ * @return Size index, or DmtxUndefined
+ */
+static int
+FindSizeIdx(int rows, int cols)
+{
+   int i;
+
+   for(i = 0; i < DmtxSymbolSquareCount + DmtxSymbolRectCount; i++) {
+      if(dmtxGetSymbolAttribute(DmtxSymAttribSymbolRows, i) == rows &&
+            dmtxGetSymbolAttribute(DmtxSymAttribSymbolCols, i) == cols)
+         return i;
+   }
+
+   return DmtxUndefined;
+}
+
+/**
+ * @brief  Parse "RxC" matrix size text
+ * @param  str NUL-terminated text
+ * @param  rows pointer to row count
+ * @param  cols pointer to column count
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+ParseMatrixSize(const char *str, int *rows, int *cols)
+{
+   char extra;
+
+   if(sscanf(str, " %dx%d %c", rows, cols, &extra) != 2)
+      return DmtxFail;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Parse one JSON object per line
+ * @param  input result reader
+ * @param  rec record to fill
+ * @return 1 for a record, 0 at end of input, -1 on malformed input
+ */
+static int
+ReadJsonRecord(ResultInput *input, ResultRecord *rec)
+{
+   int c;
+   double value;
+   char name[INPUT_NAME_MAX];
+   char text[INPUT_NUMBER_MAX];
+   InputFields fields;
+   InputString str;
+
+   c = SkipSpace(input);
+   if(c == EOF || (c == '{' && input->end != DmtxUndefined && input->offset - 1 >= input->end))
+      return 0;
+   if(c != '{')
+      return -1;
+
+   memset(rec, 0x00, sizeof(ResultRecord));
+   memset(&fields, 0x00, sizeof(InputFields));
+   fields.file.offset = fields.member.offset = fields.message.offset = -1;
+   fields.dataWords = DmtxUndefined;
+   input->bufLength = 0;
+
+   c = SkipSpace(input);
+   if(c == '}')
+      return -1;
+   UnreadChar(input, c);
+
+   for(;;) {
+      if(SkipSpace(input) != '"' || ReadJsonName(input, name) != DmtxPass ||
+            SkipSpace(input) != ':')
+         return -1;
+
+      if(strcmp(name, "file") == 0 || strcmp(name, "member") == 0 ||
+            strcmp(name, "message") == 0 || strcmp(name, "matrix_size") == 0) {
+         c = SkipSpace(input);
+         if(c == 'n' && strcmp(name, "member") == 0) {
+            /* "member":null */
+            UnreadChar(input, c);
+            if(SkipJsonValue(input) != DmtxPass)
+               return -1;
+         }
+         else {
+            if(c != '"' || ReadJsonString(input, (strcmp(name, "message") == 0) ?
+                  DmtxTrue : DmtxFalse, &str) != DmtxPass)
+               return -1;
+
+            if(strcmp(name, "file") == 0)
+               fields.file = str;
+            else if(strcmp(name, "member") == 0)
+               fields.member = str;
+            else if(strcmp(name, "message") == 0)
+               fields.message = str;
+            else {
+               if(str.length >= INPUT_NUMBER_MAX)
+                  return -1;
+               memcpy(text, input->buf + str.offset, str.length);
+               text[str.length] = '\0';
+               if(ParseMatrixSize(text, &fields.rows, &fields.cols) != DmtxPass)
+                  return -1;
+            }
+         }
+      }
+      else if(strcmp(name, "corners") == 0) {
+         if(ReadJsonCorners(input, rec, &fields) != DmtxPass)
+            return -1;
+      }
+      else if(strcmp(name, "page") == 0 || strcmp(name, "data_codewords") == 0 ||
+            strcmp(name, "rotation") == 0 || strcmp(name, "time_ms") == 0) {
+         if(ReadJsonNumber(input, &value) != DmtxPass)
+            return -1;
+
+         if(strcmp(name, "page") == 0)
+            rec->pageIndex = (long)value - 1;
+         else if(strcmp(name, "data_codewords") == 0)
+            fields.dataWords = (int)value;
+         else if(strcmp(name, "rotation") == 0)
+            rec->rotation = (int)value;
+         else
+            rec->elapsedMS = (long)value;
+      }
+      else if(SkipJsonValue(input) != DmtxPass) {
+         return -1;
+      }
+
+      c = SkipSpace(input);
+      if(c == '}')
+         break;
+      if(c != ',')
+         return -1;
+   }
+
+   return (FinishRecord(input, &fields, rec) == DmtxPass) ? 1 : -1;
+}
+
+/**
+ * @brief  Read the rest of a JSON string into the current record
+ * @param  input result reader (opening quote already read)
+ * @param  latin1 store escapes below 256 as single bytes
+ * @param  str receives the offset and length of the decoded bytes
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+ReadJsonString(ResultInput *input, DmtxBoolean latin1, InputString *str)
+{
+   int i, c;
+   long cp, low;
+   char hex[5];
+
+   str->offset = (long)input->bufLength;
+
+   for(;;) {
+      c = ReadChar(input);
+      if(c == EOF || c == '\n')
+         return DmtxFail;
+
+      if(c == '"')
+         break;
+
+      if(c != '\\') {
+         if(AppendChar(input, c, latin1) != DmtxPass)
+            return DmtxFail;
+         continue;
+      }
+
+      c = ReadChar(input);
+      switch(c) {
+         case '"':
+         case '\\':
+         case '/':
+            break;
+         case 'b':
+            c = '\b';
+            break;
+         case 'f':
+            c = '\f';
+            break;
+         case 'n':
+            c = '\n';
+            break;
+         case 'r':
+            c = '\r';
+            break;
+         case 't':
+            c = '\t';
+            break;
+         case 'u':
+            for(i = 0; i < 4; i++) {
+               c = ReadChar(input);
+               if(!isxdigit(c))
+                  return DmtxFail;
+               hex[i] = (char)c;
+            }
+            hex[4] = '\0';
+            cp = strtol(hex, NULL, 16);
+
+            /* Characters beyond the BMP arrive as surrogate pairs */
+            if(cp >= 0xd800 && cp < 0xdc00) {
+               if(ReadChar(input) != '\\' || ReadChar(input) != 'u')
+                  return DmtxFail;
+               for(i = 0; i < 4; i++) {
+                  c = ReadChar(input);
+                  if(!isxdigit(c))
+                     return DmtxFail;
+                  hex[i] = (char)c;
+               }
+               low = strtol(hex, NULL, 16);
+               if(low < 0xdc00 || low >= 0xe000)
+                  return DmtxFail;
+               cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+            }
+            /* dmtxread writes name bytes that are not UTF-8 as lone surrogates */
+            else if(cp >= 0xdc80 && cp < 0xdd00) {
+               c = (int)(cp & 0xff);
+               break;
+            }
+
+            if(AppendCodePoint(input, cp, latin1) != DmtxPass)
+               return DmtxFail;
+            continue;
+         default:
+            return DmtxFail;
+      }
+
+      if(AppendByte(input, c) != DmtxPass)
+         return DmtxFail;
+   }
+
+   str->length = (long)input->bufLength - str->offset;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Read a JSON object key
+ * @param  input result reader (opening quote already read)
+ * @param  name buffer of INPUT_NAME_MAX bytes (longer keys are cut)
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+ReadJsonName(ResultInput *input, char *name)
+{
+   size_t length;
+   InputString str;
+
+   /* Decode into the record buffer, then drop it from there */
+   length = input->bufLength;
+   if(ReadJsonString(input, DmtxFalse, &str) != DmtxPass)
+      return DmtxFail;
+
+   if(str.length >= INPUT_NAME_MAX)
+      str.length = INPUT_NAME_MAX - 1;
+   memcpy(name, input->buf + str.offset, str.length);
+   name[str.length] = '\0';
+
+   input->bufLength = length;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Read a JSON number
+ * @param  input result reader
+ * @param  value pointer to number read
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+ReadJsonNumber(ResultInput *input, double *value)
+{
+   int c, length;
+   char text[INPUT_NUMBER_MAX];
+   char *end;
+
+   c = SkipSpace(input);
+   for(length = 0; c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E' || isdigit(c);
+         c = ReadChar(input)) {
+      if(length == INPUT_NUMBER_MAX - 1)
+         return DmtxFail;
+      text[length++] = (char)c;
+   }
+   UnreadChar(input, c);
+   text[length] = '\0';
+
+   *value = strtod(text, &end);
+
+   return (length > 0 && *end == '\0') ? DmtxPass : DmtxFail;
+}
+
+/**
+ * @brief  Read the corner array [[x,y],[x,y],[x,y],[x,y]]
+ * @param  input result reader
+ * @param  rec record receiving the corners
+ * @param  fields gathered fields (counts corners read)
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+ReadJsonCorners(ResultInput *input, ResultRecord *rec, InputFields *fields)
+{
+   int i;
+   double x, y;
+
+   if(SkipSpace(input) != '[')
+      return DmtxFail;
+
+   for(i = 0; i < 4; i++) {
+      if((i > 0 && SkipSpace(input) != ',') || SkipSpace(input) != '[' ||
+            ReadJsonNumber(input, &x) != DmtxPass || SkipSpace(input) != ',' ||
+            ReadJsonNumber(input, &y) != DmtxPass || SkipSpace(input) != ']')
+         return DmtxFail;
+
+      rec->corner[2 * i] = (float)x;
+      rec->corner[2 * i + 1] = (float)y;
+   }
+
+   if(SkipSpace(input) != ']')
+      return DmtxFail;
+
+   fields->cornerCount = 4;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Skip a JSON value of any type
+ * @param  input result reader
+ * @return DmtxPass | DmtxFail
+ *
+ * Nesting is tracked with a counter rather than recursion, so deep
+ * input cannot exhaust the stack.
+ */
+static DmtxPassFail
+SkipJsonValue(ResultInput *input)
+{
+   int c;
+   long depth;
+   size_t length;
+   InputString str;
+
+   depth = 0;
+   length = input->bufLength;
+
+   for(;;) {
+      c = SkipSpace(input);
+
+      if(c == '"') {
+         if(ReadJsonString(input, DmtxFalse, &str) != DmtxPass)
+            return DmtxFail;
+         input->bufLength = length;
+      }
+      else if(c == '[' || c == '{') {
+         depth++;
+         continue;
+      }
+      else if(c == ']' || c == '}') {
+         if(--depth < 0)
+            return DmtxFail;
+      }
+      else if(c == ',' || c == ':') {
+         if(depth == 0)
+            return DmtxFail;
+         continue;
+      }
+      else if(c == '-' || isalnum(c)) {
+         /* Number, true, false or null */
+         do {
+            c = ReadChar(input);
+         } while(c == '-' || c == '+' || c == '.' || isalnum(c));
+         UnreadChar(input, c);
+      }
+      else {
+         return DmtxFail;
+      }
+
+      if(depth == 0)
+         return DmtxPass;
+   }
+}
+
+/**
+ * @brief  Parse the next <barcode> element
+ * @param  input result reader
+ * @param  rec record to fill
+ * @return 1 for a record, 0 at end of input, -1 on malformed input
+ */
+static int
+ReadXmlRecord(ResultInput *input, ResultRecord *rec)
+{
+   int i, result;
+   int attribCount;
+   double value;
+   char name[INPUT_NAME_MAX];
+   char text[INPUT_NUMBER_MAX];
+   DmtxBoolean isEnd, isEmpty, inBarcode, base64;
+   InputAttrib attribs[INPUT_ATTRIB_MAX];
+   InputFields fields;
+   InputString str;
+
+   inBarcode = DmtxFalse;
+   memset(&fields, 0x00, sizeof(InputFields));
+
+   for(;;) {
+      result = ReadXmlTag(input, name, &isEnd, &isEmpty, attribs, &attribCount);
+      if(result == 0)
+         return (inBarcode == DmtxTrue) ? -1 : 0;
+      if(result == -1)
+         return -1;
+
+      if(inBarcode == DmtxFalse) {
+         if(strcmp(name, "barcode") != 0 || isEnd == DmtxTrue)
+            continue;
+
+         /* Start a record; attributes already went into the new buffer */
+         inBarcode = DmtxTrue;
+         memset(rec, 0x00, sizeof(ResultRecord));
+         fields.file.offset = fields.member.offset = fields.message.offset = -1;
+         fields.dataWords = DmtxUndefined;
+
+         for(i = 0; i < attribCount; i++) {
+            if(strcmp(attribs[i].name, "file") == 0)
+               fields.file = attribs[i].value;
+            else if(strcmp(attribs[i].name, "member") == 0)
+               fields.member = attribs[i].value;
+            else if(strcmp(attribs[i].name, "page") == 0) {
+               if(GetNumber(input, &(attribs[i].value), &value) != DmtxPass)
+                  return -1;
+               rec->pageIndex = (long)value - 1;
+            }
+         }
+
+         if(isEmpty == DmtxTrue)
+            return -1;
+         continue;
+      }
+
+      if(isEnd == DmtxTrue) {
+         if(strcmp(name, "barcode") == 0)
+            return (FinishRecord(input, &fields, rec) == DmtxPass) ? 1 : -1;
+         continue;
+      }
+
+      if(strcmp(name, "corner") == 0) {
+         if(fields.cornerCount >= 4)
+            return -1;
+         for(i = 0; i < attribCount; i++) {
+            if(strcmp(attribs[i].name, "x") != 0 && strcmp(attribs[i].name, "y") != 0)
+               continue;
+            if(GetNumber(input, &(attribs[i].value), &value) != DmtxPass)
+               return -1;
+            rec->corner[2 * fields.cornerCount + ((attribs[i].name[0] == 'y') ? 1 : 0)] =
+                  (float)value;
+         }
+         fields.cornerCount++;
+         continue;
+      }
+
+      if(isEmpty == DmtxTrue)
+         continue;
+
+      if(strcmp(name, "message") == 0) {
+         base64 = DmtxFalse;
+         for(i = 0; i < attribCount; i++) {
+            if(strcmp(attribs[i].name, "encoding") == 0 && attribs[i].value.length == 6 &&
+                  memcmp(input->buf + attribs[i].value.offset, "base64", 6) == 0)
+               base64 = DmtxTrue;
+         }
+
+         if(ReadXmlText(input, (base64 == DmtxTrue) ? DmtxFalse : DmtxTrue, &str) != DmtxPass)
+            return -1;
+         if(base64 == DmtxTrue && DecodeBase64(input, &str) != DmtxPass)
+            return -1;
+         fields.message = str;
+      }
+      else if(strcmp(name, "matrix_size") == 0) {
+         if(ReadXmlText(input, DmtxFalse, &str) != DmtxPass || str.length >= INPUT_NUMBER_MAX)
+            return -1;
+         memcpy(text, input->buf + str.offset, str.length);
+         text[str.length] = '\0';
+         if(ParseMatrixSize(text, &fields.rows, &fields.cols) != DmtxPass)
+            return -1;
+      }
+      else if(strcmp(name, "data_codewords") == 0 || strcmp(name, "rotation") == 0 ||
+            strcmp(name, "time_ms") == 0) {
+         if(ReadXmlText(input, DmtxFalse, &str) != DmtxPass ||
+               GetNumber(input, &str, &value) != DmtxPass)
+            return -1;
+
+         if(strcmp(name, "data_codewords") == 0)
+            fields.dataWords = (int)value;
+         else if(strcmp(name, "rotation") == 0)
+            rec->rotation = (int)value;
+         else
+            rec->elapsedMS = (long)value;
+      }
+   }
+}
+
+/**
+ * @brief  Read the next start, end or empty-element tag
+ * @param  input result reader
+ * @param  name buffer of INPUT_NAME_MAX bytes for the element name
+ * @param  isEnd set for </name>
+ * @param  isEmpty set for <name/>
+ * @param  attribs attribute values, decoded into the record buffer
+ * @param  attribCount number of attributes kept
+ * @return 1 for a tag, 0 at end of input, -1 on malformed input
+ *
+ * Text, comments, processing instructions and declarations before the
+ * tag are skipped. The record buffer is emptied before a <barcode> tag
+ * so its attributes start the new record.
+ */
+static int
+ReadXmlTag(ResultInput *input, char *name, DmtxBoolean *isEnd, DmtxBoolean *isEmpty,
+      InputAttrib *attribs, int *attribCount)
+{
+   int c, quote, length;
+   char attribName[INPUT_NAME_MAX];
+   InputString value;
+
+   for(;;) {
+      do {
+         c = ReadChar(input);
+      } while(c != '<' && c != EOF);
+
+      if(c == EOF)
+         return 0;
+
+      c = ReadChar(input);
+      if(c == '?' || c == '!') {
+         UnreadChar(input, c);
+         if(SkipXmlMarkup(input) != DmtxPass)
+            return -1;
+         continue;
+      }
+      break;
+   }
+
+   *isEnd = (c == '/') ? DmtxTrue : DmtxFalse;
+   *isEmpty = DmtxFalse;
+   *attribCount = 0;
+
+   if(*isEnd == DmtxTrue)
+      c = ReadChar(input);
+
+   for(length = 0; c != EOF && !isspace(c) && c != '>' && c != '/'; c = ReadChar(input)) {
+      if(length < INPUT_NAME_MAX - 1)
+         name[length++] = (char)c;
+   }
+   name[length] = '\0';
+
+   if(length == 0)
+      return -1;
+
+   if(*isEnd == DmtxFalse && strcmp(name, "barcode") == 0)
+      input->bufLength = 0;
+
+   for(;;) {
+      while(c != EOF && isspace(c))
+         c = ReadChar(input);
+
+      if(c == '>')
+         return 1;
+
+      if(c == '/') {
+         if(ReadChar(input) != '>')
+            return -1;
+         *isEmpty = DmtxTrue;
+         return 1;
+      }
+
+      if(c == EOF || *isEnd == DmtxTrue)
+         return -1;
+
+      for(length = 0; c != EOF && !isspace(c) && c != '=' && c != '>'; c = ReadChar(input)) {
+         if(length < INPUT_NAME_MAX - 1)
+            attribName[length++] = (char)c;
+      }
+      attribName[length] = '\0';
+
+      while(c != EOF && isspace(c))
+         c = ReadChar(input);
+      if(c != '=')
+         return -1;
+
+      quote = SkipSpace(input);
+      if(quote != '"' && quote != '\'')
+         return -1;
+
+      value.offset = (long)input->bufLength;
+      for(c = ReadChar(input); c != quote; c = ReadChar(input)) {
+         if(c == EOF || c == '<')
+            return -1;
+         if(c == '&') {
+            if(ReadXmlEntity(input, DmtxFalse) != DmtxPass)
+               return -1;
+         }
+         else if(AppendByte(input, c) != DmtxPass) {
+            return -1;
+         }
+      }
+      value.length = (long)input->bufLength - value.offset;
+
+      if(*attribCount < INPUT_ATTRIB_MAX) {
+         strcpy(attribs[*attribCount].name, attribName);
+         attribs[*attribCount].value = value;
+         (*attribCount)++;
+      }
+
+      c = ReadChar(input);
+   }
+}
+
+/**
+ * @brief  Read character data up to the next tag
+ * @param  input result reader
+ * @param  latin1 store references below 256 as single bytes
+ * @param  str receives the offset and length of the decoded bytes
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+ReadXmlText(ResultInput *input, DmtxBoolean latin1, InputString *str)
+{
+   int c;
+
+   str->offset = (long)input->bufLength;
+
+   for(c = ReadChar(input); c != '<'; c = ReadChar(input)) {
+      if(c == EOF)
+         return DmtxFail;
+
+      if(c == '&') {
+         if(ReadXmlEntity(input, latin1) != DmtxPass)
+            return DmtxFail;
+      }
+      else if(AppendChar(input, c, latin1) != DmtxPass) {
+         return DmtxFail;
+      }
+   }
+   UnreadChar(input, c);
+
+   str->length = (long)input->bufLength - str->offset;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Decode an entity or character reference
+ * @param  input result reader ('&' already read)
+ * @param  latin1 store references below 256 as single bytes
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+ReadXmlEntity(ResultInput *input, DmtxBoolean latin1)
+{
+   int c, length;
+   long cp;
+   char entity[12];
+   char *end;
+
+   for(length = 0; (c = ReadChar(input)) != ';'; ) {
+      if(c == EOF || length == (int)sizeof(entity) - 1)
+         return DmtxFail;
+      entity[length++] = (char)c;
+   }
+   entity[length] = '\0';
+
+   if(strcmp(entity, "amp") == 0)
+      cp = '&';
+   else if(strcmp(entity, "lt") == 0)
+      cp = '<';
+   else if(strcmp(entity, "gt") == 0)
+      cp = '>';
+   else if(strcmp(entity, "quot") == 0)
+      cp = '"';
+   else if(strcmp(entity, "apos") == 0)
+      cp = '\'';
+   else if(entity[0] == '#' && (entity[1] == 'x' || entity[1] == 'X')) {
+      cp = strtol(entity + 2, &end, 16);
+      if(entity[2] == '\0' || *end != '\0')
+         return DmtxFail;
+   }
+   else if(entity[0] == '#') {
+      cp = strtol(entity + 1, &end, 10);
+      if(entity[1] == '\0' || *end != '\0')
+         return DmtxFail;
+   }
+   else {
+      return DmtxFail;
+   }
+
+   return AppendCodePoint(input, cp, latin1);
+}
+
+/**
+ * @brief  Skip a comment, processing instruction or declaration
+ * @param  input result reader ('<' already read, '?' or '!' next)
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+SkipXmlMarkup(ResultInput *input)
+{
+   int c, prev1, prev2;
+   DmtxBoolean comment;
+
+   c = ReadChar(input);
+   comment = DmtxFalse;
+
+   if(c == '!') {
+      c = ReadChar(input);
+      if(c == '-') {
+         c = ReadChar(input);
+         if(c != '-')
+            return DmtxFail;
+         comment = DmtxTrue;
+      }
+      else if(c == '>') {
+         return DmtxPass;
+      }
+   }
+
+   /* Comments end at "-->", everything else at the first '>' */
+   prev1 = prev2 = 0;
+   for(c = ReadChar(input); c != EOF; c = ReadChar(input)) {
+      if(c == '>' && (comment == DmtxFalse || (prev1 == '-' && prev2 == '-')))
+         return DmtxPass;
+      prev2 = prev1;
+      prev1 = c;
+   }
+
+   return DmtxFail;
+}
+
+/**
+ * @brief  Replace base64 text in the record buffer with the bytes it encodes
+ * @param  input result reader
+ * @param  str text location, updated to the decoded bytes
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+DecodeBase64(ResultInput *input, InputString *str)
+{
+   long i, outLength;
+   int c, bits, value;
+   unsigned long accum;
+   unsigned char *text;
+
+   text = input->buf + str->offset;
+   outLength = 0;
+   accum = 0;
+   bits = 0;
+
+   /* Output never overtakes input, so decode in place */
+   for(i = 0; i < str->length; i++) {
+      c = text[i];
+      if(c >= 'A' && c <= 'Z')
+         value = c - 'A';
+      else if(c >= 'a' && c <= 'z')
+         value = c - 'a' + 26;
+      else if(c >= '0' && c <= '9')
+         value = c - '0' + 52;
+      else if(c == '+')
+         value = 62;
+      else if(c == '/')
+         value = 63;
+      else if(c == '=' || isspace(c))
+         continue;
+      else
+         return DmtxFail;
+
+      accum = (accum << 6) | value;
+      bits += 6;
+      if(bits >= 8) {
+         bits -= 8;
+         text[outLength++] = (unsigned char)((accum >> bits) & 0xff);
+      }
+   }
+
+   str->length = outLength;
+   input->bufLength = str->offset + outLength;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Convert decoded text in the record buffer to a number
+ * @param  input result reader
+ * @param  str text location
+ * @param  value pointer to number read
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+GetNumber(ResultInput *input, InputString *str, double *value)
+{
+   char text[INPUT_NUMBER_MAX];
+   char *end;
+
+   if(str->length == 0 || str->length >= INPUT_NUMBER_MAX)
+      return DmtxFail;
+
+   memcpy(text, input->buf + str->offset, str->length);
+   text[str->length] = '\0';
+
+   *value = strtod(text, &end);
+   while(isspace((int)*end))
+      end++;
+
+   return (*end == '\0') ? DmtxPass : DmtxFail;
+}
@@ -0,0 +1,46 @@
+/*
+libdmtx - Data Matrix Encoding/Decoding Library
+
+Copyright (C) 2008, 2009 Mike Laughton
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+Contact: mike@dragonflylogic.com
+*/
+
+#ifndef __DMTXINPUT_H__
+#define __DMTXINPUT_H__
+
+#include <stdio.h>
+
+/* dmtxread --output-format values that can be read back */
+typedef enum {
+   InputBinary,
+   InputJsonl,
+   InputXml
+} InputFormat;
+
+typedef struct ResultInput_struct ResultInput;
+
+extern ResultInput *InputOpen(FILE *fp);
+extern void InputClose(ResultInput **input);
+extern int InputGetFormat(ResultInput *input);
+extern long InputGetLine(ResultInput *input);
+extern long InputGetOffset(ResultInput *input);
+extern DmtxPassFail InputSeek(ResultInput *input, long offset);
+extern DmtxPassFail InputSetRange(ResultInput *input, long start, long end);
+extern int InputRead(ResultInput *input, ResultRecord *rec);
+
+#endif
@@ -0,0 +1,581 @@
+/*
+libdmtx - Data Matrix Encoding/Decoding Library
+
+Copyright (C) 2008, 2009 Mike Laughton
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+Contact: mike@dragonflylogic.com
+*/
+
+/**
+ * @file dmtxjoin.c
+ * @brief Hash join of an expected-code manifest against barcode records
+ *
+ * The manifest is loaded into an open addressing table of distinct
+ * codes, then each barcode probes it: a code found once is matched, a
+ * code found again is a duplicate and a code not in the table is
+ * unexpected. Codes still unread at the end are missing. A table that
+ * would outgrow its memory limit is written out to partition files by
+ * hash instead, and the caller joins each partition on its own with a
+ * table seeded differently.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <dmtx.h>
+#include "../common/dmtxutil.h"
+#include "../common/dmtxrecord.h"
+#include "dmtxjoin.h"
+
+/* One distinct manifest code, with the first barcode that read it */
+typedef struct {
+   unsigned long hash;
+   size_t code;            /* offset into codes */
+   long length;
+   long reads;
+   size_t source;          /* offset into sources of first read's file and member */
+   int fileLength;
+   int memberLength;       /* DmtxUndefined without an archive member */
+   long page;              /* 0-based page of first read */
+} JoinEntry;
+
+struct ManifestTable_struct {
+   int seed;
+   size_t memoryLimit;     /* 0 for no limit */
+   DmtxBoolean full;
+   JoinEntry *entries;
+   unsigned long entryCount;
+   unsigned long entrySize;
+   unsigned long *slots;   /* entry index + 1, 0 for an empty slot */
+   unsigned long slotCount;
+   unsigned char *codes;
+   size_t codesLength;
+   size_t codesSize;
+   char *sources;
+   size_t sourcesLength;
+   size_t sourcesSize;
+   size_t lastSource;      /* most recent source, shared by barcodes of one image */
+   int lastFileLength;
+   int lastMemberLength;
+};
+
+static JoinEntry *FindEntry(ManifestTable *table, const unsigned char *code, long length,
+      unsigned long hash);
+static DmtxBoolean FitsLimit(ManifestTable *table, unsigned long entrySize,
+      unsigned long slotCount, size_t codesSize);
+static DmtxPassFail GrowSlots(ManifestTable *table);
+static DmtxPassFail KeepSource(ManifestTable *table, JoinEntry *entry, const ResultRecord *rec);
+static void PrintRead(FILE *fp, const char *kind, const unsigned char *code, long length,
+      const char *file, int fileLength, const char *member, int memberLength, long page);
+
+/**
+ * @brief  Create an empty manifest table
+ * @param  seed hash seed, different at each partitioning depth
+ * @param  memoryLimit bytes the table may use, or 0 for no limit
+ * @return Address of new table, or NULL if out of memory
+ */
+extern ManifestTable *
+JoinCreate(int seed, size_t memoryLimit)
+{
+   ManifestTable *table;
+
+   table = (ManifestTable *)calloc(1, sizeof(ManifestTable));
+   if(table == NULL)
+      return NULL;
+
+   table->seed = seed;
+   table->memoryLimit = memoryLimit;
+   table->full = DmtxFalse;
+   table->lastSource = (size_t)-1;
+
+   return table;
+}
+
+/**
+ * @brief  Free a manifest table
+ * @param  table pointer to table pointer
+ * @return void
+ */
+extern void
+JoinDestroy(ManifestTable **table)
+{
+   if(table == NULL || *table == NULL)
+      return;
+
+   free((*table)->entries);
+   free((*table)->slots);
+   free((*table)->codes);
+   free((*table)->sources);
+   free(*table);
+
+   *table = NULL;
+}
+
+/**
+ * @brief  Add one expected code; repeated codes are kept once
+ * @param  table manifest table
+ * @param  code code bytes
+ * @param  length code length
+ * @return DmtxPass | DmtxFail (table full or out of memory)
+ */
+extern DmtxPassFail
+JoinAddExpected(ManifestTable *table, const unsigned char *code, long length)
+{
+   unsigned long hash, entrySize, slotCount;
+   size_t codesSize;
+   void *grown;
+   JoinEntry *entry;
+
+   hash = JoinHash(code, length, table->seed);
+   if(table->slotCount > 0 && FindEntry(table, code, length, hash) != NULL)
+      return DmtxPass;
+
+   /* Check the limit before anything grows, so a full table stays usable */
+   entrySize = (table->entryCount < table->entrySize) ? table->entrySize :
+         (table->entrySize == 0) ? 1024 : table->entrySize * 2;
+   slotCount = ((table->entryCount + 1) * 2 <= table->slotCount) ? table->slotCount :
+         (table->slotCount == 0) ? 2048 : table->slotCount * 2;
+   codesSize = table->codesSize;
+   while(table->codesLength + length > codesSize)
+      codesSize = (codesSize == 0) ? 65536 : codesSize * 2;
+
+   if(FitsLimit(table, entrySize, slotCount, codesSize) == DmtxFalse) {
+      table->full = DmtxTrue;
+      return DmtxFail;
+   }
+
+   if(entrySize != table->entrySize) {
+      grown = realloc(table->entries, entrySize * sizeof(JoinEntry));
+      if(grown == NULL)
+         return DmtxFail;
+      table->entries = (JoinEntry *)grown;
+      table->entrySize = entrySize;
+   }
+
+   if(codesSize != table->codesSize) {
+      grown = realloc(table->codes, codesSize);
+      if(grown == NULL)
+         return DmtxFail;
+      table->codes = (unsigned char *)grown;
+      table->codesSize = codesSize;
+   }
+
+   while(table->slotCount < slotCount) {
+      if(GrowSlots(table) != DmtxPass)
+         return DmtxFail;
+   }
+
+   entry = &(table->entries[table->entryCount]);
+   memset(entry, 0x00, sizeof(JoinEntry));
+   entry->hash = hash;
+   entry->code = table->codesLength;
+   entry->length = length;
+   entry->memberLength = DmtxUndefined;
+   memcpy(table->codes + table->codesLength, code, length);
+   table->codesLength += length;
+   table->entryCount++;
+
+   /* Place the new entry, which FindEntry() missed above */
+   hash &= (table->slotCount - 1);
+   while(table->slots[hash] != 0)
+      hash = (hash + 1) & (table->slotCount - 1);
+   table->slots[hash] = table->entryCount;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Tell whether the table refused a code to stay within its limit
+ * @param  table manifest table
+ * @return DmtxTrue | DmtxFalse
+ */
+extern DmtxBoolean
+JoinIsFull(ManifestTable *table)
+{
+   return table->full;
+}
+
+/**
+ * @brief  Write the table's codes to partition files, one per line
+ * @param  table manifest table, before any probe
+ * @param  parts partition streams
+ * @param  partCount number of partitions
+ * @return DmtxPass | DmtxFail (write error)
+ */
+extern DmtxPassFail
+JoinSpill(ManifestTable *table, FILE **parts, int partCount)
+{
+   unsigned long i;
+   JoinEntry *entry;
+   FILE *fp;
+
+   for(i = 0; i < table->entryCount; i++) {
+      entry = &(table->entries[i]);
+      fp = parts[entry->hash % partCount];
+      if(fwrite(table->codes + entry->code, 1, entry->length, fp) != (size_t)entry->length ||
+            putc('\n', fp) == EOF)
+         return DmtxFail;
+   }
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Match one barcode against the manifest
+ *
+ * Unexpected barcodes and every read of a duplicated code are printed
+ * as they are found; the first read of a code is printed once a second
+ * one turns up.
+ *
+ * @param  table manifest table
+ * @param  rec barcode record
+ * @param  fp output stream
+ * @param  section JoinSection being printed
+ * @param  counts running totals
+ * @return DmtxPass | DmtxFail (out of memory)
+ */
+extern DmtxPassFail
+JoinProbe(ManifestTable *table, const ResultRecord *rec, FILE *fp, int section,
+      JoinCounts *counts)
+{
+   DmtxBoolean printDuplicates;
+   JoinEntry *entry;
+
+   counts->read++;
+
+   entry = (table->slotCount == 0) ? NULL : FindEntry(table, rec->message, rec->messageLength,
+         JoinHash(rec->message, rec->messageLength, table->seed));
+
+   if(entry == NULL) {
+      counts->unexpected++;
+      if(section == JoinAll || section == JoinUnexpected)
+         PrintRead(fp, "unexpected", rec->message, rec->messageLength, rec->file,
+               rec->fileLength, rec->member, rec->memberLength, rec->pageIndex);
+      return DmtxPass;
+   }
+
+   entry->reads++;
+   printDuplicates = (section == JoinAll || section == JoinDuplicate) ? DmtxTrue : DmtxFalse;
+
+   if(entry->reads == 1) {
+      counts->matched++;
+      return KeepSource(table, entry, rec);
+   }
+
+   if(entry->reads == 2) {
+      counts->matched--;
+      counts->duplicate++;
+      if(printDuplicates == DmtxTrue)
+         PrintRead(fp, "duplicate", table->codes + entry->code, entry->length,
+               table->sources + entry->source, entry->fileLength,
+               table->sources + entry->source + entry->fileLength, entry->memberLength,
+               entry->page);
+   }
+
+   if(printDuplicates == DmtxTrue)
+      PrintRead(fp, "duplicate", rec->message, rec->messageLength, rec->file,
+            rec->fileLength, rec->member, rec->memberLength, rec->pageIndex);
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Count the manifest and print the codes that were never read
+ * @param  table manifest table, after all barcodes probed it
+ * @param  fp output stream
+ * @param  section JoinSection being printed
+ * @param  counts running totals
+ * @return void
+ */
+extern void
+JoinFinish(ManifestTable *table, FILE *fp, int section, JoinCounts *counts)
+{
+   unsigned long i;
+   JoinEntry *entry;
+
+   counts->expected += table->entryCount;
+
+   for(i = 0; i < table->entryCount; i++) {
+      entry = &(table->entries[i]);
+      if(entry->reads > 0)
+         continue;
+
+      counts->missing++;
+      if(section == JoinAll || section == JoinMissing)
+         PrintRead(fp, "missing", table->codes + entry->code, entry->length,
+               NULL, 0, NULL, DmtxUndefined, DmtxUndefined);
+   }
+}
+
+/**
+ * @brief  Print reconciliation totals
+ * @param  counts totals
+ * @param  fp output stream
+ * @return void
+ */
+extern void
+JoinPrintCounts(const JoinCounts *counts, FILE *fp)
+{
+   fprintf(fp, "expected: %ld\n", counts->expected);
+   fprintf(fp, "read: %ld\n", counts->read);
+   fprintf(fp, "matched: %ld\n", counts->matched);
+   fprintf(fp, "missing: %ld\n", counts->missing);
+   fprintf(fp, "duplicate: %ld\n", counts->duplicate);
+   fprintf(fp, "unexpected: %ld\n", counts->unexpected);
+}
+
+/**
+ * @brief  Seeded 32-bit hash of a code
+ *
+ * FNV-1a followed by a final mix, so that partitions (hash modulo
+ * their count) and table slots (low bits) are both evenly filled.
+ *
+ * @param  code code bytes
+ * @param  length code length
+ * @param  seed hash seed
+ * @return Hash value
+ */
+extern unsigned long
+JoinHash(const unsigned char *code, long length, int seed)
+{
+   long i;
+   unsigned long hash;
+
+   hash = (2166136261UL ^ ((unsigned long)seed * 0x9e3779b9UL)) & 0xffffffffUL;
+   for(i = 0; i < length; i++) {
+      hash ^= code[i];
+      hash = (hash * 16777619UL) & 0xffffffffUL;
+   }
+
+   hash ^= hash >> 16;
+   hash = (hash * 0x85ebca6bUL) & 0xffffffffUL;
+   hash ^= hash >> 13;
+   hash = (hash * 0xc2b2ae35UL) & 0xffffffffUL;
+   hash ^= hash >> 16;
+
+   return hash;
+}
+
+/**
+ * @brief  Read one manifest line, without its line ending
+ * @param  fp manifest stream
+ * @param  buf pointer to line buffer, grown as needed
+ * @param  bufSize pointer to line buffer size
+ * @param  length pointer to line length
+ * @return 1 with a line | 0 at end of file | -1 out of memory
+ */
+extern int
+JoinReadLine(FILE *fp, unsigned char **buf, size_t *bufSize, long *length)
+{
+   size_t used;
+   unsigned char *grown;
+
+   if(*buf == NULL) {
+      *buf = (unsigned char *)malloc(256);
+      if(*buf == NULL)
+         return -1;
+      *bufSize = 256;
+   }
+
+   used = 0;
+   while(fgets((char *)*buf + used, (int)(*bufSize - used), fp) != NULL) {
+      used += strlen((char *)*buf + used);
+      if((used > 0 && (*buf)[used - 1] == '\n') || used + 1 < *bufSize)
+         break;
+
+      grown = (unsigned char *)realloc(*buf, *bufSize * 2);
+      if(grown == NULL)
+         return -1;
+      *buf = grown;
+      *bufSize *= 2;
+   }
+
+   if(used == 0)
+      return 0;
+
+   while(used > 0 && ((*buf)[used - 1] == '\n' || (*buf)[used - 1] == '\r'))
+      used--;
+   *length = (long)used;
+
+   return 1;
+}
+
+/**
+ * @brief  Find the entry for a code
+ * @param  table manifest table with at least one slot
+ * @param  code code bytes
+ * @param  length code length
+ * @param  hash JoinHash() of code
+ * @return Entry, or NULL if code is not in table
+ */
+static JoinEntry *
+FindEntry(ManifestTable *table, const unsigned char *code, long length, unsigned long hash)
+{
+   unsigned long slot;
+   JoinEntry *entry;
+
+   for(slot = hash & (table->slotCount - 1); table->slots[slot] != 0;
+         slot = (slot + 1) & (table->slotCount - 1)) {
+      entry = &(table->entries[table->slots[slot] - 1]);
+      if(entry->hash == hash && entry->length == length &&
+            memcmp(table->codes + entry->code, code, length) == 0)
+         return entry;
+   }
+
+   return NULL;
+}
+
+/**
+ * @brief  Tell whether the table may grow to the given sizes
+ * @param  table manifest table
+ * @param  entrySize entries allocated
+ * @param  slotCount slots allocated
+ * @param  codesSize code bytes allocated
+ * @return DmtxTrue | DmtxFalse
+ */
+static DmtxBoolean
+FitsLimit(ManifestTable *table, unsigned long entrySize, unsigned long slotCount,
+      size_t codesSize)
+{
+   size_t total;
+
+   if(table->memoryLimit == 0)
+      return DmtxTrue;
+
+   total = entrySize * sizeof(JoinEntry) + slotCount * sizeof(unsigned long) + codesSize;
+
+   return (total <= table->memoryLimit) ? DmtxTrue : DmtxFalse;
+}
+
+/**
+ * @brief  Double the slot array and place every entry again
+ * @param  table manifest table
+ * @return DmtxPass | DmtxFail (out of memory)
+ */
+static DmtxPassFail
+GrowSlots(ManifestTable *table)
+{
+   unsigned long i, slot, slotCount;
+   unsigned long *slots;
+
+   slotCount = (table->slotCount == 0) ? 2048 : table->slotCount * 2;
+   slots = (unsigned long *)calloc(slotCount, sizeof(unsigned long));
+   if(slots == NULL)
+      return DmtxFail;
+
+   for(i = 0; i < table->entryCount; i++) {
+      slot = table->entries[i].hash & (slotCount - 1);
+      while(slots[slot] != 0)
+         slot = (slot + 1) & (slotCount - 1);
+      slots[slot] = i + 1;
+   }
+
+   free(table->slots);
+   table->slots = slots;
+   table->slotCount = slotCount;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Remember where a code was first read
+ *
+ * Barcodes arrive image by image, so consecutive reads share the
+ * stored file and member name.
+ *
+ * @param  table manifest table
+ * @param  entry entry read for the first time
+ * @param  rec barcode record
+ * @return DmtxPass | DmtxFail (out of memory)
+ */
+static DmtxPassFail
+KeepSource(ManifestTable *table, JoinEntry *entry, const ResultRecord *rec)
+{
+   int memberLength;
+   size_t needed, sourcesSize;
+   char *grown;
+
+   memberLength = (rec->member == NULL) ? DmtxUndefined : rec->memberLength;
+
+   if(table->lastSource == (size_t)-1 || table->lastFileLength != rec->fileLength ||
+         table->lastMemberLength != memberLength ||
+         memcmp(table->sources + table->lastSource, rec->file, rec->fileLength) != 0 ||
+         (rec->member != NULL && memcmp(table->sources + table->lastSource + rec->fileLength,
+         rec->member, rec->memberLength) != 0)) {
+
+      needed = rec->fileLength + ((rec->member == NULL) ? 0 : rec->memberLength);
+      if(table->sourcesLength + needed > table->sourcesSize) {
+         sourcesSize = (table->sourcesSize == 0) ? 65536 : table->sourcesSize;
+         while(table->sourcesLength + needed > sourcesSize)
+            sourcesSize *= 2;
+         grown = (char *)realloc(table->sources, sourcesSize);
+         if(grown == NULL)
+            return DmtxFail;
+         table->sources = grown;
+         table->sourcesSize = sourcesSize;
+      }
+
+      table->lastSource = table->sourcesLength;
+      table->lastFileLength = rec->fileLength;
+      table->lastMemberLength = memberLength;
+      memcpy(table->sources + table->sourcesLength, rec->file, rec->fileLength);
+      if(rec->member != NULL)
+         memcpy(table->sources + table->sourcesLength + rec->fileLength, rec->member,
+               rec->memberLength);
+      table->sourcesLength += needed;
+   }
+
+   entry->source = table->lastSource;
+   entry->fileLength = rec->fileLength;
+   entry->memberLength = memberLength;
+   entry->page = rec->pageIndex;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Print one report line: kind, code, then file, member and page
+ * @param  fp output stream
+ * @param  kind "missing", "duplicate" or "unexpected"
+ * @param  code code bytes
+ * @param  length code length
+ * @param  file image file, or NULL for a code never read
+ * @param  fileLength image file name length
+ * @param  member archive member, or NULL
+ * @param  memberLength archive member name length
+ * @param  page 0-based page
+ * @return void
+ */
+static void
+PrintRead(FILE *fp, const char *kind, const unsigned char *code, long length,
+      const char *file, int fileLength, const char *member, int memberLength, long page)
+{
+   fputs(kind, fp);
+   fputc('\t', fp);
+   fwrite(code, 1, length, fp);
+
+   if(file != NULL) {
+      fputc('\t', fp);
+      fwrite(file, 1, fileLength, fp);
+      fputc('\t', fp);
+      if(member != NULL && memberLength != DmtxUndefined)
+         fwrite(member, 1, memberLength, fp);
+      fprintf(fp, "\t%ld", page + 1);
+   }
+
+   fputc('\n', fp);
+}
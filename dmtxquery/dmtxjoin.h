@@ -0,0 +1,69 @@
+/*
+libdmtx - Data Matrix Encoding/Decoding Library
+
+Copyright (C) 2008, 2009 Mike Laughton
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+Contact: mike@dragonflylogic.com
+*/
+
+#ifndef __DMTXJOIN_H__
+#define __DMTXJOIN_H__
+
+#include <stdio.h>
+
+/* Partitions a manifest is split into when it outgrows memory */
+#define JOIN_PARTITIONS  64
+
+/* Default memory for one in-memory join, in megabytes */
+#define JOIN_MEMORY_MB   256
+
+/* Partitioning depth after which a table grows past its limit instead */
+#define JOIN_DEPTH_MAX   4
+
+/* Report sections, selected by reconcile.SECTION */
+typedef enum {
+   JoinAll,
+   JoinMissing,
+   JoinDuplicate,
+   JoinUnexpected,
+   JoinSummary
+} JoinSection;
+
+typedef struct {
+   long expected;       /* distinct codes in manifest */
+   long read;           /* barcodes compared against manifest */
+   long matched;        /* codes read exactly once */
+   long missing;        /* codes never read */
+   long duplicate;      /* codes read more than once */
+   long unexpected;     /* barcodes whose code is not in manifest */
+} JoinCounts;
+
+typedef struct ManifestTable_struct ManifestTable;
+
+extern ManifestTable *JoinCreate(int seed, size_t memoryLimit);
+extern void JoinDestroy(ManifestTable **table);
+extern DmtxPassFail JoinAddExpected(ManifestTable *table, const unsigned char *code, long length);
+extern DmtxBoolean JoinIsFull(ManifestTable *table);
+extern DmtxPassFail JoinSpill(ManifestTable *table, FILE **parts, int partCount);
+extern DmtxPassFail JoinProbe(ManifestTable *table, const ResultRecord *rec, FILE *fp,
+      int section, JoinCounts *counts);
+extern void JoinFinish(ManifestTable *table, FILE *fp, int section, JoinCounts *counts);
+extern void JoinPrintCounts(const JoinCounts *counts, FILE *fp);
+extern unsigned long JoinHash(const unsigned char *code, long length, int seed);
+extern int JoinReadLine(FILE *fp, unsigned char **buf, size_t *bufSize, long *length);
+
+#endif
@@ -23,11 +23,22 @@ Contact: mike@dragonflylogic.com
 #include <stdlib.h>
 #include <stdio.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <string.h>
 #include <getopt.h>
+#include <ctype.h>
+#include <errno.h>
 #include <dmtx.h>
-#include "dmtxquery.h"
 #include "../common/dmtxutil.h"
+#include "../common/dmtxrecord.h"
+#include "dmtxinput.h"
+#include "dmtxindex.h"
+#include "dmtxstats.h"
+#include "dmtxjoin.h"
+#include "dmtxcompare.h"
+#include "dmtxwindow.h"
+#include "dmtxquery.h"
 
 char *programName;
 
@@ -42,15 +53,50 @@ int
 main(int argc, char *argv[])
 {
    int err;
+   int fileIndex, fileCount;
+   char *stdinPath;
+   char **files;
    UserOptions options;
 
    SetOptionDefaults(&options);
 
-   err = HandleArgs(&options, &argc, &argv);
-   if(err)
-      ShowUsage(err);
+   err = HandleArgs(&options, &fileIndex, &argc, &argv);
+   if(err != DmtxPass)
+      ShowUsage(EX_USAGE);
+
+   /* Both runs of a comparison are FILEs, whether results or indexes */
+   if(options.queryType == QueryCompare)
+      exit(RunCompare(&options, argv + fileIndex, argc - fileIndex));
+
+   /* FILEs named with an index are added to it before the query */
+   if(options.indexPath != NULL) {
+      if(fileIndex < argc)
+         UpdateIndex(&options, argv + fileIndex, argc - fileIndex);
+      files = NULL;
+      fileCount = 0;
+   }
+   /* Read standard input when no files are named */
+   else if(fileIndex == argc) {
+      stdinPath = "-";
+      files = &stdinPath;
+      fileCount = 1;
+   }
+   else {
+      files = argv + fileIndex;
+      fileCount = argc - fileIndex;
+   }
 
-   exit(0);
+   switch(options.queryType) {
+      case QueryAggregate:
+         exit(RunStats(&options, files, fileCount));
+      case QueryReconcile:
+         exit(RunReconcile(&options, files, fileCount));
+      case QueryWindow:
+         exit(RunWindow(&options, files, fileCount));
+      default:
+         exit((options.indexPath != NULL) ? RunIndexQuery(&options) :
+               RunQuery(&options, files, fileCount));
+   }
 }
 
 /**
@@ -63,23 +109,48 @@ SetOptionDefaults(UserOptions *options)
    memset(options, 0x00, sizeof(UserOptions));
 
    /* Set default options */
+   options->queryType = QueryBarcodeCount;
+   options->messageIndex = DmtxUndefined;
+   options->barcodeIndex = DmtxUndefined;
+   options->property = PropAll;
+   options->threads = DmtxUndefined;
+   options->manifestPath = NULL;
+   options->joinMemory = (size_t)JOIN_MEMORY_MB * 1024 * 1024;
+   options->follow = DmtxFalse;
+   options->windowSeconds = DMTXQUERY_WINDOW_SECONDS;
+   options->interval = DMTXQUERY_INTERVAL;
+   IndexFilterInit(&(options->filter));
 }
 
 /**
  * Sets and validates user-requested options from command line arguments.
  *
  * @param options    runtime options from defaults or command line
+ * @param fileIndex  pointer to index of first file argument
  * @param argcp      pointer to argument count
  * @param argvp      pointer to argument list
  * @return           DmtxPass | DmtxFail
  */
 static DmtxPassFail
-HandleArgs(UserOptions *options, int *argcp, char **argvp[])
+HandleArgs(UserOptions *options, int *fileIndex, int *argcp, char **argvp[])
 {
    int opt;
    int longIndex;
+   int err;
+   char *ptr;
 
    struct option longOptions[] = {
+         {"index",            required_argument, NULL, 'i'},
+         {"threads",          required_argument, NULL, 'j'},
+         {"where",            required_argument, NULL, OptWhere},
+         {"manifest",         required_argument, NULL, OptManifest},
+         {"memory",           required_argument, NULL, OptMemory},
+         {"follow",           no_argument,       NULL, 'f'},
+         {"window-seconds",   required_argument, NULL, OptWindowSeconds},
+         {"interval",         required_argument, NULL, OptInterval},
+         {"message",          required_argument, NULL, OptMessage},
+         {"file",             required_argument, NULL, OptFile},
+         {"page",             required_argument, NULL, OptPage},
          {"version",          no_argument,       NULL, 'V'},
          {"help",             no_argument,       NULL,  0 },
          {0, 0, 0, 0}
@@ -91,7 +162,7 @@ HandleArgs(UserOptions *options, int *argcp, char **argvp[])
       return DmtxFail;
 
    for(;;) {
-      opt = getopt_long(*argcp, *argvp, "V", longOptions, &longIndex);
+      opt = getopt_long(*argcp, *argvp, "fi:j:V", longOptions, &longIndex);
       if(opt == -1)
          break;
 
@@ -99,6 +170,57 @@ HandleArgs(UserOptions *options, int *argcp, char **argvp[])
          case 0: /* --help */
             ShowUsage(0);
             break;
+         case 'i':
+            options->indexPath = optarg;
+            break;
+         case OptMessage:
+            options->filter.message = (unsigned char *)optarg;
+            options->filter.messageLength = (long)strlen(optarg);
+            break;
+         case OptFile:
+            options->filter.file = optarg;
+            options->filter.fileLength = (int)strlen(optarg);
+            break;
+         case 'j':
+            err = StringToInt(&(options->threads), optarg, &ptr);
+            if(err != DmtxPass || options->threads < 1 ||
+                  options->threads > DMTXQUERY_THREADS_MAX || *ptr != '\0')
+               FatalError(EX_USAGE, _("Invalid thread count specified \"%s\""), optarg);
+#ifndef DMTXQUERY_THREADS
+            if(options->threads > 1)
+               FatalError(EX_USAGE, _("Threads are not supported on this platform"));
+#endif
+            break;
+         case OptWhere:
+            if(AddPredicate(&(options->filter), optarg) != DmtxPass)
+               FatalError(EX_USAGE, _("Invalid predicate specified \"%s\""), optarg);
+            break;
+         case OptManifest:
+            options->manifestPath = optarg;
+            break;
+         case OptMemory:
+            if(StringToSize(&(options->joinMemory), optarg) != DmtxPass ||
+                  options->joinMemory < 1024 * 1024)
+               FatalError(EX_USAGE, _("Invalid memory size specified \"%s\""), optarg);
+            break;
+         case 'f':
+            options->follow = DmtxTrue;
+            break;
+         case OptWindowSeconds:
+            err = StringToInt(&(options->windowSeconds), optarg, &ptr);
+            if(err != DmtxPass || options->windowSeconds < 1 ||
+                  options->windowSeconds > 86400 || *ptr != '\0')
+               FatalError(EX_USAGE, _("Invalid window length specified \"%s\""), optarg);
+            break;
+         case OptInterval:
+            err = StringToInt(&(options->interval), optarg, &ptr);
+            if(err != DmtxPass || options->interval < 1 || *ptr != '\0')
+               FatalError(EX_USAGE, _("Invalid report interval specified \"%s\""), optarg);
+            break;
+         case OptPage:
+            if(ParsePageRange(&(options->filter), optarg) != DmtxPass)
+               FatalError(EX_USAGE, _("Invalid page range specified \"%s\""), optarg);
+            break;
          case 'V':
             fprintf(stderr, "%s version %s\n", programName, DmtxVersion);
             fprintf(stderr, "libdmtx version %s\n", dmtxVersion());
@@ -110,59 +232,1814 @@ HandleArgs(UserOptions *options, int *argcp, char **argvp[])
       }
    }
 
+   if(optind >= *argcp)
+      return DmtxFail;
+
+   if(ParseProperty(options, (*argvp)[optind]) != DmtxPass)
+      FatalError(EX_USAGE, _("Invalid property specified \"%s\""), (*argvp)[optind]);
+
+   if(options->follow == DmtxTrue && options->queryType != QueryWindow)
+      FatalError(EX_USAGE, _("--follow only applies to the window property"));
+   if(options->queryType == QueryWindow && options->indexPath != NULL)
+      FatalError(EX_USAGE, _("window reads result files, not --index"));
+
+   /* Barcodes are timed as they are read, so a finished file would land
+    * in one window whole */
+   if(options->queryType == QueryWindow && options->follow == DmtxFalse)
+      FatalError(EX_USAGE, _("window requires --follow"));
+
+   *fileIndex = optind + 1;
+
    return DmtxPass;
 }
 
 /**
- * Display program usage and exit with received status.
+ * Parses a PROPERTY argument such as barcode.2.rotation or message.1.barcode.1.
  *
- * @param status error code returned to OS
- * @return       void
+ * dmtxread reports every symbol on its own, so each message is made of
+ * exactly one barcode and message.N refers to the same symbol as
+ * barcode.N.
+ *
+ * @param options    runtime options receiving the query
+ * @param query      property string from command line
+ * @return           DmtxPass | DmtxFail
  */
-static void
-ShowUsage(int status)
+static DmtxPassFail
+ParseProperty(UserOptions *options, char *query)
 {
-   if(status != 0) {
-      fprintf(stderr, _("Usage: %s PROPERTY [OPTION]... [FILE]...\n"), programName);
-      fprintf(stderr, _("Try `%s --help' for more information.\n"), programName);
+   char *ptr;
+
+   if(strcmp(query, "barcode.count") == 0) {
+      options->queryType = QueryBarcodeCount;
+      return DmtxPass;
+   }
+
+   if(strcmp(query, "message.count") == 0) {
+      options->queryType = QueryMessageCount;
+      return DmtxPass;
+   }
+
+   if(strcmp(query, "stats") == 0 || strncmp(query, "stats.", 6) == 0) {
+      options->queryType = QueryAggregate;
+      return ParseStatsSection(query + 5, &(options->property));
+   }
+
+   if(strcmp(query, "reconcile") == 0 || strncmp(query, "reconcile.", 10) == 0) {
+      options->queryType = QueryReconcile;
+      return ParseJoinSection(query + 9, &(options->property));
+   }
+
+   if(strcmp(query, "window") == 0) {
+      options->queryType = QueryWindow;
+      return DmtxPass;
+   }
+
+   if(strcmp(query, "compare") == 0 || strncmp(query, "compare.", 8) == 0) {
+      options->queryType = QueryCompare;
+      return ParseCompareSection(query + 7, &(options->property));
+   }
+
+   if(strncmp(query, "barcode.", 8) == 0) {
+      ptr = query + 8;
+      if(ParseIndex(&ptr, &(options->barcodeIndex)) != DmtxPass)
+         return DmtxFail;
+
+      options->queryType = QueryBarcodeProperty;
+      options->property = PropAll;
+
+      return (*ptr == '\0') ? DmtxPass : ParseName(ptr, &(options->property), DmtxFalse);
+   }
+
+   if(strncmp(query, "message.", 8) != 0)
+      return DmtxFail;
+
+   ptr = query + 8;
+   if(ParseIndex(&ptr, &(options->messageIndex)) != DmtxPass)
+      return DmtxFail;
+
+   options->queryType = QueryMessageProperty;
+   options->property = PropMessageAll;
+
+   if(*ptr == '\0')
+      return DmtxPass;
+
+   if(strncmp(ptr, "barcode.", 8) != 0)
+      return ParseName(ptr, &(options->property), DmtxTrue);
+
+   ptr += 8;
+   if(strcmp(ptr, "count") == 0) {
+      options->queryType = QueryMessageBarcodeCount;
+      return DmtxPass;
+   }
+
+   if(ParseIndex(&ptr, &(options->barcodeIndex)) != DmtxPass)
+      return DmtxFail;
+
+   options->queryType = QueryBarcodeProperty;
+   options->property = PropAll;
+
+   return (*ptr == '\0') ? DmtxPass : ParseName(ptr, &(options->property), DmtxFalse);
+}
+
+/**
+ * Parses a 1-based index and steps past it and any following '.'.
+ *
+ * StringToInt() wants the number to end the string, so this is done here.
+ *
+ * @param ptr        pointer to position in property string
+ * @param index      pointer to index read
+ * @return           DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+ParseIndex(char **ptr, long *index)
+{
+   char *end;
+
+   if(!isdigit((int)**ptr))
+      return DmtxFail;
+
+   errno = 0;
+   *index = strtol(*ptr, &end, 10);
+   if(errno != 0 || *index < 1)
+      return DmtxFail;
+
+   if(*end == '.')
+      end++;
+   else if(*end != '\0')
+      return DmtxFail;
+
+   *ptr = end;
+
+   return DmtxPass;
+}
+
+/**
+ * Looks up a BPROP or MPROP property name.
+ *
+ * @param name        property name from command line
+ * @param property    pointer to BarcodeProperty found
+ * @param messageProp DmtxTrue for MPROP names, DmtxFalse for BPROP names
+ * @return            DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+ParseName(char *name, int *property, DmtxBoolean messageProp)
+{
+   int i;
+   static const struct {
+      const char *name;
+      int property;
+   } barcodeProps[] = {
+         { "message",            PropMessage },
+         { "message_number",     PropMessageNumber },
+         { "message_position",   PropMessagePosition },
+         { "matrix_size",        PropMatrixSize },
+         { "data_codewords",     PropDataCodewords },
+         { "error_codewords",    PropErrorCodewords },
+         { "rotation",           PropRotation },
+         { "data_regions_count", PropDataRegionsCount },
+         { "interleaved_blocks", PropInterleavedBlocks },
+         { "file",               PropFile },
+         { "member",             PropMember },
+         { "page",               PropPage },
+         { "corners",            PropCorners },
+         { "time_ms",            PropTime }
+   }, messageProps[] = {
+         { "message",            PropMessage },
+         { "data_codeword",      PropDataCodewords },
+         { "error_codeword",     PropErrorCodewords }
+   };
+
+   if(messageProp == DmtxTrue) {
+      for(i = 0; i < (int)(sizeof(messageProps) / sizeof(messageProps[0])); i++) {
+         if(strcmp(name, messageProps[i].name) == 0) {
+            *property = messageProps[i].property;
+            return DmtxPass;
+         }
+      }
    }
    else {
-      fprintf(stderr, _("Usage: %s PROPERTY [OPTION]... [FILE]...\n"), programName);
-      fprintf(stderr, _("\
-Extract information from the XML output from dmtxread for individual or\n\
-grouped barcode scan results.\n\
-\n\
-Example: dmtxread barcode.png | %s barcode.count\n\
-Example: %s barcode.2.rotation scanresults.xml\n\
-\n\
-PROPERTY:\n"), programName, programName);
-      fprintf(stderr, _("\
-   barcode.count             count of all barcodes found in image\n\
-   barcode.N.BPROP           print BPROP property of Nth barcode\n\
-\n\
-   message.count             count of all messages found in image\n\
-   message.N.MPROP           print MPROP property of Nth message\n\
-   message.N.barcode.count   count of all barcodes in Nth message\n\
-   message.N.barcode.M       Mth barcode of Nth message, print all\n\
-   message.N.barcode.M.BPROP Mth barcode of Nth message, print BPROP\n\
-\n\
-   BPROP barcode properties:\n\
-      message        message_number      message_position\n\
-      matrix_size    data_codewords      error_codewords\n\
-      rotation       data_regions_count  interleaved_blocks\n\
-\n\
-   MPROP message properties:\n\
-      message        data_codeword       error_codeword\n\
+      for(i = 0; i < (int)(sizeof(barcodeProps) / sizeof(barcodeProps[0])); i++) {
+         if(strcmp(name, barcodeProps[i].name) == 0) {
+            *property = barcodeProps[i].property;
+            return DmtxPass;
+         }
+      }
+   }
+
+   return DmtxFail;
+}
+
+/**
+ * Parses a --page argument: N, N-M or N- (from page N on).
+ *
+ * @param filter     query filter receiving the range
+ * @param range      page range from command line
+ * @return           DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+ParsePageRange(IndexFilter *filter, char *range)
+{
+   char *ptr;
+
+   if(!isdigit((int)*range))
+      return DmtxFail;
+
+   errno = 0;
+   filter->pageFirst = strtol(range, &ptr, 10);
+   if(errno != 0 || filter->pageFirst < 1)
+      return DmtxFail;
+
+   if(*ptr == '\0') {
+      filter->pageLast = filter->pageFirst;
+      return DmtxPass;
+   }
+
+   if(*ptr != '-')
+      return DmtxFail;
+   ptr++;
+
+   if(*ptr == '\0') {
+      filter->pageLast = DmtxUndefined;
+      return DmtxPass;
+   }
+
+   if(!isdigit((int)*ptr))
+      return DmtxFail;
+
+   filter->pageLast = strtol(ptr, &ptr, 10);
+   if(errno != 0 || *ptr != '\0' || filter->pageLast < filter->pageFirst)
+      return DmtxFail;
+
+   return DmtxPass;
+}
+
+/**
+ * Looks up the report section named after "stats".
+ *
+ * @param name       "" or "." and a section name
+ * @param section    pointer to StatsSection found
+ * @return           DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+ParseStatsSection(char *name, int *section)
+{
+   int i;
+   static const struct {
+      const char *name;
+      int section;
+   } sections[] = {
+         { "",             StatsAll },
+         { ".count",       StatsCount },
+         { ".matrix_size", StatsMatrixSize },
+         { ".rotation",    StatsRotation },
+         { ".time_ms",     StatsTime },
+         { ".file",        StatsFile }
+   };
+
+   for(i = 0; i < (int)(sizeof(sections) / sizeof(sections[0])); i++) {
+      if(strcmp(name, sections[i].name) == 0) {
+         *section = sections[i].section;
+         return DmtxPass;
+      }
+   }
+
+   return DmtxFail;
+}
+
+/**
+ * Looks up the report section named after "reconcile".
+ *
+ * @param name       "" or "." and a section name
+ * @param section    pointer to JoinSection found
+ * @return           DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+ParseJoinSection(char *name, int *section)
+{
+   int i;
+   static const struct {
+      const char *name;
+      int section;
+   } sections[] = {
+         { "",            JoinAll },
+         { ".missing",    JoinMissing },
+         { ".duplicate",  JoinDuplicate },
+         { ".unexpected", JoinUnexpected },
+         { ".summary",    JoinSummary }
+   };
+
+   for(i = 0; i < (int)(sizeof(sections) / sizeof(sections[0])); i++) {
+      if(strcmp(name, sections[i].name) == 0) {
+         *section = sections[i].section;
+         return DmtxPass;
+      }
+   }
+
+   return DmtxFail;
+}
+
+/**
+ * Looks up the report section named after "compare".
+ *
+ * @param name       "" or "." and a section name
+ * @param section    pointer to CompareSection found
+ * @return           DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+ParseCompareSection(char *name, int *section)
+{
+   if(strcmp(name, "") == 0)
+      *section = CompareAll;
+   else if(strcmp(name, ".images") == 0)
+      *section = CompareImages;
+   else if(strcmp(name, ".summary") == 0)
+      *section = CompareSummary;
+   else
+      return DmtxFail;
+
+   return DmtxPass;
+}
+
+/**
+ * Adds a --where predicate to the query filter.
+ *
+ * @param filter     query filter
+ * @param expr       predicate from command line, such as rotation>45
+ * @return           DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+AddPredicate(IndexFilter *filter, char *expr)
+{
+   IndexPredicate *where;
+
+   where = (IndexPredicate *)realloc(filter->where,
+         (filter->whereCount + 1) * sizeof(IndexPredicate));
+   if(where == NULL)
+      return DmtxFail;
+   filter->where = where;
+
+   if(IndexParsePredicate(&(where[filter->whereCount]), expr) != DmtxPass)
+      return DmtxFail;
+
+   filter->whereCount++;
+
+   return DmtxPass;
+}
+
+/**
+ * Picks the stats thread count when --threads is not given.
+ *
+ * @return           online processor count, or 1
+ */
+static int
+GetDefaultThreads(void)
+{
+#if defined(DMTXQUERY_THREADS) && defined(_SC_NPROCESSORS_ONLN)
+   long count;
+
+   count = sysconf(_SC_NPROCESSORS_ONLN);
+   if(count > DMTXQUERY_THREADS_MAX)
+      return DMTXQUERY_THREADS_MAX;
+   if(count > 1)
+      return (int)count;
+#endif
+
+   return 1;
+}
+
+/**
+ * Streams result records from each file and answers the query.
+ *
+ * Binary, JSON lines and XML output from dmtxread are all accepted, and
+ * a query may mix files of different formats. Each record is parsed
+ * straight from the stream into one reusable buffer, so memory use does
+ * not grow with the size of the input.
+ *
+ * @param options    runtime options holding the query
+ * @param files      list of result files ("-" for standard input)
+ * @param fileCount  number of result files
+ * @return           exit status returned to OS
+ */
+static int
+RunQuery(UserOptions *options, char **files, int fileCount)
+{
+   int i;
+   int result;
+   long target;
+   long barcodeCount;
+   FILE *fp;
+   ResultInput *input;
+   ResultRecord rec;
+
+   target = GetTarget(options);
+   if(target == DmtxUndefined)
+      return FinishQuery(options, 0);
+
+   barcodeCount = 0;
+
+   for(i = 0; i < fileCount; i++) {
+      fp = OpenResults(files[i], &input);
+
+      while((result = InputRead(input, &rec)) == 1) {
+         if(IndexFilterMatch(&(options->filter), &rec) == DmtxFalse)
+            continue;
+
+         if(++barcodeCount != target)
+            continue;
+
+         AnswerQuery(options, &rec, barcodeCount);
+         InputClose(&input);
+         return EX_OK;
+      }
+
+      if(result == -1)
+         ReadError(input, files[i]);
+
+      InputClose(&input);
+
+      if(fp != stdin)
+         fclose(fp);
+   }
+
+   return FinishQuery(options, barcodeCount);
+}
+
+/**
+ * Answers the query from an index.
+ *
+ * Unfiltered queries go straight to the Nth barcode. Filtered queries
+ * visit only the barcodes the index finds for --message or --file.
+ *
+ * @param options    runtime options holding the query and index path
+ * @return           exit status returned to OS
+ */
+static int
+RunIndexQuery(UserOptions *options)
+{
+   int result;
+   long target;
+   long barcodeCount;
+   ResultIndex *index;
+   IndexCursor *cursor;
+   ResultRecord rec;
+
+   index = IndexOpen(options->indexPath);
+   if(index == NULL)
+      FatalError(EX_DATAERR, _("Unable to open index \"%s\""), options->indexPath);
+
+   target = GetTarget(options);
+   if(target == DmtxUndefined) {
+      IndexClose(&index);
+      return FinishQuery(options, 0);
+   }
+
+   if(IndexFilterIsEmpty(&(options->filter)) == DmtxTrue) {
+      barcodeCount = IndexGetCount(index);
+      result = (target > 0) ? IndexGetRecord(index, target, &rec) : 0;
+   }
+   else {
+      cursor = IndexFind(index, &(options->filter));
+      if(cursor == NULL)
+         FatalError(EX_OSERR, _("Unable to search index \"%s\""), options->indexPath);
+
+      barcodeCount = 0;
+      while((result = IndexNext(cursor, &rec)) == 1) {
+         if(++barcodeCount == target)
+            break;
+      }
+
+      IndexCursorClose(&cursor);
+   }
+
+   if(result == -1)
+      FatalError(EX_DATAERR, _("Corrupt index \"%s\""), options->indexPath);
+
+   if(result == 1) {
+      AnswerQuery(options, &rec, target);
+      IndexClose(&index);
+      return EX_OK;
+   }
+
+   IndexClose(&index);
+
+   return FinishQuery(options, barcodeCount);
+}
+
+/**
+ * Adds result files to the index, creating it if needed.
+ *
+ * A result file indexed before is only read from where the last update
+ * stopped, so rerunning with a file that dmtxread appends to picks up
+ * just the new barcodes. One whose indexed bytes have changed since is
+ * read again from the start, and replaces its barcodes in the index.
+ *
+ * @param options    runtime options holding the index path
+ * @param files      list of result files ("-" for standard input)
+ * @param fileCount  number of result files
+ * @return           void
+ */
+static void
+UpdateIndex(UserOptions *options, char **files, int fileCount)
+{
+   int i;
+   int result;
+   long offset;
+   char *source;
+   FILE *fp;
+   ResultInput *input;
+   IndexWriter *writer;
+   ResultRecord rec;
+
+   writer = IndexWriterOpen(options->indexPath);
+   if(writer == NULL)
+      FatalError(EX_CANTCREAT, _("Unable to open index \"%s\" for update"), options->indexPath);
+
+   for(i = 0; i < fileCount; i++) {
+      fp = OpenResults(files[i], &input);
+
+      /* Standard input cannot be read again, so its position is not kept */
+      source = (fp == stdin) ? NULL : files[i];
+      offset = (source == NULL) ? 0 : IndexWriterGetOffset(writer, source);
+
+      if(offset < 0) {
+         fprintf(stderr, _("%s: \"%s\" changed since it was last indexed, replacing its barcodes\n"),
+               programName, files[i]);
+         offset = 0;
+      }
+
+      if(offset > 0 && InputSeek(input, offset) != DmtxPass)
+         FatalError(EX_IOERR, _("Unable to seek in \"%s\""), files[i]);
+
+      if(IndexWriterBeginSource(writer, source, offset) != DmtxPass)
+         FatalError(EX_OSERR, _("Unable to allocate memory for index"));
+
+      while((result = InputRead(input, &rec)) == 1) {
+         if(IndexWriterAdd(writer, &rec) != DmtxPass)
+            FatalError(EX_DATAERR, _("Unable to add barcode from \"%s\" to index"), files[i]);
+
+         if(IndexWriterFull(writer) == DmtxTrue &&
+               IndexWriterFlush(writer, (source == NULL) ? 0 : ftell(fp)) != DmtxPass)
+            FatalError(EX_IOERR, _("Unable to write index \"%s\""), options->indexPath);
+      }
+
+      if(result == -1)
+         ReadError(input, files[i]);
+
+      IndexWriterEndSource(writer, (source == NULL) ? 0 : ftell(fp));
+      InputClose(&input);
+
+      if(fp != stdin)
+         fclose(fp);
+   }
+
+   if(IndexWriterClose(&writer) != DmtxPass)
+      FatalError(EX_IOERR, _("Unable to write index \"%s\""), options->indexPath);
+}
+
+/**
+ * Gathers aggregate statistics over the matching barcodes.
+ *
+ * The input is cut into tasks: whole result files, pieces of large
+ * jsonl files, or index segments. Threads take tasks from a shared list
+ * until none are left, each counting into its own statistics, which
+ * are merged once all threads finish. Tasks are independent, so the
+ * totals do not depend on how they were shared out.
+ *
+ * @param options    runtime options holding the query
+ * @param files      list of result files, unused with an index
+ * @param fileCount  number of result files
+ * @return           exit status returned to OS
+ */
+static int
+RunStats(UserOptions *options, char **files, int fileCount)
+{
+   int i;
+   int threads;
+   unsigned long segment;
+   StatsJob job;
+   StatsWorker *workers;
+   QueryStats *total;
+
+   memset(&job, 0x00, sizeof(StatsJob));
+   job.options = options;
+   job.files = files;
+
+   if(options->indexPath != NULL) {
+      job.index = IndexOpen(options->indexPath);
+      if(job.index == NULL)
+         FatalError(EX_DATAERR, _("Unable to open index \"%s\""), options->indexPath);
+
+      for(segment = 0; segment < IndexGetSegmentCount(job.index); segment++) {
+         if(AddTask(&job, DmtxUndefined, 0, DmtxUndefined, segment) != DmtxPass)
+            FatalError(EX_OSERR, _("Unable to allocate memory for stats"));
+      }
+   }
+   else {
+      for(i = 0; i < fileCount; i++) {
+         if(AddFileTasks(&job, i) != DmtxPass)
+            FatalError(EX_OSERR, _("Unable to allocate memory for stats"));
+      }
+   }
+
+   threads = (options->threads == DmtxUndefined) ? GetDefaultThreads() : options->threads;
+   if(threads > job.taskCount)
+      threads = (job.taskCount > 0) ? job.taskCount : 1;
+
+   workers = (StatsWorker *)calloc(threads, sizeof(StatsWorker));
+   total = StatsCreate();
+   if(workers == NULL || total == NULL)
+      FatalError(EX_OSERR, _("Unable to allocate memory for stats"));
+
+   for(i = 0; i < threads; i++) {
+      workers[i].job = &job;
+      workers[i].stats = StatsCreate();
+      if(workers[i].stats == NULL)
+         FatalError(EX_OSERR, _("Unable to allocate memory for stats"));
+   }
+
+#ifdef DMTXQUERY_THREADS
+   pthread_mutex_init(&job.lock, NULL);
+   for(i = 1; i < threads; i++) {
+      if(pthread_create(&(workers[i].thread), NULL, GatherStats, &(workers[i])) != 0)
+         FatalError(EX_OSERR, _("Unable to start stats thread"));
+   }
+#endif
+
+   /* The main thread takes tasks too */
+   GatherStats(&(workers[0]));
+
+#ifdef DMTXQUERY_THREADS
+   for(i = 1; i < threads; i++)
+      pthread_join(workers[i].thread, NULL);
+   pthread_mutex_destroy(&job.lock);
+#endif
+
+   for(i = 0; i < threads; i++) {
+      if(StatsMerge(total, workers[i].stats) != DmtxPass)
+         FatalError(EX_OSERR, _("Unable to allocate memory for stats"));
+      StatsDestroy(&(workers[i].stats));
+   }
+
+   if(StatsPrint(total, stdout, options->property) != DmtxPass)
+      FatalError(EX_OSERR, _("Unable to allocate memory for stats"));
+
+   StatsDestroy(&total);
+   free(workers);
+   free(job.tasks);
+   IndexClose(&(job.index));
+
+   return EX_OK;
+}
+
+/**
+ * Adds the stats tasks for one result file.
+ *
+ * Large jsonl files are split into byte ranges. Other formats have no
+ * way to find a record boundary from an arbitrary offset, so they are
+ * read whole by one thread.
+ *
+ * @param job        stats work
+ * @param fileIndex  index of result file in job
+ * @return           DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+AddFileTasks(StatsJob *job, int fileIndex)
+{
+   int format;
+   long start, size;
+   FILE *fp;
+   ResultInput *input;
+
+   if(strcmp(job->files[fileIndex], "-") == 0)
+      return AddTask(job, fileIndex, 0, DmtxUndefined, 0);
+
+   fp = OpenResults(job->files[fileIndex], &input);
+   format = InputGetFormat(input);
+   size = (fseek(fp, 0, SEEK_END) == 0) ? ftell(fp) : -1;
+   InputClose(&input);
+   fclose(fp);
+
+   if(format != InputJsonl || size <= DMTXQUERY_CHUNK_SIZE)
+      return AddTask(job, fileIndex, 0, DmtxUndefined, 0);
+
+   for(start = 0; start < size; start += DMTXQUERY_CHUNK_SIZE) {
+      if(AddTask(job, fileIndex, start, start + DMTXQUERY_CHUNK_SIZE, 0) != DmtxPass)
+         return DmtxFail;
+   }
+
+   return DmtxPass;
+}
+
+/**
+ * Appends one task to the stats work.
+ *
+ * @param job        stats work
+ * @param fileIndex  index of result file, or DmtxUndefined for a segment
+ * @param start      first byte of range
+ * @param end        byte after range, or DmtxUndefined for the whole file
+ * @param segment    index segment number
+ * @return           DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+AddTask(StatsJob *job, int fileIndex, long start, long end, unsigned long segment)
+{
+   StatsTask *tasks;
+
+   tasks = (StatsTask *)realloc(job->tasks, (job->taskCount + 1) * sizeof(StatsTask));
+   if(tasks == NULL)
+      return DmtxFail;
+   job->tasks = tasks;
+
+   tasks[job->taskCount].fileIndex = fileIndex;
+   tasks[job->taskCount].start = start;
+   tasks[job->taskCount].end = end;
+   tasks[job->taskCount].segment = segment;
+   job->taskCount++;
+
+   return DmtxPass;
+}
+
+/**
+ * Thread body: runs stats tasks until none are left.
+ *
+ * @param arg        StatsWorker of this thread
+ * @return           NULL
+ */
+static void *
+GatherStats(void *arg)
+{
+   StatsWorker *worker;
+   StatsJob *job;
+   StatsTask *task;
+
+   worker = (StatsWorker *)arg;
+   job = worker->job;
+
+   for(;;) {
+#ifdef DMTXQUERY_THREADS
+      pthread_mutex_lock(&(job->lock));
+#endif
+      task = (job->nextTask < job->taskCount) ? &(job->tasks[job->nextTask++]) : NULL;
+#ifdef DMTXQUERY_THREADS
+      pthread_mutex_unlock(&(job->lock));
+#endif
+
+      if(task == NULL)
+         break;
+
+      RunStatsTask(job, task, worker->stats);
+   }
+
+   return NULL;
+}
+
+/**
+ * Counts the matching barcodes of one task.
+ *
+ * @param job        stats work
+ * @param task       file, file range or index segment to read
+ * @param stats      statistics of the calling thread
+ * @return           void
+ */
+static void
+RunStatsTask(StatsJob *job, StatsTask *task, QueryStats *stats)
+{
+   int result;
+   char *path;
+   FILE *fp;
+   ResultInput *input;
+   IndexCursor *cursor;
+   ResultRecord rec;
+
+   if(task->fileIndex == DmtxUndefined) {
+      cursor = IndexFind(job->index, &(job->options->filter));
+      if(cursor == NULL)
+         FatalError(EX_OSERR, _("Unable to search index \"%s\""), job->options->indexPath);
+      IndexCursorSetSegment(cursor, task->segment);
+
+      while((result = IndexNext(cursor, &rec)) == 1) {
+         if(StatsAdd(stats, &rec) != DmtxPass)
+            FatalError(EX_OSERR, _("Unable to allocate memory for stats"));
+      }
+
+      if(result == -1)
+         FatalError(EX_DATAERR, _("Corrupt index \"%s\""), job->options->indexPath);
+
+      IndexCursorClose(&cursor);
+      return;
+   }
+
+   path = job->files[task->fileIndex];
+   fp = OpenResults(path, &input);
+
+   if(task->end != DmtxUndefined && InputSetRange(input, task->start, task->end) != DmtxPass)
+      FatalError(EX_IOERR, _("Unable to seek in \"%s\""), path);
+
+   while((result = InputRead(input, &rec)) == 1) {
+      if(IndexFilterMatch(&(job->options->filter), &rec) == DmtxTrue &&
+            StatsAdd(stats, &rec) != DmtxPass)
+         FatalError(EX_OSERR, _("Unable to allocate memory for stats"));
+   }
+
+   if(result == -1)
+      ReadError(input, path);
+
+   InputClose(&input);
+
+   if(fp != stdin)
+      fclose(fp);
+}
+
+/**
+ * Reconciles an expected-code manifest against the matching barcodes.
+ *
+ * Prints each missing, duplicate and unexpected code, or the totals
+ * for reconcile.summary. The manifest is read before any result.
+ *
+ * @param options    runtime options holding the query and manifest path
+ * @param files      list of result files, NULL with an index
+ * @param fileCount  number of result files
+ * @return           exit status returned to OS
+ */
+static int
+RunReconcile(UserOptions *options, char **files, int fileCount)
+{
+   int i;
+   long problems;
+   FILE *manifest;
+   JoinCounts counts;
+
+   if(options->manifestPath == NULL)
+      FatalError(EX_USAGE, _("reconcile requires --manifest"));
+
+   if(strcmp(options->manifestPath, "-") == 0) {
+      for(i = 0; i < fileCount; i++) {
+         if(strcmp(files[i], "-") == 0)
+            FatalError(EX_USAGE, _("Manifest and results cannot both be read from standard input"));
+      }
+      manifest = stdin;
+   }
+   else {
+      manifest = fopen(options->manifestPath, "rb");
+      if(manifest == NULL)
+         FatalError(EX_IOERR, _("Unable to open \"%s\""), options->manifestPath);
+   }
+
+   memset(&counts, 0x00, sizeof(JoinCounts));
+   ReconcilePart(options, manifest, files, fileCount, NULL, 0, &counts);
+
+   if(manifest != stdin)
+      fclose(manifest);
+
+   if(options->property == JoinSummary)
+      JoinPrintCounts(&counts, stdout);
+
+   switch(options->property) {
+      case JoinMissing:
+         problems = counts.missing;
+         break;
+      case JoinDuplicate:
+         problems = counts.duplicate;
+         break;
+      case JoinUnexpected:
+         problems = counts.unexpected;
+         break;
+      default:
+         problems = counts.missing + counts.duplicate + counts.unexpected;
+         break;
+   }
+
+   return (problems > 0) ? EX_NOTFOUND : EX_OK;
+}
+
+/**
+ * Joins one manifest against its results, partitioning both if the
+ * manifest does not fit in memory.
+ *
+ * Codes go to a partition by a hash seeded with the depth, so a code
+ * and every barcode carrying it always land in the same partition, and
+ * a partition that is still too large splits differently at the next
+ * depth. Past JOIN_DEPTH_MAX the table grows without limit.
+ *
+ * @param options    runtime options
+ * @param manifest   expected codes, one per line
+ * @param files      result files, used when results is NULL
+ * @param fileCount  number of result files
+ * @param results    binary records of a partition, or NULL at depth 0
+ * @param depth      partitioning depth
+ * @param counts     running totals
+ * @return           void
+ */
+static void
+ReconcilePart(UserOptions *options, FILE *manifest, char **files, int fileCount,
+      FILE *results, int depth, JoinCounts *counts)
+{
+   int i;
+   int result;
+   long length;
+   size_t lineSize;
+   unsigned char *line;
+   DmtxBoolean spilled;
+   ManifestTable *table;
+   FILE *fp;
+   FILE *manifestParts[JOIN_PARTITIONS];
+   FILE *resultParts[JOIN_PARTITIONS];
+
+   table = JoinCreate(depth, (depth < JOIN_DEPTH_MAX) ? options->joinMemory : 0);
+   if(table == NULL)
+      FatalError(EX_OSERR, _("Unable to allocate memory for manifest"));
+
+   spilled = DmtxFalse;
+   line = NULL;
+   lineSize = 0;
+
+   while((result = JoinReadLine(manifest, &line, &lineSize, &length)) == 1) {
+      if(length == 0)
+         continue;
+
+      if(spilled == DmtxFalse) {
+         if(JoinAddExpected(table, line, length) == DmtxPass)
+            continue;
+
+         if(JoinIsFull(table) == DmtxFalse)
+            FatalError(EX_OSERR, _("Unable to allocate memory for manifest"));
+
+         for(i = 0; i < JOIN_PARTITIONS; i++) {
+            manifestParts[i] = OpenTempFile("dmtxquery");
+            resultParts[i] = OpenTempFile("dmtxquery");
+            if(manifestParts[i] == NULL || resultParts[i] == NULL)
+               FatalError(EX_CANTCREAT, _("Unable to create spill file: %s"), strerror(errno));
+            if(RecordWriteHeader(resultParts[i]) != DmtxPass)
+               FatalError(EX_IOERR, _("Unable to write spill file"));
+         }
+
+         if(JoinSpill(table, manifestParts, JOIN_PARTITIONS) != DmtxPass)
+            FatalError(EX_IOERR, _("Unable to write spill file"));
+
+         JoinDestroy(&table);
+         spilled = DmtxTrue;
+      }
+
+      fp = manifestParts[JoinHash(line, length, depth) % JOIN_PARTITIONS];
+      if(fwrite(line, 1, length, fp) != (size_t)length || putc('\n', fp) == EOF)
+         FatalError(EX_IOERR, _("Unable to write spill file"));
+   }
+
+   if(result == -1)
+      FatalError(EX_OSERR, _("Unable to allocate memory for manifest"));
+   if(ferror(manifest)) {
+      if(depth > 0)
+         FatalError(EX_IOERR, _("Unable to read spill file"));
+      FatalError(EX_IOERR, _("Unable to read manifest \"%s\""), options->manifestPath);
+   }
+
+   free(line);
+
+   ReconcileResults(options, files, fileCount, results, table,
+         (spilled == DmtxTrue) ? resultParts : NULL, depth, counts);
+
+   if(spilled == DmtxFalse) {
+      JoinFinish(table, stdout, options->property, counts);
+      JoinDestroy(&table);
+      return;
+   }
+
+   for(i = 0; i < JOIN_PARTITIONS; i++) {
+      if(fflush(manifestParts[i]) != 0 || fflush(resultParts[i]) != 0)
+         FatalError(EX_IOERR, _("Unable to write spill file"));
+      rewind(manifestParts[i]);
+      rewind(resultParts[i]);
+
+      ReconcilePart(options, manifestParts[i], NULL, 0, resultParts[i], depth + 1, counts);
+
+      fclose(manifestParts[i]);
+      fclose(resultParts[i]);
+   }
+}
+
+/**
+ * Feeds every matching barcode to the join, from an index, result
+ * files or a partition.
+ *
+ * @param options    runtime options
+ * @param files      result files, used when results is NULL
+ * @param fileCount  number of result files
+ * @param results    binary records of a partition, or NULL
+ * @param table      manifest table, unused when parts is given
+ * @param parts      result partitions, or NULL to probe table
+ * @param depth      partitioning depth
+ * @param counts     running totals
+ * @return           void
+ */
+static void
+ReconcileResults(UserOptions *options, char **files, int fileCount, FILE *results,
+      ManifestTable *table, FILE **parts, int depth, JoinCounts *counts)
+{
+   int i;
+   int result;
+   FILE *fp;
+   ResultIndex *index;
+   IndexCursor *cursor;
+   ResultInput *input;
+   ResultRecord rec;
+
+   if(results != NULL) {
+      input = InputOpen(results);
+      if(input == NULL)
+         FatalError(EX_IOERR, _("Unable to read spill file"));
+
+      while((result = InputRead(input, &rec)) == 1)
+         ReconcileRecord(options, &rec, table, parts, depth, counts);
+
+      if(result == -1)
+         FatalError(EX_IOERR, _("Unable to read spill file"));
+
+      InputClose(&input);
+      return;
+   }
+
+   if(options->indexPath != NULL) {
+      index = IndexOpen(options->indexPath);
+      if(index == NULL)
+         FatalError(EX_DATAERR, _("Unable to open index \"%s\""), options->indexPath);
+
+      cursor = IndexFind(index, &(options->filter));
+      if(cursor == NULL)
+         FatalError(EX_OSERR, _("Unable to search index \"%s\""), options->indexPath);
+
+      while((result = IndexNext(cursor, &rec)) == 1)
+         ReconcileRecord(options, &rec, table, parts, depth, counts);
+
+      if(result == -1)
+         FatalError(EX_DATAERR, _("Corrupt index \"%s\""), options->indexPath);
+
+      IndexCursorClose(&cursor);
+      IndexClose(&index);
+      return;
+   }
+
+   for(i = 0; i < fileCount; i++) {
+      fp = OpenResults(files[i], &input);
+
+      while((result = InputRead(input, &rec)) == 1) {
+         if(IndexFilterMatch(&(options->filter), &rec) == DmtxTrue)
+            ReconcileRecord(options, &rec, table, parts, depth, counts);
+      }
+
+      if(result == -1)
+         ReadError(input, files[i]);
+
+      InputClose(&input);
+
+      if(fp != stdin)
+         fclose(fp);
+   }
+}
+
+/**
+ * Probes the manifest table with one barcode, or writes the barcode to
+ * the partition its code hashes to.
+ *
+ * @param options    runtime options
+ * @param rec        barcode record
+ * @param table      manifest table
+ * @param parts      result partitions, or NULL to probe table
+ * @param depth      partitioning depth
+ * @param counts     running totals
+ * @return           void
+ */
+static void
+ReconcileRecord(UserOptions *options, ResultRecord *rec, ManifestTable *table,
+      FILE **parts, int depth, JoinCounts *counts)
+{
+   FILE *fp;
+
+   if(parts == NULL) {
+      if(JoinProbe(table, rec, stdout, options->property, counts) != DmtxPass)
+         FatalError(EX_OSERR, _("Unable to allocate memory for manifest"));
+      return;
+   }
+
+   fp = parts[JoinHash(rec->message, rec->messageLength, depth) % JOIN_PARTITIONS];
+   if(RecordWrite(fp, rec) != DmtxPass)
+      FatalError(EX_IOERR, _("Unable to write spill file"));
+}
+
+/**
+ * Compares two runs image by image.
+ *
+ * Each run is a result file sorted by file name and page, or an index,
+ * which is read in that order. The runs are merged in one pass, one
+ * image at a time, printing barcodes lost or gained by the second run
+ * and then the totals.
+ *
+ * @param options    runtime options holding the query
+ * @param files      the two runs
+ * @param fileCount  number of runs, which must be 2
+ * @return           exit status returned to OS
+ */
+static int
+RunCompare(UserOptions *options, char **files, int fileCount)
+{
+   int cmp;
+   const ResultRecord *key;
+   CompareSide a, b;
+   CompareGroup *groupA, *groupB;
+   ResultCompare *compare;
+   DmtxBoolean changed;
+
+   if(fileCount != 2)
+      FatalError(EX_USAGE, _("compare needs exactly two result files or indexes"));
+   if(options->indexPath != NULL)
+      FatalError(EX_USAGE, _("compare reads indexes named as FILEs, not --index"));
+   if(strcmp(files[0], "-") == 0 && strcmp(files[1], "-") == 0)
+      FatalError(EX_USAGE, _("Only one run can be read from standard input"));
+
+   groupA = CompareGroupCreate();
+   groupB = CompareGroupCreate();
+   compare = CompareCreate();
+   if(groupA == NULL || groupB == NULL || compare == NULL)
+      FatalError(EX_OSERR, _("Unable to allocate memory for comparison"));
+
+   OpenCompareSide(options, &a, files[0]);
+   OpenCompareSide(options, &b, files[1]);
+
+   while(a.more == DmtxTrue || b.more == DmtxTrue) {
+      if(b.more == DmtxFalse)
+         cmp = -1;
+      else if(a.more == DmtxFalse)
+         cmp = 1;
+      else
+         cmp = CompareRecordKeys(&(a.rec), &(b.rec));
+
+      /* Take the earlier image, which may be in one run only */
+      key = (cmp <= 0) ? &(a.rec) : &(b.rec);
+      if(CompareGroupReset(groupA, key) != DmtxPass ||
+            CompareGroupReset(groupB, key) != DmtxPass)
+         FatalError(EX_OSERR, _("Unable to allocate memory for comparison"));
+
+      if(cmp <= 0)
+         FillCompareGroup(options, &a, groupA);
+      if(cmp >= 0)
+         FillCompareGroup(options, &b, groupB);
+
+      CompareImage(compare, groupA, groupB, stdout, options->property);
+   }
+
+   ComparePrint(compare, stdout, options->property);
+   changed = CompareChanged(compare);
+
+   CloseCompareSide(&a);
+   CloseCompareSide(&b);
+   CompareDestroy(&compare);
+   CompareGroupDestroy(&groupA);
+   CompareGroupDestroy(&groupB);
+
+   return (changed == DmtxTrue) ? EX_NOTFOUND : EX_OK;
+}
+
+/**
+ * Opens one run of a comparison and reads its first barcode.
+ *
+ * @param options    runtime options holding the filter
+ * @param side       run to open
+ * @param path       result file ("-" for standard input) or index
+ * @return           void
+ */
+static void
+OpenCompareSide(UserOptions *options, CompareSide *side, char *path)
+{
+   size_t length;
+   char magic[8];
+   FILE *fp;
+
+   memset(side, 0x00, sizeof(CompareSide));
+   side->path = path;
+
+   /* An index is recognized by its magic; anything else is results */
+   length = 0;
+   if(strcmp(path, "-") != 0) {
+      fp = fopen(path, "rb");
+      if(fp == NULL)
+         FatalError(EX_IOERR, _("Unable to open \"%s\""), path);
+      length = fread(magic, 1, sizeof(magic), fp);
+      fclose(fp);
+   }
+
+   if(length == sizeof(magic) && memcmp(magic, INDEX_MAGIC, sizeof(magic)) == 0) {
+      side->index = IndexOpen(path);
+      if(side->index == NULL)
+         FatalError(EX_DATAERR, _("Unable to open index \"%s\""), path);
+
+      side->cursor = IndexFindSorted(side->index, &(options->filter));
+      if(side->cursor == NULL)
+         FatalError(EX_OSERR, _("Unable to search index \"%s\""), path);
+   }
+   else {
+      side->fp = OpenResults(path, &(side->input));
+   }
+
+   ReadCompareSide(options, side);
+}
+
+/**
+ * Reads the next matching barcode of one run.
+ *
+ * @param options    runtime options holding the filter
+ * @param side       run to read
+ * @return           void
+ */
+static void
+ReadCompareSide(UserOptions *options, CompareSide *side)
+{
+   int result;
+
+   if(side->cursor != NULL) {
+      result = IndexNext(side->cursor, &(side->rec));
+      if(result == -1)
+         FatalError(EX_DATAERR, _("Corrupt index \"%s\""), side->path);
+   }
+   else {
+      while((result = InputRead(side->input, &(side->rec))) == 1) {
+         if(IndexFilterMatch(&(options->filter), &(side->rec)) == DmtxTrue)
+            break;
+      }
+      if(result == -1)
+         ReadError(side->input, side->path);
+   }
+
+   side->more = (result == 1) ? DmtxTrue : DmtxFalse;
+}
+
+/**
+ * Moves every barcode of the group's image from one run into the group.
+ *
+ * @param options    runtime options holding the filter
+ * @param side       run positioned at the group's image
+ * @param group      image group
+ * @return           void
+ */
+static void
+FillCompareGroup(UserOptions *options, CompareSide *side, CompareGroup *group)
+{
+   while(side->more == DmtxTrue && CompareGroupKey(group, &(side->rec)) == 0) {
+      if(CompareGroupAdd(group, &(side->rec)) != DmtxPass)
+         FatalError(EX_OSERR, _("Unable to allocate memory for comparison"));
+
+      ReadCompareSide(options, side);
+
+      if(side->more == DmtxTrue && CompareGroupKey(group, &(side->rec)) < 0)
+         FatalError(EX_DATAERR, _("\"%s\" is not sorted by file and page; "
+               "add it to an index with -i and compare the index"), side->path);
+   }
+}
+
+/**
+ * Closes one run of a comparison.
+ *
+ * @param side       run to close
+ * @return           void
+ */
+static void
+CloseCompareSide(CompareSide *side)
+{
+   if(side->cursor != NULL) {
+      IndexCursorClose(&(side->cursor));
+      IndexClose(&(side->index));
+      return;
+   }
+
+   InputClose(&(side->input));
+
+   if(side->fp != stdin)
+      fclose(side->fp);
+}
+
+/**
+ * Reports sliding-window rates over barcodes as they arrive.
+ *
+ * A report line is printed every --interval seconds while FILE is read, by a separate thread where threads are available
+ * so that a stalled line still reports. A last line is printed when the
+ * input ends.
+ *
+ * @param options    runtime options holding the window settings
+ * @param files      list of result files ("-" for standard input)
+ * @param fileCount  number of result files
+ * @return           exit status returned to OS
+ */
+static int
+RunWindow(UserOptions *options, char **files, int fileCount)
+{
+   WindowJob job;
+#ifdef DMTXQUERY_THREADS
+   pthread_t thread;
+#endif
+
+   if(fileCount != 1)
+      FatalError(EX_USAGE, _("--follow reads a single FILE"));
+
+   memset(&job, 0x00, sizeof(WindowJob));
+   job.options = options;
+   job.window = WindowCreate(options->windowSeconds);
+   if(job.window == NULL)
+      FatalError(EX_OSERR, _("Unable to allocate memory for window"));
+   job.nextReport = time(NULL) + options->interval;
+   job.done = DmtxFalse;
+
+   WindowPrintHeader(stdout);
+   fflush(stdout);
+
+#ifdef DMTXQUERY_THREADS
+   pthread_mutex_init(&job.lock, NULL);
+   pthread_cond_init(&job.wake, NULL);
+   if(pthread_create(&thread, NULL, ReportWindow, &job) != 0)
+      FatalError(EX_OSERR, _("Unable to start report thread"));
+#endif
+
+   ReadWindowFile(&job, files[0]);
+
+#ifdef DMTXQUERY_THREADS
+   pthread_mutex_lock(&job.lock);
+   job.done = DmtxTrue;
+   pthread_cond_signal(&job.wake);
+   pthread_mutex_unlock(&job.lock);
+   pthread_join(thread, NULL);
+   pthread_cond_destroy(&job.wake);
+   pthread_mutex_destroy(&job.lock);
+#endif
+
+   WindowPrint(job.window, stdout, time(NULL));
+   WindowDestroy(&job.window);
+
+   return EX_OK;
+}
+
+/**
+ * Reads one result file into the window.
+ *
+ * Reaching the end of a regular file means waiting for dmtxread to
+ * write more: a record cut short by the end is read again from its
+ * start once the rest arrives. Pipes simply block until data comes,
+ * and end when dmtxread does.
+ *
+ * @param job        window being counted
+ * @param path       result file ("-" for standard input)
+ * @return           void
+ */
+static void
+ReadWindowFile(WindowJob *job, char *path)
+{
+   int result;
+   long good, size;
+   DmtxBoolean tail;
+   struct stat info;
+   FILE *fp;
+   ResultInput *input;
+   ResultRecord rec;
+
+   fp = (strcmp(path, "-") == 0) ? stdin : fopen(path, "rb");
+   if(fp == NULL)
+      FatalError(EX_IOERR, _("Unable to open \"%s\""), path);
+
+   tail = (fstat(fileno(fp), &info) == 0 && S_ISREG(info.st_mode)) ? DmtxTrue : DmtxFalse;
+
+   /* Format is told from the first bytes, so wait until there are some */
+   if(tail == DmtxTrue) {
+      while((size = (fseek(fp, 0, SEEK_END) == 0) ? ftell(fp) : -1) == 0)
+         WaitForResults(job);
+      if(size < 0 || fseek(fp, 0, SEEK_SET) != 0)
+         FatalError(EX_IOERR, _("Unable to seek in \"%s\""), path);
+   }
+
+   input = InputOpen(fp);
+   if(input == NULL)
+      FatalError(EX_DATAERR, _("\"%s\" is not dmtxread binary, jsonl or xml output"), path);
+   good = InputGetOffset(input);
+
+   for(;;) {
+      while((result = InputRead(input, &rec)) == 1) {
+         if(IndexFilterMatch(&(job->options->filter), &rec) == DmtxTrue)
+            AddToWindow(job, &rec);
+         if(tail == DmtxTrue)
+            good = InputGetOffset(input);
+      }
+
+      if(tail == DmtxFalse || (result == -1 && !feof(fp)))
+         break;
+
+      clearerr(fp);
+      WaitForResults(job);
+
+      size = (fseek(fp, 0, SEEK_END) == 0) ? ftell(fp) : -1;
+      if(size < 0)
+         FatalError(EX_IOERR, _("Unable to seek in \"%s\""), path);
+
+      if(size < good) {
+         fprintf(stderr, _("%s: \"%s\" was truncated, reading it from the start\n"),
+               programName, path);
+         good = 0;
+      }
+
+      if(InputSeek(input, good) != DmtxPass)
+         FatalError(EX_IOERR, _("Unable to seek in \"%s\""), path);
+   }
+
+   if(result == -1)
+      ReadError(input, path);
+
+   InputClose(&input);
+
+   if(fp != stdin)
+      fclose(fp);
+}
+
+/**
+ * Counts one barcode, arriving now, in the window.
+ *
+ * @param job        window being counted
+ * @param rec        barcode record
+ * @return           void
+ */
+static void
+AddToWindow(WindowJob *job, ResultRecord *rec)
+{
+   int err;
+   time_t now;
+
+   now = time(NULL);
+
+#ifdef DMTXQUERY_THREADS
+   pthread_mutex_lock(&(job->lock));
+   err = WindowAdd(job->window, rec, now);
+   pthread_mutex_unlock(&(job->lock));
+#else
+   err = WindowAdd(job->window, rec, now);
+   PrintDueReport(job, now);
+#endif
+
+   if(err != DmtxPass)
+      FatalError(EX_OSERR, _("Unable to allocate memory for window"));
+}
+
+/**
+ * Pauses at the end of a growing result file.
+ *
+ * @param job        window being counted
+ * @return           void
+ */
+static void
+WaitForResults(WindowJob *job)
+{
+#ifndef DMTXQUERY_THREADS
+   PrintDueReport(job, time(NULL));
+#endif
+   sleep(1);
+}
+
+/**
+ * Prints a report line if one is due.
+ *
+ * @param job        window being counted
+ * @param now        current time
+ * @return           void
+ */
+static void
+PrintDueReport(WindowJob *job, time_t now)
+{
+   if(now < job->nextReport)
+      return;
+
+   WindowPrint(job->window, stdout, now);
+   fflush(stdout);
+
+   job->nextReport = now + job->options->interval;
+}
+
+/**
+ * Thread body: prints a report line every --interval seconds until the
+ * reader is done.
+ *
+ * @param arg        WindowJob being counted
+ * @return           NULL
+ */
+static void *
+ReportWindow(void *arg)
+{
+#ifdef DMTXQUERY_THREADS
+   WindowJob *job;
+   struct timespec deadline;
+
+   job = (WindowJob *)arg;
+
+   pthread_mutex_lock(&(job->lock));
+   while(job->done == DmtxFalse) {
+      deadline.tv_sec = job->nextReport;
+      deadline.tv_nsec = 0;
+      pthread_cond_timedwait(&(job->wake), &(job->lock), &deadline);
+
+      if(job->done == DmtxFalse)
+         PrintDueReport(job, time(NULL));
+   }
+   pthread_mutex_unlock(&(job->lock));
+#endif
+
+   return NULL;
+}
+
+/**
+ * Finds which matching barcode answers the query.
+ *
+ * Each message holds one barcode, so message N is barcode N.
+ *
+ * @param options    runtime options holding the query
+ * @return           1-based barcode number, 0 for counts, or
+ *                   DmtxUndefined if no barcode can answer
+ */
+static long
+GetTarget(UserOptions *options)
+{
+   switch(options->queryType) {
+      case QueryMessageProperty:
+      case QueryMessageBarcodeCount:
+         return options->messageIndex;
+      case QueryBarcodeProperty:
+         if(options->messageIndex == DmtxUndefined)
+            return options->barcodeIndex;
+         return (options->barcodeIndex == 1) ? options->messageIndex : DmtxUndefined;
+      default:
+         break;
+   }
+
+   return 0;
+}
+
+/**
+ * Reports a count, or that the requested barcode was not found.
+ *
+ * @param options      runtime options holding the query
+ * @param barcodeCount number of matching barcodes
+ * @return             exit status returned to OS
+ */
+static int
+FinishQuery(UserOptions *options, long barcodeCount)
+{
+   if(options->queryType == QueryBarcodeCount || options->queryType == QueryMessageCount) {
+      fprintf(stdout, "%ld\n", barcodeCount);
+      return EX_OK;
+   }
+
+   if(options->queryType == QueryBarcodeProperty && options->messageIndex != DmtxUndefined)
+      fprintf(stderr, _("%s: barcode %ld of message %ld not found\n"), programName,
+            options->barcodeIndex, options->messageIndex);
+   else if(options->messageIndex != DmtxUndefined)
+      fprintf(stderr, _("%s: message %ld not found\n"), programName, options->messageIndex);
+   else
+      fprintf(stderr, _("%s: barcode %ld not found\n"), programName, options->barcodeIndex);
+
+   return EX_NOTFOUND;
+}
+
+/**
+ * Prints the answer from the barcode the query asked for.
+ *
+ * @param options       runtime options holding the query
+ * @param rec           barcode record
+ * @param barcodeNumber position of barcode among matches (1-based)
+ * @return              void
+ */
+static void
+AnswerQuery(UserOptions *options, ResultRecord *rec, long barcodeNumber)
+{
+   if(options->queryType == QueryMessageBarcodeCount)
+      fputs("1\n", stdout);
+   else
+      PrintProperty(rec, options->property, barcodeNumber);
+}
+
+/**
+ * Opens a result file and detects its format.
+ *
+ * @param path       result file ("-" for standard input)
+ * @param input      pointer to new result reader
+ * @return           open stream
+ */
+static FILE *
+OpenResults(char *path, ResultInput **input)
+{
+   FILE *fp;
+
+   fp = (strcmp(path, "-") == 0) ? stdin : fopen(path, "rb");
+   if(fp == NULL)
+      FatalError(EX_IOERR, _("Unable to open \"%s\""), path);
+
+   *input = InputOpen(fp);
+   if(*input == NULL)
+      FatalError(EX_DATAERR, _("\"%s\" is not dmtxread binary, jsonl or xml output"), path);
+
+   return fp;
+}
+
+/**
+ * Reports malformed input and exits.
+ *
+ * @param input      result reader that failed
+ * @param path       result file
+ * @return           void
+ */
+static void
+ReadError(ResultInput *input, char *path)
+{
+   if(InputGetLine(input) > 0)
+      FatalError(EX_DATAERR, _("Malformed result in \"%s\" at line %ld"), path,
+            InputGetLine(input));
+
+   FatalError(EX_DATAERR, _("Corrupt result stream in \"%s\""), path);
+}
+
+/**
+ * Prints one property of a barcode record, or all of them.
+ *
+ * @param rec           barcode record
+ * @param property      BarcodeProperty to print
+ * @param barcodeNumber position of barcode in input (1-based)
+ * @return              void
+ */
+static void
+PrintProperty(ResultRecord *rec, int property, long barcodeNumber)
+{
+   int i;
+   int dataWordLength;
+
+   dataWordLength = dmtxGetSymbolAttribute(DmtxSymAttribSymbolDataWords, rec->sizeIdx);
+
+   if(property == PropMessageAll) {
+      fputs("message: ", stdout);
+      fwrite(rec->message, sizeof(char), rec->messageLength, stdout);
+      fprintf(stdout, "\ndata_codeword: %d\n", dataWordLength - rec->padCount);
+      fprintf(stdout, "error_codeword: %d\n",
+            dmtxGetSymbolAttribute(DmtxSymAttribSymbolErrorWords, rec->sizeIdx));
+      return;
+   }
+
+   if(property == PropAll || property == PropFile) {
+      if(property == PropAll)
+         fputs("file: ", stdout);
+      fwrite(rec->file, sizeof(char), rec->fileLength, stdout);
+      fputc('\n', stdout);
+   }
+
+   if((property == PropAll && rec->member != NULL) || property == PropMember) {
+      if(property == PropAll)
+         fputs("member: ", stdout);
+      if(rec->member != NULL)
+         fwrite(rec->member, sizeof(char), rec->memberLength, stdout);
+      fputc('\n', stdout);
+   }
+
+   if(property == PropAll || property == PropPage)
+      fprintf(stdout, "%s%ld\n", (property == PropAll) ? "page: " : "", rec->pageIndex + 1);
+
+   if(property == PropAll || property == PropMessage) {
+      if(property == PropAll)
+         fputs("message: ", stdout);
+      fwrite(rec->message, sizeof(char), rec->messageLength, stdout);
+      fputc('\n', stdout);
+   }
+
+   if(property == PropAll || property == PropMessageNumber)
+      fprintf(stdout, "%s%ld\n", (property == PropAll) ? "message_number: " : "", barcodeNumber);
+
+   if(property == PropAll || property == PropMessagePosition)
+      fprintf(stdout, "%s1\n", (property == PropAll) ? "message_position: " : "");
+
+   if(property == PropAll || property == PropMatrixSize)
+      fprintf(stdout, "%s%dx%d\n", (property == PropAll) ? "matrix_size: " : "",
+            dmtxGetSymbolAttribute(DmtxSymAttribSymbolRows, rec->sizeIdx),
+            dmtxGetSymbolAttribute(DmtxSymAttribSymbolCols, rec->sizeIdx));
+
+   if(property == PropAll || property == PropDataCodewords)
+      fprintf(stdout, "%s%d\n", (property == PropAll) ? "data_codewords: " : "",
+            dataWordLength - rec->padCount);
+
+   if(property == PropAll || property == PropErrorCodewords)
+      fprintf(stdout, "%s%d\n", (property == PropAll) ? "error_codewords: " : "",
+            dmtxGetSymbolAttribute(DmtxSymAttribSymbolErrorWords, rec->sizeIdx));
+
+   if(property == PropAll || property == PropRotation)
+      fprintf(stdout, "%s%d\n", (property == PropAll) ? "rotation: " : "", rec->rotation);
+
+   if(property == PropAll || property == PropDataRegionsCount)
+      fprintf(stdout, "%s%d\n", (property == PropAll) ? "data_regions_count: " : "",
+            dmtxGetSymbolAttribute(DmtxSymAttribHorizDataRegions, rec->sizeIdx) *
+            dmtxGetSymbolAttribute(DmtxSymAttribVertDataRegions, rec->sizeIdx));
+
+   if(property == PropAll || property == PropInterleavedBlocks)
+      fprintf(stdout, "%s%d\n", (property == PropAll) ? "interleaved_blocks: " : "",
+            dmtxGetSymbolAttribute(DmtxSymAttribInterleavedBlocks, rec->sizeIdx));
+
+   if(property == PropAll || property == PropCorners) {
+      if(property == PropAll)
+         fputs("corners: ", stdout);
+      for(i = 0; i < 4; i++)
+         fprintf(stdout, "%s%0.1f,%0.1f", (i == 0) ? "" : " ",
+               rec->corner[2 * i], rec->corner[2 * i + 1]);
+      fputc('\n', stdout);
+   }
+
+   if(property == PropAll || property == PropTime)
+      fprintf(stdout, "%s%ld\n", (property == PropAll) ? "time_ms: " : "", rec->elapsedMS);
+}
+
+/**
+ * Display program usage and exit with received status.
+ *
+ * @param status error code returned to OS
+ * @return       void
+ */
+static void
+ShowUsage(int status)
+{
+   if(status != 0) {
+      fprintf(stderr, _("Usage: %s PROPERTY [OPTION]... [FILE]...\n"), programName);
+      fprintf(stderr, _("Try `%s --help' for more information.\n"), programName);
+   }
+   else {
+      fprintf(stderr, _("Usage: %s PROPERTY [OPTION]... [FILE]...\n"), programName);
+      fprintf(stderr, _("\
+Extract information from the binary, jsonl or xml output of dmtxread for\n\
+individual or grouped barcode scan results. FILE is read from standard input\n\
+if omitted.\n\
+\n\
+Example: dmtxread --output-format=xml barcode.png | %s barcode.count\n\
+Example: %s barcode.2.rotation scanresults.jsonl\n\
+Example: %s -i serials.idx --message=SN0042 barcode.1\n\
+Example: %s --where=size=16x16 stats.time_ms nightly/*.jsonl\n\
+Example: %s --manifest=serials.txt reconcile.missing lot42/*.bin\n\
+Example: %s compare.summary before.idx after.idx\n\
+Example: dmtxread --output-format=jsonl --watch=in | %s --follow window\n\
+\n\
+PROPERTY:\n"), programName, programName, programName, programName, programName,
+            programName, programName);
+      fprintf(stderr, _("\
+   barcode.count             count of all barcodes found in image\n\
+   barcode.N                 print all properties of Nth barcode\n\
+   barcode.N.BPROP           print BPROP property of Nth barcode\n\
+\n\
+   message.count             count of all messages found in image\n\
+   message.N                 print all properties of Nth message\n\
+   message.N.MPROP           print MPROP property of Nth message\n\
+   message.N.barcode.count   count of all barcodes in Nth message\n\
+   message.N.barcode.M       Mth barcode of Nth message, print all\n\
+   message.N.barcode.M.BPROP Mth barcode of Nth message, print BPROP\n\
+\n\
+   BPROP barcode properties:\n\
+      message             message_number      message_position\n\
+      matrix_size         data_codewords      error_codewords\n\
+      rotation            data_regions_count  interleaved_blocks\n\
+      file                member              page\n\
+      corners             time_ms\n\
+\n\
+   MPROP message properties:\n\
+      message             data_codeword       error_codeword\n\
+\n\
+   stats                     summary statistics of all barcodes\n\
+   stats.SECTION             print one SECTION of the statistics\n\
+\n\
+   SECTION statistics sections:\n\
+      count               matrix_size         rotation\n\
+      time_ms             file\n\
+\n\
+   compare                   list barcodes lost or gained by FILE B over FILE A\n\
+   compare.images            only the lost and gained barcodes\n\
+   compare.summary           only the totals, recall and time percentiles\n\
+\n\
+   window                    rates over the last seconds of barcodes read,\n\
+                             with --follow\n\
+\n\
+   reconcile                 list missing, duplicate and unexpected codes\n\
+   reconcile.SECTION         print one SECTION of the reconciliation\n\
+\n\
+   SECTION reconciliation sections:\n\
+      missing             duplicate           unexpected\n\
+      summary\n\
 \n\
 OPTIONS:\n\
+  -i, --index=INDEX          answer from INDEX, first adding any FILEs to it\n\
+      --message=TEXT         only barcodes whose message is TEXT\n\
+      --file=NAME            only barcodes found in image NAME\n\
+      --page=N[-M]           only barcodes on pages N to M (N- for N onward)\n\
+      --where=EXPR           only barcodes where EXPR holds, e.g. rotation>45\n\
+  -j, --threads=N            gather stats in N threads (default: one per CPU)\n\
+  -f, --follow               keep reading FILE as it grows, printing the window\n\
+                             every --interval seconds (required by window)\n\
+      --window-seconds=N     window covers the last N seconds (default: 60)\n\
+      --interval=N           seconds between --follow reports (default: 10)\n\
+      --manifest=FILE        reconcile against expected codes in FILE\n\
+      --memory=SIZE          join in SIZE bytes (K, M, G or T suffix, at least\n\
+                             1M) before spilling to disk (default: 256M)\n\
   -V, --version              print program version information\n\
       --help                 display this help and exit\n"));
       fprintf(stderr, _("\nReport bugs to <mike@dragonflylogic.com>.\n"));
-      fprintf(stderr, "\n\
-***************************************************************\n\
-**** This program currently does nothing besides printing  ****\n\
-**** this help screen. This program is just a placeholder. ****\n\
-***************************************************************\n\n");
    }
 
    exit(status);
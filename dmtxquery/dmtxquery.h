@@ -31,12 +31,178 @@ Contact: mike@dragonflylogic.com
 #endif
 #define N_(String) String
 
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_LIBPTHREAD)
+#include <pthread.h>
+#define DMTXQUERY_THREADS
+#endif
+
+/* Exit status when the requested barcode does not exist */
+#define EX_NOTFOUND 1
+
+/* Most threads --threads accepts */
+#define DMTXQUERY_THREADS_MAX 256
+
+/* Defaults for the window property */
+#define DMTXQUERY_WINDOW_SECONDS 60
+#define DMTXQUERY_INTERVAL       10
+
+/* Jsonl files larger than this are split between threads */
+#define DMTXQUERY_CHUNK_SIZE (32L * 1024 * 1024)
+
+/* Long options without a single character equivalent */
+enum {
+   OptMessage = 256,
+   OptFile,
+   OptPage,
+   OptWhere,
+   OptManifest,
+   OptMemory,
+   OptWindowSeconds,
+   OptInterval
+};
+
+typedef enum {
+   QueryBarcodeCount,
+   QueryBarcodeProperty,
+   QueryMessageCount,
+   QueryMessageProperty,
+   QueryMessageBarcodeCount,
+   QueryAggregate,
+   QueryReconcile,
+   QueryCompare,
+   QueryWindow
+} QueryType;
+
+typedef enum {
+   PropAll,
+   PropMessage,
+   PropMatrixSize,
+   PropDataCodewords,
+   PropErrorCodewords,
+   PropRotation,
+   PropDataRegionsCount,
+   PropInterleavedBlocks,
+   PropFile,
+   PropMember,
+   PropPage,
+   PropCorners,
+   PropTime,
+   PropMessageNumber,
+   PropMessagePosition,
+   PropMessageAll
+} BarcodeProperty;
+
 typedef struct {
-   int placeHolder;
+   int queryType;       /* QueryType */
+   long messageIndex;   /* N in message.N (1-based) */
+   long barcodeIndex;   /* N in barcode.N, or M in message.N.barcode.M */
+   int property;        /* BarcodeProperty, or StatsSection, JoinSection, CompareSection */
+   int threads;         /* threads gathering stats */
+   char *manifestPath;  /* expected codes for reconcile */
+   size_t joinMemory;   /* bytes for one in-memory join before spilling */
+   DmtxBoolean follow;  /* keep reading as the result file grows */
+   int windowSeconds;   /* length of the window property's window */
+   int interval;        /* seconds between window reports with --follow */
+   char *indexPath;     /* answer from this index, or NULL to read files */
+   IndexFilter filter;  /* barcodes selected by --message, --file, --page, --where */
 } UserOptions;
 
+/* Share of the input gathered by one stats thread at a time */
+typedef struct {
+   int fileIndex;       /* result file, or DmtxUndefined for an index segment */
+   long start;          /* byte range of a split jsonl file */
+   long end;            /* DmtxUndefined to read the whole file */
+   unsigned long segment;
+} StatsTask;
+
+/* Stats work shared by all threads */
+typedef struct {
+   UserOptions *options;
+   char **files;
+   ResultIndex *index;
+   StatsTask *tasks;
+   int taskCount;
+   int nextTask;
+#ifdef DMTXQUERY_THREADS
+   pthread_mutex_t lock;
+#endif
+} StatsJob;
+
+typedef struct {
+   StatsJob *job;
+   QueryStats *stats;
+#ifdef DMTXQUERY_THREADS
+   pthread_t thread;
+#endif
+} StatsWorker;
+
+/* One run being compared, read in file and page order */
+typedef struct {
+   char *path;
+   FILE *fp;            /* result file, or NULL for an index */
+   ResultInput *input;
+   ResultIndex *index;
+   IndexCursor *cursor;
+   ResultRecord rec;    /* next barcode, valid until the side is read again */
+   DmtxBoolean more;    /* rec holds a barcode */
+} CompareSide;
+
+/* Window counted by the --follow reader and printed by the report thread */
+typedef struct {
+   UserOptions *options;
+   ResultWindow *window;
+   time_t nextReport;
+   DmtxBoolean done;
+#ifdef DMTXQUERY_THREADS
+   pthread_mutex_t lock;
+   pthread_cond_t wake;
+#endif
+} WindowJob;
+
 static void SetOptionDefaults(UserOptions *options);
-static DmtxPassFail HandleArgs(UserOptions *options, int *argcp, char **argvp[]);
+static DmtxPassFail HandleArgs(UserOptions *options, int *fileIndex, int *argcp, char **argvp[]);
+static DmtxPassFail ParseProperty(UserOptions *options, char *query);
+static DmtxPassFail ParseIndex(char **ptr, long *index);
+static DmtxPassFail ParseName(char *name, int *property, DmtxBoolean messageProp);
 static void ShowUsage(int status);
+static DmtxPassFail ParsePageRange(IndexFilter *filter, char *range);
+static DmtxPassFail ParseStatsSection(char *name, int *section);
+static DmtxPassFail ParseJoinSection(char *name, int *section);
+static DmtxPassFail ParseCompareSection(char *name, int *section);
+static DmtxPassFail AddPredicate(IndexFilter *filter, char *expr);
+static int GetDefaultThreads(void);
+static int RunQuery(UserOptions *options, char **files, int fileCount);
+static int RunIndexQuery(UserOptions *options);
+static int RunStats(UserOptions *options, char **files, int fileCount);
+static DmtxPassFail AddFileTasks(StatsJob *job, int fileIndex);
+static DmtxPassFail AddTask(StatsJob *job, int fileIndex, long start, long end,
+      unsigned long segment);
+static void *GatherStats(void *arg);
+static void RunStatsTask(StatsJob *job, StatsTask *task, QueryStats *stats);
+static int RunReconcile(UserOptions *options, char **files, int fileCount);
+static void ReconcilePart(UserOptions *options, FILE *manifest, char **files, int fileCount,
+      FILE *results, int depth, JoinCounts *counts);
+static void ReconcileResults(UserOptions *options, char **files, int fileCount, FILE *results,
+      ManifestTable *table, FILE **parts, int depth, JoinCounts *counts);
+static void ReconcileRecord(UserOptions *options, ResultRecord *rec, ManifestTable *table,
+      FILE **parts, int depth, JoinCounts *counts);
+static int RunCompare(UserOptions *options, char **files, int fileCount);
+static void OpenCompareSide(UserOptions *options, CompareSide *side, char *path);
+static void ReadCompareSide(UserOptions *options, CompareSide *side);
+static void FillCompareGroup(UserOptions *options, CompareSide *side, CompareGroup *group);
+static void CloseCompareSide(CompareSide *side);
+static int RunWindow(UserOptions *options, char **files, int fileCount);
+static void ReadWindowFile(WindowJob *job, char *path);
+static void AddToWindow(WindowJob *job, ResultRecord *rec);
+static void WaitForResults(WindowJob *job);
+static void PrintDueReport(WindowJob *job, time_t now);
+static void *ReportWindow(void *arg);
+static void UpdateIndex(UserOptions *options, char **files, int fileCount);
+static long GetTarget(UserOptions *options);
+static int FinishQuery(UserOptions *options, long barcodeCount);
+static void AnswerQuery(UserOptions *options, ResultRecord *rec, long barcodeNumber);
+static FILE *OpenResults(char *path, ResultInput **input);
+static void ReadError(ResultInput *input, char *path);
+static void PrintProperty(ResultRecord *rec, int property, long barcodeNumber);
 
 #endif
@@ -0,0 +1,453 @@
+/*
+libdmtx - Data Matrix Encoding/Decoding Library
+
+Copyright (C) 2008, 2009 Mike Laughton
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+Contact: mike@dragonflylogic.com
+*/
+
+/**
+ * @file dmtxstats.c
+ * @brief Mergeable aggregate statistics over barcode records
+ *
+ * Every statistic is kept as counts that add up, so each thread can
+ * gather its own share of the input and the shares are merged at the
+ * end in any order. Decode times are counted per millisecond, which
+ * gives exact percentiles without keeping the times themselves.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <dmtx.h>
+#include "../common/dmtxutil.h"
+#include "../common/dmtxrecord.h"
+#include "dmtxstats.h"
+
+#define STATS_SIZE_COUNT     (DmtxSymbolSquareCount + DmtxSymbolRectCount)
+#define STATS_ROTATION_COUNT (360 / STATS_ROTATION_STEP)
+
+/* Per-file totals, in an open addressing table keyed on file name */
+typedef struct {
+   unsigned long nameOffset;   /* offset + 1 into names, 0 for an empty slot */
+   unsigned long nameLength;
+   long barcodes;
+   long lastPage;              /* highest 0-based page with a barcode */
+   long lastMS;                /* latest barcode time */
+} StatsFileEntry;
+
+struct QueryStats_struct {
+   long barcodes;
+   long sizeCount[STATS_SIZE_COUNT];
+   long rotationCount[STATS_ROTATION_COUNT];
+   long *timeCount;            /* STATS_TIME_BUCKETS, then one for longer times */
+   long timeMin;
+   long timeMax;
+   double timeSum;
+   StatsFileEntry *files;
+   unsigned long fileSlots;
+   unsigned long fileCount;
+   char *names;
+   size_t namesSize;
+   size_t namesLength;
+};
+
+static StatsFileEntry *FindFile(QueryStats *stats, const char *name, unsigned long length);
+static DmtxPassFail GrowFiles(QueryStats *stats);
+static unsigned long HashName(const char *name, unsigned long length);
+static long GetPercentile(QueryStats *stats, double percent);
+static int CompareFiles(const void *a, const void *b);
+
+/* Statistics being sorted, as qsort() passes no context to comparisons */
+static QueryStats *sortStats;
+
+/**
+ * @brief  Create empty statistics
+ * @return Address of new statistics, or NULL if out of memory
+ */
+extern QueryStats *
+StatsCreate(void)
+{
+   QueryStats *stats;
+
+   stats = (QueryStats *)calloc(1, sizeof(QueryStats));
+   if(stats == NULL)
+      return NULL;
+
+   stats->timeCount = (long *)calloc(STATS_TIME_BUCKETS + 1, sizeof(long));
+   if(stats->timeCount == NULL) {
+      free(stats);
+      return NULL;
+   }
+
+   return stats;
+}
+
+/**
+ * @brief  Free statistics
+ * @param  stats pointer to statistics pointer
+ * @return void
+ */
+extern void
+StatsDestroy(QueryStats **stats)
+{
+   if(stats == NULL || *stats == NULL)
+      return;
+
+   free((*stats)->timeCount);
+   free((*stats)->files);
+   free((*stats)->names);
+   free(*stats);
+
+   *stats = NULL;
+}
+
+/**
+ * @brief  Count one barcode
+ * @param  stats statistics
+ * @param  rec barcode record
+ * @return DmtxPass | DmtxFail (out of memory)
+ */
+extern DmtxPassFail
+StatsAdd(QueryStats *stats, const ResultRecord *rec)
+{
+   long elapsedMS;
+   StatsFileEntry *file;
+
+   file = FindFile(stats, rec->file, (unsigned long)rec->fileLength);
+   if(file == NULL)
+      return DmtxFail;
+
+   elapsedMS = (rec->elapsedMS < 0) ? 0 : rec->elapsedMS;
+
+   file->barcodes++;
+   if(rec->pageIndex > file->lastPage)
+      file->lastPage = rec->pageIndex;
+   if(elapsedMS > file->lastMS)
+      file->lastMS = elapsedMS;
+
+   if(rec->sizeIdx >= 0 && rec->sizeIdx < STATS_SIZE_COUNT)
+      stats->sizeCount[rec->sizeIdx]++;
+
+   stats->rotationCount[(((rec->rotation % 360) + 360) % 360) / STATS_ROTATION_STEP]++;
+
+   stats->timeCount[(elapsedMS < STATS_TIME_BUCKETS) ? elapsedMS : STATS_TIME_BUCKETS]++;
+   if(stats->barcodes == 0 || elapsedMS < stats->timeMin)
+      stats->timeMin = elapsedMS;
+   if(elapsedMS > stats->timeMax)
+      stats->timeMax = elapsedMS;
+   stats->timeSum += elapsedMS;
+
+   stats->barcodes++;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Add one set of statistics into another
+ * @param  dst statistics receiving the totals
+ * @param  src statistics to add
+ * @return DmtxPass | DmtxFail (out of memory)
+ */
+extern DmtxPassFail
+StatsMerge(QueryStats *dst, const QueryStats *src)
+{
+   int i;
+   unsigned long j;
+   StatsFileEntry *srcFile, *dstFile;
+
+   if(src->barcodes == 0)
+      return DmtxPass;
+
+   for(j = 0; j < src->fileSlots; j++) {
+      srcFile = &(src->files[j]);
+      if(srcFile->nameOffset == 0)
+         continue;
+
+      dstFile = FindFile(dst, src->names + srcFile->nameOffset - 1, srcFile->nameLength);
+      if(dstFile == NULL)
+         return DmtxFail;
+
+      dstFile->barcodes += srcFile->barcodes;
+      if(srcFile->lastPage > dstFile->lastPage)
+         dstFile->lastPage = srcFile->lastPage;
+      if(srcFile->lastMS > dstFile->lastMS)
+         dstFile->lastMS = srcFile->lastMS;
+   }
+
+   for(i = 0; i < STATS_SIZE_COUNT; i++)
+      dst->sizeCount[i] += src->sizeCount[i];
+
+   for(i = 0; i < STATS_ROTATION_COUNT; i++)
+      dst->rotationCount[i] += src->rotationCount[i];
+
+   for(i = 0; i <= STATS_TIME_BUCKETS; i++)
+      dst->timeCount[i] += src->timeCount[i];
+
+   if(dst->barcodes == 0 || src->timeMin < dst->timeMin)
+      dst->timeMin = src->timeMin;
+   if(src->timeMax > dst->timeMax)
+      dst->timeMax = src->timeMax;
+   dst->timeSum += src->timeSum;
+
+   dst->barcodes += src->barcodes;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Print a report
+ * @param  stats statistics
+ * @param  fp output stream
+ * @param  section StatsSection to print (StatsAll prints all but the
+ *         per-file table)
+ * @return DmtxPass | DmtxFail (out of memory)
+ */
+extern DmtxPassFail
+StatsPrint(QueryStats *stats, FILE *fp, int section)
+{
+   int i;
+   unsigned long j, k;
+   unsigned long *order;
+   long percentile;
+   StatsFileEntry *file;
+   static const struct {
+      const char *name;
+      double percent;
+   } percentiles[] = {
+         { "p50",   50.0 },
+         { "p90",   90.0 },
+         { "p95",   95.0 },
+         { "p99",   99.0 },
+         { "p99.9", 99.9 }
+   };
+
+   if(section == StatsAll || section == StatsCount) {
+      fprintf(fp, "count: %ld\n", stats->barcodes);
+      fprintf(fp, "files: %lu\n", stats->fileCount);
+   }
+
+   if(section == StatsAll || section == StatsMatrixSize) {
+      for(i = 0; i < STATS_SIZE_COUNT; i++) {
+         if(stats->sizeCount[i] > 0)
+            fprintf(fp, "matrix_size %dx%d: %ld\n",
+                  dmtxGetSymbolAttribute(DmtxSymAttribSymbolRows, i),
+                  dmtxGetSymbolAttribute(DmtxSymAttribSymbolCols, i), stats->sizeCount[i]);
+      }
+   }
+
+   if(section == StatsAll || section == StatsRotation) {
+      for(i = 0; i < STATS_ROTATION_COUNT; i++)
+         fprintf(fp, "rotation %d-%d: %ld\n", i * STATS_ROTATION_STEP,
+               (i + 1) * STATS_ROTATION_STEP - 1, stats->rotationCount[i]);
+   }
+
+   if((section == StatsAll || section == StatsTime) && stats->barcodes > 0) {
+      fprintf(fp, "time_ms min: %ld\n", stats->timeMin);
+      fprintf(fp, "time_ms mean: %.1f\n", stats->timeSum / stats->barcodes);
+      for(i = 0; i < (int)(sizeof(percentiles) / sizeof(percentiles[0])); i++) {
+         percentile = GetPercentile(stats, percentiles[i].percent);
+         if(percentile < STATS_TIME_BUCKETS)
+            fprintf(fp, "time_ms %s: %ld\n", percentiles[i].name, percentile);
+         else
+            fprintf(fp, "time_ms %s: >%d\n", percentiles[i].name, STATS_TIME_BUCKETS - 1);
+      }
+      fprintf(fp, "time_ms max: %ld\n", stats->timeMax);
+   }
+
+   if(section != StatsFile)
+      return DmtxPass;
+
+   /* One line per file, in name order */
+   order = (unsigned long *)malloc((stats->fileCount + 1) * sizeof(unsigned long));
+   if(order == NULL)
+      return DmtxFail;
+
+   for(j = k = 0; j < stats->fileSlots; j++) {
+      if(stats->files[j].nameOffset != 0)
+         order[k++] = j;
+   }
+
+   sortStats = stats;
+   qsort(order, k, sizeof(unsigned long), CompareFiles);
+
+   fputs("file\tbarcodes\tpages\ttime_ms\tbarcodes_per_s\n", fp);
+   for(j = 0; j < k; j++) {
+      file = &(stats->files[order[j]]);
+      fwrite(stats->names + file->nameOffset - 1, 1, file->nameLength, fp);
+      fprintf(fp, "\t%ld\t%ld\t%ld\t", file->barcodes, file->lastPage + 1, file->lastMS);
+      if(file->lastMS > 0)
+         fprintf(fp, "%.1f\n", file->barcodes * 1000.0 / file->lastMS);
+      else
+         fputs("-\n", fp);
+   }
+
+   free(order);
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Find or add the totals of one file
+ * @param  stats statistics
+ * @param  name file name
+ * @param  length name length
+ * @return Address of file totals, or NULL if out of memory
+ */
+static StatsFileEntry *
+FindFile(QueryStats *stats, const char *name, unsigned long length)
+{
+   unsigned long slot;
+   size_t newSize;
+   char *newNames;
+   StatsFileEntry *file;
+
+   if(2 * (stats->fileCount + 1) > stats->fileSlots && GrowFiles(stats) != DmtxPass)
+      return NULL;
+
+   slot = HashName(name, length) & (stats->fileSlots - 1);
+   for(;;) {
+      file = &(stats->files[slot]);
+      if(file->nameOffset == 0)
+         break;
+      if(file->nameLength == length &&
+            memcmp(stats->names + file->nameOffset - 1, name, length) == 0)
+         return file;
+      slot = (slot + 1) & (stats->fileSlots - 1);
+   }
+
+   if(stats->namesLength + length > stats->namesSize) {
+      newSize = (stats->namesSize == 0) ? 65536 : stats->namesSize;
+      while(newSize < stats->namesLength + length)
+         newSize *= 2;
+      newNames = (char *)realloc(stats->names, newSize);
+      if(newNames == NULL)
+         return NULL;
+      stats->names = newNames;
+      stats->namesSize = newSize;
+   }
+
+   memcpy(stats->names + stats->namesLength, name, length);
+   file->nameOffset = stats->namesLength + 1;
+   file->nameLength = length;
+   file->lastPage = -1;
+   stats->namesLength += length;
+   stats->fileCount++;
+
+   return file;
+}
+
+/**
+ * @brief  Double the per-file table
+ * @param  stats statistics
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+GrowFiles(QueryStats *stats)
+{
+   unsigned long i, slot, slotCount;
+   StatsFileEntry *files;
+
+   slotCount = (stats->fileSlots == 0) ? 1024 : stats->fileSlots * 2;
+   files = (StatsFileEntry *)calloc(slotCount, sizeof(StatsFileEntry));
+   if(files == NULL)
+      return DmtxFail;
+
+   for(i = 0; i < stats->fileSlots; i++) {
+      if(stats->files[i].nameOffset == 0)
+         continue;
+      slot = HashName(stats->names + stats->files[i].nameOffset - 1,
+            stats->files[i].nameLength) & (slotCount - 1);
+      while(files[slot].nameOffset != 0)
+         slot = (slot + 1) & (slotCount - 1);
+      files[slot] = stats->files[i];
+   }
+
+   free(stats->files);
+   stats->files = files;
+   stats->fileSlots = slotCount;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  32-bit FNV-1a hash of a name
+ * @param  name name bytes
+ * @param  length byte count
+ * @return Hash value
+ */
+static unsigned long
+HashName(const char *name, unsigned long length)
+{
+   unsigned long i, hash;
+
+   hash = 2166136261UL;
+   for(i = 0; i < length; i++) {
+      hash ^= (unsigned char)name[i];
+      hash = (hash * 16777619UL) & 0xffffffffUL;
+   }
+
+   return hash;
+}
+
+/**
+ * @brief  Nearest-rank percentile of barcode times
+ * @param  stats statistics with at least one barcode
+ * @param  percent percentile wanted (0-100)
+ * @return Time in milliseconds, or STATS_TIME_BUCKETS if longer
+ */
+static long
+GetPercentile(QueryStats *stats, double percent)
+{
+   long i, rank, seen;
+
+   rank = (long)(percent / 100.0 * stats->barcodes + 0.999999);
+   if(rank < 1)
+      rank = 1;
+
+   for(i = 0, seen = 0; i < STATS_TIME_BUCKETS; i++) {
+      seen += stats->timeCount[i];
+      if(seen >= rank)
+         return i;
+   }
+
+   return STATS_TIME_BUCKETS;
+}
+
+/**
+ * @brief  qsort() comparison of file table slots by name
+ * @param  a first slot number
+ * @param  b second slot number
+ * @return Negative, zero or positive
+ */
+static int
+CompareFiles(const void *a, const void *b)
+{
+   int cmp;
+   const StatsFileEntry *fileA, *fileB;
+
+   fileA = &(sortStats->files[*(const unsigned long *)a]);
+   fileB = &(sortStats->files[*(const unsigned long *)b]);
+
+   cmp = memcmp(sortStats->names + fileA->nameOffset - 1, sortStats->names + fileB->nameOffset - 1,
+         (fileA->nameLength < fileB->nameLength) ? fileA->nameLength : fileB->nameLength);
+   if(cmp != 0)
+      return cmp;
+
+   return (fileA->nameLength < fileB->nameLength) ? -1 :
+         (fileA->nameLength > fileB->nameLength) ? 1 : 0;
+}
@@ -0,0 +1,52 @@
+/*
+libdmtx - Data Matrix Encoding/Decoding Library
+
+Copyright (C) 2008, 2009 Mike Laughton
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+Contact: mike@dragonflylogic.com
+*/
+
+#ifndef __DMTXSTATS_H__
+#define __DMTXSTATS_H__
+
+#include <stdio.h>
+
+/* Times up to this many milliseconds get exact percentiles */
+#define STATS_TIME_BUCKETS  65536
+
+/* Width of rotation histogram bins in degrees */
+#define STATS_ROTATION_STEP 15
+
+/* Report sections, selected by stats.SECTION */
+typedef enum {
+   StatsAll,
+   StatsCount,
+   StatsMatrixSize,
+   StatsRotation,
+   StatsTime,
+   StatsFile
+} StatsSection;
+
+typedef struct QueryStats_struct QueryStats;
+
+extern QueryStats *StatsCreate(void);
+extern void StatsDestroy(QueryStats **stats);
+extern DmtxPassFail StatsAdd(QueryStats *stats, const ResultRecord *rec);
+extern DmtxPassFail StatsMerge(QueryStats *dst, const QueryStats *src);
+extern DmtxPassFail StatsPrint(QueryStats *stats, FILE *fp, int section);
+
+#endif
@@ -0,0 +1,415 @@
+/*
+libdmtx - Data Matrix Encoding/Decoding Library
+
+Copyright (C) 2008, 2009 Mike Laughton
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+Contact: mike@dragonflylogic.com
+*/
+
+/**
+ * @file dmtxwindow.c
+ * @brief Sliding-window rates over barcodes as they arrive
+ *
+ * Barcodes are counted into one slot per second of arrival, kept in a
+ * ring as long as the window, so a report only sums the ring and old
+ * seconds fall out without any work. Recently seen messages and files
+ * are remembered by hash, and forgotten once they leave the window, to
+ * spot duplicates and pages that yielded nothing.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <dmtx.h>
+#include "../common/dmtxutil.h"
+#include "../common/dmtxrecord.h"
+#include "dmtxwindow.h"
+
+/* Barcodes that arrived in one second */
+typedef struct {
+   time_t second;             /* second counted here, or 0 for none */
+   long barcodes;
+   long pages;                /* pages reached, including skipped ones */
+   long skipped;              /* pages passed over without a barcode */
+   long duplicates;           /* barcodes whose message was seen within the window */
+   long latency[WINDOW_LATENCY_BINS];
+} WindowSlot;
+
+/* Message or file seen recently, keyed by a 64-bit hash of its name */
+typedef struct {
+   unsigned long key[2];
+   time_t second;             /* last seen, or 0 for an empty slot */
+   long value;                /* highest page, for files */
+} RecentEntry;
+
+typedef struct {
+   RecentEntry *entries;
+   unsigned long slots;
+   unsigned long count;
+} RecentTable;
+
+struct ResultWindow_struct {
+   int seconds;
+   WindowSlot *slots;
+   RecentTable messages;
+   RecentTable files;
+   time_t first;              /* arrival of first barcode */
+};
+
+static WindowSlot *GetSlot(ResultWindow *window, time_t now);
+static RecentEntry *FindRecent(RecentTable *table, const unsigned char *name, long length,
+      const unsigned char *suffix, long suffixLength, time_t horizon);
+static DmtxPassFail PruneRecent(RecentTable *table, time_t horizon);
+static int GetLatencyBin(long ms);
+static long GetBinLimit(int bin);
+static long GetPercentile(const long *latency, long total, double percent);
+
+/**
+ * @brief  Create an empty window
+ * @param  seconds window length
+ * @return Address of new window, or NULL if out of memory
+ */
+extern ResultWindow *
+WindowCreate(int seconds)
+{
+   ResultWindow *window;
+
+   window = (ResultWindow *)calloc(1, sizeof(ResultWindow));
+   if(window == NULL)
+      return NULL;
+
+   window->seconds = seconds;
+   window->slots = (WindowSlot *)calloc(seconds, sizeof(WindowSlot));
+   if(window->slots == NULL) {
+      free(window);
+      return NULL;
+   }
+
+   return window;
+}
+
+/**
+ * @brief  Free a window
+ * @param  window pointer to window pointer
+ * @return void
+ */
+extern void
+WindowDestroy(ResultWindow **window)
+{
+   if(window == NULL || *window == NULL)
+      return;
+
+   free((*window)->slots);
+   free((*window)->messages.entries);
+   free((*window)->files.entries);
+   free(*window);
+
+   *window = NULL;
+}
+
+/**
+ * @brief  Count one barcode arriving now
+ *
+ * Pages are counted per file from the highest page seen: reaching page
+ * N of a file for the first time adds N + 1 pages, of which those
+ * without a barcode count as skipped.
+ *
+ * @param  window sliding window
+ * @param  rec barcode record
+ * @param  now arrival time
+ * @return DmtxPass | DmtxFail (out of memory)
+ */
+extern DmtxPassFail
+WindowAdd(ResultWindow *window, const ResultRecord *rec, time_t now)
+{
+   time_t horizon;
+   WindowSlot *slot;
+   RecentEntry *entry;
+
+   if(window->first == 0)
+      window->first = now;
+
+   horizon = now - window->seconds;
+   slot = GetSlot(window, now);
+
+   slot->barcodes++;
+   slot->latency[GetLatencyBin(rec->elapsedMS)]++;
+
+   entry = FindRecent(&(window->messages), rec->message, rec->messageLength, NULL, 0, horizon);
+   if(entry == NULL)
+      return DmtxFail;
+   if(entry->second > horizon)
+      slot->duplicates++;
+   entry->second = now;
+
+   entry = FindRecent(&(window->files), (const unsigned char *)rec->file, rec->fileLength,
+         (const unsigned char *)rec->member, (rec->member == NULL) ? 0 : rec->memberLength,
+         horizon);
+   if(entry == NULL)
+      return DmtxFail;
+   if(entry->second == 0)
+      entry->value = -1;
+   if(rec->pageIndex > entry->value) {
+      slot->pages += rec->pageIndex - entry->value;
+      slot->skipped += rec->pageIndex - entry->value - 1;
+      entry->value = rec->pageIndex;
+   }
+   entry->second = now;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Print the column names of WindowPrint() lines
+ * @param  fp output stream
+ * @return void
+ */
+extern void
+WindowPrintHeader(FILE *fp)
+{
+   fputs("time\twindow_s\tbarcodes\tbarcodes_per_s\tpages\tno_read_rate\t"
+         "duplicate_rate\tp50_ms\tp99_ms\n", fp);
+}
+
+/**
+ * @brief  Print one tab-separated line for the window ending now
+ *
+ * Rates are taken over the part of the window since the first barcode,
+ * so they are meaningful before a full window has passed.
+ *
+ * @param  window sliding window
+ * @param  fp output stream
+ * @param  now end of window
+ * @return void
+ */
+extern void
+WindowPrint(ResultWindow *window, FILE *fp, time_t now)
+{
+   int i, bin;
+   long span;
+   long barcodes, pages, skipped, duplicates;
+   long latency[WINDOW_LATENCY_BINS];
+   WindowSlot *slot;
+
+   barcodes = pages = skipped = duplicates = 0;
+   memset(latency, 0x00, sizeof(latency));
+
+   for(i = 0; i < window->seconds; i++) {
+      slot = &(window->slots[i]);
+      if(slot->second == 0 || slot->second <= now - window->seconds || slot->second > now)
+         continue;
+
+      barcodes += slot->barcodes;
+      pages += slot->pages;
+      skipped += slot->skipped;
+      duplicates += slot->duplicates;
+      for(bin = 0; bin < WINDOW_LATENCY_BINS; bin++)
+         latency[bin] += slot->latency[bin];
+   }
+
+   span = (window->first == 0) ? window->seconds : (long)(now - window->first) + 1;
+   if(span > window->seconds)
+      span = window->seconds;
+
+   fprintf(fp, "%ld\t%d\t%ld\t%.1f\t%ld\t%.4f\t%.4f\t", (long)now, window->seconds, barcodes,
+         (double)barcodes / span, pages, (pages > 0) ? (double)skipped / pages : 0.0,
+         (barcodes > 0) ? (double)duplicates / barcodes : 0.0);
+
+   if(barcodes > 0)
+      fprintf(fp, "%ld\t%ld\n", GetPercentile(latency, barcodes, 50.0),
+            GetPercentile(latency, barcodes, 99.0));
+   else
+      fputs("-\t-\n", fp);
+}
+
+/**
+ * @brief  Find the slot of a second, clearing it if it held an older one
+ * @param  window sliding window
+ * @param  now second wanted
+ * @return Slot
+ */
+static WindowSlot *
+GetSlot(ResultWindow *window, time_t now)
+{
+   WindowSlot *slot;
+
+   slot = &(window->slots[(unsigned long)now % window->seconds]);
+   if(slot->second != now) {
+      memset(slot, 0x00, sizeof(WindowSlot));
+      slot->second = now;
+   }
+
+   return slot;
+}
+
+/**
+ * @brief  Find or add the entry of a name (and optional suffix, such as
+ *         an archive member)
+ * @param  table recent names
+ * @param  name name bytes
+ * @param  length name length
+ * @param  suffix more bytes of the key, or NULL
+ * @param  suffixLength suffix length
+ * @param  horizon entries last seen at or before this are forgotten when
+ *         the table fills
+ * @return Entry, with second 0 if new, or NULL if out of memory
+ */
+static RecentEntry *
+FindRecent(RecentTable *table, const unsigned char *name, long length,
+      const unsigned char *suffix, long suffixLength, time_t horizon)
+{
+   long i;
+   unsigned long key[2], slot;
+   RecentEntry *entry;
+
+   /* Two independent FNV-1a hashes make collisions negligible */
+   key[0] = 2166136261UL;
+   key[1] = 2166136261UL ^ 0x5bd1e995UL;
+   for(i = 0; i < length + suffixLength; i++) {
+      key[0] ^= (i < length) ? name[i] : suffix[i - length];
+      key[0] = (key[0] * 16777619UL) & 0xffffffffUL;
+      key[1] ^= (i < length) ? name[i] : suffix[i - length];
+      key[1] = ((key[1] * 16777619UL) ^ (key[1] >> 15)) & 0xffffffffUL;
+   }
+
+   if(2 * (table->count + 1) > table->slots && PruneRecent(table, horizon) != DmtxPass)
+      return NULL;
+
+   for(slot = key[0] & (table->slots - 1);; slot = (slot + 1) & (table->slots - 1)) {
+      entry = &(table->entries[slot]);
+      if(entry->second == 0)
+         break;
+      if(entry->key[0] == key[0] && entry->key[1] == key[1])
+         return entry;
+   }
+
+   entry->key[0] = key[0];
+   entry->key[1] = key[1];
+   table->count++;
+
+   return entry;
+}
+
+/**
+ * @brief  Rebuild a full table without the entries that left the window,
+ *         growing it if it is still more than a quarter full
+ * @param  table recent names
+ * @param  horizon entries last seen at or before this are dropped
+ * @return DmtxPass | DmtxFail (out of memory)
+ */
+static DmtxPassFail
+PruneRecent(RecentTable *table, time_t horizon)
+{
+   unsigned long i, slot, slots, count;
+   RecentEntry *entries;
+
+   count = 0;
+   for(i = 0; i < table->slots; i++) {
+      if(table->entries[i].second > horizon)
+         count++;
+   }
+
+   for(slots = 1024; slots < 4 * (count + 1); slots *= 2)
+      ;
+
+   entries = (RecentEntry *)calloc(slots, sizeof(RecentEntry));
+   if(entries == NULL)
+      return DmtxFail;
+
+   for(i = 0; i < table->slots; i++) {
+      if(table->entries[i].second <= horizon)
+         continue;
+
+      slot = table->entries[i].key[0] & (slots - 1);
+      while(entries[slot].second != 0)
+         slot = (slot + 1) & (slots - 1);
+      entries[slot] = table->entries[i];
+   }
+
+   free(table->entries);
+   table->entries = entries;
+   table->slots = slots;
+   table->count = count;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Latency bin of a time
+ * @param  ms milliseconds
+ * @return Bin, 0 to WINDOW_LATENCY_BINS - 1
+ */
+static int
+GetLatencyBin(long ms)
+{
+   int bin, e;
+
+   if(ms < 64)
+      return (ms < 0) ? 0 : (int)ms;
+
+   for(e = 6; e < 30 && (ms >> (e + 1)) != 0; e++)
+      ;
+
+   bin = 64 + (e - 6) * 16 + (int)((ms >> (e - 4)) & 15);
+
+   return (bin < WINDOW_LATENCY_BINS) ? bin : WINDOW_LATENCY_BINS - 1;
+}
+
+/**
+ * @brief  Longest time falling in a latency bin
+ * @param  bin latency bin
+ * @return Milliseconds
+ */
+static long
+GetBinLimit(int bin)
+{
+   int e;
+
+   if(bin < 64)
+      return bin;
+
+   e = 6 + (bin - 64) / 16;
+
+   return ((long)(16 + (bin - 64) % 16 + 1) << (e - 4)) - 1;
+}
+
+/**
+ * @brief  Time below which a share of the barcodes were found
+ * @param  latency summed latency bins
+ * @param  total barcodes counted in bins
+ * @param  percent share, 0 to 100
+ * @return Milliseconds, rounded up to the end of its bin
+ */
+static long
+GetPercentile(const long *latency, long total, double percent)
+{
+   int bin;
+   long seen, rank;
+
+   rank = (long)(percent / 100.0 * total + 0.5);
+   if(rank < 1)
+      rank = 1;
+
+   for(bin = 0, seen = 0; bin < WINDOW_LATENCY_BINS - 1; bin++) {
+      seen += latency[bin];
+      if(seen >= rank)
+         break;
+   }
+
+   return GetBinLimit(bin);
+}
@@ -0,0 +1,40 @@
+/*
+libdmtx - Data Matrix Encoding/Decoding Library
+
+Copyright (C) 2008, 2009 Mike Laughton
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+Contact: mike@dragonflylogic.com
+*/
+
+#ifndef __DMTXWINDOW_H__
+#define __DMTXWINDOW_H__
+
+#include <stdio.h>
+#include <time.h>
+
+/* Latency bins: 1 ms wide up to 64 ms, then 16 per doubling */
+#define WINDOW_LATENCY_BINS 256
+
+typedef struct ResultWindow_struct ResultWindow;
+
+extern ResultWindow *WindowCreate(int seconds);
+extern void WindowDestroy(ResultWindow **window);
+extern DmtxPassFail WindowAdd(ResultWindow *window, const ResultRecord *rec, time_t now);
+extern void WindowPrintHeader(FILE *fp);
+extern void WindowPrint(ResultWindow *window, FILE *fp, time_t now);
+
+#endif
@@ -0,0 +1,1153 @@
+/*
+libdmtx - Data Matrix Encoding/Decoding Library
+
+Copyright (C) 2008, 2009 Mike Laughton
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+Contact: mike@dragonflylogic.com
+*/
+
+/**
+ * @file dmtxpool.c
+ * @brief Pre-forked worker processes for crash isolation
+ *
+ * The supervisor hands file paths to long-lived worker processes over
+ * pipes. Each worker captures the output of one file and returns it in a
+ * single framed message, so a worker that crashes or hangs loses only
+ * the file it was working on. Results are written in submission order.
+ *
+ * With a memory limit, workers ask the supervisor for a share of the
+ * budget before loading each file. Requests are granted in arrival
+ * order while they fit, and released when the file's result arrives.
+ *
+ * With a symbol limit, the supervisor counts the symbols of the results
+ * it writes and hands each file what is left of the limit. A file sent
+ * out before earlier files finished may find more than it turns out to
+ * be owed; it is scanned again once it is next to be written. When the
+ * limit is reached, running workers are stopped and later files are
+ * discarded, so the output matches a single process run.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <dmtx.h>
+#include "../common/dmtxutil.h"
+#include "dmtxpool.h"
+
+#if defined(HAVE_FORK) && defined(HAVE_OPEN_MEMSTREAM)
+#define DMTXPOOL_ENABLED 1
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif
+
+extern char *programName;
+
+#ifdef DMTXPOOL_ENABLED
+
+/* Inside a worker, the pipes back to the supervisor (otherwise -1) */
+static int workerTaskFd = -1;
+static int workerResultFd = -1;
+
+typedef enum {
+   PoolMsgTask,
+   PoolMsgResult,
+   PoolMsgReserve,
+   PoolMsgGrant,
+   PoolMsgRefuse
+} PoolMsgType;
+
+typedef enum {
+   TaskQueued,
+   TaskRunning,
+   TaskDone
+} TaskState;
+
+typedef struct {
+   int type;          /* PoolMsgType */
+   int status;        /* task status (results only) */
+   int symbolCount;   /* symbol budget (tasks) or symbols decoded (results) */
+   int length[2];     /* payload lengths: path | output, log */
+   size_t bytes;      /* memory requested (reservations only) */
+} PoolMessage;
+
+typedef struct {
+   char *path;
+   TaskState state;
+   int status;
+   int symbolCount;
+   int termSignal;
+   DmtxBoolean rescanned;
+   char *output;
+   int outputLength;
+   char *log;
+   int logLength;
+} PoolTask;
+
+typedef struct {
+   pid_t pid;
+   int taskFd;        /* supervisor writes tasks here */
+   int resultFd;      /* supervisor reads results here */
+   int taskIndex;     /* running task, or DmtxUndefined */
+   DmtxTime deadline;
+   size_t memoryWanted;   /* waiting reservation, or 0 */
+   size_t memoryHeld;     /* granted for the running task */
+   unsigned long requestSeq;
+} PoolWorker;
+
+struct ProcessPool_struct {
+   PoolWorker *workers;
+   int workerCount;
+   PoolTask *tasks;
+   int taskCount;
+   int taskAlloc;
+   int nextDispatch;
+   int nextEmit;
+   int rescanTask;    /* task to dispatch again before others, or DmtxUndefined */
+   int taskTimeoutMS;
+   size_t memoryLimit;
+   size_t memoryReserved;
+   unsigned long requestSeq;
+   DmtxBoolean stopDispatch;
+   PoolInitFunc initFunc;
+   PoolTaskFunc taskFunc;
+   PoolDoneFunc doneFunc;
+   void *userData;
+   int symbolCount;
+   int symbolLimit;
+   int emittedSymbols;
+   int failureCount;
+   int firstFailure;
+};
+
+static DmtxPassFail StartWorker(ProcessPool *pool, int idx);
+static int StopWorker(ProcessPool *pool, int idx, DmtxBoolean force);
+static void WorkerMain(ProcessPool *pool, int taskFd, int resultFd);
+static DmtxPassFail DispatchTasks(ProcessPool *pool);
+static void ReadResult(ProcessPool *pool, int idx);
+static void ReleaseMemory(ProcessPool *pool, int idx);
+static void GrantMemory(ProcessPool *pool);
+static void FailTask(ProcessPool *pool, int idx, int status);
+static void EmitTasks(ProcessPool *pool);
+static int GetTaskBudget(ProcessPool *pool, int taskIndex);
+static void DiscardTasks(ProcessPool *pool);
+static void RecordFailure(ProcessPool *pool, int status);
+static int TimeRemainingMS(DmtxTime deadline);
+static DmtxPassFail WriteAll(int fd, const void *buf, size_t count);
+static DmtxPassFail ReadAll(int fd, void *buf, size_t count);
+
+/**
+ * @brief  Report whether this platform supports worker processes
+ * @return DmtxTrue | DmtxFalse
+ */
+extern DmtxBoolean
+PoolSupported(void)
+{
+   return DmtxTrue;
+}
+
+/**
+ * @brief  Start a pool of pre-forked worker processes
+ * @param  workerCount number of workers
+ * @param  taskTimeoutMS kill a worker spending longer than this on one file (or DmtxUndefined)
+ * @param  initFunc called once in each worker after fork
+ * @param  taskFunc called in a worker for every file
+ * @param  userData passed to initFunc and taskFunc
+ * @return Address of new pool, or NULL on error
+ */
+extern ProcessPool *
+PoolCreate(int workerCount, int taskTimeoutMS, PoolInitFunc initFunc,
+      PoolTaskFunc taskFunc, void *userData)
+{
+   int i;
+   ProcessPool *pool;
+
+   assert(workerCount > 0 && taskFunc != NULL);
+
+   pool = (ProcessPool *)calloc(1, sizeof(ProcessPool));
+   if(pool == NULL)
+      return NULL;
+
+   pool->workers = (PoolWorker *)calloc(workerCount, sizeof(PoolWorker));
+   if(pool->workers == NULL) {
+      free(pool);
+      return NULL;
+   }
+
+   pool->workerCount = workerCount;
+   pool->taskTimeoutMS = taskTimeoutMS;
+   pool->initFunc = initFunc;
+   pool->taskFunc = taskFunc;
+   pool->userData = userData;
+   pool->rescanTask = DmtxUndefined;
+   pool->symbolLimit = DmtxUndefined;
+   pool->firstFailure = DmtxUndefined;
+
+   for(i = 0; i < workerCount; i++) {
+      pool->workers[i].pid = -1;
+      pool->workers[i].taskFd = -1;
+      pool->workers[i].resultFd = -1;
+      pool->workers[i].taskIndex = DmtxUndefined;
+   }
+
+   /* A dead worker must not take the supervisor down with it */
+   signal(SIGPIPE, SIG_IGN);
+
+   for(i = 0; i < workerCount; i++) {
+      if(StartWorker(pool, i) != DmtxPass) {
+         PoolDestroy(&pool);
+         return NULL;
+      }
+   }
+
+   return pool;
+}
+
+/**
+ * @brief  Stop all workers and free pool memory
+ * @param  pool pointer to pool pointer
+ * @return void
+ */
+extern void
+PoolDestroy(ProcessPool **pool)
+{
+   int i;
+
+   if(pool == NULL || *pool == NULL)
+      return;
+
+   for(i = 0; i < (*pool)->workerCount; i++)
+      StopWorker(*pool, i, DmtxFalse);
+
+   for(i = (*pool)->nextEmit; i < (*pool)->taskCount; i++) {
+      free((*pool)->tasks[i].path);
+      free((*pool)->tasks[i].output);
+      free((*pool)->tasks[i].log);
+   }
+
+   free((*pool)->tasks);
+   free((*pool)->workers);
+   free(*pool);
+
+   *pool = NULL;
+}
+
+/**
+ * @brief  Queue a file for scanning
+ * @param  pool process pool
+ * @param  path image path
+ * @return DmtxPass | DmtxFail
+ */
+extern DmtxPassFail
+PoolSubmit(ProcessPool *pool, const char *path)
+{
+   int newAlloc;
+   PoolTask *task, *newTasks;
+
+   if(pool->taskCount == pool->taskAlloc) {
+      newAlloc = (pool->taskAlloc == 0) ? 64 : pool->taskAlloc * 2;
+      newTasks = (PoolTask *)realloc(pool->tasks, newAlloc * sizeof(PoolTask));
+      if(newTasks == NULL)
+         return DmtxFail;
+      pool->tasks = newTasks;
+      pool->taskAlloc = newAlloc;
+   }
+
+   task = &(pool->tasks[pool->taskCount]);
+   memset(task, 0x00, sizeof(PoolTask));
+
+   task->path = (char *)malloc(strlen(path) + 1);
+   if(task->path == NULL)
+      return DmtxFail;
+   strcpy(task->path, path);
+
+   task->state = TaskQueued;
+   pool->taskCount++;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Dispatch work, collect results, and write finished output
+ * @param  pool process pool
+ * @param  extraFd additional descriptor to watch for input (or -1)
+ * @param  timeoutMS longest time to wait for activity (or -1 for no limit)
+ * @return 1 if extraFd is readable, 0 if not, -1 on error
+ */
+extern int
+PoolPoll(ProcessPool *pool, int extraFd, int timeoutMS)
+{
+   int i, fdCount;
+   int remaining;
+   int extraReady;
+   struct pollfd *fds;
+
+   if(DispatchTasks(pool) != DmtxPass)
+      return -1;
+
+   fds = (struct pollfd *)malloc((pool->workerCount + 1) * sizeof(struct pollfd));
+   if(fds == NULL)
+      return -1;
+
+   /* Wake up in time to enforce the nearest task deadline */
+   for(i = 0; i < pool->workerCount; i++) {
+      fds[i].fd = pool->workers[i].resultFd;
+      fds[i].events = POLLIN;
+      fds[i].revents = 0;
+
+      if(pool->workers[i].taskIndex != DmtxUndefined && pool->taskTimeoutMS != DmtxUndefined &&
+            pool->workers[i].memoryWanted == 0) {
+         remaining = TimeRemainingMS(pool->workers[i].deadline);
+         if(timeoutMS < 0 || remaining < timeoutMS)
+            timeoutMS = remaining;
+      }
+   }
+
+   fdCount = pool->workerCount;
+   if(extraFd >= 0) {
+      fds[fdCount].fd = extraFd;
+      fds[fdCount].events = POLLIN;
+      fds[fdCount].revents = 0;
+      fdCount++;
+   }
+
+   if(poll(fds, fdCount, timeoutMS) == -1 && errno != EINTR) {
+      free(fds);
+      return -1;
+   }
+
+   for(i = 0; i < pool->workerCount; i++) {
+      if(fds[i].revents & (POLLIN | POLLHUP | POLLERR))
+         ReadResult(pool, i);
+   }
+
+   GrantMemory(pool);
+
+   extraReady = (extraFd >= 0 && (fds[pool->workerCount].revents & (POLLIN | POLLHUP))) ? 1 : 0;
+   free(fds);
+
+   /* Kill workers that exceeded the per-file time limit */
+   for(i = 0; i < pool->workerCount; i++) {
+      if(pool->workers[i].taskIndex != DmtxUndefined && pool->taskTimeoutMS != DmtxUndefined &&
+            pool->workers[i].memoryWanted == 0 &&
+            dmtxTimeExceeded(pool->workers[i].deadline) == DmtxTrue) {
+         FailTask(pool, i, PoolStatusTimedOut);
+      }
+   }
+
+   /* Memory released by failed tasks may let a waiting worker start */
+   GrantMemory(pool);
+
+   EmitTasks(pool);
+
+   if(DispatchTasks(pool) != DmtxPass)
+      return -1;
+
+   return extraReady;
+}
+
+/**
+ * @brief  Count tasks whose output has not been written yet
+ * @param  pool process pool
+ * @return Pending task count
+ */
+extern int
+PoolPending(ProcessPool *pool)
+{
+   return pool->taskCount - pool->nextEmit;
+}
+
+/**
+ * @brief  Discard queued tasks and stop handing out new ones
+ * @param  pool process pool
+ * @return void
+ */
+extern void
+PoolStopDispatch(ProcessPool *pool)
+{
+   int i;
+
+   pool->stopDispatch = DmtxTrue;
+
+   if(pool->rescanTask != DmtxUndefined) {
+      pool->tasks[pool->rescanTask].state = TaskDone;
+      pool->tasks[pool->rescanTask].status = PoolStatusDiscarded;
+      pool->rescanTask = DmtxUndefined;
+   }
+
+   for(i = pool->nextDispatch; i < pool->taskCount; i++) {
+      if(pool->tasks[i].state == TaskQueued) {
+         pool->tasks[i].state = TaskDone;
+         pool->tasks[i].status = PoolStatusDiscarded;
+      }
+   }
+   pool->nextDispatch = pool->taskCount;
+
+   EmitTasks(pool);
+}
+
+/**
+ * @brief  Limit memory reserved by all workers at once
+ * @param  pool process pool
+ * @param  memoryLimit bytes shared by all running tasks (0 for no limit)
+ * @return void
+ */
+extern void
+PoolSetMemoryLimit(ProcessPool *pool, size_t memoryLimit)
+{
+   pool->memoryLimit = memoryLimit;
+}
+
+/**
+ * @brief  Report each file once its output has been written
+ * @param  pool process pool
+ * @param  doneFunc called with the path and status of every file that ran
+ * @return void
+ *
+ * Files dropped by PoolStopDispatch are not reported.
+ */
+extern void
+PoolSetDoneCallback(ProcessPool *pool, PoolDoneFunc doneFunc)
+{
+   pool->doneFunc = doneFunc;
+}
+
+/**
+ * @brief  Stop once the written output holds a number of symbols
+ * @param  pool process pool
+ * @param  symbolLimit symbols across all files (or DmtxUndefined)
+ * @return void
+ *
+ * Output is written whole per file, in submission order, ending with
+ * the file that reaches the limit. Files after it are not reported.
+ */
+extern void
+PoolSetSymbolLimit(ProcessPool *pool, int symbolLimit)
+{
+   pool->symbolLimit = symbolLimit;
+}
+
+/**
+ * @brief  Block a worker until the supervisor grants it memory
+ * @param  bytes memory needed by the current task
+ * @return DmtxPass | DmtxFail
+ *
+ * Outside a worker process this returns immediately. The grant lasts
+ * until the task finishes. A task may ask again for more on top of what
+ * it holds; that request fails if granting it would mean waiting on
+ * tasks that are themselves waiting for more.
+ */
+extern DmtxPassFail
+PoolReserveMemory(size_t bytes)
+{
+   PoolMessage msg;
+
+   if(workerTaskFd == -1 || workerResultFd == -1)
+      return DmtxPass;
+
+   memset(&msg, 0x00, sizeof(PoolMessage));
+   msg.type = PoolMsgReserve;
+   msg.bytes = bytes;
+
+   if(WriteAll(workerResultFd, &msg, sizeof(PoolMessage)) != DmtxPass ||
+         ReadAll(workerTaskFd, &msg, sizeof(PoolMessage)) != DmtxPass ||
+         msg.type != PoolMsgGrant)
+      return DmtxFail;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Total symbols decoded by all workers
+ * @param  pool process pool
+ * @return Symbol count
+ */
+extern int
+PoolGetSymbolCount(ProcessPool *pool)
+{
+   return pool->symbolCount;
+}
+
+/**
+ * @brief  Number of files that failed, crashed, or timed out
+ * @param  pool process pool
+ * @return Failure count
+ */
+extern int
+PoolGetFailureCount(ProcessPool *pool)
+{
+   return pool->failureCount;
+}
+
+/**
+ * @brief  Status of the first failed file
+ * @param  pool process pool
+ * @return Task status, or DmtxUndefined if nothing failed
+ */
+extern int
+PoolGetFirstFailure(ProcessPool *pool)
+{
+   return pool->firstFailure;
+}
+
+/**
+ * @brief  Fork one worker process into slot idx
+ * @param  pool process pool
+ * @param  idx worker slot
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+StartWorker(ProcessPool *pool, int idx)
+{
+   int i;
+   int taskPipe[2], resultPipe[2];
+   pid_t pid;
+
+   if(pipe(taskPipe) != 0)
+      return DmtxFail;
+
+   if(pipe(resultPipe) != 0) {
+      close(taskPipe[0]);
+      close(taskPipe[1]);
+      return DmtxFail;
+   }
+
+   /* Keep buffered output from being written twice */
+   fflush(stdout);
+   fflush(stderr);
+
+   pid = fork();
+   if(pid == -1) {
+      close(taskPipe[0]);
+      close(taskPipe[1]);
+      close(resultPipe[0]);
+      close(resultPipe[1]);
+      return DmtxFail;
+   }
+
+   if(pid == 0) {
+      /* Worker never touches other workers' pipes */
+      for(i = 0; i < pool->workerCount; i++) {
+         if(pool->workers[i].taskFd != -1)
+            close(pool->workers[i].taskFd);
+         if(pool->workers[i].resultFd != -1)
+            close(pool->workers[i].resultFd);
+      }
+      close(taskPipe[1]);
+      close(resultPipe[0]);
+      signal(SIGPIPE, SIG_DFL);
+
+      WorkerMain(pool, taskPipe[0], resultPipe[1]);
+      _exit(EX_OK);
+   }
+
+   close(taskPipe[0]);
+   close(resultPipe[1]);
+
+   pool->workers[idx].pid = pid;
+   pool->workers[idx].taskFd = taskPipe[1];
+   pool->workers[idx].resultFd = resultPipe[0];
+   pool->workers[idx].taskIndex = DmtxUndefined;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Shut down the worker in slot idx and reap it
+ * @param  pool process pool
+ * @param  idx worker slot
+ * @param  force DmtxTrue to kill immediately, DmtxFalse to let it finish
+ * @return Wait status of the worker (0 if none was running)
+ */
+static int
+StopWorker(ProcessPool *pool, int idx, DmtxBoolean force)
+{
+   int waitStatus;
+   PoolWorker *worker = &(pool->workers[idx]);
+
+   if(worker->pid == -1)
+      return 0;
+
+   if(force == DmtxTrue)
+      kill(worker->pid, SIGKILL);
+
+   /* Closing the task pipe tells an idle worker to exit */
+   if(worker->taskFd != -1)
+      close(worker->taskFd);
+   if(worker->resultFd != -1)
+      close(worker->resultFd);
+
+   waitStatus = 0;
+   while(waitpid(worker->pid, &waitStatus, 0) == -1 && errno == EINTR)
+      ;
+
+   worker->pid = -1;
+   worker->taskFd = -1;
+   worker->resultFd = -1;
+   worker->taskIndex = DmtxUndefined;
+
+   return waitStatus;
+}
+
+/**
+ * @brief  Worker process loop: scan each file received until pipe closes
+ * @param  pool process pool (copy inherited from supervisor)
+ * @param  taskFd descriptor for incoming tasks
+ * @param  resultFd descriptor for outgoing results
+ * @return void
+ */
+static void
+WorkerMain(ProcessPool *pool, int taskFd, int resultFd)
+{
+   int status;
+   int symbolCount;
+   char *path;
+   char *output, *log;
+   size_t outputLength, logLength;
+   FILE *fpOut, *fpErr;
+   PoolMessage msg;
+
+   workerTaskFd = taskFd;
+   workerResultFd = resultFd;
+
+   if(pool->initFunc != NULL && (*pool->initFunc)(pool->userData) != DmtxPass)
+      _exit(EX_SOFTWARE);
+
+   for(;;) {
+      if(ReadAll(taskFd, &msg, sizeof(PoolMessage)) != DmtxPass || msg.type != PoolMsgTask)
+         break;
+
+      path = (char *)malloc(msg.length[0] + 1);
+      if(path == NULL || ReadAll(taskFd, path, msg.length[0]) != DmtxPass)
+         _exit(EX_OSERR);
+      path[msg.length[0]] = '\0';
+      symbolCount = msg.symbolCount;
+
+      output = log = NULL;
+      fpOut = open_memstream(&output, &outputLength);
+      fpErr = open_memstream(&log, &logLength);
+      if(fpOut == NULL || fpErr == NULL)
+         _exit(EX_OSERR);
+
+      status = (*pool->taskFunc)(path, fpOut, fpErr, &symbolCount, pool->userData);
+
+      fclose(fpOut);
+      fclose(fpErr);
+
+      memset(&msg, 0x00, sizeof(PoolMessage));
+      msg.type = PoolMsgResult;
+      msg.status = status;
+      msg.symbolCount = symbolCount;
+      msg.length[0] = (int)outputLength;
+      msg.length[1] = (int)logLength;
+
+      if(WriteAll(resultFd, &msg, sizeof(PoolMessage)) != DmtxPass ||
+            WriteAll(resultFd, output, outputLength) != DmtxPass ||
+            WriteAll(resultFd, log, logLength) != DmtxPass)
+         _exit(EX_IOERR);
+
+      free(output);
+      free(log);
+      free(path);
+   }
+
+   close(taskFd);
+   close(resultFd);
+}
+
+/**
+ * @brief  Hand queued tasks to idle workers, restarting dead ones
+ * @param  pool process pool
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+DispatchTasks(ProcessPool *pool)
+{
+   int i;
+   int taskIndex;
+   PoolTask *task;
+   PoolWorker *worker;
+   PoolMessage msg;
+
+   for(i = 0; i < pool->workerCount && (pool->rescanTask != DmtxUndefined ||
+         pool->nextDispatch < pool->taskCount); i++) {
+      worker = &(pool->workers[i]);
+      if(worker->taskIndex != DmtxUndefined)
+         continue;
+
+      if(worker->pid == -1 && StartWorker(pool, i) != DmtxPass)
+         return DmtxFail;
+
+      if(pool->rescanTask != DmtxUndefined) {
+         taskIndex = pool->rescanTask;
+         pool->rescanTask = DmtxUndefined;
+      }
+      else {
+         taskIndex = pool->nextDispatch++;
+      }
+      task = &(pool->tasks[taskIndex]);
+
+      memset(&msg, 0x00, sizeof(PoolMessage));
+      msg.type = PoolMsgTask;
+      msg.symbolCount = GetTaskBudget(pool, taskIndex);
+      msg.length[0] = strlen(task->path);
+
+      worker->taskIndex = taskIndex;
+      task->state = TaskRunning;
+
+      if(pool->taskTimeoutMS != DmtxUndefined)
+         worker->deadline = dmtxTimeAdd(dmtxTimeNow(), pool->taskTimeoutMS);
+
+      if(WriteAll(worker->taskFd, &msg, sizeof(PoolMessage)) != DmtxPass ||
+            WriteAll(worker->taskFd, task->path, msg.length[0]) != DmtxPass) {
+         FailTask(pool, i, PoolStatusCrashed);
+      }
+   }
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Collect one result message, or detect a crashed worker
+ * @param  pool process pool
+ * @param  idx worker slot
+ * @return void
+ */
+static void
+ReadResult(ProcessPool *pool, int idx)
+{
+   PoolTask *task;
+   PoolWorker *worker = &(pool->workers[idx]);
+   PoolMessage msg;
+
+   /* End of file means the worker died */
+   if(ReadAll(worker->resultFd, &msg, sizeof(PoolMessage)) != DmtxPass ||
+         (msg.type != PoolMsgResult && msg.type != PoolMsgReserve) ||
+         worker->taskIndex == DmtxUndefined) {
+      FailTask(pool, idx, PoolStatusCrashed);
+      return;
+   }
+
+   /* Worker waits for GrantMemory(); its time limit starts over when granted */
+   if(msg.type == PoolMsgReserve) {
+      worker->memoryWanted = (msg.bytes > 0) ? msg.bytes : 1;
+      worker->requestSeq = pool->requestSeq++;
+      return;
+   }
+
+   task = &(pool->tasks[worker->taskIndex]);
+   task->output = (char *)malloc(msg.length[0] + 1);
+   task->log = (char *)malloc(msg.length[1] + 1);
+
+   if(task->output == NULL || task->log == NULL ||
+         ReadAll(worker->resultFd, task->output, msg.length[0]) != DmtxPass ||
+         ReadAll(worker->resultFd, task->log, msg.length[1]) != DmtxPass) {
+      FailTask(pool, idx, PoolStatusCrashed);
+      return;
+   }
+
+   task->outputLength = msg.length[0];
+   task->logLength = msg.length[1];
+   task->status = msg.status;
+   task->symbolCount = msg.symbolCount;
+   task->state = TaskDone;
+
+   pool->symbolCount += msg.symbolCount;
+   if(msg.status != EX_OK)
+      RecordFailure(pool, msg.status);
+
+   ReleaseMemory(pool, idx);
+   worker->taskIndex = DmtxUndefined;
+}
+
+/**
+ * @brief  Return a worker's reservation to the budget
+ * @param  pool process pool
+ * @param  idx worker slot
+ * @return void
+ */
+static void
+ReleaseMemory(ProcessPool *pool, int idx)
+{
+   PoolWorker *worker = &(pool->workers[idx]);
+
+   pool->memoryReserved -= worker->memoryHeld;
+   worker->memoryHeld = 0;
+   worker->memoryWanted = 0;
+}
+
+/**
+ * @brief  Grant waiting reservations in request order while they fit
+ * @param  pool process pool
+ * @return void
+ *
+ * Tasks already holding memory and asking for more come first, since
+ * they hold memory the others wait for. A request is always granted
+ * when nothing else is reserved, so a task asking for the whole budget
+ * cannot wait forever. When every task holding memory is waiting for
+ * more and none fits, the newest request is refused instead, and that
+ * task carries on with what it holds.
+ */
+static void
+GrantMemory(ProcessPool *pool)
+{
+   int i, next;
+   DmtxBoolean stalled;
+   PoolWorker *worker;
+   PoolMessage msg;
+
+   for(;;) {
+      next = DmtxUndefined;
+      stalled = DmtxTrue;
+      for(i = 0; i < pool->workerCount; i++) {
+         worker = &(pool->workers[i]);
+         if(worker->memoryHeld > 0 && worker->memoryWanted == 0)
+            stalled = DmtxFalse;
+         if(worker->memoryWanted == 0)
+            continue;
+         if(next == DmtxUndefined ||
+               (worker->memoryHeld > 0) > (pool->workers[next].memoryHeld > 0) ||
+               ((worker->memoryHeld > 0) == (pool->workers[next].memoryHeld > 0) &&
+               worker->requestSeq < pool->workers[next].requestSeq))
+            next = i;
+      }
+
+      if(next == DmtxUndefined)
+         return;
+
+      worker = &(pool->workers[next]);
+      memset(&msg, 0x00, sizeof(PoolMessage));
+
+      if(pool->memoryLimit != 0 && pool->memoryReserved > worker->memoryHeld &&
+            pool->memoryReserved + worker->memoryWanted > pool->memoryLimit) {
+         if(worker->memoryHeld == 0 || stalled == DmtxFalse)
+            return;
+
+         for(i = 0; i < pool->workerCount; i++) {
+            if(pool->workers[i].memoryHeld > 0 && pool->workers[i].memoryWanted > 0 &&
+                  pool->workers[i].requestSeq > worker->requestSeq) {
+               next = i;
+               worker = &(pool->workers[i]);
+            }
+         }
+         worker->memoryWanted = 0;
+         msg.type = PoolMsgRefuse;
+      }
+      else {
+         pool->memoryReserved += worker->memoryWanted;
+         worker->memoryHeld += worker->memoryWanted;
+         worker->memoryWanted = 0;
+         msg.type = PoolMsgGrant;
+      }
+
+      if(pool->taskTimeoutMS != DmtxUndefined)
+         worker->deadline = dmtxTimeAdd(dmtxTimeNow(), pool->taskTimeoutMS);
+
+      if(WriteAll(worker->taskFd, &msg, sizeof(PoolMessage)) != DmtxPass)
+         FailTask(pool, next, PoolStatusCrashed);
+   }
+}
+
+/**
+ * @brief  Mark the running task failed and reap its worker
+ * @param  pool process pool
+ * @param  idx worker slot
+ * @param  status PoolStatusCrashed or PoolStatusTimedOut
+ * @return void
+ */
+static void
+FailTask(ProcessPool *pool, int idx, int status)
+{
+   int taskIndex;
+   int waitStatus;
+   PoolTask *task;
+
+   taskIndex = pool->workers[idx].taskIndex;
+
+   ReleaseMemory(pool, idx);
+
+   /* Replacement worker is started on next dispatch */
+   waitStatus = StopWorker(pool, idx, (status == PoolStatusTimedOut) ? DmtxTrue : DmtxFalse);
+
+   if(taskIndex == DmtxUndefined)
+      return;
+
+   task = &(pool->tasks[taskIndex]);
+   free(task->output);
+   free(task->log);
+   task->output = task->log = NULL;
+   task->outputLength = task->logLength = 0;
+   task->status = status;
+   task->termSignal = (status == PoolStatusCrashed && WIFSIGNALED(waitStatus)) ?
+         WTERMSIG(waitStatus) : 0;
+   task->state = TaskDone;
+
+   RecordFailure(pool, status);
+}
+
+/**
+ * @brief  Write output of finished tasks in submission order
+ * @param  pool process pool
+ * @return void
+ */
+static void
+EmitTasks(ProcessPool *pool)
+{
+   int i, shift;
+   PoolTask *task;
+
+   while(pool->nextEmit < pool->taskCount && pool->tasks[pool->nextEmit].state == TaskDone) {
+      task = &(pool->tasks[pool->nextEmit]);
+
+      /* Budget was only an upper bound while earlier files were running */
+      if(pool->symbolLimit != DmtxUndefined && task->rescanned == DmtxFalse &&
+            task->symbolCount > pool->symbolLimit - pool->emittedSymbols) {
+         free(task->output);
+         free(task->log);
+         task->output = task->log = NULL;
+         task->outputLength = task->logLength = 0;
+         pool->symbolCount -= task->symbolCount;
+         task->symbolCount = 0;
+         task->rescanned = DmtxTrue;
+         task->state = TaskQueued;
+         pool->rescanTask = pool->nextEmit;
+         break;
+      }
+
+      if(task->logLength > 0)
+         fwrite(task->log, sizeof(char), task->logLength, stderr);
+
+      if(task->outputLength > 0) {
+         fwrite(task->output, sizeof(char), task->outputLength, stdout);
+         fflush(stdout);
+      }
+
+      if(task->status == PoolStatusCrashed) {
+         if(task->termSignal != 0)
+            fprintf(stderr, "%s: worker crashed (signal %d) while reading \"%s\"\n",
+                  programName, task->termSignal, task->path);
+         else
+            fprintf(stderr, "%s: worker crashed while reading \"%s\"\n",
+                  programName, task->path);
+      }
+      else if(task->status == PoolStatusTimedOut) {
+         fprintf(stderr, "%s: worker timed out while reading \"%s\"\n",
+               programName, task->path);
+      }
+
+      if(pool->doneFunc != NULL && task->status != PoolStatusDiscarded)
+         (*pool->doneFunc)(task->path, task->status, pool->userData);
+
+      free(task->path);
+      free(task->output);
+      free(task->log);
+      pool->nextEmit++;
+
+      pool->emittedSymbols += task->symbolCount;
+      if(pool->symbolLimit != DmtxUndefined && pool->emittedSymbols >= pool->symbolLimit)
+         DiscardTasks(pool);
+   }
+
+   /* Reclaim slots of emitted tasks so long runs stay small */
+   shift = pool->nextEmit;
+   if(shift > 0 && shift >= pool->taskCount / 2) {
+      memmove(pool->tasks, pool->tasks + shift, (pool->taskCount - shift) * sizeof(PoolTask));
+      pool->taskCount -= shift;
+      pool->nextDispatch -= shift;
+      pool->nextEmit = 0;
+      if(pool->rescanTask != DmtxUndefined)
+         pool->rescanTask -= shift;
+      for(i = 0; i < pool->workerCount; i++) {
+         if(pool->workers[i].taskIndex != DmtxUndefined)
+            pool->workers[i].taskIndex -= shift;
+      }
+   }
+}
+
+/**
+ * @brief  Symbols a file may still return under the symbol limit
+ * @param  pool process pool
+ * @param  taskIndex task about to be dispatched
+ * @return Budget, or DmtxUndefined without a limit
+ *
+ * Earlier files that are still running are not known yet, so the
+ * budget may be more than the file is owed. EmitTasks() catches that.
+ */
+static int
+GetTaskBudget(ProcessPool *pool, int taskIndex)
+{
+   int i;
+   int budget;
+
+   if(pool->symbolLimit == DmtxUndefined)
+      return DmtxUndefined;
+
+   budget = pool->symbolLimit - pool->emittedSymbols;
+   for(i = pool->nextEmit; i < taskIndex; i++) {
+      if(pool->tasks[i].state == TaskDone)
+         budget -= pool->tasks[i].symbolCount;
+   }
+
+   return (budget > 0) ? budget : 0;
+}
+
+/**
+ * @brief  Stop running workers and drop every task not yet written
+ * @param  pool process pool
+ * @return void
+ *
+ * Workers only read their pipe between files, so a running worker is
+ * stopped by killing it. Replacements start only if more files arrive.
+ */
+static void
+DiscardTasks(ProcessPool *pool)
+{
+   int i;
+   PoolTask *task;
+
+   for(i = 0; i < pool->workerCount; i++) {
+      if(pool->workers[i].taskIndex != DmtxUndefined) {
+         ReleaseMemory(pool, i);
+         StopWorker(pool, i, DmtxTrue);
+      }
+   }
+
+   for(i = pool->nextEmit; i < pool->taskCount; i++) {
+      task = &(pool->tasks[i]);
+      free(task->output);
+      free(task->log);
+      task->output = task->log = NULL;
+      task->outputLength = task->logLength = 0;
+      task->state = TaskDone;
+      task->status = PoolStatusDiscarded;
+   }
+
+   pool->stopDispatch = DmtxTrue;
+   pool->rescanTask = DmtxUndefined;
+   pool->nextDispatch = pool->taskCount;
+}
+
+/**
+ * @brief  Count a failed task and remember the first failure
+ * @param  pool process pool
+ * @param  status task status
+ * @return void
+ */
+static void
+RecordFailure(ProcessPool *pool, int status)
+{
+   pool->failureCount++;
+
+   if(pool->firstFailure == DmtxUndefined)
+      pool->firstFailure = status;
+}
+
+/**
+ * @brief  Milliseconds left until deadline (0 if already passed)
+ * @param  deadline absolute time
+ * @return Remaining milliseconds
+ */
+static int
+TimeRemainingMS(DmtxTime deadline)
+{
+   long ms;
+   DmtxTime now;
+
+   now = dmtxTimeNow();
+   ms = (long)(deadline.sec - now.sec) * 1000 +
+         ((long)deadline.usec - (long)now.usec) / 1000;
+
+   return (ms > 0) ? (int)ms : 0;
+}
+
+/**
+ * @brief  Write entire buffer to descriptor
+ * @param  fd file descriptor
+ * @param  buf data
+ * @param  count byte count
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+WriteAll(int fd, const void *buf, size_t count)
+{
+   ssize_t written;
+   const char *ptr = (const char *)buf;
+
+   while(count > 0) {
+      written = write(fd, ptr, count);
+      if(written == -1 && errno == EINTR)
+         continue;
+      if(written <= 0)
+         return DmtxFail;
+      ptr += written;
+      count -= written;
+   }
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Read exactly count bytes from descriptor
+ * @param  fd file descriptor
+ * @param  buf destination
+ * @param  count byte count
+ * @return DmtxPass | DmtxFail (including end of file)
+ */
+static DmtxPassFail
+ReadAll(int fd, void *buf, size_t count)
+{
+   ssize_t bytesRead;
+   char *ptr = (char *)buf;
+
+   while(count > 0) {
+      bytesRead = read(fd, ptr, count);
+      if(bytesRead == -1 && errno == EINTR)
+         continue;
+      if(bytesRead <= 0)
+         return DmtxFail;
+      ptr += bytesRead;
+      count -= bytesRead;
+   }
+
+   return DmtxPass;
+}
+
+#else
+
+/* Platforms without fork() get stubs that always fail */
+
+extern DmtxBoolean PoolSupported(void) { return DmtxFalse; }
+extern ProcessPool *PoolCreate(int workerCount, int taskTimeoutMS, PoolInitFunc initFunc,
+      PoolTaskFunc taskFunc, void *userData) { return NULL; }
+extern void PoolDestroy(ProcessPool **pool) { }
+extern DmtxPassFail PoolSubmit(ProcessPool *pool, const char *path) { return DmtxFail; }
+extern int PoolPoll(ProcessPool *pool, int extraFd, int timeoutMS) { return -1; }
+extern int PoolPending(ProcessPool *pool) { return 0; }
+extern void PoolStopDispatch(ProcessPool *pool) { }
+extern void PoolSetMemoryLimit(ProcessPool *pool, size_t memoryLimit) { }
+extern void PoolSetDoneCallback(ProcessPool *pool, PoolDoneFunc doneFunc) { }
+extern void PoolSetSymbolLimit(ProcessPool *pool, int symbolLimit) { }
+extern DmtxPassFail PoolReserveMemory(size_t bytes) { return DmtxPass; }
+extern int PoolGetSymbolCount(ProcessPool *pool) { return 0; }
+extern int PoolGetFailureCount(ProcessPool *pool) { return 0; }
+extern int PoolGetFirstFailure(ProcessPool *pool) { return DmtxUndefined; }
+
+#endif
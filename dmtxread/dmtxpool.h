@@ -0,0 +1,63 @@
+/*
+libdmtx - Data Matrix Encoding/Decoding Library
+
+Copyright (C) 2008, 2009 Mike Laughton
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+Contact: mike@dragonflylogic.com
+*/
+
+#ifndef __DMTXPOOL_H__
+#define __DMTXPOOL_H__
+
+#include <stdio.h>
+
+/* Task outcomes beyond DmtxScanStatus values */
+#define PoolStatusCrashed  100
+#define PoolStatusTimedOut 101
+#define PoolStatusDiscarded 102
+
+typedef struct ProcessPool_struct ProcessPool;
+
+/* Called once in each worker process after fork() */
+typedef DmtxPassFail (*PoolInitFunc)(void *userData);
+
+/* Called in a worker for every file; output is captured and relayed.
+ * symbolCount holds the file's symbol budget on entry (DmtxUndefined for
+ * none) and the symbols decoded on return */
+typedef int (*PoolTaskFunc)(const char *path, FILE *fpOut, FILE *fpErr,
+      int *symbolCount, void *userData);
+
+/* Called in the supervisor as each file's output is written */
+typedef void (*PoolDoneFunc)(const char *path, int status, void *userData);
+
+extern DmtxBoolean PoolSupported(void);
+extern ProcessPool *PoolCreate(int workerCount, int taskTimeoutMS,
+      PoolInitFunc initFunc, PoolTaskFunc taskFunc, void *userData);
+extern void PoolDestroy(ProcessPool **pool);
+extern DmtxPassFail PoolSubmit(ProcessPool *pool, const char *path);
+extern int PoolPoll(ProcessPool *pool, int extraFd, int timeoutMS);
+extern int PoolPending(ProcessPool *pool);
+extern void PoolStopDispatch(ProcessPool *pool);
+extern void PoolSetMemoryLimit(ProcessPool *pool, size_t memoryLimit);
+extern void PoolSetDoneCallback(ProcessPool *pool, PoolDoneFunc doneFunc);
+extern void PoolSetSymbolLimit(ProcessPool *pool, int symbolLimit);
+extern DmtxPassFail PoolReserveMemory(size_t bytes);
+extern int PoolGetSymbolCount(ProcessPool *pool);
+extern int PoolGetFailureCount(ProcessPool *pool);
+extern int PoolGetFirstFailure(ProcessPool *pool);
+
+#endif
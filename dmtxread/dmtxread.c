@@ -26,6 +26,12 @@ Contact: mike@dragonflylogic.com
 
 char *programName;
 
+/* Set from a signal handler to end --watch */
+static volatile sig_atomic_t watchStop = 0;
+
+/* XML root element still to be closed by EndOutput */
+static DmtxBoolean xmlOpen = DmtxFalse;
+
 /**
  * @brief  Main function for the dmtxread Data Matrix scanning utility.
  * @param  argc count of arguments passed from command line
@@ -38,19 +44,13 @@ main(int argc, char *argv[])
    char *filePath;
    int i;
    int err;
-   int fileIndex, imgPageIndex;
+   int fileIndex;
    int fileCount;
-   int imgScanCount, pageScanCount;
-   int width, height;
-   unsigned char *pxl;
+   int imgScanCount;
+   int exitStatus;
    UserOptions opt;
-   DmtxTime timeout;
-   DmtxImage *img;
-   DmtxDecode *dec;
-   DmtxRegion *reg;
-   DmtxMessage *msg;
-   MagickBooleanType success;
-   MagickWand *wand;
+   ScanContext ctx;
+   DmtxScanStatus status;
 
    opt = GetDefaultOptions();
 
@@ -60,135 +60,84 @@ main(int argc, char *argv[])
 
    fileCount = (argc == fileIndex) ? 1 : argc - fileIndex;
 
-   MagickWandGenesis();
-
-   /* Loop once for each image named on command line */
-   imgScanCount = 0;
-   for(i = 0; i < fileCount; i++) {
-
-      /* Open image from file or stream (might contain multiple pages) */
-      filePath = (argc == fileIndex) ? "-" : argv[fileIndex++];
-
-      wand = NewMagickWand();
-      if(wand == NULL) {
-         FatalError(EX_OSERR, "Magick error");
-      }
-
-      /* XXX note this is not the same as MagickSetImageResolution() ...
-       * need to research what this is setting. Could be dots per inch, dots
-       * per centimeter, or even dots per "image width" */
-      if(opt.dpi != DmtxUndefined) {
-         success = MagickSetResolution(wand, (double)opt.dpi, (double)opt.dpi);
-         if(success == MagickFalse) {
-            CleanupMagick(&wand, DmtxTrue);
-            FatalError(EX_OSERR, "Unable to set image resolution");
-         }
-      }
-
-      success = MagickReadImage(wand, filePath);
-      if(success == MagickFalse) {
-         CleanupMagick(&wand, DmtxTrue);
-         FatalError(EX_OSERR, "Unable to open file \"%s\" for reading", filePath);
-      }
-
-      width = MagickGetImageWidth(wand);
-      height = MagickGetImageHeight(wand);
-
-      /* Loop once for each page within image */
-      MagickResetIterator(wand);
-      for(imgPageIndex = 0; MagickNextImage(wand) != MagickFalse; imgPageIndex++) {
+   memset(&ctx, 0x00, sizeof(ScanContext));
+   ctx.opt = &opt;
+   ctx.fpOut = stdout;
+   ctx.fpErr = stderr;
 
-         /* If requested, only scan specific page */
-         if(opt.page != DmtxUndefined && opt.page - 1 != imgPageIndex)
-            continue;
-
-         /* Reset timeout for each new page */
-         if(opt.timeoutMS != DmtxUndefined)
-            timeout = dmtxTimeAdd(dmtxTimeNow(), opt.timeoutMS);
-
-         /* Allocate memory for pixel data */
-         pxl = (unsigned char *)malloc(3 * width * height * sizeof(unsigned char));
-         if(pxl == NULL) {
-            CleanupMagick(&wand, DmtxFalse);
-            FatalError(EX_OSERR, "malloc() error");
-         }
-
-         /* Copy pixels to known format */
-         success = MagickGetImagePixels(wand, 0, 0, width, height, "RGB", CharPixel, pxl);
-         if(success == MagickFalse || pxl == NULL) {
-            CleanupMagick(&wand, DmtxTrue);
-            FatalError(EX_OSERR, "malloc() error");
-         }
+   if(opt.watchDir != NULL && argc != fileIndex)
+      FatalError(EX_USAGE, _("Files cannot be named together with --watch"));
 
-         /* Initialize libdmtx image */
-         img = dmtxImageCreate(pxl, width, height, DmtxPack24bppRGB);
-         if(img == NULL) {
-            CleanupMagick(&wand, DmtxFalse);
-            FatalError(EX_SOFTWARE, "dmtxImageCreate() error");
-         }
+   if(opt.outputSocket != NULL)
+      ConnectOutput(opt.outputSocket);
 
-         dmtxImageSetProp(img, DmtxPropImageFlip, DmtxFlipNone);
+   BeginOutput(&opt);
 
-         /* Initialize scan */
-         dec = dmtxDecodeCreate(img, opt.shrinkMin);
-         if(dec == NULL) {
-            CleanupMagick(&wand, DmtxFalse);
-            FatalError(EX_SOFTWARE, "decode create error");
-         }
+   /* Hand files to isolated worker processes if requested */
+   if(opt.workers != DmtxUndefined) {
+      filePath = "-";
+      if(opt.watchDir != NULL)
+         exitStatus = WatchDirectory(&ctx);
+      else if(argc == fileIndex)
+         exitStatus = ScanFilesWithPool(&ctx, &filePath, 1);
+      else
+         exitStatus = ScanFilesWithPool(&ctx, argv + fileIndex, fileCount);
 
-         err = SetDecodeOptions(dec, img, &opt);
-         if(err != DmtxPass) {
-            CleanupMagick(&wand, DmtxFalse);
-            FatalError(EX_SOFTWARE, "decode option error");
-         }
+      EndOutput();
+      exit(exitStatus);
+   }
 
-         /* Find and decode every barcode on page */
-         pageScanCount = 0;
-         for(;;) {
-            /* Find next barcode region within image, but do not decode yet */
-            if(opt.timeoutMS == DmtxUndefined)
-               reg = dmtxRegionFindNext(dec, NULL);
-            else
-               reg = dmtxRegionFindNext(dec, &timeout);
+   dmtxScanGenesis();
 
-            /* Finished file or ran out of time before finding another region */
-            if(reg == NULL)
-               break;
+   if(SetResourceLimits(&opt, 1) != DmtxPass)
+      FatalError(EX_USAGE, _("Unable to apply ImageMagick resource limits"));
 
-            /* Decode region based on requested barcode mode */
-            if(opt.mosaic == DmtxTrue)
-               msg = dmtxDecodeMosaicRegion(dec, reg, opt.correctionsMax);
-            else
-               msg = dmtxDecodeMatrixRegion(dec, reg, opt.correctionsMax);
+   if(opt.verbose == DmtxTrue)
+      PrintResourceLimits(stderr);
 
-            if(msg != NULL) {
-               PrintStats(dec, reg, msg, imgPageIndex, &opt);
-               PrintMessage(reg, msg, &opt);
+   ctx.scan = dmtxScanCreate(&opt.scan);
+   if(ctx.scan == NULL)
+      FatalError(EX_OSERR, "malloc() error");
 
-               pageScanCount++;
-               imgScanCount++;
+   dmtxScanSetCallbacks(ctx.scan, HandleSymbol, HandlePage, &ctx);
 
-               dmtxMessageDestroy(&msg);
-            }
+   if(opt.watchDir != NULL) {
+      exitStatus = WatchDirectory(&ctx);
+      dmtxScanDestroy(&ctx.scan);
+      dmtxScanTerminus();
+      EndOutput();
+      exit(exitStatus);
+   }
 
-            dmtxRegionDestroy(&reg);
+   /* Loop once for each image named on command line */
+   exitStatus = EX_OK;
+   for(i = 0; i < fileCount; i++) {
 
-            if(opt.stopAfter != DmtxUndefined && imgScanCount >= opt.stopAfter)
-               break;
-         }
+      /* Open image from file or stream (might contain multiple pages) */
+      filePath = (argc == fileIndex) ? "-" : argv[fileIndex++];
 
-         if(opt.diagnose == DmtxTrue)
-            WriteDiagnosticImage(dec, "debug.pnm");
+      status = dmtxScanFile(ctx.scan, filePath);
+      PrintPeakMemory(&ctx, filePath);
 
-         dmtxDecodeDestroy(&dec);
-         dmtxImageDestroy(&img);
-         free(pxl);
+      /* A file that runs out of time is skipped, not fatal */
+      if(status == DmtxScanErrorDeadline) {
+         fprintf(stderr, "%s: %s\n", programName, dmtxScanGetError(ctx.scan));
+         if(exitStatus == EX_OK)
+            exitStatus = GetExitStatus(status);
+      }
+      else if(status != DmtxScanOk) {
+         FatalError(GetExitStatus(status), "%s", dmtxScanGetError(ctx.scan));
       }
-
-      CleanupMagick(&wand, DmtxFalse);
    }
 
-   MagickWandTerminus();
+   imgScanCount = dmtxScanGetSymbolCount(ctx.scan);
+
+   dmtxScanDestroy(&ctx.scan);
+   dmtxScanTerminus();
+   EndOutput();
+
+   if(exitStatus != EX_OK)
+      exit(exitStatus);
 
    exit((imgScanCount > 0) ? EX_OK : 1);
 }
@@ -205,32 +154,21 @@ GetDefaultOptions(void)
    memset(&opt, 0x00, sizeof(UserOptions));
 
    /* Default options */
+   opt.scan = dmtxScanOptionsDefault();
    opt.codewords = DmtxFalse;
-   opt.edgeMin = DmtxUndefined;
-   opt.edgeMax = DmtxUndefined;
-   opt.scanGap = 2;
-   opt.timeoutMS = DmtxUndefined;
    opt.newline = DmtxFalse;
-   opt.page = DmtxUndefined;
-   opt.squareDevn = DmtxUndefined;
-   opt.dpi = DmtxUndefined;
-   opt.sizeIdxExpected = DmtxSymbolShapeAuto;
-   opt.edgeThresh = 5;
-   opt.xMin = NULL;
-   opt.xMax = NULL;
-   opt.yMin = NULL;
-   opt.yMax = NULL;
-   opt.correctionsMax = DmtxUndefined;
    opt.diagnose = DmtxFalse;
-   opt.mosaic = DmtxFalse;
-   opt.stopAfter = DmtxUndefined;
    opt.pageNumbers = DmtxFalse;
    opt.corners = DmtxFalse;
-   opt.shrinkMin = 1;
-   opt.shrinkMax = 1;
    opt.unicode = DmtxFalse;
    opt.verbose = DmtxFalse;
-   opt.gs1 = DmtxUndefined;
+   opt.workers = DmtxUndefined;
+   opt.workerTimeoutMS = DmtxUndefined;
+   opt.watchDir = NULL;
+   opt.doneDir = NULL;
+   opt.failedDir = NULL;
+   opt.outputFormat = OutputText;
+   opt.outputSocket = NULL;
 
    return opt;
 }
@@ -278,6 +216,26 @@ HandleArgs(UserOptions *opt, int *fileIndex, int *argcp, char **argvp[])
          {"shrink",           required_argument, NULL, 'S'},
          {"unicode",          no_argument,       NULL, 'U'},
          {"gs1",              required_argument, NULL, 'G'},
+         {"workers",          required_argument, NULL, 'j'},
+         {"worker-timeout",   required_argument, NULL, OptWorkerTimeout},
+         {"deadline",         required_argument, NULL, OptDeadline},
+         {"magick-threads",   required_argument, NULL, OptMagickThreads},
+         {"magick-memory",    required_argument, NULL, OptMagickMemory},
+         {"magick-map",       required_argument, NULL, OptMagickMap},
+         {"magick-area",      required_argument, NULL, OptMagickArea},
+         {"magick-disk",      required_argument, NULL, OptMagickDisk},
+         {"no-disk-cache",    no_argument,       NULL, OptNoDiskCache},
+         {"memory-limit",     required_argument, NULL, OptMemoryLimit},
+         {"stream",           no_argument,       NULL, OptStream},
+         {"band-height",      required_argument, NULL, OptBandHeight},
+         {"magick-fax",       no_argument,       NULL, OptMagickFax},
+         {"rasterize-pdf",    no_argument,       NULL, OptRasterizePdf},
+         {"locate-resolution", required_argument, NULL, OptLocateResolution},
+         {"watch",            required_argument, NULL, OptWatch},
+         {"done-dir",         required_argument, NULL, OptDoneDir},
+         {"failed-dir",       required_argument, NULL, OptFailedDir},
+         {"output-format",    required_argument, NULL, OptOutputFormat},
+         {"output-socket",    required_argument, NULL, OptOutputSocket},
          {"verbose",          no_argument,       NULL, 'v'},
          {"version",          no_argument,       NULL, 'V'},
          {"help",             no_argument,       NULL,  0 },
@@ -290,7 +248,7 @@ HandleArgs(UserOptions *opt, int *fileIndex, int *argcp, char **argvp[])
 
    for(;;) {
       optchr = getopt_long(*argcp, *argvp,
-            "ce:E:g:lm:np:q:r:s:t:x:X:y:Y:vC:DMN:PRS:G:UV", longOptions, &longIndex);
+            "ce:E:g:j:lm:np:q:r:s:t:x:X:y:Y:vC:DMN:PRS:G:UV", longOptions, &longIndex);
       if(optchr == -1)
          break;
 
@@ -306,59 +264,152 @@ HandleArgs(UserOptions *opt, int *fileIndex, int *argcp, char **argvp[])
             opt->codewords = DmtxTrue;
             break;
          case 'e':
-            err = StringToInt(&(opt->edgeMin), optarg, &ptr);
-            if(err != DmtxPass || opt->edgeMin <= 0 || *ptr != '\0')
+            err = StringToInt(&(opt->scan.edgeMin), optarg, &ptr);
+            if(err != DmtxPass || opt->scan.edgeMin <= 0 || *ptr != '\0')
                FatalError(EX_USAGE, _("Invalid edge length specified \"%s\""), optarg);
             break;
          case 'E':
-            err = StringToInt(&(opt->edgeMax), optarg, &ptr);
-            if(err != DmtxPass || opt->edgeMax <= 0 || *ptr != '\0')
+            err = StringToInt(&(opt->scan.edgeMax), optarg, &ptr);
+            if(err != DmtxPass || opt->scan.edgeMax <= 0 || *ptr != '\0')
                FatalError(EX_USAGE, _("Invalid edge length specified \"%s\""), optarg);
             break;
          case 'g':
-            err = StringToInt(&(opt->scanGap), optarg, &ptr);
-            if(err != DmtxPass || opt->scanGap <= 0 || *ptr != '\0')
+            err = StringToInt(&(opt->scan.scanGap), optarg, &ptr);
+            if(err != DmtxPass || opt->scan.scanGap <= 0 || *ptr != '\0')
                FatalError(EX_USAGE, _("Invalid gap specified \"%s\""), optarg);
             break;
+         case 'j':
+            err = StringToInt(&(opt->workers), optarg, &ptr);
+            if(err != DmtxPass || opt->workers < 1 || *ptr != '\0')
+               FatalError(EX_USAGE, _("Invalid worker count specified \"%s\""), optarg);
+            if(PoolSupported() == DmtxFalse)
+               FatalError(EX_USAGE, _("Worker processes are not supported on this platform"));
+            break;
+         case OptWorkerTimeout:
+            err = StringToInt(&(opt->workerTimeoutMS), optarg, &ptr);
+            if(err != DmtxPass || opt->workerTimeoutMS < 1 || *ptr != '\0')
+               FatalError(EX_USAGE, _("Invalid worker timeout specified \"%s\""), optarg);
+            break;
+         case OptDeadline:
+            err = StringToInt(&(opt->scan.deadlineMS), optarg, &ptr);
+            if(err != DmtxPass || opt->scan.deadlineMS < 1 || *ptr != '\0')
+               FatalError(EX_USAGE, _("Invalid deadline (in milliseconds) specified \"%s\""), optarg);
+            break;
+         case OptMagickThreads:
+            err = StringToInt(&i, optarg, &ptr);
+            if(err != DmtxPass || i < 1 || *ptr != '\0')
+               FatalError(EX_USAGE, _("Invalid thread count specified \"%s\""), optarg);
+            opt->limit[LimitThread] = (size_t)i;
+            opt->limitSet[LimitThread] = DmtxTrue;
+            break;
+         case OptMagickMemory:
+         case OptMagickMap:
+         case OptMagickArea:
+         case OptMagickDisk:
+            i = LimitMemory + (optchr - OptMagickMemory);
+            if(StringToSize(&(opt->limit[i]), optarg) != DmtxPass)
+               FatalError(EX_USAGE, _("Invalid resource limit specified \"%s\""), optarg);
+            opt->limitSet[i] = DmtxTrue;
+            break;
+         case OptNoDiskCache:
+            opt->limit[LimitDisk] = 0;
+            opt->limitSet[LimitDisk] = DmtxTrue;
+            break;
+         case OptMemoryLimit:
+            if(StringToSize(&(opt->scan.memoryLimit), optarg) != DmtxPass ||
+                  opt->scan.memoryLimit == 0)
+               FatalError(EX_USAGE, _("Invalid memory limit specified \"%s\""), optarg);
+            break;
+         case OptStream:
+            opt->scan.stream = DmtxTrue;
+            break;
+         case OptBandHeight:
+            err = StringToInt(&(opt->scan.bandHeight), optarg, &ptr);
+            if(err != DmtxPass || opt->scan.bandHeight < 1 || *ptr != '\0')
+               FatalError(EX_USAGE, _("Invalid band height specified \"%s\""), optarg);
+            break;
+         case OptMagickFax:
+            opt->scan.nativeFax = DmtxFalse;
+            break;
+         case OptRasterizePdf:
+            opt->scan.nativePdf = DmtxFalse;
+            break;
+         case OptLocateResolution:
+            err = StringToInt(&(opt->scan.locateDpi), optarg, &ptr);
+            if(err != DmtxPass || *ptr != '\0' || opt->scan.locateDpi < 1)
+               FatalError(EX_USAGE, _("Invalid locate resolution specified \"%s\""), optarg);
+            break;
+         case OptWatch:
+            if(WatchSupported() == DmtxFalse)
+               FatalError(EX_USAGE, _("Watching directories is not supported on this platform"));
+            if(IsDirectory(optarg) == DmtxFalse)
+               FatalError(EX_USAGE, _("Invalid watch directory specified \"%s\""), optarg);
+            opt->watchDir = optarg;
+            break;
+         case OptDoneDir:
+            if(IsDirectory(optarg) == DmtxFalse)
+               FatalError(EX_USAGE, _("Invalid done directory specified \"%s\""), optarg);
+            opt->doneDir = optarg;
+            break;
+         case OptFailedDir:
+            if(IsDirectory(optarg) == DmtxFalse)
+               FatalError(EX_USAGE, _("Invalid failed directory specified \"%s\""), optarg);
+            opt->failedDir = optarg;
+            break;
+         case OptOutputFormat:
+            if(strcmp(optarg, "text") == 0)
+               opt->outputFormat = OutputText;
+            else if(strcmp(optarg, "jsonl") == 0)
+               opt->outputFormat = OutputJsonl;
+            else if(strcmp(optarg, "xml") == 0)
+               opt->outputFormat = OutputXml;
+            else if(strcmp(optarg, "binary") == 0)
+               opt->outputFormat = OutputBinary;
+            else
+               FatalError(EX_USAGE, _("Invalid output format specified \"%s\""), optarg);
+            break;
+         case OptOutputSocket:
+            opt->outputSocket = optarg;
+            break;
          case 'm':
-            err = StringToInt(&(opt->timeoutMS), optarg, &ptr);
-            if(err != DmtxPass || opt->timeoutMS < 0 || *ptr != '\0')
+            err = StringToInt(&(opt->scan.timeoutMS), optarg, &ptr);
+            if(err != DmtxPass || opt->scan.timeoutMS < 0 || *ptr != '\0')
                FatalError(EX_USAGE, _("Invalid timeout (in milliseconds) specified \"%s\""), optarg);
             break;
          case 'n':
             opt->newline = DmtxTrue;
             break;
          case 'p':
-            err = StringToInt(&(opt->page), optarg, &ptr);
-            if(err != DmtxPass || opt->page < 1 || *ptr != '\0')
+            err = StringToInt(&(opt->scan.page), optarg, &ptr);
+            if(err != DmtxPass || opt->scan.page < 1 || *ptr != '\0')
                FatalError(EX_USAGE, _("Invalid page specified \"%s\""), optarg);
             break;
          case 'q':
-            err = StringToInt(&(opt->squareDevn), optarg, &ptr);
+            err = StringToInt(&(opt->scan.squareDevn), optarg, &ptr);
             if(err != DmtxPass || *ptr != '\0' ||
-                  opt->squareDevn < 0 || opt->squareDevn > 90)
+                  opt->scan.squareDevn < 0 || opt->scan.squareDevn > 90)
                FatalError(EX_USAGE, _("Invalid squareness deviation specified \"%s\""), optarg);
             break;
          case 'r':
-            err = StringToInt(&(opt->dpi), optarg, &ptr);
-            if(err != DmtxPass || *ptr != '\0' || opt->dpi < 1)
+            err = StringToInt(&(opt->scan.dpi), optarg, &ptr);
+            if(err != DmtxPass || *ptr != '\0' || opt->scan.dpi < 1)
                FatalError(EX_USAGE, _("Invalid resolution specified \"%s\""), optarg);
             break;
          case 's':
             /* Determine correct barcode size and/or shape */
             if(*optarg == 'a') {
-               opt->sizeIdxExpected = DmtxSymbolShapeAuto;
+               opt->scan.sizeIdxExpected = DmtxSymbolShapeAuto;
             }
             else if(*optarg == 's') {
-               opt->sizeIdxExpected = DmtxSymbolSquareAuto;
+               opt->scan.sizeIdxExpected = DmtxSymbolSquareAuto;
             }
             else if(*optarg == 'r') {
-               opt->sizeIdxExpected = DmtxSymbolRectAuto;
+               opt->scan.sizeIdxExpected = DmtxSymbolRectAuto;
             }
             else {
                for(i = 0; i < DmtxSymbolSquareCount + DmtxSymbolRectCount; i++) {
                   if(strncmp(optarg, symbolSizes[i], 8) == 0) {
-                     opt->sizeIdxExpected = i;
+                     opt->scan.sizeIdxExpected = i;
                      break;
                   }
                }
@@ -367,40 +418,40 @@ HandleArgs(UserOptions *opt, int *fileIndex, int *argcp, char **argvp[])
             }
             break;
          case 't':
-            err = StringToInt(&(opt->edgeThresh), optarg, &ptr);
+            err = StringToInt(&(opt->scan.edgeThresh), optarg, &ptr);
             if(err != DmtxPass || *ptr != '\0' ||
-                  opt->edgeThresh < 1 || opt->edgeThresh > 100)
+                  opt->scan.edgeThresh < 1 || opt->scan.edgeThresh > 100)
                FatalError(EX_USAGE, _("Invalid edge threshold specified \"%s\""), optarg);
             break;
          case 'x':
-            opt->xMin = optarg;
+            opt->scan.xMin = optarg;
             break;
          case 'X':
-            opt->xMax = optarg;
+            opt->scan.xMax = optarg;
             break;
          case 'y':
-            opt->yMin = optarg;
+            opt->scan.yMin = optarg;
             break;
          case 'Y':
-            opt->yMax = optarg;
+            opt->scan.yMax = optarg;
             break;
          case 'v':
             opt->verbose = DmtxTrue;
             break;
          case 'C':
-            err = StringToInt(&(opt->correctionsMax), optarg, &ptr);
-            if(err != DmtxPass || opt->correctionsMax < 0 || *ptr != '\0')
+            err = StringToInt(&(opt->scan.correctionsMax), optarg, &ptr);
+            if(err != DmtxPass || opt->scan.correctionsMax < 0 || *ptr != '\0')
                FatalError(EX_USAGE, _("Invalid max corrections specified \"%s\""), optarg);
             break;
          case 'D':
             opt->diagnose = DmtxTrue;
             break;
          case 'M':
-            opt->mosaic = DmtxTrue;
+            opt->scan.mosaic = DmtxTrue;
             break;
          case 'N':
-            err = StringToInt(&(opt->stopAfter), optarg, &ptr);
-            if(err != DmtxPass || opt->stopAfter < 1 || *ptr != '\0')
+            err = StringToInt(&(opt->scan.stopAfter), optarg, &ptr);
+            if(err != DmtxPass || opt->scan.stopAfter < 1 || *ptr != '\0')
                FatalError(EX_USAGE, _("Invalid count specified \"%s\""), optarg);
             break;
          case 'P':
@@ -410,19 +461,19 @@ HandleArgs(UserOptions *opt, int *fileIndex, int *argcp, char **argvp[])
             opt->corners = DmtxTrue;
             break;
          case 'S':
-            err = StringToInt(&(opt->shrinkMin), optarg, &ptr);
-            if(err != DmtxPass || opt->shrinkMin < 1 || *ptr != '\0')
+            err = StringToInt(&(opt->scan.shrinkMin), optarg, &ptr);
+            if(err != DmtxPass || opt->scan.shrinkMin < 1 || *ptr != '\0')
                FatalError(EX_USAGE, _("Invalid shrink factor specified \"%s\""), optarg);
 
             /* XXX later populate shrinkMax based on specified N-N range */
-            opt->shrinkMax = opt->shrinkMin;
+            opt->scan.shrinkMax = opt->scan.shrinkMin;
             break;
          case 'U':
             opt->unicode = DmtxTrue;
             break;
          case 'G':
-            err = StringToInt(&(opt->gs1), optarg, &ptr);
-            if(err != DmtxPass || opt->gs1 <= 0 || opt->gs1 > 255 || *ptr != '\0')
+            err = StringToInt(&(opt->scan.gs1), optarg, &ptr);
+            if(err != DmtxPass || opt->scan.gs1 <= 0 || opt->scan.gs1 > 255 || *ptr != '\0')
                FatalError(EX_USAGE, _("Invalid gs1 character specified \"%s\""), optarg);
             break;
          case 'V':
@@ -437,6 +488,19 @@ HandleArgs(UserOptions *opt, int *fileIndex, int *argcp, char **argvp[])
    }
    *fileIndex = optind;
 
+   if(opt->watchDir == NULL && (opt->doneDir != NULL || opt->failedDir != NULL))
+      FatalError(EX_USAGE, _("--done-dir and --failed-dir require --watch"));
+
+   /* Files moved into the watched directory would be picked up again */
+   if(opt->doneDir != NULL && IsSameDirectory(opt->doneDir, opt->watchDir) == DmtxTrue)
+      FatalError(EX_USAGE, _("--done-dir cannot be the watched directory"));
+   if(opt->failedDir != NULL && IsSameDirectory(opt->failedDir, opt->watchDir) == DmtxTrue)
+      FatalError(EX_USAGE, _("--failed-dir cannot be the watched directory"));
+
+   /* The symbol count behind --stop-after never resets while watching */
+   if(opt->watchDir != NULL && opt->scan.stopAfter != DmtxUndefined)
+      FatalError(EX_USAGE, _("--stop-after cannot be used with --watch"));
+
    return DmtxPass;
 }
 
@@ -457,6 +521,8 @@ ShowUsage(int status)
       fprintf(stderr, _("\
 Scan image FILE for Data Matrix barcodes and print decoded results to\n\
 standard output.  Note that %s may find multiple barcodes in one image.\n\
+FILE may also be a tar or zip archive, whose images are scanned in place and\n\
+reported with the member name before each message.\n\
 \n\
 Example: Scan top third of IMAGE001.png and stop after first barcode is found:\n\
 \n\
@@ -468,10 +534,46 @@ OPTIONS:\n"), programName, programName);
   -e, --minimum-edge=N        pixel length of smallest expected edge in image\n\
   -E, --maximum-edge=N        pixel length of largest expected edge in image\n\
   -g, --gap=N                 use scan grid with gap of N pixels between lines\n\
+  -j, --workers=N             scan files in N crash-isolated worker processes\n\
+      --worker-timeout=N      restart a worker stuck on one file for N milliseconds\n\
   -l, --list-formats          list supported image formats\n"));
       fprintf(stderr, _("\
   -m, --milliseconds=N        stop scan after N milliseconds (per image)\n\
+      --deadline=N            skip a file not finished within N milliseconds\n\
+      --magick-threads=N      limit ImageMagick to N threads per process\n\
+      --magick-memory=SIZE    limit ImageMagick heap pixel cache (e.g. 512M)\n\
+      --magick-map=SIZE       limit ImageMagick memory-mapped pixel cache\n\
+      --magick-area=SIZE      limit pixels in one image held in memory\n\
+      --magick-disk=SIZE      limit ImageMagick disk pixel cache\n\
+      --no-disk-cache         fail instead of spilling pixels to disk\n\
+      --memory-limit=SIZE     keep concurrent scans within SIZE bytes, scanning\n\
+                              oversized pages in bands\n\
+      --stream                scan every page in bands, reading PNM input\n\
+                              incrementally instead of loading whole pages\n\
+      --band-height=N         use bands of N rows when scanning in bands\n\
+      --magick-fax            read fax TIFF images through ImageMagick instead\n\
+                              of the built-in G3/G4 decoder\n\
+      --rasterize-pdf         render every PDF page instead of decoding the\n\
+                              embedded image of scanned pages\n\
+      --locate-resolution=N   find symbols on vector pages at N dpi, then scan\n\
+                              only around them at --resolution or a resolution\n\
+                              chosen from their size\n\
+      --watch=DIR             keep running and scan files as they are written\n\
+                              to or moved into DIR, prefixing each message with\n\
+                              its file name, until interrupted\n\
+      --done-dir=DIR          with --watch, move scanned files to DIR instead of\n\
+                              adding a .done suffix\n\
+      --failed-dir=DIR        with --watch, move unreadable files to DIR instead\n\
+                              of adding a .failed suffix\n\
   -n, --newline               print newline character at the end of decoded data\n\
+      --output-format=FORMAT  print each barcode as a record with its file, page,\n\
+                              message, size, rotation, corners and timing\n\
+        text = Decoded message only, options below add detail [default]\n\
+       jsonl = One JSON object per line\n\
+         xml = One <barcode> element per barcode\n\
+      binary = Length-prefixed binary records (see dmtxquery)\n\
+      --output-socket=PATH    write results to the Unix socket PATH instead of\n\
+                              standard output\n\
   -p, --page=N                only scan Nth page of images\n\
   -q, --square-deviation=N    allow non-squareness of corners in degrees (0-90)\n\
   -r, --resolution=N          resolution for vector images (PDF, SVG, etc...)\n"));
@@ -508,135 +610,588 @@ OPTIONS:\n"), programName, programName);
 }
 
 /**
- *
- *
+ * @brief  Print each decoded symbol as the scan session reports it
+ * @param  result decoded symbol details
+ * @param  userData scan context
+ * @return DmtxPass | DmtxFail
  */
 static DmtxPassFail
-SetDecodeOptions(DmtxDecode *dec, DmtxImage *img, UserOptions *opt)
+HandleSymbol(DmtxScanResult *result, void *userData)
 {
-   int err;
+   ScanContext *ctx = (ScanContext *)userData;
 
-#define RETURN_IF_FAILED(e) if(e != DmtxPass) { return DmtxFail; }
+   /* Records carry everything the text options would add */
+   if(ctx->opt->outputFormat != OutputText)
+      return PrintRecord(result, ctx);
 
-   err = dmtxDecodeSetProp(dec, DmtxPropScanGap, opt->scanGap);
-   RETURN_IF_FAILED(err)
+   PrintStats(result, ctx);
 
-   if(opt->gs1 != DmtxUndefined) {
-      err = dmtxDecodeSetProp(dec, DmtxPropFnc1, opt->gs1);
-      RETURN_IF_FAILED(err)
-   }
+   /* Watched files are gone by the time messages are read, so name them */
+   if(ctx->opt->watchDir != NULL)
+      fprintf(ctx->fpOut, "%s:", result->source);
+   else if(result->member != NULL)
+      fprintf(ctx->fpOut, "%s:", result->member);
+
+   PrintMessage(result->reg, result->msg, ctx);
 
-   if(opt->edgeMin != DmtxUndefined) {
-      err = dmtxDecodeSetProp(dec, DmtxPropEdgeMin, opt->edgeMin);
-      RETURN_IF_FAILED(err)
+   return DmtxPass;
+}
+
+/**
+ * @brief  Write diagnostic image after each page if requested
+ * @param  page completed page details
+ * @param  userData scan context
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+HandlePage(DmtxScanPage *page, void *userData)
+{
+   ScanContext *ctx = (ScanContext *)userData;
+
+   if(ctx->opt->verbose == DmtxTrue && page->blank == DmtxTrue)
+      fprintf(ctx->fpErr, "%s: page %d of \"%s\" is blank, skipped\n", programName,
+            page->pageIndex + 1, page->source);
+
+   /* Pages scanned in bands have no whole-page decoder to draw */
+   if(ctx->opt->diagnose == DmtxTrue && page->dec != NULL)
+      WriteDiagnosticImage(page->dec, "debug.pnm");
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Map scan session status to program exit code
+ * @param  status scan session status
+ * @return Exit code returned to OS
+ */
+static int
+GetExitStatus(DmtxScanStatus status)
+{
+   switch(status) {
+      case DmtxScanOk:
+         return EX_OK;
+      case DmtxScanErrorArgument:
+         return EX_USAGE;
+      case DmtxScanErrorDecode:
+      case DmtxScanErrorCallback:
+         return EX_SOFTWARE;
+      case DmtxScanErrorDeadline:
+         return EX_TEMPFAIL;
+      default:
+         break;
    }
 
-   if(opt->edgeMax != DmtxUndefined) {
-      err = dmtxDecodeSetProp(dec, DmtxPropEdgeMax, opt->edgeMax);
-      RETURN_IF_FAILED(err)
+   return EX_OSERR;
+}
+
+/**
+ * @brief  Scan files in a pool of pre-forked worker processes
+ * @param  ctx scan context (session is created inside each worker)
+ * @param  files list of image paths
+ * @param  fileCount number of image paths
+ * @return Exit code returned to OS
+ */
+static int
+ScanFilesWithPool(ScanContext *ctx, char **files, int fileCount)
+{
+   int i;
+   int symbolCount;
+   int firstFailure;
+   ProcessPool *pool;
+
+   pool = CreatePool(ctx);
+
+   for(i = 0; i < fileCount; i++) {
+      if(PoolSubmit(pool, files[i]) != DmtxPass)
+         FatalError(EX_OSERR, "malloc() error");
    }
 
-   if(opt->squareDevn != DmtxUndefined) {
-      err = dmtxDecodeSetProp(dec, DmtxPropSquareDevn, opt->squareDevn);
-      RETURN_IF_FAILED(err)
+   while(PoolPending(pool) > 0) {
+      if(PoolPoll(pool, -1, -1) == -1)
+         FatalError(EX_OSERR, _("Lost contact with worker processes"));
    }
 
-   err = dmtxDecodeSetProp(dec, DmtxPropSymbolSize, opt->sizeIdxExpected);
-   RETURN_IF_FAILED(err)
+   symbolCount = PoolGetSymbolCount(pool);
+   firstFailure = PoolGetFirstFailure(pool);
+
+   PoolDestroy(&pool);
+
+   /* Failed files are reported as they happen, but still affect exit code */
+   if(firstFailure == PoolStatusCrashed || firstFailure == PoolStatusTimedOut)
+      return EX_SOFTWARE;
+   else if(firstFailure != DmtxUndefined)
+      return firstFailure;
+
+   return (symbolCount > 0) ? EX_OK : 1;
+}
+
+/**
+ * @brief  Start worker processes sized by the runtime options
+ * @param  ctx scan context (session is created inside each worker)
+ * @return Address of new pool
+ */
+static ProcessPool *
+CreatePool(ScanContext *ctx)
+{
+   int taskTimeoutMS;
+   UserOptions *opt = ctx->opt;
+   ProcessPool *pool;
+
+   /* Loading can sit in a delegate (e.g. Ghostscript) that never checks
+    * the deadline, so the supervisor enforces it too with some slack */
+   taskTimeoutMS = opt->workerTimeoutMS;
+   if(taskTimeoutMS == DmtxUndefined && opt->scan.deadlineMS != DmtxUndefined)
+      taskTimeoutMS = opt->scan.deadlineMS + DMTXREAD_DEADLINE_GRACE_MS;
 
-   err = dmtxDecodeSetProp(dec, DmtxPropEdgeThresh, opt->edgeThresh);
-   RETURN_IF_FAILED(err)
+   pool = PoolCreate(opt->workers, taskTimeoutMS, WorkerInit, ScanFileTask, ctx);
+   if(pool == NULL)
+      FatalError(EX_OSERR, _("Unable to start worker processes"));
 
-   if(opt->xMin) {
-      err = dmtxDecodeSetProp(dec, DmtxPropXmin, ScaleNumberString(opt->xMin, img->width));
-      RETURN_IF_FAILED(err)
+   PoolSetMemoryLimit(pool, opt->scan.memoryLimit);
+   PoolSetSymbolLimit(pool, opt->scan.stopAfter);
+
+   return pool;
+}
+
+/**
+ * @brief  Scan files dropped into a hot folder until interrupted
+ * @param  ctx scan context, with a session unless --workers was given
+ * @return Exit code returned to OS
+ *
+ * The process, and ImageMagick with it, stays initialized between files.
+ * With --workers, files are queued to the pool as soon as they land and
+ * moved once their output has been written. SIGINT or SIGTERM stops
+ * picking up files; files already being scanned are finished first.
+ */
+static int
+WatchDirectory(ScanContext *ctx)
+{
+   int ready;
+   const char *path;
+   UserOptions *opt = ctx->opt;
+   ProcessPool *pool;
+   DmtxScanStatus status;
+#ifdef HAVE_SYS_INOTIFY_H
+   struct pollfd fds;
+#endif
+
+   /* Installed before forking so a terminal interrupt also lets each
+    * worker finish its current file rather than killing it */
+   signal(SIGINT, StopWatching);
+   signal(SIGTERM, StopWatching);
+
+   pool = NULL;
+   if(opt->workers != DmtxUndefined) {
+      pool = CreatePool(ctx);
+      PoolSetDoneCallback(pool, FinishWatchedFile);
    }
 
-   if(opt->xMax) {
-      err = dmtxDecodeSetProp(dec, DmtxPropXmax, ScaleNumberString(opt->xMax, img->width));
-      RETURN_IF_FAILED(err)
+   ctx->watch = WatchCreate(opt->watchDir, opt->doneDir, opt->failedDir);
+   if(ctx->watch == NULL)
+      FatalError(EX_OSERR, _("Unable to watch \"%s\": %s"), opt->watchDir, strerror(errno));
+
+   while(watchStop == 0) {
+      if(pool != NULL) {
+         while((path = WatchNext(ctx->watch)) != NULL) {
+            if(PoolSubmit(pool, path) != DmtxPass)
+               FatalError(EX_OSERR, "malloc() error");
+         }
+
+         ready = PoolPoll(pool, WatchGetFd(ctx->watch), -1);
+         if(ready == -1)
+            FatalError(EX_OSERR, _("Lost contact with worker processes"));
+      }
+      else if((path = WatchNext(ctx->watch)) != NULL) {
+         status = dmtxScanFile(ctx->scan, path);
+         PrintPeakMemory(ctx, path);
+         if(status != DmtxScanOk)
+            fprintf(ctx->fpErr, "%s: %s\n", programName, dmtxScanGetError(ctx->scan));
+         fflush(ctx->fpOut);
+
+         FinishWatchedFile(path, GetExitStatus(status), ctx);
+
+         /* Pick up files that arrived during the scan */
+         ready = 1;
+      }
+      else {
+#ifdef HAVE_SYS_INOTIFY_H
+         fds.fd = WatchGetFd(ctx->watch);
+         fds.events = POLLIN;
+         fds.revents = 0;
+
+         ready = poll(&fds, 1, -1);
+         if(ready == -1 && errno != EINTR)
+            FatalError(EX_OSERR, _("Unable to wait for files: %s"), strerror(errno));
+#else
+         ready = -1;
+#endif
+      }
+
+      if(ready > 0 && WatchRead(ctx->watch) != DmtxPass)
+         FatalError(EX_OSERR, _("Lost watch on \"%s\": %s"), opt->watchDir, strerror(errno));
    }
 
-   if(opt->yMin) {
-      err = dmtxDecodeSetProp(dec, DmtxPropYmin, ScaleNumberString(opt->yMin, img->height));
-      RETURN_IF_FAILED(err)
+   /* Files still queued stay in place and are picked up by the next run */
+   if(pool != NULL) {
+      PoolStopDispatch(pool);
+      while(PoolPending(pool) > 0) {
+         if(PoolPoll(pool, -1, -1) == -1)
+            FatalError(EX_OSERR, _("Lost contact with worker processes"));
+      }
+      PoolDestroy(&pool);
    }
 
-   if(opt->yMax) {
-      err = dmtxDecodeSetProp(dec, DmtxPropYmax, ScaleNumberString(opt->yMax, img->height));
-      RETURN_IF_FAILED(err)
+   WatchDestroy(&ctx->watch);
+
+   return EX_OK;
+}
+
+/**
+ * @brief  Move a watched file aside once its output has been written
+ * @param  path path of the scanned file
+ * @param  status exit code for this file
+ * @param  userData scan context
+ * @return void
+ */
+static void
+FinishWatchedFile(const char *path, int status, void *userData)
+{
+   ScanContext *ctx = (ScanContext *)userData;
+
+   /* Failures are reported by the watch, and the file stays for next run */
+   WatchFinish(ctx->watch, path, (status == EX_OK) ? DmtxTrue : DmtxFalse);
+}
+
+/**
+ * @brief  Ask --watch to stop after the files in progress
+ * @param  sig signal number
+ * @return void
+ */
+static void
+StopWatching(int sig)
+{
+   watchStop = 1;
+
+   /* A second interrupt does not wait */
+   signal(sig, SIG_DFL);
+}
+
+/**
+ * @brief  Check that a path names an existing directory
+ * @param  path directory path
+ * @return DmtxTrue | DmtxFalse
+ */
+static DmtxBoolean
+IsDirectory(const char *path)
+{
+   struct stat info;
+
+   return (stat(path, &info) == 0 && S_ISDIR(info.st_mode)) ? DmtxTrue : DmtxFalse;
+}
+
+/**
+ * @brief  Check whether two paths resolve to the same directory
+ * @param  path1 directory path
+ * @param  path2 directory path
+ * @return DmtxTrue | DmtxFalse (also when either cannot be resolved)
+ */
+static DmtxBoolean
+IsSameDirectory(const char *path1, const char *path2)
+{
+   char *real1, *real2;
+   DmtxBoolean same;
+
+   real1 = realpath(path1, NULL);
+   real2 = realpath(path2, NULL);
+
+   same = (real1 != NULL && real2 != NULL && strcmp(real1, real2) == 0) ? DmtxTrue : DmtxFalse;
+
+   free(real1);
+   free(real2);
+
+   return same;
+}
+
+/**
+ * @brief  Prepare a scan session once per worker process
+ * @param  userData scan context
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+WorkerInit(void *userData)
+{
+   ScanContext *ctx = (ScanContext *)userData;
+
+   /* The document belongs to the supervisor, even if a worker exits */
+   xmlOpen = DmtxFalse;
+
+   dmtxScanGenesis();
+
+   if(SetResourceLimits(ctx->opt, ctx->opt->workers) != DmtxPass) {
+      fprintf(stderr, "%s: %s\n", programName, _("Unable to apply ImageMagick resource limits"));
+      return DmtxFail;
    }
 
-#undef RETURN_IF_FAILED
+   ctx->scan = dmtxScanCreate(&(ctx->opt->scan));
+   if(ctx->scan == NULL)
+      return DmtxFail;
+
+   dmtxScanSetCallbacks(ctx->scan, HandleSymbol, HandlePage, ctx);
+
+   /* Workers share --memory-limit through the supervisor */
+   if(ctx->opt->scan.memoryLimit != 0)
+      dmtxScanSetReserveCallback(ctx->scan, ReserveMemory);
 
    return DmtxPass;
 }
 
+/**
+ * @brief  Apply ImageMagick resource limits for this process
+ * @param  opt runtime options
+ * @param  processCount number of scanning processes sharing the host
+ * @return DmtxPass | DmtxFail
+ *
+ * Limits not given on the command line keep Magick's defaults, except
+ * that worker processes use one thread each and split the memory and
+ * map limits between them so that N workers do not oversubscribe the
+ * cores and memory that Magick sized for a single process. The memory
+ * limit never exceeds --memory-limit.
+ */
+static DmtxPassFail
+SetResourceLimits(UserOptions *opt, int processCount)
+{
+   int i;
+   MagickSizeType value;
+   static const ResourceType resourceType[LimitCount] = {
+         ThreadResource, MemoryResource, MapResource, AreaResource, DiskResource };
+
+   for(i = 0; i < LimitCount; i++) {
+      if(opt->limitSet[i] == DmtxTrue) {
+         value = (MagickSizeType)opt->limit[i];
+      }
+      else if(processCount > 1 && i == LimitThread) {
+         value = 1;
+      }
+      else if(processCount > 1 && (i == LimitMemory || i == LimitMap)) {
+         value = MagickGetResourceLimit(resourceType[i]);
+         if(RESOURCE_UNLIMITED(value)) {
+            /* An unlimited pixel cache is still held to --memory-limit */
+            if(i != LimitMemory || opt->scan.memoryLimit == 0)
+               continue;
+            value = opt->scan.memoryLimit / processCount;
+         }
+         else {
+            value /= processCount;
+         }
+      }
+      else if(i != LimitMemory || opt->scan.memoryLimit == 0) {
+         continue;
+      }
+      else {
+         value = MagickGetResourceLimit(resourceType[i]);
+      }
+
+      /* Pixel cache beyond --memory-limit goes to map or disk instead */
+      if(i == LimitMemory && opt->limitSet[i] == DmtxFalse &&
+            opt->scan.memoryLimit != 0 && value > opt->scan.memoryLimit)
+         value = opt->scan.memoryLimit;
+
+      if(MagickSetResourceLimit(resourceType[i], value) == MagickFalse)
+         return DmtxFail;
+   }
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Print effective ImageMagick resource limits
+ * @param  fp output stream
+ * @return void
+ */
+static void
+PrintResourceLimits(FILE *fp)
+{
+   int i;
+   double value;
+   MagickSizeType limit;
+   static const ResourceType resourceType[LimitCount] = {
+         ThreadResource, MemoryResource, MapResource, AreaResource, DiskResource };
+   static const char *label[LimitCount] = {
+         "    Magick Threads", "     Magick Memory", "        Magick Map",
+         "       Magick Area", "       Magick Disk" };
+
+   fprintf(fp, "--------------------------------------------------\n");
+   for(i = 0; i < LimitCount; i++) {
+      limit = MagickGetResourceLimit(resourceType[i]);
+      value = (double)limit;
+
+      if(RESOURCE_UNLIMITED(limit))
+         fprintf(fp, "%s: unlimited\n", label[i]);
+      else if(i == LimitThread)
+         fprintf(fp, "%s: %.0f\n", label[i], value);
+      else if(i == LimitArea)
+         fprintf(fp, "%s: %.1f megapixels\n", label[i], value / 1000000.0);
+      else if(value >= 1024.0 * 1024.0 * 1024.0)
+         fprintf(fp, "%s: %.1f GiB\n", label[i], value / (1024.0 * 1024.0 * 1024.0));
+      else
+         fprintf(fp, "%s: %.1f MiB\n", label[i], value / (1024.0 * 1024.0));
+   }
+   fprintf(fp, "--------------------------------------------------\n");
+}
+
+/**
+ * @brief  Wait for the supervisor to admit a file under --memory-limit
+ * @param  bytes estimated footprint of the file
+ * @param  userData scan context (unused)
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+ReserveMemory(size_t bytes, void *userData)
+{
+   (void)userData;
+
+   return PoolReserveMemory(bytes);
+}
+
+/**
+ * @brief  Show the peak resident set size after each file in verbose mode
+ * @param  ctx output streams and runtime options
+ * @param  path file just scanned
+ * @return void
+ *
+ * With --workers the figure is that of the worker that scanned the file,
+ * covering every file it has scanned so far.
+ */
+static void
+PrintPeakMemory(ScanContext *ctx, const char *path)
+{
+   double peak;
+
+   if(ctx->opt->verbose == DmtxFalse)
+      return;
+
+   peak = GetPeakMemoryMiB();
+   if(peak >= 0.0)
+      fprintf(ctx->fpErr, "%s: peak memory %0.1f MiB after \"%s\"\n", programName, peak, path);
+}
+
+/**
+ * @brief  Largest resident set size of this process so far
+ * @return Peak RSS in MiB, or -1.0 if unknown
+ */
+static double
+GetPeakMemoryMiB(void)
+{
+#if defined(HAVE_SYS_RESOURCE_H) && defined(HAVE_GETRUSAGE)
+   struct rusage usage;
+
+   if(getrusage(RUSAGE_SELF, &usage) != 0)
+      return -1.0;
+
+   /* Linux and the BSDs report kilobytes, Darwin reports bytes */
+#ifdef __APPLE__
+   return (double)usage.ru_maxrss / (1024.0 * 1024.0);
+#else
+   return (double)usage.ru_maxrss / 1024.0;
+#endif
+#else
+   return -1.0;
+#endif
+}
+
+/**
+ * @brief  Scan one file inside a worker, writing to captured streams
+ * @param  path image path
+ * @param  fpOut stream receiving decoded messages
+ * @param  fpErr stream receiving stats and errors
+ * @param  symbolCount pointer to count of symbols decoded from this file
+ * @param  userData scan context
+ * @return Exit code for this file
+ */
+static int
+ScanFileTask(const char *path, FILE *fpOut, FILE *fpErr, int *symbolCount, void *userData)
+{
+   int countBefore;
+   DmtxScanStatus status;
+   ScanContext *ctx = (ScanContext *)userData;
+
+   ctx->fpOut = fpOut;
+   ctx->fpErr = fpErr;
+
+   /* Show each worker's limits once, with its first file */
+   if(ctx->opt->verbose == DmtxTrue && ctx->limitsReported == DmtxFalse) {
+      PrintResourceLimits(fpErr);
+      ctx->limitsReported = DmtxTrue;
+   }
+
+   /* The supervisor's budget keeps --stop-after global across workers */
+   countBefore = dmtxScanGetSymbolCount(ctx->scan);
+   if(*symbolCount != DmtxUndefined)
+      dmtxScanSetStopAfter(ctx->scan, countBefore + *symbolCount);
+   status = dmtxScanFile(ctx->scan, path);
+   *symbolCount = dmtxScanGetSymbolCount(ctx->scan) - countBefore;
+   PrintPeakMemory(ctx, path);
+
+   if(status != DmtxScanOk)
+      fprintf(fpErr, "%s: %s\n", programName, dmtxScanGetError(ctx->scan));
+
+   return GetExitStatus(status);
+}
+
 /**
  * @brief  Print decoded message to standard output
- * @param  opt runtime options from defaults or command line
- * @param  dec pointer to DmtxDecode struct
+ * @param  result decoded symbol details
+ * @param  ctx output streams and runtime options
  * @return DmtxPass | DmtxFail
  */
 static DmtxPassFail
-PrintStats(DmtxDecode *dec, DmtxRegion *reg, DmtxMessage *msg,
-      int imgPageIndex, UserOptions *opt)
+PrintStats(DmtxScanResult *result, ScanContext *ctx)
 {
    int height;
    int dataWordLength;
-   int rotateInt;
-   double rotate;
+   UserOptions *opt = ctx->opt;
+   DmtxRegion *reg = result->reg;
+   DmtxMessage *msg = result->msg;
    DmtxVector2 p00, p10, p11, p01;
 
-   height = dmtxDecodeGetProp(dec, DmtxPropHeight);
+   height = result->height;
 
-   p00.X = p00.Y = p10.Y = p01.X = 0.0;
-   p10.X = p01.Y = p11.X = p11.Y = 1.0;
-   dmtxMatrix3VMultiplyBy(&p00, reg->fit2raw);
-   dmtxMatrix3VMultiplyBy(&p10, reg->fit2raw);
-   dmtxMatrix3VMultiplyBy(&p11, reg->fit2raw);
-   dmtxMatrix3VMultiplyBy(&p01, reg->fit2raw);
+   p00 = result->corner[0];
+   p10 = result->corner[1];
+   p11 = result->corner[2];
+   p01 = result->corner[3];
 
    dataWordLength = dmtxGetSymbolAttribute(DmtxSymAttribSymbolDataWords, reg->sizeIdx);
    if(opt->verbose == DmtxTrue) {
-
-/*    rotate = (2 * M_PI) + (atan2(reg->fit2raw[0][1], reg->fit2raw[1][1]) -
-            atan2(reg->fit2raw[1][0], reg->fit2raw[0][0])) / 2.0; */
-      rotate = (2 * M_PI) + atan2(p10.Y - p00.Y, p10.X - p00.X);
-
-      rotateInt = (int)(rotate * 180/M_PI + 0.5);
-      if(rotateInt >= 360)
-         rotateInt -= 360;
-
-      fprintf(stderr, "--------------------------------------------------\n");
-      fprintf(stderr, "       Matrix Size: %d x %d\n",
+      fprintf(ctx->fpErr, "--------------------------------------------------\n");
+      fprintf(ctx->fpErr, "       Matrix Size: %d x %d\n",
             dmtxGetSymbolAttribute(DmtxSymAttribSymbolRows, reg->sizeIdx),
             dmtxGetSymbolAttribute(DmtxSymAttribSymbolCols, reg->sizeIdx));
-      fprintf(stderr, "    Data Codewords: %d (capacity %d)\n",
+      fprintf(ctx->fpErr, "    Data Codewords: %d (capacity %d)\n",
             dataWordLength - msg->padCount, dataWordLength);
-      fprintf(stderr, "   Error Codewords: %d\n",
+      fprintf(ctx->fpErr, "   Error Codewords: %d\n",
             dmtxGetSymbolAttribute(DmtxSymAttribSymbolErrorWords, reg->sizeIdx));
-      fprintf(stderr, "      Data Regions: %d x %d\n",
+      fprintf(ctx->fpErr, "      Data Regions: %d x %d\n",
             dmtxGetSymbolAttribute(DmtxSymAttribHorizDataRegions, reg->sizeIdx),
             dmtxGetSymbolAttribute(DmtxSymAttribVertDataRegions, reg->sizeIdx));
-      fprintf(stderr, "Interleaved Blocks: %d\n",
+      fprintf(ctx->fpErr, "Interleaved Blocks: %d\n",
             dmtxGetSymbolAttribute(DmtxSymAttribInterleavedBlocks, reg->sizeIdx));
-      fprintf(stderr, "    Rotation Angle: %d\n", rotateInt);
-      fprintf(stderr, "          Corner 0: (%0.1f, %0.1f)\n", p00.X, height - 1 - p00.Y);
-      fprintf(stderr, "          Corner 1: (%0.1f, %0.1f)\n", p10.X, height - 1 - p10.Y);
-      fprintf(stderr, "          Corner 2: (%0.1f, %0.1f)\n", p11.X, height - 1 - p11.Y);
-      fprintf(stderr, "          Corner 3: (%0.1f, %0.1f)\n", p01.X, height - 1 - p01.Y);
-      fprintf(stderr, "--------------------------------------------------\n");
+      fprintf(ctx->fpErr, "    Rotation Angle: %d\n", result->rotation);
+      fprintf(ctx->fpErr, "          Corner 0: (%0.1f, %0.1f)\n", p00.X, height - 1 - p00.Y);
+      fprintf(ctx->fpErr, "          Corner 1: (%0.1f, %0.1f)\n", p10.X, height - 1 - p10.Y);
+      fprintf(ctx->fpErr, "          Corner 2: (%0.1f, %0.1f)\n", p11.X, height - 1 - p11.Y);
+      fprintf(ctx->fpErr, "          Corner 3: (%0.1f, %0.1f)\n", p01.X, height - 1 - p01.Y);
+      fprintf(ctx->fpErr, "--------------------------------------------------\n");
    }
 
    if(opt->pageNumbers == DmtxTrue)
-      fprintf(stderr, "%d:", imgPageIndex + 1);
+      fprintf(ctx->fpErr, "%d:", result->pageIndex + 1);
 
    if(opt->corners == DmtxTrue) {
-      fprintf(stderr, "%d,%d:", (int)(p00.X + 0.5), height - 1 - (int)(p00.Y + 0.5));
-      fprintf(stderr, "%d,%d:", (int)(p10.X + 0.5), height - 1 - (int)(p10.Y + 0.5));
-      fprintf(stderr, "%d,%d:", (int)(p11.X + 0.5), height - 1 - (int)(p11.Y + 0.5));
-      fprintf(stderr, "%d,%d:", (int)(p01.X + 0.5), height - 1 - (int)(p01.Y + 0.5));
+      fprintf(ctx->fpErr, "%d,%d:", (int)(p00.X + 0.5), height - 1 - (int)(p00.Y + 0.5));
+      fprintf(ctx->fpErr, "%d,%d:", (int)(p10.X + 0.5), height - 1 - (int)(p10.Y + 0.5));
+      fprintf(ctx->fpErr, "%d,%d:", (int)(p11.X + 0.5), height - 1 - (int)(p11.Y + 0.5));
+      fprintf(ctx->fpErr, "%d,%d:", (int)(p01.X + 0.5), height - 1 - (int)(p01.Y + 0.5));
    }
 
    return DmtxPass;
@@ -647,70 +1202,442 @@ PrintStats(DmtxDecode *dec, DmtxRegion *reg, DmtxMessage *msg,
  *
  */
 static DmtxPassFail
-PrintMessage(DmtxRegion *reg, DmtxMessage *msg, UserOptions *opt)
+PrintMessage(DmtxRegion *reg, DmtxMessage *msg, ScanContext *ctx)
 {
    int i;
    int remainingDataWords;
    int dataWordLength;
+   UserOptions *opt = ctx->opt;
 
    if(opt->codewords == DmtxTrue) {
       dataWordLength = dmtxGetSymbolAttribute(DmtxSymAttribSymbolDataWords, reg->sizeIdx);
       for(i = 0; i < msg->codeSize; i++) {
          remainingDataWords = dataWordLength - i;
          if(remainingDataWords > msg->padCount)
-            fprintf(stdout, "%c:%03d\n", 'd', msg->code[i]);
+            fprintf(ctx->fpOut, "%c:%03d\n", 'd', msg->code[i]);
          else if(remainingDataWords > 0)
-            fprintf(stdout, "%c:%03d\n", 'p', msg->code[i]);
+            fprintf(ctx->fpOut, "%c:%03d\n", 'p', msg->code[i]);
          else
-            fprintf(stdout, "%c:%03d\n", 'e', msg->code[i]);
+            fprintf(ctx->fpOut, "%c:%03d\n", 'e', msg->code[i]);
       }
    }
    else {
       if(opt->unicode == DmtxTrue) {
          for(i = 0; i < msg->outputIdx; i++) {
             if(msg->output[i] < 128) {
-               fputc(msg->output[i], stdout);
+               fputc(msg->output[i], ctx->fpOut);
             }
             else if(msg->output[i] < 192) {
-              fputc(0xc2, stdout);
-              fputc(msg->output[i], stdout);
+              fputc(0xc2, ctx->fpOut);
+              fputc(msg->output[i], ctx->fpOut);
             }
             else {
-               fputc(0xc3, stdout);
-               fputc(msg->output[i] - 64, stdout);
+               fputc(0xc3, ctx->fpOut);
+               fputc(msg->output[i] - 64, ctx->fpOut);
             }
          }
       }
       else {
-         fwrite(msg->output, sizeof(char), msg->outputIdx, stdout);
+         fwrite(msg->output, sizeof(char), msg->outputIdx, ctx->fpOut);
       }
 
       if(opt->newline)
-         fputc('\n', stdout);
+         fputc('\n', ctx->fpOut);
+   }
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Send standard output to a listening Unix socket
+ * @param  path socket path
+ * @return void
+ *
+ * Replacing the descriptor itself means worker output relayed by the
+ * pool reaches the socket too.
+ */
+static void
+ConnectOutput(const char *path)
+{
+#if defined(HAVE_SYS_SOCKET_H) && defined(HAVE_SYS_UN_H)
+   int fd;
+   struct sockaddr_un addr;
+
+   memset(&addr, 0x00, sizeof(struct sockaddr_un));
+   addr.sun_family = AF_UNIX;
+   if(strlen(path) >= sizeof(addr.sun_path))
+      FatalError(EX_USAGE, _("Invalid socket path specified \"%s\""), path);
+   strcpy(addr.sun_path, path);
+
+   fd = socket(AF_UNIX, SOCK_STREAM, 0);
+   if(fd == -1 || connect(fd, (struct sockaddr *)&addr, sizeof(struct sockaddr_un)) != 0)
+      FatalError(EX_OSERR, _("Unable to connect to \"%s\": %s"), path, strerror(errno));
+
+   fflush(stdout);
+   if(dup2(fd, STDOUT_FILENO) == -1)
+      FatalError(EX_OSERR, _("Unable to connect to \"%s\": %s"), path, strerror(errno));
+   close(fd);
+#else
+   FatalError(EX_USAGE, _("Output sockets are not supported on this platform"));
+#endif
+}
+
+/**
+ * @brief  Prepare standard output for the selected format
+ * @param  opt runtime options
+ * @return void
+ *
+ * Record formats may produce millions of lines, so they get a larger
+ * buffer than the terminal default. Worker output is captured in memory
+ * and relayed through the same buffer.
+ */
+static void
+BeginOutput(UserOptions *opt)
+{
+   if(opt->outputFormat == OutputText)
+      return;
+
+   setvbuf(stdout, NULL, _IOFBF, DMTXREAD_OUTPUT_BUFFER);
+
+   if(opt->outputFormat == OutputXml) {
+      fputs("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<dmtxread>\n", stdout);
+
+      /* FatalError() exits from anywhere, so the root is closed on the way out */
+      xmlOpen = DmtxTrue;
+      atexit(EndOutput);
+   }
+   else if(opt->outputFormat == OutputBinary) {
+      RecordWriteHeader(stdout);
+   }
+}
+
+/**
+ * @brief  Close the document opened by BeginOutput
+ * @return void
+ *
+ * Safe to call more than once; it also runs from atexit().
+ */
+static void
+EndOutput(void)
+{
+   if(xmlOpen == DmtxTrue) {
+      fputs("</dmtxread>\n", stdout);
+      xmlOpen = DmtxFalse;
    }
 
+   fflush(stdout);
+}
+
+/**
+ * @brief  Write one decoded symbol as a JSON line, XML element or binary record
+ * @param  result decoded symbol details
+ * @param  ctx output streams and runtime options
+ * @return DmtxPass | DmtxFail
+ *
+ * Messages are written with each byte as the code point of the same
+ * value (ISO 8859-1), which keeps binary payloads lossless. XML cannot
+ * hold most control characters, so a message containing them is written
+ * in base64 instead. Corners use the same coordinates as --corners.
+ */
+static DmtxPassFail
+PrintRecord(DmtxScanResult *result, ScanContext *ctx)
+{
+   int i;
+   int height;
+   int fileLength;
+   int dataWordLength;
+   int sizeIdx;
+   DmtxBoolean printable;
+   FILE *fp = ctx->fpOut;
+   DmtxMessage *msg = result->msg;
+   ResultRecord rec;
+
+   height = result->height;
+   sizeIdx = result->reg->sizeIdx;
+   dataWordLength = dmtxGetSymbolAttribute(DmtxSymAttribSymbolDataWords, sizeIdx);
+
+   /* Archive sources are labeled "archive:member" */
+   fileLength = strlen(result->source);
+   if(result->member != NULL)
+      fileLength -= strlen(result->member) + 1;
+
+   if(ctx->opt->outputFormat == OutputBinary) {
+      memset(&rec, 0x00, sizeof(ResultRecord));
+      rec.type = RecordTypeSymbol;
+      rec.sizeIdx = sizeIdx;
+      rec.padCount = msg->padCount;
+      rec.rotation = result->rotation;
+      rec.pageIndex = result->pageIndex;
+      rec.elapsedMS = result->elapsedMS;
+      for(i = 0; i < 4; i++) {
+         rec.corner[2 * i] = (float)result->corner[i].X;
+         rec.corner[2 * i + 1] = (float)(height - 1 - result->corner[i].Y);
+      }
+      rec.file = result->source;
+      rec.fileLength = fileLength;
+      rec.member = result->member;
+      rec.memberLength = (result->member == NULL) ? 0 : strlen(result->member);
+      rec.message = msg->output;
+      rec.messageLength = msg->outputIdx;
+
+      return RecordWrite(fp, &rec);
+   }
+
+   if(ctx->opt->outputFormat == OutputJsonl) {
+      fputs("{\"file\":", fp);
+      WriteJsonString(fp, (const unsigned char *)result->source, fileLength, DmtxFalse);
+      if(result->member != NULL) {
+         fputs(",\"member\":", fp);
+         WriteJsonString(fp, (const unsigned char *)result->member,
+               strlen(result->member), DmtxFalse);
+      }
+      fprintf(fp, ",\"page\":%d,\"message\":", result->pageIndex + 1);
+      WriteJsonString(fp, msg->output, msg->outputIdx, DmtxTrue);
+      fprintf(fp, ",\"matrix_size\":\"%dx%d\",\"data_codewords\":%d,\"capacity\":%d,"
+            "\"error_codewords\":%d,\"data_regions_count\":%d,\"interleaved_blocks\":%d,"
+            "\"rotation\":%d,\"corners\":[",
+            dmtxGetSymbolAttribute(DmtxSymAttribSymbolRows, sizeIdx),
+            dmtxGetSymbolAttribute(DmtxSymAttribSymbolCols, sizeIdx),
+            dataWordLength - msg->padCount, dataWordLength,
+            dmtxGetSymbolAttribute(DmtxSymAttribSymbolErrorWords, sizeIdx),
+            dmtxGetSymbolAttribute(DmtxSymAttribHorizDataRegions, sizeIdx) *
+            dmtxGetSymbolAttribute(DmtxSymAttribVertDataRegions, sizeIdx),
+            dmtxGetSymbolAttribute(DmtxSymAttribInterleavedBlocks, sizeIdx),
+            result->rotation);
+      for(i = 0; i < 4; i++)
+         fprintf(fp, "%s[%0.1f,%0.1f]", (i == 0) ? "" : ",",
+               result->corner[i].X, height - 1 - result->corner[i].Y);
+      fprintf(fp, "],\"time_ms\":%ld}\n", result->elapsedMS);
+
+      return DmtxPass;
+   }
+
+   fputs(" <barcode file=\"", fp);
+   WriteXmlText(fp, (const unsigned char *)result->source, fileLength, DmtxFalse);
+   if(result->member != NULL) {
+      fputs("\" member=\"", fp);
+      WriteXmlText(fp, (const unsigned char *)result->member, strlen(result->member), DmtxFalse);
+   }
+   fprintf(fp, "\" page=\"%d\">\n", result->pageIndex + 1);
+
+   printable = DmtxTrue;
+   for(i = 0; i < msg->outputIdx; i++) {
+      if(msg->output[i] < 0x20 && msg->output[i] != '\t' &&
+            msg->output[i] != '\n' && msg->output[i] != '\r') {
+         printable = DmtxFalse;
+         break;
+      }
+   }
+
+   if(printable == DmtxTrue) {
+      fputs("  <message>", fp);
+      WriteXmlText(fp, msg->output, msg->outputIdx, DmtxTrue);
+   }
+   else {
+      fputs("  <message encoding=\"base64\">", fp);
+      WriteBase64(fp, msg->output, msg->outputIdx);
+   }
+   fputs("</message>\n", fp);
+
+   fprintf(fp, "  <matrix_size>%dx%d</matrix_size>\n",
+         dmtxGetSymbolAttribute(DmtxSymAttribSymbolRows, sizeIdx),
+         dmtxGetSymbolAttribute(DmtxSymAttribSymbolCols, sizeIdx));
+   fprintf(fp, "  <data_codewords capacity=\"%d\">%d</data_codewords>\n",
+         dataWordLength, dataWordLength - msg->padCount);
+   fprintf(fp, "  <error_codewords>%d</error_codewords>\n",
+         dmtxGetSymbolAttribute(DmtxSymAttribSymbolErrorWords, sizeIdx));
+   fprintf(fp, "  <data_regions_count>%d</data_regions_count>\n",
+         dmtxGetSymbolAttribute(DmtxSymAttribHorizDataRegions, sizeIdx) *
+         dmtxGetSymbolAttribute(DmtxSymAttribVertDataRegions, sizeIdx));
+   fprintf(fp, "  <interleaved_blocks>%d</interleaved_blocks>\n",
+         dmtxGetSymbolAttribute(DmtxSymAttribInterleavedBlocks, sizeIdx));
+   fprintf(fp, "  <rotation>%d</rotation>\n", result->rotation);
+   fputs("  <corners>", fp);
+   for(i = 0; i < 4; i++)
+      fprintf(fp, "<corner x=\"%0.1f\" y=\"%0.1f\"/>",
+            result->corner[i].X, height - 1 - result->corner[i].Y);
+   fputs("</corners>\n", fp);
+   fprintf(fp, "  <time_ms>%ld</time_ms>\n </barcode>\n", result->elapsedMS);
+
    return DmtxPass;
 }
 
 /**
+ * @brief  Write a quoted JSON string
+ * @param  fp output stream
+ * @param  str bytes to write
+ * @param  length byte count
+ * @param  latin1 DmtxTrue to escape bytes above 0x7f as code points, or
+ *         DmtxFalse to pass valid UTF-8 through (file names)
+ * @return void
  *
+ * Bytes of file names that are not part of valid UTF-8 are escaped as
+ * the lone surrogates U+DC80 to U+DCFF, which no character uses, so
+ * names in other encodings still give valid JSON and dmtxquery decodes
+ * them back to the same bytes.
+ */
+static void
+WriteJsonString(FILE *fp, const unsigned char *str, int length, DmtxBoolean latin1)
+{
+   int i, start;
+   int sequence;
+   unsigned char c;
+
+   fputc('"', fp);
+
+   /* Copy runs of plain characters in one call */
+   for(start = i = 0; i < length; i++) {
+      c = str[i];
+      if(c >= 0x80 && latin1 == DmtxFalse &&
+            (sequence = GetUtf8Length(str + i, length - i)) > 0) {
+         i += sequence - 1;
+         continue;
+      }
+
+      if(c >= 0x20 && c < 0x7f && c != '"' && c != '\\')
+         continue;
+
+      fwrite(str + start, sizeof(char), i - start, fp);
+      start = i + 1;
+
+      if(c == '"' || c == '\\')
+         fprintf(fp, "\\%c", c);
+      else if(c == '\n')
+         fputs("\\n", fp);
+      else if(c == '\r')
+         fputs("\\r", fp);
+      else if(c == '\t')
+         fputs("\\t", fp);
+      else if(c >= 0x80 && latin1 == DmtxFalse)
+         fprintf(fp, "\\u%04x", 0xdc00 | c);
+      else
+         fprintf(fp, "\\u%04x", c);
+   }
+   fwrite(str + start, sizeof(char), length - start, fp);
+
+   fputc('"', fp);
+}
+
+/**
+ * @brief  Write XML character data, also safe inside a quoted attribute
+ * @param  fp output stream
+ * @param  str bytes to write
+ * @param  length byte count
+ * @param  latin1 DmtxTrue to write bytes above 0x7f as character
+ *         references, or DmtxFalse to pass valid UTF-8 through
+ * @return void
  *
+ * Control characters XML cannot represent are replaced with '?'. Bytes
+ * that are not part of valid UTF-8 become character references.
  */
 static void
-CleanupMagick(MagickWand **wand, int magickError)
+WriteXmlText(FILE *fp, const unsigned char *str, int length, DmtxBoolean latin1)
 {
-   char *excMessage;
-   ExceptionType excSeverity;
+   int i, start;
+   int sequence;
+   unsigned char c;
+
+   for(start = i = 0; i < length; i++) {
+      c = str[i];
+      if(c >= 0x80 && latin1 == DmtxFalse &&
+            (sequence = GetUtf8Length(str + i, length - i)) > 0) {
+         i += sequence - 1;
+         continue;
+      }
 
-   if(magickError == DmtxTrue) {
-      excMessage = MagickGetException(*wand, &excSeverity);
-/*    fprintf(stderr, "%s %s %lu %s\n", GetMagickModule(), excMessage); */
-      MagickRelinquishMemory(excMessage);
+      if(c >= 0x20 && c < 0x7f && c != '&' && c != '<' && c != '>' && c != '"')
+         continue;
+
+      fwrite(str + start, sizeof(char), i - start, fp);
+      start = i + 1;
+
+      if(c == '&')
+         fputs("&amp;", fp);
+      else if(c == '<')
+         fputs("&lt;", fp);
+      else if(c == '>')
+         fputs("&gt;", fp);
+      else if(c == '"')
+         fputs("&quot;", fp);
+      else if(c >= 0x7f || c == '\t' || c == '\n' || c == '\r')
+         fprintf(fp, "&#x%x;", c);
+      else
+         fputc('?', fp);
    }
+   fwrite(str + start, sizeof(char), length - start, fp);
+}
 
-   if(*wand != NULL) {
-      DestroyMagickWand(*wand);
-      *wand = NULL;
+/**
+ * @brief  Length of the UTF-8 sequence starting a string
+ * @param  str bytes
+ * @param  length bytes available
+ * @return Sequence length, or 0 if the bytes are not valid UTF-8
+ *
+ * Overlong forms, surrogates and values above U+10FFFF are invalid.
+ */
+static int
+GetUtf8Length(const unsigned char *str, int length)
+{
+   int i, sequence;
+   unsigned long value;
+
+   if(str[0] < 0x80)
+      return 1;
+   else if(str[0] >= 0xc2 && str[0] <= 0xdf)
+      sequence = 2;
+   else if(str[0] >= 0xe0 && str[0] <= 0xef)
+      sequence = 3;
+   else if(str[0] >= 0xf0 && str[0] <= 0xf4)
+      sequence = 4;
+   else
+      return 0;
+
+   if(sequence > length)
+      return 0;
+
+   value = str[0] & (0x7f >> sequence);
+   for(i = 1; i < sequence; i++) {
+      if((str[i] & 0xc0) != 0x80)
+         return 0;
+      value = (value << 6) | (str[i] & 0x3f);
+   }
+
+   if((sequence == 3 && value < 0x800) || (sequence == 4 && value < 0x10000) ||
+         (value >= 0xd800 && value <= 0xdfff) || value > 0x10ffff)
+      return 0;
+
+   return sequence;
+}
+
+/**
+ * @brief  Write bytes as base64 without line breaks
+ * @param  fp output stream
+ * @param  data bytes to encode
+ * @param  length byte count
+ * @return void
+ */
+static void
+WriteBase64(FILE *fp, const unsigned char *data, int length)
+{
+   int i;
+   unsigned long triple;
+   char quad[4];
+   static const char alphabet[] =
+         "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+   for(i = 0; i < length; i += 3) {
+      triple = (unsigned long)data[i] << 16;
+      if(i + 1 < length)
+         triple |= (unsigned long)data[i + 1] << 8;
+      if(i + 2 < length)
+         triple |= data[i + 2];
+
+      quad[0] = alphabet[(triple >> 18) & 0x3f];
+      quad[1] = alphabet[(triple >> 12) & 0x3f];
+      quad[2] = (i + 1 < length) ? alphabet[(triple >> 6) & 0x3f] : '=';
+      quad[3] = (i + 2 < length) ? alphabet[triple & 0x3f] : '=';
+
+      fwrite(quad, sizeof(char), 4, fp);
    }
 }
 
@@ -780,32 +1707,3 @@ WriteDiagnosticImage(DmtxDecode *dec, char *imagePath)
    free(pnm);
    fclose(fp);
 }
-
-/**
- *
- *
- */
-static int
-ScaleNumberString(char *s, int extent)
-{
-   int err;
-   int numValue;
-   int scaledValue;
-   char *terminate;
-
-   assert(s != NULL);
-
-   err = StringToInt(&numValue, s, &terminate);
-   if(err != DmtxPass)
-      FatalError(EX_USAGE, _("Integer value required"));
-
-   scaledValue = (*terminate == '%') ? (int)(0.01 * numValue * extent + 0.5) : numValue;
-
-   if(scaledValue < 0)
-      scaledValue = 0;
-
-   if(scaledValue >= extent)
-      scaledValue = extent - 1;
-
-   return scaledValue;
-}
@@ -33,9 +33,27 @@ Contact: mike@dragonflylogic.com
 #include <math.h>
 #include <stdarg.h>
 #include <assert.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 #include <dmtx.h>
 #include "../common/dmtxutil.h"
+#include "../common/dmtxrecord.h"
+
+#if defined(HAVE_SYS_RESOURCE_H) && defined(HAVE_GETRUSAGE)
+#include <sys/resource.h>
+#endif
+
+#ifdef HAVE_SYS_INOTIFY_H
+#include <poll.h>
+#endif
+
+#if defined(HAVE_SYS_SOCKET_H) && defined(HAVE_SYS_UN_H)
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
 
 #ifdef IM_API_7
 #include <MagickWand/MagickWand.h>
@@ -43,10 +61,9 @@ Contact: mike@dragonflylogic.com
 #include <wand/magick-wand.h>
 #endif
 
-#if MagickLibVersion > 0x645
-#define MagickGetImagePixels MagickExportImagePixels
-#endif
-
+#include "../libdmtxutil/dmtxscan.h"
+#include "dmtxpool.h"
+#include "dmtxwatch.h"
 
 #if ENABLE_NLS
 # include <libintl.h>
@@ -56,46 +73,122 @@ Contact: mike@dragonflylogic.com
 #endif
 #define N_(String) String
 
+/* Magick reports resources without a limit as (nearly) all bits set */
+#ifdef MagickResourceInfinity
+#define RESOURCE_UNLIMITED(v) ((v) >= MagickResourceInfinity)
+#else
+#define RESOURCE_UNLIMITED(v) ((v) >= (~((MagickSizeType)0) >> 1))
+#endif
+
+/* Extra time a worker gets past --deadline before it is killed */
+#define DMTXREAD_DEADLINE_GRACE_MS 1000
+
+/* Standard output buffer for record formats, which are written in bulk */
+#define DMTXREAD_OUTPUT_BUFFER (1 << 16)
+
+/* Long options without a single character equivalent */
+enum {
+   OptWorkerTimeout = 256,
+   OptDeadline,
+   OptMagickThreads,
+   OptMagickMemory,
+   OptMagickMap,
+   OptMagickArea,
+   OptMagickDisk,
+   OptNoDiskCache,
+   OptMemoryLimit,
+   OptStream,
+   OptBandHeight,
+   OptMagickFax,
+   OptRasterizePdf,
+   OptLocateResolution,
+   OptWatch,
+   OptDoneDir,
+   OptFailedDir,
+   OptOutputFormat,
+   OptOutputSocket
+};
+
+/* Result formats selected by --output-format */
+typedef enum {
+   OutputText = 0,
+   OutputJsonl,
+   OutputXml,
+   OutputBinary
+} OutputFormat;
+
+/* ImageMagick resources that can be limited from the command line */
+typedef enum {
+   LimitThread = 0,
+   LimitMemory,
+   LimitMap,
+   LimitArea,
+   LimitDisk,
+   LimitCount
+} ResourceLimit;
+
 typedef struct {
+   DmtxScanOptions scan; /* -e -E -g -m -p -q -r -s -t -x -X -y -Y -C -M -N -S -G and long options */
    int codewords;       /* -c, --codewords */
-   int edgeMin;         /* -e, --minimum-edge */
-   int edgeMax;         /* -E, --maximum-edge */
-   int scanGap;         /* -g, --gap */
-   int timeoutMS;       /* -m, --milliseconds */
    int newline;         /* -n, --newline */
-   int page;            /* -p, --page */
-   int squareDevn;      /* -q, --square-deviation */
-   int dpi;             /* -r, --resolution */
-   int sizeIdxExpected; /* -s, --symbol-size */
-   int edgeThresh;      /* -t, --threshold */
-   char *xMin;          /* -x, --x-range-min */
-   char *xMax;          /* -X, --x-range-max */
-   char *yMin;          /* -y, --y-range-min */
-   char *yMax;          /* -Y, --y-range-max */
-   int correctionsMax;  /* -C, --corrections-max */
    int diagnose;        /* -D, --diagnose */
-   int mosaic;          /* -M, --mosaic */
-   int stopAfter;       /* -N, --stop-after */
    int pageNumbers;     /* -P, --page-numbers */
    int corners;         /* -R, --corners */
-   int shrinkMax;       /* -S, --shrink */
-   int shrinkMin;       /* -S, --shrink (if range specified) */
    int unicode;         /* -U, --unicode */
-   int gs1;             /* -G, --gs1 */
    int verbose;         /* -v, --verbose */
+   int workers;         /* -j, --workers */
+   int workerTimeoutMS; /*     --worker-timeout */
+   char *watchDir;      /*     --watch */
+   char *doneDir;       /*     --done-dir */
+   char *failedDir;     /*     --failed-dir */
+   int outputFormat;    /*     --output-format */
+   char *outputSocket;  /*     --output-socket */
+   int limitSet[LimitCount];  /* --magick-threads, --magick-memory, etc... */
+   size_t limit[LimitCount];  /* --no-disk-cache sets a disk limit of 0 */
 } UserOptions;
 
+typedef struct {
+   UserOptions *opt;
+   DmtxScan *scan;
+   FILE *fpOut;         /* decoded messages */
+   FILE *fpErr;         /* stats, prefixes and errors */
+   int limitsReported;  /* resource limits already shown by this process */
+   DirWatch *watch;     /* hot folder being watched, or NULL */
+} ScanContext;
+
 /* Functions */
 static UserOptions GetDefaultOptions(void);
 static DmtxPassFail HandleArgs(UserOptions *opt, int *fileIndex, int *argcp, char **argvp[]);
 static void ShowUsage(int status);
-static DmtxPassFail SetDecodeOptions(DmtxDecode *dec, DmtxImage *img, UserOptions *opt);
-static DmtxPassFail PrintStats(DmtxDecode *dec, DmtxRegion *reg, DmtxMessage *msg,
-      int imgPageIndex, UserOptions *opt);
-static DmtxPassFail PrintMessage(DmtxRegion *reg, DmtxMessage *msg, UserOptions *opt);
-static void CleanupMagick(MagickWand **wand, int magicError);
+static DmtxPassFail HandleSymbol(DmtxScanResult *result, void *userData);
+static DmtxPassFail HandlePage(DmtxScanPage *page, void *userData);
+static int GetExitStatus(DmtxScanStatus status);
+static int ScanFilesWithPool(ScanContext *ctx, char **files, int fileCount);
+static ProcessPool *CreatePool(ScanContext *ctx);
+static int WatchDirectory(ScanContext *ctx);
+static void FinishWatchedFile(const char *path, int status, void *userData);
+static void StopWatching(int sig);
+static DmtxBoolean IsDirectory(const char *path);
+static DmtxBoolean IsSameDirectory(const char *path1, const char *path2);
+static DmtxPassFail WorkerInit(void *userData);
+static DmtxPassFail SetResourceLimits(UserOptions *opt, int processCount);
+static void PrintResourceLimits(FILE *fp);
+static DmtxPassFail ReserveMemory(size_t bytes, void *userData);
+static void PrintPeakMemory(ScanContext *ctx, const char *path);
+static double GetPeakMemoryMiB(void);
+static int ScanFileTask(const char *path, FILE *fpOut, FILE *fpErr, int *symbolCount,
+      void *userData);
+static DmtxPassFail PrintStats(DmtxScanResult *result, ScanContext *ctx);
+static DmtxPassFail PrintMessage(DmtxRegion *reg, DmtxMessage *msg, ScanContext *ctx);
+static void ConnectOutput(const char *path);
+static void BeginOutput(UserOptions *opt);
+static void EndOutput(void);
+static DmtxPassFail PrintRecord(DmtxScanResult *result, ScanContext *ctx);
+static void WriteJsonString(FILE *fp, const unsigned char *str, int length, DmtxBoolean latin1);
+static void WriteXmlText(FILE *fp, const unsigned char *str, int length, DmtxBoolean latin1);
+static int GetUtf8Length(const unsigned char *str, int length);
+static void WriteBase64(FILE *fp, const unsigned char *data, int length);
 static void ListImageFormats(void);
 static void WriteDiagnosticImage(DmtxDecode *dec, char *imagePath);
-static int ScaleNumberString(char *s, int extent);
 
 #endif
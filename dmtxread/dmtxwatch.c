@@ -0,0 +1,562 @@
+/*
+libdmtx - Data Matrix Encoding/Decoding Library
+
+Copyright (C) 2008, 2009 Mike Laughton
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+Contact: mike@dragonflylogic.com
+*/
+
+/**
+ * @file dmtxwatch.c
+ * @brief Hot folder that hands over files as soon as they are complete
+ *
+ * Files are picked up when a writer closes them or when they are renamed
+ * into the directory, so a scanner or upload that is still writing is
+ * never read early. Names starting with a dot are left alone, which lets
+ * writers create a hidden temporary file and rename it when finished.
+ *
+ * A finished file is moved to the done or failed directory, or renamed
+ * in place with a ".done" or ".failed" suffix. Either way it will not be
+ * picked up again, and files already waiting when the watch starts are
+ * scanned first.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <dmtx.h>
+#include "../common/dmtxutil.h"
+#include "dmtxwatch.h"
+
+#ifdef HAVE_SYS_INOTIFY_H
+#define DMTXWATCH_ENABLED 1
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#endif
+
+extern char *programName;
+
+#ifdef DMTXWATCH_ENABLED
+
+#define DMTXWATCH_DONE_SUFFIX   ".done"
+#define DMTXWATCH_FAILED_SUFFIX ".failed"
+
+/* Attempts at a free name before giving up on moving a file */
+#define DMTXWATCH_RENAME_MAX    1000
+
+typedef enum {
+   WatchFileReady,
+   WatchFileBusy
+} WatchFileState;
+
+typedef struct {
+   char *name;            /* entry name within the watched directory */
+   char *path;            /* full path handed to the scanner */
+   WatchFileState state;
+   DmtxBoolean rewritten; /* written again while busy, so scan it again */
+} WatchFile;
+
+struct DirWatch_struct {
+   int fd;
+   int wd;
+   char *dirPath;
+   char *doneDir;         /* or NULL to add DMTXWATCH_DONE_SUFFIX */
+   char *failedDir;       /* or NULL to add DMTXWATCH_FAILED_SUFFIX */
+   WatchFile *files;
+   int fileCount;
+   int fileAlloc;
+};
+
+static DmtxPassFail ListDirectory(DirWatch *watch);
+static DmtxPassFail AddFile(DirWatch *watch, const char *name);
+static void RemoveFile(DirWatch *watch, int idx);
+static DmtxBoolean IgnoreName(const char *name);
+static DmtxPassFail MoveFile(DirWatch *watch, WatchFile *file, DmtxBoolean success);
+static char *JoinPath(const char *dir, const char *name, const char *suffix, int serial);
+static char *CopyString(const char *str);
+
+/**
+ * @brief  Report whether this platform supports watching directories
+ * @return DmtxTrue | DmtxFalse
+ */
+extern DmtxBoolean
+WatchSupported(void)
+{
+   return DmtxTrue;
+}
+
+/**
+ * @brief  Start watching a directory for completed files
+ * @param  dirPath directory to watch
+ * @param  doneDir directory receiving scanned files (or NULL to tag them)
+ * @param  failedDir directory receiving unreadable files (or NULL to tag them)
+ * @return Address of new watch, or NULL on error (with errno set)
+ */
+extern DirWatch *
+WatchCreate(const char *dirPath, const char *doneDir, const char *failedDir)
+{
+   int err;
+   DirWatch *watch;
+
+   watch = (DirWatch *)calloc(1, sizeof(DirWatch));
+   if(watch == NULL)
+      return NULL;
+
+   watch->fd = -1;
+   watch->wd = -1;
+   watch->dirPath = CopyString(dirPath);
+   watch->doneDir = (doneDir == NULL) ? NULL : CopyString(doneDir);
+   watch->failedDir = (failedDir == NULL) ? NULL : CopyString(failedDir);
+
+   if(watch->dirPath == NULL || (doneDir != NULL && watch->doneDir == NULL) ||
+         (failedDir != NULL && watch->failedDir == NULL)) {
+      WatchDestroy(&watch);
+      errno = ENOMEM;
+      return NULL;
+   }
+
+   watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+   if(watch->fd != -1)
+      watch->wd = inotify_add_watch(watch->fd, dirPath, IN_CLOSE_WRITE |
+            IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+
+   /* Watch first, so a file arriving during the listing is not missed */
+   if(watch->wd == -1 || ListDirectory(watch) != DmtxPass) {
+      err = errno;
+      WatchDestroy(&watch);
+      errno = err;
+      return NULL;
+   }
+
+   return watch;
+}
+
+/**
+ * @brief  Stop watching and free watch memory
+ * @param  watch pointer to watch pointer
+ * @return void
+ */
+extern void
+WatchDestroy(DirWatch **watch)
+{
+   int i;
+
+   if(watch == NULL || *watch == NULL)
+      return;
+
+   if((*watch)->fd != -1)
+      close((*watch)->fd);
+
+   for(i = 0; i < (*watch)->fileCount; i++) {
+      free((*watch)->files[i].name);
+      free((*watch)->files[i].path);
+   }
+
+   free((*watch)->files);
+   free((*watch)->dirPath);
+   free((*watch)->doneDir);
+   free((*watch)->failedDir);
+   free(*watch);
+
+   *watch = NULL;
+}
+
+/**
+ * @brief  Descriptor that becomes readable when files arrive
+ * @param  watch directory watch
+ * @return File descriptor
+ */
+extern int
+WatchGetFd(DirWatch *watch)
+{
+   return watch->fd;
+}
+
+/**
+ * @brief  Queue files reported since the last call
+ * @param  watch directory watch
+ * @return DmtxPass | DmtxFail (including removal of the watched directory)
+ *
+ * Never blocks. If the kernel dropped events the directory is listed
+ * again, so no completed file is lost.
+ */
+extern DmtxPassFail
+WatchRead(DirWatch *watch)
+{
+   ssize_t bytesRead;
+   size_t offset;
+   struct inotify_event *event;
+   union {
+      struct inotify_event event;
+      char buf[4096];
+   } events;
+
+   for(;;) {
+      bytesRead = read(watch->fd, events.buf, sizeof(events.buf));
+      if(bytesRead == -1 && errno == EINTR)
+         continue;
+      if(bytesRead == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+         break;
+      if(bytesRead <= 0)
+         return DmtxFail;
+
+      for(offset = 0; offset < (size_t)bytesRead;
+            offset += sizeof(struct inotify_event) + event->len) {
+         event = (struct inotify_event *)(events.buf + offset);
+
+         if(event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+            errno = ENOENT;
+            return DmtxFail;
+         }
+
+         if(event->mask & IN_Q_OVERFLOW) {
+            if(ListDirectory(watch) != DmtxPass)
+               return DmtxFail;
+         }
+         else if(event->len > 0 && !(event->mask & IN_ISDIR) &&
+               (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))) {
+            if(AddFile(watch, event->name) != DmtxPass)
+               return DmtxFail;
+         }
+      }
+   }
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Take the next completed file for scanning
+ * @param  watch directory watch
+ * @return Path valid until WatchFinish, or NULL if nothing is waiting
+ */
+extern const char *
+WatchNext(DirWatch *watch)
+{
+   int i;
+
+   for(i = 0; i < watch->fileCount; i++) {
+      if(watch->files[i].state == WatchFileReady) {
+         watch->files[i].state = WatchFileBusy;
+         return watch->files[i].path;
+      }
+   }
+
+   return NULL;
+}
+
+/**
+ * @brief  Move a scanned file out of the way, or queue it again if rewritten
+ * @param  watch directory watch
+ * @param  path path returned by WatchNext
+ * @param  success DmtxTrue if the file was scanned, DmtxFalse if it failed
+ * @return DmtxPass | DmtxFail
+ *
+ * A file that cannot be moved is reported and forgotten, so it stays in
+ * place until the next run. One that was removed in the meantime is not
+ * an error.
+ */
+extern DmtxPassFail
+WatchFinish(DirWatch *watch, const char *path, DmtxBoolean success)
+{
+   int i;
+   DmtxPassFail result;
+   WatchFile *file;
+
+   for(i = 0; i < watch->fileCount; i++) {
+      if(watch->files[i].state == WatchFileBusy && strcmp(watch->files[i].path, path) == 0)
+         break;
+   }
+
+   if(i == watch->fileCount)
+      return DmtxFail;
+
+   file = &(watch->files[i]);
+
+   /* Written again while it was being scanned, so the result is stale */
+   if(file->rewritten == DmtxTrue) {
+      file->state = WatchFileReady;
+      file->rewritten = DmtxFalse;
+      return DmtxPass;
+   }
+
+   result = DmtxPass;
+   if(MoveFile(watch, file, success) != DmtxPass && errno != ENOENT) {
+      fprintf(stderr, "%s: unable to move \"%s\": %s\n", programName, file->path,
+            strerror(errno));
+      result = DmtxFail;
+   }
+
+   RemoveFile(watch, i);
+
+   return result;
+}
+
+/**
+ * @brief  Queue every regular file already in the watched directory
+ * @param  watch directory watch
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+ListDirectory(DirWatch *watch)
+{
+   int i, count;
+   char *path;
+   struct stat info;
+   struct dirent **entries;
+   DmtxPassFail result;
+
+   count = scandir(watch->dirPath, &entries, NULL, alphasort);
+   if(count == -1)
+      return DmtxFail;
+
+   result = DmtxPass;
+   for(i = 0; i < count; i++) {
+      if(result == DmtxPass && IgnoreName(entries[i]->d_name) == DmtxFalse) {
+         path = JoinPath(watch->dirPath, entries[i]->d_name, NULL, 0);
+         if(path == NULL)
+            result = DmtxFail;
+         else if(stat(path, &info) == 0 && S_ISREG(info.st_mode))
+            result = AddFile(watch, entries[i]->d_name);
+         free(path);
+      }
+      free(entries[i]);
+   }
+   free(entries);
+
+   return result;
+}
+
+/**
+ * @brief  Queue a file unless it is already waiting or being scanned
+ * @param  watch directory watch
+ * @param  name entry name within the watched directory
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+AddFile(DirWatch *watch, const char *name)
+{
+   int i;
+   int newAlloc;
+   WatchFile *file, *newFiles;
+
+   if(IgnoreName(name) == DmtxTrue)
+      return DmtxPass;
+
+   for(i = 0; i < watch->fileCount; i++) {
+      if(strcmp(watch->files[i].name, name) == 0) {
+         if(watch->files[i].state == WatchFileBusy)
+            watch->files[i].rewritten = DmtxTrue;
+         return DmtxPass;
+      }
+   }
+
+   if(watch->fileCount == watch->fileAlloc) {
+      newAlloc = (watch->fileAlloc == 0) ? 16 : watch->fileAlloc * 2;
+      newFiles = (WatchFile *)realloc(watch->files, newAlloc * sizeof(WatchFile));
+      if(newFiles == NULL)
+         return DmtxFail;
+      watch->files = newFiles;
+      watch->fileAlloc = newAlloc;
+   }
+
+   file = &(watch->files[watch->fileCount]);
+   memset(file, 0x00, sizeof(WatchFile));
+
+   file->name = CopyString(name);
+   file->path = JoinPath(watch->dirPath, name, NULL, 0);
+   if(file->name == NULL || file->path == NULL) {
+      free(file->name);
+      free(file->path);
+      return DmtxFail;
+   }
+
+   file->state = WatchFileReady;
+   file->rewritten = DmtxFalse;
+   watch->fileCount++;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Forget a file, keeping the others in arrival order
+ * @param  watch directory watch
+ * @param  idx file index
+ * @return void
+ */
+static void
+RemoveFile(DirWatch *watch, int idx)
+{
+   free(watch->files[idx].name);
+   free(watch->files[idx].path);
+
+   memmove(watch->files + idx, watch->files + idx + 1,
+         (watch->fileCount - idx - 1) * sizeof(WatchFile));
+   watch->fileCount--;
+}
+
+/**
+ * @brief  Recognize names that are never picked up
+ * @param  name entry name within the watched directory
+ * @return DmtxTrue if the file should be ignored
+ *
+ * Hidden names are still being written, and suffixed names were tagged
+ * by an earlier run.
+ */
+static DmtxBoolean
+IgnoreName(const char *name)
+{
+   size_t length, doneLength, failedLength;
+
+   if(name[0] == '.')
+      return DmtxTrue;
+
+   length = strlen(name);
+   doneLength = strlen(DMTXWATCH_DONE_SUFFIX);
+   failedLength = strlen(DMTXWATCH_FAILED_SUFFIX);
+
+   if(length > doneLength && strcmp(name + length - doneLength, DMTXWATCH_DONE_SUFFIX) == 0)
+      return DmtxTrue;
+
+   if(length > failedLength && strcmp(name + length - failedLength, DMTXWATCH_FAILED_SUFFIX) == 0)
+      return DmtxTrue;
+
+   return DmtxFalse;
+}
+
+/**
+ * @brief  Rename a finished file without replacing an earlier one
+ * @param  watch directory watch
+ * @param  file finished file
+ * @param  success DmtxTrue to use the done destination, DmtxFalse for failed
+ * @return DmtxPass | DmtxFail (with errno set)
+ *
+ * Scanners often reuse names, so a name already taken at the destination
+ * gets a numbered suffix instead. Destinations must be on the same file
+ * system as the watched directory.
+ */
+static DmtxPassFail
+MoveFile(DirWatch *watch, WatchFile *file, DmtxBoolean success)
+{
+   int serial;
+   int err;
+   char *dir, *target;
+   const char *suffix;
+   struct stat info;
+
+   dir = (success == DmtxTrue) ? watch->doneDir : watch->failedDir;
+   suffix = (success == DmtxTrue) ? DMTXWATCH_DONE_SUFFIX : DMTXWATCH_FAILED_SUFFIX;
+
+   for(serial = 0; serial < DMTXWATCH_RENAME_MAX; serial++) {
+      if(dir == NULL)
+         target = JoinPath(watch->dirPath, file->name, suffix, serial);
+      else
+         target = JoinPath(dir, file->name, NULL, serial);
+
+      if(target == NULL) {
+         errno = ENOMEM;
+         return DmtxFail;
+      }
+
+      if(lstat(target, &info) != 0 && errno == ENOENT) {
+         if(rename(file->path, target) != 0) {
+            err = errno;
+            free(target);
+            errno = err;
+            return DmtxFail;
+         }
+         free(target);
+         return DmtxPass;
+      }
+
+      free(target);
+   }
+
+   errno = EEXIST;
+   return DmtxFail;
+}
+
+/**
+ * @brief  Build "dir/name[.serial][suffix]" in newly allocated memory
+ * @param  dir directory path
+ * @param  name entry name
+ * @param  suffix tag appended last (or NULL)
+ * @param  serial number inserted before the suffix when nonzero
+ * @return New string, or NULL on error
+ */
+static char *
+JoinPath(const char *dir, const char *name, const char *suffix, int serial)
+{
+   size_t dirLength;
+   char *path;
+   char number[16];
+
+   number[0] = '\0';
+   if(serial > 0)
+      sprintf(number, ".%d", serial);
+
+   if(suffix == NULL)
+      suffix = "";
+
+   /* Avoid doubling the separator after "dir/" */
+   dirLength = strlen(dir);
+   while(dirLength > 1 && dir[dirLength - 1] == '/')
+      dirLength--;
+
+   path = (char *)malloc(dirLength + strlen(name) + strlen(number) + strlen(suffix) + 2);
+   if(path == NULL)
+      return NULL;
+
+   memcpy(path, dir, dirLength);
+   sprintf(path + dirLength, "%s%s%s%s", (dir[dirLength - 1] == '/') ? "" : "/",
+         name, number, suffix);
+
+   return path;
+}
+
+/**
+ * @brief  Duplicate a string
+ * @param  str string to copy
+ * @return New string, or NULL on error
+ */
+static char *
+CopyString(const char *str)
+{
+   char *copy;
+
+   copy = (char *)malloc(strlen(str) + 1);
+   if(copy != NULL)
+      strcpy(copy, str);
+
+   return copy;
+}
+
+#else
+
+/* Platforms without inotify get stubs that always fail */
+extern DmtxBoolean WatchSupported(void) { return DmtxFalse; }
+extern DirWatch *WatchCreate(const char *dirPath, const char *doneDir, const char *failedDir) { return NULL; }
+extern void WatchDestroy(DirWatch **watch) { }
+extern int WatchGetFd(DirWatch *watch) { return -1; }
+extern DmtxPassFail WatchRead(DirWatch *watch) { return DmtxFail; }
+extern const char *WatchNext(DirWatch *watch) { return NULL; }
+extern DmtxPassFail WatchFinish(DirWatch *watch, const char *path, DmtxBoolean success) { return DmtxFail; }
+
+#endif
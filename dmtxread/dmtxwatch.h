@@ -0,0 +1,36 @@
+/*
+libdmtx - Data Matrix Encoding/Decoding Library
+
+Copyright (C) 2008, 2009 Mike Laughton
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+Contact: mike@dragonflylogic.com
+*/
+
+#ifndef __DMTXWATCH_H__
+#define __DMTXWATCH_H__
+
+typedef struct DirWatch_struct DirWatch;
+
+extern DmtxBoolean WatchSupported(void);
+extern DirWatch *WatchCreate(const char *dirPath, const char *doneDir, const char *failedDir);
+extern void WatchDestroy(DirWatch **watch);
+extern int WatchGetFd(DirWatch *watch);
+extern DmtxPassFail WatchRead(DirWatch *watch);
+extern const char *WatchNext(DirWatch *watch);
+extern DmtxPassFail WatchFinish(DirWatch *watch, const char *path, DmtxBoolean success);
+
+#endif
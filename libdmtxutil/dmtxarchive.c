@@ -0,0 +1,1009 @@
+/*
+libdmtx - Data Matrix Encoding/Decoding Library
+
+Copyright (C) 2008, 2009 Mike Laughton
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+Contact: mike@dragonflylogic.com
+*/
+
+/**
+ * @file dmtxarchive.c
+ * @brief Tar and zip archive input
+ *
+ * Each regular member of an archive is scanned as if it were a file of
+ * its own, reported as "archive:member". Archive files are memory-mapped
+ * where the system allows, so stored members reach the image readers
+ * without being copied. Otherwise members are read one at a time, which
+ * is also how tar archives are scanned from standard input.
+ */
+
+/**
+ * @brief  Scan the members of a tar or zip file
+ * @param  scan session
+ * @param  path archive path
+ * @param  handled set to DmtxFalse if the file is not an archive
+ * @return DmtxScanOk or error status
+ */
+static DmtxScanStatus
+ScanArchiveFile(DmtxScan *scan, const char *path, DmtxBoolean *handled)
+{
+   size_t headerLength;
+   long size;
+   unsigned char header[DMTXSCAN_TAR_BLOCK];
+   ScanArchiveType type;
+   ScanArchiveReader ar;
+   DmtxScanStatus status;
+   FILE *fp;
+
+   *handled = DmtxFalse;
+
+   /* Unreadable files are left to Magick, which reports the error */
+   fp = fopen(path, "rb");
+   if(fp == NULL)
+      return DmtxScanOk;
+
+   headerLength = fread(header, 1, sizeof(header), fp);
+   type = GetArchiveType(header, headerLength);
+   if(type == ScanArchiveNone || fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < 0 ||
+         fseek(fp, 0, SEEK_SET) != 0) {
+      fclose(fp);
+      return DmtxScanOk;
+   }
+
+   *handled = DmtxTrue;
+
+   memset(&ar, 0x00, sizeof(ScanArchiveReader));
+   ar.path = path;
+   ar.fp = fp;
+   ar.size = (size_t)size;
+   ar.seekable = DmtxTrue;
+
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+   if(ar.size > 0) {
+      ar.mapBase = mmap(NULL, ar.size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+      if(ar.mapBase == MAP_FAILED) {
+         ar.mapBase = NULL;
+      }
+      else {
+         ar.map = (const unsigned char *)ar.mapBase;
+#ifdef MADV_SEQUENTIAL
+         /* Tar members are visited once, front to back */
+         if(type == ScanArchiveTar)
+            madvise(ar.mapBase, ar.size, MADV_SEQUENTIAL);
+#endif
+      }
+   }
+#endif
+
+   status = ScanArchive(scan, &ar, type);
+
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+   if(ar.mapBase != NULL)
+      munmap(ar.mapBase, ar.size);
+#endif
+   fclose(fp);
+
+   return status;
+}
+
+/**
+ * @brief  Scan the members of an archive read from standard input
+ * @param  scan session
+ * @param  data bytes already read from standard input
+ * @param  length number of bytes already read
+ * @param  complete DmtxTrue if data holds the whole stream
+ * @return DmtxScanOk or error status
+ *
+ * Tar members are scanned as they arrive. Zip archives keep their
+ * directory at the end, so are only scanned once the stream is complete.
+ */
+static DmtxScanStatus
+ScanArchiveStdin(DmtxScan *scan, const unsigned char *data, size_t length, DmtxBoolean complete)
+{
+   ScanArchiveType type;
+   ScanArchiveReader ar;
+
+   type = GetArchiveType(data, length);
+
+   memset(&ar, 0x00, sizeof(ScanArchiveReader));
+   ar.path = "-";
+
+   if(complete == DmtxTrue) {
+      ar.map = data;
+      ar.size = length;
+   }
+   else {
+      ar.fp = stdin;
+      ar.prefix = data;
+      ar.prefixLength = length;
+      ar.seekable = DmtxFalse;
+   }
+
+   return ScanArchive(scan, &ar, type);
+}
+
+/**
+ * @brief  Recognize a tar or zip archive from its first bytes
+ * @param  header first bytes of the file
+ * @param  length number of bytes available (up to DMTXSCAN_TAR_BLOCK)
+ * @return ScanArchiveTar, ScanArchiveZip or ScanArchiveNone
+ */
+static ScanArchiveType
+GetArchiveType(const unsigned char *header, size_t length)
+{
+   /* Local file header, or the end record of an empty archive */
+   if(length >= 4 && header[0] == 'P' && header[1] == 'K' &&
+         ((header[2] == 3 && header[3] == 4) || (header[2] == 5 && header[3] == 6)))
+      return ScanArchiveZip;
+
+   if(length >= DMTXSCAN_TAR_BLOCK && IsTarHeader(header) == DmtxTrue)
+      return ScanArchiveTar;
+
+   return ScanArchiveNone;
+}
+
+/**
+ * @brief  Scan every member of an open archive
+ * @param  scan session
+ * @param  ar archive reader
+ * @param  type archive format
+ * @return DmtxScanOk or error status
+ *
+ * Members that cannot be read are skipped, and the last such error is
+ * returned once the rest have been scanned. Other errors stop the scan.
+ */
+static DmtxScanStatus
+ScanArchive(DmtxScan *scan, ScanArchiveReader *ar, ScanArchiveType type)
+{
+   DmtxScanStatus status;
+
+   /* Members are not known in advance, so the archive reserves the
+    * whole limit once and each member is scanned within it */
+   if(ReserveMemory(scan, scan->opt.memoryLimit, ar->path) != DmtxPass)
+      return DmtxScanErrorMemory;
+
+   ar->failed = DmtxScanOk;
+
+   if(type == ScanArchiveTar)
+      status = ScanTarMembers(scan, ar);
+   else
+      status = ScanZipMembers(scan, ar);
+
+   free(ar->buf);
+   free(ar->inflated);
+   free(ar->label);
+
+   return (status == DmtxScanOk) ? ar->failed : status;
+}
+
+/**
+ * @brief  Scan the regular members of a tar archive in order
+ * @param  scan session
+ * @param  ar archive reader
+ * @return DmtxScanOk or error status
+ *
+ * GNU long names and pax extended headers override the name and size in
+ * the header that follows them.
+ */
+static DmtxScanStatus
+ScanTarMembers(DmtxScan *scan, ScanArchiveReader *ar)
+{
+   int i;
+   size_t offset, size, paxSize;
+   unsigned char header[DMTXSCAN_TAR_BLOCK];
+   const unsigned char *block, *data;
+   char *longName, *paxPath, *name;
+   DmtxBoolean hasPaxSize;
+   DmtxScanStatus status;
+
+   longName = paxPath = NULL;
+   hasPaxSize = DmtxFalse;
+   paxSize = 0;
+   status = DmtxScanOk;
+
+   for(offset = 0; status == DmtxScanOk && StopReached(scan) == DmtxFalse; ) {
+
+      /* Archives may simply end without their two zero blocks */
+      if(ar->size != 0 && offset == ar->size)
+         break;
+
+      if(GetArchiveBytes(ar, offset, DMTXSCAN_TAR_BLOCK, &block) != DmtxPass) {
+         if(ar->size == 0 && ar->eof == DmtxTrue && ar->pos == offset)
+            break;
+         SetError(scan, "Truncated tar archive \"%s\"", ar->path);
+         status = DmtxScanErrorRead;
+         break;
+      }
+
+      /* Reads of member data reuse the buffer holding the header */
+      memcpy(header, block, DMTXSCAN_TAR_BLOCK);
+
+      for(i = 0; i < DMTXSCAN_TAR_BLOCK && header[i] == 0; i++);
+      if(i == DMTXSCAN_TAR_BLOCK)
+         break;
+
+      if(IsTarHeader(header) == DmtxFalse ||
+            GetTarNumber(header + 124, 12, &size) != DmtxPass) {
+         SetError(scan, "Invalid tar header at offset %lu in \"%s\"", (unsigned long)offset, ar->path);
+         status = DmtxScanErrorRead;
+         break;
+      }
+
+      offset += DMTXSCAN_TAR_BLOCK;
+
+      switch(header[156]) {
+         case 'L':
+         case 'x':
+            if(size > DMTXSCAN_TAR_NAME_MAX || GetArchiveBytes(ar, offset, size, &data) != DmtxPass) {
+               SetError(scan, "Invalid tar header at offset %lu in \"%s\"",
+                     (unsigned long)offset - DMTXSCAN_TAR_BLOCK, ar->path);
+               status = DmtxScanErrorRead;
+               break;
+            }
+            if(header[156] == 'L') {
+               free(longName);
+               longName = CopyTarName(data, size);
+            }
+            else {
+               ReadPaxHeader(data, size, &paxPath, &paxSize, &hasPaxSize);
+            }
+            break;
+
+         case '0':
+         case '7':
+         case '\0':
+            if(hasPaxSize == DmtxTrue)
+               size = paxSize;
+
+            name = (paxPath != NULL) ? paxPath : (longName != NULL) ? longName : NULL;
+            status = ScanTarMember(scan, ar, header, name, offset, size);
+
+            free(longName);
+            free(paxPath);
+            longName = paxPath = NULL;
+            hasPaxSize = DmtxFalse;
+            break;
+
+         default:
+            /* Directories, links and devices hold no image */
+            free(longName);
+            free(paxPath);
+            longName = paxPath = NULL;
+            hasPaxSize = DmtxFalse;
+            break;
+      }
+
+      /* Member data is padded to whole blocks */
+      if(size > (size_t)-1 - offset - DMTXSCAN_TAR_BLOCK) {
+         SetError(scan, "Invalid tar header in \"%s\"", ar->path);
+         status = DmtxScanErrorRead;
+         break;
+      }
+      offset += (size + DMTXSCAN_TAR_BLOCK - 1) / DMTXSCAN_TAR_BLOCK * DMTXSCAN_TAR_BLOCK;
+   }
+
+   free(longName);
+   free(paxPath);
+
+   return status;
+}
+
+/**
+ * @brief  Read and scan one regular tar member
+ * @param  scan session
+ * @param  ar archive reader
+ * @param  header member's header block
+ * @param  name name from a long name or pax header, or NULL to use the header's
+ * @param  offset archive offset of the member data
+ * @param  size member size in bytes
+ * @return DmtxScanOk or error status
+ */
+static DmtxScanStatus
+ScanTarMember(DmtxScan *scan, ScanArchiveReader *ar, const unsigned char *header, const char *name,
+      size_t offset, size_t size)
+{
+   int nameLength, prefixLength;
+   char headerName[DMTXSCAN_TAR_BLOCK];
+   const unsigned char *data;
+
+   /* POSIX tar splits long names between the prefix and name fields */
+   if(name == NULL) {
+      for(nameLength = 0; nameLength < 100 && header[nameLength] != '\0'; nameLength++);
+      prefixLength = 0;
+      if(memcmp(header + 257, "ustar", 5) == 0)
+         for(; prefixLength < 155 && header[345 + prefixLength] != '\0'; prefixLength++);
+
+      if(prefixLength > 0) {
+         memcpy(headerName, header + 345, prefixLength);
+         headerName[prefixLength++] = '/';
+      }
+      memcpy(headerName + prefixLength, header, nameLength);
+      headerName[prefixLength + nameLength] = '\0';
+      name = headerName;
+   }
+
+   if(name[0] == '\0' || name[strlen(name) - 1] == '/' || size == 0)
+      return DmtxScanOk;
+
+   if(StartArchiveMember(scan, ar, name) != DmtxPass)
+      return DmtxScanErrorMemory;
+
+   /* Oversized members are skipped, and fail the archive at the end */
+   if(ar->map == NULL && scan->opt.memoryLimit != 0 && size > scan->opt.memoryLimit) {
+      SetError(scan, "Member \"%s\" is larger than the memory limit", ar->label);
+      ar->failed = DmtxScanErrorMemory;
+      return EndArchiveMember(scan, ar, DmtxScanOk);
+   }
+
+   if(GetArchiveBytes(ar, offset, size, &data) != DmtxPass) {
+      SetError(scan, "Truncated tar archive \"%s\"", ar->path);
+      scan->member = NULL;
+      return DmtxScanErrorRead;
+   }
+
+   return EndArchiveMember(scan, ar, ScanArchiveMember(scan, ar, data, size));
+}
+
+/**
+ * @brief  Check the checksum of a tar header block
+ * @param  header DMTXSCAN_TAR_BLOCK bytes
+ * @return DmtxTrue if the block is a tar header
+ *
+ * The checksum is the only mark old (pre-POSIX) tar headers carry.
+ */
+static DmtxBoolean
+IsTarHeader(const unsigned char *header)
+{
+   int i;
+   size_t stored;
+   unsigned long sum;
+
+   if(GetTarNumber(header + 148, 8, &stored) != DmtxPass)
+      return DmtxFalse;
+
+   /* The checksum field itself counts as spaces */
+   for(sum = 0, i = 0; i < DMTXSCAN_TAR_BLOCK; i++)
+      sum += (i >= 148 && i < 156) ? ' ' : header[i];
+
+   return (sum == stored && sum != 8 * ' ') ? DmtxTrue : DmtxFalse;
+}
+
+/**
+ * @brief  Decode a numeric tar header field
+ * @param  field first byte of the field
+ * @param  width field width in bytes
+ * @param  value pointer to decoded value
+ * @return DmtxPass | DmtxFail
+ *
+ * Fields are octal text, or base-256 when the high bit of the first byte
+ * is set (GNU tar, for members of 8GB and more).
+ */
+static DmtxPassFail
+GetTarNumber(const unsigned char *field, int width, size_t *value)
+{
+   int i;
+
+   *value = 0;
+
+   if(field[0] & 0x80) {
+      for(i = 0; i < width; i++) {
+         if(*value > ((size_t)-1 >> 8))
+            return DmtxFail;
+         *value = (*value << 8) | ((i == 0) ? (field[i] & 0x7f) : field[i]);
+      }
+      return DmtxPass;
+   }
+
+   for(i = 0; i < width && (field[i] == ' ' || field[i] == '\0'); i++);
+   if(i == width)
+      return DmtxFail;
+
+   for(; i < width && field[i] >= '0' && field[i] <= '7'; i++) {
+      if(*value > ((size_t)-1 >> 3))
+         return DmtxFail;
+      *value = (*value << 3) | (field[i] - '0');
+   }
+
+   /* Digits end with a space or NUL, or fill the field */
+   return (i == width || field[i] == ' ' || field[i] == '\0') ? DmtxPass : DmtxFail;
+}
+
+/**
+ * @brief  Copy a member name stored as data in a tar archive
+ * @param  data name bytes, possibly NUL padded
+ * @param  length number of bytes
+ * @return New string, or NULL on error
+ */
+static char *
+CopyTarName(const unsigned char *data, size_t length)
+{
+   size_t i;
+   char *name;
+
+   for(i = 0; i < length && data[i] != '\0'; i++);
+
+   name = (char *)malloc(i + 1);
+   if(name == NULL)
+      return NULL;
+
+   memcpy(name, data, i);
+   name[i] = '\0';
+
+   return name;
+}
+
+/**
+ * @brief  Read the path and size records of a pax extended header
+ * @param  data header data
+ * @param  length data length in bytes
+ * @param  path pointer to new path string, replaced if present
+ * @param  size pointer to size, set if present
+ * @param  hasSize set to DmtxTrue if a size was read
+ * @return void
+ *
+ * Records take the form "<length> <key>=<value>\n". Other keys are ignored.
+ */
+static void
+ReadPaxHeader(const unsigned char *data, size_t length, char **path, size_t *size,
+      DmtxBoolean *hasSize)
+{
+   size_t pos, recordLength, i;
+   const unsigned char *record, *key, *value, *end;
+
+   for(pos = 0; pos < length; pos += recordLength) {
+      record = data + pos;
+
+      for(recordLength = 0, i = 0; pos + i < length && ISDIGIT(record[i]) && i < 16; i++)
+         recordLength = recordLength * 10 + (record[i] - '0');
+
+      if(i == 0 || pos + i >= length || record[i] != ' ' || recordLength <= i + 1 ||
+            recordLength > length - pos || record[recordLength - 1] != '\n')
+         return;
+
+      key = record + i + 1;
+      end = record + recordLength - 1;
+      for(value = key; value < end && *value != '='; value++);
+      if(value == end)
+         continue;
+      value++;
+
+      if(value - key == 5 && memcmp(key, "path=", 5) == 0) {
+         free(*path);
+         *path = CopyTarName(value, (size_t)(end - value));
+      }
+      else if(value - key == 5 && memcmp(key, "size=", 5) == 0 && value < end) {
+         for(*size = 0; value < end && ISDIGIT(*value); value++) {
+            if(*size > ((size_t)-1 - 9) / 10)
+               return;
+            *size = *size * 10 + (*value - '0');
+         }
+         *hasSize = (value == end) ? DmtxTrue : DmtxFalse;
+      }
+   }
+}
+
+/**
+ * @brief  Scan the members of a zip archive in central directory order
+ * @param  scan session
+ * @param  ar archive reader (size known)
+ * @return DmtxScanOk or error status
+ *
+ * Zip64 archives and members are supported. Stored members are scanned
+ * in place and deflated members are inflated one at a time.
+ */
+static DmtxScanStatus
+ScanZipMembers(DmtxScan *scan, ScanArchiveReader *ar)
+{
+   size_t tail, end, entries, entry, dirSize, dirOffset, pos;
+   size_t nameLength, extraLength, commentLength;
+   const unsigned char *p;
+   unsigned char *dir;
+   char *name;
+   ScanZipEntry member;
+   DmtxScanStatus status;
+
+   if(ar->size < DMTXSCAN_ZIP_END_SIZE) {
+      SetError(scan, "Invalid zip archive \"%s\"", ar->path);
+      return DmtxScanErrorRead;
+   }
+
+   /* The end record sits before a comment of up to 64KB */
+   tail = (ar->size < DMTXSCAN_ZIP_END_SIZE + 65535) ? ar->size : DMTXSCAN_ZIP_END_SIZE + 65535;
+   if(GetArchiveBytes(ar, ar->size - tail, tail, &p) != DmtxPass) {
+      SetError(scan, "Unable to read zip archive \"%s\"", ar->path);
+      return DmtxScanErrorRead;
+   }
+
+   for(end = tail - DMTXSCAN_ZIP_END_SIZE + 1; end > 0; end--) {
+      if(memcmp(p + end - 1, "PK\005\006", 4) == 0)
+         break;
+   }
+
+   if(end == 0) {
+      SetError(scan, "Invalid zip archive \"%s\"", ar->path);
+      return DmtxScanErrorRead;
+   }
+   p += end - 1;
+   end = ar->size - tail + end - 1;
+
+   entries = GetZipValue(p + 10, 2);
+   dirSize = GetZipValue(p + 12, 4);
+   dirOffset = GetZipValue(p + 16, 4);
+
+   /* Zip64 archives keep the real values in a second end record */
+   if(entries == 0xffff || dirSize == 0xffffffffUL || dirOffset == 0xffffffffUL) {
+      if(end < 20 || GetArchiveBytes(ar, end - 20, 20, &p) != DmtxPass ||
+            memcmp(p, "PK\006\007", 4) != 0 ||
+            GetArchiveBytes(ar, GetZipValue(p + 8, 8), 56, &p) != DmtxPass ||
+            memcmp(p, "PK\006\006", 4) != 0) {
+         SetError(scan, "Invalid zip64 archive \"%s\"", ar->path);
+         return DmtxScanErrorRead;
+      }
+      entries = GetZipValue(p + 32, 8);
+      dirSize = GetZipValue(p + 40, 8);
+      dirOffset = GetZipValue(p + 48, 8);
+   }
+
+   /* Member reads reuse the reader's buffer, so keep a copy of the directory */
+   if(dirOffset > ar->size || dirSize > ar->size - dirOffset ||
+         GetArchiveBytes(ar, dirOffset, dirSize, &p) != DmtxPass) {
+      SetError(scan, "Invalid zip directory in \"%s\"", ar->path);
+      return DmtxScanErrorRead;
+   }
+
+   dir = (unsigned char *)malloc(dirSize + 1);
+   if(dir == NULL) {
+      SetError(scan, "malloc() error");
+      return DmtxScanErrorMemory;
+   }
+   memcpy(dir, p, dirSize);
+
+   status = DmtxScanOk;
+   for(entry = 0, pos = 0; entry < entries && status == DmtxScanOk &&
+         StopReached(scan) == DmtxFalse; entry++) {
+
+      p = dir + pos;
+      if(dirSize - pos < 46 || memcmp(p, "PK\001\002", 4) != 0) {
+         SetError(scan, "Invalid zip directory in \"%s\"", ar->path);
+         status = DmtxScanErrorRead;
+         break;
+      }
+
+      nameLength = GetZipValue(p + 28, 2);
+      extraLength = GetZipValue(p + 30, 2);
+      commentLength = GetZipValue(p + 32, 2);
+      if(dirSize - pos - 46 < nameLength + extraLength + commentLength) {
+         SetError(scan, "Invalid zip directory in \"%s\"", ar->path);
+         status = DmtxScanErrorRead;
+         break;
+      }
+
+      memset(&member, 0x00, sizeof(ScanZipEntry));
+      member.flags = (int)GetZipValue(p + 8, 2);
+      member.method = (int)GetZipValue(p + 10, 2);
+      member.compressedSize = GetZipValue(p + 20, 4);
+      member.size = GetZipValue(p + 24, 4);
+      member.localOffset = GetZipValue(p + 42, 4);
+      ReadZip64Extra(p + 46 + nameLength, extraLength, &member);
+
+      /* Names are not terminated in the directory, but the copy has room */
+      name = (char *)malloc(nameLength + 1);
+      if(name == NULL) {
+         SetError(scan, "malloc() error");
+         status = DmtxScanErrorMemory;
+         break;
+      }
+      memcpy(name, p + 46, nameLength);
+      name[nameLength] = '\0';
+
+      pos += 46 + nameLength + extraLength + commentLength;
+
+      if(nameLength > 0 && name[nameLength - 1] != '/')
+         status = ScanZipMember(scan, ar, name, &member);
+
+      free(name);
+   }
+
+   free(dir);
+
+   return status;
+}
+
+/**
+ * @brief  Read the zip64 sizes and offset of a directory entry
+ * @param  extra extra field of the entry
+ * @param  length extra field length in bytes
+ * @param  member entry whose saturated values are replaced
+ * @return void
+ */
+static void
+ReadZip64Extra(const unsigned char *extra, size_t length, ScanZipEntry *member)
+{
+   size_t pos, fieldLength, used;
+   const unsigned char *data;
+
+   for(pos = 0; pos + 4 <= length; pos += 4 + fieldLength) {
+      fieldLength = GetZipValue(extra + pos + 2, 2);
+      if(fieldLength > length - pos - 4)
+         return;
+
+      if(GetZipValue(extra + pos, 2) != 0x0001)
+         continue;
+
+      /* Only values that overflowed are present, in this order */
+      data = extra + pos + 4;
+      used = 0;
+      if(member->size == 0xffffffffUL && used + 8 <= fieldLength) {
+         member->size = GetZipValue(data + used, 8);
+         used += 8;
+      }
+      if(member->compressedSize == 0xffffffffUL && used + 8 <= fieldLength) {
+         member->compressedSize = GetZipValue(data + used, 8);
+         used += 8;
+      }
+      if(member->localOffset == 0xffffffffUL && used + 8 <= fieldLength)
+         member->localOffset = GetZipValue(data + used, 8);
+      return;
+   }
+}
+
+/**
+ * @brief  Read, inflate if needed, and scan one zip member
+ * @param  scan session
+ * @param  ar archive reader
+ * @param  name member name
+ * @param  member directory entry
+ * @return DmtxScanOk or error status
+ */
+static DmtxScanStatus
+ScanZipMember(DmtxScan *scan, ScanArchiveReader *ar, const char *name, ScanZipEntry *member)
+{
+   size_t dataOffset;
+   const unsigned char *p;
+   const unsigned char *data;
+
+   if(StartArchiveMember(scan, ar, name) != DmtxPass)
+      return DmtxScanErrorMemory;
+
+   if(member->flags & 0x0001) {
+      SetError(scan, "Member \"%s\" is encrypted", ar->label);
+      return EndArchiveMember(scan, ar, DmtxScanErrorRead);
+   }
+
+   if(member->method != 0 && member->method != 8) {
+      SetError(scan, "Member \"%s\" uses unsupported compression method %d",
+            ar->label, member->method);
+      return EndArchiveMember(scan, ar, DmtxScanErrorRead);
+   }
+
+   /* Whatever is held in memory must fit within the limit */
+   if(scan->opt.memoryLimit != 0 && ((member->method == 8 && member->size > scan->opt.memoryLimit) ||
+         (ar->map == NULL && member->compressedSize > scan->opt.memoryLimit))) {
+      SetError(scan, "Member \"%s\" is larger than the memory limit", ar->label);
+      ar->failed = DmtxScanErrorMemory;
+      return EndArchiveMember(scan, ar, DmtxScanOk);
+   }
+
+   /* The local header repeats the name, with an extra field of its own */
+   if(GetArchiveBytes(ar, member->localOffset, 30, &p) != DmtxPass ||
+         memcmp(p, "PK\003\004", 4) != 0) {
+      SetError(scan, "Invalid zip header for member \"%s\"", ar->label);
+      return EndArchiveMember(scan, ar, DmtxScanErrorRead);
+   }
+   dataOffset = member->localOffset + 30 + GetZipValue(p + 26, 2) + GetZipValue(p + 28, 2);
+
+   if(GetArchiveBytes(ar, dataOffset, member->compressedSize, &data) != DmtxPass) {
+      SetError(scan, "Truncated zip member \"%s\"", ar->label);
+      return EndArchiveMember(scan, ar, DmtxScanErrorRead);
+   }
+
+   if(member->method == 0)
+      return EndArchiveMember(scan, ar, (member->compressedSize == 0) ? DmtxScanOk :
+            ScanArchiveMember(scan, ar, data, member->compressedSize));
+
+   if(InflateZipMember(scan, ar, data, member) != DmtxPass)
+      return EndArchiveMember(scan, ar, DmtxScanErrorRead);
+
+   return EndArchiveMember(scan, ar, (member->size == 0) ? DmtxScanOk :
+         ScanArchiveMember(scan, ar, ar->inflated, member->size));
+}
+
+/**
+ * @brief  Inflate a deflated zip member into the reader's inflate buffer
+ * @param  scan session
+ * @param  ar archive reader
+ * @param  data compressed member data
+ * @param  member directory entry
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+InflateZipMember(DmtxScan *scan, ScanArchiveReader *ar, const unsigned char *data, ScanZipEntry *member)
+{
+#if defined(HAVE_ZLIB_H) && defined(HAVE_LIBZ)
+   int err;
+   unsigned char *inflated;
+   z_stream strm;
+
+   if(member->size + 1 > ar->inflatedAlloc) {
+      inflated = (unsigned char *)realloc(ar->inflated, member->size + 1);
+      if(inflated == NULL) {
+         SetError(scan, "malloc() error");
+         return DmtxFail;
+      }
+      ar->inflated = inflated;
+      ar->inflatedAlloc = member->size + 1;
+   }
+
+   /* Members are raw deflate data, without a zlib header */
+   memset(&strm, 0x00, sizeof(z_stream));
+   if(inflateInit2(&strm, -MAX_WBITS) != Z_OK) {
+      SetError(scan, "Unable to inflate member \"%s\"", ar->label);
+      return DmtxFail;
+   }
+
+   strm.next_in = (Bytef *)data;
+   strm.avail_in = (uInt)member->compressedSize;
+   strm.next_out = ar->inflated;
+   strm.avail_out = (uInt)member->size + 1;
+
+   err = (member->compressedSize > (uInt)-1 || member->size >= (uInt)-1) ?
+         Z_MEM_ERROR : inflate(&strm, Z_FINISH);
+   inflateEnd(&strm);
+
+   if(err != Z_STREAM_END || strm.total_out != member->size) {
+      SetError(scan, "Corrupt compressed data in member \"%s\"", ar->label);
+      return DmtxFail;
+   }
+
+   return DmtxPass;
+#else
+   SetError(scan, "Member \"%s\" is compressed, which needs zlib support", ar->label);
+   return DmtxFail;
+#endif
+}
+
+/**
+ * @brief  Decode an unsigned little-endian zip integer
+ * @param  p first byte
+ * @param  size 2, 4 or 8 bytes
+ * @return Value
+ */
+static size_t
+GetZipValue(const unsigned char *p, int size)
+{
+   int i;
+   size_t value = 0;
+
+   for(i = size - 1; i >= 0; i--)
+      value = (value << 8) | p[i];
+
+   return value;
+}
+
+/**
+ * @brief  Point to bytes of an archive, reading them if it is not mapped
+ * @param  ar archive reader
+ * @param  offset archive offset
+ * @param  length number of bytes
+ * @param  data pointer to bytes, valid until the next call
+ * @return DmtxPass | DmtxFail
+ *
+ * Streams that cannot seek only move forward, skipping unread bytes.
+ */
+static DmtxPassFail
+GetArchiveBytes(ScanArchiveReader *ar, size_t offset, size_t length, const unsigned char **data)
+{
+   size_t count, skip;
+   unsigned char *buf;
+
+   if(ar->map != NULL) {
+      if(offset > ar->size || length > ar->size - offset)
+         return DmtxFail;
+      *data = ar->map + offset;
+      return DmtxPass;
+   }
+
+   if(ar->size != 0 && (offset > ar->size || length > ar->size - offset))
+      return DmtxFail;
+
+   if(length + 1 > ar->bufAlloc) {
+      buf = (unsigned char *)realloc(ar->buf, length + 1);
+      if(buf == NULL)
+         return DmtxFail;
+      ar->buf = buf;
+      ar->bufAlloc = length + 1;
+   }
+
+   if(offset != ar->pos) {
+      if(ar->seekable == DmtxTrue) {
+         if(fseek(ar->fp, (long)offset, SEEK_SET) != 0)
+            return DmtxFail;
+         ar->pos = offset;
+      }
+      else {
+         if(offset < ar->pos)
+            return DmtxFail;
+         while(ar->pos < offset) {
+            skip = offset - ar->pos;
+            count = ReadArchiveStream(ar, ar->buf, (skip < length + 1) ? skip : length + 1);
+            if(count == 0)
+               return DmtxFail;
+         }
+      }
+   }
+
+   if(ReadArchiveStream(ar, ar->buf, length) != length)
+      return DmtxFail;
+
+   *data = ar->buf;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Read the next bytes of an unmapped archive
+ * @param  ar archive reader
+ * @param  dest destination
+ * @param  length number of bytes wanted
+ * @return Number of bytes read, less than length only at the end
+ *
+ * Bytes read from standard input before the archive was recognized are
+ * returned first.
+ */
+static size_t
+ReadArchiveStream(ScanArchiveReader *ar, unsigned char *dest, size_t length)
+{
+   size_t count, total;
+
+   total = 0;
+   if(ar->pos < ar->prefixLength) {
+      total = ar->prefixLength - ar->pos;
+      if(total > length)
+         total = length;
+      memcpy(dest, ar->prefix + ar->pos, total);
+      ar->pos += total;
+   }
+
+   while(total < length) {
+      count = fread(dest + total, 1, length - total, ar->fp);
+      if(count == 0) {
+         ar->eof = DmtxTrue;
+         break;
+      }
+      total += count;
+      ar->pos += count;
+   }
+
+   return total;
+}
+
+/**
+ * @brief  Name the member about to be scanned and start its deadline
+ * @param  scan session
+ * @param  ar archive reader
+ * @param  name member name within the archive
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+StartArchiveMember(DmtxScan *scan, ScanArchiveReader *ar, const char *name)
+{
+   size_t length, held;
+   char *label;
+
+   length = strlen(ar->path) + strlen(name) + 2;
+   if(length > ar->labelAlloc) {
+      label = (char *)realloc(ar->label, length);
+      if(label == NULL) {
+         SetError(scan, "malloc() error");
+         return DmtxFail;
+      }
+      ar->label = label;
+      ar->labelAlloc = length;
+   }
+   sprintf(ar->label, "%s:%s", ar->path, name);
+
+   /* Each member gets its own deadline but shares the archive's memory */
+   held = scan->reservedBytes;
+   StartSource(scan);
+   scan->reserved = DmtxTrue;
+   scan->reservedBytes = held;
+   scan->member = ar->label + strlen(ar->path) + 1;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Finish a member, keeping the archive going past unreadable ones
+ * @param  scan session
+ * @param  ar archive reader
+ * @param  status member status
+ * @return DmtxScanOk, or status if it should stop the archive
+ */
+static DmtxScanStatus
+EndArchiveMember(DmtxScan *scan, ScanArchiveReader *ar, DmtxScanStatus status)
+{
+   scan->member = NULL;
+
+   switch(status) {
+      case DmtxScanErrorRead:
+      case DmtxScanErrorDecode:
+      case DmtxScanErrorDeadline:
+         ar->failed = status;
+         return DmtxScanOk;
+      default:
+         break;
+   }
+
+   return status;
+}
+
+/**
+ * @brief  Scan one member held in memory with the reader its contents call for
+ * @param  scan session
+ * @param  ar archive reader
+ * @param  data member bytes (not copied, not freed)
+ * @param  length member length in bytes
+ * @return DmtxScanOk or error status
+ *
+ * PDF members are indexed in place. PNM (with --stream) and fax TIFF
+ * members are read through a stdio stream over the same bytes where the
+ * system provides fmemopen(). Everything else goes to Magick as a blob.
+ */
+static DmtxScanStatus
+ScanArchiveMember(DmtxScan *scan, ScanArchiveReader *ar, const unsigned char *data, size_t length)
+{
+   DmtxBoolean handled;
+   DmtxScanStatus status;
+#ifdef HAVE_FMEMOPEN
+   FILE *fp;
+#endif
+
+   handled = DmtxFalse;
+   status = DmtxScanOk;
+
+#ifdef HAVE_FMEMOPEN
+   if(scan->opt.stream == DmtxTrue && length > 2 && data[0] == 'P' &&
+         data[1] >= '4' && data[1] <= '6') {
+      fp = fmemopen((void *)data, length, "r");
+      if(fp != NULL) {
+         handled = DmtxTrue;
+         fseek(fp, 2, SEEK_SET);
+         status = ScanPnmStream(scan, fp, data[1], ar->label);
+         fclose(fp);
+      }
+   }
+#endif
+
+   if(handled == DmtxFalse && scan->opt.nativePdf == DmtxTrue)
+      status = ScanPdfData(scan, data, length, ar->label, &handled);
+
+#ifdef HAVE_FMEMOPEN
+   if(handled == DmtxFalse && scan->opt.nativeFax == DmtxTrue && length > 8 &&
+         ((data[0] == 'I' && data[1] == 'I') || (data[0] == 'M' && data[1] == 'M'))) {
+      fp = fmemopen((void *)data, length, "r");
+      if(fp != NULL) {
+         status = ScanTiffStream(scan, fp, ar->label, &handled);
+         fclose(fp);
+      }
+   }
+#endif
+
+   if(handled == DmtxFalse)
+      status = ReadWand(scan, NULL, data, length, ar->label, 0);
+
+   return status;
+}
@@ -0,0 +1,1447 @@
+/*
+libdmtx - Data Matrix Encoding/Decoding Library
+
+Copyright (C) 2008, 2009 Mike Laughton
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+Contact: mike@dragonflylogic.com
+*/
+
+/**
+ * @file dmtxpdf.c
+ * @brief Page images of scanned PDF files
+ *
+ * A scanner writes each page as one JPEG, JPEG 2000 or CCITT image, and
+ * rasterizing that page through Ghostscript only resamples the image it
+ * already holds. Pages whose content draws exactly one such image and
+ * nothing else visible are decoded straight from the embedded stream at
+ * native resolution. All other pages are still rendered by Magick.
+ */
+
+/**
+ * @brief  Scan the page images of a PDF file, rendering only vector pages
+ * @param  scan session
+ * @param  path PDF path
+ * @param  handled set to DmtxFalse if the file should be read by Magick instead
+ * @return DmtxScanOk or error status
+ */
+static DmtxScanStatus
+ScanPdfFile(DmtxScan *scan, const char *path, DmtxBoolean *handled)
+{
+   ScanPdfDoc doc;
+   DmtxScanStatus status;
+
+   *handled = DmtxFalse;
+
+   /* Anything unreadable or unusual is left to Magick */
+   if(LoadPdf(path, scan->opt.memoryLimit, &doc) != DmtxPass)
+      return DmtxScanOk;
+
+   status = ScanPdfDocument(scan, &doc, path, path, handled);
+   FreePdf(&doc);
+
+   return status;
+}
+
+/**
+ * @brief  Scan the page images of a PDF file already held in memory
+ * @param  scan session
+ * @param  data file bytes (not copied, and kept until this returns)
+ * @param  length file length in bytes
+ * @param  source name reported to callbacks
+ * @param  handled set to DmtxFalse if the file should be read by Magick instead
+ * @return DmtxScanOk or error status
+ *
+ * With no path to render single pages from, files with any vector page
+ * are left to Magick as a whole.
+ */
+static DmtxScanStatus
+ScanPdfData(DmtxScan *scan, const unsigned char *data, size_t length, const char *source,
+      DmtxBoolean *handled)
+{
+   size_t headerLength;
+   ScanPdfDoc doc;
+   DmtxScanStatus status;
+
+   *handled = DmtxFalse;
+
+   headerLength = (length < DMTXSCAN_PDF_HEADER_SEARCH) ? length : DMTXSCAN_PDF_HEADER_SEARCH;
+   if(FindPdfText(data, data + headerLength, "%PDF-") == NULL ||
+         (scan->opt.memoryLimit != 0 && length > scan->opt.memoryLimit))
+      return DmtxScanOk;
+
+   memset(&doc, 0x00, sizeof(ScanPdfDoc));
+   doc.data = (unsigned char *)data;
+   doc.length = length;
+   doc.borrowed = DmtxTrue;
+
+   if(IndexPdf(&doc) != DmtxPass) {
+      FreePdf(&doc);
+      return DmtxScanOk;
+   }
+
+   status = ScanPdfDocument(scan, &doc, NULL, source, handled);
+   FreePdf(&doc);
+
+   return status;
+}
+
+/**
+ * @brief  Scan the pages of a loaded PDF document, rendering only vector pages
+ * @param  scan session
+ * @param  doc indexed document
+ * @param  path PDF path for rendering vector pages, or NULL if there is none
+ * @param  source name reported to callbacks
+ * @param  handled set to DmtxFalse if the file should be read by Magick instead
+ * @return DmtxScanOk or error status
+ */
+static DmtxScanStatus
+ScanPdfDocument(DmtxScan *scan, ScanPdfDoc *doc, const char *path, const char *source,
+      DmtxBoolean *handled)
+{
+   int pageIndex, pageCount, pageAlloc, nativeCount, pickedCount;
+   size_t need, pageNeed;
+   char *subimage;
+   ScanPdfPage *pages, *page;
+   ScanPdfValue catalog, tree;
+   ScanFaxReader fax;
+   DmtxScanStatus status;
+
+   *handled = DmtxFalse;
+
+   /* Page numbers only match Magick's if the whole page tree is read. The
+    * page array is not moved after this, as fax pages point into it. */
+   pages = NULL;
+   pageCount = pageAlloc = 0;
+   if(GetPdfObject(doc, doc->root, &catalog) != DmtxPass ||
+         GetPdfDictValue(doc, &catalog, "/Pages", &tree) != DmtxPass ||
+         CollectPdfPages(doc, &tree, NULL, 0, &pages, &pageCount, &pageAlloc) != DmtxPass) {
+      free(pages);
+      return DmtxScanOk;
+   }
+
+   nativeCount = pickedCount = 0;
+   for(pageIndex = 0; pageIndex < pageCount; pageIndex++) {
+      if(scan->opt.page != DmtxUndefined && scan->opt.page - 1 != pageIndex)
+         continue;
+
+      pickedCount++;
+      ClassifyPdfPage(doc, &pages[pageIndex]);
+      if(pages[pageIndex].type != ScanPdfPageVector)
+         nativeCount++;
+   }
+
+   /* Without a page image to decode, Magick renders the file in one pass */
+   if(nativeCount == 0 || (path == NULL && nativeCount < pickedCount)) {
+      free(pages);
+      return DmtxScanOk;
+   }
+
+   *handled = DmtxTrue;
+
+   /* Reserve for the file held in memory and the largest page scanned */
+   need = 0;
+   for(pageIndex = 0; pageIndex < pageCount; pageIndex++) {
+      pageNeed = GetPdfPageBytes(scan, &pages[pageIndex]);
+      if(pageNeed > need && (scan->opt.page == DmtxUndefined || scan->opt.page - 1 == pageIndex))
+         need = pageNeed;
+   }
+
+   if(ReserveMemory(scan, doc->length + need, source) != DmtxPass) {
+      free(pages);
+      return DmtxScanErrorMemory;
+   }
+
+   /* The fax decoder copies its strips from the file in memory */
+   memset(&fax, 0x00, sizeof(ScanFaxReader));
+   fax.mem = doc->data;
+   fax.memLength = doc->length;
+
+   status = DmtxScanOk;
+   for(pageIndex = 0; pageIndex < pageCount && status == DmtxScanOk; pageIndex++) {
+
+      /* If requested, only scan specific page */
+      if(scan->opt.page != DmtxUndefined && scan->opt.page - 1 != pageIndex)
+         continue;
+
+      if(StopReached(scan) == DmtxTrue)
+         break;
+
+      page = &pages[pageIndex];
+      switch(page->type) {
+         case ScanPdfPageImage:
+            status = ReadWand(scan, NULL, page->imageData, page->imageLength, source, pageIndex);
+            break;
+         case ScanPdfPageFax:
+            status = ScanFaxPage(scan, &fax, &page->fax, source, pageIndex);
+            break;
+         default:
+            subimage = (char *)malloc(strlen(path) + 16);
+            if(subimage == NULL) {
+               SetError(scan, "malloc() error");
+               status = DmtxScanErrorMemory;
+               break;
+            }
+            sprintf(subimage, "%s[%d]", path, pageIndex);
+            status = ReadWand(scan, subimage, NULL, 0, source, pageIndex);
+            free(subimage);
+            break;
+      }
+   }
+
+   free(fax.data);
+   free(fax.cur);
+   free(fax.ref);
+   free(pages);
+
+   return status;
+}
+
+/**
+ * @brief  Estimate bytes needed to decode and scan one PDF page
+ * @param  scan session
+ * @param  page classified page
+ * @return Estimated bytes, or the memory limit for pages Magick renders
+ */
+static size_t
+GetPdfPageBytes(DmtxScan *scan, ScanPdfPage *page)
+{
+   switch(page->type) {
+      case ScanPdfPageImage:
+         return dmtxScanEstimatePage(&(scan->opt), page->width, page->height, DmtxPack24bppRGB);
+      case ScanPdfPageFax:
+         return GetFaxPageBytes(scan, &page->fax);
+      default:
+         return scan->opt.memoryLimit;
+   }
+}
+
+/**
+ * @brief  Read a PDF file into memory and index its objects
+ * @param  path PDF path
+ * @param  limit memory limit in bytes, or 0 for none
+ * @param  doc document to fill in
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+LoadPdf(const char *path, size_t limit, ScanPdfDoc *doc)
+{
+   long size;
+   size_t headerLength;
+   unsigned char header[DMTXSCAN_PDF_HEADER_SEARCH];
+   FILE *fp;
+
+   memset(doc, 0x00, sizeof(ScanPdfDoc));
+
+   fp = fopen(path, "rb");
+   if(fp == NULL)
+      return DmtxFail;
+
+   /* Readers accept junk ahead of the header, so look a little way in */
+   headerLength = fread(header, 1, sizeof(header), fp);
+   if(FindPdfText(header, header + headerLength, "%PDF-") == NULL ||
+         fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) <= 0 ||
+         (limit != 0 && (size_t)size > limit) || fseek(fp, 0, SEEK_SET) != 0) {
+      fclose(fp);
+      return DmtxFail;
+   }
+
+   doc->data = (unsigned char *)malloc((size_t)size);
+   if(doc->data == NULL || fread(doc->data, 1, (size_t)size, fp) != (size_t)size) {
+      fclose(fp);
+      FreePdf(doc);
+      return DmtxFail;
+   }
+   doc->length = (size_t)size;
+   fclose(fp);
+
+   if(IndexPdf(doc) != DmtxPass) {
+      FreePdf(doc);
+      return DmtxFail;
+   }
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Index the objects of a PDF file held in memory and find its catalog
+ * @param  doc document with data and length set
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+IndexPdf(ScanPdfDoc *doc)
+{
+   const unsigned char *p, *end, *root;
+   ScanPdfValue value;
+
+   end = doc->data + doc->length;
+
+   /* Encrypted streams would need decrypting first */
+   if(FindPdfText(doc->data, end, "/Encrypt") != NULL || IndexPdfObjects(doc) != DmtxPass)
+      return DmtxFail;
+
+   /* Incremental updates append trailers, and the last one is current */
+   root = NULL;
+   for(p = doc->data; (p = FindPdfText(p, end, "/Root")) != NULL; p += 5)
+      root = p;
+
+   if(root != NULL)
+      ReadPdfValue(root + 5, end, &value);
+
+   if(root == NULL || value.type != ScanPdfTokenRef)
+      return DmtxFail;
+   doc->root = value.objectNum;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Free a document loaded by LoadPdf() or ScanPdfData()
+ * @param  doc document
+ * @return void
+ */
+static void
+FreePdf(ScanPdfDoc *doc)
+{
+   int i;
+
+   for(i = 0; i < doc->bufferCount; i++)
+      free(doc->buffers[i]);
+
+   free(doc->buffers);
+   free(doc->objects);
+   if(doc->borrowed == DmtxFalse)
+      free(doc->data);
+
+   memset(doc, 0x00, sizeof(ScanPdfDoc));
+}
+
+/**
+ * @brief  Find every "objectNum generation obj" in the file
+ * @param  doc document
+ * @return DmtxPass | DmtxFail
+ *
+ * The cross-reference table is not trusted, since many writers get its
+ * offsets wrong. Objects compressed into object streams are indexed in a
+ * second pass, once every stream they may refer to is known.
+ */
+static DmtxPassFail
+IndexPdfObjects(ScanPdfDoc *doc)
+{
+   int objectNum, digits;
+   const unsigned char *data, *end, *p, *q, *obj, *numEnd;
+   ScanPdfValue value, keyword;
+
+   data = doc->data;
+   end = data + doc->length;
+
+   for(p = data; (obj = FindPdfText(p, end, "obj")) != NULL; ) {
+      p = obj + 3;
+
+      /* Must be a whole keyword after two unsigned integers */
+      if(p < end && !ISPDFSPACE(*p) && !ISPDFDELIM(*p))
+         continue;
+
+      for(q = obj; q > data && ISPDFSPACE(q[-1]); q--);
+      if(q == obj || q == data || !ISDIGIT(q[-1]))
+         continue;
+
+      for(; q > data && ISDIGIT(q[-1]); q--);
+      for(numEnd = q; q > data && ISPDFSPACE(q[-1]); q--);
+      if(q == numEnd)
+         continue;
+
+      for(numEnd = q, digits = 0; q > data && ISDIGIT(q[-1]) && digits < 8; q--, digits++);
+      if(digits == 0 || (q > data && !ISPDFSPACE(q[-1]) && !ISPDFDELIM(q[-1])))
+         continue;
+
+      for(objectNum = 0; q < numEnd; q++)
+         objectNum = objectNum * 10 + (*q - '0');
+
+      if(SetPdfObject(doc, objectNum, p, end, (size_t)(obj - data)) != DmtxPass)
+         return DmtxFail;
+
+      /* Stream data may contain anything, so skip it whole */
+      q = ReadPdfValue(p, end, &value);
+      if(value.type == ScanPdfTokenDict) {
+         q = ReadPdfToken(q, end, &keyword);
+         if(keyword.type == ScanPdfTokenKeyword && PdfValueIs(&keyword, "stream") == DmtxTrue) {
+            q = FindPdfText(q, end, "endstream");
+            if(q == NULL)
+               break;
+            p = q + 9;
+         }
+      }
+   }
+
+   for(objectNum = 0; objectNum < doc->objectCount; objectNum++) {
+      if(doc->objects[objectNum].start != NULL)
+         ExpandPdfObjectStream(doc, objectNum);
+   }
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Record where an object is defined, unless a later definition exists
+ * @param  doc document
+ * @param  objectNum object number
+ * @param  start first byte of the object's value
+ * @param  end end of the data holding the value
+ * @param  order file offset of the definition
+ * @return DmtxPass | DmtxFail (memory error)
+ */
+static DmtxPassFail
+SetPdfObject(ScanPdfDoc *doc, int objectNum, const unsigned char *start,
+      const unsigned char *end, size_t order)
+{
+   int count;
+   ScanPdfObject *objects;
+
+   /* Objects past the limit are dropped, and pages using them fall back */
+   if(objectNum < 0 || objectNum >= DMTXSCAN_PDF_OBJECTS_MAX)
+      return DmtxPass;
+
+   if(objectNum >= doc->objectCount) {
+      count = (doc->objectCount * 2 > objectNum) ? doc->objectCount * 2 : objectNum + 1;
+      if(count > DMTXSCAN_PDF_OBJECTS_MAX)
+         count = DMTXSCAN_PDF_OBJECTS_MAX;
+
+      objects = (ScanPdfObject *)realloc(doc->objects, count * sizeof(ScanPdfObject));
+      if(objects == NULL)
+         return DmtxFail;
+
+      memset(objects + doc->objectCount, 0x00, (count - doc->objectCount) * sizeof(ScanPdfObject));
+      doc->objects = objects;
+      doc->objectCount = count;
+   }
+
+   if(doc->objects[objectNum].start == NULL || doc->objects[objectNum].order <= order) {
+      doc->objects[objectNum].start = start;
+      doc->objects[objectNum].end = end;
+      doc->objects[objectNum].order = order;
+   }
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Index the objects held by an object stream
+ * @param  doc document
+ * @param  objectNum object to check, which is ignored unless an object stream
+ * @return void
+ */
+static void
+ExpandPdfObjectStream(ScanPdfDoc *doc, int objectNum)
+{
+   int i, count, first, memberNum;
+   size_t length, order;
+   unsigned char *buffer, **buffers;
+   const unsigned char *p;
+   ScanPdfValue dict, type, token;
+
+   if(GetPdfObject(doc, objectNum, &dict) != DmtxPass || dict.type != ScanPdfTokenDict ||
+         GetPdfDictValue(doc, &dict, "/Type", &type) != DmtxPass ||
+         PdfValueIs(&type, "/ObjStm") == DmtxFalse)
+      return;
+
+   order = doc->objects[objectNum].order;
+   count = GetPdfDictInt(doc, &dict, "/N", 0);
+   first = GetPdfDictInt(doc, &dict, "/First", -1);
+
+   if(first < 0 || DecodePdfStream(doc, &dict, &buffer, &length) != DmtxPass)
+      return;
+
+   buffers = (unsigned char **)realloc(doc->buffers, (doc->bufferCount + 1) * sizeof(unsigned char *));
+   if(buffers == NULL || (size_t)first > length) {
+      if(buffers != NULL)
+         doc->buffers = buffers;
+      free(buffer);
+      return;
+   }
+   doc->buffers = buffers;
+   doc->buffers[doc->bufferCount++] = buffer;
+
+   /* Header holds "objectNum offset" pairs, offsets counted from First */
+   for(p = buffer, i = 0; i < count; i++) {
+      p = ReadPdfToken(p, buffer + first, &token);
+      if(token.type != ScanPdfTokenNumber)
+         break;
+      memberNum = (int)token.number;
+
+      p = ReadPdfToken(p, buffer + first, &token);
+      if(token.type != ScanPdfTokenNumber || token.number < 0.0 || token.number > (double)(length - first))
+         break;
+
+      if(SetPdfObject(doc, memberNum, buffer + first + (size_t)token.number,
+            buffer + length, order) != DmtxPass)
+         break;
+   }
+}
+
+/**
+ * @brief  Append the leaves of a page tree node to a page list
+ * @param  doc document
+ * @param  node page tree node
+ * @param  resources resources inherited from the node's ancestors, or NULL
+ * @param  depth nesting depth of node
+ * @param  pages pointer to page array, grown as needed
+ * @param  pageCount pointer to page count
+ * @param  pageAlloc pointer to allocated length of page array
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+CollectPdfPages(ScanPdfDoc *doc, ScanPdfValue *node, ScanPdfValue *resources,
+      int depth, ScanPdfPage **pages, int *pageCount, int *pageAlloc)
+{
+   int alloc;
+   const unsigned char *p;
+   ScanPdfValue own, kids, kid;
+   ScanPdfPage *newPages;
+
+   if(depth > DMTXSCAN_PDF_DEPTH_MAX || node->type != ScanPdfTokenDict ||
+         ++doc->walkSteps > doc->objectCount)
+      return DmtxFail;
+
+   /* Resources are inherited from the nearest ancestor that has them */
+   if(GetPdfDictValue(doc, node, "/Resources", &own) == DmtxPass)
+      resources = &own;
+
+   if(GetPdfDictValue(doc, node, "/Kids", &kids) == DmtxPass) {
+      if(kids.type != ScanPdfTokenArray)
+         return DmtxFail;
+
+      for(p = kids.start + 1;;) {
+         p = ReadPdfValue(p, kids.end, &kid);
+         if(kid.type == ScanPdfTokenArrayEnd)
+            break;
+
+         if(kid.type != ScanPdfTokenRef || GetPdfObject(doc, kid.objectNum, &kid) != DmtxPass ||
+               CollectPdfPages(doc, &kid, resources, depth + 1, pages, pageCount,
+               pageAlloc) != DmtxPass)
+            return DmtxFail;
+      }
+
+      return DmtxPass;
+   }
+
+   if(*pageCount == *pageAlloc) {
+      alloc = (*pageAlloc == 0) ? 16 : *pageAlloc * 2;
+      newPages = (ScanPdfPage *)realloc(*pages, alloc * sizeof(ScanPdfPage));
+      if(newPages == NULL)
+         return DmtxFail;
+      *pages = newPages;
+      *pageAlloc = alloc;
+   }
+
+   memset(&(*pages)[*pageCount], 0x00, sizeof(ScanPdfPage));
+   (*pages)[*pageCount].dict = *node;
+   if(resources != NULL)
+      (*pages)[*pageCount].resources = *resources;
+   (*pageCount)++;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Decide whether a page can be scanned from its one image
+ * @param  doc document
+ * @param  page page, whose type is left ScanPdfPageVector unless so
+ * @return void
+ */
+static void
+ClassifyPdfPage(ScanPdfDoc *doc, ScanPdfPage *page)
+{
+   double ctm[6];
+   unsigned char *content;
+   size_t contentLength;
+   ScanPdfValue contents;
+
+   page->type = ScanPdfPageVector;
+   page->imageCount = 0;
+
+   /* Pages without content are blank, and Magick reports them as such */
+   if(GetPdfDictValue(doc, &page->dict, "/Contents", &contents) != DmtxPass ||
+         ReadPdfContent(doc, &contents, &content, &contentLength) != DmtxPass)
+      return;
+
+   ctm[0] = ctm[3] = 1.0;
+   ctm[1] = ctm[2] = ctm[4] = ctm[5] = 0.0;
+
+   if(FindPdfPageImage(doc, page, content, contentLength, &page->resources, ctm, 0) == DmtxPass &&
+         page->imageCount == 1)
+      ClassifyPdfImage(doc, page);
+
+   free(content);
+}
+
+/**
+ * @brief  Decide whether a page image is decoded natively, and how
+ * @param  doc document
+ * @param  page page with its one image found
+ * @return void
+ */
+static void
+ClassifyPdfImage(ScanPdfDoc *doc, ScanPdfPage *page)
+{
+   int k;
+   DmtxBoolean inverted;
+   ScanPdfValue filter, parms, value;
+   ScanPdfValue *image = &page->image;
+   ScanTiffPage *fax = &page->fax;
+
+   page->width = GetPdfDictInt(doc, image, "/Width", 0);
+   page->height = GetPdfDictInt(doc, image, "/Height", 0);
+
+   if(page->width < 1 || page->height < 1 ||
+         GetPdfStream(doc, image, &page->imageData, &page->imageLength) != DmtxPass ||
+         GetPdfFilter(doc, image, &filter, &parms) != DmtxPass || filter.type != ScanPdfTokenName)
+      return;
+
+   /* Masked images are composited by the renderer */
+   if(GetPdfDictValue(doc, image, "/SMask", &value) == DmtxPass ||
+         GetPdfDictValue(doc, image, "/Mask", &value) == DmtxPass)
+      return;
+
+   if(PdfValueIs(&filter, "/DCTDecode") == DmtxTrue || PdfValueIs(&filter, "/JPXDecode") == DmtxTrue) {
+      if(GetPdfDictValue(doc, image, "/Decode", &value) != DmtxPass)
+         page->type = ScanPdfPageImage;
+      return;
+   }
+
+   if(PdfValueIs(&filter, "/CCITTFaxDecode") == DmtxFalse ||
+         GetPdfDictInt(doc, &parms, "/Columns", 1728) != page->width)
+      return;
+
+   /* Decode [1 0] swaps black and white */
+   inverted = DmtxFalse;
+   if(GetPdfDictValue(doc, image, "/Decode", &value) == DmtxPass) {
+      if(value.type != ScanPdfTokenArray)
+         return;
+      ReadPdfValue(value.start + 1, value.end, &value);
+      if(value.type != ScanPdfTokenNumber)
+         return;
+      inverted = (value.number > 0.5) ? DmtxTrue : DmtxFalse;
+   }
+
+   /* The image stream is laid out as a single strip TIFF page */
+   k = GetPdfDictInt(doc, &parms, "/K", 0);
+   memset(fax, 0x00, sizeof(ScanTiffPage));
+   fax->width = page->width;
+   fax->height = page->height;
+   fax->compression = (k < 0) ? DMTXSCAN_TIFF_CCITT_T6 : DMTXSCAN_TIFF_CCITT_T4;
+   fax->t4Options = (k > 0) ? 0x01 : 0x00;
+   fax->lsbFirst = DmtxFalse;
+   fax->rowsPerStrip = page->height;
+   fax->stripCount = 1;
+
+   /* Code white renders dark when BlackIs1 is not undone by Decode */
+   fax->blackIsZero = (GetPdfDictBool(doc, &parms, "/BlackIs1") != inverted) ? DmtxTrue : DmtxFalse;
+
+   /* With EOL codes it is the EOL that ends on a byte boundary instead */
+   fax->byteAligned = (GetPdfDictBool(doc, &parms, "/EncodedByteAlign") == DmtxTrue &&
+         (k < 0 || GetPdfDictBool(doc, &parms, "/EndOfLine") == DmtxFalse)) ? DmtxTrue : DmtxFalse;
+
+   page->faxOffset = (unsigned long)(page->imageData - doc->data);
+   page->faxLength = (unsigned long)page->imageLength;
+   fax->stripOffsets = &page->faxOffset;
+   fax->stripByteCounts = &page->faxLength;
+   page->type = ScanPdfPageFax;
+}
+
+/**
+ * @brief  Decode and join the content streams of a page
+ * @param  doc document
+ * @param  contents page /Contents value, a stream or array of streams
+ * @param  content pointer to new buffer of content
+ * @param  contentLength pointer to content length
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+ReadPdfContent(ScanPdfDoc *doc, ScanPdfValue *contents, unsigned char **content,
+      size_t *contentLength)
+{
+   size_t partLength;
+   unsigned char *part, *joined;
+   const unsigned char *p;
+   ScanPdfValue ref;
+
+   if(contents->type == ScanPdfTokenDict)
+      return DecodePdfStream(doc, contents, content, contentLength);
+
+   if(contents->type != ScanPdfTokenArray)
+      return DmtxFail;
+
+   *content = NULL;
+   *contentLength = 0;
+
+   /* Streams are joined with white-space, since tokens never span them */
+   for(p = contents->start + 1;;) {
+      p = ReadPdfValue(p, contents->end, &ref);
+      if(ref.type == ScanPdfTokenArrayEnd)
+         return DmtxPass;
+
+      if(ref.type != ScanPdfTokenRef || GetPdfObject(doc, ref.objectNum, &ref) != DmtxPass ||
+            DecodePdfStream(doc, &ref, &part, &partLength) != DmtxPass) {
+         free(*content);
+         return DmtxFail;
+      }
+
+      joined = (unsigned char *)realloc(*content, *contentLength + partLength + 1);
+      if(joined == NULL) {
+         free(part);
+         free(*content);
+         return DmtxFail;
+      }
+
+      memcpy(joined + *contentLength, part, partLength);
+      joined[*contentLength + partLength] = '\n';
+      *content = joined;
+      *contentLength += partLength + 1;
+      free(part);
+   }
+}
+
+/**
+ * @brief  Run a content stream, counting images and failing on anything else visible
+ * @param  doc document
+ * @param  page page whose imageCount and image are updated
+ * @param  content decoded content stream
+ * @param  contentLength content length
+ * @param  resources resources of the page or form
+ * @param  ctm current transformation matrix, updated in place
+ * @param  depth form nesting depth
+ * @return DmtxPass if only images are painted, otherwise DmtxFail
+ *
+ * Clipping, colour and marked content are ignored. Text is allowed only
+ * in render mode 3 (invisible), which is how OCR software lays a text
+ * layer over a scan.
+ */
+static DmtxPassFail
+FindPdfPageImage(ScanPdfDoc *doc, ScanPdfPage *page, const unsigned char *content,
+      size_t contentLength, ScanPdfValue *resources, double *ctm, int depth)
+{
+   static const char *harmless[] = {
+      "w", "J", "j", "M", "d", "ri", "i", "gs",
+      "m", "l", "c", "v", "y", "h", "re", "n", "W", "W*",
+      "BT", "ET", "Tc", "Tw", "Tz", "TL", "Tf", "Ts", "Td", "TD", "Tm", "T*",
+      "CS", "cs", "SC", "SCN", "sc", "scn", "G", "g", "RG", "rg", "K", "k",
+      "MP", "DP", "BMC", "BDC", "EMC", NULL
+   };
+   int i;
+   int operandCount, stackCount, render, compatibility;
+   int renderStack[DMTXSCAN_PDF_DEPTH_MAX];
+   double ctmStack[DMTXSCAN_PDF_DEPTH_MAX][6];
+   double m[6];
+   const unsigned char *p, *end;
+   ScanPdfValue token, operands[6];
+
+   operandCount = stackCount = render = compatibility = 0;
+
+   for(p = content, end = content + contentLength;;) {
+      p = ReadPdfValue(p, end, &token);
+      if(token.type == ScanPdfTokenEnd)
+         return DmtxPass;
+      else if(token.type == ScanPdfTokenError)
+         return DmtxFail;
+
+      /* Only the last few operands are ever needed */
+      if(token.type != ScanPdfTokenKeyword) {
+         if(operandCount == 6) {
+            memmove(operands, operands + 1, 5 * sizeof(ScanPdfValue));
+            operandCount--;
+         }
+         operands[operandCount++] = token;
+         continue;
+      }
+
+      if(PdfValueIs(&token, "q") == DmtxTrue) {
+         if(stackCount == DMTXSCAN_PDF_DEPTH_MAX)
+            return DmtxFail;
+         memcpy(ctmStack[stackCount], ctm, 6 * sizeof(double));
+         renderStack[stackCount++] = render;
+      }
+      else if(PdfValueIs(&token, "Q") == DmtxTrue) {
+         if(stackCount > 0) {
+            stackCount--;
+            memcpy(ctm, ctmStack[stackCount], 6 * sizeof(double));
+            render = renderStack[stackCount];
+         }
+      }
+      else if(PdfValueIs(&token, "cm") == DmtxTrue) {
+         if(operandCount != 6)
+            return DmtxFail;
+         for(i = 0; i < 6; i++) {
+            if(operands[i].type != ScanPdfTokenNumber)
+               return DmtxFail;
+            m[i] = operands[i].number;
+         }
+         MultiplyPdfMatrix(m, ctm);
+         memcpy(ctm, m, 6 * sizeof(double));
+      }
+      else if(PdfValueIs(&token, "Tr") == DmtxTrue) {
+         if(operandCount < 1 || operands[operandCount-1].type != ScanPdfTokenNumber)
+            return DmtxFail;
+         render = (int)operands[operandCount-1].number;
+      }
+      else if(PdfValueIs(&token, "Tj") == DmtxTrue || PdfValueIs(&token, "TJ") == DmtxTrue ||
+            PdfValueIs(&token, "'") == DmtxTrue || PdfValueIs(&token, "\"") == DmtxTrue) {
+         if(render != 3)
+            return DmtxFail;
+      }
+      else if(PdfValueIs(&token, "Do") == DmtxTrue) {
+         if(operandCount < 1 || operands[operandCount-1].type != ScanPdfTokenName ||
+               FindPdfXObject(doc, page, resources, &operands[operandCount-1], ctm,
+               depth) != DmtxPass)
+            return DmtxFail;
+      }
+      else if(PdfValueIs(&token, "BX") == DmtxTrue) {
+         compatibility++;
+      }
+      else if(PdfValueIs(&token, "EX") == DmtxTrue) {
+         if(compatibility > 0)
+            compatibility--;
+      }
+      else {
+         /* Painting, shading and inline images all make a page vector */
+         for(i = 0; harmless[i] != NULL && PdfValueIs(&token, harmless[i]) == DmtxFalse; i++);
+         if(harmless[i] == NULL && compatibility == 0)
+            return DmtxFail;
+      }
+
+      operandCount = 0;
+   }
+}
+
+/**
+ * @brief  Count an image drawn by Do, or run a form drawn by Do
+ * @param  doc document
+ * @param  page page whose imageCount and image are updated
+ * @param  resources resources holding the XObject
+ * @param  name XObject name operand
+ * @param  ctm current transformation matrix
+ * @param  depth form nesting depth
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+FindPdfXObject(ScanPdfDoc *doc, ScanPdfPage *page, ScanPdfValue *resources,
+      ScanPdfValue *name, double *ctm, int depth)
+{
+   int i;
+   char key[128];
+   double m[6];
+   size_t length;
+   unsigned char *content;
+   const unsigned char *p;
+   ScanPdfValue xobjects, xobject, subtype, value, formResources;
+   DmtxPassFail err;
+
+   length = (size_t)(name->end - name->start);
+   if(length >= sizeof(key))
+      return DmtxFail;
+   memcpy(key, name->start, length);
+   key[length] = '\0';
+
+   if(GetPdfDictValue(doc, resources, "/XObject", &xobjects) != DmtxPass ||
+         GetPdfDictValue(doc, &xobjects, key, &xobject) != DmtxPass ||
+         GetPdfDictValue(doc, &xobject, "/Subtype", &subtype) != DmtxPass)
+      return DmtxFail;
+
+   if(PdfValueIs(&subtype, "/Image") == DmtxTrue) {
+
+      /* Stencil masks paint with the fill colour instead */
+      if(GetPdfDictBool(doc, &xobject, "/ImageMask") == DmtxTrue)
+         return DmtxFail;
+
+      /* A mirrored image would hold mirrored, unreadable symbols */
+      if(ctm[0] * ctm[3] - ctm[1] * ctm[2] <= 0.0)
+         return DmtxFail;
+
+      page->image = xobject;
+      return (++page->imageCount == 1) ? DmtxPass : DmtxFail;
+   }
+
+   if(PdfValueIs(&subtype, "/Form") == DmtxFalse || depth >= DMTXSCAN_PDF_DEPTH_MAX)
+      return DmtxFail;
+
+   /* Forms draw through their own matrix, with their own resources if any */
+   m[0] = m[3] = 1.0;
+   m[1] = m[2] = m[4] = m[5] = 0.0;
+   if(GetPdfDictValue(doc, &xobject, "/Matrix", &value) == DmtxPass) {
+      if(value.type != ScanPdfTokenArray)
+         return DmtxFail;
+
+      for(p = value.start + 1, i = 0; i < 6; i++) {
+         p = ReadPdfValue(p, value.end, &subtype);
+         if(subtype.type != ScanPdfTokenNumber)
+            return DmtxFail;
+         m[i] = subtype.number;
+      }
+   }
+   MultiplyPdfMatrix(m, ctm);
+
+   if(GetPdfDictValue(doc, &xobject, "/Resources", &formResources) != DmtxPass)
+      formResources = *resources;
+
+   if(DecodePdfStream(doc, &xobject, &content, &length) != DmtxPass)
+      return DmtxFail;
+
+   err = FindPdfPageImage(doc, page, content, length, &formResources, m, depth + 1);
+   free(content);
+
+   return err;
+}
+
+/**
+ * @brief  Concatenate a matrix with the current transformation matrix
+ * @param  m matrix, replaced by m x ctm
+ * @param  ctm current transformation matrix
+ * @return void
+ */
+static void
+MultiplyPdfMatrix(double *m, const double *ctm)
+{
+   double r[6];
+
+   r[0] = m[0] * ctm[0] + m[1] * ctm[2];
+   r[1] = m[0] * ctm[1] + m[1] * ctm[3];
+   r[2] = m[2] * ctm[0] + m[3] * ctm[2];
+   r[3] = m[2] * ctm[1] + m[3] * ctm[3];
+   r[4] = m[4] * ctm[0] + m[5] * ctm[2] + ctm[4];
+   r[5] = m[4] * ctm[1] + m[5] * ctm[3] + ctm[5];
+
+   memcpy(m, r, 6 * sizeof(double));
+}
+
+/**
+ * @brief  Locate the raw data of a stream object
+ * @param  doc document
+ * @param  dict stream dictionary
+ * @param  data pointer to first data byte
+ * @param  length pointer to data length
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+GetPdfStream(ScanPdfDoc *doc, ScanPdfValue *dict, const unsigned char **data, size_t *length)
+{
+   const unsigned char *p, *end, *endstream;
+   ScanPdfValue keyword, value;
+
+   /* Streams are never compressed into object streams */
+   end = doc->data + doc->length;
+   if(dict->type != ScanPdfTokenDict || dict->end < doc->data || dict->end >= end)
+      return DmtxFail;
+
+   p = ReadPdfToken(dict->end, end, &keyword);
+   if(keyword.type != ScanPdfTokenKeyword || PdfValueIs(&keyword, "stream") == DmtxFalse)
+      return DmtxFail;
+
+   if(p < end && *p == '\r')
+      p++;
+   if(p < end && *p == '\n')
+      p++;
+
+   /* Trust /Length only if endstream follows where it says */
+   if(GetPdfDictValue(doc, dict, "/Length", &value) == DmtxPass &&
+         value.type == ScanPdfTokenNumber && value.number >= 0.0 &&
+         value.number <= (double)(end - p)) {
+      endstream = p + (size_t)value.number;
+      if(FindPdfText(endstream, (end - endstream > 32) ? endstream + 32 : end, "endstream") != NULL) {
+         *data = p;
+         *length = (size_t)value.number;
+         return DmtxPass;
+      }
+   }
+
+   endstream = FindPdfText(p, end, "endstream");
+   if(endstream == NULL)
+      return DmtxFail;
+
+   if(endstream > p && endstream[-1] == '\n')
+      endstream--;
+   if(endstream > p && endstream[-1] == '\r')
+      endstream--;
+
+   *data = p;
+   *length = (size_t)(endstream - p);
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Decode a stream that is unfiltered or Flate compressed
+ * @param  doc document
+ * @param  dict stream dictionary
+ * @param  out pointer to new buffer of decoded data
+ * @param  outLength pointer to decoded length
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+DecodePdfStream(ScanPdfDoc *doc, ScanPdfValue *dict, unsigned char **out, size_t *outLength)
+{
+   size_t length;
+   const unsigned char *data;
+   ScanPdfValue filter, parms;
+
+   if(GetPdfStream(doc, dict, &data, &length) != DmtxPass ||
+         GetPdfFilter(doc, dict, &filter, &parms) != DmtxPass)
+      return DmtxFail;
+
+   if(filter.type == ScanPdfTokenEnd) {
+      *out = (unsigned char *)malloc(length + 1);
+      if(*out == NULL)
+         return DmtxFail;
+      memcpy(*out, data, length);
+      *outLength = length;
+      return DmtxPass;
+   }
+
+   if(PdfValueIs(&filter, "/FlateDecode") == DmtxFalse ||
+         GetPdfDictInt(doc, &parms, "/Predictor", 1) != 1)
+      return DmtxFail;
+
+   return InflatePdfData(data, length, out, outLength);
+}
+
+/**
+ * @brief  Inflate zlib compressed data
+ * @param  data compressed data
+ * @param  length compressed length
+ * @param  out pointer to new buffer of inflated data
+ * @param  outLength pointer to inflated length
+ * @return DmtxPass | DmtxFail (or always DmtxFail when built without zlib)
+ *
+ * Data cut short is kept as far as it goes, as other PDF readers do.
+ */
+static DmtxPassFail
+InflatePdfData(const unsigned char *data, size_t length, unsigned char **out, size_t *outLength)
+{
+#if defined(HAVE_ZLIB_H) && defined(HAVE_LIBZ)
+   int err;
+   size_t alloc;
+   unsigned char *buffer, *newBuffer;
+   z_stream z;
+
+   if(length > 0x7fffffffUL)
+      return DmtxFail;
+
+   memset(&z, 0x00, sizeof(z_stream));
+   if(inflateInit(&z) != Z_OK)
+      return DmtxFail;
+
+   alloc = (length < DMTXSCAN_PDF_INFLATE_MAX / 4) ? length * 4 + 1024 : DMTXSCAN_PDF_INFLATE_MAX;
+   buffer = (unsigned char *)malloc(alloc);
+   if(buffer == NULL) {
+      inflateEnd(&z);
+      return DmtxFail;
+   }
+
+   z.next_in = (Bytef *)data;
+   z.avail_in = (uInt)length;
+
+   for(;;) {
+      z.next_out = buffer + z.total_out;
+      z.avail_out = (uInt)(alloc - z.total_out);
+
+      err = inflate(&z, Z_NO_FLUSH);
+      if(err == Z_STREAM_END || (err == Z_BUF_ERROR && z.avail_out != 0))
+         break;
+      else if(err != Z_OK && err != Z_BUF_ERROR)
+         break;
+      else if(z.avail_out != 0)
+         continue;
+
+      if(alloc >= DMTXSCAN_PDF_INFLATE_MAX) {
+         err = Z_MEM_ERROR;
+         break;
+      }
+
+      alloc = (alloc * 2 < DMTXSCAN_PDF_INFLATE_MAX) ? alloc * 2 : DMTXSCAN_PDF_INFLATE_MAX;
+      newBuffer = (unsigned char *)realloc(buffer, alloc);
+      if(newBuffer == NULL) {
+         err = Z_MEM_ERROR;
+         break;
+      }
+      buffer = newBuffer;
+   }
+
+   *outLength = z.total_out;
+   inflateEnd(&z);
+
+   if(err == Z_MEM_ERROR || (err != Z_STREAM_END && *outLength == 0)) {
+      free(buffer);
+      return DmtxFail;
+   }
+   *out = buffer;
+
+   return DmtxPass;
+#else
+   (void)data;
+   (void)length;
+   (void)out;
+   (void)outLength;
+
+   return DmtxFail;
+#endif
+}
+
+/**
+ * @brief  Read the filter of a stream and its decode parameters
+ * @param  doc document
+ * @param  dict stream dictionary
+ * @param  filter filter name, or type ScanPdfTokenEnd if unfiltered
+ * @param  parms parameter dictionary, or type ScanPdfTokenEnd if none
+ * @return DmtxPass | DmtxFail (chained filters included)
+ */
+static DmtxPassFail
+GetPdfFilter(ScanPdfDoc *doc, ScanPdfValue *dict, ScanPdfValue *filter, ScanPdfValue *parms)
+{
+   const unsigned char *p, *end;
+   ScanPdfValue next;
+
+   if(GetPdfDictValue(doc, dict, "/Filter", filter) != DmtxPass) {
+      filter->type = parms->type = ScanPdfTokenEnd;
+      return DmtxPass;
+   }
+
+   /* Only a single filter is decoded, even when given as an array */
+   if(filter->type == ScanPdfTokenArray) {
+      end = filter->end;
+      p = ReadPdfValue(filter->start + 1, end, filter);
+      ReadPdfValue(p, end, &next);
+      if(next.type != ScanPdfTokenArrayEnd)
+         return DmtxFail;
+   }
+
+   if(filter->type != ScanPdfTokenName)
+      return DmtxFail;
+
+   if(GetPdfDictValue(doc, dict, "/DecodeParms", parms) != DmtxPass) {
+      parms->type = ScanPdfTokenEnd;
+      return DmtxPass;
+   }
+
+   if(parms->type == ScanPdfTokenArray) {
+      ReadPdfValue(parms->start + 1, parms->end, parms);
+      if(parms->type == ScanPdfTokenRef && GetPdfObject(doc, parms->objectNum, parms) != DmtxPass)
+         parms->type = ScanPdfTokenEnd;
+   }
+
+   if(parms->type != ScanPdfTokenDict)
+      parms->type = ScanPdfTokenEnd;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Read the value of an indirect object
+ * @param  doc document
+ * @param  objectNum object number
+ * @param  value object value
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+GetPdfObject(ScanPdfDoc *doc, int objectNum, ScanPdfValue *value)
+{
+   ScanPdfObject *obj;
+
+   if(objectNum < 0 || objectNum >= doc->objectCount || doc->objects[objectNum].start == NULL)
+      return DmtxFail;
+
+   obj = &doc->objects[objectNum];
+   ReadPdfValue(obj->start, obj->end, value);
+
+   return (value->type == ScanPdfTokenEnd || value->type == ScanPdfTokenError ||
+         value->type == ScanPdfTokenRef) ? DmtxFail : DmtxPass;
+}
+
+/**
+ * @brief  Look up a dictionary entry, following an indirect reference
+ * @param  doc document
+ * @param  dict dictionary
+ * @param  key key name, with its leading slash
+ * @param  value entry value
+ * @return DmtxPass, or DmtxFail if absent or null
+ */
+static DmtxPassFail
+GetPdfDictValue(ScanPdfDoc *doc, ScanPdfValue *dict, const char *key, ScanPdfValue *value)
+{
+   const unsigned char *p;
+   ScanPdfValue name;
+
+   if(dict->type != ScanPdfTokenDict)
+      return DmtxFail;
+
+   for(p = dict->start + 2;;) {
+      p = ReadPdfValue(p, dict->end, &name);
+      if(name.type != ScanPdfTokenName)
+         return DmtxFail;
+
+      p = ReadPdfValue(p, dict->end, value);
+      if(value->type == ScanPdfTokenEnd || value->type == ScanPdfTokenError ||
+            value->type == ScanPdfTokenDictEnd)
+         return DmtxFail;
+
+      if(PdfValueIs(&name, key) == DmtxTrue)
+         break;
+   }
+
+   if(value->type == ScanPdfTokenRef)
+      return GetPdfObject(doc, value->objectNum, value);
+
+   return (PdfValueIs(value, "null") == DmtxTrue) ? DmtxFail : DmtxPass;
+}
+
+/**
+ * @brief  Look up an integer dictionary entry
+ * @param  doc document
+ * @param  dict dictionary (any type other than dictionary reads as empty)
+ * @param  key key name, with its leading slash
+ * @param  defaultValue value returned if the entry is absent or not a number
+ * @return Entry value
+ */
+static int
+GetPdfDictInt(ScanPdfDoc *doc, ScanPdfValue *dict, const char *key, int defaultValue)
+{
+   ScanPdfValue value;
+
+   if(GetPdfDictValue(doc, dict, key, &value) != DmtxPass || value.type != ScanPdfTokenNumber ||
+         value.number < -2147483647.0 || value.number > 2147483647.0)
+      return defaultValue;
+
+   return (int)value.number;
+}
+
+/**
+ * @brief  Look up a boolean dictionary entry
+ * @param  doc document
+ * @param  dict dictionary (any type other than dictionary reads as empty)
+ * @param  key key name, with its leading slash
+ * @return DmtxTrue only if the entry is present and true
+ */
+static DmtxBoolean
+GetPdfDictBool(ScanPdfDoc *doc, ScanPdfValue *dict, const char *key)
+{
+   ScanPdfValue value;
+
+   if(GetPdfDictValue(doc, dict, key, &value) != DmtxPass)
+      return DmtxFalse;
+
+   return PdfValueIs(&value, "true");
+}
+
+/**
+ * @brief  Compare the text of a value with a string
+ * @param  value value
+ * @param  text string, with the leading slash of a name
+ * @return DmtxTrue | DmtxFalse
+ */
+static DmtxBoolean
+PdfValueIs(ScanPdfValue *value, const char *text)
+{
+   size_t length = strlen(text);
+
+   return ((size_t)(value->end - value->start) == length &&
+         memcmp(value->start, text, length) == 0) ? DmtxTrue : DmtxFalse;
+}
+
+/**
+ * @brief  Read one value, taking arrays, dictionaries and references whole
+ * @param  p first byte to read
+ * @param  end end of data
+ * @param  value value read, or a token of type ScanPdfTokenEnd or _Error
+ * @return Position after the value
+ */
+static const unsigned char *
+ReadPdfValue(const unsigned char *p, const unsigned char *end, ScanPdfValue *value)
+{
+   int depth;
+   const unsigned char *q;
+   ScanPdfValue token;
+
+   p = ReadPdfToken(p, end, value);
+
+   if(value->type == ScanPdfTokenNumber) {
+
+      /* "objectNum generation R" is a reference */
+      q = ReadPdfToken(p, end, &token);
+      if(token.type != ScanPdfTokenNumber)
+         return p;
+
+      q = ReadPdfToken(q, end, &token);
+      if(token.type != ScanPdfTokenKeyword || PdfValueIs(&token, "R") == DmtxFalse)
+         return p;
+
+      value->type = ScanPdfTokenRef;
+      value->objectNum = (value->number >= 0.0 && value->number < (double)DMTXSCAN_PDF_OBJECTS_MAX) ?
+            (int)value->number : DmtxUndefined;
+      value->end = token.end;
+      return q;
+   }
+
+   if(value->type != ScanPdfTokenArray && value->type != ScanPdfTokenDict)
+      return p;
+
+   for(depth = 1; depth > 0;) {
+      p = ReadPdfToken(p, end, &token);
+      if(token.type == ScanPdfTokenArray || token.type == ScanPdfTokenDict) {
+         depth++;
+      }
+      else if(token.type == ScanPdfTokenArrayEnd || token.type == ScanPdfTokenDictEnd) {
+         depth--;
+      }
+      else if(token.type == ScanPdfTokenEnd || token.type == ScanPdfTokenError) {
+         value->type = ScanPdfTokenError;
+         break;
+      }
+   }
+   value->end = p;
+
+   return p;
+}
+
+/**
+ * @brief  Read one token, skipping white-space and comments
+ * @param  p first byte to read
+ * @param  end end of data
+ * @param  token token read
+ * @return Position after the token
+ */
+static const unsigned char *
+ReadPdfToken(const unsigned char *p, const unsigned char *end, ScanPdfValue *token)
+{
+   int depth;
+   double number, scale;
+   DmtxBoolean negative, digits;
+   const unsigned char *q;
+
+   while(p < end) {
+      if(*p == '%') {
+         while(p < end && *p != '\n' && *p != '\r')
+            p++;
+      }
+      else if(ISPDFSPACE(*p)) {
+         p++;
+      }
+      else {
+         break;
+      }
+   }
+
+   memset(token, 0x00, sizeof(ScanPdfValue));
+   token->start = p;
+   token->type = ScanPdfTokenError;
+
+   if(p == end) {
+      token->type = ScanPdfTokenEnd;
+   }
+   else if(*p == '/') {
+      for(p++; p < end && !ISPDFSPACE(*p) && !ISPDFDELIM(*p); p++);
+      token->type = ScanPdfTokenName;
+   }
+   else if(*p == '(') {
+      for(depth = 0; p < end; p++) {
+         if(*p == '\\' && p + 1 < end)
+            p++;
+         else if(*p == '(')
+            depth++;
+         else if(*p == ')' && --depth == 0)
+            break;
+      }
+      if(p < end) {
+         p++;
+         token->type = ScanPdfTokenString;
+      }
+   }
+   else if(*p == '<' && p + 1 < end && p[1] == '<') {
+      p += 2;
+      token->type = ScanPdfTokenDict;
+   }
+   else if(*p == '<') {
+      q = (const unsigned char *)memchr(p, '>', end - p);
+      if(q != NULL) {
+         p = q + 1;
+         token->type = ScanPdfTokenString;
+      }
+   }
+   else if(*p == '>' && p + 1 < end && p[1] == '>') {
+      p += 2;
+      token->type = ScanPdfTokenDictEnd;
+   }
+   else if(*p == '[') {
+      p++;
+      token->type = ScanPdfTokenArray;
+   }
+   else if(*p == ']') {
+      p++;
+      token->type = ScanPdfTokenArrayEnd;
+   }
+   else if(*p == '{' || *p == '}') {
+      p++;
+      token->type = ScanPdfTokenKeyword;
+   }
+   else if(!ISPDFDELIM(*p)) {
+      for(q = p; p < end && !ISPDFSPACE(*p) && !ISPDFDELIM(*p); p++);
+      token->type = ScanPdfTokenKeyword;
+
+      /* Numbers are [+-]digits[.digits], with no exponent */
+      negative = (*q == '-') ? DmtxTrue : DmtxFalse;
+      if(*q == '-' || *q == '+')
+         q++;
+
+      digits = DmtxFalse;
+      for(number = 0.0; q < p && ISDIGIT(*q); q++, digits = DmtxTrue)
+         number = number * 10.0 + (*q - '0');
+
+      if(q < p && *q == '.') {
+         for(q++, scale = 0.1; q < p && ISDIGIT(*q); q++, scale *= 0.1, digits = DmtxTrue)
+            number += (*q - '0') * scale;
+      }
+
+      if(q == p && digits == DmtxTrue) {
+         token->type = ScanPdfTokenNumber;
+         token->number = (negative == DmtxTrue) ? -number : number;
+      }
+   }
+
+   token->end = p;
+
+   return p;
+}
+
+/**
+ * @brief  Find the first occurrence of a string in a byte range
+ * @param  p first byte to search
+ * @param  end end of range
+ * @param  text string to find
+ * @return Position of the match, or NULL
+ */
+static const unsigned char *
+FindPdfText(const unsigned char *p, const unsigned char *end, const char *text)
+{
+   size_t length = strlen(text);
+
+   while(p < end && (size_t)(end - p) >= length) {
+      p = (const unsigned char *)memchr(p, text[0], (end - p) - length + 1);
+      if(p == NULL)
+         return NULL;
+      else if(memcmp(p, text, length) == 0)
+         return p;
+      p++;
+   }
+
+   return NULL;
+}
@@ -0,0 +1,379 @@
+/*
+libdmtx - Data Matrix Encoding/Decoding Library
+
+Copyright (C) 2008, 2009 Mike Laughton
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+Contact: mike@dragonflylogic.com
+*/
+
+/**
+ * @file dmtxpnm.c
+ * @brief Streaming reader for binary PNM images
+ *
+ * Used by --stream so that arbitrarily tall PBM, PGM and PPM images (or
+ * a stream of them on standard input) are scanned one band at a time
+ * without ImageMagick ever holding a whole page.
+ */
+
+/**
+ * @brief  Scan a file as a stream of binary PNM images
+ * @param  scan session
+ * @param  path image path ("-" for standard input)
+ * @param  handled set to DmtxFalse if the file should be read by Magick instead
+ * @return DmtxScanOk or error status
+ */
+static DmtxScanStatus
+ScanPnmFile(DmtxScan *scan, const char *path, DmtxBoolean *handled)
+{
+   int c0, c1;
+   FILE *fp;
+   DmtxScanStatus status;
+
+   *handled = DmtxFalse;
+
+   /* Unreadable files are left to Magick, which reports the error */
+   fp = (strcmp(path, "-") == 0) ? stdin : fopen(path, "rb");
+   if(fp == NULL)
+      return DmtxScanOk;
+
+   c0 = getc(fp);
+   c1 = getc(fp);
+   if(c0 != 'P' || c1 < '4' || c1 > '6') {
+      if(fp == stdin) {
+         *handled = DmtxTrue;
+         return ScanStdinBlob(scan, c0, c1);
+      }
+      fclose(fp);
+      return DmtxScanOk;
+   }
+
+   *handled = DmtxTrue;
+
+   status = ScanPnmStream(scan, fp, c1, path);
+
+   if(fp != stdin)
+      fclose(fp);
+
+   return status;
+}
+
+/**
+ * @brief  Scan binary PNM images read from an open stream
+ * @param  scan session
+ * @param  fp stream positioned just after the first magic number
+ * @param  format format character of the first magic number ('4', '5' or '6')
+ * @param  source name reported to callbacks
+ * @return DmtxScanOk or error status
+ */
+static DmtxScanStatus
+ScanPnmStream(DmtxScan *scan, FILE *fp, int format, const char *source)
+{
+   int c0, c1;
+   int pageIndex;
+   int width, height;
+   size_t need;
+   int overlap;
+   ScanPnmReader pnm;
+   ScanBandSource src;
+   DmtxScanStatus status;
+
+   memset(&pnm, 0x00, sizeof(ScanPnmReader));
+   pnm.fp = fp;
+   pnm.format = format;
+
+   /* A PNM file may hold several images back to back */
+   status = DmtxScanOk;
+   for(pageIndex = 0; status == DmtxScanOk; pageIndex++) {
+      if(pageIndex > 0) {
+         do {
+            c0 = getc(fp);
+         } while(c0 == ' ' || c0 == '\t' || c0 == '\r' || c0 == '\n');
+
+         if(c0 == EOF)
+            break;
+
+         c1 = getc(fp);
+         if(c0 != 'P' || c1 < '4' || c1 > '6') {
+            SetError(scan, "Invalid PNM image %d in \"%s\"", pageIndex + 1, source);
+            status = DmtxScanErrorRead;
+            break;
+         }
+         pnm.format = c1;
+      }
+
+      if(ReadPnmHeader(&pnm, &width, &height) != DmtxPass) {
+         SetError(scan, "Invalid PNM header in \"%s\"", source);
+         status = DmtxScanErrorRead;
+         break;
+      }
+
+      if(StopReached(scan) == DmtxTrue)
+         break;
+
+      memset(&src, 0x00, sizeof(ScanBandSource));
+      src.scan = scan;
+      src.source = source;
+      src.width = width;
+      src.height = height;
+      src.pack = (pnm.format == '6') ? DmtxPack24bppRGB : DmtxPack8bppK;
+      src.readRows = ReadPnmRows;
+      src.reader = &pnm;
+      src.phase = DmtxScanPhaseLoad;
+
+      /* If requested, only scan specific page */
+      if(scan->opt.page != DmtxUndefined && scan->opt.page - 1 != pageIndex) {
+         if(SkipPnmRows(&pnm, height) != DmtxPass) {
+            SetError(scan, "Unexpected end of PNM data in \"%s\"", source);
+            status = DmtxScanErrorRead;
+         }
+         continue;
+      }
+
+      /* One band is all a streamed source ever holds */
+      need = (size_t)GetBandHeight(scan, &src, &overlap) * GetBandRowCost(scan, &src);
+      if(ReserveMemory(scan, need, source) != DmtxPass) {
+         status = DmtxScanErrorMemory;
+         break;
+      }
+
+      status = ScanBands(scan, &src, pageIndex);
+
+      /* Consume rows left unread when scanning stopped early */
+      if(status == DmtxScanOk && src.nextRow < height &&
+            SkipPnmRows(&pnm, height - src.nextRow) != DmtxPass) {
+         SetError(scan, "Unexpected end of PNM data in \"%s\"", source);
+         status = DmtxScanErrorRead;
+      }
+   }
+
+   free(pnm.raw);
+
+   return status;
+}
+
+/**
+ * @brief  Scan non-PNM standard input as an archive or through Magick
+ * @param  scan session
+ * @param  c0 first byte already read (or EOF)
+ * @param  c1 second byte already read (or EOF)
+ * @return DmtxScanOk or error status
+ *
+ * Tar archives are scanned member by member as they arrive. Anything
+ * else is read whole first.
+ */
+static DmtxScanStatus
+ScanStdinBlob(DmtxScan *scan, int c0, int c1)
+{
+   size_t length, alloc, bytesRead;
+   unsigned char *blob, *newBlob;
+   DmtxBoolean sniffed;
+   DmtxScanStatus status;
+
+   alloc = 65536;
+   blob = (unsigned char *)malloc(alloc);
+   if(blob == NULL) {
+      SetError(scan, "malloc() error");
+      return DmtxScanErrorMemory;
+   }
+
+   length = 0;
+   if(c0 != EOF)
+      blob[length++] = (unsigned char)c0;
+   if(c1 != EOF)
+      blob[length++] = (unsigned char)c1;
+
+   sniffed = DmtxFalse;
+   for(;;) {
+      if(length == alloc) {
+         newBlob = (unsigned char *)realloc(blob, alloc * 2);
+         if(newBlob == NULL) {
+            free(blob);
+            SetError(scan, "malloc() error");
+            return DmtxScanErrorMemory;
+         }
+         blob = newBlob;
+         alloc *= 2;
+      }
+
+      bytesRead = fread(blob + length, 1, alloc - length, stdin);
+      if(bytesRead == 0)
+         break;
+      length += bytesRead;
+
+      /* A tar header fills the first block */
+      if(sniffed == DmtxFalse && length >= DMTXSCAN_TAR_BLOCK) {
+         sniffed = DmtxTrue;
+         if(GetArchiveType(blob, length) == ScanArchiveTar) {
+            status = ScanArchiveStdin(scan, blob, length, DmtxFalse);
+            free(blob);
+            return status;
+         }
+      }
+   }
+
+   if(length == 0) {
+      free(blob);
+      SetError(scan, "Empty image on standard input");
+      return DmtxScanErrorRead;
+   }
+
+   if(GetArchiveType(blob, length) != ScanArchiveNone)
+      status = ScanArchiveStdin(scan, blob, length, DmtxTrue);
+   else
+      status = ReadWand(scan, NULL, blob, length, "-", 0);
+   free(blob);
+
+   return status;
+}
+
+/**
+ * @brief  Read the rest of a PNM header after its magic number
+ * @param  pnm reader with format set
+ * @param  width pointer to image width
+ * @param  height pointer to image height
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+ReadPnmHeader(ScanPnmReader *pnm, int *width, int *height)
+{
+   int sampleBytes;
+   unsigned char *raw;
+
+   *width = ReadPnmNumber(pnm->fp);
+   *height = ReadPnmNumber(pnm->fp);
+   pnm->maxval = (pnm->format == '4') ? 1 : ReadPnmNumber(pnm->fp);
+
+   if(*width < 1 || *height < 1 || pnm->maxval < 1 || pnm->maxval > 65535)
+      return DmtxFail;
+
+   /* Raw and converted row sizes are int, so reject widths they cannot hold */
+   sampleBytes = ((pnm->format == '6') ? 3 : 1) * ((pnm->maxval > 255) ? 2 : 1);
+   if(*width > INT_MAX / sampleBytes)
+      return DmtxFail;
+
+   if(pnm->format == '4')
+      pnm->rawRowBytes = (*width + 7) / 8;
+   else
+      pnm->rawRowBytes = *width * sampleBytes;
+
+   raw = (unsigned char *)realloc(pnm->raw, pnm->rawRowBytes);
+   if(raw == NULL)
+      return DmtxFail;
+   pnm->raw = raw;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Read one decimal header field, skipping whitespace and comments
+ * @param  fp PNM stream
+ * @return Field value, or -1 on error
+ *
+ * The single whitespace character ending the last field is consumed, so
+ * the stream is left at the first raster byte.
+ */
+static int
+ReadPnmNumber(FILE *fp)
+{
+   int c;
+   long value;
+
+   for(;;) {
+      c = getc(fp);
+      if(c == '#') {
+         while(c != '\n' && c != EOF)
+            c = getc(fp);
+      }
+      else if(c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+         break;
+      }
+   }
+
+   if(!ISDIGIT(c))
+      return -1;
+
+   for(value = 0; ISDIGIT(c); c = getc(fp)) {
+      value = value * 10 + (c - '0');
+      if(value > 0x7fffffffL / 10)
+         return -1;
+   }
+
+   return (int)value;
+}
+
+/**
+ * @brief  Read and convert the next rows of a PNM image
+ * @param  src band source reading from a ScanPnmReader
+ * @param  dest destination for rowCount rows (8bpp gray or 24bpp RGB)
+ * @param  rowCount number of rows
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+ReadPnmRows(ScanBandSource *src, unsigned char *dest, int rowCount)
+{
+   int row, i;
+   int sampleCount;
+   unsigned int value;
+   ScanPnmReader *pnm = (ScanPnmReader *)src->reader;
+   unsigned char *raw = pnm->raw;
+
+   sampleCount = src->width * ((pnm->format == '6') ? 3 : 1);
+
+   for(row = 0; row < rowCount; row++) {
+      if(fread(raw, 1, pnm->rawRowBytes, pnm->fp) != (size_t)pnm->rawRowBytes) {
+         SetError(src->scan, "Unexpected end of PNM data in \"%s\"", src->source);
+         return DmtxFail;
+      }
+
+      /* PBM sets a bit for black */
+      if(pnm->format == '4') {
+         UnpackRow(raw, dest, src->width);
+      }
+      else if(pnm->maxval == 255) {
+         memcpy(dest, raw, sampleCount);
+      }
+      else {
+         for(i = 0; i < sampleCount; i++) {
+            value = (pnm->maxval > 255) ? ((unsigned int)raw[2*i] << 8) | raw[2*i+1] : raw[i];
+            dest[i] = (unsigned char)((value * 255 + pnm->maxval / 2) / pnm->maxval);
+         }
+      }
+
+      dest += sampleCount;
+   }
+
+   src->nextRow += rowCount;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Discard rows of a PNM image
+ * @param  pnm reader
+ * @param  rowCount number of rows
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+SkipPnmRows(ScanPnmReader *pnm, int rowCount)
+{
+   while(rowCount-- > 0) {
+      if(fread(pnm->raw, 1, pnm->rawRowBytes, pnm->fp) != (size_t)pnm->rawRowBytes)
+         return DmtxFail;
+   }
+
+   return DmtxPass;
+}
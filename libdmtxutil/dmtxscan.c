@@ -0,0 +1,2159 @@
+/*
+libdmtx - Data Matrix Encoding/Decoding Library
+
+Copyright (C) 2008, 2009 Mike Laughton
+Copyright (C) 2008 Ryan Raasch
+Copyright (C) 2008 Olivier Guilyardi
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+Contact: mike@dragonflylogic.com
+*/
+
+/**
+ * @file dmtxscan.c
+ * @brief Reusable scan session behind dmtxread
+ *
+ * A DmtxScan session owns a copy of the scan options and reports every
+ * decoded symbol through callbacks. Sessions share no mutable state, so
+ * separate threads may each drive their own session concurrently once
+ * dmtxScanGenesis() has been called.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "../config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <math.h>
+#include <assert.h>
+#include <dmtx.h>
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+#include <sys/mman.h>
+#endif
+#if defined(HAVE_ZLIB_H) && defined(HAVE_LIBZ)
+#include <zlib.h>
+#endif
+#include "dmtxscan.h"
+#include "dmtxscanstatic.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/* Eight 8bppK pixels for each byte of packed 1bpp pixels, filled once by
+ * InitPackedTable() and read-only afterward */
+static unsigned char packedLut[256][8];
+
+#include "dmtxpnm.c"
+#include "dmtxtiff.c"
+#include "dmtxpdf.c"
+#include "dmtxarchive.c"
+
+/**
+ * @brief  Initialize ImageMagick and decoder tables for all sessions in this process
+ * @return DmtxPass | DmtxFail
+ */
+extern DmtxPassFail
+dmtxScanGenesis(void)
+{
+   MagickWandGenesis();
+   InitPackedTable();
+   InitFaxTables();
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Release ImageMagick resources once all sessions are destroyed
+ * @return void
+ */
+extern void
+dmtxScanTerminus(void)
+{
+   MagickWandTerminus();
+}
+
+/**
+ * @brief  Return scan options matching dmtxread defaults
+ * @return Default options
+ */
+extern DmtxScanOptions
+dmtxScanOptionsDefault(void)
+{
+   DmtxScanOptions opt;
+
+   memset(&opt, 0x00, sizeof(DmtxScanOptions));
+
+   opt.edgeMin = DmtxUndefined;
+   opt.edgeMax = DmtxUndefined;
+   opt.scanGap = 2;
+   opt.timeoutMS = DmtxUndefined;
+   opt.page = DmtxUndefined;
+   opt.squareDevn = DmtxUndefined;
+   opt.dpi = DmtxUndefined;
+   opt.sizeIdxExpected = DmtxSymbolShapeAuto;
+   opt.edgeThresh = 5;
+   opt.xMin = NULL;
+   opt.xMax = NULL;
+   opt.yMin = NULL;
+   opt.yMax = NULL;
+   opt.correctionsMax = DmtxUndefined;
+   opt.mosaic = DmtxFalse;
+   opt.stopAfter = DmtxUndefined;
+   opt.shrinkMin = 1;
+   opt.shrinkMax = 1;
+   opt.gs1 = DmtxUndefined;
+   opt.deadlineMS = DmtxUndefined;
+   opt.memoryLimit = 0;
+   opt.stream = DmtxFalse;
+   opt.bandHeight = DmtxUndefined;
+   opt.nativeFax = DmtxTrue;
+   opt.nativePdf = DmtxTrue;
+   opt.locateDpi = DmtxUndefined;
+
+   return opt;
+}
+
+/**
+ * @brief  Create a scan session with private copies of the options
+ * @param  opt scan options (NULL for defaults)
+ * @return Address of new session, or NULL on allocation failure
+ */
+extern DmtxScan *
+dmtxScanCreate(const DmtxScanOptions *opt)
+{
+   DmtxScan *scan;
+
+   scan = (DmtxScan *)calloc(1, sizeof(DmtxScan));
+   if(scan == NULL)
+      return NULL;
+
+   scan->opt = (opt == NULL) ? dmtxScanOptionsDefault() : *opt;
+
+   /* Region strings are copied so callers may free theirs */
+   scan->opt.xMin = CopyString(scan->opt.xMin);
+   scan->opt.xMax = CopyString(scan->opt.xMax);
+   scan->opt.yMin = CopyString(scan->opt.yMin);
+   scan->opt.yMax = CopyString(scan->opt.yMax);
+
+   if((opt != NULL && opt->xMin != NULL && scan->opt.xMin == NULL) ||
+         (opt != NULL && opt->xMax != NULL && scan->opt.xMax == NULL) ||
+         (opt != NULL && opt->yMin != NULL && scan->opt.yMin == NULL) ||
+         (opt != NULL && opt->yMax != NULL && scan->opt.yMax == NULL)) {
+      dmtxScanDestroy(&scan);
+      return NULL;
+   }
+
+   return scan;
+}
+
+/**
+ * @brief  Free scan session memory
+ * @param  scan pointer to session pointer
+ * @return DmtxPass | DmtxFail
+ */
+extern DmtxPassFail
+dmtxScanDestroy(DmtxScan **scan)
+{
+   if(scan == NULL || *scan == NULL)
+      return DmtxFail;
+
+   free((*scan)->opt.xMin);
+   free((*scan)->opt.xMax);
+   free((*scan)->opt.yMin);
+   free((*scan)->opt.yMax);
+   free(*scan);
+
+   *scan = NULL;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Register result callbacks
+ * @param  scan session
+ * @param  symbolFunc called once per decoded symbol (may be NULL)
+ * @param  pageFunc called once per scanned page (may be NULL)
+ * @param  userData passed unchanged to both callbacks
+ * @return void
+ */
+extern void
+dmtxScanSetCallbacks(DmtxScan *scan, DmtxScanSymbolCallback symbolFunc,
+      DmtxScanPageCallback pageFunc, void *userData)
+{
+   assert(scan != NULL);
+
+   scan->symbolFunc = symbolFunc;
+   scan->pageFunc = pageFunc;
+   scan->userData = userData;
+}
+
+/**
+ * @brief  Register memory admission callback
+ * @param  scan session
+ * @param  reserveFunc called with the expected footprint before each
+ *         source is loaded when a memory limit is set (may be NULL)
+ * @return void
+ *
+ * The callback receives the same userData as dmtxScanSetCallbacks().
+ * Requests never exceed the memory limit, since larger pages fall back
+ * to banded scanning. Memory is not returned explicitly; the caller
+ * knows when the source it asked for is finished.
+ *
+ * A two-pass vector scan may call again during its source, with the
+ * bytes it needs on top of those already granted, before rendering a
+ * page at a higher resolution. Refusing that request is not an error:
+ * the page is then decoded from the pixels of the first pass.
+ */
+extern void
+dmtxScanSetReserveCallback(DmtxScan *scan, DmtxScanReserveCallback reserveFunc)
+{
+   assert(scan != NULL);
+
+   scan->reserveFunc = reserveFunc;
+}
+
+/**
+ * @brief  Change the symbol count at which the session stops
+ * @param  scan session
+ * @param  stopAfter symbols counted from the start of the session, as
+ *         dmtxScanGetSymbolCount() counts them, or DmtxUndefined
+ * @return void
+ */
+extern void
+dmtxScanSetStopAfter(DmtxScan *scan, int stopAfter)
+{
+   assert(scan != NULL);
+
+   scan->opt.stopAfter = stopAfter;
+}
+
+/**
+ * @brief  Scan every page of an image file ("-" for standard input)
+ * @param  scan session
+ * @param  path image path
+ * @return DmtxScanOk or error status
+ */
+extern DmtxScanStatus
+dmtxScanFile(DmtxScan *scan, const char *path)
+{
+   DmtxBoolean handled;
+   DmtxScanStatus status;
+
+   assert(scan != NULL && path != NULL);
+
+   StartSource(scan);
+
+   /* Archive members are scanned in place, without extracting them */
+   if(strcmp(path, "-") != 0) {
+      status = ScanArchiveFile(scan, path, &handled);
+      if(handled == DmtxTrue)
+         return status;
+   }
+
+   /* PNM input is streamed without ever holding a whole page */
+   if(scan->opt.stream == DmtxTrue) {
+      status = ScanPnmFile(scan, path, &handled);
+      if(handled == DmtxTrue)
+         return status;
+   }
+
+   /* Scanned PDF pages are decoded from their images, not rendered */
+   if(scan->opt.nativePdf == DmtxTrue && strcmp(path, "-") != 0) {
+      status = ScanPdfFile(scan, path, &handled);
+      if(handled == DmtxTrue)
+         return status;
+   }
+
+   /* Fax TIFF pages are decoded without a Magick pixel cache */
+   if(scan->opt.nativeFax == DmtxTrue && strcmp(path, "-") != 0) {
+      status = ScanTiffFile(scan, path, &handled);
+      if(handled == DmtxTrue)
+         return status;
+   }
+
+   /* Standard input may hold an archive, so is sniffed before Magick reads it */
+   if(strcmp(path, "-") == 0)
+      return ScanStdinBlob(scan, EOF, EOF);
+
+   return ReadWand(scan, path, NULL, 0, path, 0);
+}
+
+/**
+ * @brief  Scan every page of an encoded image held in memory
+ * @param  scan session
+ * @param  blob encoded image bytes (PNG, TIFF, PDF, etc...)
+ * @param  length blob length in bytes
+ * @param  label name reported to callbacks (may be NULL)
+ * @return DmtxScanOk or error status
+ */
+extern DmtxScanStatus
+dmtxScanBlob(DmtxScan *scan, const void *blob, size_t length, const char *label)
+{
+   assert(scan != NULL);
+
+   if(label == NULL)
+      label = "blob";
+
+   if(blob == NULL || length == 0) {
+      SetError(scan, "Empty image blob \"%s\"", label);
+      return DmtxScanErrorArgument;
+   }
+
+   StartSource(scan);
+
+   return ReadWand(scan, NULL, blob, length, label, 0);
+}
+
+/**
+ * @brief  Scan a single page of raw pixels already held in memory
+ * @param  scan session
+ * @param  pxl pixel buffer (not copied, not freed)
+ * @param  width image width in pixels
+ * @param  height image height in pixels
+ * @param  pack libdmtx pixel packing (DmtxPack24bppRGB, DmtxPack8bppK, etc...)
+ * @param  label name reported to callbacks (may be NULL)
+ * @param  pageIndex page index reported to callbacks
+ * @return DmtxScanOk or error status
+
+ * DmtxPack1bppK rows start on byte boundaries, most significant bit
+ * first, with set bits black as in PBM. Bilevel pages held this way use
+ * an eighth of the memory of 8bppK and are always scanned in bands.
+ */
+extern DmtxScanStatus
+dmtxScanPixels(DmtxScan *scan, unsigned char *pxl, int width, int height, int pack,
+      const char *label, int pageIndex)
+{
+   size_t shrink;
+   ScanBandSource src;
+
+   assert(scan != NULL);
+
+   if(pxl == NULL || width < 1 || height < 1) {
+      SetError(scan, "Invalid pixel buffer");
+      return DmtxScanErrorArgument;
+   }
+
+   if(StopReached(scan) == DmtxTrue)
+      return DmtxScanOk;
+
+   StartSource(scan);
+
+   if(label == NULL)
+      label = "pixels";
+
+   memset(&src, 0x00, sizeof(ScanBandSource));
+   src.scan = scan;
+   src.source = label;
+   src.width = width;
+   src.height = height;
+   src.pack = pack;
+   src.phase = DmtxScanPhaseSearch;
+
+   /* libdmtx cannot read packed bits, so they are expanded a band at a time */
+   if(pack == DmtxPack1bppK) {
+      src.pack = DmtxPack8bppK;
+      src.readRows = ReadPackedRows;
+      src.reader = pxl;
+      return ScanBands(scan, &src, pageIndex);
+   }
+
+   /* Caller owns the pixels, so only the decoder cache counts here */
+   shrink = (scan->opt.shrinkMin < 1) ? 1 : (size_t)scan->opt.shrinkMin;
+   if(scan->opt.stream == DmtxTrue || (scan->opt.memoryLimit != 0 &&
+         (size_t)width * height / (shrink * shrink) > scan->opt.memoryLimit)) {
+      src.pxl = pxl;
+      return ScanBands(scan, &src, pageIndex);
+   }
+
+   return ScanPage(scan, pxl, width, height, pack, label, pageIndex);
+}
+
+/**
+ * @brief  Count of symbols decoded by this session so far
+ * @param  scan session
+ * @return Symbol count
+ */
+extern int
+dmtxScanGetSymbolCount(DmtxScan *scan)
+{
+   assert(scan != NULL);
+
+   return scan->symbolCount;
+}
+
+/**
+ * @brief  Describe the most recent error reported by this session
+ * @param  scan session
+ * @return Error message (empty string if none)
+ */
+extern const char *
+dmtxScanGetError(DmtxScan *scan)
+{
+   assert(scan != NULL);
+
+   return scan->error;
+}
+
+/**
+ * @brief  Short description of a status value
+ * @param  status scan status
+ * @return Status description
+ */
+extern const char *
+dmtxScanStatusString(DmtxScanStatus status)
+{
+   switch(status) {
+      case DmtxScanOk:
+         return "ok";
+      case DmtxScanErrorArgument:
+         return "invalid argument";
+      case DmtxScanErrorMemory:
+         return "out of memory";
+      case DmtxScanErrorRead:
+         return "image read error";
+      case DmtxScanErrorDecode:
+         return "decoder error";
+      case DmtxScanErrorCallback:
+         return "stopped by callback";
+      case DmtxScanErrorDeadline:
+         return "deadline exceeded";
+   }
+
+   return "unknown error";
+}
+
+/**
+ * @brief  Phase that was running when the last deadline expired
+ * @param  scan session
+ * @return Phase, or DmtxScanPhaseNone if the last source finished in time
+ */
+extern DmtxScanPhase
+dmtxScanGetTimeoutPhase(DmtxScan *scan)
+{
+   assert(scan != NULL);
+
+   return scan->timeoutPhase;
+}
+
+/**
+ * @brief  Short name of a scan phase
+ * @param  phase scan phase
+ * @return Phase name
+ */
+extern const char *
+dmtxScanPhaseString(DmtxScanPhase phase)
+{
+   switch(phase) {
+      case DmtxScanPhaseNone:
+         return "none";
+      case DmtxScanPhaseLoad:
+         return "load";
+      case DmtxScanPhaseRasterize:
+         return "rasterize";
+      case DmtxScanPhaseExport:
+         return "export";
+      case DmtxScanPhaseSearch:
+         return "search";
+      case DmtxScanPhaseDecode:
+         return "decode";
+   }
+
+   return "unknown";
+}
+
+/**
+ * @brief  Convert "N" or "N%" into a pixel offset within extent
+ * @param  s number string
+ * @param  extent image width or height
+ * @param  value pointer to scaled result
+ * @return DmtxPass | DmtxFail
+ */
+extern DmtxPassFail
+dmtxScanScaleNumberString(const char *s, int extent, int *value)
+{
+   long numValue;
+   int scaledValue;
+   char *terminate;
+
+   assert(s != NULL && value != NULL);
+
+   if(!ISDIGIT(*s))
+      return DmtxFail;
+
+   errno = 0;
+   numValue = strtol(s, &terminate, 10);
+
+   while(*terminate == ' ' || *terminate == '\t')
+      terminate++;
+
+   if(errno != 0 || (*terminate != '\0' && *terminate != '%'))
+      return DmtxFail;
+
+   scaledValue = (*terminate == '%') ? (int)(0.01 * numValue * extent + 0.5) : (int)numValue;
+
+   if(scaledValue < 0)
+      scaledValue = 0;
+
+   if(scaledValue >= extent)
+      scaledValue = extent - 1;
+
+   *value = scaledValue;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Estimate peak memory used to scan one page loaded by ImageMagick
+ * @param  opt scan options (NULL for defaults)
+ * @param  width page width in pixels
+ * @param  height page height in pixels
+ * @param  pack libdmtx pixel packing of the exported page
+ * @return Estimated bytes for Magick's pixel cache, the exported pixels
+ *         and the libdmtx decoder cache
+ */
+extern size_t
+dmtxScanEstimatePage(const DmtxScanOptions *opt, int width, int height, int pack)
+{
+   size_t pixels;
+   size_t shrink;
+
+   shrink = (opt == NULL || opt->shrinkMin < 1) ? 1 : (size_t)opt->shrinkMin;
+   pixels = (size_t)width * height;
+
+   return pixels * DMTXSCAN_MAGICK_PIXEL_BYTES +
+         PackRowBytes(pack, width) * height +
+         pixels / (shrink * shrink);
+}
+
+/**
+ * @brief  Duplicate string into newly allocated memory
+ * @param  s string to copy (may be NULL)
+ * @return Copy of string, or NULL
+ */
+static char *
+CopyString(const char *s)
+{
+   char *copy;
+
+   if(s == NULL)
+      return NULL;
+
+   copy = (char *)malloc(strlen(s) + 1);
+   if(copy != NULL)
+      strcpy(copy, s);
+
+   return copy;
+}
+
+/**
+ * @brief  Record error message for dmtxScanGetError()
+ * @param  scan session
+ * @param  fmt error message format
+ * @return void
+ */
+static void
+SetError(DmtxScan *scan, const char *fmt, ...)
+{
+   va_list va;
+
+   va_start(va, fmt);
+   vsnprintf(scan->error, DMTXSCAN_ERROR_SIZE, fmt, va);
+   va_end(va);
+}
+
+/**
+ * @brief  Record error message with the pending Magick exception appended
+ * @param  scan session
+ * @param  wand Magick wand holding the exception
+ * @param  fmt error message format with at most one %s
+ * @param  arg argument for fmt (may be NULL)
+ * @return void
+ */
+static void
+SetMagickError(DmtxScan *scan, MagickWand *wand, const char *fmt, const char *arg)
+{
+   size_t length;
+   char *excMessage;
+   ExceptionType excSeverity;
+
+   SetError(scan, fmt, (arg == NULL) ? "" : arg);
+
+   excMessage = MagickGetException(wand, &excSeverity);
+   if(excMessage != NULL) {
+      length = strlen(scan->error);
+      if(*excMessage != '\0' && length + 2 < DMTXSCAN_ERROR_SIZE)
+         snprintf(scan->error + length, DMTXSCAN_ERROR_SIZE - length, ": %s", excMessage);
+      MagickRelinquishMemory(excMessage);
+   }
+}
+
+/**
+ * @brief  Check whether the session already returned --stop-after symbols
+ * @param  scan session
+ * @return DmtxTrue | DmtxFalse
+ */
+static DmtxBoolean
+StopReached(DmtxScan *scan)
+{
+   if(scan->opt.stopAfter != DmtxUndefined && scan->symbolCount >= scan->opt.stopAfter)
+      return DmtxTrue;
+
+   return DmtxFalse;
+}
+
+/**
+ * @brief  Start the clocks and memory reservation for a new source
+ * @param  scan session
+ * @return void
+ */
+static void
+StartSource(DmtxScan *scan)
+{
+   scan->reserved = DmtxFalse;
+   scan->reservedBytes = 0;
+   scan->timeoutPhase = DmtxScanPhaseNone;
+   scan->sourceStart = dmtxTimeNow();
+   scan->deadlineActive = (scan->opt.deadlineMS == DmtxUndefined) ? DmtxFalse : DmtxTrue;
+
+   if(scan->deadlineActive == DmtxTrue)
+      scan->deadline = dmtxTimeAdd(scan->sourceStart, scan->opt.deadlineMS);
+}
+
+/**
+ * @brief  Wait for admission of a source's memory, once per source
+ * @param  scan session
+ * @param  bytes expected footprint (capped at the memory limit)
+ * @param  source name used in the error message
+ * @return DmtxPass | DmtxFail
+ *
+ * Sources read one page at a time may ask again for each page, but only
+ * the first request reaches the reserve callback. A second request from
+ * a source already holding memory could otherwise wait forever.
+ */
+static DmtxPassFail
+ReserveMemory(DmtxScan *scan, size_t bytes, const char *source)
+{
+   if(scan->opt.memoryLimit == 0 || scan->reserveFunc == NULL || scan->reserved == DmtxTrue)
+      return DmtxPass;
+
+   if(bytes > scan->opt.memoryLimit)
+      bytes = scan->opt.memoryLimit;
+
+   if((*scan->reserveFunc)(bytes, scan->userData) != DmtxPass) {
+      SetError(scan, "Memory reservation for \"%s\" refused", source);
+      return DmtxFail;
+   }
+   scan->reserved = DmtxTrue;
+   scan->reservedBytes = bytes;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Extend the memory admitted for the current source
+ * @param  scan session
+ * @param  bytes total footprint now expected (capped at the memory limit)
+ * @return DmtxPass | DmtxFail (refused; the source keeps what it holds)
+ */
+static DmtxPassFail
+GrowMemory(DmtxScan *scan, size_t bytes)
+{
+   if(scan->opt.memoryLimit == 0 || scan->reserveFunc == NULL || scan->reserved == DmtxFalse)
+      return DmtxPass;
+
+   if(bytes > scan->opt.memoryLimit)
+      bytes = scan->opt.memoryLimit;
+
+   if(bytes <= scan->reservedBytes)
+      return DmtxPass;
+
+   if((*scan->reserveFunc)(bytes - scan->reservedBytes, scan->userData) != DmtxPass)
+      return DmtxFail;
+   scan->reservedBytes = bytes;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Check the source deadline, recording the phase on expiry
+ * @param  scan session
+ * @param  phase phase being entered or just completed
+ * @param  source name used in the error message
+ * @return DmtxTrue if the deadline has passed
+ */
+static DmtxBoolean
+DeadlineExceeded(DmtxScan *scan, DmtxScanPhase phase, const char *source)
+{
+   if(scan->deadlineActive == DmtxFalse || dmtxTimeExceeded(scan->deadline) == DmtxFalse)
+      return DmtxFalse;
+
+   scan->timeoutPhase = phase;
+   SetError(scan, "Deadline of %d ms exceeded during %s of \"%s\"",
+         scan->opt.deadlineMS, dmtxScanPhaseString(phase), source);
+
+   return DmtxTrue;
+}
+
+/**
+ * @brief  Magick progress monitor that cancels reads past the deadline
+ * @param  text progress tag (unused)
+ * @param  offset progress so far (unused)
+ * @param  span progress total (unused)
+ * @param  clientData scan session
+ * @return MagickTrue to continue, MagickFalse to abort
+ */
+static MagickBooleanType
+DeadlineMonitor(const char *text, const MagickOffsetType offset,
+      const MagickSizeType span, void *clientData)
+{
+   DmtxScan *scan = (DmtxScan *)clientData;
+
+   (void)text;
+   (void)offset;
+   (void)span;
+
+   return (dmtxTimeExceeded(scan->deadline) == DmtxTrue) ? MagickFalse : MagickTrue;
+}
+
+/**
+ * @brief  Load a file or blob into a new wand and scan its pages
+ * @param  scan session
+ * @param  path image path, or NULL to read blob
+ * @param  blob encoded image bytes (used when path is NULL)
+ * @param  length blob length in bytes
+ * @param  source name reported to callbacks
+ * @param  firstPage page index of the first image read
+ * @return DmtxScanOk or error status
+ */
+static DmtxScanStatus
+ReadWand(DmtxScan *scan, const char *path, const void *blob, size_t length,
+      const char *source, int firstPage)
+{
+   int dpi;
+   size_t need;
+   DmtxBoolean locate;
+   DmtxScanStatus status;
+   MagickWand *wand;
+
+   /* Only a positive --locate-resolution asks for two passes: options
+    * zeroed by a caller rather than taken from dmtxScanOptionsDefault()
+    * still scan in one pass at Magick's default density */
+   locate = (scan->opt.locateDpi > 0) ? DmtxTrue : DmtxFalse;
+   dpi = (locate == DmtxTrue) ? scan->opt.locateDpi : scan->opt.dpi;
+
+   /* Wait for admission before any large allocation happens. Two-pass
+    * scans are admitted for the first pass and grow before the second. */
+   if(scan->opt.memoryLimit != 0 && scan->reserveFunc != NULL && scan->reserved == DmtxFalse) {
+      need = PingFootprint(scan, path, blob, length, dpi);
+      if(ReserveMemory(scan, need, source) != DmtxPass)
+         return DmtxScanErrorMemory;
+   }
+
+   wand = OpenWand(scan, path, blob, length, source, dpi, &status);
+   if(wand == NULL)
+      return status;
+
+   if(locate == DmtxTrue)
+      status = LocateWand(scan, wand, path, blob, length, source, firstPage);
+   else
+      status = ScanWand(scan, wand, source, firstPage);
+
+   DestroyMagickWand(wand);
+
+   return status;
+}
+
+/**
+ * @brief  Read a file or blob into a new wand
+ * @param  scan session
+ * @param  path image path, or with a blob NULL or a page selector such
+ *         as "[2]" naming the only page to read
+ * @param  blob encoded image bytes, or NULL to read path
+ * @param  length blob length in bytes
+ * @param  source name used in error messages
+ * @param  dpi resolution for vector input, or DmtxUndefined for the default
+ * @param  status set to the error status when NULL is returned
+ * @return New wand, or NULL on error
+ */
+static MagickWand *
+OpenWand(DmtxScan *scan, const char *path, const void *blob, size_t length,
+      const char *source, int dpi, DmtxScanStatus *status)
+{
+   DmtxScanPhase phase;
+   MagickBooleanType success;
+   MagickWand *wand;
+
+   wand = NewMagickWand();
+   if(wand == NULL) {
+      SetError(scan, "Magick error");
+      *status = DmtxScanErrorMemory;
+      return NULL;
+   }
+
+   /* XXX note this is not the same as MagickSetImageResolution() ...
+    * need to research what this is setting. Could be dots per inch, dots
+    * per centimeter, or even dots per "image width" */
+   if(dpi != DmtxUndefined) {
+      success = MagickSetResolution(wand, (double)dpi, (double)dpi);
+      if(success == MagickFalse) {
+         SetMagickError(scan, wand, "Unable to set image resolution", NULL);
+         DestroyMagickWand(wand);
+         *status = DmtxScanErrorRead;
+         return NULL;
+      }
+   }
+
+   /* Coders poll the monitor between rows, so a slow read stops soon
+    * after the deadline instead of running to completion */
+   if(scan->deadlineActive == DmtxTrue)
+      MagickSetProgressMonitor(wand, DeadlineMonitor, scan);
+
+   /* A resolution only matters when the reader renders vector input */
+   phase = (dpi == DmtxUndefined) ? DmtxScanPhaseLoad : DmtxScanPhaseRasterize;
+
+   /* A blob's file name only carries the page selector to the reader */
+   if(blob == NULL)
+      success = MagickReadImage(wand, path);
+   else if(path != NULL && MagickSetFilename(wand, path) == MagickFalse)
+      success = MagickFalse;
+   else
+      success = MagickReadImageBlob(wand, blob, length);
+
+   if(success == MagickFalse) {
+      if(DeadlineExceeded(scan, phase, source) == DmtxTrue)
+         *status = DmtxScanErrorDeadline;
+      else if(blob == NULL) {
+         SetMagickError(scan, wand, "Unable to open file \"%s\" for reading", path);
+         *status = DmtxScanErrorRead;
+      }
+      else {
+         SetMagickError(scan, wand, "Unable to read image blob \"%s\"", source);
+         *status = DmtxScanErrorRead;
+      }
+      DestroyMagickWand(wand);
+      return NULL;
+   }
+
+   if(DeadlineExceeded(scan, phase, source) == DmtxTrue) {
+      DestroyMagickWand(wand);
+      *status = DmtxScanErrorDeadline;
+      return NULL;
+   }
+
+   return wand;
+}
+
+/**
+ * @brief  Scan each requested page held by a Magick wand
+ * @param  scan session
+ * @param  wand wand holding one or more images
+ * @param  source name reported to callbacks
+ * @param  firstPage page index of the wand's first image
+ * @return DmtxScanOk or error status
+ */
+static DmtxScanStatus
+ScanWand(DmtxScan *scan, MagickWand *wand, const char *source, int firstPage)
+{
+   int pageIndex;
+   DmtxScanStatus status;
+
+   /* Loop once for each page within image */
+   MagickResetIterator(wand);
+   for(pageIndex = firstPage; MagickNextImage(wand) != MagickFalse; pageIndex++) {
+
+      /* If requested, only scan specific page */
+      if(scan->opt.page != DmtxUndefined && scan->opt.page - 1 != pageIndex)
+         continue;
+
+      if(StopReached(scan) == DmtxTrue)
+         break;
+
+      status = ScanWandImage(scan, wand, source, pageIndex);
+      if(status != DmtxScanOk)
+         return status;
+   }
+
+   return DmtxScanOk;
+}
+
+/**
+ * @brief  Scan the current image of a Magick wand
+ * @param  scan session
+ * @param  wand wand positioned at the page
+ * @param  source name reported to callbacks
+ * @param  pageIndex page index reported to callbacks
+ * @return DmtxScanOk or error status
+ */
+static DmtxScanStatus
+ScanWandImage(DmtxScan *scan, MagickWand *wand, const char *source, int pageIndex)
+{
+   int width, height;
+   int pack;
+   unsigned char *pxl;
+   DmtxScanStatus status;
+   MagickBooleanType success;
+   ScanBandSource src;
+
+   width = MagickGetImageWidth(wand);
+   height = MagickGetImageHeight(wand);
+   pack = GetWandPack(wand);
+
+   /* Pages over the memory limit are exported and scanned a band at a time */
+   if(scan->opt.stream == DmtxTrue || (scan->opt.memoryLimit != 0 &&
+         dmtxScanEstimatePage(&(scan->opt), width, height, pack) >
+         scan->opt.memoryLimit)) {
+      memset(&src, 0x00, sizeof(ScanBandSource));
+      src.scan = scan;
+      src.source = source;
+      src.width = width;
+      src.height = height;
+      src.pack = pack;
+      src.readRows = ReadWandRows;
+      src.reader = wand;
+      src.fixedBytes = (size_t)width * height * DMTXSCAN_MAGICK_PIXEL_BYTES;
+      src.phase = DmtxScanPhaseExport;
+
+      return ScanBands(scan, &src, pageIndex);
+   }
+
+   /* Allocate memory for pixel data */
+   pxl = (unsigned char *)malloc(PackRowBytes(pack, width) * height);
+   if(pxl == NULL) {
+      SetError(scan, "malloc() error");
+      return DmtxScanErrorMemory;
+   }
+
+   /* Copy pixels to known format */
+   success = MagickGetImagePixels(wand, 0, 0, width, height,
+         (pack == DmtxPack8bppK) ? "I" : "RGB", CharPixel, pxl);
+   if(DeadlineExceeded(scan, DmtxScanPhaseExport, source) == DmtxTrue) {
+      free(pxl);
+      return DmtxScanErrorDeadline;
+   }
+   else if(success == MagickFalse) {
+      SetMagickError(scan, wand, "Unable to export pixels from \"%s\"", source);
+      free(pxl);
+      return DmtxScanErrorRead;
+   }
+
+   status = ScanPage(scan, pxl, width, height, pack, source, pageIndex);
+   free(pxl);
+
+   return status;
+}
+
+/**
+ * @brief  Choose how to export the pixels of a wand's current image
+ * @param  wand wand positioned at the page
+ * @return DmtxPack8bppK for bilevel images, otherwise DmtxPack24bppRGB
+ */
+static int
+GetWandPack(MagickWand *wand)
+{
+   /* Bilevel pages lose nothing as gray, at a third the size of RGB */
+   return (MagickGetImageType(wand) == BilevelType) ? DmtxPack8bppK : DmtxPack24bppRGB;
+}
+
+/**
+ * @brief  Scan the pages of a wand read at --locate-resolution
+ * @param  scan session
+ * @param  wand wand holding one or more images
+ * @param  path image path the wand was read from, or NULL for blob
+ * @param  blob encoded image bytes (used when path is NULL)
+ * @param  length blob length in bytes
+ * @param  source name reported to callbacks
+ * @param  firstPage page index of the wand's first image
+ * @return DmtxScanOk or error status
+ *
+ * Raster pages are scanned as they are, since no resolution changes
+ * their pixels. Vector pages are searched for symbols first and then
+ * rendered again, with only the areas around symbols scanned.
+ */
+static DmtxScanStatus
+LocateWand(DmtxScan *scan, MagickWand *wand, const char *path, const void *blob,
+      size_t length, const char *source, int firstPage)
+{
+   int pageIndex;
+   DmtxScanStatus status;
+
+   MagickResetIterator(wand);
+   for(pageIndex = firstPage; MagickNextImage(wand) != MagickFalse; pageIndex++) {
+
+      /* If requested, only scan specific page */
+      if(scan->opt.page != DmtxUndefined && scan->opt.page - 1 != pageIndex)
+         continue;
+
+      if(StopReached(scan) == DmtxTrue)
+         break;
+
+      if(IsVectorImage(wand) == DmtxTrue)
+         status = ScanVectorPage(scan, wand, path, blob, length, source, pageIndex,
+               pageIndex - firstPage);
+      else
+         status = ScanWandImage(scan, wand, source, pageIndex);
+
+      if(status != DmtxScanOk)
+         return status;
+   }
+
+   return DmtxScanOk;
+}
+
+/**
+ * @brief  Check whether the current image of a wand was rendered from vectors
+ * @param  wand wand positioned at the page
+ * @return DmtxTrue if rendering it again at a higher resolution adds detail
+ */
+static DmtxBoolean
+IsVectorImage(MagickWand *wand)
+{
+   static const char *vectorFormats[] = {
+      "AI", "EMF", "EPDF", "EPI", "EPS", "EPSF", "EPSI", "MSVG", "PCL", "PDF",
+      "PDFA", "PS", "RSVG", "SVG", "SVGZ", "WMF", "XPS", NULL
+   };
+   int i;
+   char *format;
+   DmtxBoolean vector;
+
+   format = MagickGetImageFormat(wand);
+   if(format == NULL)
+      return DmtxFalse;
+
+   vector = DmtxFalse;
+   for(i = 0; vectorFormats[i] != NULL; i++) {
+      if(strcmp(format, vectorFormats[i]) == 0) {
+         vector = DmtxTrue;
+         break;
+      }
+   }
+
+   MagickRelinquishMemory(format);
+
+   return vector;
+}
+
+/**
+ * @brief  Locate symbols on a low resolution page, then scan around them at high resolution
+ * @param  scan session
+ * @param  wand wand positioned at the page rendered at --locate-resolution
+ * @param  path image path the wand was read from, or NULL for blob
+ * @param  blob encoded image bytes (used when path is NULL)
+ * @param  length blob length in bytes
+ * @param  source name reported to callbacks
+ * @param  pageIndex page index reported to callbacks
+ * @param  imageIndex index of the page within path or blob
+ * @return DmtxScanOk or error status
+ */
+static DmtxScanStatus
+ScanVectorPage(DmtxScan *scan, MagickWand *wand, const char *path, const void *blob,
+      size_t length, const char *source, int pageIndex, int imageIndex)
+{
+   int dpi;
+   int width, height;
+   int windowCount;
+   double scale;
+   unsigned char *pxl;
+   char *spec;
+   char selector[32];
+   MagickWand *pageWand;
+   MagickBooleanType success;
+   ScanWindow windows[DMTXSCAN_LOCATE_WINDOWS_MAX];
+   DmtxScanStatus status;
+
+   width = MagickGetImageWidth(wand);
+   height = MagickGetImageHeight(wand);
+
+   /* Finding regions only needs gray pixels */
+   pxl = (unsigned char *)malloc((size_t)width * height);
+   if(pxl == NULL) {
+      SetError(scan, "malloc() error");
+      return DmtxScanErrorMemory;
+   }
+
+   success = MagickGetImagePixels(wand, 0, 0, width, height, "I", CharPixel, pxl);
+   if(DeadlineExceeded(scan, DmtxScanPhaseExport, source) == DmtxTrue) {
+      free(pxl);
+      return DmtxScanErrorDeadline;
+   }
+   else if(success == MagickFalse) {
+      SetMagickError(scan, wand, "Unable to export pixels from \"%s\"", source);
+      free(pxl);
+      return DmtxScanErrorRead;
+   }
+
+   status = LocateSymbols(scan, pxl, width, height, source, windows, &windowCount, &dpi);
+   free(pxl);
+
+   if(status != DmtxScanOk)
+      return status;
+
+   /* Nothing located: fall back to one pass at the requested resolution */
+   if(windowCount == 0) {
+      if(scan->opt.dpi == DmtxUndefined || scan->opt.dpi <= scan->opt.locateDpi)
+         return ScanWandImage(scan, wand, source, pageIndex);
+      dpi = scan->opt.dpi;
+   }
+
+   /* Symbols already large enough are scanned in the locate pass's
+    * pixels, as are all of them when the memory for a second render
+    * is refused */
+   scale = (double)dpi / scan->opt.locateDpi;
+   if(dpi <= scan->opt.locateDpi || GrowMemory(scan, scan->reservedBytes +
+         dmtxScanEstimatePage(&(scan->opt), (int)ceil(width * scale),
+         (int)ceil(height * scale), DmtxPack24bppRGB)) != DmtxPass) {
+      if(windowCount == 0)
+         return ScanWandImage(scan, wand, source, pageIndex);
+      return ScanWindows(scan, wand, windows, windowCount, 1.0, source, pageIndex);
+   }
+
+   /* Render just this page again */
+   if(path != NULL) {
+      spec = (char *)malloc(strlen(path) + 16);
+      if(spec == NULL) {
+         SetError(scan, "malloc() error");
+         return DmtxScanErrorMemory;
+      }
+
+      /* Paths that already name a page keep it */
+      if(path[0] != '\0' && path[strlen(path) - 1] == ']')
+         strcpy(spec, path);
+      else
+         sprintf(spec, "%s[%d]", path, imageIndex);
+
+      pageWand = OpenWand(scan, spec, NULL, 0, source, dpi, &status);
+      free(spec);
+   }
+   else {
+      /* Rendering the whole blob for each page would cost O(pages^2) */
+      sprintf(selector, "[%d]", imageIndex);
+      pageWand = OpenWand(scan, selector, blob, length, source, dpi, &status);
+   }
+
+   if(pageWand == NULL)
+      return status;
+
+   /* A reader that ignores the selector returns every page */
+   if(MagickSetIteratorIndex(pageWand,
+         (MagickGetNumberImages(pageWand) > 1) ? imageIndex : 0) == MagickFalse) {
+      SetMagickError(scan, pageWand, "Unable to render page again from \"%s\"", source);
+      DestroyMagickWand(pageWand);
+      return DmtxScanErrorRead;
+   }
+
+   if(windowCount == 0)
+      status = ScanWandImage(scan, pageWand, source, pageIndex);
+   else
+      status = ScanWindows(scan, pageWand, windows, windowCount,
+            (double)MagickGetImageWidth(pageWand) / width, source, pageIndex);
+
+   DestroyMagickWand(pageWand);
+
+   return status;
+}
+
+/**
+ * @brief  Find symbol regions without decoding them
+ * @param  scan session
+ * @param  pxl 8bpp gray page
+ * @param  width page width
+ * @param  height page height
+ * @param  source name used in error messages
+ * @param  windows array of DMTXSCAN_LOCATE_WINDOWS_MAX page areas to fill in
+ * @param  windowCount pointer to number of areas found
+ * @param  dpi pointer to resolution at which every region found is readable
+ * @return DmtxScanOk or error status
+ *
+ * Each area covers a region and a margin of half its size, so a symbol
+ * located slightly off still lies inside. Overlapping areas are merged.
+ * The resolution gives every module DMTXSCAN_LOCATE_MODULE_PIXELS pixels
+ * and every symbol edge at least --minimum-edge pixels. It is the
+ * requested --resolution instead when one is given.
+ */
+static DmtxScanStatus
+LocateSymbols(DmtxScan *scan, unsigned char *pxl, int width, int height, const char *source,
+      ScanWindow *windows, int *windowCount, int *dpi)
+{
+   int i;
+   double need, margin, sideX, sideY, side, module;
+   double minX, maxX, minY, maxY;
+   DmtxTime timeout;
+   DmtxImage *img;
+   DmtxDecode *dec;
+   DmtxRegion *reg;
+   DmtxVector2 p[4];
+   ScanWindow window;
+   DmtxScanStatus status;
+
+   *windowCount = 0;
+   *dpi = scan->opt.locateDpi;
+
+   img = dmtxImageCreate(pxl, width, height, DmtxPack8bppK);
+   if(img == NULL) {
+      SetError(scan, "dmtxImageCreate() error");
+      return DmtxScanErrorDecode;
+   }
+
+   dmtxImageSetProp(img, DmtxPropImageFlip, DmtxFlipNone);
+
+   dec = dmtxDecodeCreate(img, 1);
+   if(dec == NULL) {
+      dmtxImageDestroy(&img);
+      SetError(scan, "decode create error");
+      return DmtxScanErrorDecode;
+   }
+
+   /* Edge lengths and page limits are given at the final resolution */
+   if(dmtxDecodeSetProp(dec, DmtxPropSymbolSize, scan->opt.sizeIdxExpected) != DmtxPass ||
+         dmtxDecodeSetProp(dec, DmtxPropEdgeThresh, scan->opt.edgeThresh) != DmtxPass ||
+         (scan->opt.squareDevn != DmtxUndefined &&
+         dmtxDecodeSetProp(dec, DmtxPropSquareDevn, scan->opt.squareDevn) != DmtxPass)) {
+      dmtxDecodeDestroy(&dec);
+      dmtxImageDestroy(&img);
+      SetError(scan, "decode option error");
+      return DmtxScanErrorArgument;
+   }
+
+   need = 0.0;
+   status = DmtxScanOk;
+   while(*windowCount < DMTXSCAN_LOCATE_WINDOWS_MAX) {
+      reg = dmtxRegionFindNext(dec, GetSearchLimit(scan, &timeout));
+      if(reg == NULL) {
+         if(DeadlineExceeded(scan, DmtxScanPhaseSearch, source) == DmtxTrue)
+            status = DmtxScanErrorDeadline;
+         break;
+      }
+
+      p[0].X = p[0].Y = p[1].Y = p[3].X = 0.0;
+      p[1].X = p[3].Y = p[2].X = p[2].Y = 1.0;
+      for(i = 0; i < 4; i++)
+         dmtxMatrix3VMultiplyBy(&p[i], reg->fit2raw);
+
+      sideX = sqrt((p[1].X - p[0].X) * (p[1].X - p[0].X) + (p[1].Y - p[0].Y) * (p[1].Y - p[0].Y));
+      sideY = sqrt((p[3].X - p[0].X) * (p[3].X - p[0].X) + (p[3].Y - p[0].Y) * (p[3].Y - p[0].Y));
+      side = (sideX > sideY) ? sideX : sideY;
+
+      /* Scale up until modules, and edges if limited, are big enough */
+      if(reg->symbolCols > 0 && reg->symbolRows > 0) {
+         module = (sideX / reg->symbolCols < sideY / reg->symbolRows) ?
+               sideX / reg->symbolCols : sideY / reg->symbolRows;
+         if(module > 0.0 && DMTXSCAN_LOCATE_MODULE_PIXELS / module > need)
+            need = DMTXSCAN_LOCATE_MODULE_PIXELS / module;
+      }
+      if(scan->opt.edgeMin != DmtxUndefined && side > 0.0 && scan->opt.edgeMin / side > need)
+         need = scan->opt.edgeMin / side;
+
+      /* libdmtx rows count up from the bottom of the page */
+      minX = maxX = p[0].X;
+      minY = maxY = height - 1 - p[0].Y;
+      for(i = 1; i < 4; i++) {
+         minX = (p[i].X < minX) ? p[i].X : minX;
+         maxX = (p[i].X > maxX) ? p[i].X : maxX;
+         minY = (height - 1 - p[i].Y < minY) ? height - 1 - p[i].Y : minY;
+         maxY = (height - 1 - p[i].Y > maxY) ? height - 1 - p[i].Y : maxY;
+      }
+
+      margin = side / 2.0 + 2.0;
+      window.x0 = (int)floor(minX - margin);
+      window.y0 = (int)floor(minY - margin);
+      window.x1 = (int)ceil(maxX + margin) + 1;
+      window.y1 = (int)ceil(maxY + margin) + 1;
+
+      window.x0 = (window.x0 < 0) ? 0 : window.x0;
+      window.y0 = (window.y0 < 0) ? 0 : window.y0;
+      window.x1 = (window.x1 > width) ? width : window.x1;
+      window.y1 = (window.y1 > height) ? height : window.y1;
+
+      if(window.x0 < window.x1 && window.y0 < window.y1)
+         *windowCount = AddWindow(windows, *windowCount, &window);
+
+      dmtxRegionDestroy(&reg);
+
+      if(StopReached(scan) == DmtxTrue)
+         break;
+   }
+
+   dmtxDecodeDestroy(&dec);
+   dmtxImageDestroy(&img);
+
+   if(scan->opt.dpi != DmtxUndefined)
+      *dpi = scan->opt.dpi;
+   else if(need > 1.0)
+      *dpi = (scan->opt.locateDpi * need < DMTXSCAN_LOCATE_DPI_MAX) ?
+            (int)ceil(scan->opt.locateDpi * need) : DMTXSCAN_LOCATE_DPI_MAX;
+
+   return status;
+}
+
+/**
+ * @brief  Add a page area to a list, merging it with any it overlaps
+ * @param  windows list of non-overlapping areas
+ * @param  windowCount areas in list
+ * @param  window area to add
+ * @return New number of areas in list
+ */
+static int
+AddWindow(ScanWindow *windows, int windowCount, ScanWindow *window)
+{
+   int i;
+   ScanWindow merged = *window;
+
+   /* Merging can make the area overlap others, so start over each time */
+   for(i = 0; i < windowCount; i++) {
+      if(merged.x0 >= windows[i].x1 || windows[i].x0 >= merged.x1 ||
+            merged.y0 >= windows[i].y1 || windows[i].y0 >= merged.y1)
+         continue;
+
+      merged.x0 = (windows[i].x0 < merged.x0) ? windows[i].x0 : merged.x0;
+      merged.y0 = (windows[i].y0 < merged.y0) ? windows[i].y0 : merged.y0;
+      merged.x1 = (windows[i].x1 > merged.x1) ? windows[i].x1 : merged.x1;
+      merged.y1 = (windows[i].y1 > merged.y1) ? windows[i].y1 : merged.y1;
+
+      windows[i] = windows[--windowCount];
+      i = -1;
+   }
+
+   windows[windowCount++] = merged;
+
+   return windowCount;
+}
+
+/**
+ * @brief  Scan only the given areas of a page
+ * @param  scan session
+ * @param  wand wand positioned at the page
+ * @param  windows areas found at the locate resolution
+ * @param  windowCount number of areas
+ * @param  scale page size over its size at the locate resolution
+ * @param  source name reported to callbacks
+ * @param  pageIndex page index reported to callbacks
+ * @return DmtxScanOk or error status
+ *
+ * Symbols are reported in page coordinates, once even if found in two
+ * areas, and the page callback counts each area as a band.
+ */
+static DmtxScanStatus
+ScanWindows(DmtxScan *scan, MagickWand *wand, ScanWindow *windows, int windowCount,
+      double scale, const char *source, int pageIndex)
+{
+   int i;
+   int pack;
+   int x0, y0, x1, y1;
+   unsigned char *pxl;
+   DmtxScanStatus status;
+   MagickBooleanType success;
+   DmtxTime timeout;
+   DmtxTime *searchLimit;
+   DmtxScanPage page;
+   ScanSeenList seen;
+
+   memset(&page, 0x00, sizeof(DmtxScanPage));
+   page.source = source;
+   page.pageIndex = pageIndex;
+   page.width = MagickGetImageWidth(wand);
+   page.height = MagickGetImageHeight(wand);
+
+   pack = GetWandPack(wand);
+   memset(&seen, 0x00, sizeof(ScanSeenList));
+   searchLimit = GetSearchLimit(scan, &timeout);
+
+   status = DmtxScanOk;
+   for(i = 0; i < windowCount && status == DmtxScanOk && StopReached(scan) == DmtxFalse; i++) {
+      x0 = (int)floor(windows[i].x0 * scale);
+      y0 = (int)floor(windows[i].y0 * scale);
+      x1 = (int)ceil(windows[i].x1 * scale);
+      y1 = (int)ceil(windows[i].y1 * scale);
+      x1 = (x1 > page.width) ? page.width : x1;
+      y1 = (y1 > page.height) ? page.height : y1;
+      if(x0 >= x1 || y0 >= y1)
+         continue;
+
+      pxl = (unsigned char *)malloc(PackRowBytes(pack, x1 - x0) * (y1 - y0));
+      if(pxl == NULL) {
+         SetError(scan, "malloc() error");
+         status = DmtxScanErrorMemory;
+         break;
+      }
+
+      success = MagickGetImagePixels(wand, x0, y0, x1 - x0, y1 - y0,
+            (pack == DmtxPack8bppK) ? "I" : "RGB", CharPixel, pxl);
+      if(DeadlineExceeded(scan, DmtxScanPhaseExport, source) == DmtxTrue) {
+         status = DmtxScanErrorDeadline;
+      }
+      else if(success == MagickFalse) {
+         SetMagickError(scan, wand, "Unable to export pixels from \"%s\"", source);
+         status = DmtxScanErrorRead;
+      }
+      else {
+         /* libdmtx rows count up from the bottom of the page */
+         status = ScanBand(scan, pxl, pack, x1 - x0, y1 - y0, x0, page.height - y1,
+               &page, searchLimit, &seen);
+         page.bandCount++;
+      }
+
+      free(pxl);
+   }
+
+   free(seen.seen);
+
+   if(status == DmtxScanOk && scan->pageFunc != NULL) {
+      if((*scan->pageFunc)(&page, scan->userData) != DmtxPass) {
+         SetError(scan, "Page callback failed");
+         status = DmtxScanErrorCallback;
+      }
+   }
+
+   return status;
+}
+
+/**
+ * @brief  Estimate bytes needed to load and scan a file or blob
+ * @param  scan session
+ * @param  path image path, or NULL for blob
+ * @param  blob encoded image bytes (used when path is NULL)
+ * @param  length blob length in bytes
+ * @param  dpi resolution for vector input, or DmtxUndefined for the default
+ * @return Estimated bytes, or the memory limit if the source cannot be pinged
+ *
+ * Magick holds every page of a source at once, but pixels are exported
+ * and decoded one page at a time.
+ */
+static size_t
+PingFootprint(DmtxScan *scan, const char *path, const void *blob, size_t length, int dpi)
+{
+   int pageIndex;
+   size_t width, height;
+   size_t magickBytes, pageBytes, largestPage;
+   MagickBooleanType success;
+   MagickWand *wand;
+
+   /* Standard input can only be read once */
+   if(path != NULL && strcmp(path, "-") == 0)
+      return scan->opt.memoryLimit;
+
+   wand = NewMagickWand();
+   if(wand == NULL)
+      return scan->opt.memoryLimit;
+
+   if(dpi != DmtxUndefined)
+      MagickSetResolution(wand, (double)dpi, (double)dpi);
+
+   if(path != NULL)
+      success = MagickPingImage(wand, path);
+   else
+      success = MagickPingImageBlob(wand, blob, length);
+
+   if(success == MagickFalse) {
+      DestroyMagickWand(wand);
+      return scan->opt.memoryLimit;
+   }
+
+   magickBytes = largestPage = 0;
+
+   MagickResetIterator(wand);
+   for(pageIndex = 0; MagickNextImage(wand) != MagickFalse; pageIndex++) {
+      width = MagickGetImageWidth(wand);
+      height = MagickGetImageHeight(wand);
+      magickBytes += width * height * DMTXSCAN_MAGICK_PIXEL_BYTES;
+
+      if(scan->opt.page != DmtxUndefined && scan->opt.page - 1 != pageIndex)
+         continue;
+
+      pageBytes = dmtxScanEstimatePage(&(scan->opt), (int)width, (int)height, DmtxPack24bppRGB) -
+            width * height * DMTXSCAN_MAGICK_PIXEL_BYTES;
+      if(pageBytes > largestPage)
+         largestPage = pageBytes;
+   }
+
+   DestroyMagickWand(wand);
+
+   return magickBytes + largestPage;
+}
+
+/**
+ * @brief  Bytes in one row of pixels
+ * @param  pack libdmtx pixel packing
+ * @param  width row width in pixels
+ * @return Row size in bytes
+ */
+static size_t
+PackRowBytes(int pack, int width)
+{
+   switch(pack) {
+      case DmtxPack1bppK:
+         return ((size_t)width + 7) / 8;
+      case DmtxPack8bppK:
+         return (size_t)width;
+      case DmtxPack16bppRGB:
+      case DmtxPack16bppRGBX:
+      case DmtxPack16bppXRGB:
+      case DmtxPack16bppBGR:
+      case DmtxPack16bppBGRX:
+      case DmtxPack16bppXBGR:
+      case DmtxPack16bppYCbCr:
+         return (size_t)width * 2;
+      case DmtxPack24bppRGB:
+      case DmtxPack24bppBGR:
+      case DmtxPack24bppYCbCr:
+         return (size_t)width * 3;
+      default:
+         break;
+   }
+
+   return (size_t)width * 4;
+}
+
+/**
+ * @brief  Choose the region search limit for a new page
+ * @param  scan session
+ * @param  timeout storage for the --milliseconds page timeout
+ * @return Earlier of the page timeout and source deadline, or NULL for none
+ */
+static DmtxTime *
+GetSearchLimit(DmtxScan *scan, DmtxTime *timeout)
+{
+   DmtxTime *searchLimit = NULL;
+
+   /* Reset timeout for each new page, never searching past the deadline */
+   if(scan->opt.timeoutMS != DmtxUndefined) {
+      *timeout = dmtxTimeAdd(dmtxTimeNow(), scan->opt.timeoutMS);
+      searchLimit = timeout;
+   }
+
+   if(scan->deadlineActive == DmtxTrue && (searchLimit == NULL ||
+         scan->deadline.sec < timeout->sec || (scan->deadline.sec == timeout->sec &&
+         scan->deadline.usec < timeout->usec)))
+      searchLimit = &(scan->deadline);
+
+   return searchLimit;
+}
+
+/**
+ * @brief  Find and decode every barcode on one page
+ * @param  scan session
+ * @param  pxl pixel buffer
+ * @param  width page width
+ * @param  height page height
+ * @param  pack pixel packing of pxl
+ * @param  source name reported to callbacks
+ * @param  pageIndex page index reported to callbacks
+ * @return DmtxScanOk or error status
+ */
+static DmtxScanStatus
+ScanPage(DmtxScan *scan, unsigned char *pxl, int width, int height, int pack,
+      const char *source, int pageIndex)
+{
+   DmtxTime timeout;
+   DmtxScanPage page;
+
+   memset(&page, 0x00, sizeof(DmtxScanPage));
+   page.source = source;
+   page.pageIndex = pageIndex;
+   page.width = width;
+   page.height = height;
+   page.bandCount = 1;
+
+   return ScanBand(scan, pxl, pack, width, height, 0, 0, &page, GetSearchLimit(scan, &timeout), NULL);
+}
+
+/**
+ * @brief  Scan a page in overlapping horizontal bands
+ * @param  scan session
+ * @param  src page rows, either in memory or read on demand
+ * @param  pageIndex page index reported to callbacks
+ * @return DmtxScanOk or error status
+ *
+ * Bands overlap by 1.5 times --maximum-edge (or a quarter band when no
+ * maximum is given), so any symbol that fits in the overlap lies wholly
+ * inside at least one band. Symbols found twice in an overlap are
+ * reported once, with corners translated to page coordinates. Rows are
+ * read once, top to bottom, and the overlap is carried over between
+ * bands, so streamed sources never need more than one band in memory.
+ */
+static DmtxScanStatus
+ScanBands(DmtxScan *scan, ScanBandSource *src, int pageIndex)
+{
+   int y, rows, keep;
+   size_t rowBytes;
+   int overlap;
+   int bandHeight;
+   unsigned char *band, *bandPxl;
+   DmtxPassFail err;
+   DmtxScanStatus status;
+   DmtxTime timeout;
+   DmtxTime *searchLimit;
+   DmtxScanPage page;
+   ScanSeenList seen;
+
+   /* Readers and libdmtx address a row with int offsets */
+   if(src->width > INT_MAX / 4) {
+      SetError(scan, "Page too wide in \"%s\"", src->source);
+      return DmtxScanErrorRead;
+   }
+
+   rowBytes = PackRowBytes(src->pack, src->width);
+   bandHeight = GetBandHeight(scan, src, &overlap);
+
+   band = NULL;
+   if(src->pxl == NULL) {
+      band = (unsigned char *)malloc((size_t)rowBytes * bandHeight);
+      if(band == NULL) {
+         SetError(scan, "malloc() error");
+         return DmtxScanErrorMemory;
+      }
+   }
+
+   memset(&page, 0x00, sizeof(DmtxScanPage));
+   page.source = src->source;
+   page.pageIndex = pageIndex;
+   page.width = src->width;
+   page.height = src->height;
+
+   memset(&seen, 0x00, sizeof(ScanSeenList));
+   searchLimit = GetSearchLimit(scan, &timeout);
+
+   /* Rows [y, y + rows) form the current band */
+   y = keep = 0;
+   rows = bandHeight;
+   status = DmtxScanOk;
+   for(;;) {
+      if(src->pxl != NULL) {
+         bandPxl = src->pxl + (size_t)y * rowBytes;
+      }
+      else {
+         err = (*src->readRows)(src, band + (size_t)keep * rowBytes, rows - keep);
+         if(DeadlineExceeded(scan, src->phase, src->source) == DmtxTrue) {
+            status = DmtxScanErrorDeadline;
+            break;
+         }
+         else if(err != DmtxPass) {
+            status = DmtxScanErrorRead;
+            break;
+         }
+         bandPxl = band;
+      }
+
+      /* libdmtx rows count up from the bottom of the page */
+      status = ScanBand(scan, bandPxl, src->pack, src->width, rows, 0, src->height - y - rows,
+            &page, searchLimit, &seen);
+      page.bandCount++;
+
+      if(status != DmtxScanOk || y + rows >= src->height || StopReached(scan) == DmtxTrue)
+         break;
+
+      /* Carry the bottom of this band over as the top of the next */
+      if(band != NULL)
+         memmove(band, band + (size_t)(rows - overlap) * rowBytes, (size_t)overlap * rowBytes);
+
+      y += rows - overlap;
+      keep = overlap;
+      rows = (src->height - y < bandHeight) ? src->height - y : bandHeight;
+   }
+
+   free(seen.seen);
+   free(band);
+
+   if(status == DmtxScanOk && scan->pageFunc != NULL) {
+      if((*scan->pageFunc)(&page, scan->userData) != DmtxPass) {
+         SetError(scan, "Page callback failed");
+         status = DmtxScanErrorCallback;
+      }
+   }
+
+   return status;
+}
+
+/**
+ * @brief  Choose band height and overlap for a banded scan
+ * @param  scan session
+ * @param  src page rows
+ * @param  overlap pointer to rows shared by neighboring bands
+ * @return Rows per band (never more than the page height)
+ */
+static int
+GetBandHeight(DmtxScan *scan, ScanBandSource *src, int *overlap)
+{
+   int bandHeight;
+   size_t budget, rowCost;
+
+   /* Explicit height first, then what fits in the memory limit */
+   if(scan->opt.bandHeight != DmtxUndefined) {
+      bandHeight = scan->opt.bandHeight;
+   }
+   else if(scan->opt.memoryLimit != 0) {
+      rowCost = GetBandRowCost(scan, src);
+      budget = (scan->opt.memoryLimit > src->fixedBytes) ?
+            scan->opt.memoryLimit - src->fixedBytes : 0;
+      bandHeight = (budget / rowCost < (size_t)src->height) ? (int)(budget / rowCost) : src->height;
+   }
+   else {
+      bandHeight = DMTXSCAN_BAND_HEIGHT_DEFAULT;
+   }
+
+   *overlap = (scan->opt.edgeMax != DmtxUndefined) ? scan->opt.edgeMax * 3 / 2 : bandHeight / 4;
+   if(*overlap < DMTXSCAN_BAND_OVERLAP_MIN)
+      *overlap = DMTXSCAN_BAND_OVERLAP_MIN;
+
+   if(bandHeight < 2 * *overlap)
+      bandHeight = 2 * *overlap;
+   if(bandHeight < DMTXSCAN_BAND_HEIGHT_MIN)
+      bandHeight = DMTXSCAN_BAND_HEIGHT_MIN;
+   if(bandHeight > src->height)
+      bandHeight = src->height;
+
+   return bandHeight;
+}
+
+/**
+ * @brief  Bytes of band buffer and decoder cache needed per band row
+ * @param  scan session
+ * @param  src page rows
+ * @return Bytes per row
+ */
+static size_t
+GetBandRowCost(DmtxScan *scan, ScanBandSource *src)
+{
+   size_t shrink;
+
+   shrink = (scan->opt.shrinkMin < 1) ? 1 : (size_t)scan->opt.shrinkMin;
+
+   return (size_t)src->width / (shrink * shrink) + 1 +
+         ((src->pxl == NULL) ? PackRowBytes(src->pack, src->width) : 0);
+}
+
+/**
+ * @brief  Export the next rows of a Magick page as RGB, or gray for 8bppK
+ * @param  src band source reading from a wand
+ * @param  dest destination for rowCount rows
+ * @param  rowCount number of rows
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+ReadWandRows(ScanBandSource *src, unsigned char *dest, int rowCount)
+{
+   MagickWand *wand = (MagickWand *)src->reader;
+
+   if(MagickGetImagePixels(wand, 0, src->nextRow, src->width, rowCount,
+         (src->pack == DmtxPack8bppK) ? "I" : "RGB", CharPixel, dest) == MagickFalse) {
+      SetMagickError(src->scan, wand, "Unable to export pixels from \"%s\"", src->source);
+      return DmtxFail;
+   }
+
+   src->nextRow += rowCount;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Expand the next rows of a packed 1bpp page to 8bppK
+ * @param  src band source whose reader is the packed pixel buffer
+ * @param  dest destination for rowCount rows
+ * @param  rowCount number of rows
+ * @return DmtxPass
+ */
+static DmtxPassFail
+ReadPackedRows(ScanBandSource *src, unsigned char *dest, int rowCount)
+{
+   int row;
+   size_t rowBytes;
+   unsigned char *bits;
+
+   rowBytes = PackRowBytes(DmtxPack1bppK, src->width);
+   bits = (unsigned char *)src->reader + (size_t)src->nextRow * rowBytes;
+
+   for(row = 0; row < rowCount; row++) {
+      UnpackRow(bits, dest, src->width);
+      bits += rowBytes;
+      dest += src->width;
+   }
+
+   src->nextRow += rowCount;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Build the table expanding one packed byte to eight pixels
+ * @return void
+ */
+static void
+InitPackedTable(void)
+{
+   int byte, bit;
+
+   for(byte = 0; byte < 256; byte++) {
+      for(bit = 0; bit < 8; bit++)
+         packedLut[byte][bit] = (byte & (0x80 >> bit)) ? 0 : 255;
+   }
+}
+
+/**
+ * @brief  Expand one row of packed 1bpp pixels (set bits black) to 8bppK
+ * @param  bits packed row, most significant bit first
+ * @param  dest destination for width pixels
+ * @param  width row width in pixels
+ * @return void
+ */
+static void
+UnpackRow(const unsigned char *bits, unsigned char *dest, int width)
+{
+   int i;
+   int whole = width / 8;
+
+   /* Whole bytes expand by table, eight pixels per copy */
+   for(i = 0; i < whole; i++)
+      memcpy(dest + 8 * i, packedLut[bits[i]], 8);
+
+   if(width > 8 * whole)
+      memcpy(dest + 8 * whole, packedLut[bits[whole]], width - 8 * whole);
+}
+
+/**
+ * @brief  Find and decode every barcode in a page or band
+ * @param  scan session
+ * @param  pxl pixel buffer holding bandHeight rows of bandWidth pixels
+ * @param  pack pixel packing of pxl
+ * @param  bandWidth columns in pxl (page width unless scanning a window)
+ * @param  bandHeight rows in pxl (page height when not banded)
+ * @param  xOffset column of the band's left edge within the page
+ * @param  yOffset libdmtx Y coordinate of the band's bottom row within the page
+ * @param  page page being scanned (symbol count is updated)
+ * @param  searchLimit region search time limit, or NULL
+ * @param  seen symbols from earlier bands, or NULL when not banded
+ * @return DmtxScanOk or error status
+ */
+static DmtxScanStatus
+ScanBand(DmtxScan *scan, unsigned char *pxl, int pack, int bandWidth, int bandHeight,
+      int xOffset, int yOffset, DmtxScanPage *page, DmtxTime *searchLimit, ScanSeenList *seen)
+{
+   int i;
+   DmtxPassFail err;
+   DmtxBoolean inRange;
+   DmtxScanStatus status;
+   DmtxImage *img;
+   DmtxDecode *dec;
+   DmtxRegion *reg;
+   DmtxMessage *msg;
+   DmtxScanResult result;
+   DmtxTime now;
+
+   /* Initialize libdmtx image */
+   img = dmtxImageCreate(pxl, bandWidth, bandHeight, pack);
+   if(img == NULL) {
+      SetError(scan, "dmtxImageCreate() error");
+      return DmtxScanErrorDecode;
+   }
+
+   dmtxImageSetProp(img, DmtxPropImageFlip, DmtxFlipNone);
+
+   /* Initialize scan */
+   dec = dmtxDecodeCreate(img, scan->opt.shrinkMin);
+   if(dec == NULL) {
+      dmtxImageDestroy(&img);
+      SetError(scan, "decode create error");
+      return DmtxScanErrorDecode;
+   }
+
+   err = SetDecodeOptions(scan, dec, page->width, page->height, xOffset, yOffset,
+         bandWidth, bandHeight, &inRange);
+   if(err != DmtxPass) {
+      dmtxDecodeDestroy(&dec);
+      dmtxImageDestroy(&img);
+      return DmtxScanErrorArgument;
+   }
+
+   /* Find and decode every barcode on page (bands outside -x/-X/-y/-Y are skipped) */
+   status = DmtxScanOk;
+   while(inRange == DmtxTrue) {
+      /* Find next barcode region within image, but do not decode yet */
+      reg = dmtxRegionFindNext(dec, searchLimit);
+
+      /* Finished file or ran out of time before finding another region */
+      if(reg == NULL) {
+         if(DeadlineExceeded(scan, DmtxScanPhaseSearch, page->source) == DmtxTrue)
+            status = DmtxScanErrorDeadline;
+         break;
+      }
+
+      /* Decoding cannot be interrupted, so do not start one past the deadline */
+      if(DeadlineExceeded(scan, DmtxScanPhaseDecode, page->source) == DmtxTrue) {
+         dmtxRegionDestroy(&reg);
+         status = DmtxScanErrorDeadline;
+         break;
+      }
+
+      /* Decode region based on requested barcode mode */
+      if(scan->opt.mosaic == DmtxTrue)
+         msg = dmtxDecodeMosaicRegion(dec, reg, scan->opt.correctionsMax);
+      else
+         msg = dmtxDecodeMatrixRegion(dec, reg, scan->opt.correctionsMax);
+
+      if(msg != NULL) {
+         memset(&result, 0x00, sizeof(DmtxScanResult));
+         result.source = page->source;
+         result.member = scan->member;
+         result.pageIndex = page->pageIndex;
+         result.width = page->width;
+         result.height = page->height;
+         result.dec = dec;
+         result.reg = reg;
+         result.msg = msg;
+         GetResultCorners(&result);
+
+         now = dmtxTimeNow();
+         result.elapsedMS = (long)(now.sec - scan->sourceStart.sec) * 1000 +
+               ((long)now.usec - (long)scan->sourceStart.usec) / 1000;
+
+         for(i = 0; i < 4; i++) {
+            result.corner[i].X += xOffset;
+            result.corner[i].Y += yOffset;
+         }
+
+         if(seen == NULL || AlreadySeen(seen, &result) == DmtxFalse) {
+            page->symbolCount++;
+            scan->symbolCount++;
+
+            if(scan->symbolFunc != NULL &&
+                  (*scan->symbolFunc)(&result, scan->userData) != DmtxPass) {
+               SetError(scan, "Symbol callback failed");
+               status = DmtxScanErrorCallback;
+            }
+         }
+
+         dmtxMessageDestroy(&msg);
+      }
+
+      dmtxRegionDestroy(&reg);
+
+      /* Symbols decoded in time are kept even if decoding overran */
+      if(status == DmtxScanOk && DeadlineExceeded(scan, DmtxScanPhaseDecode, page->source) == DmtxTrue)
+         status = DmtxScanErrorDeadline;
+
+      if(status != DmtxScanOk || StopReached(scan) == DmtxTrue)
+         break;
+   }
+
+   /* Whole pages hand their decoder to the page callback for diagnostics */
+   if(seen == NULL && status == DmtxScanOk && scan->pageFunc != NULL) {
+      page->dec = dec;
+      if((*scan->pageFunc)(page, scan->userData) != DmtxPass) {
+         SetError(scan, "Page callback failed");
+         status = DmtxScanErrorCallback;
+      }
+      page->dec = NULL;
+   }
+
+   dmtxDecodeDestroy(&dec);
+   dmtxImageDestroy(&img);
+
+   return status;
+}
+
+/**
+ * @brief  Check for a symbol already reported from an overlapping band
+ * @param  seen symbols reported so far on this page
+ * @param  result new symbol with page coordinates
+ * @return DmtxTrue if the same message was found at the same place
+ *
+ * New symbols are added to the list. If the list cannot grow the symbol
+ * is treated as new, which at worst reports it twice.
+ */
+static DmtxBoolean
+AlreadySeen(ScanSeenList *seen, DmtxScanResult *result)
+{
+   int i;
+   int newAlloc;
+   unsigned long hash;
+   double dx, dy, radius;
+   DmtxVector2 center;
+   ScanSeen *entry, *newSeen;
+   DmtxMessage *msg = result->msg;
+
+   /* FNV-1a hash of decoded output */
+   hash = 2166136261UL;
+   for(i = 0; i < msg->outputIdx; i++)
+      hash = ((hash ^ msg->output[i]) * 16777619UL) & 0xffffffffUL;
+
+   center.X = (result->corner[0].X + result->corner[2].X) / 2.0;
+   center.Y = (result->corner[0].Y + result->corner[2].Y) / 2.0;
+   dx = result->corner[2].X - result->corner[0].X;
+   dy = result->corner[2].Y - result->corner[0].Y;
+   radius = sqrt(dx * dx + dy * dy) / 2.0;
+
+   for(i = 0; i < seen->count; i++) {
+      entry = &(seen->seen[i]);
+      if(entry->hash != hash || entry->length != msg->outputIdx)
+         continue;
+
+      dx = entry->center.X - center.X;
+      dy = entry->center.Y - center.Y;
+      if(sqrt(dx * dx + dy * dy) < ((entry->radius > radius) ? entry->radius : radius))
+         return DmtxTrue;
+   }
+
+   if(seen->count == seen->alloc) {
+      newAlloc = (seen->alloc == 0) ? 16 : seen->alloc * 2;
+      newSeen = (ScanSeen *)realloc(seen->seen, newAlloc * sizeof(ScanSeen));
+      if(newSeen == NULL)
+         return DmtxFalse;
+      seen->seen = newSeen;
+      seen->alloc = newAlloc;
+   }
+
+   entry = &(seen->seen[seen->count++]);
+   entry->hash = hash;
+   entry->length = msg->outputIdx;
+   entry->center = center;
+   entry->radius = radius;
+
+   return DmtxFalse;
+}
+
+/**
+ * @brief  Apply session options to a new decoder
+ * @param  scan session
+ * @param  dec decoder
+ * @param  width page width
+ * @param  height page height (percentages in -y/-Y are relative to this)
+ * @param  xOffset column of the band's left edge within the page
+ * @param  yOffset libdmtx Y coordinate of the band's bottom row within the page
+ * @param  bandWidth columns held by the decoder's image
+ * @param  bandHeight rows held by the decoder's image
+ * @param  inRange set to DmtxFalse if -x/-X/-y/-Y exclude the whole band
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+SetDecodeOptions(DmtxScan *scan, DmtxDecode *dec, int width, int height, int xOffset,
+      int yOffset, int bandWidth, int bandHeight, DmtxBoolean *inRange)
+{
+   int err;
+   int value;
+   DmtxScanOptions *opt = &(scan->opt);
+
+   *inRange = DmtxTrue;
+
+#define RETURN_IF_FAILED(e) if(e != DmtxPass) { SetError(scan, "decode option error"); return DmtxFail; }
+
+   err = dmtxDecodeSetProp(dec, DmtxPropScanGap, opt->scanGap);
+   RETURN_IF_FAILED(err)
+
+   if(opt->gs1 != DmtxUndefined) {
+      err = dmtxDecodeSetProp(dec, DmtxPropFnc1, opt->gs1);
+      RETURN_IF_FAILED(err)
+   }
+
+   if(opt->edgeMin != DmtxUndefined) {
+      err = dmtxDecodeSetProp(dec, DmtxPropEdgeMin, opt->edgeMin);
+      RETURN_IF_FAILED(err)
+   }
+
+   if(opt->edgeMax != DmtxUndefined) {
+      err = dmtxDecodeSetProp(dec, DmtxPropEdgeMax, opt->edgeMax);
+      RETURN_IF_FAILED(err)
+   }
+
+   if(opt->squareDevn != DmtxUndefined) {
+      err = dmtxDecodeSetProp(dec, DmtxPropSquareDevn, opt->squareDevn);
+      RETURN_IF_FAILED(err)
+   }
+
+   err = dmtxDecodeSetProp(dec, DmtxPropSymbolSize, opt->sizeIdxExpected);
+   RETURN_IF_FAILED(err)
+
+   err = dmtxDecodeSetProp(dec, DmtxPropEdgeThresh, opt->edgeThresh);
+   RETURN_IF_FAILED(err)
+
+#undef RETURN_IF_FAILED
+#define RETURN_IF_FAILED(e, s) if(e != DmtxPass) { SetError(scan, "Invalid scan range \"%s\"", s); return DmtxFail; }
+
+   /* Limits are given for the page and moved into the band */
+   if(opt->xMin) {
+      err = dmtxScanScaleNumberString(opt->xMin, width, &value);
+      RETURN_IF_FAILED(err, opt->xMin)
+      value -= xOffset;
+      if(value > bandWidth - 1)
+         *inRange = DmtxFalse;
+      err = dmtxDecodeSetProp(dec, DmtxPropXmin, (value < 0) ? 0 : value);
+      RETURN_IF_FAILED(err, opt->xMin)
+   }
+
+   if(opt->xMax) {
+      err = dmtxScanScaleNumberString(opt->xMax, width, &value);
+      RETURN_IF_FAILED(err, opt->xMax)
+      value -= xOffset;
+      if(value < 0)
+         *inRange = DmtxFalse;
+      err = dmtxDecodeSetProp(dec, DmtxPropXmax, (value > bandWidth - 1) ? bandWidth - 1 : value);
+      RETURN_IF_FAILED(err, opt->xMax)
+   }
+
+   if(opt->yMin) {
+      err = dmtxScanScaleNumberString(opt->yMin, height, &value);
+      RETURN_IF_FAILED(err, opt->yMin)
+      value -= yOffset;
+      if(value > bandHeight - 1)
+         *inRange = DmtxFalse;
+      err = dmtxDecodeSetProp(dec, DmtxPropYmin, (value < 0) ? 0 : value);
+      RETURN_IF_FAILED(err, opt->yMin)
+   }
+
+   if(opt->yMax) {
+      err = dmtxScanScaleNumberString(opt->yMax, height, &value);
+      RETURN_IF_FAILED(err, opt->yMax)
+      value -= yOffset;
+      if(value < 0)
+         *inRange = DmtxFalse;
+      err = dmtxDecodeSetProp(dec, DmtxPropYmax, (value > bandHeight - 1) ? bandHeight - 1 : value);
+      RETURN_IF_FAILED(err, opt->yMax)
+   }
+
+#undef RETURN_IF_FAILED
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Fill in corner locations and rotation angle for a result
+ * @param  result result holding a decoded region
+ * @return void
+ */
+static void
+GetResultCorners(DmtxScanResult *result)
+{
+   int rotateInt;
+   double rotate;
+   DmtxVector2 *p = result->corner;
+
+   p[0].X = p[0].Y = p[1].Y = p[3].X = 0.0;
+   p[1].X = p[3].Y = p[2].X = p[2].Y = 1.0;
+   dmtxMatrix3VMultiplyBy(&p[0], result->reg->fit2raw);
+   dmtxMatrix3VMultiplyBy(&p[1], result->reg->fit2raw);
+   dmtxMatrix3VMultiplyBy(&p[2], result->reg->fit2raw);
+   dmtxMatrix3VMultiplyBy(&p[3], result->reg->fit2raw);
+
+   rotate = (2 * M_PI) + atan2(p[1].Y - p[0].Y, p[1].X - p[0].X);
+
+   rotateInt = (int)(rotate * 180/M_PI + 0.5);
+   if(rotateInt >= 360)
+      rotateInt -= 360;
+
+   result->rotation = rotateInt;
+}
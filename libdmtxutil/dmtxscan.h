@@ -0,0 +1,168 @@
+/*
+libdmtx - Data Matrix Encoding/Decoding Library
+
+Copyright (C) 2008, 2009 Mike Laughton
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+Contact: mike@dragonflylogic.com
+*/
+
+#ifndef __DMTXSCAN_H__
+#define __DMTXSCAN_H__
+
+#include <stddef.h>
+#include <dmtx.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Result of a scan session call. Errors are returned to the caller and
+ * never terminate the process, so one session can outlive a bad image.
+ */
+typedef enum {
+   DmtxScanOk = 0,
+   DmtxScanErrorArgument,  /* invalid option value or argument */
+   DmtxScanErrorMemory,    /* allocation failed */
+   DmtxScanErrorRead,      /* image could not be opened or rasterized */
+   DmtxScanErrorDecode,    /* libdmtx image or decoder setup failed */
+   DmtxScanErrorCallback,  /* a callback asked the session to stop */
+   DmtxScanErrorDeadline   /* source exceeded its deadline (see dmtxScanGetTimeoutPhase) */
+} DmtxScanStatus;
+
+/**
+ * Stage of work on a source, used to report where a deadline expired.
+ */
+typedef enum {
+   DmtxScanPhaseNone = 0,
+   DmtxScanPhaseLoad,      /* reading and decoding the image file */
+   DmtxScanPhaseRasterize, /* rendering a vector page at the requested resolution */
+   DmtxScanPhaseExport,    /* copying page pixels out of ImageMagick */
+   DmtxScanPhaseSearch,    /* looking for the next barcode region */
+   DmtxScanPhaseDecode     /* decoding a located region */
+} DmtxScanPhase;
+
+/**
+ * Scan options, matching the dmtxread command line options of the same
+ * name. Region strings take the form "N" (pixels) or "N%" (of extent).
+ */
+typedef struct DmtxScanOptions_struct {
+   int edgeMin;            /* smallest expected edge, or DmtxUndefined */
+   int edgeMax;            /* largest expected edge, or DmtxUndefined */
+   int scanGap;            /* pixels between scan grid lines */
+   int timeoutMS;          /* region search time per page, or DmtxUndefined */
+   int page;               /* only scan this page (1-based), or DmtxUndefined */
+   int squareDevn;         /* allowed non-squareness in degrees, or DmtxUndefined */
+   int dpi;                /* resolution for vector images, or DmtxUndefined */
+   int sizeIdxExpected;    /* symbol size index or shape */
+   int edgeThresh;         /* minimum edge strength (1-100) */
+   char *xMin;             /* left scan limit, or NULL */
+   char *xMax;             /* right scan limit, or NULL */
+   char *yMin;             /* bottom scan limit, or NULL */
+   char *yMax;             /* top scan limit, or NULL */
+   int correctionsMax;     /* error correction limit, or DmtxUndefined */
+   int mosaic;             /* interpret regions as Data Mosaic */
+   int stopAfter;          /* stop session after N symbols, or DmtxUndefined */
+   int shrinkMin;          /* internal shrink factor */
+   int shrinkMax;          /* largest shrink factor (reserved) */
+   int gs1;                /* FNC1 substitute character, or DmtxUndefined */
+   int deadlineMS;         /* time limit for a whole source, or DmtxUndefined */
+   size_t memoryLimit;     /* byte budget for scanning one source, or 0 for none */
+   int stream;             /* always scan in bands, reading PNM files incrementally */
+   int bandHeight;         /* rows per band, or DmtxUndefined to choose automatically */
+   int nativeFax;          /* decode CCITT fax TIFF files without ImageMagick */
+   int nativePdf;          /* decode PDF page images instead of rendering pages */
+   int locateDpi;          /* first-pass resolution for vector pages, or DmtxUndefined */
+} DmtxScanOptions;
+
+/**
+ * Decoded symbol handed to the symbol callback. Pointers are owned by
+ * the session and only valid for the duration of the callback.
+ */
+typedef struct DmtxScanResult_struct {
+   const char *source;     /* file path or blob label, "archive:member" for archives */
+   const char *member;     /* member name within an archive, or NULL */
+   int pageIndex;          /* 0-based page within source */
+   int width;              /* page width in pixels */
+   int height;             /* page height in pixels */
+   DmtxDecode *dec;
+   DmtxRegion *reg;
+   DmtxMessage *msg;
+   DmtxVector2 corner[4];  /* fit2raw corners (0,0) (1,0) (1,1) (0,1) */
+   int rotation;           /* rotation angle in degrees (0-359) */
+   long elapsedMS;         /* time from the start of the source to this symbol */
+} DmtxScanResult;
+
+/**
+ * Completed page handed to the page callback. Pages too large for the
+ * memory limit are scanned in overlapping horizontal bands; those report
+ * the band count and no decoder. Fax pages with too little ink to hold
+ * a symbol are reported as blank without being scanned.
+ */
+typedef struct DmtxScanPage_struct {
+   const char *source;
+   int pageIndex;
+   int width;
+   int height;
+   int symbolCount;        /* symbols decoded on this page */
+   int bandCount;          /* 1 unless the page was scanned in bands */
+   DmtxDecode *dec;        /* whole-page decoder, or NULL if scanned in bands */
+   int blank;              /* skipped as blank, with no bands and no decoder */
+} DmtxScanPage;
+
+typedef DmtxPassFail (*DmtxScanSymbolCallback)(DmtxScanResult *result, void *userData);
+typedef DmtxPassFail (*DmtxScanPageCallback)(DmtxScanPage *page, void *userData);
+
+/* Asked before loading a source; return only once bytes may be used */
+typedef DmtxPassFail (*DmtxScanReserveCallback)(size_t bytes, void *userData);
+
+typedef struct DmtxScan_struct DmtxScan;
+
+/* Process-wide setup, call once before and after all sessions */
+extern DmtxPassFail dmtxScanGenesis(void);
+extern void dmtxScanTerminus(void);
+
+/* Session lifecycle */
+extern DmtxScanOptions dmtxScanOptionsDefault(void);
+extern DmtxScan *dmtxScanCreate(const DmtxScanOptions *opt);
+extern DmtxPassFail dmtxScanDestroy(DmtxScan **scan);
+extern void dmtxScanSetCallbacks(DmtxScan *scan, DmtxScanSymbolCallback symbolFunc,
+      DmtxScanPageCallback pageFunc, void *userData);
+extern void dmtxScanSetReserveCallback(DmtxScan *scan, DmtxScanReserveCallback reserveFunc);
+extern void dmtxScanSetStopAfter(DmtxScan *scan, int stopAfter);
+
+/* Scanning entry points */
+extern DmtxScanStatus dmtxScanFile(DmtxScan *scan, const char *path);
+extern DmtxScanStatus dmtxScanBlob(DmtxScan *scan, const void *blob, size_t length,
+      const char *label);
+extern DmtxScanStatus dmtxScanPixels(DmtxScan *scan, unsigned char *pxl, int width,
+      int height, int pack, const char *label, int pageIndex);
+
+/* Session state */
+extern int dmtxScanGetSymbolCount(DmtxScan *scan);
+extern const char *dmtxScanGetError(DmtxScan *scan);
+extern const char *dmtxScanStatusString(DmtxScanStatus status);
+extern DmtxScanPhase dmtxScanGetTimeoutPhase(DmtxScan *scan);
+extern const char *dmtxScanPhaseString(DmtxScanPhase phase);
+extern DmtxPassFail dmtxScanScaleNumberString(const char *s, int extent, int *value);
+extern size_t dmtxScanEstimatePage(const DmtxScanOptions *opt, int width, int height, int pack);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
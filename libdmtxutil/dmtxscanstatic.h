@@ -0,0 +1,494 @@
+/*
+libdmtx - Data Matrix Encoding/Decoding Library
+
+Copyright (C) 2008, 2009 Mike Laughton
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+Contact: mike@dragonflylogic.com
+*/
+
+#ifndef __DMTXSCANSTATIC_H__
+#define __DMTXSCANSTATIC_H__
+
+#ifdef IM_API_7
+#include <MagickWand/MagickWand.h>
+#else
+#include <wand/magick-wand.h>
+#endif
+
+#if MagickLibVersion > 0x645
+#define MagickGetImagePixels MagickExportImagePixels
+#endif
+
+#define DMTXSCAN_ERROR_SIZE 512
+
+/* Banded scans never use bands shorter than this, or smaller overlaps */
+#define DMTXSCAN_BAND_HEIGHT_MIN 128
+#define DMTXSCAN_BAND_OVERLAP_MIN 64
+
+/* Band height for --stream when neither a height nor a memory limit is set */
+#define DMTXSCAN_BAND_HEIGHT_DEFAULT 1024
+
+/* Bytes per pixel of the RGBA pixel cache Magick keeps for each image */
+#if defined(MAGICKCORE_HDRI_ENABLE) && MAGICKCORE_HDRI_ENABLE
+#define DMTXSCAN_MAGICK_PIXEL_BYTES (4 * sizeof(float))
+#elif defined(MAGICKCORE_QUANTUM_DEPTH)
+#define DMTXSCAN_MAGICK_PIXEL_BYTES (4 * MAGICKCORE_QUANTUM_DEPTH / 8)
+#else
+#define DMTXSCAN_MAGICK_PIXEL_BYTES 8
+#endif
+
+/* Least a page must print to possibly hold the smallest (10x10) symbol */
+#define DMTXSCAN_SYMBOL_ROWS_MIN 10
+#define DMTXSCAN_SYMBOL_DARK_MIN 27
+
+/* Longest CCITT code word in bits, which sizes the run length lookup */
+#define DMTXSCAN_FAX_LOOKUP_BITS 13
+
+/* TIFF field types, tags and compression schemes read by the fax reader */
+#define DMTXSCAN_TIFF_SHORT               3
+#define DMTXSCAN_TIFF_LONG                4
+#define DMTXSCAN_TIFF_IMAGE_WIDTH       256
+#define DMTXSCAN_TIFF_IMAGE_LENGTH      257
+#define DMTXSCAN_TIFF_BITS_PER_SAMPLE   258
+#define DMTXSCAN_TIFF_COMPRESSION       259
+#define DMTXSCAN_TIFF_PHOTOMETRIC       262
+#define DMTXSCAN_TIFF_FILL_ORDER        266
+#define DMTXSCAN_TIFF_STRIP_OFFSETS     273
+#define DMTXSCAN_TIFF_ORIENTATION       274
+#define DMTXSCAN_TIFF_SAMPLES_PER_PIXEL 277
+#define DMTXSCAN_TIFF_ROWS_PER_STRIP    278
+#define DMTXSCAN_TIFF_STRIP_BYTE_COUNTS 279
+#define DMTXSCAN_TIFF_T4_OPTIONS        292
+#define DMTXSCAN_TIFF_T6_OPTIONS        293
+#define DMTXSCAN_TIFF_UNCOMPRESSED        1
+#define DMTXSCAN_TIFF_CCITT_RLE           2
+#define DMTXSCAN_TIFF_CCITT_T4            3
+#define DMTXSCAN_TIFF_CCITT_T6            4
+#define DMTXSCAN_TIFF_STRIPS_MAX    1048576
+
+/* Bounds on the PDF structure followed when looking for page images */
+#define DMTXSCAN_PDF_HEADER_SEARCH     1024
+#define DMTXSCAN_PDF_OBJECTS_MAX    1048576
+#define DMTXSCAN_PDF_DEPTH_MAX           32
+#define DMTXSCAN_PDF_INFLATE_MAX  268435456
+
+/* Two-pass scanning of vector pages: pixels wanted per module at the
+ * final resolution, highest resolution chosen automatically, and most
+ * page areas re-scanned */
+#define DMTXSCAN_LOCATE_MODULE_PIXELS     5
+#define DMTXSCAN_LOCATE_DPI_MAX        1200
+#define DMTXSCAN_LOCATE_WINDOWS_MAX      64
+
+/* Tar blocks, largest long name or pax header read, and zip end record */
+#define DMTXSCAN_TAR_BLOCK              512
+#define DMTXSCAN_TAR_NAME_MAX         65536
+#define DMTXSCAN_ZIP_END_SIZE            22
+
+#undef ISDIGIT
+#define ISDIGIT(n) (n > 47 && n < 58)
+
+/* PDF white-space and delimiter characters */
+#define ISPDFSPACE(n) (n == 0 || n == '\t' || n == '\n' || n == '\f' || n == '\r' || n == ' ')
+#define ISPDFDELIM(n) (n == '(' || n == ')' || n == '<' || n == '>' || n == '[' || \
+      n == ']' || n == '{' || n == '}' || n == '/' || n == '%')
+
+/* Symbol already reported from an earlier band of the same page */
+typedef struct {
+   unsigned long hash;
+   int length;
+   DmtxVector2 center;
+   double radius;
+} ScanSeen;
+
+typedef struct {
+   ScanSeen *seen;
+   int count;
+   int alloc;
+} ScanSeenList;
+
+/* Page area around located symbols, top-left origin, end exclusive */
+typedef struct {
+   int x0, y0;
+   int x1, y1;
+} ScanWindow;
+
+typedef enum {
+   ScanArchiveNone,
+   ScanArchiveTar,
+   ScanArchiveZip
+} ScanArchiveType;
+
+/* Tar or zip archive, either mapped whole or read a member at a time */
+typedef struct {
+   const char *path;          /* archive path, "-" for standard input */
+   const unsigned char *map;  /* whole archive in memory, or NULL */
+   void *mapBase;             /* mapping to release, or NULL */
+   FILE *fp;                  /* stream read when not in memory */
+   DmtxBoolean seekable;
+   DmtxBoolean eof;
+   size_t size;               /* archive size, or 0 for a stream */
+   size_t pos;                /* stream position */
+   const unsigned char *prefix; /* bytes read from the stream before it was recognized */
+   size_t prefixLength;
+   unsigned char *buf;        /* bytes read from the stream */
+   size_t bufAlloc;
+   unsigned char *inflated;   /* current deflated zip member */
+   size_t inflatedAlloc;
+   char *label;               /* "archive:member" */
+   size_t labelAlloc;
+   DmtxScanStatus failed;     /* last error of a skipped member */
+} ScanArchiveReader;
+
+/* Zip central directory entry */
+typedef struct {
+   int flags;
+   int method;                /* 0 stored, 8 deflated */
+   size_t compressedSize;
+   size_t size;
+   size_t localOffset;
+} ScanZipEntry;
+
+typedef struct ScanBandSource_struct ScanBandSource;
+
+/* Copies the next rowCount rows of the page into dest */
+typedef DmtxPassFail (*ScanReadRowsFunc)(ScanBandSource *src, unsigned char *dest, int rowCount);
+
+/* Supplier of page rows, read top to bottom exactly once */
+struct ScanBandSource_struct {
+   DmtxScan *scan;            /* for error messages */
+   const char *source;        /* name reported to callbacks */
+   int width;
+   int height;
+   int pack;                  /* pixel packing of the rows supplied */
+   int nextRow;               /* first row not yet read */
+   unsigned char *pxl;        /* whole page already in memory, or NULL to use readRows */
+   ScanReadRowsFunc readRows;
+   void *reader;              /* reader state */
+   size_t fixedBytes;         /* memory the reader holds outside the band buffer */
+   DmtxScanPhase phase;       /* phase reported if reading passes the deadline */
+};
+
+/* Binary PNM (P4, P5, P6) image read a row at a time */
+typedef struct {
+   FILE *fp;
+   int format;                /* '4', '5' or '6' */
+   int maxval;
+   int rawRowBytes;
+   unsigned char *raw;
+} ScanPnmReader;
+
+/* Layout of one CCITT compressed TIFF page (or PDF image) */
+typedef struct {
+   unsigned long ifdOffset;   /* file offset of the page's directory */
+   int width;
+   int height;
+   int compression;           /* DMTXSCAN_TIFF_CCITT_RLE, _T4 or _T6 */
+   long t4Options;
+   DmtxBoolean lsbFirst;      /* FillOrder 2 */
+   DmtxBoolean blackIsZero;   /* PhotometricInterpretation 1 */
+   DmtxBoolean byteAligned;   /* rows start on byte boundaries, without EOL codes */
+   int rowsPerStrip;
+   int stripCount;
+   unsigned long *stripOffsets;
+   unsigned long *stripByteCounts;
+} ScanTiffPage;
+
+/* CCITT decoder state, working one compressed strip at a time */
+typedef struct {
+   FILE *fp;
+   const unsigned char *mem;  /* file held in memory, read instead of fp */
+   size_t memLength;
+   ScanTiffPage *page;
+   int strip;                 /* strip held in data, or -1 */
+   int row;                   /* next row of the page to decode */
+   unsigned char *data;
+   size_t dataAlloc;
+   size_t length;
+   size_t bitPos;
+   DmtxBoolean broken;        /* rest of strip is corrupt and decodes as white */
+   int *cur;                  /* changing elements of the row just decoded */
+   int curCount;
+   int *ref;                  /* changing elements of the row before it */
+   int refCount;
+} ScanFaxReader;
+
+/* Code word as written in the T.4 tables */
+typedef struct {
+   const char *bits;
+   int run;
+} ScanFaxCodeDef;
+
+/* Run length lookup entry, with bits of 0 for an invalid code */
+typedef struct {
+   short run;
+   unsigned char bits;
+} ScanFaxCode;
+
+typedef enum {
+   ScanFaxModeInvalid = 0,
+   ScanFaxModePass,
+   ScanFaxModeHorizontal,
+   ScanFaxModeVertical
+} ScanFaxMode;
+
+typedef enum {
+   ScanPdfTokenEnd = 0,
+   ScanPdfTokenError,
+   ScanPdfTokenNumber,
+   ScanPdfTokenName,
+   ScanPdfTokenString,
+   ScanPdfTokenKeyword,
+   ScanPdfTokenArray,
+   ScanPdfTokenArrayEnd,
+   ScanPdfTokenDict,
+   ScanPdfTokenDictEnd,
+   ScanPdfTokenRef
+} ScanPdfTokenType;
+
+/* PDF value spanning start to end, with arrays and dictionaries whole */
+typedef struct {
+   ScanPdfTokenType type;
+   const unsigned char *start;
+   const unsigned char *end;
+   double number;
+   int objectNum;             /* for ScanPdfTokenRef */
+} ScanPdfValue;
+
+/* Where an indirect object's value starts */
+typedef struct {
+   const unsigned char *start;   /* NULL if the object is not defined */
+   const unsigned char *end;
+   size_t order;              /* file offset of the definition, so later ones win */
+} ScanPdfObject;
+
+/* PDF file held in memory with an index of its objects */
+typedef struct {
+   unsigned char *data;
+   size_t length;
+   DmtxBoolean borrowed;      /* data belongs to the caller and is not freed */
+   ScanPdfObject *objects;
+   int objectCount;
+   unsigned char **buffers;   /* decoded object streams */
+   int bufferCount;
+   int root;                  /* object number of the catalog */
+   int walkSteps;             /* page tree nodes visited, which stops cycles */
+} ScanPdfDoc;
+
+typedef enum {
+   ScanPdfPageVector = 0,     /* rendered by Magick */
+   ScanPdfPageImage,          /* JPEG or JPEG 2000 decoded by Magick */
+   ScanPdfPageFax             /* CCITT decoded natively */
+} ScanPdfPageType;
+
+/* One PDF page and, when it only draws an image, where that image is */
+typedef struct {
+   ScanPdfValue dict;
+   ScanPdfValue resources;    /* own or inherited */
+   ScanPdfPageType type;
+   int width;                 /* image size, for native pages */
+   int height;
+   int imageCount;
+   ScanPdfValue image;        /* image XObject dictionary */
+   const unsigned char *imageData;
+   size_t imageLength;
+   ScanTiffPage fax;
+   unsigned long faxOffset;
+   unsigned long faxLength;
+} ScanPdfPage;
+
+struct DmtxScan_struct {
+   DmtxScanOptions opt;
+   DmtxScanSymbolCallback symbolFunc;
+   DmtxScanPageCallback pageFunc;
+   DmtxScanReserveCallback reserveFunc;
+   void *userData;
+   int symbolCount;
+   DmtxBoolean reserved;      /* memory already reserved for the current source */
+   size_t reservedBytes;      /* bytes granted for the current source */
+   DmtxBoolean deadlineActive;
+   DmtxTime deadline;
+   DmtxTime sourceStart;      /* when work on the current source began */
+   DmtxScanPhase timeoutPhase;
+   const char *member;        /* archive member being scanned, or NULL */
+   char error[DMTXSCAN_ERROR_SIZE];
+};
+
+static char *CopyString(const char *s);
+static void SetError(DmtxScan *scan, const char *fmt, ...);
+static void SetMagickError(DmtxScan *scan, MagickWand *wand, const char *fmt, const char *arg);
+static DmtxBoolean StopReached(DmtxScan *scan);
+static void StartSource(DmtxScan *scan);
+static DmtxPassFail ReserveMemory(DmtxScan *scan, size_t bytes, const char *source);
+static DmtxPassFail GrowMemory(DmtxScan *scan, size_t bytes);
+static DmtxBoolean DeadlineExceeded(DmtxScan *scan, DmtxScanPhase phase, const char *source);
+static MagickBooleanType DeadlineMonitor(const char *text, const MagickOffsetType offset,
+      const MagickSizeType span, void *clientData);
+static DmtxScanStatus ReadWand(DmtxScan *scan, const char *path, const void *blob,
+      size_t length, const char *source, int firstPage);
+static MagickWand *OpenWand(DmtxScan *scan, const char *path, const void *blob, size_t length,
+      const char *source, int dpi, DmtxScanStatus *status);
+static DmtxScanStatus ScanWand(DmtxScan *scan, MagickWand *wand, const char *source,
+      int firstPage);
+static DmtxScanStatus ScanWandImage(DmtxScan *scan, MagickWand *wand, const char *source,
+      int pageIndex);
+static int GetWandPack(MagickWand *wand);
+static DmtxScanStatus LocateWand(DmtxScan *scan, MagickWand *wand, const char *path,
+      const void *blob, size_t length, const char *source, int firstPage);
+static DmtxBoolean IsVectorImage(MagickWand *wand);
+static DmtxScanStatus ScanVectorPage(DmtxScan *scan, MagickWand *wand, const char *path,
+      const void *blob, size_t length, const char *source, int pageIndex, int imageIndex);
+static DmtxScanStatus LocateSymbols(DmtxScan *scan, unsigned char *pxl, int width, int height,
+      const char *source, ScanWindow *windows, int *windowCount, int *dpi);
+static int AddWindow(ScanWindow *windows, int windowCount, ScanWindow *window);
+static DmtxScanStatus ScanWindows(DmtxScan *scan, MagickWand *wand, ScanWindow *windows,
+      int windowCount, double scale, const char *source, int pageIndex);
+static size_t PingFootprint(DmtxScan *scan, const char *path, const void *blob, size_t length,
+      int dpi);
+static size_t PackRowBytes(int pack, int width);
+static DmtxTime *GetSearchLimit(DmtxScan *scan, DmtxTime *timeout);
+static DmtxScanStatus ScanPage(DmtxScan *scan, unsigned char *pxl, int width, int height,
+      int pack, const char *source, int pageIndex);
+static DmtxScanStatus ScanBands(DmtxScan *scan, ScanBandSource *src, int pageIndex);
+static int GetBandHeight(DmtxScan *scan, ScanBandSource *src, int *overlap);
+static size_t GetBandRowCost(DmtxScan *scan, ScanBandSource *src);
+static DmtxPassFail ReadWandRows(ScanBandSource *src, unsigned char *dest, int rowCount);
+static DmtxPassFail ReadPackedRows(ScanBandSource *src, unsigned char *dest, int rowCount);
+static void InitPackedTable(void);
+static void UnpackRow(const unsigned char *bits, unsigned char *dest, int width);
+static DmtxScanStatus ScanBand(DmtxScan *scan, unsigned char *pxl, int pack, int bandWidth,
+      int bandHeight, int xOffset, int yOffset, DmtxScanPage *page, DmtxTime *searchLimit,
+      ScanSeenList *seen);
+static DmtxBoolean AlreadySeen(ScanSeenList *seen, DmtxScanResult *result);
+static DmtxPassFail SetDecodeOptions(DmtxScan *scan, DmtxDecode *dec, int width, int height,
+      int xOffset, int yOffset, int bandWidth, int bandHeight, DmtxBoolean *inRange);
+static void GetResultCorners(DmtxScanResult *result);
+
+/* dmtxpnm.c */
+static DmtxScanStatus ScanPnmFile(DmtxScan *scan, const char *path, DmtxBoolean *handled);
+static DmtxScanStatus ScanPnmStream(DmtxScan *scan, FILE *fp, int format, const char *source);
+static DmtxScanStatus ScanStdinBlob(DmtxScan *scan, int c0, int c1);
+static DmtxPassFail ReadPnmHeader(ScanPnmReader *pnm, int *width, int *height);
+static int ReadPnmNumber(FILE *fp);
+static DmtxPassFail ReadPnmRows(ScanBandSource *src, unsigned char *dest, int rowCount);
+static DmtxPassFail SkipPnmRows(ScanPnmReader *pnm, int rowCount);
+
+/* dmtxtiff.c */
+static void InitFaxTables(void);
+static void AddFaxCodes(ScanFaxCode *lookup, const ScanFaxCodeDef *defs);
+static DmtxScanStatus ScanTiffFile(DmtxScan *scan, const char *path, DmtxBoolean *handled);
+static DmtxScanStatus ScanTiffStream(DmtxScan *scan, FILE *fp, const char *source,
+      DmtxBoolean *handled);
+static DmtxScanStatus ScanFaxPage(DmtxScan *scan, ScanFaxReader *fax, ScanTiffPage *page,
+      const char *source, int pageIndex);
+static DmtxBoolean IsBlankFaxPage(DmtxScan *scan, ScanBandSource *src);
+static DmtxPassFail StartFaxPage(ScanFaxReader *fax, ScanTiffPage *page);
+static size_t GetFaxPageBytes(DmtxScan *scan, ScanTiffPage *page);
+static size_t GetFaxFixedBytes(ScanTiffPage *page);
+static DmtxPassFail ReadFaxRows(ScanBandSource *src, unsigned char *dest, int rowCount);
+static DmtxPassFail DecodeFaxRow(ScanFaxReader *fax);
+static DmtxPassFail DecodeFaxRow1D(ScanFaxReader *fax);
+static DmtxPassFail DecodeFaxRow2D(ScanFaxReader *fax);
+static void AddFaxChange(ScanFaxReader *fax, int pos);
+static int ReadFaxRun(ScanFaxReader *fax, int color);
+static ScanFaxMode ReadFaxMode(ScanFaxReader *fax, int *offset);
+static DmtxBoolean SkipFaxEol(ScanFaxReader *fax);
+static unsigned int PeekFaxBits(ScanFaxReader *fax, int count);
+static DmtxPassFail LoadFaxStrip(ScanFaxReader *fax, int strip);
+static DmtxPassFail ReadTiffPages(FILE *fp, ScanTiffPage **pages, int *pageCount);
+static DmtxPassFail ReadTiffPage(FILE *fp, unsigned long offset, DmtxBoolean bigEndian,
+      ScanTiffPage *page, unsigned long *nextOffset);
+static DmtxPassFail ReadTiffArray(FILE *fp, unsigned char *entry, DmtxBoolean bigEndian,
+      unsigned long **values);
+static unsigned long GetTiffValue(const unsigned char *p, int size, DmtxBoolean bigEndian);
+static void FreeTiffPages(ScanTiffPage *pages, int pageCount);
+
+/* dmtxpdf.c */
+static DmtxScanStatus ScanPdfFile(DmtxScan *scan, const char *path, DmtxBoolean *handled);
+static DmtxScanStatus ScanPdfData(DmtxScan *scan, const unsigned char *data, size_t length,
+      const char *source, DmtxBoolean *handled);
+static DmtxScanStatus ScanPdfDocument(DmtxScan *scan, ScanPdfDoc *doc, const char *path,
+      const char *source, DmtxBoolean *handled);
+static size_t GetPdfPageBytes(DmtxScan *scan, ScanPdfPage *page);
+static DmtxPassFail LoadPdf(const char *path, size_t limit, ScanPdfDoc *doc);
+static DmtxPassFail IndexPdf(ScanPdfDoc *doc);
+static void FreePdf(ScanPdfDoc *doc);
+static DmtxPassFail IndexPdfObjects(ScanPdfDoc *doc);
+static DmtxPassFail SetPdfObject(ScanPdfDoc *doc, int objectNum, const unsigned char *start,
+      const unsigned char *end, size_t order);
+static void ExpandPdfObjectStream(ScanPdfDoc *doc, int objectNum);
+static DmtxPassFail CollectPdfPages(ScanPdfDoc *doc, ScanPdfValue *node, ScanPdfValue *resources,
+      int depth, ScanPdfPage **pages, int *pageCount, int *pageAlloc);
+static void ClassifyPdfPage(ScanPdfDoc *doc, ScanPdfPage *page);
+static void ClassifyPdfImage(ScanPdfDoc *doc, ScanPdfPage *page);
+static DmtxPassFail ReadPdfContent(ScanPdfDoc *doc, ScanPdfValue *contents, unsigned char **content,
+      size_t *contentLength);
+static DmtxPassFail FindPdfPageImage(ScanPdfDoc *doc, ScanPdfPage *page, const unsigned char *content,
+      size_t contentLength, ScanPdfValue *resources, double *ctm, int depth);
+static DmtxPassFail FindPdfXObject(ScanPdfDoc *doc, ScanPdfPage *page, ScanPdfValue *resources,
+      ScanPdfValue *name, double *ctm, int depth);
+static void MultiplyPdfMatrix(double *m, const double *ctm);
+static DmtxPassFail GetPdfStream(ScanPdfDoc *doc, ScanPdfValue *dict, const unsigned char **data,
+      size_t *length);
+static DmtxPassFail DecodePdfStream(ScanPdfDoc *doc, ScanPdfValue *dict, unsigned char **out,
+      size_t *outLength);
+static DmtxPassFail InflatePdfData(const unsigned char *data, size_t length, unsigned char **out,
+      size_t *outLength);
+static DmtxPassFail GetPdfFilter(ScanPdfDoc *doc, ScanPdfValue *dict, ScanPdfValue *filter,
+      ScanPdfValue *parms);
+static DmtxPassFail GetPdfObject(ScanPdfDoc *doc, int objectNum, ScanPdfValue *value);
+static DmtxPassFail GetPdfDictValue(ScanPdfDoc *doc, ScanPdfValue *dict, const char *key,
+      ScanPdfValue *value);
+static int GetPdfDictInt(ScanPdfDoc *doc, ScanPdfValue *dict, const char *key, int defaultValue);
+static DmtxBoolean GetPdfDictBool(ScanPdfDoc *doc, ScanPdfValue *dict, const char *key);
+static DmtxBoolean PdfValueIs(ScanPdfValue *value, const char *text);
+static const unsigned char *ReadPdfValue(const unsigned char *p, const unsigned char *end,
+      ScanPdfValue *value);
+static const unsigned char *ReadPdfToken(const unsigned char *p, const unsigned char *end,
+      ScanPdfValue *token);
+static const unsigned char *FindPdfText(const unsigned char *p, const unsigned char *end,
+      const char *text);
+
+/* dmtxarchive.c */
+static DmtxScanStatus ScanArchiveFile(DmtxScan *scan, const char *path, DmtxBoolean *handled);
+static DmtxScanStatus ScanArchiveStdin(DmtxScan *scan, const unsigned char *data, size_t length,
+      DmtxBoolean complete);
+static ScanArchiveType GetArchiveType(const unsigned char *header, size_t length);
+static DmtxScanStatus ScanArchive(DmtxScan *scan, ScanArchiveReader *ar, ScanArchiveType type);
+static DmtxScanStatus ScanTarMembers(DmtxScan *scan, ScanArchiveReader *ar);
+static DmtxScanStatus ScanTarMember(DmtxScan *scan, ScanArchiveReader *ar, const unsigned char *header,
+      const char *name, size_t offset, size_t size);
+static DmtxBoolean IsTarHeader(const unsigned char *header);
+static DmtxPassFail GetTarNumber(const unsigned char *field, int width, size_t *value);
+static char *CopyTarName(const unsigned char *data, size_t length);
+static void ReadPaxHeader(const unsigned char *data, size_t length, char **path, size_t *size,
+      DmtxBoolean *hasSize);
+static DmtxScanStatus ScanZipMembers(DmtxScan *scan, ScanArchiveReader *ar);
+static void ReadZip64Extra(const unsigned char *extra, size_t length, ScanZipEntry *member);
+static DmtxScanStatus ScanZipMember(DmtxScan *scan, ScanArchiveReader *ar, const char *name,
+      ScanZipEntry *member);
+static DmtxPassFail InflateZipMember(DmtxScan *scan, ScanArchiveReader *ar, const unsigned char *data,
+      ScanZipEntry *member);
+static size_t GetZipValue(const unsigned char *p, int size);
+static DmtxPassFail GetArchiveBytes(ScanArchiveReader *ar, size_t offset, size_t length,
+      const unsigned char **data);
+static size_t ReadArchiveStream(ScanArchiveReader *ar, unsigned char *dest, size_t length);
+static DmtxPassFail StartArchiveMember(DmtxScan *scan, ScanArchiveReader *ar, const char *name);
+static DmtxScanStatus EndArchiveMember(DmtxScan *scan, ScanArchiveReader *ar, DmtxScanStatus status);
+static DmtxScanStatus ScanArchiveMember(DmtxScan *scan, ScanArchiveReader *ar, const unsigned char *data,
+      size_t length);
+
+#endif
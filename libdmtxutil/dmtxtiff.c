@@ -0,0 +1,1132 @@
+/*
+libdmtx - Data Matrix Encoding/Decoding Library
+
+Copyright (C) 2008, 2009 Mike Laughton
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+Contact: mike@dragonflylogic.com
+*/
+
+/**
+ * @file dmtxtiff.c
+ * @brief Native reader for CCITT fax TIFF images
+ *
+ * Bilevel TIFF pages compressed with Modified Huffman, T.4 (Group 3) or
+ * T.6 (Group 4) coding are decoded straight into 8bpp rows, instead of
+ * ImageMagick expanding them to a full color pixel cache. Each row is
+ * first decoded to its list of changing elements (the columns where the
+ * color flips), which is all that blank page detection needs, and only
+ * rows that are scanned are ever expanded to pixels.
+ */
+
+/* Code words from ITU-T T.4 tables 2 and 3, including extended makeup codes */
+static const ScanFaxCodeDef faxWhiteCodes[] = {
+   { "00110101",    0 }, { "000111",      1 }, { "0111",        2 }, { "1000",        3 },
+   { "1011",        4 }, { "1100",        5 }, { "1110",        6 }, { "1111",        7 },
+   { "10011",       8 }, { "10100",       9 }, { "00111",      10 }, { "01000",      11 },
+   { "001000",     12 }, { "000011",     13 }, { "110100",     14 }, { "110101",     15 },
+   { "101010",     16 }, { "101011",     17 }, { "0100111",    18 }, { "0001100",    19 },
+   { "0001000",    20 }, { "0010111",    21 }, { "0000011",    22 }, { "0000100",    23 },
+   { "0101000",    24 }, { "0101011",    25 }, { "0010011",    26 }, { "0100100",    27 },
+   { "0011000",    28 }, { "00000010",   29 }, { "00000011",   30 }, { "00011010",   31 },
+   { "00011011",   32 }, { "00010010",   33 }, { "00010011",   34 }, { "00010100",   35 },
+   { "00010101",   36 }, { "00010110",   37 }, { "00010111",   38 }, { "00101000",   39 },
+   { "00101001",   40 }, { "00101010",   41 }, { "00101011",   42 }, { "00101100",   43 },
+   { "00101101",   44 }, { "00000100",   45 }, { "00000101",   46 }, { "00001010",   47 },
+   { "00001011",   48 }, { "01010010",   49 }, { "01010011",   50 }, { "01010100",   51 },
+   { "01010101",   52 }, { "00100100",   53 }, { "00100101",   54 }, { "01011000",   55 },
+   { "01011001",   56 }, { "01011010",   57 }, { "01011011",   58 }, { "01001010",   59 },
+   { "01001011",   60 }, { "00110010",   61 }, { "00110011",   62 }, { "00110100",   63 },
+   { "11011",      64 }, { "10010",     128 }, { "010111",    192 }, { "0110111",   256 },
+   { "00110110",  320 }, { "00110111",  384 }, { "01100100",  448 }, { "01100101",  512 },
+   { "01101000",  576 }, { "01100111",  640 }, { "011001100", 704 }, { "011001101", 768 },
+   { "011010010", 832 }, { "011010011", 896 }, { "011010100", 960 }, { "011010101", 1024 },
+   { "011010110", 1088 }, { "011010111", 1152 }, { "011011000", 1216 }, { "011011001", 1280 },
+   { "011011010", 1344 }, { "011011011", 1408 }, { "010011000", 1472 }, { "010011001", 1536 },
+   { "010011010", 1600 }, { "011000",   1664 }, { "010011011", 1728 },
+   { NULL, 0 }
+};
+
+static const ScanFaxCodeDef faxBlackCodes[] = {
+   { "0000110111",    0 }, { "010",           1 }, { "11",            2 }, { "10",            3 },
+   { "011",           4 }, { "0011",          5 }, { "0010",          6 }, { "00011",         7 },
+   { "000101",        8 }, { "000100",        9 }, { "0000100",      10 }, { "0000101",      11 },
+   { "0000111",      12 }, { "00000100",     13 }, { "00000111",     14 }, { "000011000",    15 },
+   { "0000010111",   16 }, { "0000011000",   17 }, { "0000001000",   18 }, { "00001100111",  19 },
+   { "00001101000",  20 }, { "00001101100",  21 }, { "00000110111",  22 }, { "00000101000",  23 },
+   { "00000010111",  24 }, { "00000011000",  25 }, { "000011001010", 26 }, { "000011001011", 27 },
+   { "000011001100", 28 }, { "000011001101", 29 }, { "000001101000", 30 }, { "000001101001", 31 },
+   { "000001101010", 32 }, { "000001101011", 33 }, { "000011010010", 34 }, { "000011010011", 35 },
+   { "000011010100", 36 }, { "000011010101", 37 }, { "000011010110", 38 }, { "000011010111", 39 },
+   { "000001101100", 40 }, { "000001101101", 41 }, { "000011011010", 42 }, { "000011011011", 43 },
+   { "000001010100", 44 }, { "000001010101", 45 }, { "000001010110", 46 }, { "000001010111", 47 },
+   { "000001100100", 48 }, { "000001100101", 49 }, { "000001010010", 50 }, { "000001010011", 51 },
+   { "000000100100", 52 }, { "000000110111", 53 }, { "000000111000", 54 }, { "000000100111", 55 },
+   { "000000101000", 56 }, { "000001011000", 57 }, { "000001011001", 58 }, { "000000101011", 59 },
+   { "000000101100", 60 }, { "000001011010", 61 }, { "000001100110", 62 }, { "000001100111", 63 },
+   { "0000001111",     64 }, { "000011001000",  128 }, { "000011001001",  192 },
+   { "000001011011",  256 }, { "000000110011",  320 }, { "000000110100",  384 },
+   { "000000110101",  448 }, { "0000001101100", 512 }, { "0000001101101", 576 },
+   { "0000001001010", 640 }, { "0000001001011", 704 }, { "0000001001100", 768 },
+   { "0000001001101", 832 }, { "0000001110010", 896 }, { "0000001110011", 960 },
+   { "0000001110100", 1024 }, { "0000001110101", 1088 }, { "0000001110110", 1152 },
+   { "0000001110111", 1216 }, { "0000001010010", 1280 }, { "0000001010011", 1344 },
+   { "0000001010100", 1408 }, { "0000001010101", 1472 }, { "0000001011010", 1536 },
+   { "0000001011011", 1600 }, { "0000001100100", 1664 }, { "0000001100101", 1728 },
+   { NULL, 0 }
+};
+
+static const ScanFaxCodeDef faxExtendedCodes[] = {
+   { "00000001000",  1792 }, { "00000001100",  1856 }, { "00000001101",  1920 },
+   { "000000010010", 1984 }, { "000000010011", 2048 }, { "000000010100", 2112 },
+   { "000000010101", 2176 }, { "000000010110", 2240 }, { "000000010111", 2304 },
+   { "000000011100", 2368 }, { "000000011101", 2432 }, { "000000011110", 2496 },
+   { "000000011111", 2560 },
+   { NULL, 0 }
+};
+
+/* Run length lookup indexed by the next DMTXSCAN_FAX_LOOKUP_BITS bits,
+ * filled once by InitFaxTables() and read-only afterward */
+static ScanFaxCode faxLookup[2][1 << DMTXSCAN_FAX_LOOKUP_BITS];
+
+/**
+ * @brief  Build the white and black run length lookup tables
+ * @return void
+ */
+static void
+InitFaxTables(void)
+{
+   int color;
+
+   memset(faxLookup, 0x00, sizeof(faxLookup));
+
+   for(color = 0; color < 2; color++) {
+      AddFaxCodes(faxLookup[color], (color == 0) ? faxWhiteCodes : faxBlackCodes);
+      AddFaxCodes(faxLookup[color], faxExtendedCodes);
+   }
+}
+
+/**
+ * @brief  Enter every prefix of a set of code words into a lookup table
+ * @param  lookup table indexed by DMTXSCAN_FAX_LOOKUP_BITS bits
+ * @param  defs code words terminated by a NULL entry
+ * @return void
+ */
+static void
+AddFaxCodes(ScanFaxCode *lookup, const ScanFaxCodeDef *defs)
+{
+   int i, bits;
+   unsigned int code, first, last;
+
+   for(; defs->bits != NULL; defs++) {
+      bits = (int)strlen(defs->bits);
+      for(code = 0, i = 0; i < bits; i++)
+         code = (code << 1) | (unsigned int)(defs->bits[i] - '0');
+
+      first = code << (DMTXSCAN_FAX_LOOKUP_BITS - bits);
+      last = first + (1U << (DMTXSCAN_FAX_LOOKUP_BITS - bits));
+      for(code = first; code < last; code++) {
+         lookup[code].run = (short)defs->run;
+         lookup[code].bits = (unsigned char)bits;
+      }
+   }
+}
+
+/**
+ * @brief  Scan a file with the native fax decoder if it is a CCITT TIFF
+ * @param  scan session
+ * @param  path image path
+ * @param  handled set to DmtxFalse if the file should be read by Magick instead
+ * @return DmtxScanOk or error status
+ *
+ * Files are only handled here when every page is a bilevel CCITT page,
+ * so page numbering always matches what Magick would report.
+ */
+static DmtxScanStatus
+ScanTiffFile(DmtxScan *scan, const char *path, DmtxBoolean *handled)
+{
+   FILE *fp;
+   DmtxScanStatus status;
+
+   *handled = DmtxFalse;
+
+   /* Unreadable files are left to Magick, which reports the error */
+   fp = fopen(path, "rb");
+   if(fp == NULL)
+      return DmtxScanOk;
+
+   status = ScanTiffStream(scan, fp, path, handled);
+   fclose(fp);
+
+   return status;
+}
+
+/**
+ * @brief  Scan the fax pages of a TIFF file read from an open stream
+ * @param  scan session
+ * @param  fp seekable stream holding the whole file
+ * @param  source name reported to callbacks
+ * @param  handled set to DmtxFalse if the file should be read by Magick instead
+ * @return DmtxScanOk or error status
+ */
+static DmtxScanStatus
+ScanTiffStream(DmtxScan *scan, FILE *fp, const char *source, DmtxBoolean *handled)
+{
+   int pageIndex, pageCount;
+   size_t need, pageNeed;
+   ScanTiffPage *pages;
+   ScanFaxReader fax;
+   DmtxScanStatus status;
+
+   *handled = DmtxFalse;
+
+   if(ReadTiffPages(fp, &pages, &pageCount) != DmtxPass)
+      return DmtxScanOk;
+
+   *handled = DmtxTrue;
+
+   /* Reserve for the largest page scanned, never more than the limit */
+   need = 0;
+   for(pageIndex = 0; pageIndex < pageCount; pageIndex++) {
+      pageNeed = GetFaxPageBytes(scan, &pages[pageIndex]);
+      if(pageNeed > need && (scan->opt.page == DmtxUndefined || scan->opt.page - 1 == pageIndex))
+         need = pageNeed;
+   }
+
+   if(ReserveMemory(scan, need, source) != DmtxPass) {
+      FreeTiffPages(pages, pageCount);
+      return DmtxScanErrorMemory;
+   }
+
+   memset(&fax, 0x00, sizeof(ScanFaxReader));
+   fax.fp = fp;
+
+   status = DmtxScanOk;
+   for(pageIndex = 0; pageIndex < pageCount && status == DmtxScanOk; pageIndex++) {
+
+      /* If requested, only scan specific page */
+      if(scan->opt.page != DmtxUndefined && scan->opt.page - 1 != pageIndex)
+         continue;
+
+      if(StopReached(scan) == DmtxTrue)
+         break;
+
+      status = ScanFaxPage(scan, &fax, &pages[pageIndex], source, pageIndex);
+   }
+
+   free(fax.data);
+   free(fax.cur);
+   free(fax.ref);
+   FreeTiffPages(pages, pageCount);
+
+   return status;
+}
+
+/**
+ * @brief  Skip a blank fax page, or decode and scan it
+ * @param  scan session
+ * @param  fax decoder state shared by the pages of a file
+ * @param  page page layout
+ * @param  source name reported to callbacks
+ * @param  pageIndex page index reported to callbacks
+ * @return DmtxScanOk or error status
+ */
+static DmtxScanStatus
+ScanFaxPage(DmtxScan *scan, ScanFaxReader *fax, ScanTiffPage *page, const char *source,
+      int pageIndex)
+{
+   unsigned char *pxl;
+   DmtxPassFail err;
+   DmtxScanStatus status;
+   DmtxScanPage blankPage;
+   ScanBandSource src;
+
+   if(StartFaxPage(fax, page) != DmtxPass) {
+      SetError(scan, "malloc() error");
+      return DmtxScanErrorMemory;
+   }
+
+   memset(&src, 0x00, sizeof(ScanBandSource));
+   src.scan = scan;
+   src.source = source;
+   src.width = page->width;
+   src.height = page->height;
+   src.pack = DmtxPack8bppK;
+   src.readRows = ReadFaxRows;
+   src.reader = fax;
+   src.fixedBytes = GetFaxFixedBytes(page);
+   src.phase = DmtxScanPhaseLoad;
+
+   if(IsBlankFaxPage(scan, &src) == DmtxTrue) {
+      if(DeadlineExceeded(scan, DmtxScanPhaseLoad, source) == DmtxTrue)
+         return DmtxScanErrorDeadline;
+
+      memset(&blankPage, 0x00, sizeof(DmtxScanPage));
+      blankPage.source = source;
+      blankPage.pageIndex = pageIndex;
+      blankPage.width = page->width;
+      blankPage.height = page->height;
+      blankPage.blank = DmtxTrue;
+
+      if(scan->pageFunc != NULL && (*scan->pageFunc)(&blankPage, scan->userData) != DmtxPass) {
+         SetError(scan, "Page callback failed");
+         return DmtxScanErrorCallback;
+      }
+      return DmtxScanOk;
+   }
+
+   /* Decode again from the top, this time into pixels */
+   StartFaxPage(fax, page);
+
+   if(scan->opt.stream == DmtxTrue || (scan->opt.memoryLimit != 0 &&
+         GetFaxPageBytes(scan, page) > scan->opt.memoryLimit))
+      return ScanBands(scan, &src, pageIndex);
+
+   pxl = (unsigned char *)malloc((size_t)page->width * page->height);
+   if(pxl == NULL) {
+      SetError(scan, "malloc() error");
+      return DmtxScanErrorMemory;
+   }
+
+   err = ReadFaxRows(&src, pxl, page->height);
+   if(DeadlineExceeded(scan, DmtxScanPhaseLoad, source) == DmtxTrue) {
+      free(pxl);
+      return DmtxScanErrorDeadline;
+   }
+   else if(err != DmtxPass) {
+      free(pxl);
+      return DmtxScanErrorRead;
+   }
+
+   status = ScanPage(scan, pxl, page->width, page->height, DmtxPack8bppK, source, pageIndex);
+   free(pxl);
+
+   return status;
+}
+
+/**
+ * @brief  Decide from run lengths alone whether a page is too empty to hold a symbol
+ * @param  scan session
+ * @param  src band source reading from a ScanFaxReader at the top of its page
+ * @return DmtxTrue if the page can be skipped
+ *
+ * The smallest Data Matrix (10x10) prints at least 27 dark modules over
+ * 10 rows, and a symbol of edge E crosses at least E rows. A page with
+ * less ink than that cannot hold a symbol. Decoding stops as soon as
+ * both limits are passed, so pages with content pay for only a few rows.
+ */
+static DmtxBoolean
+IsBlankFaxPage(DmtxScan *scan, ScanBandSource *src)
+{
+   int i, row;
+   int rowsMin;
+   int rowsDark;
+   int rowDark;
+   long darkPixels;
+   ScanFaxReader *fax = (ScanFaxReader *)src->reader;
+
+   rowsMin = DMTXSCAN_SYMBOL_ROWS_MIN;
+   if(scan->opt.edgeMin != DmtxUndefined && scan->opt.edgeMin > rowsMin)
+      rowsMin = scan->opt.edgeMin;
+
+   darkPixels = 0;
+   rowsDark = 0;
+   for(row = 0; row < src->height; row++) {
+      if(row % 256 == 0 && DeadlineExceeded(scan, DmtxScanPhaseLoad, src->source) == DmtxTrue)
+         return DmtxTrue;
+
+      if(DecodeFaxRow(fax) != DmtxPass)
+         return DmtxFalse;
+
+      /* Odd spans are black in the coding, which may be the light color */
+      for(rowDark = 0, i = 0; i < fax->curCount; i += 2)
+         rowDark += fax->cur[i + 1] - fax->cur[i];
+      if(fax->page->blackIsZero == DmtxTrue)
+         rowDark = src->width - rowDark;
+
+      if(rowDark > 0) {
+         darkPixels += rowDark;
+         rowsDark++;
+         if(rowsDark >= rowsMin && darkPixels >= DMTXSCAN_SYMBOL_DARK_MIN)
+            return DmtxFalse;
+      }
+   }
+
+   return DmtxTrue;
+}
+
+/**
+ * @brief  Rewind the decoder to the first row of a page
+ * @param  fax decoder state
+ * @param  page page layout
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+StartFaxPage(ScanFaxReader *fax, ScanTiffPage *page)
+{
+   int *cur, *ref;
+
+   /* A row never has more changing elements than pixels, plus end markers */
+   if(fax->page == NULL || fax->page->width < page->width) {
+      cur = (int *)realloc(fax->cur, (page->width + 3) * sizeof(int));
+      if(cur == NULL)
+         return DmtxFail;
+      fax->cur = cur;
+
+      ref = (int *)realloc(fax->ref, (page->width + 3) * sizeof(int));
+      if(ref == NULL)
+         return DmtxFail;
+      fax->ref = ref;
+   }
+
+   fax->page = page;
+   fax->strip = -1;
+   fax->row = 0;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Estimate bytes needed to decode and scan a whole fax page
+ * @param  scan session
+ * @param  page page layout
+ * @return Bytes for the decoder, the 8bpp page and the libdmtx decoder cache
+ */
+static size_t
+GetFaxPageBytes(DmtxScan *scan, ScanTiffPage *page)
+{
+   size_t shrink;
+   size_t pixels = (size_t)page->width * page->height;
+
+   shrink = (scan->opt.shrinkMin < 1) ? 1 : (size_t)scan->opt.shrinkMin;
+
+   return GetFaxFixedBytes(page) + pixels + pixels / (shrink * shrink);
+}
+
+/**
+ * @brief  Memory the decoder holds for a page besides its output rows
+ * @param  page page layout
+ * @return Bytes for the largest compressed strip and two rows of changing elements
+ */
+static size_t
+GetFaxFixedBytes(ScanTiffPage *page)
+{
+   int i;
+   size_t largest = 0;
+
+   for(i = 0; i < page->stripCount; i++) {
+      if(page->stripByteCounts[i] > largest)
+         largest = page->stripByteCounts[i];
+   }
+
+   return largest + 2 * (page->width + 3) * sizeof(int);
+}
+
+/**
+ * @brief  Decode the next rows of a fax page into 8bpp pixels
+ * @param  src band source reading from a ScanFaxReader
+ * @param  dest destination for rowCount rows
+ * @param  rowCount number of rows
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+ReadFaxRows(ScanBandSource *src, unsigned char *dest, int rowCount)
+{
+   int i, row;
+   unsigned char white, black;
+   ScanFaxReader *fax = (ScanFaxReader *)src->reader;
+
+   white = (fax->page->blackIsZero == DmtxTrue) ? 0 : 255;
+   black = (unsigned char)(255 - white);
+
+   for(row = 0; row < rowCount; row++) {
+      if(DecodeFaxRow(fax) != DmtxPass) {
+         SetError(src->scan, "Unable to read fax data in \"%s\"", src->source);
+         return DmtxFail;
+      }
+
+      memset(dest, white, src->width);
+      for(i = 0; i < fax->curCount; i += 2)
+         memset(dest + fax->cur[i], black, fax->cur[i + 1] - fax->cur[i]);
+
+      dest += src->width;
+   }
+
+   src->nextRow += rowCount;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Decode the changing elements of the next row
+ * @param  fax decoder state
+ * @return DmtxPass, or DmtxFail if a strip could not be read
+ *
+ * On return fax->cur holds fax->curCount strictly increasing columns
+ * where the color changes (the first one to black), followed by three
+ * copies of the page width. Corrupt coding is not an error: the rest of
+ * its strip decodes as white, as most fax viewers do.
+ */
+static DmtxPassFail
+DecodeFaxRow(ScanFaxReader *fax)
+{
+   int *swap;
+   int strip;
+   int width = fax->page->width;
+   DmtxBoolean twoD;
+   DmtxPassFail err;
+
+   /* Previous row becomes the reference, and strips start from white */
+   swap = fax->ref;
+   fax->ref = fax->cur;
+   fax->cur = swap;
+   fax->refCount = fax->curCount;
+
+   strip = fax->row / fax->page->rowsPerStrip;
+   if(strip != fax->strip) {
+      if(LoadFaxStrip(fax, strip) != DmtxPass)
+         return DmtxFail;
+      fax->refCount = 0;
+   }
+   fax->row++;
+
+   fax->ref[fax->refCount] = fax->ref[fax->refCount + 1] = fax->ref[fax->refCount + 2] = width;
+   fax->curCount = 0;
+
+   if(fax->broken == DmtxFalse) {
+      if(fax->page->byteAligned == DmtxTrue)
+         fax->bitPos = (fax->bitPos + 7) & ~((size_t)7);
+
+      switch(fax->page->compression) {
+         case DMTXSCAN_TIFF_CCITT_RLE:
+            err = DecodeFaxRow1D(fax);
+            break;
+         case DMTXSCAN_TIFF_CCITT_T4:
+            /* EOL is optional, but 2D coding always tags each row */
+            SkipFaxEol(fax);
+            twoD = DmtxFalse;
+            if(fax->page->t4Options & 0x01) {
+               twoD = (PeekFaxBits(fax, 1) == 0) ? DmtxTrue : DmtxFalse;
+               fax->bitPos++;
+            }
+            err = (twoD == DmtxTrue) ? DecodeFaxRow2D(fax) : DecodeFaxRow1D(fax);
+            break;
+         default:
+            err = DecodeFaxRow2D(fax);
+            break;
+      }
+
+      if(err != DmtxPass || fax->bitPos > fax->length * 8)
+         fax->broken = DmtxTrue;
+   }
+
+   fax->cur[fax->curCount] = fax->cur[fax->curCount + 1] = fax->cur[fax->curCount + 2] = width;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Decode one row of white and black runs (T.4 one-dimensional coding)
+ * @param  fax decoder state
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+DecodeFaxRow1D(ScanFaxReader *fax)
+{
+   int run, pos, color;
+   int width = fax->page->width;
+
+   for(pos = 0, color = 0; pos < width; color ^= 1) {
+      run = ReadFaxRun(fax, color);
+      if(run < 0)
+         return DmtxFail;
+      pos += run;
+      AddFaxChange(fax, pos);
+   }
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Decode one row coded against the previous row (T.4 2D and T.6 coding)
+ * @param  fax decoder state
+ * @return DmtxPass | DmtxFail
+ *
+ * a0 is the current position, and b1 the first changing element on the
+ * reference row to the right of a0 that changes to the color opposite
+ * a0. Reference elements at even indexes change to black, so the index
+ * i of b1 always has the parity of the current color.
+ */
+static DmtxPassFail
+DecodeFaxRow2D(ScanFaxReader *fax)
+{
+   int i;
+   int a0, a1, b1;
+   int color, offset;
+   int run1, run2;
+   int width = fax->page->width;
+   int *ref = fax->ref;
+   ScanFaxMode mode;
+
+   a0 = -1;
+   color = 0;
+   i = 0;
+   while(a0 < width) {
+      while(ref[i] <= a0)
+         i += 2;
+      b1 = ref[i];
+
+      mode = ReadFaxMode(fax, &offset);
+      switch(mode) {
+         case ScanFaxModePass:
+            a0 = ref[i + 1];
+            i += 2;
+            break;
+
+         case ScanFaxModeHorizontal:
+            if(a0 < 0)
+               a0 = 0;
+            run1 = ReadFaxRun(fax, color);
+            run2 = (run1 < 0) ? -1 : ReadFaxRun(fax, color ^ 1);
+            if(run2 < 0)
+               return DmtxFail;
+            AddFaxChange(fax, a0 + run1);
+            AddFaxChange(fax, a0 + run1 + run2);
+            a0 += run1 + run2;
+            break;
+
+         case ScanFaxModeVertical:
+            a1 = b1 + offset;
+            if(a1 < 0 || a1 < a0 || a1 > width)
+               return DmtxFail;
+            AddFaxChange(fax, a1);
+            a0 = a1;
+            color ^= 1;
+            i = (i > 0) ? i - 1 : 1;
+            break;
+
+         default:
+            /* End of facsimile block, uncompressed mode, or corrupt data */
+            return DmtxFail;
+      }
+   }
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Append a changing element to the row being decoded
+ * @param  fax decoder state
+ * @param  pos column where the color changes
+ * @return void
+ *
+ * A zero length run makes two changes at the same column, which cancel.
+ */
+static void
+AddFaxChange(ScanFaxReader *fax, int pos)
+{
+   if(pos >= fax->page->width)
+      return;
+
+   if(fax->curCount > 0 && fax->cur[fax->curCount - 1] == pos)
+      fax->curCount--;
+   else
+      fax->cur[fax->curCount++] = pos;
+}
+
+/**
+ * @brief  Read makeup and terminating codes for one run
+ * @param  fax decoder state
+ * @param  color 0 for a white run, 1 for black
+ * @return Run length, or -1 for an invalid code
+ */
+static int
+ReadFaxRun(ScanFaxReader *fax, int color)
+{
+   int total;
+   ScanFaxCode *code;
+
+   for(total = 0; total <= fax->page->width; ) {
+      code = &faxLookup[color][PeekFaxBits(fax, DMTXSCAN_FAX_LOOKUP_BITS)];
+      if(code->bits == 0)
+         return -1;
+
+      fax->bitPos += code->bits;
+      total += code->run;
+
+      /* Terminating codes end the run, makeup codes continue it */
+      if(code->run < 64)
+         return total;
+   }
+
+   return -1;
+}
+
+/**
+ * @brief  Read a two-dimensional coding mode
+ * @param  fax decoder state
+ * @param  offset pointer to a1 - b1 for vertical modes
+ * @return ScanFaxModePass, ScanFaxModeHorizontal, ScanFaxModeVertical
+ *         or ScanFaxModeInvalid
+ */
+static ScanFaxMode
+ReadFaxMode(ScanFaxReader *fax, int *offset)
+{
+   unsigned int bits;
+
+   bits = PeekFaxBits(fax, 7);
+
+   /* V0 1, VR1 011, VL1 010, H 001, P 0001 */
+   if(bits & 0x40) {
+      fax->bitPos += 1;
+      *offset = 0;
+      return ScanFaxModeVertical;
+   }
+   else if(bits & 0x20) {
+      fax->bitPos += 3;
+      *offset = (bits & 0x10) ? 1 : -1;
+      return ScanFaxModeVertical;
+   }
+   else if(bits & 0x10) {
+      fax->bitPos += 3;
+      return ScanFaxModeHorizontal;
+   }
+   else if(bits & 0x08) {
+      fax->bitPos += 4;
+      return ScanFaxModePass;
+   }
+
+   /* VR2 000011, VL2 000010, VR3 0000011, VL3 0000010 */
+   if(bits & 0x04) {
+      fax->bitPos += 6;
+      *offset = (bits & 0x02) ? 2 : -2;
+      return ScanFaxModeVertical;
+   }
+   else if(bits & 0x02) {
+      fax->bitPos += 7;
+      *offset = (bits & 0x01) ? 3 : -3;
+      return ScanFaxModeVertical;
+   }
+
+   return ScanFaxModeInvalid;
+}
+
+/**
+ * @brief  Consume an end of line code and any fill bits before it
+ * @param  fax decoder state
+ * @return DmtxTrue if an EOL was found, DmtxFalse (and nothing consumed) if not
+ */
+static DmtxBoolean
+SkipFaxEol(ScanFaxReader *fax)
+{
+   int zeros;
+   size_t start = fax->bitPos;
+
+   for(zeros = 0; fax->bitPos < fax->length * 8 && PeekFaxBits(fax, 1) == 0; zeros++)
+      fax->bitPos++;
+
+   /* No code word other than EOL has 11 leading zeros */
+   if(zeros >= 11 && PeekFaxBits(fax, 1) == 1) {
+      fax->bitPos++;
+      return DmtxTrue;
+   }
+
+   fax->bitPos = start;
+
+   return DmtxFalse;
+}
+
+/**
+ * @brief  Look at upcoming bits without consuming them
+ * @param  fax decoder state
+ * @param  count number of bits (1 to 17)
+ * @return Next count bits, most significant first, padded with zeros past the end
+ */
+static unsigned int
+PeekFaxBits(ScanFaxReader *fax, int count)
+{
+   int i;
+   size_t byte;
+   unsigned long window;
+
+   byte = fax->bitPos >> 3;
+   for(window = 0, i = 0; i < 3; i++)
+      window = (window << 8) | ((byte + i < fax->length) ? fax->data[byte + i] : 0);
+
+   return (unsigned int)(window >> (24 - (int)(fax->bitPos & 0x07) - count)) &
+         ((1U << count) - 1);
+}
+
+/**
+ * @brief  Read a compressed strip into memory
+ * @param  fax decoder state
+ * @param  strip strip index within the page
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+LoadFaxStrip(ScanFaxReader *fax, int strip)
+{
+   int i, j;
+   unsigned char c, r;
+   unsigned char *data;
+   size_t length;
+
+   length = fax->page->stripByteCounts[strip];
+   if(length > fax->dataAlloc) {
+      data = (unsigned char *)realloc(fax->data, length);
+      if(data == NULL)
+         return DmtxFail;
+      fax->data = data;
+      fax->dataAlloc = length;
+   }
+
+   /* Strips of a file already held in memory are copied, not read */
+   if(fax->mem != NULL) {
+      if(fax->page->stripOffsets[strip] > fax->memLength ||
+            length > fax->memLength - fax->page->stripOffsets[strip])
+         return DmtxFail;
+      memcpy(fax->data, fax->mem + fax->page->stripOffsets[strip], length);
+   }
+   else if(fseek(fax->fp, (long)fax->page->stripOffsets[strip], SEEK_SET) != 0 ||
+         fread(fax->data, 1, length, fax->fp) != length) {
+      return DmtxFail;
+   }
+
+   /* FillOrder 2 packs the first bit in the least significant position */
+   if(fax->page->lsbFirst == DmtxTrue) {
+      for(i = 0; i < (int)length; i++) {
+         for(c = fax->data[i], r = 0, j = 0; j < 8; j++, c >>= 1)
+            r = (unsigned char)((r << 1) | (c & 0x01));
+         fax->data[i] = r;
+      }
+   }
+
+   fax->strip = strip;
+   fax->length = length;
+   fax->bitPos = 0;
+   fax->broken = DmtxFalse;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Read the layout of every page of a TIFF file
+ * @param  fp open file
+ * @param  pages pointer to new array of page layouts
+ * @param  pageCount pointer to page count
+ * @return DmtxPass if every page can be decoded natively, otherwise DmtxFail
+ */
+static DmtxPassFail
+ReadTiffPages(FILE *fp, ScanTiffPage **pages, int *pageCount)
+{
+   int i, count;
+   unsigned char header[8];
+   unsigned long offset;
+   DmtxBoolean bigEndian;
+   ScanTiffPage *newPages;
+
+   *pages = NULL;
+   *pageCount = 0;
+
+   if(fread(header, 1, 8, fp) != 8)
+      return DmtxFail;
+
+   if(header[0] == 'I' && header[1] == 'I')
+      bigEndian = DmtxFalse;
+   else if(header[0] == 'M' && header[1] == 'M')
+      bigEndian = DmtxTrue;
+   else
+      return DmtxFail;
+
+   if(GetTiffValue(header + 2, 2, bigEndian) != 42)
+      return DmtxFail;
+
+   offset = GetTiffValue(header + 4, 4, bigEndian);
+   for(count = 0; offset != 0; count++) {
+
+      /* Directories that loop back are left to Magick */
+      for(i = 0; i < count; i++) {
+         if((*pages)[i].ifdOffset == offset)
+            break;
+      }
+
+      newPages = (i < count) ? NULL :
+            (ScanTiffPage *)realloc(*pages, (count + 1) * sizeof(ScanTiffPage));
+      if(newPages == NULL) {
+         FreeTiffPages(*pages, count);
+         *pages = NULL;
+         return DmtxFail;
+      }
+      *pages = newPages;
+
+      if(ReadTiffPage(fp, offset, bigEndian, &(*pages)[count], &offset) != DmtxPass) {
+         FreeTiffPages(*pages, count + 1);
+         *pages = NULL;
+         return DmtxFail;
+      }
+   }
+
+   *pageCount = count;
+
+   return (count > 0) ? DmtxPass : DmtxFail;
+}
+
+/**
+ * @brief  Read one image file directory
+ * @param  fp open file
+ * @param  offset file offset of the directory
+ * @param  bigEndian byte order of the file
+ * @param  page layout to fill
+ * @param  nextOffset pointer to offset of the next directory (0 at the end)
+ * @return DmtxPass if the page can be decoded natively, otherwise DmtxFail
+ */
+static DmtxPassFail
+ReadTiffPage(FILE *fp, unsigned long offset, DmtxBoolean bigEndian, ScanTiffPage *page,
+      unsigned long *nextOffset)
+{
+   int i, entryCount;
+   int tag, type;
+   int stripCount;
+   unsigned long count, value;
+   unsigned long rowsPerStrip;
+   unsigned long offsetCount, byteCountCount;
+   unsigned char buf[12];
+   unsigned char *entry, *entries;
+   long photometric, fillOrder, bitsPerSample, samplesPerPixel, orientation, t6Options;
+   DmtxPassFail err;
+
+   memset(page, 0x00, sizeof(ScanTiffPage));
+   page->ifdOffset = offset;
+   page->compression = DMTXSCAN_TIFF_UNCOMPRESSED;
+
+   if(fseek(fp, (long)offset, SEEK_SET) != 0 || fread(buf, 1, 2, fp) != 2)
+      return DmtxFail;
+
+   entryCount = (int)GetTiffValue(buf, 2, bigEndian);
+   entries = (unsigned char *)malloc(entryCount * 12 + 4);
+   if(entries == NULL)
+      return DmtxFail;
+
+   if(fread(entries, 1, entryCount * 12 + 4, fp) != (size_t)(entryCount * 12 + 4)) {
+      free(entries);
+      return DmtxFail;
+   }
+   *nextOffset = GetTiffValue(entries + entryCount * 12, 4, bigEndian);
+
+   photometric = fillOrder = bitsPerSample = samplesPerPixel = orientation = -1;
+   t6Options = 0;
+   rowsPerStrip = 0xffffffffUL;
+   offsetCount = byteCountCount = 0;
+
+   err = DmtxPass;
+   for(i = 0; i < entryCount && err == DmtxPass; i++) {
+      entry = entries + i * 12;
+      tag = (int)GetTiffValue(entry, 2, bigEndian);
+      type = (int)GetTiffValue(entry + 2, 2, bigEndian);
+      count = GetTiffValue(entry + 4, 4, bigEndian);
+
+      /* First value of a SHORT or LONG field */
+      if(type == DMTXSCAN_TIFF_SHORT)
+         value = GetTiffValue(entry + 8, 2, bigEndian);
+      else if(type == DMTXSCAN_TIFF_LONG)
+         value = GetTiffValue(entry + 8, 4, bigEndian);
+      else
+         value = 0;
+
+      switch(tag) {
+         case DMTXSCAN_TIFF_IMAGE_WIDTH:
+            page->width = (int)value;
+            break;
+         case DMTXSCAN_TIFF_IMAGE_LENGTH:
+            page->height = (int)value;
+            break;
+         case DMTXSCAN_TIFF_BITS_PER_SAMPLE:
+            bitsPerSample = (long)value;
+            break;
+         case DMTXSCAN_TIFF_COMPRESSION:
+            page->compression = (int)value;
+            break;
+         case DMTXSCAN_TIFF_PHOTOMETRIC:
+            photometric = (long)value;
+            break;
+         case DMTXSCAN_TIFF_FILL_ORDER:
+            fillOrder = (long)value;
+            break;
+         case DMTXSCAN_TIFF_STRIP_OFFSETS:
+            offsetCount = count;
+            err = ReadTiffArray(fp, entry, bigEndian, &page->stripOffsets);
+            break;
+         case DMTXSCAN_TIFF_ORIENTATION:
+            orientation = (long)value;
+            break;
+         case DMTXSCAN_TIFF_SAMPLES_PER_PIXEL:
+            samplesPerPixel = (long)value;
+            break;
+         case DMTXSCAN_TIFF_ROWS_PER_STRIP:
+            rowsPerStrip = value;
+            break;
+         case DMTXSCAN_TIFF_STRIP_BYTE_COUNTS:
+            byteCountCount = count;
+            err = ReadTiffArray(fp, entry, bigEndian, &page->stripByteCounts);
+            break;
+         case DMTXSCAN_TIFF_T4_OPTIONS:
+            page->t4Options = (long)value;
+            break;
+         case DMTXSCAN_TIFF_T6_OPTIONS:
+            t6Options = (long)value;
+            break;
+         default:
+            break;
+      }
+   }
+   free(entries);
+
+   if(err != DmtxPass || page->width < 1 || page->height < 1)
+      return DmtxFail;
+
+   /* Bilevel CCITT pages in normal orientation, without uncompressed mode */
+   if(page->compression != DMTXSCAN_TIFF_CCITT_RLE &&
+         page->compression != DMTXSCAN_TIFF_CCITT_T4 &&
+         page->compression != DMTXSCAN_TIFF_CCITT_T6)
+      return DmtxFail;
+
+   if((bitsPerSample != -1 && bitsPerSample != 1) ||
+         (samplesPerPixel != -1 && samplesPerPixel != 1) ||
+         (orientation != -1 && orientation != 1) ||
+         (photometric != -1 && photometric != 0 && photometric != 1) ||
+         (fillOrder != -1 && fillOrder != 1 && fillOrder != 2) ||
+         (page->t4Options & 0x02) || (t6Options & 0x02))
+      return DmtxFail;
+
+   page->blackIsZero = (photometric == 1) ? DmtxTrue : DmtxFalse;
+   page->byteAligned = (page->compression == DMTXSCAN_TIFF_CCITT_RLE) ? DmtxTrue : DmtxFalse;
+   page->lsbFirst = (fillOrder == 2) ? DmtxTrue : DmtxFalse;
+   page->rowsPerStrip = (rowsPerStrip == 0 || rowsPerStrip > (unsigned long)page->height) ?
+         page->height : (int)rowsPerStrip;
+
+   stripCount = (page->height + page->rowsPerStrip - 1) / page->rowsPerStrip;
+   if(page->stripOffsets == NULL || page->stripByteCounts == NULL ||
+         offsetCount < (unsigned long)stripCount || byteCountCount < (unsigned long)stripCount)
+      return DmtxFail;
+   page->stripCount = stripCount;
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Read all values of a SHORT or LONG directory entry
+ * @param  fp open file
+ * @param  entry 12 byte directory entry
+ * @param  bigEndian byte order of the file
+ * @param  values pointer to new array of values
+ * @return DmtxPass | DmtxFail
+ */
+static DmtxPassFail
+ReadTiffArray(FILE *fp, unsigned char *entry, DmtxBoolean bigEndian, unsigned long **values)
+{
+   int size;
+   unsigned long i, count;
+   unsigned char *raw, *p;
+
+   switch(GetTiffValue(entry + 2, 2, bigEndian)) {
+      case DMTXSCAN_TIFF_SHORT:
+         size = 2;
+         break;
+      case DMTXSCAN_TIFF_LONG:
+         size = 4;
+         break;
+      default:
+         return DmtxFail;
+   }
+
+   count = GetTiffValue(entry + 4, 4, bigEndian);
+   if(count == 0 || count > DMTXSCAN_TIFF_STRIPS_MAX || *values != NULL)
+      return DmtxFail;
+
+   *values = (unsigned long *)malloc(count * sizeof(unsigned long));
+   if(*values == NULL)
+      return DmtxFail;
+
+   /* Values that fit in 4 bytes are stored in the entry itself */
+   raw = NULL;
+   if(count * size <= 4) {
+      p = entry + 8;
+   }
+   else {
+      raw = (unsigned char *)malloc(count * size);
+      if(raw == NULL)
+         return DmtxFail;
+
+      if(fseek(fp, (long)GetTiffValue(entry + 8, 4, bigEndian), SEEK_SET) != 0 ||
+            fread(raw, size, count, fp) != count) {
+         free(raw);
+         return DmtxFail;
+      }
+      p = raw;
+   }
+
+   for(i = 0; i < count; i++)
+      (*values)[i] = GetTiffValue(p + i * size, size, bigEndian);
+
+   free(raw);
+
+   return DmtxPass;
+}
+
+/**
+ * @brief  Decode an unsigned TIFF integer
+ * @param  p first byte
+ * @param  size 2 or 4 bytes
+ * @param  bigEndian byte order of the file
+ * @return Value
+ */
+static unsigned long
+GetTiffValue(const unsigned char *p, int size, DmtxBoolean bigEndian)
+{
+   int i;
+   unsigned long value = 0;
+
+   for(i = 0; i < size; i++) {
+      if(bigEndian == DmtxTrue)
+         value = (value << 8) | p[i];
+      else
+         value |= (unsigned long)p[i] << (8 * i);
+   }
+
+   return value;
+}
+
+/**
+ * @brief  Free page layouts
+ * @param  pages array of page layouts (may be NULL)
+ * @param  pageCount number of entries
+ * @return void
+ */
+static void
+FreeTiffPages(ScanTiffPage *pages, int pageCount)
+{
+   int i;
+
+   if(pages == NULL)
+      return;
+
+   for(i = 0; i < pageCount; i++) {
+      free(pages[i].stripOffsets);
+      free(pages[i].stripByteCounts);
+   }
+
+   free(pages);
+}